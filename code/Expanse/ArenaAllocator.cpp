@@ -0,0 +1,175 @@
+#include "ArenaAllocator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace expanse
+{
+	ArenaAllocator::Mark::Mark()
+		: m_block(nullptr)
+		, m_offset(0)
+	{
+	}
+
+	ArenaAllocator::ArenaAllocator(IAllocator *backingAlloc, size_t blockSize)
+		: m_backingAlloc(backingAlloc)
+		, m_blockSize(blockSize)
+		, m_firstBlock(nullptr)
+		, m_currentBlock(nullptr)
+		, m_currentOffset(0)
+		, m_lastAllocation(nullptr)
+		, m_lastAllocationSize(0)
+	{
+	}
+
+	ArenaAllocator::~ArenaAllocator()
+	{
+		Block *block = m_firstBlock;
+		while (block != nullptr)
+		{
+			Block *nextBlock = block->m_next;
+			m_backingAlloc->Release(block);
+			block = nextBlock;
+		}
+	}
+
+	void *ArenaAllocator::Alloc(size_t size, size_t alignment)
+	{
+		if (size == 0)
+			return nullptr;
+
+		size_t startOffset = 0;
+
+		if (m_currentBlock == nullptr || !TryFitInBlock(m_currentBlock, m_currentOffset, size, alignment, startOffset))
+		{
+			// Blocks after the current one are free, skip any that are too small rather than giving them up
+			Block *block = (m_currentBlock != nullptr) ? m_currentBlock->m_next : m_firstBlock;
+			while (block != nullptr && !TryFitInBlock(block, 0, size, alignment, startOffset))
+				block = block->m_next;
+
+			if (block == nullptr)
+			{
+				if (size > std::numeric_limits<size_t>::max() - alignment)
+					return nullptr;
+
+				block = AddBlockAfterCurrent(size + alignment);
+				if (block == nullptr)
+					return nullptr;
+
+				if (!TryFitInBlock(block, 0, size, alignment, startOffset))
+					return nullptr;
+			}
+
+			m_currentBlock = block;
+		}
+
+		void *mem = GetBlockData(m_currentBlock) + startOffset;
+
+		m_currentOffset = startOffset + size;
+		m_lastAllocation = mem;
+		m_lastAllocationSize = size;
+
+		return mem;
+	}
+
+	void ArenaAllocator::Release(void *ptr)
+	{
+	}
+
+	void *ArenaAllocator::Realloc(void *ptr, size_t newSize, size_t alignment)
+	{
+		if (ptr == nullptr)
+			return this->Alloc(newSize, alignment);
+
+		if (ptr != m_lastAllocation)
+			return nullptr;
+
+		if (reinterpret_cast<uintptr_t>(ptr) % static_cast<uintptr_t>(alignment) != 0)
+			return nullptr;
+
+		// Resize in place if the block has room
+		const size_t startOffset = static_cast<size_t>(static_cast<uint8_t*>(ptr) - GetBlockData(m_currentBlock));
+		if (newSize <= m_currentBlock->m_capacity - startOffset)
+		{
+			m_currentOffset = startOffset + newSize;
+			m_lastAllocationSize = newSize;
+			return ptr;
+		}
+
+		const size_t oldSize = m_lastAllocationSize;
+
+		void *newMem = this->Alloc(newSize, alignment);
+		if (newMem == nullptr)
+			return nullptr;
+
+		memcpy(newMem, ptr, std::min(oldSize, newSize));
+
+		return newMem;
+	}
+
+	ArenaAllocator::Mark ArenaAllocator::GetMark() const
+	{
+		Mark mark;
+		mark.m_block = m_currentBlock;
+		mark.m_offset = m_currentOffset;
+
+		return mark;
+	}
+
+	void ArenaAllocator::Rewind(const Mark &mark)
+	{
+		m_currentBlock = static_cast<Block*>(mark.m_block);
+		m_currentOffset = mark.m_offset;
+		m_lastAllocation = nullptr;
+		m_lastAllocationSize = 0;
+	}
+
+	uint8_t *ArenaAllocator::GetBlockData(Block *block)
+	{
+		return reinterpret_cast<uint8_t*>(block + 1);
+	}
+
+	bool ArenaAllocator::TryFitInBlock(Block *block, size_t offset, size_t size, size_t alignment, size_t &outStartOffset)
+	{
+		const uintptr_t address = reinterpret_cast<uintptr_t>(GetBlockData(block)) + offset;
+
+		size_t padding = static_cast<size_t>(address % static_cast<uintptr_t>(alignment));
+		if (padding != 0)
+			padding = alignment - padding;
+
+		if (block->m_capacity - offset < padding || block->m_capacity - offset - padding < size)
+			return false;
+
+		outStartOffset = offset + padding;
+		return true;
+	}
+
+	ArenaAllocator::Block *ArenaAllocator::AddBlockAfterCurrent(size_t minCapacity)
+	{
+		const size_t capacity = std::max(minCapacity, m_blockSize);
+		if (capacity > std::numeric_limits<size_t>::max() - sizeof(Block))
+			return nullptr;
+
+		void *mem = m_backingAlloc->Alloc(sizeof(Block) + capacity, alignof(std::max_align_t));
+		if (mem == nullptr)
+			return nullptr;
+
+		Block *block = static_cast<Block*>(mem);
+		block->m_capacity = capacity;
+
+		// Keep the free blocks after the new one so that they are still reused
+		if (m_currentBlock != nullptr)
+		{
+			block->m_next = m_currentBlock->m_next;
+			m_currentBlock->m_next = block;
+		}
+		else
+		{
+			block->m_next = m_firstBlock;
+			m_firstBlock = block;
+		}
+
+		return block;
+	}
+}
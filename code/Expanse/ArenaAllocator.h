@@ -0,0 +1,67 @@
+#pragma once
+
+#include "IAllocator.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	// Bump allocator that carves allocations out of large blocks taken from a backing allocator.  Release does
+	// nothing, memory is only reclaimed in bulk by rewinding to a mark, which costs the same no matter how many
+	// allocations were made since.  Blocks stay with the arena after a rewind and are reused, they only go back to
+	// the backing allocator when the arena is destroyed.
+	//
+	// Anything allocated after a mark must be destroyed before rewinding to it.  Not thread-safe.
+	class ArenaAllocator final : public IAllocator
+	{
+	public:
+		struct Mark
+		{
+			Mark();
+
+		private:
+			friend class ArenaAllocator;
+
+			void *m_block;
+			size_t m_offset;
+		};
+
+		ArenaAllocator(IAllocator *backingAlloc, size_t blockSize);
+		~ArenaAllocator();
+
+		void *Alloc(size_t size, size_t alignment) override;
+		void Release(void *ptr) override;
+
+		// Only the most recent allocation can be resized, anything else fails
+		void *Realloc(void *ptr, size_t newSize, size_t alignment) override;
+
+		Mark GetMark() const;
+		void Rewind(const Mark &mark);
+
+	private:
+		struct Block
+		{
+			Block *m_next;
+			size_t m_capacity;
+		};
+
+		ArenaAllocator(const ArenaAllocator &other) = delete;
+		ArenaAllocator &operator=(const ArenaAllocator &other) = delete;
+
+		static uint8_t *GetBlockData(Block *block);
+		static bool TryFitInBlock(Block *block, size_t offset, size_t size, size_t alignment, size_t &outStartOffset);
+
+		Block *AddBlockAfterCurrent(size_t minCapacity);
+
+		IAllocator *m_backingAlloc;
+		size_t m_blockSize;
+
+		Block *m_firstBlock;
+		Block *m_currentBlock;	// Null until the first allocation, or after rewinding to the start
+		size_t m_currentOffset;
+
+		void *m_lastAllocation;
+		size_t m_lastAllocationSize;
+	};
+}
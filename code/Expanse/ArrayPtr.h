@@ -31,6 +31,9 @@ namespace expanse
 
 		T *GetBuffer() const;
 
+		// Destroys the elements past newCount, the memory isn't released until the whole array is
+		void Truncate(size_t newCount);
+
 		ArrayPtr<T> &operator=(ArrayPtr<T> &&other);
 
 	private:
@@ -135,6 +138,18 @@ namespace expanse
 		return m_elements;
 	}
 
+	template<class T>
+	void ArrayPtr<T>::Truncate(size_t newCount)
+	{
+		EXP_ASSERT(newCount <= m_size);
+
+		while (m_size > newCount)
+		{
+			m_size--;
+			m_elements[m_size].~T();
+		}
+	}
+
 	template<class T>
 	ArrayPtr<T> &ArrayPtr<T>::operator=(ArrayPtr<T> &&other)
 	{
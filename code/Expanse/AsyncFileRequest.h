@@ -1,5 +1,6 @@
 #pragma once
 
+#include "AsyncFileSystem.h"
 #include "CoreObject.h"
 #include "ErrorCode.h"
 #include "StringProto.h"
@@ -9,13 +10,22 @@
 namespace expanse
 {
 	template<class T> struct ArrayPtr;
+	class ThreadEvent;
 
 	class AsyncFileRequest : public CoreObject
 	{
 	public:
 		virtual bool IsFinished() const = 0;
+
+		// Blocks until the request finishes.  finishEvent must be an auto-reset event that isn't signalled by anything
+		// else, it's left unsignalled on return so that it can be reused for the next wait.
+		virtual void WaitForFinish(ThreadEvent *finishEvent) = 0;
+
 		virtual ErrorCode GetErrorCode() const = 0;
 		virtual ArrayPtr<uint8_t> TakeResult() = 0;
 		virtual void TakeIdentifier(UTF8String_t &outDevice, UTF8String_t &outPath) = 0;
+
+		// Moves a request that hasn't been picked up by a worker yet to a more urgent priority, does nothing otherwise
+		virtual void Promote(AsyncFileRequestPriority priority) = 0;
 	};
 }
@@ -0,0 +1,57 @@
+#include "AsyncFileRequest_Posix.h"
+
+#include "AsyncFileWorkQueue.h"
+
+namespace expanse
+{
+	AsyncFileRequest_Posix::AsyncFileRequest_Posix(AsyncFileSystem_Posix *fs)
+		: m_fs(fs)
+		, m_workItem(nullptr)
+	{
+	}
+
+	AsyncFileRequest_Posix::~AsyncFileRequest_Posix()
+	{
+		if (m_workItem != nullptr)
+			m_fs->CancelItem(m_workItem);
+	}
+
+	void AsyncFileRequest_Posix::Init(AsyncFileSystem_Posix::WorkItem *workItem)
+	{
+		m_workItem = workItem;
+	}
+
+	bool AsyncFileRequest_Posix::IsFinished() const
+	{
+		if (m_workItem == nullptr)
+			return false;
+
+		return m_workItem->IsFinished();
+	}
+
+	void AsyncFileRequest_Posix::WaitForFinish(ThreadEvent *finishEvent)
+	{
+		m_workItem->WaitForFinish(finishEvent);
+	}
+
+	ErrorCode AsyncFileRequest_Posix::GetErrorCode() const
+	{
+		return m_workItem->GetErrorCode();
+	}
+
+	ArrayPtr<uint8_t> AsyncFileRequest_Posix::TakeResult()
+	{
+		return m_workItem->TakeResult();
+	}
+
+	void AsyncFileRequest_Posix::TakeIdentifier(UTF8String_t &outDevice, UTF8String_t &outPath)
+	{
+		m_workItem->TakeIdentifier(outDevice, outPath);
+	}
+
+	void AsyncFileRequest_Posix::Promote(AsyncFileRequestPriority priority)
+	{
+		if (m_workItem != nullptr)
+			m_fs->PromoteItem(m_workItem, priority);
+	}
+}
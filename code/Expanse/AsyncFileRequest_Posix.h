@@ -0,0 +1,32 @@
+#pragma once
+
+#include "AsyncFileRequest.h"
+#include "AsyncFileSystem_Posix.h"
+
+#include "CorePtr.h"
+
+namespace expanse
+{
+	class AsyncFileSystem_Posix;
+	struct IAllocator;
+
+	class AsyncFileRequest_Posix final : public AsyncFileRequest
+	{
+	public:
+		explicit AsyncFileRequest_Posix(AsyncFileSystem_Posix *fs);
+		~AsyncFileRequest_Posix();
+
+		void Init(AsyncFileSystem_Posix::WorkItem *workItem);
+
+		bool IsFinished() const override;
+		void WaitForFinish(ThreadEvent *finishEvent) override;
+		ErrorCode GetErrorCode() const override;
+		ArrayPtr<uint8_t> TakeResult() override;
+		void TakeIdentifier(UTF8String_t &outDevice, UTF8String_t &outPath) override;
+		void Promote(AsyncFileRequestPriority priority) override;
+
+	private:
+		AsyncFileSystem_Posix *m_fs;
+		AsyncFileSystem_Posix::WorkItem *m_workItem;
+	};
+}
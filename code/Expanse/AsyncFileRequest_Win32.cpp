@@ -1,9 +1,12 @@
 #include "AsyncFileRequest_Win32.h"
 
+#include "AsyncFileWorkQueue.h"
+
 namespace expanse
 {
 	AsyncFileRequest_Win32::AsyncFileRequest_Win32(AsyncFileSystem_Win32 *fs)
 		: m_fs(fs)
+		, m_workItem(nullptr)
 	{
 	}
 
@@ -13,9 +16,9 @@ namespace expanse
 			m_fs->CancelItem(m_workItem);
 	}
 
-	void AsyncFileRequest_Win32::Init(CorePtr<AsyncFileSystem_Win32::WorkItem> &&workItem)
+	void AsyncFileRequest_Win32::Init(AsyncFileSystem_Win32::WorkItem *workItem)
 	{
-		m_workItem = std::move(workItem);
+		m_workItem = workItem;
 	}
 
 
@@ -24,22 +27,32 @@ namespace expanse
 		if (m_workItem == nullptr)
 			return false;
 
-		return m_workItem->m_finished.load(std::memory_order_acquire);
+		return m_workItem->IsFinished();
+	}
+
+	void AsyncFileRequest_Win32::WaitForFinish(ThreadEvent *finishEvent)
+	{
+		m_workItem->WaitForFinish(finishEvent);
 	}
 
 	ErrorCode AsyncFileRequest_Win32::GetErrorCode() const
 	{
-		return m_workItem->m_errorCode;
+		return m_workItem->GetErrorCode();
 	}
 
 	ArrayPtr<uint8_t> AsyncFileRequest_Win32::TakeResult()
 	{
-		return ArrayPtr<uint8_t>(std::move(m_workItem->m_result));
+		return m_workItem->TakeResult();
 	}
 
 	void AsyncFileRequest_Win32::TakeIdentifier(UTF8String_t &outDevice, UTF8String_t &outPath)
 	{
-		outDevice = std::move(m_workItem->m_id.m_device);
-		outPath = std::move(m_workItem->m_id.m_path);
+		m_workItem->TakeIdentifier(outDevice, outPath);
+	}
+
+	void AsyncFileRequest_Win32::Promote(AsyncFileRequestPriority priority)
+	{
+		if (m_workItem != nullptr)
+			m_fs->PromoteItem(m_workItem, priority);
 	}
 }
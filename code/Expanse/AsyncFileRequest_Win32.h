@@ -8,7 +8,6 @@
 namespace expanse
 {
 	class AsyncFileSystem_Win32;
-	class AsyncFileSystem_Win32_WorkItem;
 	struct IAllocator;
 
 	class AsyncFileRequest_Win32 final : public AsyncFileRequest
@@ -17,15 +16,17 @@ namespace expanse
 		explicit AsyncFileRequest_Win32(AsyncFileSystem_Win32 *fs);
 		~AsyncFileRequest_Win32();
 
-		void Init(CorePtr<AsyncFileSystem_Win32::WorkItem> &&workItem);
+		void Init(AsyncFileSystem_Win32::WorkItem *workItem);
 
 		bool IsFinished() const override;
+		void WaitForFinish(ThreadEvent *finishEvent) override;
 		ErrorCode GetErrorCode() const override;
 		ArrayPtr<uint8_t> TakeResult() override;
 		void TakeIdentifier(UTF8String_t &outDevice, UTF8String_t &outPath) override;
+		void Promote(AsyncFileRequestPriority priority) override;
 
 	private:
 		AsyncFileSystem_Win32 *m_fs;
-		CorePtr<AsyncFileSystem_Win32::WorkItem> m_workItem;
+		AsyncFileSystem_Win32::WorkItem *m_workItem;
 	};
 }
@@ -3,17 +3,34 @@
 #include "CoreObject.h"
 #include "StringProto.h"
 
+#include <cstdint>
+
 namespace expanse
 {
 	class AsyncFileRequest;
 	class AsyncFileRequestHandle;
+	template<class T> struct ArrayPtr;
 	template<class T> struct CorePtr;
 	struct Result;
 	template<class T> struct ResultRV;
 
+	enum class AsyncFileRequestPriority
+	{
+		kBlocking,		// The requester can't make progress until this finishes
+		kNormal,
+		kSpeculative,	// Prefetch that may never be used
+
+		kCount,
+	};
+
+	// Runs on the IO worker that loaded a file, before its request finishes, so it may be running on several
+	// workers at once.  Only called for files that loaded successfully.
+	typedef void (*AsyncFileContentsFilter_t)(ArrayPtr<uint8_t> &contents);
+
 	class AsyncFileSystem : public CoreObject
 	{
 	public:
-		virtual ResultRV<CorePtr<AsyncFileRequest>> Retrieve(const UTF8StringView_t &device, const UTF8StringView_t &name) = 0;
+		// contentsFilter may be null
+		virtual ResultRV<CorePtr<AsyncFileRequest>> Retrieve(const UTF8StringView_t &device, const UTF8StringView_t &name, AsyncFileRequestPriority priority, AsyncFileContentsFilter_t contentsFilter) = 0;
 	};
 }
@@ -0,0 +1,244 @@
+#include "AsyncFileSystem_Posix.h"
+
+#include "AsyncFileRequest_Posix.h"
+#include "AsyncFileWorkQueue.h"
+#include "CorePtr.h"
+#include "ExpAssert.h"
+#include "FileStream_Posix.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "SynchronousFileSystem_Posix.h"
+#include "Thread.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits>
+#include <unistd.h>
+
+// This works via a pool of IO threads fed by a lock-free priority queue.  AsyncFileRequest lifetimes must exist
+// within the async file system lifetime.
+// AsyncFileRequests and the queue share ownership of the WorkItem, cancelling a request marks the item cancelled
+// and the worker that eventually pops it drops it without loading.
+//
+// Each worker takes a batch of queued items at once, opens all of them and hints the kernel to start readahead
+// on every file before reading any of them, so the reads of a batch overlap in the page cache instead of
+// being serialized behind one another.  Regular files are always "ready" as far as epoll is concerned, so
+// the overlap comes from posix_fadvise and multiple workers issuing pread rather than from readiness polling.
+
+namespace expanse
+{
+	AsyncFileSystem_Posix::AsyncFileSystem_Posix(SynchronousFileSystem_Posix *syncFileSystem)
+		: m_syncFileSystem(syncFileSystem)
+		, m_initialized(false)
+	{
+	}
+
+	AsyncFileSystem_Posix::~AsyncFileSystem_Posix()
+	{
+		if (m_queue == nullptr)
+			return;
+
+		m_queue->Shutdown();
+
+		// Stop the IO threads and wait
+		m_ioThreads = nullptr;
+
+		m_queue->CancelAll();
+	}
+
+	Result AsyncFileSystem_Posix::Initialize(size_t numWorkerThreads)
+	{
+		IAllocator *alloc = GetCoreObjectAllocator();
+
+		if (numWorkerThreads == 0)
+			numWorkerThreads = 1;
+
+		CHECK_RV(CorePtr<AsyncFileWorkQueue>, queue, New<AsyncFileWorkQueue>(alloc));
+		CHECK(queue->Initialize(kQueueCapacityPerPriority));
+		CHECK_RV(ArrayPtr<CorePtr<Thread>>, ioThreads, NewArray<CorePtr<Thread>>(alloc, numWorkerThreads));
+
+		m_queue = std::move(queue);
+		m_ioThreads = std::move(ioThreads);
+
+		for (size_t i = 0; i < numWorkerThreads; i++)
+		{
+			CHECK_RV(CorePtr<Thread>, ioThread, Thread::CreateThread(alloc, StaticThreadFunc, this, UTF8StringView_t("AsyncFileSystem")));
+			m_ioThreads[i] = std::move(ioThread);
+		}
+
+		m_initialized = true;
+		return ErrorCode::kOK;
+	}
+
+	ResultRV<CorePtr<AsyncFileRequest>> AsyncFileSystem_Posix::Retrieve(const UTF8StringView_t &device, const UTF8StringView_t &path, AsyncFileRequestPriority priority, AsyncFileContentsFilter_t contentsFilter)
+	{
+		EXP_ASSERT(m_initialized);
+
+		IAllocator *alloc = GetCoreObjectAllocator();
+
+		CHECK_RV(CorePtr<AsyncFileRequest_Posix>, asyncRequest, New<AsyncFileRequest_Posix>(alloc, this));
+		CHECK_RV(WorkItem *, workItem, AsyncFileWorkItem::Create(alloc, device, path, contentsFilter));
+
+		asyncRequest->Init(workItem);
+		m_queue->Push(workItem, priority);
+
+		return CorePtr<AsyncFileRequest>(std::move(asyncRequest));
+	}
+
+	void AsyncFileSystem_Posix::CancelItem(WorkItem *workItem)
+	{
+		workItem->Cancel();
+		workItem->Release();
+	}
+
+	void AsyncFileSystem_Posix::PromoteItem(WorkItem *workItem, AsyncFileRequestPriority priority)
+	{
+		m_queue->Promote(workItem, priority);
+	}
+
+	int AsyncFileSystem_Posix::StaticThreadFunc(void *self)
+	{
+		return static_cast<AsyncFileSystem_Posix*>(self)->ThreadFunc();
+	}
+
+	int AsyncFileSystem_Posix::ThreadFunc()
+	{
+		AsyncFileWorkQueue *queue = m_queue;
+		PendingLoad loads[kMaxBatchSize];
+
+		for (;;)
+		{
+			if (queue->IsShuttingDown())
+			{
+				queue->WakeWorker();
+				return 0;
+			}
+
+			size_t batchSize = 0;
+			while (batchSize < kMaxBatchSize)
+			{
+				WorkItem *workItem = queue->TryPop();
+				if (workItem == nullptr)
+					break;
+
+				if (!workItem->TryBeginLoad())
+				{
+					// Cancelled while queued, or a promoted item's other entry
+					workItem->Release();
+					continue;
+				}
+
+				loads[batchSize].m_workItem = workItem;
+				batchSize++;
+			}
+
+			if (batchSize == 0)
+			{
+				queue->WaitForWork();
+				continue;
+			}
+
+			for (size_t i = 0; i < batchSize; i++)
+				BeginLoad(loads[i]);
+
+			for (size_t i = 0; i < batchSize; i++)
+			{
+				PendingLoad &load = loads[i];
+
+				FinishLoad(load);
+
+				load.m_workItem->Complete(load.m_errorCode, std::move(load.m_contents));
+				load.m_workItem->Release();
+
+				load.m_workItem = nullptr;
+				load.m_size = 0;
+				load.m_errorCode = ErrorCode::kOK;
+			}
+		}
+	}
+
+	void AsyncFileSystem_Posix::BeginLoad(PendingLoad &load)
+	{
+		Result result(BeginLoadChecked(load));
+		result.Handle();
+
+		load.m_errorCode = result.GetErrorCode();
+	}
+
+	void AsyncFileSystem_Posix::FinishLoad(PendingLoad &load)
+	{
+		if (load.m_errorCode == ErrorCode::kOK)
+		{
+			Result result(FinishLoadChecked(load));
+			result.Handle();
+
+			load.m_errorCode = result.GetErrorCode();
+		}
+
+		load.m_stream = nullptr;
+	}
+
+	Result AsyncFileSystem_Posix::BeginLoadChecked(PendingLoad &load)
+	{
+		const WorkItem *workItem = load.m_workItem;
+
+		CHECK_RV(CorePtr<FileStream_Posix>, stream, m_syncFileSystem->OpenPosix(workItem->GetDevice(), workItem->GetPath(), SynchronousFileSystem::Permission::kRead, SynchronousFileSystem::CreationDisposition::kOpenExisting));
+
+		CHECK_RV(UFilePos_t, fileSize, stream->GetSize());
+
+		if (fileSize > std::numeric_limits<size_t>::max())
+			return ErrorCode::kOutOfMemory;
+
+#if defined(POSIX_FADV_WILLNEED)
+		posix_fadvise(stream->GetFileDescriptor(), 0, static_cast<off_t>(fileSize), POSIX_FADV_WILLNEED);
+#endif
+
+		load.m_stream = std::move(stream);
+		load.m_size = fileSize;
+
+		return ErrorCode::kOK;
+	}
+
+	Result AsyncFileSystem_Posix::FinishLoadChecked(PendingLoad &load)
+	{
+		const size_t fileSize = static_cast<size_t>(load.m_size);
+		if (fileSize == 0)
+			return ErrorCode::kOK;
+
+		IAllocator *alloc = GetCoreObjectAllocator();
+
+		CHECK_RV(ArrayPtr<uint8_t>, contents, NewArrayUninitialized<uint8_t>(alloc, fileSize));
+
+		const int fd = load.m_stream->GetFileDescriptor();
+		uint8_t *buffer = contents.GetBuffer();
+		size_t amountRead = 0;
+
+		while (amountRead < fileSize)
+		{
+			const ssize_t numberRead = pread(fd, buffer + amountRead, fileSize - amountRead, static_cast<off_t>(amountRead));
+			if (numberRead < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return ErrorCode::kIOError;
+			}
+
+			// File was truncated while loading
+			if (numberRead == 0)
+				return ErrorCode::kIOError;
+
+			amountRead += static_cast<size_t>(numberRead);
+		}
+
+		load.m_contents = std::move(contents);
+
+		return ErrorCode::kOK;
+	}
+
+	AsyncFileSystem_Posix::PendingLoad::PendingLoad()
+		: m_workItem(nullptr)
+		, m_size(0)
+		, m_errorCode(ErrorCode::kOK)
+	{
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "AsyncFileSystem.h"
+#include "ArrayPtr.h"
+#include "CorePtr.h"
+#include "ErrorCode.h"
+#include "FileStream.h"
+#include "XString.h"
+
+#include <cstddef>
+
+namespace expanse
+{
+	class AsyncFileRequest_Posix;
+	class AsyncFileWorkItem;
+	class AsyncFileWorkQueue;
+	class FileStream_Posix;
+	class SynchronousFileSystem_Posix;
+	class Thread;
+	struct IAllocator;
+
+	class AsyncFileSystem_Posix final : public AsyncFileSystem
+	{
+	public:
+		explicit AsyncFileSystem_Posix(SynchronousFileSystem_Posix *syncFileSystem);
+		~AsyncFileSystem_Posix();
+
+		Result Initialize(size_t numWorkerThreads);
+		ResultRV<CorePtr<AsyncFileRequest>> Retrieve(const UTF8StringView_t &device, const UTF8StringView_t &path, AsyncFileRequestPriority priority, AsyncFileContentsFilter_t contentsFilter) override;
+
+		typedef AsyncFileWorkItem WorkItem;
+
+		void CancelItem(WorkItem *workItem);
+		void PromoteItem(WorkItem *workItem, AsyncFileRequestPriority priority);
+
+	private:
+		static const size_t kMaxBatchSize = 16;
+		static const size_t kQueueCapacityPerPriority = 1024;
+
+		struct PendingLoad
+		{
+			PendingLoad();
+
+			WorkItem *m_workItem;
+			CorePtr<FileStream_Posix> m_stream;
+			UFilePos_t m_size;
+			ArrayPtr<uint8_t> m_contents;
+			ErrorCode m_errorCode;
+		};
+
+		static int StaticThreadFunc(void *self);
+		int ThreadFunc();
+
+		void BeginLoad(PendingLoad &load);
+		void FinishLoad(PendingLoad &load);
+		Result BeginLoadChecked(PendingLoad &load);
+		Result FinishLoadChecked(PendingLoad &load);
+
+		ArrayPtr<CorePtr<Thread>> m_ioThreads;
+		CorePtr<AsyncFileWorkQueue> m_queue;
+
+		SynchronousFileSystem_Posix *m_syncFileSystem;
+		bool m_initialized;
+	};
+}
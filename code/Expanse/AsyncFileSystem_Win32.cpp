@@ -1,137 +1,89 @@
 #include "AsyncFileSystem_Win32.h"
 
 #include "AsyncFileRequest_Win32.h"
+#include "AsyncFileWorkQueue.h"
 #include "CorePtr.h"
 #include "ExpAssert.h"
 #include "FileStream.h"
-#include "Mutex.h"
-#include "MutexLock.h"
 #include "Result.h"
 #include "ResultRV.h"
 #include "SynchronousFileSystem.h"
 #include "Thread.h"
-#include "ThreadEvent.h"
 
-// This works via an IO thread.  AsyncFileRequest lifetimes must exist within the async file system lifetime.
-// AsyncFileRequests own the WorkItem but must lock the async file system to modify it.
-// A WorkItem is either in the queue, the current work item, or orphaned.
+// This works via a pool of IO threads fed by a lock-free priority queue.  AsyncFileRequest lifetimes must exist
+// within the async file system lifetime.
+// AsyncFileRequests and the queue share ownership of the WorkItem, cancelling a request marks the item cancelled
+// and the worker that eventually pops it drops it without loading.
 
 namespace expanse
 {
 	AsyncFileSystem_Win32::AsyncFileSystem_Win32(SynchronousFileSystem *syncFileSystem)
 		: m_syncFileSystem(syncFileSystem)
-		, m_queueHead(nullptr)
-		, m_queueTail(nullptr)
-		, m_inProgressItem(nullptr)
 		, m_initialized(false)
-		, m_isQuitting(false)
 	{
 	}
 
 	AsyncFileSystem_Win32::~AsyncFileSystem_Win32()
 	{
-		{
-			MutexLock lock(m_queueMutex);
-
-			for (WorkItem *workItem = m_queueHead; workItem; workItem = workItem->m_next)
-				workItem->m_itemState = WorkItemState::kCancelled;
-
-			if (m_inProgressItem)
-				m_inProgressItem->m_itemState = WorkItemState::kCancelled;
+		if (m_queue == nullptr)
+			return;
 
-			m_queueHead = nullptr;
-			m_queueTail = nullptr;
-			m_inProgressItem = nullptr;
-
-			m_isQuitting = true;
-		}
+		m_queue->Shutdown();
 
-		m_ioWakeEvent->Set();
+		// Stop the IO threads and wait
+		m_ioThreads = nullptr;
 
-		// Stop the IO thread and wait
-		m_ioThread = nullptr;
+		m_queue->CancelAll();
 	}
 
-	Result AsyncFileSystem_Win32::Initialize()
+	Result AsyncFileSystem_Win32::Initialize(size_t numWorkerThreads)
 	{
 		IAllocator *alloc = GetCoreObjectAllocator();
 
-		CHECK_RV(CorePtr<ThreadEvent>, ioWakeEvent, ThreadEvent::Create(alloc, UTF8StringView_t(""), true, false));
-		CHECK_RV(CorePtr<Mutex>, queueMutex, Mutex::Create(alloc));
+		if (numWorkerThreads == 0)
+			numWorkerThreads = 1;
 
-		m_queueMutex = std::move(queueMutex);
-		m_ioWakeEvent = std::move(ioWakeEvent);
-		
-		CHECK_RV(CorePtr<Thread>, ioThread, Thread::CreateThread(alloc, StaticThreadFunc, this, UTF8StringView_t("AsyncFileSystem")));
-		m_ioThread = std::move(ioThread);
+		CHECK_RV(CorePtr<AsyncFileWorkQueue>, queue, New<AsyncFileWorkQueue>(alloc));
+		CHECK(queue->Initialize(kQueueCapacityPerPriority));
+		CHECK_RV(ArrayPtr<CorePtr<Thread>>, ioThreads, NewArray<CorePtr<Thread>>(alloc, numWorkerThreads));
+
+		m_queue = std::move(queue);
+		m_ioThreads = std::move(ioThreads);
+
+		for (size_t i = 0; i < numWorkerThreads; i++)
+		{
+			CHECK_RV(CorePtr<Thread>, ioThread, Thread::CreateThread(alloc, StaticThreadFunc, this, UTF8StringView_t("AsyncFileSystem")));
+			m_ioThreads[i] = std::move(ioThread);
+		}
 
 		m_initialized = true;
 		return ErrorCode::kOK;
 	}
 
-	ResultRV<CorePtr<AsyncFileRequest>> AsyncFileSystem_Win32::Retrieve(const UTF8StringView_t &device, const UTF8StringView_t &path)
+	ResultRV<CorePtr<AsyncFileRequest>> AsyncFileSystem_Win32::Retrieve(const UTF8StringView_t &device, const UTF8StringView_t &path, AsyncFileRequestPriority priority, AsyncFileContentsFilter_t contentsFilter)
 	{
 		EXP_ASSERT(m_initialized);
 
 		IAllocator *alloc = GetCoreObjectAllocator();
 
-		CHECK_RV(UTF8String_t, deviceCopy, device.CloneToString(alloc));
-		CHECK_RV(UTF8String_t, pathCopy, path.CloneToString(alloc));
-		CHECK_RV(CorePtr<WorkItem>, workItem, New<WorkItem>(alloc));
 		CHECK_RV(CorePtr<AsyncFileRequest_Win32>, asyncRequest, New<AsyncFileRequest_Win32>(alloc, this));
+		CHECK_RV(WorkItem *, workItem, AsyncFileWorkItem::Create(alloc, device, path, contentsFilter));
 
-		WorkItem *workItemRef = workItem;
-
-		WorkItemIdentifier id;
-		id.m_device = std::move(deviceCopy);
-		id.m_path = std::move(pathCopy);
-
-		workItemRef->m_id = std::move(id);
-
-		{
-			MutexLock lock(m_queueMutex);
-			EXP_ASSERT(!m_isQuitting);
-
-			WorkItem *queueTail = m_queueTail;
-			if (queueTail == nullptr)
-				m_queueHead = m_queueTail = workItemRef;
-			else
-			{
-				queueTail->m_next = workItemRef;
-				workItemRef->m_prev = queueTail;
-
-				m_queueTail = workItemRef;
-			}
-		}
-
-		m_ioWakeEvent->Set();
-
-		asyncRequest->Init(std::move(workItem));
+		asyncRequest->Init(workItem);
+		m_queue->Push(workItem, priority);
 
 		return CorePtr<AsyncFileRequest>(std::move(asyncRequest));
 	}
 
-
 	void AsyncFileSystem_Win32::CancelItem(WorkItem *workItem)
 	{
-		MutexLock lock(m_queueMutex);
-
-		workItem->m_itemState = WorkItemState::kCancelled;
+		workItem->Cancel();
+		workItem->Release();
+	}
 
-		if (m_inProgressItem == workItem)
-			m_inProgressItem = nullptr;
-		else
-		{
-			if (m_queueHead == workItem)
-				m_queueHead = workItem->m_next;
-			if (m_queueTail == workItem)
-				m_queueTail = workItem->m_prev;
-
-			if (workItem->m_prev)
-				workItem->m_prev->m_next = workItem->m_next;
-			if (workItem->m_next)
-				workItem->m_next->m_prev = workItem->m_prev;
-		}
+	void AsyncFileSystem_Win32::PromoteItem(WorkItem *workItem, AsyncFileRequestPriority priority)
+	{
+		m_queue->Promote(workItem, priority);
 	}
 
 	int AsyncFileSystem_Win32::StaticThreadFunc(void *self)
@@ -141,87 +93,53 @@ namespace expanse
 
 	int AsyncFileSystem_Win32::ThreadFunc()
 	{
+		AsyncFileWorkQueue *queue = m_queue;
+
 		for (;;)
 		{
-			WorkItemIdentifier identifier;
-
+			if (queue->IsShuttingDown())
 			{
-				MutexLock lock(m_queueMutex);
-				if (m_isQuitting)
-					return 0;
-
-				WorkItem *headWorkItem = m_queueHead;
-				if (headWorkItem == nullptr)
-				{
-					lock.Release();
-					m_ioWakeEvent->Wait();
-					continue;
-				}
-
-				m_inProgressItem = headWorkItem;
-				m_queueHead = headWorkItem->m_next;
-				if (m_queueHead)
-					m_queueHead->m_prev = nullptr;
-				if (m_queueTail == headWorkItem)
-					m_queueTail = nullptr;
-
-				EXP_ASSERT(headWorkItem->m_itemState == WorkItemState::kQueued);
-
-				headWorkItem->m_next = nullptr;
-				headWorkItem->m_prev = nullptr;
-				headWorkItem->m_itemState = WorkItemState::kInProgress;
-
-				identifier = std::move(headWorkItem->m_id);
+				queue->WakeWorker();
+				return 0;
 			}
 
-			WorkItemState outState = WorkItemState::kQueued;
-			ArrayPtr<uint8_t> contents;
-			ErrorCode outErrorCode = ErrorCode::kOK;
-			TryLoadWorkItem(identifier, outState, outErrorCode, contents);
-
+			WorkItem *workItem = queue->TryPop();
+			if (workItem == nullptr)
 			{
-				MutexLock lock(m_queueMutex);
-				WorkItem *inProgressItem = m_inProgressItem;
-
-				if (inProgressItem)
-				{
-					inProgressItem->m_result = std::move(contents);
-					inProgressItem->m_itemState = outState;
-					inProgressItem->m_errorCode = outErrorCode;
-					inProgressItem->m_id = std::move(identifier);
+				queue->WaitForWork();
+				continue;
+			}
 
-					// Must be last
-					inProgressItem->m_finished.fetch_add(1, std::memory_order_release);
+			if (workItem->TryBeginLoad())
+			{
+				ArrayPtr<uint8_t> contents;
+				const ErrorCode errorCode = TryLoadWorkItem(*workItem, contents);
 
-					m_inProgressItem = nullptr;
-				}
+				workItem->Complete(errorCode, std::move(contents));
 			}
+
+			workItem->Release();
 		}
 	}
 
-	void AsyncFileSystem_Win32::TryLoadWorkItem(const WorkItemIdentifier &identifier, WorkItemState &outState, ErrorCode &outErrorCode, ArrayPtr<uint8_t> &outContents)
+	ErrorCode AsyncFileSystem_Win32::TryLoadWorkItem(const WorkItem &workItem, ArrayPtr<uint8_t> &outContents)
 	{
 		ArrayPtr<uint8_t> contents;
 
-		Result result(TryLoadWorkItemChecked(identifier, contents));
+		Result result(TryLoadWorkItemChecked(workItem, contents));
 		result.Handle();
 
 		const ErrorCode errorCode = result.GetErrorCode();
 
-		outErrorCode = errorCode;
-
 		if (errorCode == ErrorCode::kOK)
-		{
-			outState = WorkItemState::kFinished;
 			outContents = std::move(contents);
-		}
-		else
-			outState = WorkItemState::kFailed;
+
+		return errorCode;
 	}
 
-	Result AsyncFileSystem_Win32::TryLoadWorkItemChecked(const WorkItemIdentifier &identifier, ArrayPtr<uint8_t> &outContents)
+	Result AsyncFileSystem_Win32::TryLoadWorkItemChecked(const WorkItem &workItem, ArrayPtr<uint8_t> &outContents)
 	{
-		CHECK_RV(CorePtr<FileStream>, stream, m_syncFileSystem->Open(identifier.m_device, identifier.m_path, SynchronousFileSystem::Permission::kRead, SynchronousFileSystem::CreationDisposition::kOpenExisting));
+		CHECK_RV(CorePtr<FileStream>, stream, m_syncFileSystem->Open(workItem.GetDevice(), workItem.GetPath(), SynchronousFileSystem::Permission::kRead, SynchronousFileSystem::CreationDisposition::kOpenExisting));
 
 		CHECK_RV(UFilePos_t, fileSize, stream->GetSize());
 
@@ -240,13 +158,4 @@ namespace expanse
 
 		return ErrorCode::kOK;
 	}
-
-	AsyncFileSystem_Win32::WorkItem::WorkItem()
-		: m_itemState(WorkItemState::kQueued)
-		, m_prev(nullptr)
-		, m_next(nullptr)
-		, m_errorCode(ErrorCode::kOK)
-		, m_finished(0)
-	{
-	}
 }
@@ -1,19 +1,20 @@
 #pragma once
 
 #include "AsyncFileSystem.h"
+#include "ArrayPtr.h"
 #include "CorePtr.h"
 #include "ErrorCode.h"
 #include "XString.h"
 
-#include <atomic>
+#include <cstddef>
 
 namespace expanse
 {
 	class AsyncFileRequest_Win32;
+	class AsyncFileWorkItem;
+	class AsyncFileWorkQueue;
 	class SynchronousFileSystem;
-	class Mutex;
 	class Thread;
-	class ThreadEvent;
 	struct IAllocator;
 
 	class AsyncFileSystem_Win32 final : public AsyncFileSystem
@@ -22,56 +23,27 @@ namespace expanse
 		AsyncFileSystem_Win32(SynchronousFileSystem *syncFileSystem);
 		~AsyncFileSystem_Win32();
 
-		Result Initialize();
-		ResultRV<CorePtr<AsyncFileRequest>> Retrieve(const UTF8StringView_t &device, const UTF8StringView_t &path) override;
+		Result Initialize(size_t numWorkerThreads);
+		ResultRV<CorePtr<AsyncFileRequest>> Retrieve(const UTF8StringView_t &device, const UTF8StringView_t &path, AsyncFileRequestPriority priority, AsyncFileContentsFilter_t contentsFilter) override;
 
-		enum WorkItemState
-		{
-			kQueued,
-			kInProgress,
-			kFailed,
-			kCancelled,
-			kFinished,
-		};
-
-		struct WorkItemIdentifier
-		{
-			UTF8String_t m_device;
-			UTF8String_t m_path;
-		};
-
-		struct WorkItem final : public CoreObject
-		{
-			WorkItem();
-
-			ArrayPtr<uint8_t> m_result;
-			WorkItemState m_itemState;	// Requires lock
-			WorkItemIdentifier m_id;
-			WorkItem *m_prev;
-			WorkItem *m_next;
-
-			std::atomic<int> m_finished;
-			ErrorCode m_errorCode;
-		};
+		typedef AsyncFileWorkItem WorkItem;
 
 		void CancelItem(WorkItem *workItem);
+		void PromoteItem(WorkItem *workItem, AsyncFileRequestPriority priority);
 
 	public:
 		static int StaticThreadFunc(void *self);
 		int ThreadFunc();
 
-		void TryLoadWorkItem(const WorkItemIdentifier &identifier, WorkItemState &outState, ErrorCode &outErrorCode, ArrayPtr<uint8_t> &outContents);
-		Result TryLoadWorkItemChecked(const WorkItemIdentifier &identifier, ArrayPtr<uint8_t> &outContents);
+		ErrorCode TryLoadWorkItem(const WorkItem &workItem, ArrayPtr<uint8_t> &outContents);
+		Result TryLoadWorkItemChecked(const WorkItem &workItem, ArrayPtr<uint8_t> &outContents);
+
+		static const size_t kQueueCapacityPerPriority = 1024;
 
-		CorePtr<Thread> m_ioThread;
-		CorePtr<ThreadEvent> m_ioWakeEvent;
-		CorePtr<Mutex> m_queueMutex;
+		ArrayPtr<CorePtr<Thread>> m_ioThreads;
+		CorePtr<AsyncFileWorkQueue> m_queue;
 
 		SynchronousFileSystem *m_syncFileSystem;
-		WorkItem *m_queueHead;
-		WorkItem *m_queueTail;
-		WorkItem *m_inProgressItem;
 		bool m_initialized;
-		bool m_isQuitting;
 	};
 }
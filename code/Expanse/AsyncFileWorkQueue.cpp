@@ -0,0 +1,267 @@
+#include "AsyncFileWorkQueue.h"
+
+#include "ExpAssert.h"
+#include "Mem.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "ThreadEvent.h"
+
+#include <thread>
+
+namespace expanse
+{
+	AsyncFileWorkItem::AsyncFileWorkItem()
+		: m_state(State::kQueued)
+		, m_refCount(2)
+		, m_finishEvent(nullptr)
+		, m_contentsFilter(nullptr)
+		, m_errorCode(ErrorCode::kOK)
+	{
+	}
+
+	AsyncFileWorkItem::~AsyncFileWorkItem()
+	{
+	}
+
+	ResultRV<AsyncFileWorkItem*> AsyncFileWorkItem::Create(IAllocator *alloc, const UTF8StringView_t &device, const UTF8StringView_t &path, AsyncFileContentsFilter_t contentsFilter)
+	{
+		CHECK_RV(UTF8String_t, deviceCopy, device.CloneToString(alloc));
+		CHECK_RV(UTF8String_t, pathCopy, path.CloneToString(alloc));
+		CHECK_RV(CorePtr<AsyncFileWorkItem>, workItem, New<AsyncFileWorkItem>(alloc));
+
+		AsyncFileWorkItem *workItemRef = workItem;
+		workItemRef->m_device = std::move(deviceCopy);
+		workItemRef->m_path = std::move(pathCopy);
+		workItemRef->m_contentsFilter = contentsFilter;
+		workItemRef->m_self = std::move(workItem);
+
+		return workItemRef;
+	}
+
+	bool AsyncFileWorkItem::TryBeginLoad()
+	{
+		State expected = State::kQueued;
+		return m_state.compare_exchange_strong(expected, State::kInProgress, std::memory_order_acquire);
+	}
+
+	void AsyncFileWorkItem::Complete(ErrorCode errorCode, ArrayPtr<uint8_t> &&contents)
+	{
+		if (errorCode == ErrorCode::kOK && m_contentsFilter != nullptr)
+			m_contentsFilter(contents);
+
+		m_result = std::move(contents);
+		m_errorCode = errorCode;
+
+		const State finalState = (errorCode == ErrorCode::kOK) ? State::kFinished : State::kFailed;
+
+		// Must be last, other than waking the requester.  Sequentially consistent so that WaitForFinish either sees
+		// the final state or has its event taken below.
+		State expected = State::kInProgress;
+		if (!m_state.compare_exchange_strong(expected, finalState, std::memory_order_seq_cst))
+		{
+			// Cancelled mid-load, nobody will ever read the result
+			EXP_ASSERT(expected == State::kCancelled);
+			m_result = nullptr;
+		}
+
+		ThreadEvent *finishEvent = m_finishEvent.exchange(nullptr, std::memory_order_seq_cst);
+		if (finishEvent != nullptr)
+			finishEvent->Set();
+	}
+
+	const UTF8String_t &AsyncFileWorkItem::GetDevice() const
+	{
+		return m_device;
+	}
+
+	const UTF8String_t &AsyncFileWorkItem::GetPath() const
+	{
+		return m_path;
+	}
+
+	bool AsyncFileWorkItem::IsFinished() const
+	{
+		const State state = m_state.load(std::memory_order_acquire);
+		return state == State::kFinished || state == State::kFailed;
+	}
+
+	void AsyncFileWorkItem::WaitForFinish(ThreadEvent *finishEvent)
+	{
+		m_finishEvent.store(finishEvent, std::memory_order_seq_cst);
+
+		const State state = m_state.load(std::memory_order_seq_cst);
+		if (state != State::kFinished && state != State::kFailed)
+		{
+			// Not finished when the event was published, so Complete is bound to take it and set it
+			finishEvent->Wait();
+		}
+		else if (m_finishEvent.exchange(nullptr, std::memory_order_seq_cst) == nullptr)
+		{
+			// Finished, but Complete took the event anyway.  Wait for its signal so that it doesn't wake the next
+			// wait early, and so that the event isn't touched again once this returns.
+			finishEvent->Wait();
+		}
+	}
+
+	ErrorCode AsyncFileWorkItem::GetErrorCode() const
+	{
+		return m_errorCode;
+	}
+
+	ArrayPtr<uint8_t> AsyncFileWorkItem::TakeResult()
+	{
+		return ArrayPtr<uint8_t>(std::move(m_result));
+	}
+
+	void AsyncFileWorkItem::TakeIdentifier(UTF8String_t &outDevice, UTF8String_t &outPath)
+	{
+		outDevice = std::move(m_device);
+		outPath = std::move(m_path);
+	}
+
+	bool AsyncFileWorkItem::IsQueued() const
+	{
+		return m_state.load(std::memory_order_relaxed) == State::kQueued;
+	}
+
+	void AsyncFileWorkItem::Cancel()
+	{
+		State state = m_state.load(std::memory_order_relaxed);
+		while (state == State::kQueued || state == State::kInProgress)
+		{
+			if (m_state.compare_exchange_weak(state, State::kCancelled, std::memory_order_relaxed))
+				break;
+		}
+	}
+
+	void AsyncFileWorkItem::AddRef()
+	{
+		m_refCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void AsyncFileWorkItem::Release()
+	{
+		if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			CorePtr<AsyncFileWorkItem> self(std::move(m_self));
+			// Destroyed on scope exit, don't touch members after this
+		}
+	}
+
+	AsyncFileWorkQueue::AsyncFileWorkQueue()
+		: m_isShuttingDown(false)
+	{
+	}
+
+	AsyncFileWorkQueue::~AsyncFileWorkQueue()
+	{
+		CancelAll();
+	}
+
+	Result AsyncFileWorkQueue::Initialize(size_t capacityPerPriority)
+	{
+		IAllocator *alloc = GetCoreObjectAllocator();
+
+		for (size_t i = 0; i < kNumPriorities; i++)
+		{
+			CHECK(m_queues[i].Initialize(alloc, capacityPerPriority));
+		}
+
+		CHECK_RV(CorePtr<ThreadEvent>, wakeEvent, ThreadEvent::Create(alloc, UTF8StringView_t(""), true, false));
+		m_wakeEvent = std::move(wakeEvent);
+
+		return ErrorCode::kOK;
+	}
+
+	void AsyncFileWorkQueue::Push(AsyncFileWorkItem *workItem, AsyncFileRequestPriority priority)
+	{
+		EXP_ASSERT(!m_isShuttingDown.load(std::memory_order_relaxed));
+
+		MPMCQueue<AsyncFileWorkItem*> &queue = m_queues[static_cast<size_t>(priority)];
+
+		// The rings are sized well past the number of loads the preprocessors keep in flight, if one does fill
+		// up then the workers are already busy and will free a slot shortly.
+		while (!queue.TryPush(workItem))
+		{
+			m_wakeEvent->Set();
+			std::this_thread::yield();
+		}
+
+		m_wakeEvent->Set();
+	}
+
+	AsyncFileWorkItem *AsyncFileWorkQueue::TryPop()
+	{
+		for (size_t i = 0; i < kNumPriorities; i++)
+		{
+			AsyncFileWorkItem *workItem = nullptr;
+			if (m_queues[i].TryPop(workItem))
+			{
+				// The wake event is auto-reset, so several pushes may have only woken one worker
+				if (!IsEmpty())
+					m_wakeEvent->Set();
+
+				return workItem;
+			}
+		}
+
+		return nullptr;
+	}
+
+	void AsyncFileWorkQueue::Promote(AsyncFileWorkItem *workItem, AsyncFileRequestPriority priority)
+	{
+		if (!workItem->IsQueued())
+			return;
+
+		// The new entry holds its own reference
+		workItem->AddRef();
+		Push(workItem, priority);
+	}
+
+	void AsyncFileWorkQueue::WaitForWork()
+	{
+		m_wakeEvent->Wait();
+	}
+
+	void AsyncFileWorkQueue::WakeWorker()
+	{
+		m_wakeEvent->Set();
+	}
+
+	bool AsyncFileWorkQueue::IsShuttingDown() const
+	{
+		return m_isShuttingDown.load(std::memory_order_acquire);
+	}
+
+	void AsyncFileWorkQueue::Shutdown()
+	{
+		m_isShuttingDown.store(true, std::memory_order_release);
+
+		// Each worker passes this along to the next one on the way out
+		m_wakeEvent->Set();
+	}
+
+	void AsyncFileWorkQueue::CancelAll()
+	{
+		for (size_t i = 0; i < kNumPriorities; i++)
+		{
+			AsyncFileWorkItem *workItem = nullptr;
+			while (m_queues[i].TryPop(workItem))
+			{
+				workItem->Cancel();
+				workItem->Release();
+			}
+		}
+	}
+
+	bool AsyncFileWorkQueue::IsEmpty() const
+	{
+		for (size_t i = 0; i < kNumPriorities; i++)
+		{
+			if (!m_queues[i].IsEmpty())
+				return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "ArrayPtr.h"
+#include "AsyncFileSystem.h"
+#include "CoreObject.h"
+#include "CorePtr.h"
+#include "ErrorCode.h"
+#include "MPMCQueue.h"
+#include "XString.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace expanse
+{
+	class ThreadEvent;
+	struct IAllocator;
+	struct Result;
+	template<class T> struct ResultRV;
+
+	// A single file load shared between an AsyncFileRequest and the IO workers.  Items are reference counted,
+	// one reference for the request and one for each queue entry, so a request can be cancelled while its item
+	// is still sitting in the lock-free queue.  Whoever drops the last reference destroys the item.
+	class AsyncFileWorkItem final : public CoreObject
+	{
+	public:
+		enum class State
+		{
+			kQueued,
+			kInProgress,
+			kCancelled,
+			kFailed,
+			kFinished,
+		};
+
+		AsyncFileWorkItem();
+		~AsyncFileWorkItem();
+
+		// Returns an item holding two references
+		static ResultRV<AsyncFileWorkItem*> Create(IAllocator *alloc, const UTF8StringView_t &device, const UTF8StringView_t &path, AsyncFileContentsFilter_t contentsFilter);
+
+		// Worker side.  TryBeginLoad fails if the item was cancelled while queued, or if it was queued more than once
+		// and another entry for it was already picked up.  Complete runs the contents filter, if there is one.
+		bool TryBeginLoad();
+		void Complete(ErrorCode errorCode, ArrayPtr<uint8_t> &&contents);
+
+		const UTF8String_t &GetDevice() const;
+		const UTF8String_t &GetPath() const;
+
+		// Request side.  Results are only valid once IsFinished returns true.
+		bool IsFinished() const;
+		void WaitForFinish(ThreadEvent *finishEvent);
+		ErrorCode GetErrorCode() const;
+		ArrayPtr<uint8_t> TakeResult();
+		void TakeIdentifier(UTF8String_t &outDevice, UTF8String_t &outPath);
+
+		bool IsQueued() const;
+
+		void Cancel();
+		void AddRef();
+		void Release();
+
+	private:
+		CorePtr<AsyncFileWorkItem> m_self;
+		std::atomic<State> m_state;
+		std::atomic<int> m_refCount;
+		std::atomic<ThreadEvent*> m_finishEvent;	// Set by a waiting requester, taken by Complete
+
+		UTF8String_t m_device;
+		UTF8String_t m_path;
+		AsyncFileContentsFilter_t m_contentsFilter;
+
+		ArrayPtr<uint8_t> m_result;
+		ErrorCode m_errorCode;
+	};
+
+	// Lock-free priority queue of pending loads, drained by a pool of IO workers.  Each priority level is its own
+	// MPMC ring and workers always pop from the most urgent non-empty level.
+	class AsyncFileWorkQueue final : public CoreObject
+	{
+	public:
+		AsyncFileWorkQueue();
+		~AsyncFileWorkQueue();
+
+		Result Initialize(size_t capacityPerPriority);
+
+		// Takes over the queue's reference to the item
+		void Push(AsyncFileWorkItem *workItem, AsyncFileRequestPriority priority);
+
+		// Returns nullptr if every level is empty
+		AsyncFileWorkItem *TryPop();
+
+		// Queues a second entry for an item that's still waiting so that it's picked up at the more urgent priority.
+		// The stale entry stays in its old level and is dropped by whichever worker pops it.
+		void Promote(AsyncFileWorkItem *workItem, AsyncFileRequestPriority priority);
+
+		// Worker loop helpers.  WaitForWork may return spuriously.
+		void WaitForWork();
+		void WakeWorker();
+		bool IsShuttingDown() const;
+
+		// Wakes every worker and makes IsShuttingDown return true
+		void Shutdown();
+
+		// Cancels and releases everything still queued, only valid once all workers have exited
+		void CancelAll();
+
+	private:
+		static const size_t kNumPriorities = static_cast<size_t>(AsyncFileRequestPriority::kCount);
+
+		bool IsEmpty() const;
+
+		MPMCQueue<AsyncFileWorkItem*> m_queues[kNumPriorities];
+		CorePtr<ThreadEvent> m_wakeEvent;
+		std::atomic<bool> m_isShuttingDown;
+	};
+}
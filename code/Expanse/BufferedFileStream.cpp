@@ -0,0 +1,141 @@
+#include "BufferedFileStream.h"
+#include "ExpAssert.h"
+#include "Mem.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace expanse
+{
+	const size_t BufferedFileStream::kDefaultBufferSize;
+
+	BufferedFileStream::BufferedFileStream(IAllocator *alloc, CorePtr<FileStream> &&stream)
+		: m_alloc(alloc)
+		, m_stream(std::move(stream))
+		, m_numBuffered(0)
+		, m_numReserved(0)
+	{
+	}
+
+	BufferedFileStream::~BufferedFileStream()
+	{
+		Result result(Flush());
+		result.Handle();
+	}
+
+	Result BufferedFileStream::Initialize(size_t bufferSize)
+	{
+		EXP_ASSERT(bufferSize > 0);
+
+		CHECK_RV_ASSIGN(m_buffer, NewArrayUninitialized<uint8_t>(m_alloc, bufferSize));
+
+		return ErrorCode::kOK;
+	}
+
+	Result BufferedFileStream::Flush()
+	{
+		EXP_ASSERT(m_numReserved == 0);
+
+		if (m_numBuffered == 0)
+			return ErrorCode::kOK;
+
+		const size_t numBuffered = m_numBuffered;
+		m_numBuffered = 0;
+
+		return m_stream->WriteAll(ArrayView<const uint8_t>(&m_buffer[0], numBuffered));
+	}
+
+	ResultRV<uint8_t*> BufferedFileStream::Reserve(size_t size)
+	{
+		EXP_ASSERT(m_numReserved == 0);
+
+		if (size > m_buffer.Count())
+			return ErrorCode::kInvalidArgument;
+
+		if (size > m_buffer.Count() - m_numBuffered)
+			CHECK(Flush());
+
+		m_numReserved = size;
+
+		return &m_buffer[m_numBuffered];
+	}
+
+	void BufferedFileStream::Commit(size_t size)
+	{
+		EXP_ASSERT(size <= m_numReserved);
+
+		m_numBuffered += size;
+		m_numReserved = 0;
+	}
+
+	Result BufferedFileStream::SeekStart(UFilePos_t pos)
+	{
+		CHECK(Flush());
+
+		return m_stream->SeekStart(pos);
+	}
+
+	Result BufferedFileStream::SeekCurrent(FilePos_t pos)
+	{
+		CHECK(Flush());
+
+		return m_stream->SeekCurrent(pos);
+	}
+
+	Result BufferedFileStream::SeekEnd(FilePos_t pos)
+	{
+		CHECK(Flush());
+
+		return m_stream->SeekEnd(pos);
+	}
+
+	ResultRV<UFilePos_t> BufferedFileStream::GetPosition() const
+	{
+		CHECK_RV(UFilePos_t, streamPosition, m_stream->GetPosition());
+
+		return streamPosition + m_numBuffered;
+	}
+
+	ResultRV<UFilePos_t> BufferedFileStream::GetSize() const
+	{
+		CHECK_RV(UFilePos_t, streamPosition, m_stream->GetPosition());
+		CHECK_RV(UFilePos_t, streamSize, m_stream->GetSize());
+
+		return std::max<UFilePos_t>(streamSize, streamPosition + m_numBuffered);
+	}
+
+	bool BufferedFileStream::IsReadable()
+	{
+		return m_stream->IsReadable();
+	}
+
+	bool BufferedFileStream::IsWriteable()
+	{
+		return m_stream->IsWriteable();
+	}
+
+	ResultRV<size_t> BufferedFileStream::Read(void *buffer, size_t size)
+	{
+		CHECK(Flush());
+
+		return m_stream->ReadPartial(ArrayView<uint8_t>(static_cast<uint8_t*>(buffer), size));
+	}
+
+	ResultRV<size_t> BufferedFileStream::Write(const void *buffer, size_t size)
+	{
+		EXP_ASSERT(m_numReserved == 0);
+
+		if (size > m_buffer.Count() - m_numBuffered)
+		{
+			CHECK(Flush());
+
+			if (size >= m_buffer.Count())
+				return m_stream->WritePartial(ArrayView<const uint8_t>(static_cast<const uint8_t*>(buffer), size));
+		}
+
+		memcpy(&m_buffer[m_numBuffered], buffer, size);
+		m_numBuffered += size;
+
+		return size;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ArrayPtr.h"
+#include "CorePtr.h"
+#include "FileStream.h"
+
+namespace expanse
+{
+	struct IAllocator;
+
+	// Collects writes into a buffer and passes them on to another stream in blocks of up to the buffer size, so that
+	// producers that write a few bytes at a time don't pay for a write on the underlying stream each time.  Writes that
+	// are at least as large as the buffer go straight through.  Seeking and reading flush the buffer first.
+	//
+	// Buffered bytes are only written by Flush or when the buffer fills up.  The destructor flushes too, but can't
+	// report a failure, so anything that cares about the output being complete should Flush explicitly.
+	class BufferedFileStream final : public FileStream
+	{
+	public:
+		static const size_t kDefaultBufferSize = 64 * 1024;
+
+		BufferedFileStream(IAllocator *alloc, CorePtr<FileStream> &&stream);
+		~BufferedFileStream();
+
+		Result Initialize(size_t bufferSize);
+
+		Result Flush();
+
+		// Returns space for size bytes at the end of the buffer, flushing it first if they don't fit, for the caller to
+		// write into directly.  Commit then adds however many of them were used to the buffered bytes, and nothing
+		// else may be written to the stream in between.  size can't be larger than the buffer.
+		ResultRV<uint8_t*> Reserve(size_t size);
+		void Commit(size_t size);
+
+		Result SeekStart(UFilePos_t pos) override;
+		Result SeekCurrent(FilePos_t pos) override;
+		Result SeekEnd(FilePos_t pos) override;
+
+		ResultRV<UFilePos_t> GetPosition() const override;
+		ResultRV<UFilePos_t> GetSize() const override;
+
+		bool IsReadable() override;
+		bool IsWriteable() override;
+
+	protected:
+		ResultRV<size_t> Read(void *buffer, size_t size) override;
+		ResultRV<size_t> Write(const void *buffer, size_t size) override;
+
+	private:
+		BufferedFileStream() = delete;
+
+		IAllocator *m_alloc;
+		CorePtr<FileStream> m_stream;
+
+		ArrayPtr<uint8_t> m_buffer;
+		size_t m_numBuffered;
+		size_t m_numReserved;
+	};
+}
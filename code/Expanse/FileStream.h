@@ -2,6 +2,7 @@
 
 #include "CoreObject.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace expanse
@@ -45,6 +46,7 @@ namespace expanse
 }
 
 #include "ArrayView.h"
+#include "Result.h"
 #include "ResultRV.h"
 
 namespace expanse
@@ -0,0 +1,139 @@
+#include "FileStream_Posix.h"
+#include "Result.h"
+
+#include <errno.h>
+#include <limits>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace expanse
+{
+	FileStream_Posix::FileStream_Posix()
+		: m_fd(-1)
+		, m_isReadable(false)
+		, m_isWriteable(false)
+	{
+	}
+
+	FileStream_Posix::~FileStream_Posix()
+	{
+		if (m_fd >= 0)
+			close(m_fd);
+	}
+
+	Result FileStream_Posix::SeekStart(UFilePos_t pos)
+	{
+		if (pos >= static_cast<UFilePos_t>(std::numeric_limits<off_t>::max()))
+			return ErrorCode::kInvalidArgument;
+
+		if (lseek(m_fd, static_cast<off_t>(pos), SEEK_SET) < 0)
+			return ErrorCode::kIOError;
+
+		return ErrorCode::kOK;
+	}
+
+	Result FileStream_Posix::SeekCurrent(FilePos_t pos)
+	{
+		if (lseek(m_fd, static_cast<off_t>(pos), SEEK_CUR) < 0)
+			return ErrorCode::kIOError;
+
+		return ErrorCode::kOK;
+	}
+
+	ResultRV<UFilePos_t> FileStream_Posix::GetPosition() const
+	{
+		const off_t position = lseek(m_fd, 0, SEEK_CUR);
+		if (position < 0)
+			return ErrorCode::kIOError;
+
+		return static_cast<UFilePos_t>(position);
+	}
+
+	ResultRV<UFilePos_t> FileStream_Posix::GetSize() const
+	{
+		struct stat fileStat;
+		if (fstat(m_fd, &fileStat) != 0)
+			return ErrorCode::kIOError;
+
+		return static_cast<UFilePos_t>(fileStat.st_size);
+	}
+
+	Result FileStream_Posix::SeekEnd(FilePos_t pos)
+	{
+		if (lseek(m_fd, static_cast<off_t>(pos), SEEK_END) < 0)
+			return ErrorCode::kIOError;
+
+		return ErrorCode::kOK;
+	}
+
+	bool FileStream_Posix::IsReadable()
+	{
+		return m_isReadable;
+	}
+
+	bool FileStream_Posix::IsWriteable()
+	{
+		return m_isWriteable;
+	}
+
+	int FileStream_Posix::GetFileDescriptor() const
+	{
+		return m_fd;
+	}
+
+	ResultRV<size_t> FileStream_Posix::Read(void *buffer, size_t size)
+	{
+		size_t cumulativeRead = 0;
+		while (size > 0)
+		{
+			const ssize_t numberRead = read(m_fd, buffer, size);
+			if (numberRead < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return ErrorCode::kIOError;
+			}
+
+			if (numberRead == 0)
+				break;
+
+			cumulativeRead += static_cast<size_t>(numberRead);
+			buffer = static_cast<void*>(static_cast<uint8_t*>(buffer) + numberRead);
+			size -= static_cast<size_t>(numberRead);
+		}
+
+		return cumulativeRead;
+	}
+
+	ResultRV<size_t> FileStream_Posix::Write(const void *buffer, size_t size)
+	{
+		size_t cumulativeWritten = 0;
+		while (size > 0)
+		{
+			const ssize_t numberWritten = write(m_fd, buffer, size);
+			if (numberWritten < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return ErrorCode::kIOError;
+			}
+
+			if (numberWritten == 0)
+				break;
+
+			cumulativeWritten += static_cast<size_t>(numberWritten);
+			buffer = static_cast<const void*>(static_cast<const uint8_t*>(buffer) + numberWritten);
+			size -= static_cast<size_t>(numberWritten);
+		}
+
+		return cumulativeWritten;
+	}
+
+	void FileStream_Posix::Init(int fd, bool readable, bool writeable)
+	{
+		m_fd = fd;
+		m_isReadable = readable;
+		m_isWriteable = writeable;
+	}
+}
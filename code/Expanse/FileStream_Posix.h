@@ -0,0 +1,40 @@
+#pragma once
+
+#include "FileStream.h"
+
+namespace expanse
+{
+	class SynchronousFileSystem_Posix;
+
+	class FileStream_Posix final : public FileStream
+	{
+	public:
+		FileStream_Posix();
+		~FileStream_Posix();
+
+		Result SeekStart(UFilePos_t pos) override;
+		Result SeekCurrent(FilePos_t pos) override;
+		Result SeekEnd(FilePos_t pos) override;
+
+		ResultRV<UFilePos_t> GetPosition() const override;
+		ResultRV<UFilePos_t> GetSize() const override;
+
+		bool IsReadable() override;
+		bool IsWriteable() override;
+
+		int GetFileDescriptor() const;
+
+	protected:
+		ResultRV<size_t> Read(void *buffer, size_t size) override;
+		ResultRV<size_t> Write(const void *buffer, size_t size) override;
+
+	private:
+		friend class SynchronousFileSystem_Posix;
+
+		void Init(int fd, bool readable, bool writeable);
+
+		int m_fd;
+		bool m_isReadable;
+		bool m_isWriteable;
+	};
+}
@@ -2,6 +2,8 @@
 
 #include "Hash.h"
 
+#include <cstddef>
+
 namespace expanse
 {
 	struct IAllocator;
@@ -158,6 +160,7 @@ namespace expanse
 	};
 }
 
+#include "IAllocator.h"
 #include "Result.h"
 #include "Optional.h"
 #include "Hasher.h"
@@ -645,6 +648,8 @@ namespace expanse
 		{
 			if (HashMapUtils::GetCompactValue(this->m_valueMainPosPlusOne, m_cvPrecision, m_freeSlotScan) == 0)
 				break;
+
+			m_freeSlotScan++;
 		}
 
 		// Couldn't find a free spot, rehash and try again
@@ -675,10 +680,13 @@ namespace expanse
 				nextIndexPlusOne = HashMapUtils::GetCompactValue(this->m_nextPlusOne, m_cvPrecision, otherIndex);
 			}
 
-			// precedingIndex -> freeSlotIndex -> keyMainPosition -> 0
+			// Before: precedingIndex -> keyMainPosition -> ...
+			// After: precedingIndex -> freeSlotIndex -> ..., keyMainPosition -> 0
 
 			const size_t precedingIndex = otherIndex;
+			const size_t displacedNextPlusOne = HashMapUtils::GetCompactValue(m_nextPlusOne, m_cvPrecision, keyMainPosition);
 			HashMapUtils::SetCompactValue(m_nextPlusOne, m_cvPrecision, precedingIndex, freeSlotIndex + 1);
+			HashMapUtils::SetCompactValue(m_nextPlusOne, m_cvPrecision, freeSlotIndex, displacedNextPlusOne);
 			HashMapUtils::SetCompactValue(m_nextPlusOne, m_cvPrecision, keyMainPosition, 0);
 
 			new (&m_keys[freeSlotIndex]) TKey(std::move(m_keys[keyMainPosition]));
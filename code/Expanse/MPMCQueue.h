@@ -0,0 +1,161 @@
+#pragma once
+
+#include "ArrayPtr.h"
+
+#include <atomic>
+#include <cstddef>
+
+namespace expanse
+{
+	struct IAllocator;
+	struct Result;
+
+	// Bounded lock-free multi-producer multi-consumer FIFO.  Each cell carries a sequence number that tells
+	// producers and consumers whether the cell is free for the current lap around the ring, so a push or pop
+	// is a single CAS on the shared position plus a release store on the cell.
+	template<class T>
+	struct MPMCQueue
+	{
+	public:
+		MPMCQueue();
+
+		// Capacity is rounded up to a power of two
+		Result Initialize(IAllocator *alloc, size_t capacity);
+
+		bool TryPush(const T &item);
+		bool TryPop(T &outItem);
+
+		// Only a hint when other threads are pushing or popping
+		bool IsEmpty() const;
+
+	private:
+		static const size_t kCacheLineSize = 64;
+
+		struct Cell
+		{
+			Cell();
+
+			std::atomic<size_t> m_sequence;
+			T m_item;
+		};
+
+		MPMCQueue(const MPMCQueue<T> &other) = delete;
+		MPMCQueue<T> &operator=(const MPMCQueue<T> &other) = delete;
+
+		ArrayPtr<Cell> m_cells;
+		size_t m_mask;
+
+		alignas(kCacheLineSize) std::atomic<size_t> m_pushPos;
+		alignas(kCacheLineSize) std::atomic<size_t> m_popPos;
+	};
+}
+
+#include "Mem.h"
+#include "Result.h"
+
+namespace expanse
+{
+	template<class T>
+	MPMCQueue<T>::Cell::Cell()
+		: m_sequence(0)
+		, m_item()
+	{
+	}
+
+	template<class T>
+	MPMCQueue<T>::MPMCQueue()
+		: m_mask(0)
+		, m_pushPos(0)
+		, m_popPos(0)
+	{
+	}
+
+	template<class T>
+	Result MPMCQueue<T>::Initialize(IAllocator *alloc, size_t capacity)
+	{
+		size_t roundedCapacity = 2;
+		while (roundedCapacity < capacity)
+		{
+			if (roundedCapacity > (std::numeric_limits<size_t>::max() / 2u))
+				return ErrorCode::kOutOfMemory;
+
+			roundedCapacity *= 2u;
+		}
+
+		CHECK_RV(ArrayPtr<Cell>, cells, NewArray<Cell>(alloc, roundedCapacity));
+
+		for (size_t i = 0; i < roundedCapacity; i++)
+			cells[i].m_sequence.store(i, std::memory_order_relaxed);
+
+		m_cells = std::move(cells);
+		m_mask = roundedCapacity - 1u;
+		m_pushPos.store(0, std::memory_order_relaxed);
+		m_popPos.store(0, std::memory_order_relaxed);
+
+		return ErrorCode::kOK;
+	}
+
+	template<class T>
+	bool MPMCQueue<T>::TryPush(const T &item)
+	{
+		if (m_cells == nullptr)
+			return false;
+
+		size_t pos = m_pushPos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell &cell = m_cells[pos & m_mask];
+			const size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+			const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos);
+
+			if (diff == 0)
+			{
+				if (m_pushPos.compare_exchange_weak(pos, pos + 1u, std::memory_order_relaxed))
+				{
+					cell.m_item = item;
+					cell.m_sequence.store(pos + 1u, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false;	// Full
+			else
+				pos = m_pushPos.load(std::memory_order_relaxed);
+		}
+	}
+
+	template<class T>
+	bool MPMCQueue<T>::TryPop(T &outItem)
+	{
+		if (m_cells == nullptr)
+			return false;
+
+		size_t pos = m_popPos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell &cell = m_cells[pos & m_mask];
+			const size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+			const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos + 1u);
+
+			if (diff == 0)
+			{
+				if (m_popPos.compare_exchange_weak(pos, pos + 1u, std::memory_order_relaxed))
+				{
+					outItem = cell.m_item;
+					cell.m_sequence.store(pos + m_mask + 1u, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false;	// Empty
+			else
+				pos = m_popPos.load(std::memory_order_relaxed);
+		}
+	}
+
+	template<class T>
+	bool MPMCQueue<T>::IsEmpty() const
+	{
+		return m_popPos.load(std::memory_order_relaxed) == m_pushPos.load(std::memory_order_relaxed);
+	}
+}
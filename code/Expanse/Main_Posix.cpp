@@ -0,0 +1,295 @@
+#include "AsyncFileSystem_Posix.h"
+#include "FileStream.h"
+#include "SynchronousFileSystem_Posix.h"
+#include "Services.h"
+#include "ServiceCollection.h"
+#include "Mem.h"
+#include "PooledAllocator.h"
+#include "Result.h"
+#include "Vector.h"
+#include "XString.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <utility>
+
+expanse::Result TestCC(expanse::IAllocator *alloc, const expanse::ArrayView<expanse::IAllocator *const> &workerAllocators, expanse::SynchronousFileSystem *syncFS, expanse::AsyncFileSystem *asyncFS, const expanse::ArrayView<const expanse::UTF8String_t> &sourcePaths, const expanse::ArrayView<const expanse::UTF8String_t> &manifestPaths, bool binaryHAsm);
+expanse::Result LexerBenchmark(expanse::IAllocator *alloc, expanse::SynchronousFileSystem *syncFS, const expanse::ArrayView<const expanse::UTF8String_t> &sourcePaths);
+expanse::Result SelfTest(expanse::IAllocator *alloc);
+
+class Allocator_Posix final : public expanse::IAllocator
+{
+public:
+	void *Alloc(size_t size, size_t alignment) override;
+	void Release(void *ptr) override;
+	void *Realloc(void *ptr, size_t newSize, size_t alignment) override;
+
+	static const uint32_t kSentinelStart = 0xaabe4410;
+};
+
+struct MemBlockInfo
+{
+	void *m_baseAddress;
+	size_t m_size;
+	size_t m_alignment;
+	uint32_t m_sentinel;
+};
+
+void *Allocator_Posix::Alloc(size_t size, size_t alignment)
+{
+	if (size == 0)
+		return nullptr;
+
+	size_t extraRequired = sizeof(MemBlockInfo) + alignment - 1;
+
+	const size_t maxSize = std::numeric_limits<size_t>::max() - extraRequired;
+	if (maxSize < size)
+		return nullptr;
+
+	uint8_t *mem = static_cast<uint8_t*>(malloc(size + extraRequired));
+	if (mem == nullptr)
+		return nullptr;
+
+	uint8_t *memBlockEndAddressBase = mem + sizeof(MemBlockInfo);
+
+	size_t padding = alignment - static_cast<size_t>(reinterpret_cast<uintptr_t>(memBlockEndAddressBase) % static_cast<uintptr_t>(alignment));
+
+	if (padding == alignment)
+		padding = 0;
+
+	uint8_t *memBlockEndAddress = memBlockEndAddressBase + padding;
+
+	MemBlockInfo memBlockInfo;
+	memBlockInfo.m_size = size;
+	memBlockInfo.m_baseAddress = mem;
+	memBlockInfo.m_alignment = alignment;
+	memBlockInfo.m_sentinel = kSentinelStart;
+
+	memcpy(memBlockEndAddress - sizeof(MemBlockInfo), &memBlockInfo, sizeof(MemBlockInfo));
+
+	return memBlockEndAddress;
+}
+
+void Allocator_Posix::Release(void *ptr)
+{
+	if (ptr == nullptr)
+		return;
+
+	MemBlockInfo memBlockInfo;
+	memcpy(&memBlockInfo, static_cast<uint8_t*>(ptr) - sizeof(MemBlockInfo), sizeof(MemBlockInfo));
+
+	EXP_ASSERT(memBlockInfo.m_sentinel == kSentinelStart);
+
+	free(memBlockInfo.m_baseAddress);
+}
+
+void *Allocator_Posix::Realloc(void *ptr, size_t newSize, size_t alignment)
+{
+	if (ptr == nullptr)
+		return this->Alloc(newSize, alignment);
+
+	MemBlockInfo memBlockInfo;
+	memcpy(&memBlockInfo, static_cast<uint8_t*>(ptr) - sizeof(MemBlockInfo), sizeof(MemBlockInfo));
+
+	if (memBlockInfo.m_alignment != alignment)
+		return nullptr;
+
+	void *newMem = this->Alloc(newSize, alignment);
+	if (!newMem)
+		return nullptr;
+
+	size_t copySize = memBlockInfo.m_size;
+	if (newSize < copySize)
+		copySize = newSize;
+
+	memcpy(newMem, ptr, copySize);
+
+	free(memBlockInfo.m_baseAddress);
+
+	return newMem;
+}
+
+static size_t GetDefaultIOThreadCount()
+{
+	const long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numCPUs < 1)
+		return 1;
+
+	// IO workers mostly wait on the file system, a handful is enough to keep the preprocessor fed
+	if (numCPUs > 8)
+		return 8;
+
+	return static_cast<size_t>(numCPUs);
+}
+
+static size_t GetDefaultCompileThreadCount()
+{
+	const long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numCPUs < 1)
+		return 1;
+
+	return static_cast<size_t>(numCPUs);
+}
+
+static void PrintAllocatorStats(const expanse::PooledAllocator &alloc)
+{
+	const expanse::PooledAllocator::Stats stats = alloc.GetStats();
+
+	fprintf(stderr, "Allocator: %llu bytes live, %llu peak, %llu large allocations, %llu in-place reallocs\n",
+		static_cast<unsigned long long>(stats.m_liveBytes),
+		static_cast<unsigned long long>(stats.m_peakLiveBytes),
+		static_cast<unsigned long long>(stats.m_numLargeAllocations),
+		static_cast<unsigned long long>(stats.m_numInPlaceReallocs));
+
+	for (size_t i = 0; i < alloc.GetNumSizeClasses(); i++)
+	{
+		const expanse::PooledAllocator::SizeClassStats classStats = alloc.GetSizeClassStats(i);
+		if (classStats.m_numAllocations == 0)
+			continue;
+
+		fprintf(stderr, "Allocator size class %u: %llu allocations, %llu live\n",
+			static_cast<unsigned int>(classStats.m_slotSize),
+			static_cast<unsigned long long>(classStats.m_numAllocations),
+			static_cast<unsigned long long>(classStats.m_numLive));
+	}
+}
+
+static expanse::Result CheckedMain(int argc, char **argv)
+{
+	// Stats have to be requested before anything is allocated
+	bool collectAllocatorStats = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-allocstats"))
+			collectAllocatorStats = true;
+	}
+
+	Allocator_Posix systemAlloc;
+	expanse::PooledAllocator alloc(&systemAlloc, collectAllocatorStats);
+	CHECK(alloc.Initialize());
+
+	expanse::ServiceCollection serviceCollection;
+
+	expanse::ServiceCollection::ms_primaryInstance = &serviceCollection;
+
+	CHECK_RV(expanse::CorePtr<expanse::SynchronousFileSystem_Posix>, syncFileSystem, expanse::New<expanse::SynchronousFileSystem_Posix>(&alloc));
+
+	serviceCollection.m_syncFileSystem = syncFileSystem;
+
+	size_t numIOThreads = GetDefaultIOThreadCount();
+	size_t numCompileThreads = GetDefaultCompileThreadCount();
+
+	expanse::Vector<expanse::UTF8String_t> sourcePaths(&alloc);
+	expanse::Vector<expanse::UTF8String_t> manifestPaths(&alloc);
+	bool runLexerBenchmark = false;
+	bool runSelfTest = false;
+	bool binaryHAsm = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-data"))
+		{
+			i++;
+			if (i == argc)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			CHECK(syncFileSystem->SetGamePath(expanse::UTF8StringView_t(argv[i])));
+		}
+		else if (!strcmp(argv[i], "-iothreads"))
+		{
+			i++;
+			if (i == argc)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			const long threadCount = strtol(argv[i], nullptr, 10);
+			if (threadCount < 1)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			numIOThreads = static_cast<size_t>(threadCount);
+		}
+		else if (!strcmp(argv[i], "-jobs"))
+		{
+			i++;
+			if (i == argc)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			const long threadCount = strtol(argv[i], nullptr, 10);
+			if (threadCount < 1)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			numCompileThreads = static_cast<size_t>(threadCount);
+		}
+		else if (!strcmp(argv[i], "-allocstats"))
+		{
+			// Already handled
+		}
+		else if (!strcmp(argv[i], "-lexbench"))
+		{
+			runLexerBenchmark = true;
+		}
+		else if (!strcmp(argv[i], "-selftest"))
+		{
+			runSelfTest = true;
+		}
+		else if (!strcmp(argv[i], "-binaryhasm"))
+		{
+			binaryHAsm = true;
+		}
+		else if (!strcmp(argv[i], "-manifest"))
+		{
+			i++;
+			if (i == argc)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			CHECK_RV(expanse::UTF8String_t, manifestPath, expanse::UTF8StringView_t(argv[i]).CloneToString(&alloc));
+			CHECK(manifestPaths.Add(std::move(manifestPath)));
+		}
+		else if (argv[i][0] == '-')
+			return expanse::ErrorCode::kInvalidArgument;
+		else
+		{
+			CHECK_RV(expanse::UTF8String_t, sourcePath, expanse::UTF8StringView_t(argv[i]).CloneToString(&alloc));
+			CHECK(sourcePaths.Add(std::move(sourcePath)));
+		}
+	}
+
+	CHECK_RV(expanse::CorePtr<expanse::AsyncFileSystem_Posix>, asyncFileSystem, expanse::New<expanse::AsyncFileSystem_Posix>(&alloc, syncFileSystem));
+	CHECK(asyncFileSystem->Initialize(numIOThreads));
+
+	serviceCollection.m_asyncFileSystem = asyncFileSystem;
+
+	// Compile workers share the pooled allocator, which keeps a cache for each thread
+	CHECK_RV(expanse::ArrayPtr<expanse::IAllocator*>, workerAllocatorRefs, expanse::NewArray<expanse::IAllocator*>(&alloc, numCompileThreads));
+
+	for (size_t i = 0; i < numCompileThreads; i++)
+		workerAllocatorRefs[i] = &alloc;
+
+	///////////////////////////////////////////////////////////////////////////////
+	// Main function
+	expanse::Result testResult(runSelfTest
+		? SelfTest(&alloc)
+		: runLexerBenchmark
+		? LexerBenchmark(&alloc, syncFileSystem, sourcePaths.ConstView())
+		: TestCC(&alloc, workerAllocatorRefs.ConstView(), syncFileSystem, serviceCollection.m_asyncFileSystem, sourcePaths.ConstView(), manifestPaths.ConstView(), binaryHAsm));
+	const expanse::ErrorCode testErrorCode = testResult.GetErrorCode();
+	testResult.Handle();
+
+	if (alloc.IsCollectingStats())
+		PrintAllocatorStats(alloc);
+
+	return testErrorCode;
+}
+
+int main(int argc, char **argv)
+{
+	expanse::ErrorCode errorCode = expanse::ErrorCode::kOK;
+	{
+		expanse::Result result(CheckedMain(argc, argv));
+		errorCode = result.GetErrorCode();
+		result.Handle();
+	}
+
+	return static_cast<int>(errorCode);
+}
@@ -5,14 +5,20 @@
 #include "Services.h"
 #include "ServiceCollection.h"
 #include "Mem.h"
+#include "PooledAllocator.h"
 #include "Result.h"
+#include "Vector.h"
 #include "WindowsGlobals.h"
 #include "WindowsUtils.h"
+#include "XString.h"
 
 #include <shellapi.h>
+#include <cstdio>
 #include <utility>
 
-expanse::Result TestCC(expanse::IAllocator *alloc, expanse::AsyncFileSystem *asyncFS, expanse::FileStream *outFile, expanse::FileStream *traceOutFile);
+expanse::Result TestCC(expanse::IAllocator *alloc, const expanse::ArrayView<expanse::IAllocator *const> &workerAllocators, expanse::SynchronousFileSystem *syncFS, expanse::AsyncFileSystem *asyncFS, const expanse::ArrayView<const expanse::UTF8String_t> &sourcePaths, const expanse::ArrayView<const expanse::UTF8String_t> &manifestPaths, bool binaryHAsm);
+expanse::Result LexerBenchmark(expanse::IAllocator *alloc, expanse::SynchronousFileSystem *syncFS, const expanse::ArrayView<const expanse::UTF8String_t> &sourcePaths);
+expanse::Result SelfTest(expanse::IAllocator *alloc);
 
 class Allocator_Win32 final : public expanse::IAllocator
 {
@@ -103,15 +109,76 @@ void *Allocator_Win32::Realloc(void *ptr, size_t newSize, size_t alignment)
 	return newMem;
 }
 
-static expanse::Result CheckedWinMain()
+static size_t GetDefaultIOThreadCount()
+{
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+
+	const size_t numCPUs = static_cast<size_t>(systemInfo.dwNumberOfProcessors);
+	if (numCPUs < 1)
+		return 1;
+
+	// IO workers mostly wait on the file system, a handful is enough to keep the preprocessor fed
+	if (numCPUs > 8)
+		return 8;
+
+	return numCPUs;
+}
+
+static size_t GetDefaultCompileThreadCount()
+{
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+
+	const size_t numCPUs = static_cast<size_t>(systemInfo.dwNumberOfProcessors);
+	if (numCPUs < 1)
+		return 1;
+
+	return numCPUs;
+}
+
+static void PrintAllocatorStats(const expanse::PooledAllocator &alloc)
 {
-	Allocator_Win32 alloc;
+	const expanse::PooledAllocator::Stats stats = alloc.GetStats();
+
+	fprintf(stderr, "Allocator: %llu bytes live, %llu peak, %llu large allocations, %llu in-place reallocs\n",
+		static_cast<unsigned long long>(stats.m_liveBytes),
+		static_cast<unsigned long long>(stats.m_peakLiveBytes),
+		static_cast<unsigned long long>(stats.m_numLargeAllocations),
+		static_cast<unsigned long long>(stats.m_numInPlaceReallocs));
+
+	for (size_t i = 0; i < alloc.GetNumSizeClasses(); i++)
+	{
+		const expanse::PooledAllocator::SizeClassStats classStats = alloc.GetSizeClassStats(i);
+		if (classStats.m_numAllocations == 0)
+			continue;
+
+		fprintf(stderr, "Allocator size class %u: %llu allocations, %llu live\n",
+			static_cast<unsigned int>(classStats.m_slotSize),
+			static_cast<unsigned long long>(classStats.m_numAllocations),
+			static_cast<unsigned long long>(classStats.m_numLive));
+	}
+}
 
+static expanse::Result CheckedWinMain()
+{
 	expanse::WindowsGlobals &winGlobals = expanse::WindowsGlobals::ms_instance;
 
 	const LPWSTR *argv = winGlobals.m_argv;
 	const int argc = winGlobals.m_argc;
 
+	// Stats have to be requested before anything is allocated
+	bool collectAllocatorStats = false;
+	for (int i = 0; i < argc; i++)
+	{
+		if (!wcscmp(argv[i], L"-allocstats"))
+			collectAllocatorStats = true;
+	}
+
+	Allocator_Win32 systemAlloc;
+	expanse::PooledAllocator alloc(&systemAlloc, collectAllocatorStats);
+	CHECK(alloc.Initialize());
+
 	expanse::ServiceCollection serviceCollection;
 
 	expanse::ServiceCollection::ms_primaryInstance = &serviceCollection;
@@ -120,10 +187,14 @@ static expanse::Result CheckedWinMain()
 
 	serviceCollection.m_syncFileSystem = syncFileSystem;
 
-	CHECK_RV(expanse::CorePtr<expanse::AsyncFileSystem_Win32>, asyncFileSystem, expanse::New<expanse::AsyncFileSystem_Win32>(&alloc, syncFileSystem));
-	CHECK(asyncFileSystem->Initialize());
+	size_t numIOThreads = GetDefaultIOThreadCount();
+	size_t numCompileThreads = GetDefaultCompileThreadCount();
 
-	serviceCollection.m_asyncFileSystem = asyncFileSystem;
+	expanse::Vector<expanse::UTF8String_t> sourcePaths(&alloc);
+	expanse::Vector<expanse::UTF8String_t> manifestPaths(&alloc);
+	bool runLexerBenchmark = false;
+	bool runSelfTest = false;
+	bool binaryHAsm = false;
 
 	for (int i = 0; i < argc; i++)
 	{
@@ -137,16 +208,89 @@ static expanse::Result CheckedWinMain()
 
 			CHECK(syncFileSystem->SetGamePath(std::move(dataDir)));
 		}
+		else if (!wcscmp(argv[i], L"-iothreads"))
+		{
+			i++;
+			if (i == argc)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			const long threadCount = wcstol(argv[i], nullptr, 10);
+			if (threadCount < 1)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			numIOThreads = static_cast<size_t>(threadCount);
+		}
+		else if (!wcscmp(argv[i], L"-jobs"))
+		{
+			i++;
+			if (i == argc)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			const long threadCount = wcstol(argv[i], nullptr, 10);
+			if (threadCount < 1)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			numCompileThreads = static_cast<size_t>(threadCount);
+		}
+		else if (!wcscmp(argv[i], L"-allocstats"))
+		{
+			// Already handled
+		}
+		else if (!wcscmp(argv[i], L"-lexbench"))
+		{
+			runLexerBenchmark = true;
+		}
+		else if (!wcscmp(argv[i], L"-selftest"))
+		{
+			runSelfTest = true;
+		}
+		else if (!wcscmp(argv[i], L"-binaryhasm"))
+		{
+			binaryHAsm = true;
+		}
+		else if (!wcscmp(argv[i], L"-manifest"))
+		{
+			i++;
+			if (i == argc)
+				return expanse::ErrorCode::kInvalidArgument;
+
+			CHECK_RV(expanse::UTF8String_t, manifestPath, expanse::WindowsUtils::ConvertToUTF8(&alloc, argv[i]));
+			CHECK(manifestPaths.Add(std::move(manifestPath)));
+		}
+		else if (argv[i][0] == L'-')
+			return expanse::ErrorCode::kInvalidArgument;
+		else
+		{
+			CHECK_RV(expanse::UTF8String_t, sourcePath, expanse::WindowsUtils::ConvertToUTF8(&alloc, argv[i]));
+			CHECK(sourcePaths.Add(std::move(sourcePath)));
+		}
 	}
 
-	CHECK_RV(expanse::CorePtr<expanse::FileStream>, outFile, syncFileSystem->Open(expanse::UTF8StringView_t("game"), expanse::UTF8StringView_t("logic/test.i"), expanse::SynchronousFileSystem::Permission::kWrite, expanse::SynchronousFileSystem::CreationDisposition::kCreateAlways));
-	CHECK_RV(expanse::CorePtr<expanse::FileStream>, traceOutFile, syncFileSystem->Open(expanse::UTF8StringView_t("game"), expanse::UTF8StringView_t("logic/test.tr"), expanse::SynchronousFileSystem::Permission::kWrite, expanse::SynchronousFileSystem::CreationDisposition::kCreateAlways));
+	CHECK_RV(expanse::CorePtr<expanse::AsyncFileSystem_Win32>, asyncFileSystem, expanse::New<expanse::AsyncFileSystem_Win32>(&alloc, syncFileSystem));
+	CHECK(asyncFileSystem->Initialize(numIOThreads));
+
+	serviceCollection.m_asyncFileSystem = asyncFileSystem;
+
+	// Compile workers share the pooled allocator, which keeps a cache for each thread
+	CHECK_RV(expanse::ArrayPtr<expanse::IAllocator*>, workerAllocatorRefs, expanse::NewArray<expanse::IAllocator*>(&alloc, numCompileThreads));
+
+	for (size_t i = 0; i < numCompileThreads; i++)
+		workerAllocatorRefs[i] = &alloc;
 
 	///////////////////////////////////////////////////////////////////////////////
 	// Main function
-	CHECK(TestCC(&alloc, serviceCollection.m_asyncFileSystem, outFile, traceOutFile));
-
-	return expanse::ErrorCode::kOK;
+	expanse::Result testResult(runSelfTest
+		? SelfTest(&alloc)
+		: runLexerBenchmark
+		? LexerBenchmark(&alloc, syncFileSystem, sourcePaths.ConstView())
+		: TestCC(&alloc, workerAllocatorRefs.ConstView(), syncFileSystem, serviceCollection.m_asyncFileSystem, sourcePaths.ConstView(), manifestPaths.ConstView(), binaryHAsm));
+	const expanse::ErrorCode testErrorCode = testResult.GetErrorCode();
+	testResult.Handle();
+
+	if (alloc.IsCollectingStats())
+		PrintAllocatorStats(alloc);
+
+	return testErrorCode;
 }
 
 int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine, int nCmdShow)
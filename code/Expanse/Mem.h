@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 namespace expanse
 {
 	template<class T> struct ArrayPtr;
@@ -64,6 +66,7 @@ namespace expanse
 #include "IAllocator.h"
 #include "ResultRV.h"
 
+#include <limits>
 #include <utility>
 #include <new>
 
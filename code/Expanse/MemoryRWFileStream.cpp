@@ -1,6 +1,7 @@
 #include "MemoryRWFileStream.h"
 
 #include <algorithm>
+#include <cstring>
 
 
 namespace expanse
@@ -0,0 +1,37 @@
+#include "Mutex_Posix.h"
+
+#include "Mem.h"
+
+namespace expanse
+{
+	Mutex_Posix::Mutex_Posix()
+	{
+		pthread_mutex_init(&m_mutex, nullptr);
+	}
+
+	Mutex_Posix::~Mutex_Posix()
+	{
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	void Mutex_Posix::Lock()
+	{
+		pthread_mutex_lock(&m_mutex);
+	}
+
+	bool Mutex_Posix::TryLock()
+	{
+		return (pthread_mutex_trylock(&m_mutex) == 0);
+	}
+
+	void Mutex_Posix::Unlock()
+	{
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	ResultRV<CorePtr<Mutex>> Mutex::Create(IAllocator *alloc)
+	{
+		CHECK_RV(CorePtr<Mutex_Posix>, mutex, New<Mutex_Posix>(alloc));
+		return CorePtr<Mutex>(std::move(mutex));
+	}
+}
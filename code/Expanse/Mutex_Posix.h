@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Mutex.h"
+
+#include <pthread.h>
+
+namespace expanse
+{
+	class Mutex_Posix final : public Mutex
+	{
+	public:
+		Mutex_Posix();
+		~Mutex_Posix() override;
+
+		void Lock() override;
+		bool TryLock() override;
+		void Unlock() override;
+
+	private:
+		pthread_mutex_t m_mutex;
+	};
+}
@@ -0,0 +1,641 @@
+#include "PooledAllocator.h"
+
+#include "Mem.h"
+#include "Mutex.h"
+#include "MutexLock.h"
+#include "Result.h"
+#include "ResultRV.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+
+namespace expanse
+{
+	struct PooledAllocator::ThreadCache
+	{
+		ThreadCache();
+
+		ThreadCache *m_nextCache;
+		FreeSlot *m_freeLists[kNumSizeClasses];
+		size_t m_numFree[kNumSizeClasses];
+	};
+
+	struct PooledAllocator::SlabMapLeaf
+	{
+		SlabMapLeaf();
+
+		static const size_t kNumWords = (static_cast<size_t>(1) << kSlabMapLeafBits) / 32u;
+
+		std::atomic<uint32_t> m_words[kNumWords];
+	};
+
+	const size_t PooledAllocator::kSlabSize;
+	const size_t PooledAllocator::kMaxSmallSize;
+	const size_t PooledAllocator::kSizeClassGranularity;
+	const size_t PooledAllocator::kNumSizeClasses;
+	const size_t PooledAllocator::kSlabDataOffset;
+	const size_t PooledAllocator::kSlabsPerSegment;
+	const size_t PooledAllocator::kLargeGranularity;
+	const size_t PooledAllocator::kLargeDataOffset;
+	const unsigned int PooledAllocator::kSlabIndexBits;
+	const unsigned int PooledAllocator::kSlabMapLeafBits;
+	const size_t PooledAllocator::kSlabMapRootSize;
+	const size_t PooledAllocator::kMaxThreadCacheBindings;
+	const size_t PooledAllocator::SlabMapLeaf::kNumWords;
+
+	// Four classes per doubling above 128 bytes keeps the worst case internal waste at 25%
+	const uint32_t PooledAllocator::kSizeClassSlotSizes[kNumSizeClasses] =
+	{
+		16, 32, 48, 64, 80, 96, 112, 128,
+		160, 192, 224, 256,
+		320, 384, 448, 512,
+		640, 768, 896, 1024,
+		1280, 1536, 1792, 2048,
+		2560, 3072, 3584, 4096,
+		5120, 6144, 7168, 8192,
+		10240, 12288, 14336, 16384,
+	};
+
+	std::atomic<uint64_t> PooledAllocator::ms_nextSerial(1);
+	thread_local PooledAllocator::ThreadCacheBindings PooledAllocator::ms_threadCacheBindings;
+
+	PooledAllocator::Stats::Stats()
+		: m_liveBytes(0)
+		, m_peakLiveBytes(0)
+		, m_numLargeAllocations(0)
+		, m_numInPlaceReallocs(0)
+	{
+	}
+
+	PooledAllocator::SizeClassStats::SizeClassStats()
+		: m_slotSize(0)
+		, m_numAllocations(0)
+		, m_numLive(0)
+	{
+	}
+
+	PooledAllocator::SizeClassPool::SizeClassPool()
+		: m_slotSize(0)
+		, m_batchSize(0)
+		, m_freeList(nullptr)
+		, m_unusedStart(nullptr)
+		, m_unusedEnd(nullptr)
+		, m_numAllocations(0)
+		, m_numLive(0)
+	{
+	}
+
+	PooledAllocator::ThreadCache::ThreadCache()
+		: m_nextCache(nullptr)
+	{
+		for (size_t i = 0; i < kNumSizeClasses; i++)
+		{
+			m_freeLists[i] = nullptr;
+			m_numFree[i] = 0;
+		}
+	}
+
+	PooledAllocator::SlabMapLeaf::SlabMapLeaf()
+	{
+		for (size_t i = 0; i < kNumWords; i++)
+			m_words[i].store(0, std::memory_order_relaxed);
+	}
+
+	PooledAllocator::PooledAllocator(IAllocator *backingAlloc, bool collectStats)
+		: m_backingAlloc(backingAlloc)
+		, m_collectStats(collectStats)
+		, m_serial(ms_nextSerial.fetch_add(1, std::memory_order_relaxed))
+		, m_firstSegment(nullptr)
+		, m_numSlabsUsedInSegment(kSlabsPerSegment)
+		, m_firstThreadCache(nullptr)
+		, m_liveBytes(0)
+		, m_peakLiveBytes(0)
+		, m_numLargeAllocations(0)
+		, m_numInPlaceReallocs(0)
+	{
+		size_t sizeClass = 0;
+		for (size_t i = 0; i <= kMaxSmallSize / kSizeClassGranularity; i++)
+		{
+			while (kSizeClassSlotSizes[sizeClass] < i * kSizeClassGranularity)
+				sizeClass++;
+
+			m_sizeClassForSize[i] = static_cast<uint8_t>(sizeClass);
+		}
+	}
+
+	PooledAllocator::ThreadCacheBindings::~ThreadCacheBindings()
+	{
+		for (size_t i = 0; i < kMaxThreadCacheBindings; i++)
+		{
+			ThreadCacheBinding &binding = m_bindings[i];
+			if (binding.m_allocatorSerial != 0)
+				binding.m_allocator->ReleaseThreadCache(binding.m_cache);
+
+			binding.m_allocatorSerial = 0;
+		}
+	}
+
+	PooledAllocator::~PooledAllocator()
+	{
+		// The destroying thread's binding would otherwise be drained into this allocator after it's gone
+		for (size_t i = 0; i < kMaxThreadCacheBindings; i++)
+		{
+			ThreadCacheBinding &binding = ms_threadCacheBindings.m_bindings[i];
+			if (binding.m_allocatorSerial == m_serial)
+				binding.m_allocatorSerial = 0;
+		}
+
+		ThreadCache *cache = m_firstThreadCache;
+		while (cache != nullptr)
+		{
+			ThreadCache *nextCache = cache->m_nextCache;
+			cache->~ThreadCache();
+			m_backingAlloc->Release(cache);
+			cache = nextCache;
+		}
+
+		SlabHeader *segment = m_firstSegment;
+		while (segment != nullptr)
+		{
+			SlabHeader *nextSegment = segment->m_nextSegment;
+			m_backingAlloc->Release(segment);
+			segment = nextSegment;
+		}
+
+		for (size_t i = 0; i < m_slabMap.Count(); i++)
+		{
+			SlabMapLeaf *leaf = m_slabMap[i].load(std::memory_order_relaxed);
+			if (leaf != nullptr)
+			{
+				leaf->~SlabMapLeaf();
+				m_backingAlloc->Release(leaf);
+			}
+		}
+	}
+
+	Result PooledAllocator::Initialize()
+	{
+		CHECK_RV(ArrayPtr<SizeClassPool>, pools, NewArray<SizeClassPool>(m_backingAlloc, kNumSizeClasses));
+
+		for (size_t i = 0; i < kNumSizeClasses; i++)
+		{
+			SizeClassPool &pool = pools[i];
+
+			CHECK_RV_ASSIGN(pool.m_mutex, Mutex::Create(m_backingAlloc));
+			pool.m_slotSize = kSizeClassSlotSizes[i];
+
+			// Move around 32kB per batch, but not so few slots that big classes hit the lock every other call
+			pool.m_batchSize = std::max<size_t>(4, std::min<size_t>(64, 32 * 1024 / pool.m_slotSize));
+		}
+
+		CHECK_RV(ArrayPtr<std::atomic<SlabMapLeaf*>>, slabMap, NewArray<std::atomic<SlabMapLeaf*>>(m_backingAlloc, kSlabMapRootSize));
+		for (size_t i = 0; i < kSlabMapRootSize; i++)
+			slabMap[i].store(nullptr, std::memory_order_relaxed);
+
+		CHECK_RV(CorePtr<Mutex>, slabMutex, Mutex::Create(m_backingAlloc));
+		CHECK_RV(CorePtr<Mutex>, threadCacheMutex, Mutex::Create(m_backingAlloc));
+
+		m_pools = std::move(pools);
+		m_slabMap = std::move(slabMap);
+		m_slabMutex = std::move(slabMutex);
+		m_threadCacheMutex = std::move(threadCacheMutex);
+
+		return ErrorCode::kOK;
+	}
+
+	void *PooledAllocator::Alloc(size_t size, size_t alignment)
+	{
+		if (size == 0)
+			return nullptr;
+
+		if (size <= kMaxSmallSize && alignment <= kSlabDataOffset)
+		{
+			// Slots are aligned to the largest power of two that divides their size, up to the slab data offset
+			size_t sizeClass = m_sizeClassForSize[(size + kSizeClassGranularity - 1) / kSizeClassGranularity];
+			while (sizeClass < kNumSizeClasses && kSizeClassSlotSizes[sizeClass] % alignment != 0)
+				sizeClass++;
+
+			if (sizeClass < kNumSizeClasses)
+				return AllocSmall(sizeClass);
+		}
+
+		return AllocLarge(size, alignment);
+	}
+
+	void PooledAllocator::Release(void *ptr)
+	{
+		if (ptr == nullptr)
+			return;
+
+		const SlabHeader *slab = GetSlab(ptr);
+
+		if (IsSmallSlab(slab))
+		{
+			ReleaseSmall(ptr, slab->m_sizeClass);
+			return;
+		}
+
+		const LargeHeader *header = GetLargeHeader(ptr);
+
+		if (m_collectStats)
+			RemoveLiveBytes(header->m_capacity);
+
+		m_backingAlloc->Release(header->m_block);
+	}
+
+	void *PooledAllocator::Realloc(void *ptr, size_t newSize, size_t alignment)
+	{
+		if (ptr == nullptr)
+			return this->Alloc(newSize, alignment);
+
+		if (newSize == 0)
+			return nullptr;
+
+		const SlabHeader *slab = GetSlab(ptr);
+		const size_t usableSize = IsSmallSlab(slab) ? m_pools[slab->m_sizeClass].m_slotSize : GetLargeHeader(ptr)->m_capacity;
+
+		if (newSize <= usableSize && reinterpret_cast<uintptr_t>(ptr) % static_cast<uintptr_t>(alignment) == 0)
+		{
+			if (m_collectStats)
+				m_numInPlaceReallocs.fetch_add(1, std::memory_order_relaxed);
+
+			return ptr;
+		}
+
+		void *newMem = this->Alloc(newSize, alignment);
+		if (newMem == nullptr)
+			return nullptr;
+
+		memcpy(newMem, ptr, std::min(usableSize, newSize));
+		this->Release(ptr);
+
+		return newMem;
+	}
+
+	bool PooledAllocator::IsCollectingStats() const
+	{
+		return m_collectStats;
+	}
+
+	PooledAllocator::Stats PooledAllocator::GetStats() const
+	{
+		Stats stats;
+		stats.m_liveBytes = m_liveBytes.load(std::memory_order_relaxed);
+		stats.m_peakLiveBytes = m_peakLiveBytes.load(std::memory_order_relaxed);
+		stats.m_numLargeAllocations = m_numLargeAllocations.load(std::memory_order_relaxed);
+		stats.m_numInPlaceReallocs = m_numInPlaceReallocs.load(std::memory_order_relaxed);
+
+		return stats;
+	}
+
+	size_t PooledAllocator::GetNumSizeClasses() const
+	{
+		return kNumSizeClasses;
+	}
+
+	PooledAllocator::SizeClassStats PooledAllocator::GetSizeClassStats(size_t sizeClass) const
+	{
+		const SizeClassPool &pool = m_pools[sizeClass];
+
+		SizeClassStats stats;
+		stats.m_slotSize = pool.m_slotSize;
+		stats.m_numAllocations = pool.m_numAllocations.load(std::memory_order_relaxed);
+		stats.m_numLive = pool.m_numLive.load(std::memory_order_relaxed);
+
+		return stats;
+	}
+
+	PooledAllocator::SlabHeader *PooledAllocator::GetSlab(void *ptr)
+	{
+		return reinterpret_cast<SlabHeader*>(reinterpret_cast<uintptr_t>(ptr) & ~static_cast<uintptr_t>(kSlabSize - 1));
+	}
+
+	PooledAllocator::LargeHeader *PooledAllocator::GetLargeHeader(void *ptr)
+	{
+		return reinterpret_cast<LargeHeader*>(static_cast<uint8_t*>(ptr) - sizeof(LargeHeader));
+	}
+
+	bool PooledAllocator::MarkSmallSlabs(const SlabHeader *firstSlab, size_t numSlabs)
+	{
+		const uintptr_t firstIndex = reinterpret_cast<uintptr_t>(firstSlab) / kSlabSize;
+
+		// Beyond the range of the map, which no OS hands out without being asked to
+		if ((firstIndex + numSlabs - 1u) >> kSlabIndexBits != 0)
+			return false;
+
+		// Create every leaf first so that a failure doesn't leave some of the slabs marked
+		for (size_t i = 0; i < numSlabs; i++)
+		{
+			std::atomic<SlabMapLeaf*> &leafSlot = m_slabMap[(firstIndex + i) >> kSlabMapLeafBits];
+			if (leafSlot.load(std::memory_order_relaxed) != nullptr)
+				continue;
+
+			void *mem = m_backingAlloc->Alloc(sizeof(SlabMapLeaf), alignof(SlabMapLeaf));
+			if (mem == nullptr)
+				return false;
+
+			leafSlot.store(new (mem) SlabMapLeaf(), std::memory_order_release);
+		}
+
+		for (size_t i = 0; i < numSlabs; i++)
+		{
+			const uintptr_t slabIndex = firstIndex + i;
+			SlabMapLeaf *leaf = m_slabMap[slabIndex >> kSlabMapLeafBits].load(std::memory_order_relaxed);
+
+			const size_t bitIndex = static_cast<size_t>(slabIndex & ((static_cast<uintptr_t>(1) << kSlabMapLeafBits) - 1u));
+			leaf->m_words[bitIndex / 32u].fetch_or(static_cast<uint32_t>(1) << (bitIndex % 32u), std::memory_order_release);
+		}
+
+		return true;
+	}
+
+	bool PooledAllocator::IsSmallSlab(const SlabHeader *slab) const
+	{
+		const uintptr_t slabIndex = reinterpret_cast<uintptr_t>(slab) / kSlabSize;
+		if (slabIndex >> kSlabIndexBits != 0)
+			return false;
+
+		const SlabMapLeaf *leaf = m_slabMap[slabIndex >> kSlabMapLeafBits].load(std::memory_order_acquire);
+		if (leaf == nullptr)
+			return false;
+
+		const size_t bitIndex = static_cast<size_t>(slabIndex & ((static_cast<uintptr_t>(1) << kSlabMapLeafBits) - 1u));
+		return ((leaf->m_words[bitIndex / 32u].load(std::memory_order_acquire) >> (bitIndex % 32u)) & 1u) != 0;
+	}
+
+	void *PooledAllocator::AllocSmall(size_t sizeClass)
+	{
+		SizeClassPool &pool = m_pools[sizeClass];
+		ThreadCache *cache = GetThreadCache();
+
+		FreeSlot *slot = nullptr;
+
+		if (cache != nullptr)
+		{
+			if (cache->m_freeLists[sizeClass] == nullptr)
+			{
+				MutexLock lock(pool.m_mutex);
+				cache->m_numFree[sizeClass] = TakeSlotsLocked(pool, sizeClass, pool.m_batchSize, cache->m_freeLists[sizeClass]);
+			}
+
+			slot = cache->m_freeLists[sizeClass];
+			if (slot == nullptr)
+				return nullptr;
+
+			cache->m_freeLists[sizeClass] = slot->m_next;
+			cache->m_numFree[sizeClass]--;
+		}
+		else
+		{
+			MutexLock lock(pool.m_mutex);
+			if (TakeSlotsLocked(pool, sizeClass, 1, slot) == 0)
+				return nullptr;
+		}
+
+		if (m_collectStats)
+		{
+			pool.m_numAllocations.fetch_add(1, std::memory_order_relaxed);
+			pool.m_numLive.fetch_add(1, std::memory_order_relaxed);
+			AddLiveBytes(pool.m_slotSize);
+		}
+
+		return slot;
+	}
+
+	void PooledAllocator::ReleaseSmall(void *ptr, size_t sizeClass)
+	{
+		SizeClassPool &pool = m_pools[sizeClass];
+		FreeSlot *slot = static_cast<FreeSlot*>(ptr);
+
+		if (m_collectStats)
+		{
+			pool.m_numLive.fetch_sub(1, std::memory_order_relaxed);
+			RemoveLiveBytes(pool.m_slotSize);
+		}
+
+		ThreadCache *cache = GetThreadCache();
+		if (cache == nullptr)
+		{
+			ReturnBatch(pool, slot, slot);
+			return;
+		}
+
+		slot->m_next = cache->m_freeLists[sizeClass];
+		cache->m_freeLists[sizeClass] = slot;
+		cache->m_numFree[sizeClass]++;
+
+		// Slots released on a different thread than they were allocated on pile up here, keep one batch and
+		// hand another back to the pool
+		if (cache->m_numFree[sizeClass] > pool.m_batchSize * 2u)
+		{
+			FreeSlot *last = slot;
+			for (size_t i = 1; i < pool.m_batchSize; i++)
+				last = last->m_next;
+
+			cache->m_freeLists[sizeClass] = last->m_next;
+			cache->m_numFree[sizeClass] -= pool.m_batchSize;
+
+			ReturnBatch(pool, slot, last);
+		}
+	}
+
+	void *PooledAllocator::AllocLarge(size_t size, size_t alignment)
+	{
+		static_assert(sizeof(LargeHeader) <= kLargeDataOffset, "Large allocation header doesn't fit before the data");
+
+		// The block only needs the data's own alignment, the header sits in the padding in front of it
+		const size_t blockAlignment = std::max(kLargeDataOffset, alignment);
+		const size_t dataOffset = blockAlignment;
+		if (size > std::numeric_limits<size_t>::max() - dataOffset - kLargeGranularity)
+			return nullptr;
+
+		const size_t totalSize = (dataOffset + size + kLargeGranularity - 1u) & ~(kLargeGranularity - 1u);
+
+		void *mem = m_backingAlloc->Alloc(totalSize, blockAlignment);
+		if (mem == nullptr)
+			return nullptr;
+
+		uint8_t *data = static_cast<uint8_t*>(mem) + dataOffset;
+
+		LargeHeader *header = GetLargeHeader(data);
+		header->m_block = mem;
+		header->m_capacity = totalSize - dataOffset;
+
+		if (m_collectStats)
+		{
+			m_numLargeAllocations.fetch_add(1, std::memory_order_relaxed);
+			AddLiveBytes(header->m_capacity);
+		}
+
+		return data;
+	}
+
+	size_t PooledAllocator::TakeSlotsLocked(SizeClassPool &pool, size_t sizeClass, size_t maxSlots, FreeSlot *&outFirst)
+	{
+		FreeSlot *first = nullptr;
+		size_t numTaken = 0;
+
+		while (numTaken < maxSlots)
+		{
+			FreeSlot *slot = pool.m_freeList;
+
+			if (slot != nullptr)
+				pool.m_freeList = slot->m_next;
+			else
+			{
+				if (static_cast<size_t>(pool.m_unusedEnd - pool.m_unusedStart) < pool.m_slotSize)
+				{
+					// Don't start a new slab just to fill up a batch
+					if (numTaken > 0)
+						break;
+
+					SlabHeader *slab = AllocSlab();
+					if (slab == nullptr)
+						break;
+
+					slab->m_sizeClass = sizeClass;
+
+					pool.m_unusedStart = reinterpret_cast<uint8_t*>(slab) + kSlabDataOffset;
+					pool.m_unusedEnd = reinterpret_cast<uint8_t*>(slab) + kSlabSize;
+				}
+
+				slot = reinterpret_cast<FreeSlot*>(pool.m_unusedStart);
+				pool.m_unusedStart += pool.m_slotSize;
+			}
+
+			slot->m_next = first;
+			first = slot;
+			numTaken++;
+		}
+
+		outFirst = first;
+		return numTaken;
+	}
+
+	void PooledAllocator::ReturnBatch(SizeClassPool &pool, FreeSlot *first, FreeSlot *last)
+	{
+		MutexLock lock(pool.m_mutex);
+
+		last->m_next = pool.m_freeList;
+		pool.m_freeList = first;
+	}
+
+	PooledAllocator::SlabHeader *PooledAllocator::AllocSlab()
+	{
+		MutexLock lock(m_slabMutex);
+
+		if (m_numSlabsUsedInSegment == kSlabsPerSegment)
+		{
+			// Slabs come in segments so that the backing allocator's alignment padding is paid once per segment
+			void *mem = m_backingAlloc->Alloc(kSlabSize * kSlabsPerSegment, kSlabSize);
+			if (mem == nullptr)
+				return nullptr;
+
+			SlabHeader *segment = static_cast<SlabHeader*>(mem);
+			if (!MarkSmallSlabs(segment, kSlabsPerSegment))
+			{
+				m_backingAlloc->Release(mem);
+				return nullptr;
+			}
+
+			segment->m_nextSegment = m_firstSegment;
+
+			m_firstSegment = segment;
+			m_numSlabsUsedInSegment = 0;
+		}
+
+		uint8_t *slabMem = reinterpret_cast<uint8_t*>(m_firstSegment) + m_numSlabsUsedInSegment * kSlabSize;
+		m_numSlabsUsedInSegment++;
+
+		SlabHeader *slab = reinterpret_cast<SlabHeader*>(slabMem);
+		if (slab != m_firstSegment)
+			slab->m_nextSegment = nullptr;
+
+		return slab;
+	}
+
+	PooledAllocator::ThreadCache *PooledAllocator::GetThreadCache()
+	{
+		ThreadCacheBinding *freeBinding = nullptr;
+
+		for (size_t i = 0; i < kMaxThreadCacheBindings; i++)
+		{
+			ThreadCacheBinding &binding = ms_threadCacheBindings.m_bindings[i];
+			if (binding.m_allocatorSerial == m_serial)
+				return binding.m_cache;
+
+			if (binding.m_allocatorSerial == 0 && freeBinding == nullptr)
+				freeBinding = &binding;
+		}
+
+		// A thread that has used up all of its bindings goes straight to the pools
+		if (freeBinding == nullptr)
+			return nullptr;
+
+		void *mem = m_backingAlloc->Alloc(sizeof(ThreadCache), alignof(ThreadCache));
+		if (mem == nullptr)
+			return nullptr;
+
+		ThreadCache *cache = new (mem) ThreadCache();
+
+		{
+			MutexLock lock(m_threadCacheMutex);
+			cache->m_nextCache = m_firstThreadCache;
+			m_firstThreadCache = cache;
+		}
+
+		freeBinding->m_allocatorSerial = m_serial;
+		freeBinding->m_allocator = this;
+		freeBinding->m_cache = cache;
+
+		return cache;
+	}
+
+	void PooledAllocator::ReleaseThreadCache(ThreadCache *cache)
+	{
+		for (size_t sizeClass = 0; sizeClass < kNumSizeClasses; sizeClass++)
+		{
+			FreeSlot *first = cache->m_freeLists[sizeClass];
+			if (first == nullptr)
+				continue;
+
+			FreeSlot *last = first;
+			while (last->m_next != nullptr)
+				last = last->m_next;
+
+			ReturnBatch(m_pools[sizeClass], first, last);
+		}
+
+		{
+			MutexLock lock(m_threadCacheMutex);
+
+			ThreadCache **link = &m_firstThreadCache;
+			while (*link != cache)
+				link = &(*link)->m_nextCache;
+
+			*link = cache->m_nextCache;
+		}
+
+		cache->~ThreadCache();
+		m_backingAlloc->Release(cache);
+	}
+
+	void PooledAllocator::AddLiveBytes(size_t size)
+	{
+		const uint64_t liveBytes = m_liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+		uint64_t peakLiveBytes = m_peakLiveBytes.load(std::memory_order_relaxed);
+		while (liveBytes > peakLiveBytes)
+		{
+			if (m_peakLiveBytes.compare_exchange_weak(peakLiveBytes, liveBytes, std::memory_order_relaxed))
+				break;
+		}
+	}
+
+	void PooledAllocator::RemoveLiveBytes(size_t size)
+	{
+		m_liveBytes.fetch_sub(size, std::memory_order_relaxed);
+	}
+}
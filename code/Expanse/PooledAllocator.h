@@ -0,0 +1,192 @@
+#pragma once
+
+#include "ArrayPtr.h"
+#include "CorePtr.h"
+#include "IAllocator.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	struct Result;
+	class Mutex;
+
+	// General purpose allocator that serves small requests from per-size-class pools of fixed-size slots, carved out
+	// of slabs taken from a backing allocator.  Each thread keeps a cache of free slots per size class and only takes
+	// the size class's lock to move a batch of slots in or out of it, so threads sharing the allocator rarely contend
+	// with each other and never on the backing allocator for small objects.
+	//
+	// Slabs are aligned to kSlabSize and start with a header naming their size class, so slots carry no header of
+	// their own.  Every slab is marked in a bitmap indexed by address, which is how Release tells slots apart from
+	// everything else.  Requests larger than kMaxSmallSize, or more aligned than any slot that fits them, get a block
+	// from the backing allocator with only their own alignment and a header just before the data, rounded up so that
+	// Realloc can usually grow them in place.  Slabs are only returned to the backing allocator when the pooled
+	// allocator is destroyed.
+	//
+	// A thread's caches are drained back into the pools when the thread exits.  Threads other than the one destroying
+	// the allocator have to exit before it's destroyed.
+	class PooledAllocator final : public IAllocator
+	{
+	public:
+		struct Stats
+		{
+			Stats();
+
+			uint64_t m_liveBytes;
+			uint64_t m_peakLiveBytes;
+			uint64_t m_numLargeAllocations;
+			uint64_t m_numInPlaceReallocs;
+		};
+
+		struct SizeClassStats
+		{
+			SizeClassStats();
+
+			size_t m_slotSize;
+			uint64_t m_numAllocations;
+			uint64_t m_numLive;
+		};
+
+		// Stats cost a few atomic operations per call, so they're only collected if asked for
+		PooledAllocator(IAllocator *backingAlloc, bool collectStats);
+		~PooledAllocator();
+
+		Result Initialize();
+
+		void *Alloc(size_t size, size_t alignment) override;
+		void Release(void *ptr) override;
+		void *Realloc(void *ptr, size_t newSize, size_t alignment) override;
+
+		// Counters are read without stopping other threads, so they can be slightly behind while they allocate
+		bool IsCollectingStats() const;
+		Stats GetStats() const;
+		size_t GetNumSizeClasses() const;
+		SizeClassStats GetSizeClassStats(size_t sizeClass) const;
+
+		static const size_t kSlabSize = 64 * 1024;
+		static const size_t kMaxSmallSize = 16 * 1024;
+		static const size_t kSizeClassGranularity = 16;
+
+	private:
+		struct FreeSlot
+		{
+			FreeSlot *m_next;
+		};
+
+		struct SlabHeader
+		{
+			size_t m_sizeClass;
+			SlabHeader *m_nextSegment;	// First slab of each segment only
+		};
+
+		// Immediately before the data of a large allocation
+		struct LargeHeader
+		{
+			void *m_block;				// As returned by the backing allocator
+			size_t m_capacity;			// Usable bytes
+		};
+
+		struct SlabMapLeaf;
+
+		struct SizeClassPool
+		{
+			SizeClassPool();
+
+			CorePtr<Mutex> m_mutex;
+			size_t m_slotSize;
+			size_t m_batchSize;
+
+			// Guarded by m_mutex
+			FreeSlot *m_freeList;
+			uint8_t *m_unusedStart;		// Part of the newest slab that was never handed out
+			uint8_t *m_unusedEnd;
+
+			std::atomic<uint64_t> m_numAllocations;
+			std::atomic<uint64_t> m_numLive;
+		};
+
+		struct ThreadCache;
+
+		struct ThreadCacheBinding
+		{
+			uint64_t m_allocatorSerial;
+			PooledAllocator *m_allocator;
+			ThreadCache *m_cache;
+		};
+
+		static const size_t kNumSizeClasses = 36;
+		static const size_t kSlabDataOffset = 64;
+		static const size_t kSlabsPerSegment = 16;
+		static const size_t kLargeGranularity = 4096;
+		static const size_t kLargeDataOffset = 16;
+		static const unsigned int kSlabIndexBits = (sizeof(uintptr_t) >= 8 ? 48 : 32) - 16;
+		static const unsigned int kSlabMapLeafBits = (kSlabIndexBits < 20) ? kSlabIndexBits : 20;
+		static const size_t kSlabMapRootSize = static_cast<size_t>(1) << (kSlabIndexBits - kSlabMapLeafBits);
+		static const size_t kMaxThreadCacheBindings = 4;
+		static const uint32_t kSizeClassSlotSizes[kNumSizeClasses];
+
+		// Drains the thread's caches when it exits
+		struct ThreadCacheBindings
+		{
+			~ThreadCacheBindings();
+
+			ThreadCacheBinding m_bindings[kMaxThreadCacheBindings];
+		};
+
+		PooledAllocator(const PooledAllocator &other) = delete;
+		PooledAllocator &operator=(const PooledAllocator &other) = delete;
+
+		static SlabHeader *GetSlab(void *ptr);
+		static LargeHeader *GetLargeHeader(void *ptr);
+
+		// Only ever called with m_slabMutex held, but IsSmallSlab can be called from anywhere
+		bool MarkSmallSlabs(const SlabHeader *firstSlab, size_t numSlabs);
+		bool IsSmallSlab(const SlabHeader *slab) const;
+
+		void *AllocSmall(size_t sizeClass);
+		void ReleaseSmall(void *ptr, size_t sizeClass);
+		void *AllocLarge(size_t size, size_t alignment);
+
+		// Unlinks up to maxSlots free slots as a null-terminated list, carving a new slab if the pool is empty.
+		// Returns the number of slots taken.  Called with the pool locked.
+		size_t TakeSlotsLocked(SizeClassPool &pool, size_t sizeClass, size_t maxSlots, FreeSlot *&outFirst);
+		void ReturnBatch(SizeClassPool &pool, FreeSlot *first, FreeSlot *last);
+
+		SlabHeader *AllocSlab();
+		ThreadCache *GetThreadCache();
+
+		// Returns all of a cache's free slots to the pools and releases it
+		void ReleaseThreadCache(ThreadCache *cache);
+
+		void AddLiveBytes(size_t size);
+		void RemoveLiveBytes(size_t size);
+
+		IAllocator *m_backingAlloc;
+		bool m_collectStats;
+		uint64_t m_serial;
+
+		uint8_t m_sizeClassForSize[kMaxSmallSize / kSizeClassGranularity + 1];
+		ArrayPtr<SizeClassPool> m_pools;
+
+		CorePtr<Mutex> m_slabMutex;
+		SlabHeader *m_firstSegment;		// Guarded by m_slabMutex
+		size_t m_numSlabsUsedInSegment;
+
+		// One bit per kSlabSize of address space, set for slabs of small slots.  Leaves are created under
+		// m_slabMutex and released when the allocator is destroyed.
+		ArrayPtr<std::atomic<SlabMapLeaf*>> m_slabMap;
+
+		CorePtr<Mutex> m_threadCacheMutex;
+		ThreadCache *m_firstThreadCache;	// Guarded by m_threadCacheMutex
+
+		std::atomic<uint64_t> m_liveBytes;
+		std::atomic<uint64_t> m_peakLiveBytes;
+		std::atomic<uint64_t> m_numLargeAllocations;
+		std::atomic<uint64_t> m_numInPlaceReallocs;
+
+		static std::atomic<uint64_t> ms_nextSerial;
+		static thread_local ThreadCacheBindings ms_threadCacheBindings;
+	};
+}
@@ -0,0 +1,144 @@
+#include "SynchronousFileSystem_Posix.h"
+
+#include "CorePtr.h"
+#include "FileStream_Posix.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "StrUtils.h"
+#include "XString.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace expanse
+{
+	SynchronousFileSystem_Posix::SynchronousFileSystem_Posix()
+	{
+	}
+
+	ResultRV<CorePtr<FileStream>> SynchronousFileSystem_Posix::Open(const UTF8StringView_t &device, const UTF8StringView_t &path, Permission permission, CreationDisposition creationDisposition)
+	{
+		CHECK_RV(CorePtr<FileStream_Posix>, fileStream, OpenPosix(device, path, permission, creationDisposition));
+
+		return CorePtr<FileStream>(std::move(fileStream));
+	}
+
+	ResultRV<CorePtr<FileStream_Posix>> SynchronousFileSystem_Posix::OpenPosix(const UTF8StringView_t &device, const UTF8StringView_t &path, Permission permission, CreationDisposition creationDisposition)
+	{
+		IAllocator *alloc = GetCoreObjectAllocator();
+
+		CHECK_RV(CorePtr<FileStream_Posix>, fileStream, New<FileStream_Posix>(alloc));
+		CHECK_RV(UTF8String_t, canonicalPath, CanonicalizePath(device, path));
+
+		if (canonicalPath == nullptr)
+			return ErrorCode::kInvalidPath;
+
+		bool readable = false;
+		bool writeable = false;
+
+		int flags = O_CLOEXEC;
+		switch (permission)
+		{
+		case Permission::kRead:
+			flags |= O_RDONLY;
+			readable = true;
+			break;
+		case Permission::kWrite:
+			flags |= O_WRONLY;
+			writeable = true;
+			break;
+		case Permission::kReadWrite:
+			flags |= O_RDWR;
+			readable = true;
+			writeable = true;
+			break;
+		default:
+			return ErrorCode::kInvalidArgument;
+		}
+
+		switch (creationDisposition)
+		{
+		case CreationDisposition::kCreateAlways:
+			flags |= (O_CREAT | O_TRUNC);
+			break;
+		case CreationDisposition::kCreateNew:
+			flags |= (O_CREAT | O_EXCL);
+			break;
+		case CreationDisposition::kOpenAlways:
+			flags |= O_CREAT;
+			break;
+		case CreationDisposition::kOpenExisting:
+			break;
+		case CreationDisposition::kTruncateExisting:
+			flags |= O_TRUNC;
+			break;
+		default:
+			return ErrorCode::kInvalidArgument;
+		}
+
+		const char *pathStr = reinterpret_cast<const char *>(canonicalPath.GetChars().begin());
+
+		int fd = -1;
+		do
+		{
+			fd = open(pathStr, flags, 0666);
+		} while (fd < 0 && errno == EINTR);
+
+		if (fd < 0)
+		{
+			if (errno == ENOENT || errno == ENOTDIR)
+				return ErrorCode::kFileNotFound;
+			else
+				return ErrorCode::kIOError;
+		}
+
+		fileStream->Init(fd, readable, writeable);
+
+		return fileStream;
+	}
+
+	Result SynchronousFileSystem_Posix::SetGamePath(const UTF8StringView_t &gamePath)
+	{
+		IAllocator *alloc = GetCoreObjectAllocator();
+
+		if (gamePath.Length() > 0)
+		{
+			CHECK_RV(UTF8String_t, pathCopy, gamePath.CloneToString(alloc));
+
+			m_gamePath = std::move(pathCopy);
+
+			const uint8_t lastChar = gamePath.GetChars()[gamePath.Length() - 1];
+			if (lastChar != '/')
+			{
+				CHECK(StrUtils::Append(alloc, m_gamePath, UTF8StringView_t("/")));
+			}
+		}
+
+		return ErrorCode::kOK;
+	}
+
+	ResultRV<UTF8String_t> SynchronousFileSystem_Posix::CanonicalizePath(const UTF8StringView_t &device, const UTF8StringView_t &path)
+	{
+		const UTF8String_t *basePath = nullptr;
+		if (device == UTF8StringView_t("game"))
+			basePath = &m_gamePath;
+
+		if (!basePath)
+			return UTF8String_t();
+
+		const ArrayView<const uint8_t> pathChars = path.GetChars();
+		for (size_t i = 0; i < pathChars.Size(); i++)
+		{
+			if (pathChars[i] == 0)
+				return ErrorCode::kInvalidPath;
+		}
+
+		IAllocator *alloc = GetCoreObjectAllocator();
+
+		CHECK_RV(UTF8String_t, pathUTF8, basePath->Clone(alloc));
+		CHECK(StrUtils::Append(alloc, pathUTF8, path));
+
+		return pathUTF8;
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "SynchronousFileSystem.h"
+#include "StringProto.h"
+#include "XString.h"
+
+namespace expanse
+{
+	class FileStream_Posix;
+	struct IAllocator;
+	struct Result;
+	template<class T> struct ResultRV;
+
+	class SynchronousFileSystem_Posix : public SynchronousFileSystem
+	{
+	public:
+		SynchronousFileSystem_Posix();
+
+		ResultRV<CorePtr<FileStream>> Open(const UTF8StringView_t &device, const UTF8StringView_t &path, Permission permission, CreationDisposition creationDisposition) override;
+
+		// Same as Open, but exposes the descriptor-backed stream so the async file system can issue positional reads
+		ResultRV<CorePtr<FileStream_Posix>> OpenPosix(const UTF8StringView_t &device, const UTF8StringView_t &path, Permission permission, CreationDisposition creationDisposition);
+
+		Result SetGamePath(const UTF8StringView_t &gamePath);
+
+	private:
+		ResultRV<UTF8String_t> CanonicalizePath(const UTF8StringView_t &device, const UTF8StringView_t &path);
+
+		UTF8String_t m_gamePath;
+	};
+}
@@ -3,6 +3,8 @@
 #include "CoreObject.h"
 #include "StringProto.h"
 
+#include <cstddef>
+
 namespace expanse
 {
 	typedef int(*ThreadFunc_t)(void *userdata);
@@ -22,6 +24,11 @@ namespace expanse
 
 		static ResultRV<CorePtr<Thread>> CreateThread(IAllocator *alloc, ThreadFunc_t threadFunc, void *userData, const UTF8StringView_t &name);
 
+		// stackSize is only reserved up front, pages are committed as the stack grows into them
+		static ResultRV<CorePtr<Thread>> CreateThread(IAllocator *alloc, ThreadFunc_t threadFunc, void *userData, const UTF8StringView_t &name, size_t stackSize);
+
+		static const size_t kDefaultStackSize = 1024 * 1024;
+
 	protected:
 		Thread();
 	};
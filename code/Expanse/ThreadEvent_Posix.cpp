@@ -0,0 +1,88 @@
+#include "ThreadEvent_Posix.h"
+
+#include "Mem.h"
+#include "Result.h"
+#include "ResultRV.h"
+
+#include <errno.h>
+#include <time.h>
+
+namespace expanse
+{
+	ThreadEvent_Posix::ThreadEvent_Posix(bool autoReset, bool startSignaled)
+		: m_autoReset(autoReset)
+		, m_signaled(startSignaled)
+	{
+		pthread_mutex_init(&m_mutex, nullptr);
+		pthread_cond_init(&m_cond, nullptr);
+	}
+
+	ThreadEvent_Posix::~ThreadEvent_Posix()
+	{
+		pthread_cond_destroy(&m_cond);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	void ThreadEvent_Posix::WaitTimed(uint32_t msec)
+	{
+		timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+
+		deadline.tv_sec += static_cast<time_t>(msec / 1000u);
+		deadline.tv_nsec += static_cast<long>(msec % 1000u) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		pthread_mutex_lock(&m_mutex);
+		while (!m_signaled)
+		{
+			if (pthread_cond_timedwait(&m_cond, &m_mutex, &deadline) == ETIMEDOUT)
+				break;
+		}
+
+		if (m_signaled && m_autoReset)
+			m_signaled = false;
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	void ThreadEvent_Posix::Wait()
+	{
+		pthread_mutex_lock(&m_mutex);
+		while (!m_signaled)
+			pthread_cond_wait(&m_cond, &m_mutex);
+
+		if (m_autoReset)
+			m_signaled = false;
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	void ThreadEvent_Posix::Set()
+	{
+		pthread_mutex_lock(&m_mutex);
+		m_signaled = true;
+		if (m_autoReset)
+			pthread_cond_signal(&m_cond);
+		else
+			pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	void ThreadEvent_Posix::Reset()
+	{
+		pthread_mutex_lock(&m_mutex);
+		m_signaled = false;
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	ResultRV<CorePtr<ThreadEvent>> ThreadEvent::Create(IAllocator *alloc, const UTF8StringView_t &name, bool autoReset, bool startSignaled)
+	{
+		(void)name;
+
+		CHECK_RV(CorePtr<ThreadEvent_Posix>, threadEvent, New<ThreadEvent_Posix>(alloc, autoReset, startSignaled));
+
+		return CorePtr<ThreadEvent>(std::move(threadEvent));
+	}
+}
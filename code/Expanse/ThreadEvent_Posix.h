@@ -0,0 +1,26 @@
+#pragma once
+
+#include "ThreadEvent.h"
+
+#include <pthread.h>
+
+namespace expanse
+{
+	class ThreadEvent_Posix final : public ThreadEvent
+	{
+	public:
+		ThreadEvent_Posix(bool autoReset, bool startSignaled);
+		~ThreadEvent_Posix() override;
+
+		void WaitTimed(uint32_t msec) override;
+		void Wait() override;
+		void Set() override;
+		void Reset() override;
+
+	private:
+		pthread_mutex_t m_mutex;
+		pthread_cond_t m_cond;
+		bool m_autoReset;
+		bool m_signaled;
+	};
+}
@@ -0,0 +1,131 @@
+#include "Thread_Posix.h"
+
+#include "ExpAssert.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "StringView.h"
+#include "ThreadEvent.h"
+
+#include <cstring>
+
+namespace expanse
+{
+	const size_t Thread::kDefaultStackSize;
+
+	std::atomic<ThreadID_t> Thread_Posix::ms_nextID(1);
+
+	Thread_Posix::~Thread_Posix()
+	{
+		if (m_haveThread)
+			WaitForExit();
+	}
+
+	bool Thread_Posix::IsRunning() const
+	{
+		EXP_ASSERT(m_haveThread);
+		return !m_exited.load(std::memory_order_acquire);
+	}
+
+	void Thread_Posix::WaitForExit() const
+	{
+		EXP_ASSERT(m_haveThread);
+		if (!m_joined)
+		{
+			pthread_join(m_thread, nullptr);
+			m_joined = true;
+		}
+	}
+
+	int Thread_Posix::GetExitCode() const
+	{
+		EXP_ASSERT(m_haveThread);
+		EXP_ASSERT(m_exited.load(std::memory_order_acquire));
+
+		return m_exitCode;
+	}
+
+	ThreadID_t Thread_Posix::GetID() const
+	{
+		return m_id;
+	}
+
+	Thread_Posix::Thread_Posix()
+		: m_thread()
+		, m_id(ms_nextID.fetch_add(1, std::memory_order_relaxed))
+		, m_exitCode(0)
+		, m_haveThread(false)
+		, m_joined(false)
+		, m_exited(false)
+	{
+	}
+
+	void Thread_Posix::Init(pthread_t thread)
+	{
+		m_thread = thread;
+		m_haveThread = true;
+	}
+
+	void *Thread_Posix::ThreadStart(void *threadParameter)
+	{
+		const ThreadStartData *startData = static_cast<const ThreadStartData *>(threadParameter);
+		ThreadFunc_t threadFunc = startData->m_threadFunc;
+		void *userData = startData->m_userdata;
+		Thread_Posix *thread = startData->m_thread;
+		ThreadEvent *startEvent = startData->m_startedEvent;
+
+#if defined(__linux__)
+		pthread_setname_np(pthread_self(), startData->m_name);
+#endif
+
+		startEvent->Set();
+
+		thread->m_exitCode = threadFunc(userData);
+		thread->m_exited.store(true, std::memory_order_release);
+
+		return nullptr;
+	}
+
+	ResultRV<CorePtr<Thread>> Thread::CreateThread(IAllocator *alloc, ThreadFunc_t threadFunc, void *userData, const UTF8StringView_t &name)
+	{
+		return CreateThread(alloc, threadFunc, userData, name, kDefaultStackSize);
+	}
+
+	ResultRV<CorePtr<Thread>> Thread::CreateThread(IAllocator *alloc, ThreadFunc_t threadFunc, void *userData, const UTF8StringView_t &name, size_t stackSize)
+	{
+		CHECK_RV(CorePtr<ThreadEvent>, startupEvent, ThreadEvent::Create(alloc, UTF8StringView_t("Thread Startup Event"), true, false));
+		CHECK_RV(CorePtr<Thread_Posix>, thread, New<Thread_Posix>(alloc));
+
+		// Linux limits thread names to 15 characters plus the terminator
+		char threadName[16];
+		const size_t nameLength = (name.Length() < sizeof(threadName) - 1) ? name.Length() : (sizeof(threadName) - 1);
+		if (nameLength > 0)
+			memcpy(threadName, name.GetChars().begin(), nameLength);
+		threadName[nameLength] = '\0';
+
+		Thread_Posix::ThreadStartData startData;
+		startData.m_name = threadName;
+		startData.m_startedEvent = startupEvent;
+		startData.m_thread = thread;
+		startData.m_threadFunc = threadFunc;
+		startData.m_userdata = userData;
+
+		pthread_attr_t attr;
+		if (pthread_attr_init(&attr) != 0)
+			return ErrorCode::kSystemError;
+
+		pthread_attr_setstacksize(&attr, stackSize);
+
+		pthread_t pthread;
+		const int createResult = pthread_create(&pthread, &attr, Thread_Posix::ThreadStart, &startData);
+		pthread_attr_destroy(&attr);
+
+		if (createResult != 0)
+			return ErrorCode::kSystemError;
+
+		startupEvent->Wait();
+
+		thread->Init(pthread);
+
+		return CorePtr<Thread>(std::move(thread));
+	}
+}
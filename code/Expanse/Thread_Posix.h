@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Thread.h"
+
+#include <atomic>
+#include <pthread.h>
+
+namespace expanse
+{
+	class ThreadEvent;
+
+	class Thread_Posix final : public Thread
+	{
+	public:
+		Thread_Posix();
+		~Thread_Posix() override;
+
+		virtual bool IsRunning() const override;
+		virtual void WaitForExit() const override;
+		virtual int GetExitCode() const override;
+		virtual ThreadID_t GetID() const override;
+
+	private:
+		friend class Thread;
+
+		struct ThreadStartData
+		{
+			ThreadFunc_t m_threadFunc;
+			void *m_userdata;
+			const char *m_name;
+			Thread_Posix *m_thread;
+			ThreadEvent *m_startedEvent;
+		};
+
+		void Init(pthread_t thread);
+
+		static void *ThreadStart(void *threadParameter);
+
+		pthread_t m_thread;
+		ThreadID_t m_id;
+		int m_exitCode;
+		bool m_haveThread;
+		mutable bool m_joined;
+		std::atomic<bool> m_exited;
+
+		static std::atomic<ThreadID_t> ms_nextID;
+	};
+}
@@ -9,6 +9,8 @@
 
 namespace expanse
 {
+	const size_t Thread::kDefaultStackSize;
+
 	Thread_Win32::~Thread_Win32()
 	{
 		if (m_handle)
@@ -72,6 +74,11 @@ namespace expanse
 	}
 
 	ResultRV<CorePtr<Thread>> Thread::CreateThread(IAllocator *alloc, ThreadFunc_t threadFunc, void *userData, const UTF8StringView_t &name)
+	{
+		return CreateThread(alloc, threadFunc, userData, name, kDefaultStackSize);
+	}
+
+	ResultRV<CorePtr<Thread>> Thread::CreateThread(IAllocator *alloc, ThreadFunc_t threadFunc, void *userData, const UTF8StringView_t &name, size_t stackSize)
 	{
 		CHECK_RV(ArrayPtr<wchar_t>, threadName, WindowsUtils::ConvertToWideChar(alloc, name));
 		CHECK_RV(CorePtr<ThreadEvent>, startupEvent, ThreadEvent::Create(alloc, UTF8StringView_t("Thread Startup Event"), true, false));
@@ -84,7 +91,7 @@ namespace expanse
 		startData.m_userdata = userData;
 
 		DWORD threadID = 0;
-		HANDLE hThread = ::CreateThread(nullptr, 1024 * 1024, Thread_Win32::ThreadStart, &startData, 0, &threadID);
+		HANDLE hThread = ::CreateThread(nullptr, stackSize, Thread_Win32::ThreadStart, &startData, STACK_SIZE_PARAM_IS_A_RESERVATION, &threadID);
 		if (hThread == nullptr)
 			return ErrorCode::kSystemError;
 
@@ -26,6 +26,7 @@ namespace expanse
 		const T &operator[](size_t index) const;
 
 		Result Resize(size_t newSize);
+		void Clear();	// Unlike Resize(0), keeps the storage for reuse
 		Result Add(T &&item);
 		Result Add(const T &item);
 		Result Add(const ArrayView<T> &elements);
@@ -85,6 +86,9 @@ namespace expanse
 			size--;
 			elements[size].~T();
 		}
+
+		if (elements)
+			m_alloc->Release(elements);
 	}
 
 	template<class T>
@@ -125,6 +129,17 @@ namespace expanse
 		return m_array[index];
 	}
 
+	template<class T>
+	void Vector<T>::Clear()
+	{
+		T *elements = m_array;
+		while (m_size > 0)
+		{
+			m_size--;
+			elements[m_size].~T();
+		}
+	}
+
 	template<class T>
 	Result Vector<T>::Resize(size_t newSize)
 	{
@@ -155,7 +170,7 @@ namespace expanse
 		{
 			T *elements = m_array;
 
-			if (newSize <= oldSize)
+			if (newSize > oldSize)
 			{
 				for (size_t i = oldSize; i < newSize; i++)
 					new (elements + i) T();
@@ -256,6 +271,8 @@ namespace expanse
 	{
 		if (this != &other)
 		{
+			this->~Vector();
+
 			m_array = other.m_array;
 			m_size = other.m_size;
 			m_capacity = other.m_capacity;
@@ -276,7 +293,7 @@ namespace expanse
 		const size_t maxElements = std::numeric_limits<size_t>::max() / sizeof(T);
 		const size_t size = m_size;
 
-		if (m_capacity - numAdditional < numAdditional)
+		if (m_capacity - size >= numAdditional)
 			return ErrorCode::kOK;
 
 		const size_t newCapacityRequired = size + numAdditional;
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "ArrayPtr.h"
+
+#include <atomic>
+#include <cstddef>
+
+namespace expanse
+{
+	struct IAllocator;
+	struct Result;
+
+	// Bounded Chase-Lev deque.  The owning thread pushes and pops at the bottom without contention, other threads
+	// steal from the top, so the owner works through its own items newest-first while thieves take the oldest ones.
+	// T must be trivially copyable.
+	template<class T>
+	struct WorkStealingDeque
+	{
+	public:
+		WorkStealingDeque();
+
+		// Capacity is rounded up to a power of two
+		Result Initialize(IAllocator *alloc, size_t capacity);
+
+		// Owner only.  TryPush fails if the deque is full.
+		bool TryPush(const T &item);
+		bool TryPop(T &outItem);
+
+		// Any thread.  Only fails if the deque was empty, losing a race to another thief retries.
+		bool TrySteal(T &outItem);
+
+	private:
+		static const size_t kCacheLineSize = 64;
+
+		WorkStealingDeque(const WorkStealingDeque<T> &other) = delete;
+		WorkStealingDeque<T> &operator=(const WorkStealingDeque<T> &other) = delete;
+
+		ArrayPtr<std::atomic<T>> m_items;
+		ptrdiff_t m_mask;
+
+		alignas(kCacheLineSize) std::atomic<ptrdiff_t> m_top;
+		alignas(kCacheLineSize) std::atomic<ptrdiff_t> m_bottom;
+	};
+}
+
+#include "Mem.h"
+#include "Result.h"
+
+#include <limits>
+
+namespace expanse
+{
+	template<class T>
+	WorkStealingDeque<T>::WorkStealingDeque()
+		: m_mask(0)
+		, m_top(0)
+		, m_bottom(0)
+	{
+	}
+
+	template<class T>
+	Result WorkStealingDeque<T>::Initialize(IAllocator *alloc, size_t capacity)
+	{
+		size_t roundedCapacity = 2;
+		while (roundedCapacity < capacity)
+		{
+			if (roundedCapacity > static_cast<size_t>(std::numeric_limits<ptrdiff_t>::max() / 2))
+				return ErrorCode::kOutOfMemory;
+
+			roundedCapacity *= 2u;
+		}
+
+		CHECK_RV(ArrayPtr<std::atomic<T>>, items, NewArray<std::atomic<T>>(alloc, roundedCapacity));
+
+		m_items = std::move(items);
+		m_mask = static_cast<ptrdiff_t>(roundedCapacity - 1u);
+		m_top.store(0, std::memory_order_relaxed);
+		m_bottom.store(0, std::memory_order_relaxed);
+
+		return ErrorCode::kOK;
+	}
+
+	template<class T>
+	bool WorkStealingDeque<T>::TryPush(const T &item)
+	{
+		if (m_items == nullptr)
+			return false;
+
+		const ptrdiff_t bottom = m_bottom.load(std::memory_order_relaxed);
+		const ptrdiff_t top = m_top.load(std::memory_order_acquire);
+
+		if (bottom - top > m_mask)
+			return false;	// Full
+
+		m_items[bottom & m_mask].store(item, std::memory_order_relaxed);
+		m_bottom.store(bottom + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	template<class T>
+	bool WorkStealingDeque<T>::TryPop(T &outItem)
+	{
+		if (m_items == nullptr)
+			return false;
+
+		// Claim the bottom item first so that a thief racing for the last item sees it as taken
+		const ptrdiff_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		ptrdiff_t top = m_top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			// Empty
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return false;
+		}
+
+		const T item = m_items[bottom & m_mask].load(std::memory_order_relaxed);
+
+		if (top == bottom)
+		{
+			// Last item, settle it with the thieves via top
+			const bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+			if (!won)
+				return false;
+		}
+
+		outItem = item;
+		return true;
+	}
+
+	template<class T>
+	bool WorkStealingDeque<T>::TrySteal(T &outItem)
+	{
+		if (m_items == nullptr)
+			return false;
+
+		for (;;)
+		{
+			ptrdiff_t top = m_top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const ptrdiff_t bottom = m_bottom.load(std::memory_order_acquire);
+
+			if (top >= bottom)
+				return false;	// Empty
+
+			const T item = m_items[top & m_mask].load(std::memory_order_relaxed);
+
+			if (m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				outItem = item;
+				return true;
+			}
+		}
+	}
+}
@@ -0,0 +1,271 @@
+#include "BinaryHAsmWriter.h"
+#include "FileStream.h"
+#include "Result.h"
+#include "ResultRV.h"
+
+namespace expanse
+{
+	namespace cc
+	{
+		const uint8_t BinaryHAsmWriter::kDataOpcodeSeek;
+		const uint8_t BinaryHAsmWriter::kDataOpcodeEnd;
+		const uint8_t BinaryHAsmWriter::kCodedTypeData;
+		const uint8_t BinaryHAsmWriter::kCodedTypeDataOffset;
+		const uint8_t BinaryHAsmWriter::kCodedTypeLiteralPtr;
+		const size_t BinaryHAsmWriter::kMaxRunLength;
+		const size_t BinaryHAsmWriter::kFlushThreshold;
+
+		BinaryHAsmWriter::BinaryHAsmWriter(IAllocator *alloc, FileStream *fs)
+			: m_fs(fs)
+			, m_buffer(alloc)
+			, m_pointerSize(0)
+			, m_haveRun(false)
+			, m_runCodedType(0)
+			, m_runLength(0)
+			, m_runOpcodeOffset(0)
+		{
+		}
+
+		Result BinaryHAsmWriter::Start(const HAsmHeader &asmHeader)
+		{
+			CHECK_RV_ASSIGN(m_pointerSize, GetVerbatimSize(asmHeader.m_pointerLType));
+
+			CHECK(WriteByte(static_cast<uint8_t>(asmHeader.m_pointerLType)));
+
+			return ErrorCode::kOK;
+		}
+
+		Result BinaryHAsmWriter::OpenDataSection(const HAsmOpenDataSectionInstruction &instr)
+		{
+			CHECK(WriteByte(static_cast<uint8_t>(HAsmOpcode::kOpenDataSection)));
+			CHECK(WriteVarUInt(instr.m_objectID));
+			CHECK(WriteByte(instr.m_flags));
+
+			if (instr.m_flags & HAsmOpenDataSectionInstruction::kFlagStructural)
+				CHECK(WriteVarUInt(instr.m_structureReference));
+
+			return ErrorCode::kOK;
+		}
+
+		Result BinaryHAsmWriter::CloseDataSection()
+		{
+			CHECK(WriteDataOpcode(kDataOpcodeEnd, 0));
+			CHECK(FlushIfFull());
+
+			return ErrorCode::kOK;
+		}
+
+		Result BinaryHAsmWriter::WriteDataEmitOpt(const HAsmDataEmitOpt &emitOpt)
+		{
+			// Numbers up to F64 and NULL have the same codes as in CodedType, the pointers are arranged differently
+			uint8_t codedType = static_cast<uint8_t>(emitOpt.m_codedType);
+			size_t verbatimSize = 0;
+
+			switch (emitOpt.m_codedType)
+			{
+			case HAsmDataEmitOpt::CodedType::kS8:
+			case HAsmDataEmitOpt::CodedType::kU8:
+				verbatimSize = 1;
+				break;
+			case HAsmDataEmitOpt::CodedType::kS16:
+			case HAsmDataEmitOpt::CodedType::kU16:
+				verbatimSize = 2;
+				break;
+			case HAsmDataEmitOpt::CodedType::kS32:
+			case HAsmDataEmitOpt::CodedType::kU32:
+			case HAsmDataEmitOpt::CodedType::kF32:
+				verbatimSize = 4;
+				break;
+			case HAsmDataEmitOpt::CodedType::kS64:
+			case HAsmDataEmitOpt::CodedType::kU64:
+			case HAsmDataEmitOpt::CodedType::kF64:
+				verbatimSize = 8;
+				break;
+			case HAsmDataEmitOpt::CodedType::kNullPtr:
+				break;
+			case HAsmDataEmitOpt::CodedType::kDataPtr:
+				codedType = kCodedTypeData;
+				break;
+			case HAsmDataEmitOpt::CodedType::kDataOffsetPtr:
+				codedType = kCodedTypeDataOffset;
+				verbatimSize = m_pointerSize;
+				break;
+			case HAsmDataEmitOpt::CodedType::KLiteralPtr:
+				codedType = kCodedTypeLiteralPtr;
+				verbatimSize = m_pointerSize;
+				break;
+			default:
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			}
+
+			if (m_haveRun && m_runCodedType == codedType && m_runLength < kMaxRunLength)
+			{
+				m_runLength++;
+				m_buffer[m_runOpcodeOffset] = static_cast<uint8_t>(((m_runLength - 1) << 4) | codedType);
+			}
+			else
+			{
+				EndRun();
+
+				m_haveRun = true;
+				m_runCodedType = codedType;
+				m_runLength = 1;
+				m_runOpcodeOffset = m_buffer.Size();
+
+				CHECK(WriteByte(codedType));
+			}
+
+			if (emitOpt.m_codedType == HAsmDataEmitOpt::CodedType::kDataPtr || emitOpt.m_codedType == HAsmDataEmitOpt::CodedType::kDataOffsetPtr)
+				CHECK(WriteVarUInt(emitOpt.m_symbolTableIndex));
+
+			if (verbatimSize > 0)
+				CHECK(WriteVerbatim(emitOpt.m_compilerConst, verbatimSize));
+
+			// The run's opcode has to stay in the buffer until the run ends
+			if (m_buffer.Size() >= kFlushThreshold)
+			{
+				EndRun();
+				CHECK(FlushIfFull());
+			}
+
+			return ErrorCode::kOK;
+		}
+
+		Result BinaryHAsmWriter::WriteDataSeekOpt(const HAsmDataSeekOpt &seekOpt)
+		{
+			if (seekOpt.m_offset >= MaxSInt(-8) && seekOpt.m_offset <= MaxSInt(7) && seekOpt.m_offset != MaxSInt(0))
+			{
+				uint8_t offsetByte = 0;
+				seekOpt.m_offset.BitCastToUnsigned().ToLittleEndian(&offsetByte, 1);
+
+				CHECK(WriteDataOpcode(kDataOpcodeSeek, offsetByte & 0xf));
+			}
+			else
+			{
+				uint8_t offsetBytes[MaxUInt::kMaxBytes];
+				seekOpt.m_offset.BitCastToUnsigned().ToLittleEndian(offsetBytes, MaxUInt::kMaxBytes);
+
+				uint64_t offsetBits = 0;
+				for (size_t i = 0; i < MaxUInt::kMaxBytes; i++)
+					offsetBits |= static_cast<uint64_t>(offsetBytes[i]) << (i * 8);
+
+				// Zigzag coded so that small negative offsets stay short
+				const uint64_t signBits = (offsetBits & (static_cast<uint64_t>(1) << 63)) ? ~static_cast<uint64_t>(0) : 0;
+
+				CHECK(WriteDataOpcode(kDataOpcodeSeek, 0));
+				CHECK(WriteVarUInt((offsetBits << 1) ^ signBits));
+			}
+
+			CHECK(FlushIfFull());
+
+			return ErrorCode::kOK;
+		}
+
+		Result BinaryHAsmWriter::Finish()
+		{
+			EndRun();
+
+			CHECK(m_fs->WriteAll(m_buffer.ConstView()));
+			m_buffer.Clear();
+
+			return ErrorCode::kOK;
+		}
+
+		Result BinaryHAsmWriter::WriteByte(uint8_t b)
+		{
+			return m_buffer.Add(b);
+		}
+
+		Result BinaryHAsmWriter::WriteVarUInt(uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				CHECK(WriteByte(static_cast<uint8_t>((value & 0x7f) | 0x80)));
+				value >>= 7;
+			}
+
+			return WriteByte(static_cast<uint8_t>(value));
+		}
+
+		Result BinaryHAsmWriter::WriteVerbatim(const CompilerConstant &c, size_t size)
+		{
+			uint8_t bytes[MaxUInt::kMaxBytes];
+
+			switch (c.GetLType())
+			{
+			case LType::kSInt8:
+			case LType::kSInt16:
+			case LType::kSInt32:
+			case LType::kSInt64:
+				c.GetSigned().BitCastToUnsigned().ToLittleEndian(bytes, size);
+				break;
+
+			case LType::kUInt8:
+			case LType::kUInt16:
+			case LType::kUInt32:
+			case LType::kUInt64:
+			case LType::kFloat32:
+			case LType::kFloat64:
+			case LType::kAddress:
+				c.GetUnsigned().ToLittleEndian(bytes, size);
+				break;
+
+			default:
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			}
+
+			return m_buffer.Add(ArrayView<const uint8_t>(bytes, size));
+		}
+
+		Result BinaryHAsmWriter::WriteDataOpcode(uint8_t opcode, uint8_t operand)
+		{
+			EndRun();
+
+			return WriteByte(static_cast<uint8_t>((opcode << 4) | operand));
+		}
+
+		Result BinaryHAsmWriter::FlushIfFull()
+		{
+			EXP_ASSERT(!m_haveRun);
+
+			if (m_buffer.Size() < kFlushThreshold)
+				return ErrorCode::kOK;
+
+			CHECK(m_fs->WriteAll(m_buffer.ConstView()));
+			m_buffer.Clear();
+
+			return ErrorCode::kOK;
+		}
+
+		void BinaryHAsmWriter::EndRun()
+		{
+			m_haveRun = false;
+		}
+
+		ResultRV<size_t> BinaryHAsmWriter::GetVerbatimSize(LType lType)
+		{
+			switch (lType)
+			{
+			case LType::kSInt8:
+			case LType::kUInt8:
+				return static_cast<size_t>(1);
+			case LType::kSInt16:
+			case LType::kUInt16:
+				return static_cast<size_t>(2);
+			case LType::kSInt32:
+			case LType::kUInt32:
+			case LType::kFloat32:
+				return static_cast<size_t>(4);
+			case LType::kSInt64:
+			case LType::kUInt64:
+			case LType::kFloat64:
+				return static_cast<size_t>(8);
+			default:
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			}
+		}
+	}
+}
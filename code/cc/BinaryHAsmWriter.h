@@ -0,0 +1,66 @@
+#pragma once
+
+#include "IHAsmWriter.h"
+#include "Vector.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	class FileStream;
+	struct IAllocator;
+
+	namespace cc
+	{
+		struct CompilerConstant;
+
+		// Writes HAsm in the binary encoding described in notes/hlasm.txt.  Output is collected in a buffer and
+		// written in large blocks, and consecutive emits of the same coded type are merged into runs.
+		class BinaryHAsmWriter final : public IHAsmWriter
+		{
+		public:
+			BinaryHAsmWriter(IAllocator *alloc, FileStream *fs);
+
+			Result Start(const HAsmHeader &asmHeader) override;
+
+			Result OpenDataSection(const HAsmOpenDataSectionInstruction &instr) override;
+			Result CloseDataSection() override;
+			Result WriteDataEmitOpt(const HAsmDataEmitOpt &emitOpt) override;
+			Result WriteDataSeekOpt(const HAsmDataSeekOpt &seekOpt) override;
+
+			Result Finish() override;
+
+		private:
+			static const uint8_t kDataOpcodeSeek = 14;
+			static const uint8_t kDataOpcodeEnd = 15;
+			static const uint8_t kCodedTypeData = 11;
+			static const uint8_t kCodedTypeDataOffset = 12;
+			static const uint8_t kCodedTypeLiteralPtr = 13;
+			static const size_t kMaxRunLength = 14;
+			static const size_t kFlushThreshold = 64 * 1024;
+
+			BinaryHAsmWriter() = delete;
+
+			Result WriteByte(uint8_t b);
+			Result WriteVarUInt(uint64_t value);
+			Result WriteVerbatim(const CompilerConstant &c, size_t size);
+			Result WriteDataOpcode(uint8_t opcode, uint8_t operand);
+			Result FlushIfFull();
+
+			// Ends the current emit run, after which the bytes in the buffer don't change any more
+			void EndRun();
+
+			static ResultRV<size_t> GetVerbatimSize(LType lType);
+
+			FileStream *m_fs;
+			Vector<uint8_t> m_buffer;
+			size_t m_pointerSize;
+
+			bool m_haveRun;
+			uint8_t m_runCodedType;
+			size_t m_runLength;
+			size_t m_runOpcodeOffset;
+		};
+	}
+}
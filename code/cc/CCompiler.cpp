@@ -3,13 +3,23 @@
 #include "CGrammar.h"
 #include "CLexer.h"
 #include "CScope.h"
+#include "CharCodes.h"
+#include "CompilerConstant.h"
+#include "ConstantInitializerEmitter.h"
 #include "FileCoordinate.h"
 #include "HStorageClass.h"
 #include "IHAsmWriter.h"
+#include "MaxInt.h"
+#include "NumericLiteral.h"
 #include "Result.h"
 #include "ResultRV.h"
 #include "Optional.h"
 #include "PPTokenStr.h"
+#include "TokenKind.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 // Speculative parse attempts to parse an optional construct.
 #define SPECULATIVE_PARSE(type, name, func)	\
@@ -80,7 +90,7 @@
 	} while(false)
 
 
-#define EXPECT_TOKEN(str)	\
+#define EXPECT_TOKEN(kind)	\
 	do\
 	{\
 		TokenStrView tempToken;\
@@ -93,7 +103,7 @@
 			ReportCompileError(CompilationErrorCode::kUnexpectedEndOfFile, coord);\
 			return ErrorCode::kOperationFailed;\
 		}\
-		if (!tempToken.IsString(str))\
+		if (tempToken.GetKind() != (kind))\
 		{\
 			if (speculative)\
 				return false;\
@@ -109,6 +119,59 @@ namespace expanse
 		CCompiler::CCompiler(IAllocator *alloc, IErrorReporter *errorReporter, ArrayPtr<uint8_t> &&contents, CPreprocessorTraceInfo *traceInfo, IHAsmWriter *asmWriter)
 			: m_contents(std::move(contents))
 			, m_traceInfo(traceInfo)
+			, m_sourceChannel(nullptr)
+			, m_sourceChunks(alloc)
+			, m_sourceSize(0)
+			, m_lastSourceChunkIndex(0)
+			, m_sourceErrorCode(ErrorCode::kOK)
+			, m_numDroppedSourceChunks(0)
+			, m_sourceLineStarts(alloc)
+			, m_numLineIndexedSourceChunks(0)
+			, m_tokens(alloc)
+			, m_tokenCursor(0)
+			, m_tokensBaseOffset(0)
+			, m_numDiscardedTokens(0)
+			, m_identifiers(alloc)
+			, m_parseArena(alloc, kParseArenaBlockSize)
+			, m_parseMemo(alloc)
+			, m_parseMemoBaseTokenIndex(0)
+			, m_parseMemoNumTokens(0)
+			, m_parseNestingDepth(0)
+			, m_currentScope(nullptr)
+			, m_errorReporter(errorReporter)
+			, m_asmWriter(asmWriter)
+			, m_globalInternedTypes(*alloc)
+			, m_tempInternedTypes(*alloc)
+			, m_globalInternedAggregates(alloc)
+			, m_tempInternedAggregates(alloc)
+			, m_globalInternedEnums(alloc)
+			, m_tempInternedEnums(alloc)
+			, m_globalObjects(alloc)
+			, m_externalLinkageLookup(*alloc)
+			, m_tracer(this)
+		{
+		}
+
+		CCompiler::CCompiler(IAllocator *alloc, IErrorReporter *errorReporter, PreprocessorOutputChannel *sourceChannel, IHAsmWriter *asmWriter)
+			: m_traceInfo(nullptr)
+			, m_sourceChannel(sourceChannel)
+			, m_sourceChunks(alloc)
+			, m_sourceSize(0)
+			, m_lastSourceChunkIndex(0)
+			, m_sourceErrorCode(ErrorCode::kOK)
+			, m_numDroppedSourceChunks(0)
+			, m_sourceLineStarts(alloc)
+			, m_numLineIndexedSourceChunks(0)
+			, m_tokens(alloc)
+			, m_tokenCursor(0)
+			, m_tokensBaseOffset(0)
+			, m_numDiscardedTokens(0)
+			, m_identifiers(alloc)
+			, m_parseArena(alloc, kParseArenaBlockSize)
+			, m_parseMemo(alloc)
+			, m_parseMemoBaseTokenIndex(0)
+			, m_parseMemoNumTokens(0)
+			, m_parseNestingDepth(0)
 			, m_currentScope(nullptr)
 			, m_errorReporter(errorReporter)
 			, m_asmWriter(asmWriter)
@@ -119,7 +182,36 @@ namespace expanse
 			, m_globalInternedEnums(alloc)
 			, m_tempInternedEnums(alloc)
 			, m_globalObjects(alloc)
+			, m_externalLinkageLookup(*alloc)
+			, m_tracer(this)
+		{
+		}
+
+		CCompiler::ParseMemoEntry::ParseMemoEntry()
+			: m_state(ParseMemoState::kUntried)
+		{
+		}
+
+		CCompiler::ParseNestingScope::ParseNestingScope(CCompiler *compiler)
+			: m_compiler(compiler)
+		{
+			m_compiler->m_parseNestingDepth++;
+		}
+
+		CCompiler::ParseNestingScope::~ParseNestingScope()
 		{
+			m_compiler->m_parseNestingDepth--;
+		}
+
+		Result CCompiler::ParseNestingScope::Check(const FileCoordinate &coord) const
+		{
+			if (m_compiler->m_parseNestingDepth > kMaxParseNestingDepth)
+			{
+				m_compiler->ReportCompileError(CompilationErrorCode::kNestedTooDeeply, coord);
+				return ErrorCode::kOperationFailed;
+			}
+
+			return ErrorCode::kOK;
 		}
 
 		Result CCompiler::Compile()
@@ -127,26 +219,64 @@ namespace expanse
 			m_globalScope = nullptr;
 			CHECK(InitGlobalScope());
 
+			// Fully buffered source is just a single chunk
+			if (m_contents != nullptr)
+			{
+				PreprocessorOutputChannel::Chunk chunk;
+				chunk.m_size = m_contents.Count();
+				chunk.m_contents = std::move(m_contents);
+
+				m_sourceSize = chunk.m_size;
+				CHECK(m_sourceChunks.Add(std::move(chunk)));
+			}
+
 			HAsmHeader header;
 			header.m_pointerLType = UnsignedLType(m_config.m_intptrLType);
 			CHECK(m_asmWriter->Start(header));
 			
-			FileCoordinate coord;
-			coord.m_column = 0;
-			coord.m_lineNumber = 1;
-			coord.m_fileOffset = 0;
-			CHECK_RV(bool, isTranslationUnit, ParseTranslationUnit(coord));
+			FileCoordinate coord(0);
+			ResultRV<bool> parseResult(ParseTranslationUnit(coord));
+			const ErrorCode parseErrorCode = parseResult.GetErrorCode();
+			parseResult.Handle();
+
+			// Whatever was written goes out even if compiling failed, the same as with unbuffered writers
+			CHECK(m_asmWriter->Finish());
+
+			// Running out of source because of a failure looks like a parse error, report the cause instead
+			if (m_sourceErrorCode != ErrorCode::kOK)
+				return m_sourceErrorCode;
+
+			if (parseErrorCode != ErrorCode::kOK)
+				return parseErrorCode;
 
 			return ErrorCode::kOK;
 		}
 
+		const ParseRuleStats &CCompiler::GetParseRuleStats(ParseRule rule) const
+		{
+			return m_parseRuleStats[static_cast<size_t>(rule)];
+		}
+
 		ResultRV<bool> CCompiler::ParseTranslationUnit(FileCoordinate &inOutCoordinate)
 		{
 			bool anyExternalDecl = false;
 			for (;;)
 			{
+				FileCoordinate endCheckCoord = inOutCoordinate;
+				TokenStrView nextToken;
+				CLexer::TokenType nextTokenType;
+				if (!GetToken(nextToken, endCheckCoord, nextTokenType))
+					break;
+
+				const ArenaAllocator::Mark declMark = m_parseArena.GetMark();
+
 				CHECK_RV(bool, haveExternalDecl, ParseExternalDeclaration(inOutCoordinate));
 				anyExternalDecl = true;
+
+				// Everything the declaration needs past this point was committed outside of the arena, and parked
+				// elements are the only ones still alive
+				DiscardParsedTokens(inOutCoordinate);
+				m_parseArena.Rewind(declMark);
 			}
 
 			if (!anyExternalDecl)
@@ -162,6 +292,9 @@ namespace expanse
 		{
 			const bool speculative = false;
 
+			// Nothing before this declaration is parsed again
+			ResetParseMemo();
+
 			// Either function-definition or declaration
 			// function-definition: declaration-specifiers declarator [declaration-list] compound-statement
 			// declaration: declaration-specifiers [init-declarator-list] ";"
@@ -179,7 +312,7 @@ namespace expanse
 			REQUIRE_PARSE(CDeclarationSpecifiers, declSpecifiers, ParseDeclSpecifiers);
 
 			PEEK_TOKEN(possibleSemiToken, possibleSemiCoord);
-			if (possibleSemiToken.IsString(";"))
+			if (possibleSemiToken.GetKind() == TokenKind::kSemicolon)
 			{
 				ReportCompileWarning(CompilationWarningCode::kEmptyDeclaration, coord);
 				coord = possibleSemiCoord;
@@ -189,18 +322,20 @@ namespace expanse
 				REQUIRE_PARSE(CDeclarator, declarator, ParseDeclarator);
 
 				PEEK_TOKEN(postDeclaratorToken, postDeclaratorCoord);
-				if (postDeclaratorToken.IsString("="))
+				if (postDeclaratorToken.GetKind() == TokenKind::kAssign)
 				{
 					coord = postDeclaratorCoord;
 
 					CHECK(ParseAndCompileInitializerForDeclarator(declSpecifiers, declarator, coord));
 
 					PEEK_TOKEN(postInitializerToken, postInitializerCoord);
-					if (postInitializerToken.IsString(";"))
+					if (postInitializerToken.GetKind() == TokenKind::kSemicolon)
 					{
+						coord = postInitializerCoord;
 					}
-					else if (postInitializerToken.IsString(","))
+					else if (postInitializerToken.GetKind() == TokenKind::kComma)
 					{
+						coord = postInitializerCoord;
 						CHECK(ParseAndCompileInitDeclaratorListEndingInSemi(declSpecifiers, coord));
 					}
 					else
@@ -209,15 +344,16 @@ namespace expanse
 						return ErrorCode::kOperationFailed;
 					}
 				}
-				else if (postDeclaratorToken.IsString(","))
+				else if (postDeclaratorToken.GetKind() == TokenKind::kComma)
 				{
 					CHECK(CommitDeclarator(declSpecifiers, declarator));
 					coord = postDeclaratorCoord;
 
 					CHECK(ParseAndCompileInitDeclaratorListEndingInSemi(declSpecifiers, coord));
 				}
-				else if (postDeclaratorToken.IsString(";"))
+				else if (postDeclaratorToken.GetKind() == TokenKind::kSemicolon)
 				{
+					CHECK(CompileTentativeDefinition(declSpecifiers, declarator));
 					coord = postDeclaratorCoord;
 				}
 				else
@@ -232,7 +368,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseDeclSpecifiers(FileCoordinate &inOutCoordinate, CorePtr<CDeclarationSpecifiers> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			// Series of one of:
 			// storage-class-specifier
@@ -247,7 +383,7 @@ namespace expanse
 
 			FileCoordinate coord = inOutCoordinate;
 
-			Vector<CorePtr<CGrammarElement>> elements(this->GetCoreObjectAllocator());
+			Vector<CorePtr<CGrammarElement>> elements(alloc);
 			REQUIRE_PARSE(CGrammarElement, firstElement, ParseSingleDeclSpecifier);
 			CHECK(elements.Add(std::move(firstElement)));
 
@@ -268,7 +404,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseSingleDeclSpecifier(FileCoordinate &inOutCoordinate, CorePtr<CGrammarElement> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			// One of:
 			// storage-class-specifier
@@ -286,48 +422,73 @@ namespace expanse
 			FileCoordinate preTokenCoord = coord;
 			REQUIRE_TOKEN(token);
 
-			if (token.IsString("typedef") || token.IsString("extern") || token.IsString("static") || token.IsString("auto") || token.IsString("register"))
-			{
-				CHECK_RV(CorePtr<CToken>, tokenElement, New<CToken>(alloc, CGrammarElement::Subtype::kStorageClassSpecifier, token, preTokenCoord));
-				outProduct = std::move(tokenElement);
-			}
-			else if (token.IsString("void") || token.IsString("char") || token.IsString("short") || token.IsString("int") || token.IsString("long")
-				|| token.IsString("float") || token.IsString("double") || token.IsString("signed") || token.IsString("unsigned") || token.IsString("_Bool")
-				|| token.IsString("_Complex"))
-			{
-				CHECK_RV(CorePtr<CToken>, tokenElement, New<CToken>(alloc, CGrammarElement::Subtype::kTypeSpecifier, token, preTokenCoord));
-				outProduct = std::move(tokenElement);
-			}
-			else if (token.IsString("const") || token.IsString("restrict") || token.IsString("volatile"))
-			{
-				CHECK_RV(CorePtr<CToken>, tokenElement, New<CToken>(alloc, CGrammarElement::Subtype::kTypeQualifier, token, preTokenCoord));
-				outProduct = std::move(tokenElement);
-			}
-			else if (token.IsString("inline"))
-			{
-				CHECK_RV(CorePtr<CToken>, tokenElement, New<CToken>(alloc, CGrammarElement::Subtype::kFunctionSpecifier, token, preTokenCoord));
-				outProduct = std::move(tokenElement);
-			}
-			else if (token.IsString("enum"))
-			{
-				REQUIRE_PARSE(CEnumSpecifier, enumSpecifier, ParseEnumSpecifierAfterEnum);
-				outProduct = std::move(enumSpecifier);
-			}
-			else if (token.IsString("struct"))
-			{
-				REQUIRE_PARSE(CStructOrUnionSpecifier, structSpecifier, ParseStructSpecifierAfterStruct);
-				outProduct = std::move(structSpecifier);
-			}
-			else if (token.IsString("union"))
-			{
-				REQUIRE_PARSE(CStructOrUnionSpecifier, unionSpecifier, ParseUnionSpecifierAfterUnion);
-				outProduct = std::move(unionSpecifier);
-			}
-			else
+			switch (token.GetKind())
 			{
-				coord = preTokenCoord;
-				REQUIRE_PARSE(CToken, typedefName, ParseTypedefName);
-				outProduct = std::move(typedefName);
+			case TokenKind::kTypedef:
+			case TokenKind::kExtern:
+			case TokenKind::kStatic:
+			case TokenKind::kAuto:
+			case TokenKind::kRegister:
+				{
+					CHECK_RV(CorePtr<CToken>, tokenElement, New<CToken>(alloc, CGrammarElement::Subtype::kStorageClassSpecifier, token, preTokenCoord));
+					outProduct = std::move(tokenElement);
+				}
+				break;
+			case TokenKind::kVoid:
+			case TokenKind::kChar:
+			case TokenKind::kShort:
+			case TokenKind::kInt:
+			case TokenKind::kLong:
+			case TokenKind::kFloat:
+			case TokenKind::kDouble:
+			case TokenKind::kSigned:
+			case TokenKind::kUnsigned:
+			case TokenKind::kBool:
+			case TokenKind::kComplex:
+				{
+					CHECK_RV(CorePtr<CToken>, tokenElement, New<CToken>(alloc, CGrammarElement::Subtype::kTypeSpecifier, token, preTokenCoord));
+					outProduct = std::move(tokenElement);
+				}
+				break;
+			case TokenKind::kConst:
+			case TokenKind::kRestrict:
+			case TokenKind::kVolatile:
+				{
+					CHECK_RV(CorePtr<CToken>, tokenElement, New<CToken>(alloc, CGrammarElement::Subtype::kTypeQualifier, token, preTokenCoord));
+					outProduct = std::move(tokenElement);
+				}
+				break;
+			case TokenKind::kInline:
+				{
+					CHECK_RV(CorePtr<CToken>, tokenElement, New<CToken>(alloc, CGrammarElement::Subtype::kFunctionSpecifier, token, preTokenCoord));
+					outProduct = std::move(tokenElement);
+				}
+				break;
+			case TokenKind::kEnum:
+				{
+					REQUIRE_PARSE(CEnumSpecifier, enumSpecifier, ParseEnumSpecifierAfterEnum);
+					outProduct = std::move(enumSpecifier);
+				}
+				break;
+			case TokenKind::kStruct:
+				{
+					REQUIRE_PARSE(CStructOrUnionSpecifier, structSpecifier, ParseStructSpecifierAfterStruct);
+					outProduct = std::move(structSpecifier);
+				}
+				break;
+			case TokenKind::kUnion:
+				{
+					REQUIRE_PARSE(CStructOrUnionSpecifier, unionSpecifier, ParseUnionSpecifierAfterUnion);
+					outProduct = std::move(unionSpecifier);
+				}
+				break;
+			default:
+				{
+					coord = preTokenCoord;
+					REQUIRE_PARSE(CToken, typedefName, ParseTypedefName);
+					outProduct = std::move(typedefName);
+				}
+				break;
 			}
 
 			inOutCoordinate = coord;
@@ -336,13 +497,18 @@ namespace expanse
 
 
 		ResultRV<bool> CCompiler::ParseDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CDeclarator> &outProduct, bool speculative)
+		{
+			return MemoizedParse(ParseRule::kDeclarator, &CCompiler::ParseDeclaratorUnmemoized, inOutCoordinate, outProduct, speculative);
+		}
+
+		ResultRV<bool> CCompiler::ParseDeclaratorUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CDeclarator> &outProduct, bool speculative)
 		{
 			FileCoordinate coord = inOutCoordinate;
 			SPECULATIVE_PARSE(CPointer, pointer, ParsePointer);
 
 			REQUIRE_PARSE(CDirectDeclarator, directDecl, ParseDirectDeclarator);
 
-			CHECK_RV_ASSIGN(outProduct, New<CDeclarator>(GetCoreObjectAllocator(), std::move(pointer), std::move(directDecl), inOutCoordinate));
+			CHECK_RV_ASSIGN(outProduct, New<CDeclarator>(&m_parseArena, std::move(pointer), std::move(directDecl), inOutCoordinate));
 
 			inOutCoordinate = coord;
 			return true;
@@ -350,7 +516,12 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseAbstractDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CAbstractDeclarator> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			return MemoizedParse(ParseRule::kAbstractDeclarator, &CCompiler::ParseAbstractDeclaratorUnmemoized, inOutCoordinate, outProduct, speculative);
+		}
+
+		ResultRV<bool> CCompiler::ParseAbstractDeclaratorUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CAbstractDeclarator> &outProduct, bool speculative)
+		{
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 			SPECULATIVE_PARSE(CPointer, pointer, ParsePointer);
@@ -379,19 +550,19 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseDirectDeclaratorContinuation(FileCoordinate &inOutCoordinate, CorePtr<CDirectDeclaratorContinuation> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			CorePtr<CDirectDeclaratorContinuation> continuation;
 
 			PEEK_TOKEN(possibleBracketToken, possibleBracketEndCoord);
-			if (possibleBracketToken.IsString("["))
+			if (possibleBracketToken.GetKind() == TokenKind::kLeftBracket)
 			{
 				coord = possibleBracketEndCoord;
 
 				PEEK_TOKEN(possibleStaticToken1, possibleStaticEndCoord1);
-				if (possibleStaticToken1.IsString("static"))
+				if (possibleStaticToken1.GetKind() == TokenKind::kStatic)
 				{
 					// static [type-qualifier-list] assignment-expression
 					coord = possibleStaticEndCoord1;
@@ -407,7 +578,7 @@ namespace expanse
 					SPECULATIVE_PARSE(CTypeQualifierList, typeQualifierList, ParseTypeQualifierList);
 
 					PEEK_TOKEN(possibleStaticOrAsteriskToken, possibleStaticOrAsteriskEndCoord);
-					if (typeQualifierList != nullptr && possibleStaticOrAsteriskToken.IsString("static"))
+					if (typeQualifierList != nullptr && possibleStaticOrAsteriskToken.GetKind() == TokenKind::kStatic)
 					{
 						// type-qualifier-list static assignment-expression
 						coord = possibleStaticOrAsteriskEndCoord;
@@ -416,7 +587,7 @@ namespace expanse
 						CHECK_RV(CorePtr<CDirectDeclaratorContinuation>, newDirectDecl, New<CDirectDeclaratorContinuation>(alloc, std::move(typeQualifierList), std::move(assignmentExpr), true, false, inOutCoordinate));
 						continuation = std::move(newDirectDecl);
 					}
-					else if (possibleStaticOrAsteriskToken.IsString("*"))
+					else if (possibleStaticOrAsteriskToken.GetKind() == TokenKind::kAsterisk)
 					{
 						// [type-qualifier-list] *
 						coord = possibleStaticOrAsteriskEndCoord;
@@ -433,11 +604,11 @@ namespace expanse
 					}
 				}
 
-				EXPECT_TOKEN("]");
+				EXPECT_TOKEN(TokenKind::kRightBracket);
 			}
 			else
 			{
-				EXPECT_TOKEN("(");
+				EXPECT_TOKEN(TokenKind::kLeftParen);
 
 				coord = possibleBracketEndCoord;
 
@@ -454,7 +625,7 @@ namespace expanse
 					continuation = std::move(newDirectDecl);
 				}
 
-				EXPECT_TOKEN(")");
+				EXPECT_TOKEN(TokenKind::kRightParen);
 			}
 
 			outProduct = std::move(continuation);
@@ -465,7 +636,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseDirectDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CDirectDeclarator> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -473,14 +644,14 @@ namespace expanse
 
 			FileCoordinate ddStartCoord = coord;
 			PEEK_TOKEN(lparenToken, lparenEndCoord);
-			if (lparenToken.IsString("("))
+			if (lparenToken.GetKind() == TokenKind::kLeftParen)
 			{
 				coord = lparenEndCoord;
 
 				REQUIRE_PARSE(CDeclarator, decl, ParseDeclarator);
 
 				PEEK_TOKEN(rparenToken, rparenEndCoord);
-				if (!rparenToken.IsString(")"))
+				if (rparenToken.GetKind() != TokenKind::kRightParen)
 				{
 					if (speculative)
 						return false;
@@ -521,7 +692,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseDirectAbstractDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CDirectAbstractDeclarator> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -529,7 +700,7 @@ namespace expanse
 
 			FileCoordinate beforePossibleAbstractDecl = coord;
 			PEEK_TOKEN(lparenToken, lparenEndCoord);
-			if (lparenToken.IsString("("))
+			if (lparenToken.GetKind() == TokenKind::kLeftParen)
 			{
 				coord = lparenEndCoord;
 
@@ -537,7 +708,7 @@ namespace expanse
 				if (speculativeAbsDecl != nullptr)
 				{
 					PEEK_TOKEN(rparenToken, rparenEndCoord);
-					if (rparenToken.IsString(")"))
+					if (rparenToken.GetKind() == TokenKind::kRightParen)
 					{
 						coord = rparenEndCoord;
 
@@ -565,26 +736,36 @@ namespace expanse
 				CHECK(suffixes.Add(std::move(suffix)));
 			}
 
+			// Nothing at all isn't a direct-abstract-declarator, so type names like the one in (int)x don't get one
+			if (absDecl == nullptr && suffixes.Size() == 0)
+			{
+				if (speculative)
+					return false;
+
+				ReportCompileError(CompilationErrorCode::kUnexpectedToken, inOutCoordinate);
+				return ErrorCode::kOperationFailed;
+			}
+
 			CHECK_RV(ArrayPtr<CorePtr<CDirectAbstractDeclaratorSuffix>>, flat, suffixes.View().CloneTake(alloc));
 			CHECK_RV_ASSIGN(outProduct, New<CDirectAbstractDeclarator>(alloc, std::move(absDecl), std::move(flat)));
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseDirectAbstractDeclaratorSuffix(FileCoordinate &inOutCoordinate, CorePtr<CDirectAbstractDeclaratorSuffix> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			PEEK_TOKEN(possibleBracketToken, possibleBracketEndCoord);
-			if (possibleBracketToken.IsString("["))
+			if (possibleBracketToken.GetKind() == TokenKind::kLeftBracket)
 			{
 				coord = possibleBracketEndCoord;
 
 				PEEK_TOKEN(possibleStaticToken1, possibleStaticEndCoord1);
-				if (possibleStaticToken1.IsString("static"))
+				if (possibleStaticToken1.GetKind() == TokenKind::kStatic)
 				{
 					// static [type-qualifier-list] assignment-expression
 					coord = possibleStaticEndCoord1;
@@ -601,7 +782,7 @@ namespace expanse
 					if (typeQualifierList != nullptr)
 					{
 						PEEK_TOKEN(possibleStaticToken, possibleStaticEndCoord);
-						if (possibleStaticToken.IsString("static"))
+						if (possibleStaticToken.GetKind() == TokenKind::kStatic)
 						{
 							// type-qualifier-list static assignment-expression
 							coord = possibleStaticEndCoord;
@@ -619,7 +800,7 @@ namespace expanse
 					else
 					{
 						PEEK_TOKEN(possibleAsteriskToken, possibleAsteriskEndCoord);
-						if (possibleAsteriskToken.IsString("*"))
+						if (possibleAsteriskToken.GetKind() == TokenKind::kAsterisk)
 						{
 							coord = possibleAsteriskEndCoord;
 
@@ -634,9 +815,9 @@ namespace expanse
 					}
 				}
 
-				EXPECT_TOKEN("]");
+				EXPECT_TOKEN(TokenKind::kRightBracket);
 			}
-			else if (possibleBracketToken.IsString("("))
+			else if (possibleBracketToken.GetKind() == TokenKind::kLeftParen)
 			{
 				coord = possibleBracketEndCoord;
 
@@ -651,7 +832,7 @@ namespace expanse
 					CHECK_RV_ASSIGN(outProduct, New<CDirectAbstractDeclaratorSuffix>(alloc, std::move(identifierList)));
 				}
 
-				EXPECT_TOKEN(")");
+				EXPECT_TOKEN(TokenKind::kRightParen);
 			}
 
 			inOutCoordinate = coord;
@@ -660,13 +841,13 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseEnumSpecifierAfterEnum(FileCoordinate &inOutCoordinate, CorePtr<CEnumSpecifier> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 			SPECULATIVE_PARSE(CToken, identifier, ParseIdentifier);
 
 			PEEK_TOKEN(openBraceToken, openBraceEndCoord);
-			if (openBraceToken.IsString("{"))
+			if (openBraceToken.GetKind() == TokenKind::kLeftBrace)
 			{
 				coord = openBraceEndCoord;
 
@@ -674,10 +855,10 @@ namespace expanse
 				CHECK_RV_ASSIGN(outProduct, New<CEnumSpecifier>(alloc, CEnumSpecifier(std::move(identifier), std::move(enumeratorList), inOutCoordinate)));
 
 				PEEK_TOKEN(afterEnumeratorListToken, afterEnumeratorListEndCoord);
-				if (afterEnumeratorListToken.IsString(","))
+				if (afterEnumeratorListToken.GetKind() == TokenKind::kComma)
 					coord = afterEnumeratorListEndCoord;
 
-				EXPECT_TOKEN("}");
+				EXPECT_TOKEN(TokenKind::kRightBrace);
 			}
 			else
 			{
@@ -701,7 +882,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseEnumeratorList(FileCoordinate &inOutCoordinate, CorePtr<CEnumeratorList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -715,7 +896,7 @@ namespace expanse
 				FileCoordinate possibleEOLCoord = coord;
 
 				PEEK_TOKEN(nextToken, nextTokenEndCoord);
-				if (nextToken.IsString(","))
+				if (nextToken.GetKind() == TokenKind::kComma)
 				{
 					coord = nextTokenEndCoord;
 					SPECULATIVE_PARSE(CEnumerator, nextEnumerator, ParseEnumerator);
@@ -741,14 +922,14 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseEnumerator(FileCoordinate &inOutCoordinate, CorePtr<CEnumerator> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			REQUIRE_PARSE(CToken, enumConstant, ParseIdentifier);
 
 			PEEK_TOKEN(possibleEqualToken, possibleEqualEndCoord);
-			if (possibleEqualToken.IsString("="))
+			if (possibleEqualToken.GetKind() == TokenKind::kAssign)
 			{
 				FileCoordinate eqFailCoord = coord;
 				coord = possibleEqualEndCoord;
@@ -782,20 +963,20 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseStructOrUnionSpecifierAfterDesignator(FileCoordinate &inOutCoordinate, CorePtr<CStructOrUnionSpecifier> &outProduct, bool speculative, CAggregateType aggType)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 			SPECULATIVE_PARSE(CToken, identifier, ParseIdentifier);
 
 			PEEK_TOKEN(openBraceToken, openBraceEndCoord);
-			if (openBraceToken.IsString("{"))
+			if (openBraceToken.GetKind() == TokenKind::kLeftBrace)
 			{
 				coord = openBraceEndCoord;
 
 				REQUIRE_PARSE(CStructDeclarationList, structDeclarationList, ParseStructDeclarationList);
 				CHECK_RV_ASSIGN(outProduct, New<CStructOrUnionSpecifier>(alloc, std::move(identifier), std::move(structDeclarationList), aggType, inOutCoordinate));
 
-				EXPECT_TOKEN("}");
+				EXPECT_TOKEN(TokenKind::kRightBrace);
 			}
 			else
 			{
@@ -819,7 +1000,10 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseStructDeclarationList(FileCoordinate &inOutCoordinate, CorePtr<CStructDeclarationList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
+
+			ParseNestingScope nestingScope(this);
+			CHECK(nestingScope.Check(inOutCoordinate));
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -846,7 +1030,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseInitDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CInitDeclarator> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 			FileCoordinate coord = inOutCoordinate;
 
 			REQUIRE_PARSE(CDeclarator, decl, ParseDeclarator);
@@ -855,7 +1039,7 @@ namespace expanse
 
 			FileCoordinate backupCoord = coord;
 			PEEK_TOKEN(equalToken, equalEndCoord);
-			if (equalToken.IsString("="))
+			if (equalToken.GetKind() == TokenKind::kAssign)
 			{
 				coord = equalEndCoord;
 				SPECULATIVE_PARSE(CInitializer, possibleInitializer, ParseInitializer);
@@ -873,7 +1057,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseInitDeclaratorList(FileCoordinate &inOutCoordinate, CorePtr<CInitDeclaratorList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 			FileCoordinate coord = inOutCoordinate;
 
 			Vector<CorePtr<CInitDeclarator>> initDecls(alloc);
@@ -899,12 +1083,12 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseDeclaration(FileCoordinate &inOutCoordinate, CorePtr<CDeclaration> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 			FileCoordinate coord = inOutCoordinate;
 
 			REQUIRE_PARSE(CDeclarationSpecifiers, declSpecs, ParseDeclSpecifiers);
 			SPECULATIVE_PARSE(CInitDeclaratorList, initDeclList, ParseInitDeclaratorList);
-			EXPECT_TOKEN(";");
+			EXPECT_TOKEN(TokenKind::kSemicolon);
 
 			CHECK_RV_ASSIGN(outProduct, New<CDeclaration>(alloc, std::move(declSpecs), std::move(initDeclList)));
 
@@ -914,7 +1098,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseDeclarationList(FileCoordinate &inOutCoordinate, CorePtr<CDeclarationList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -941,13 +1125,13 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseStructDeclaration(FileCoordinate &inOutCoordinate, CorePtr<CStructDeclaration> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			REQUIRE_PARSE(CSpecifierQualifierList, specQualList, ParseSpecifierQualifierList);
 			REQUIRE_PARSE(CStructDeclaratorList, structDeclList, ParseStructDeclaratorList);
-			EXPECT_TOKEN(";");
+			EXPECT_TOKEN(TokenKind::kSemicolon);
 
 			inOutCoordinate = coord;
 			return true;
@@ -955,7 +1139,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseSpecifierQualifierList(FileCoordinate &inOutCoordinate, CorePtr<CSpecifierQualifierList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1001,7 +1185,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseStructDeclaratorList(FileCoordinate &inOutCoordinate, CorePtr<CStructDeclaratorList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1015,7 +1199,7 @@ namespace expanse
 				FileCoordinate nextDeclFailCoord = coord;
 
 				PEEK_TOKEN(commaToken, commaEndCoord);
-				if (commaToken.IsString(","))
+				if (commaToken.GetKind() == TokenKind::kComma)
 				{
 					coord = commaEndCoord;
 
@@ -1041,7 +1225,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseStructDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CStructDeclarator> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1051,7 +1235,7 @@ namespace expanse
 				FileCoordinate preColonCoord = coord;
 
 				PEEK_TOKEN(colonToken, colonEndCoord);
-				if (colonToken.IsString(":"))
+				if (colonToken.GetKind() == TokenKind::kColon)
 				{
 					SPECULATIVE_PARSE(CExpression, constExpr, ParseConstantExpression);
 					if (constExpr != nullptr)
@@ -1071,7 +1255,7 @@ namespace expanse
 			}
 			else
 			{
-				EXPECT_TOKEN(":");
+				EXPECT_TOKEN(TokenKind::kColon);
 				REQUIRE_PARSE(CExpression, constExpr, ParseConstantExpression);
 
 				CHECK_RV_ASSIGN(outProduct, New<CStructDeclarator>(alloc, std::move(constExpr)));
@@ -1084,13 +1268,13 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseTypeQualifier(FileCoordinate &inOutCoordinate, CorePtr<CToken> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			PEEK_TOKEN(token, tokenEndCoord);
 
-			if (token.IsString("const") || token.IsString("restrict") || token.IsString("volatile"))
+			if (token.GetKind() == TokenKind::kConst || token.GetKind() == TokenKind::kRestrict || token.GetKind() == TokenKind::kVolatile)
 			{
 				CHECK_RV_ASSIGN(outProduct, New<CToken>(alloc, CGrammarElement::Subtype::kTypeQualifier, token, coord));
 				coord = tokenEndCoord;
@@ -1110,44 +1294,60 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseTypeSpecifier(FileCoordinate &inOutCoordinate, CorePtr<CGrammarElement> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			PEEK_TOKEN(token, tokenEndCoord);
 
-			if (token.IsString("void") || token.IsString("char") || token.IsString("short") || token.IsString("int") || token.IsString("long")
-				|| token.IsString("float") || token.IsString("double") || token.IsString("signed") || token.IsString("unsigned") || token.IsString("_Bool")
-				|| token.IsString("_Complex"))
-			{
-				CHECK_RV_ASSIGN(outProduct, New<CToken>(alloc, CGrammarElement::Subtype::kTypeSpecifier, token, coord));
-				coord = tokenEndCoord;
-			}
-			else if (token.IsString("struct"))
+			switch (token.GetKind())
 			{
-				coord = tokenEndCoord;
+			case TokenKind::kVoid:
+			case TokenKind::kChar:
+			case TokenKind::kShort:
+			case TokenKind::kInt:
+			case TokenKind::kLong:
+			case TokenKind::kFloat:
+			case TokenKind::kDouble:
+			case TokenKind::kSigned:
+			case TokenKind::kUnsigned:
+			case TokenKind::kBool:
+			case TokenKind::kComplex:
+				{
+					CHECK_RV_ASSIGN(outProduct, New<CToken>(alloc, CGrammarElement::Subtype::kTypeSpecifier, token, coord));
+					coord = tokenEndCoord;
+				}
+				break;
+			case TokenKind::kStruct:
+				{
+					coord = tokenEndCoord;
 
-				REQUIRE_PARSE(CStructOrUnionSpecifier, souSpecifier, ParseStructSpecifierAfterStruct);
-				outProduct = CorePtr<CGrammarElement>(std::move(souSpecifier));
-			}
-			else if (token.IsString("union"))
-			{
-				coord = tokenEndCoord;
+					REQUIRE_PARSE(CStructOrUnionSpecifier, souSpecifier, ParseStructSpecifierAfterStruct);
+					outProduct = CorePtr<CGrammarElement>(std::move(souSpecifier));
+				}
+				break;
+			case TokenKind::kUnion:
+				{
+					coord = tokenEndCoord;
 
-				REQUIRE_PARSE(CStructOrUnionSpecifier, souSpecifier, ParseUnionSpecifierAfterUnion);
-				outProduct = CorePtr<CGrammarElement>(std::move(souSpecifier));
-			}
-			else if (token.IsString("enum"))
-			{
-				coord = tokenEndCoord;
+					REQUIRE_PARSE(CStructOrUnionSpecifier, souSpecifier, ParseUnionSpecifierAfterUnion);
+					outProduct = CorePtr<CGrammarElement>(std::move(souSpecifier));
+				}
+				break;
+			case TokenKind::kEnum:
+				{
+					coord = tokenEndCoord;
 
-				REQUIRE_PARSE(CEnumSpecifier, enumSpecifier, ParseEnumSpecifierAfterEnum);
-				outProduct = CorePtr<CGrammarElement>(std::move(enumSpecifier));
-			}
-			else
-			{
-				REQUIRE_PARSE(CToken, typedefName, ParseTypedefName);
-				outProduct = CorePtr<CGrammarElement>(std::move(typedefName));
+					REQUIRE_PARSE(CEnumSpecifier, enumSpecifier, ParseEnumSpecifierAfterEnum);
+					outProduct = CorePtr<CGrammarElement>(std::move(enumSpecifier));
+				}
+				break;
+			default:
+				{
+					REQUIRE_PARSE(CToken, typedefName, ParseTypedefName);
+					outProduct = CorePtr<CGrammarElement>(std::move(typedefName));
+				}
+				break;
 			}
 
 			inOutCoordinate = coord;
@@ -1156,13 +1356,13 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParsePointer(FileCoordinate &inOutCoordinate, CorePtr<CPointer> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			Vector<CPointer::IndirectionLevel> indirLevels(alloc);
 
-			EXPECT_TOKEN("*");
+			EXPECT_TOKEN(TokenKind::kAsterisk);
 
 			SPECULATIVE_PARSE(CTypeQualifierList, qualList, ParseTypeQualifierList);
 
@@ -1176,7 +1376,7 @@ namespace expanse
 				FileCoordinate backupCoord = coord;
 
 				PEEK_TOKEN(asteriskToken, asteriskEndCoord);
-				if (asteriskToken.IsString("*"))
+				if (asteriskToken.GetKind() == TokenKind::kAsterisk)
 				{
 					coord = asteriskEndCoord;
 
@@ -1199,7 +1399,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseIdentifier(FileCoordinate &inOutCoordinate, CorePtr<CToken> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1214,7 +1414,7 @@ namespace expanse
 				return ErrorCode::kOperationFailed;
 			}
 
-			if (tokenType != CLexer::TokenType::kIdentifier || IsKeyword(token))
+			if (tokenType != CLexer::TokenType::kIdentifier || TokenKindLookup::IsKeyword(token.GetKind()))
 			{
 				if (speculative)
 					return false;
@@ -1231,7 +1431,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseTypeQualifierList(FileCoordinate &inOutCoordinate, CorePtr<CTypeQualifierList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1261,7 +1461,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseParameterTypeList(FileCoordinate &inOutCoordinate, CorePtr<CParameterTypeList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1275,12 +1475,12 @@ namespace expanse
 			{
 				FileCoordinate preCommaCoord = coord;
 				PEEK_TOKEN(commaToken, commaEndCoord);
-				if (commaToken.IsString(","))
+				if (commaToken.GetKind() == TokenKind::kComma)
 				{
 					coord = commaEndCoord;
 
 					PEEK_TOKEN(dotsToken, dotsEndCoord);
-					if (dotsToken.IsString("..."))
+					if (dotsToken.GetKind() == TokenKind::kEllipsis)
 					{
 						coord = dotsEndCoord;
 						isVarArg = true;
@@ -1315,7 +1515,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseParameterDeclaration(FileCoordinate &inOutCoordinate, CorePtr<CParameterDeclaration> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1345,7 +1545,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseIdentifierList(FileCoordinate &inOutCoordinate, CorePtr<CIdentifierList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1359,7 +1559,7 @@ namespace expanse
 				FileCoordinate possibleEOLCoord = coord;
 
 				PEEK_TOKEN(nextToken, nextTokenEndCoord);
-				if (nextToken.IsString(","))
+				if (nextToken.GetKind() == TokenKind::kComma)
 				{
 					coord = nextTokenEndCoord;
 					SPECULATIVE_PARSE(CToken, nextIdentifier, ParseIdentifier);
@@ -1387,7 +1587,12 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseTypeName(FileCoordinate &inOutCoordinate, CorePtr<CTypeName> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = GetCoreObjectAllocator();
+			return MemoizedParse(ParseRule::kTypeName, &CCompiler::ParseTypeNameUnmemoized, inOutCoordinate, outProduct, speculative);
+		}
+
+		ResultRV<bool> CCompiler::ParseTypeNameUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CTypeName> &outProduct, bool speculative)
+		{
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1397,7 +1602,7 @@ namespace expanse
 			CHECK_RV_ASSIGN(outProduct, New<CTypeName>(alloc, std::move(specQualList), std::move(absDecl)));
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseConstantExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
@@ -1407,7 +1612,7 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseConditionalExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1417,7 +1622,7 @@ namespace expanse
 			bool isTernary = false;
 			PEEK_TOKEN(questionToken, questionEndCoord);
 
-			if (questionToken.IsString("?"))
+			if (questionToken.GetKind() == TokenKind::kQuestion)
 			{
 				coord = questionEndCoord;
 				SPECULATIVE_PARSE(CExpression, trueExpression, ParseExpression);
@@ -1426,7 +1631,7 @@ namespace expanse
 				{
 					PEEK_TOKEN(colonToken, colonEndCoord);
 
-					if (colonToken.IsString(":"))
+					if (colonToken.GetKind() == TokenKind::kColon)
 					{
 						coord = colonEndCoord;
 						SPECULATIVE_PARSE(CExpression, falseExpression, ParseConditionalExpression);
@@ -1447,12 +1652,16 @@ namespace expanse
 			outProduct = std::move(resultExpr);
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseAssignmentExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
+
+			// Right-recursive, so chained assignments nest
+			ParseNestingScope nestingScope(this);
+			CHECK(nestingScope.Check(inOutCoordinate));
 
 			FileCoordinate coord = inOutCoordinate;
 				
@@ -1463,30 +1672,45 @@ namespace expanse
 				PEEK_TOKEN(operatorToken, operatorEndCoord);
 
 				CBinaryOperator binOp = CBinaryOperator::kInvalid;
-				if (operatorToken.IsString("="))
+				switch (operatorToken.GetKind())
+				{
+				case TokenKind::kAssign:
 					binOp = CBinaryOperator::kAssign;
-				if (operatorToken.IsString("*="))
+					break;
+				case TokenKind::kMulAssign:
 					binOp = CBinaryOperator::kMulAssign;
-				if (operatorToken.IsString("/="))
+					break;
+				case TokenKind::kDivAssign:
 					binOp = CBinaryOperator::kDivAssign;
-				if (operatorToken.IsString("%="))
+					break;
+				case TokenKind::kModAssign:
 					binOp = CBinaryOperator::kModAssign;
-				if (operatorToken.IsString("+="))
+					break;
+				case TokenKind::kAddAssign:
 					binOp = CBinaryOperator::kAddAssign;
-				if (operatorToken.IsString("-="))
+					break;
+				case TokenKind::kSubAssign:
 					binOp = CBinaryOperator::kSubAssign;
-				if (operatorToken.IsString("<<="))
+					break;
+				case TokenKind::kLshAssign:
 					binOp = CBinaryOperator::kLshAssign;
-				if (operatorToken.IsString(">>="))
+					break;
+				case TokenKind::kRshAssign:
 					binOp = CBinaryOperator::kRshAssign;
-				if (operatorToken.IsString("&="))
+					break;
+				case TokenKind::kAndAssign:
 					binOp = CBinaryOperator::kBitAndAssign;
-				if (operatorToken.IsString("^="))
+					break;
+				case TokenKind::kXorAssign:
 					binOp = CBinaryOperator::kBitXorAssign;
-				if (operatorToken.IsString("|="))
+					break;
+				case TokenKind::kOrAssign:
 					binOp = CBinaryOperator::kBitOrAssign;
-				else
+					break;
+				default:
 					isAssignment = false;
+					break;
+				}
 
 				if (isAssignment)
 				{
@@ -1504,11 +1728,17 @@ namespace expanse
 			else
 				isAssignment = false;
 
+			// The conditional expression starts with the same unary expression
 			if (!isAssignment)
+			{
+				if (unaryExpr != nullptr)
+					ParkParseResult(ParseRule::kUnaryExpression, inOutCoordinate, std::move(unaryExpr));
+
 				return ParseConditionalExpression(inOutCoordinate, outProduct, speculative);
+			}
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseLogicalOrExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
@@ -1568,7 +1798,12 @@ namespace expanse
 
 		ResultRV<bool> CCompiler::ParseUnaryExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			return MemoizedParse(ParseRule::kUnaryExpression, &CCompiler::ParseUnaryExpressionUnmemoized, inOutCoordinate, outProduct, speculative);
+		}
+
+		ResultRV<bool> CCompiler::ParseUnaryExpressionUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
+		{
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1576,9 +1811,9 @@ namespace expanse
 
 			PEEK_TOKEN(opToken, opEndCoord);
 			CUnaryOperator unaryOp = CUnaryOperator::kInvalid;
-			if (opToken.IsString("++"))
+			if (opToken.GetKind() == TokenKind::kIncrement)
 				unaryOp = CUnaryOperator::kPreIncrement;
-			else if (opToken.IsString("--"))
+			else if (opToken.GetKind() == TokenKind::kDecrement)
 				unaryOp = CUnaryOperator::kPreDecrement;
 
 			bool isUnaryExpression = false;
@@ -1591,18 +1826,29 @@ namespace expanse
 			}
 			else
 			{
-				if (opToken.IsString("&"))
+				switch (opToken.GetKind())
+				{
+				case TokenKind::kAmpersand:
 					unaryOp = CUnaryOperator::kReference;
-				else if (opToken.IsString("*"))
+					break;
+				case TokenKind::kAsterisk:
 					unaryOp = CUnaryOperator::kDereference;
-				else if (opToken.IsString("+"))
+					break;
+				case TokenKind::kPlus:
 					unaryOp = CUnaryOperator::kAbs;
-				else if (opToken.IsString("-"))
+					break;
+				case TokenKind::kMinus:
 					unaryOp = CUnaryOperator::kNeg;
-				else if (opToken.IsString("~"))
+					break;
+				case TokenKind::kTilde:
 					unaryOp = CUnaryOperator::kBitNot;
-				else if (opToken.IsString("!"))
+					break;
+				case TokenKind::kExclamation:
 					unaryOp = CUnaryOperator::kLogicalNot;
+					break;
+				default:
+					break;
+				}
 
 				if (unaryOp != CUnaryOperator::kInvalid)
 				{
@@ -1613,14 +1859,14 @@ namespace expanse
 				}
 				else
 				{
-					if (opToken.IsString("sizeof"))
+					if (opToken.GetKind() == TokenKind::kSizeof)
 					{
 						coord = opEndCoord;
 
 						FileCoordinate sizeofArgCoordinate = coord;
 						bool isSizeofType = false;
 						PEEK_TOKEN(lparenToken, lparenEndCoord);
-						if (lparenToken.IsString("("))
+						if (lparenToken.GetKind() == TokenKind::kLeftParen)
 						{
 							coord = lparenEndCoord;
 
@@ -1628,13 +1874,15 @@ namespace expanse
 							if (typeName != nullptr)
 							{
 								PEEK_TOKEN(rparenToken, rparenEndCoord);
-								if (rparenToken.IsString(")"))
+								if (rparenToken.GetKind() == TokenKind::kRightParen)
 								{
 									coord = rparenEndCoord;
 									isSizeofType = true;
 
 									CHECK_RV_ASSIGN(outProduct, New<CSizeOfTypeExpression>(alloc, std::move(typeName)));
 								}
+								else
+									ParkParseResult(ParseRule::kTypeName, lparenEndCoord, std::move(typeName));
 							}
 						}
 
@@ -1656,12 +1904,12 @@ namespace expanse
 				return ParsePostfixExpression(inOutCoordinate, outProduct, speculative);
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParsePostfixExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1674,7 +1922,7 @@ namespace expanse
 				bool succeeded = false;
 				PEEK_TOKEN(opToken, opEndCoord);
 
-				if (opToken.IsString("."))
+				if (opToken.GetKind() == TokenKind::kPeriod)
 				{
 					coord = opEndCoord;
 					SPECULATIVE_PARSE(CToken, identifier, ParseIdentifier);
@@ -1684,7 +1932,7 @@ namespace expanse
 						succeeded = true;
 					}
 				}
-				else if (opToken.IsString("->"))
+				else if (opToken.GetKind() == TokenKind::kArrow)
 				{
 					coord = opEndCoord;
 					SPECULATIVE_PARSE(CToken, identifier, ParseIdentifier);
@@ -1694,14 +1942,14 @@ namespace expanse
 						succeeded = true;
 					}
 				}
-				else if (opToken.IsString("["))
+				else if (opToken.GetKind() == TokenKind::kLeftBracket)
 				{
 					coord = opEndCoord;
 					SPECULATIVE_PARSE(CExpression, indexer, ParseExpression);
 					if (indexer)
 					{
 						PEEK_TOKEN(rbracketToken, rbracketEndCoord);
-						if (rbracketToken.IsString("]"))
+						if (rbracketToken.GetKind() == TokenKind::kRightBracket)
 						{
 							coord = rbracketEndCoord;
 							CHECK_RV_ASSIGN(leftSide, New<CBinaryExpression>(alloc, std::move(leftSide), std::move(indexer), CBinaryOperator::kIndex));
@@ -1709,27 +1957,27 @@ namespace expanse
 						}
 					}
 				}
-				else if (opToken.IsString("("))
+				else if (opToken.GetKind() == TokenKind::kLeftParen)
 				{
 					coord = opEndCoord;
 
 					SPECULATIVE_PARSE(CArgumentExpressionList, argList, ParseArgumentExpressionList);
 
 					PEEK_TOKEN(rparenToken, rparenEndCoord);
-					if (rparenToken.IsString(")"))
+					if (rparenToken.GetKind() == TokenKind::kRightParen)
 					{
 						coord = rparenEndCoord;
 						CHECK_RV_ASSIGN(leftSide, New<CInvokeExpression>(alloc, std::move(leftSide), std::move(argList)));
 						succeeded = true;
 					}
 				}
-				else if (opToken.IsString("++"))
+				else if (opToken.GetKind() == TokenKind::kIncrement)
 				{
 					coord = opEndCoord;
 					CHECK_RV_ASSIGN(leftSide, New<CUnaryExpression>(alloc, std::move(leftSide), CUnaryOperator::kPostIncrement));
 					succeeded = true;
 				}
-				else if (opToken.IsString("--"))
+				else if (opToken.GetKind() == TokenKind::kDecrement)
 				{
 					coord = opEndCoord;
 					CHECK_RV_ASSIGN(leftSide, New<CUnaryExpression>(alloc, std::move(leftSide), CUnaryOperator::kPostDecrement));
@@ -1746,12 +1994,12 @@ namespace expanse
 			outProduct = std::move(leftSide);
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParsePostfixExpressionLeftSide(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1760,7 +2008,7 @@ namespace expanse
 			FileCoordinate backupCoord = coord;
 
 			PEEK_TOKEN(lparenToken, lparenEndCoord);
-			if (lparenToken.IsString("("))
+			if (lparenToken.GetKind() == TokenKind::kLeftParen)
 			{
 				coord = lparenEndCoord;
 
@@ -1778,22 +2026,22 @@ namespace expanse
 				return ParsePrimaryExpression(inOutCoordinate, outProduct, speculative);
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParsePrimaryExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			PEEK_TOKEN_WITH_TYPE(peToken, peTokenEndCoord, tokenType);
-			if (peToken.IsString("("))
+			if (peToken.GetKind() == TokenKind::kLeftParen)
 			{
 				coord = peTokenEndCoord;
 
 				REQUIRE_PARSE(CExpression, expr, ParseExpression);
-				EXPECT_TOKEN(")");
+				EXPECT_TOKEN(TokenKind::kRightParen);
 
 				outProduct = std::move(expr);
 			}
@@ -1824,33 +2072,33 @@ namespace expanse
 			}
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParsePostfixExpressionInitializerListAfterTypeName(FileCoordinate &inOutCoordinate, CorePtr<CInitializerList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
-			EXPECT_TOKEN(")");
-			EXPECT_TOKEN("{");
+			EXPECT_TOKEN(TokenKind::kRightParen);
+			EXPECT_TOKEN(TokenKind::kLeftBrace);
 
 			REQUIRE_PARSE(CInitializerList, initList, ParseInitializerList);
 
 			PEEK_TOKEN(commaToken, commaEndCoord);
-			if (commaToken.IsString(","))
+			if (commaToken.GetKind() == TokenKind::kComma)
 				coord = commaEndCoord;
 
-			EXPECT_TOKEN("}");
+			EXPECT_TOKEN(TokenKind::kRightBrace);
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseInitializerList(FileCoordinate &inOutCoordinate, CorePtr<CInitializerList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1865,13 +2113,13 @@ namespace expanse
 
 				bool isExtension = false;
 				PEEK_TOKEN(commaToken, commaEndCoord);
-				if (commaToken.IsString(","))
+				if (commaToken.GetKind() == TokenKind::kComma)
 				{
 					coord = commaEndCoord;
 					SPECULATIVE_PARSE(CDesignatableInitializer, nextDesigInit, ParseDesignatableInitializer);
 					if (nextDesigInit)
 					{
-						CHECK(items.Add(std::move(firstDesigInit)));
+						CHECK(items.Add(std::move(nextDesigInit)));
 						isExtension = true;
 					}
 				}
@@ -1887,12 +2135,12 @@ namespace expanse
 			CHECK_RV_ASSIGN(outProduct, New<CInitializerList>(alloc, std::move(flat)));
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseDesignatableInitializer(FileCoordinate &inOutCoordinate, CorePtr<CDesignatableInitializer> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1902,27 +2150,27 @@ namespace expanse
 			CHECK_RV_ASSIGN(outProduct, New<CDesignatableInitializer>(alloc, std::move(designation), std::move(initializer)));
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseDesignation(FileCoordinate &inOutCoordinate, CorePtr<CDesignation> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			REQUIRE_PARSE(CDesignatorList, designatorList, ParseDesignatorList);
-			EXPECT_TOKEN("=");
+			EXPECT_TOKEN(TokenKind::kAssign);
 
 			CHECK_RV_ASSIGN(outProduct, New<CDesignation>(alloc, std::move(designatorList)));
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseDesignatorList(FileCoordinate &inOutCoordinate, CorePtr<CDesignatorList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -1944,52 +2192,55 @@ namespace expanse
 			CHECK_RV_ASSIGN(outProduct, New<CDesignatorList>(alloc, std::move(flat)));
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseDesignator(FileCoordinate &inOutCoordinate, CorePtr<CDesignator> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			PEEK_TOKEN(lbracketToken, lbracketEndCoord);
-			if (lbracketToken.IsString("["))
+			if (lbracketToken.GetKind() == TokenKind::kLeftBracket)
 			{
 				coord = lbracketEndCoord;
 
 				REQUIRE_PARSE(CExpression, expr, ParseConstantExpression);
-				EXPECT_TOKEN("]");
+				EXPECT_TOKEN(TokenKind::kRightBracket);
 
 				CHECK_RV_ASSIGN(outProduct, New<CDesignator>(alloc, std::move(expr)));
 			}
 			else
 			{
-				EXPECT_TOKEN(".");
+				EXPECT_TOKEN(TokenKind::kPeriod);
 				REQUIRE_PARSE(CToken, identifier, ParseIdentifier);
 				CHECK_RV_ASSIGN(outProduct, New<CDesignator>(alloc, std::move(identifier)));
 			}
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseInitializer(FileCoordinate &inOutCoordinate, CorePtr<CInitializer> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
+
+			ParseNestingScope nestingScope(this);
+			CHECK(nestingScope.Check(inOutCoordinate));
 
 			FileCoordinate coord = inOutCoordinate;
 
 			PEEK_TOKEN(lbraceToken, lbraceEndCoord);
-			if (lbraceToken.IsString("{"))
+			if (lbraceToken.GetKind() == TokenKind::kLeftBrace)
 			{
 				coord = lbraceEndCoord;
 
 				REQUIRE_PARSE(CInitializerList, initList, ParseInitializerList);
 				PEEK_TOKEN(commaToken, commaEndCoord);
-				if (commaToken.IsString(","))
+				if (commaToken.GetKind() == TokenKind::kComma)
 					coord = commaEndCoord;
-				EXPECT_TOKEN("}");
+				EXPECT_TOKEN(TokenKind::kRightBrace);
 				CHECK_RV_ASSIGN(outProduct, New<CInitializer>(alloc, std::move(initList)));
 			}
 			else
@@ -1999,13 +2250,13 @@ namespace expanse
 			}
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 
 		}
 
 		ResultRV<bool> CCompiler::ParseArgumentExpressionList(FileCoordinate &inOutCoordinate, CorePtr<CArgumentExpressionList> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -2018,7 +2269,7 @@ namespace expanse
 
 				bool succeeded = false;
 				PEEK_TOKEN(commaToken, commaEndCoord);
-				if (commaToken.IsString(","))
+				if (commaToken.GetKind() == TokenKind::kComma)
 				{
 					coord = commaEndCoord;
 
@@ -2041,12 +2292,12 @@ namespace expanse
 			CHECK_RV_ASSIGN(outProduct, New<CArgumentExpressionList>(alloc, std::move(flat)));
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseTypedefName(FileCoordinate &inOutCoordinate, CorePtr<CToken> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
@@ -2061,7 +2312,7 @@ namespace expanse
 				return ErrorCode::kOperationFailed;
 			}
 
-			const CIdentifierBinding *identifierBinding = m_currentScope->GetSymbolRecursive(identifierToken);
+			const CIdentifierBinding *identifierBinding = m_currentScope->GetSymbolRecursive(identifierToken.GetAtom());
 			if (identifierBinding == nullptr || identifierBinding->GetBindingType() != CIdentifierBinding::BindingType::kTypeDef)
 			{
 				if (speculative)
@@ -2076,16 +2327,21 @@ namespace expanse
 			CHECK_RV_ASSIGN(outProduct, New<CToken>(alloc, CGrammarElement::Subtype::kTypeDefNameSpecifier, identifierToken, inOutCoordinate));
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::DynamicParseLTRBinaryExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative, BinOperatorResolver_t opResolverFunc, ExpressionParseFunc_t nextPriorityFunc)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
-			REQUIRE_PARSE(CExpression, leftSide, *nextPriorityFunc);
+			CorePtr<CExpression> leftSide;
+			{
+				CHECK_RV(bool, parsedOK, (this->*nextPriorityFunc)(coord, leftSide, speculative));
+				if (!parsedOK)
+					return false;
+			}
 
 			for (;;)
 			{
@@ -2093,12 +2349,17 @@ namespace expanse
 
 				bool succeeded = false;
 				PEEK_TOKEN(operatorToken, operatorEndCoord);
-				CBinaryOperator binOp = opResolverFunc(operatorToken);
+				CBinaryOperator binOp = opResolverFunc(operatorToken.GetKind());
 				if (binOp != CBinaryOperator::kInvalid)
 				{
 					coord = operatorEndCoord;
 
-					SPECULATIVE_PARSE(CExpression, nextExpr, *nextPriorityFunc);
+					CorePtr<CExpression> nextExpr;
+					{
+						CHECK_RV(bool, parsedOK, (this->*nextPriorityFunc)(coord, nextExpr, true));
+						if (!parsedOK)
+							nextExpr = nullptr;
+					}
 					if (nextExpr)
 					{
 						CHECK_RV_ASSIGN(leftSide, New<CBinaryExpression>(alloc, std::move(leftSide), std::move(nextExpr), binOp));
@@ -2116,18 +2377,23 @@ namespace expanse
 			outProduct = std::move(leftSide);
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
 		ResultRV<bool> CCompiler::ParseCastExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
 		{
-			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
+			return MemoizedParse(ParseRule::kCastExpression, &CCompiler::ParseCastExpressionUnmemoized, inOutCoordinate, outProduct, speculative);
+		}
+
+		ResultRV<bool> CCompiler::ParseCastExpressionUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative)
+		{
+			IAllocator *alloc = &m_parseArena;
 
 			FileCoordinate coord = inOutCoordinate;
 
 			bool isCast = false;
 			PEEK_TOKEN(lparenToken, lparenEndCoord);
-			if (lparenToken.IsString("("))
+			if (lparenToken.GetKind() == TokenKind::kLeftParen)
 			{
 				coord = lparenEndCoord;
 
@@ -2135,7 +2401,7 @@ namespace expanse
 				if (typeName != nullptr)
 				{
 					PEEK_TOKEN(rparenToken, rparenEndCoord);
-					if (lparenToken.IsString(")"))
+					if (rparenToken.GetKind() == TokenKind::kRightParen)
 					{
 						coord = rparenEndCoord;
 
@@ -2146,6 +2412,10 @@ namespace expanse
 							CHECK_RV_ASSIGN(outProduct, New<CCastExpression>(alloc, std::move(typeName), std::move(rightSideExpr)));
 						}
 					}
+
+					// A parenthesized type name that isn't a cast is retried as a compound literal
+					if (!isCast)
+						ParkParseResult(ParseRule::kTypeName, lparenEndCoord, std::move(typeName));
 				}
 			}
 
@@ -2153,117 +2423,335 @@ namespace expanse
 				return ParseUnaryExpression(inOutCoordinate, outProduct, speculative);
 
 			inOutCoordinate = coord;
-			return ErrorCode::kOK;
+			return true;
 		}
 
-		CBinaryOperator CCompiler::ResolveLogicalOrOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveLogicalOrOperator(TokenKind kind)
 		{
-			if (token.IsString("||"))
+			switch (kind)
+			{
+			case TokenKind::kLogicalOr:
 				return CBinaryOperator::kLogicalOr;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveLogicalAndOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveLogicalAndOperator(TokenKind kind)
 		{
-			if (token.IsString("&&"))
+			switch (kind)
+			{
+			case TokenKind::kLogicalAnd:
 				return CBinaryOperator::kLogicalAnd;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveInclusiveOrOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveInclusiveOrOperator(TokenKind kind)
 		{
-			if (token.IsString("|"))
+			switch (kind)
+			{
+			case TokenKind::kVerticalBar:
 				return CBinaryOperator::kBitOr;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveExclusiveOrOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveExclusiveOrOperator(TokenKind kind)
 		{
-			if (token.IsString("^"))
+			switch (kind)
+			{
+			case TokenKind::kCaret:
 				return CBinaryOperator::kBitXor;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveAndOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveAndOperator(TokenKind kind)
 		{
-			if (token.IsString("&"))
+			switch (kind)
+			{
+			case TokenKind::kAmpersand:
 				return CBinaryOperator::kBitAnd;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveEqualityOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveEqualityOperator(TokenKind kind)
 		{
-			if (token.IsString("=="))
+			switch (kind)
+			{
+			case TokenKind::kEqual:
 				return CBinaryOperator::kEqual;
-			if (token.IsString("!="))
+			case TokenKind::kNotEqual:
 				return CBinaryOperator::kNotEqual;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveRelationalOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveRelationalOperator(TokenKind kind)
 		{
-			if (token.IsString(">"))
+			switch (kind)
+			{
+			case TokenKind::kGreater:
 				return CBinaryOperator::kGreater;
-			if (token.IsString("<"))
+			case TokenKind::kLess:
 				return CBinaryOperator::kLess;
-			if (token.IsString(">="))
+			case TokenKind::kGreaterEqual:
 				return CBinaryOperator::kGreaterOrEqual;
-			if (token.IsString("<="))
+			case TokenKind::kLessEqual:
 				return CBinaryOperator::kLessOrEqual;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveShiftOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveShiftOperator(TokenKind kind)
 		{
-			if (token.IsString(">>"))
+			switch (kind)
+			{
+			case TokenKind::kRightShift:
 				return CBinaryOperator::kRsh;
-			if (token.IsString("<<"))
+			case TokenKind::kLeftShift:
 				return CBinaryOperator::kLsh;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveAdditiveOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveAdditiveOperator(TokenKind kind)
 		{
-			if (token.IsString("+"))
+			switch (kind)
+			{
+			case TokenKind::kPlus:
 				return CBinaryOperator::kAdd;
-			if (token.IsString("-"))
+			case TokenKind::kMinus:
 				return CBinaryOperator::kSub;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveMultiplicativeOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveMultiplicativeOperator(TokenKind kind)
 		{
-			if (token.IsString("*"))
+			switch (kind)
+			{
+			case TokenKind::kAsterisk:
 				return CBinaryOperator::kMul;
-			if (token.IsString("/"))
+			case TokenKind::kSlash:
 				return CBinaryOperator::kDiv;
-			if (token.IsString("%"))
+			case TokenKind::kPercent:
 				return CBinaryOperator::kMod;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
-		CBinaryOperator CCompiler::ResolveCommaOperator(const TokenStrView &token)
+		CBinaryOperator CCompiler::ResolveCommaOperator(TokenKind kind)
 		{
-			if (token.IsString(","))
+			switch (kind)
+			{
+			case TokenKind::kComma:
 				return CBinaryOperator::kComma;
-
-			return CBinaryOperator::kInvalid;
+			default:
+				return CBinaryOperator::kInvalid;
+			}
 		}
 
 		Result CCompiler::ParseAndCompileInitializerForDeclarator(CDeclarationSpecifiers *declSpecifiers, CDeclarator *declarator, FileCoordinate &inOutCoordinate)
 		{
-			EXP_ASSERT(false);
-			return ErrorCode::kNotImplemented;
+			FileCoordinate coord = inOutCoordinate;
+
+			Optional<HStorageClass> storageClass;
+			TokenStrView name;
+			HTypeQualified elementType;
+			LType elementLType = LType::kSInt32;
+			bool isArray = false;
+			Optional<MaxUInt> numDeclaredElements;
+			CHECK_RV(bool, isConstantTable, ResolveConstantTableDeclarator(declSpecifiers, declarator, storageClass, name, elementType, elementLType, isArray, numDeclaredElements));
+
+			if (!isConstantTable || m_currentScope != m_globalScope)
+			{
+				EXP_ASSERT(false);
+				return ErrorCode::kNotImplemented;
+			}
+
+			// The declarator's source is released while the initializer is streamed, so anything that's reported at
+			// it has to be checked first
+			ConstantInitializerEmitter emitter(m_asmWriter, elementLType);
+			CHECK(OpenConstantTable(storageClass, name, elementType, numDeclaredElements, declarator, emitter));
+
+			CHECK_RV(bool, parsedInitializer, ParseAndEmitConstantInitializer(emitter, isArray, numDeclaredElements, coord));
+
+			// Arrays without a size get it from the highest initialized element
+			CHECK_RV(bool, finishedOK, emitter.Finish(numDeclaredElements.IsSet() ? numDeclaredElements.Get() : emitter.GetNumElements()));
+			if (!finishedOK)
+			{
+				ReportCompileError(CompilationErrorCode::kInvalidArraySize, coord);
+				return ErrorCode::kOperationFailed;
+			}
+
+			CHECK(m_asmWriter->CloseDataSection());
+
+			inOutCoordinate = coord;
+			return ErrorCode::kOK;
+		}
+
+		Result CCompiler::CompileTentativeDefinition(CDeclarationSpecifiers *declSpecifiers, CDeclarator *declarator)
+		{
+			Optional<HStorageClass> storageClass;
+			TokenStrView name;
+			HTypeQualified elementType;
+			LType elementLType = LType::kSInt32;
+			bool isArray = false;
+			Optional<MaxUInt> numDeclaredElements;
+			CHECK_RV(bool, isConstantTable, ResolveConstantTableDeclarator(declSpecifiers, declarator, storageClass, name, elementType, elementLType, isArray, numDeclaredElements));
+
+			// Declarations of anything else aren't compiled yet, and extern ones aren't definitions
+			if (!isConstantTable || (storageClass.IsSet() && storageClass.Get() == HStorageClass::kExtern))
+				return ErrorCode::kOK;
+
+			// Nothing can declare the table again to complete it, so it's defined here with an initializer of 0,
+			// which gives arrays without a size one element (6.9.2)
+			ConstantInitializerEmitter emitter(m_asmWriter, elementLType);
+			CHECK(OpenConstantTable(storageClass, name, elementType, numDeclaredElements, declarator, emitter));
+
+			CHECK_RV(bool, finishedOK, emitter.Finish(numDeclaredElements.IsSet() ? numDeclaredElements.Get() : MaxUInt(1)));
+			EXP_ASSERT(finishedOK);
+
+			CHECK(m_asmWriter->CloseDataSection());
+
+			return ErrorCode::kOK;
+		}
+
+		ResultRV<bool> CCompiler::ParseAndEmitConstantInitializer(ConstantInitializerEmitter &emitter, bool isArray, const Optional<MaxUInt> &numDeclaredElements, FileCoordinate &inOutCoordinate)
+		{
+			const bool speculative = false;
+
+			FileCoordinate coord = inOutCoordinate;
+
+			if (!isArray)
+			{
+				CHECK_RV(bool, parsedElement, ParseAndEmitConstantInitializerElement(emitter, false, numDeclaredElements, coord));
+
+				inOutCoordinate = coord;
+				return true;
+			}
+
+			EXPECT_TOKEN(TokenKind::kLeftBrace);
+
+			for (;;)
+			{
+				CHECK_RV(bool, parsedElement, ParseAndEmitConstantInitializerElement(emitter, true, numDeclaredElements, coord));
+
+				const FileCoordinate separatorCoord = coord;
+				PEEK_TOKEN(separatorToken, separatorEndCoord);
+				coord = separatorEndCoord;
+
+				if (separatorToken.GetKind() == TokenKind::kRightBrace)
+					break;
+
+				if (separatorToken.GetKind() != TokenKind::kComma)
+				{
+					ReportCompileError(CompilationErrorCode::kUnexpectedToken, separatorCoord);
+					return ErrorCode::kOperationFailed;
+				}
+
+				PEEK_TOKEN(rbraceToken, rbraceEndCoord);
+				if (rbraceToken.GetKind() == TokenKind::kRightBrace)
+				{
+					coord = rbraceEndCoord;
+					break;
+				}
+			}
+
+			inOutCoordinate = coord;
+			return true;
+		}
+
+		ResultRV<bool> CCompiler::ParseAndEmitConstantInitializerElement(ConstantInitializerEmitter &emitter, bool isArray, const Optional<MaxUInt> &numDeclaredElements, FileCoordinate &inOutCoordinate)
+		{
+			const bool speculative = false;
+
+			FileCoordinate coord = inOutCoordinate;
+
+			const ArenaAllocator::Mark elementMark = m_parseArena.GetMark();
+
+			{
+				if (isArray)
+				{
+					const FileCoordinate designationCoord = coord;
+					SPECULATIVE_PARSE(CDesignation, designation, ParseDesignation);
+					if (designation != nullptr)
+					{
+						const ArrayView<CorePtr<CDesignator>> designators = designation->GetDesignatorList()->GetChildren();
+
+						MaxUInt index;
+						bool isValidIndex = false;
+						if (designators.Size() == 1 && designators[0]->GetDesignatorSubtype() == CDesignator::DesignatorSubtype::kIndexExpression)
+						{
+							CHECK_RV_ASSIGN(isValidIndex, EvaluateConstantIndex(*designators[0]->GetIndexExpression(), designationCoord, index));
+						}
+
+						if (!isValidIndex || (numDeclaredElements.IsSet() && index >= numDeclaredElements.Get()))
+						{
+							ReportCompileError(CompilationErrorCode::kInvalidDesignator, designationCoord);
+							return ErrorCode::kOperationFailed;
+						}
+
+						emitter.SeekToElement(index);
+					}
+					else if (numDeclaredElements.IsSet() && emitter.GetNextIndex() >= numDeclaredElements.Get())
+					{
+						ReportCompileError(CompilationErrorCode::kTooManyInitializers, designationCoord);
+						return ErrorCode::kOperationFailed;
+					}
+				}
+
+				// Scalar initializers can be in braces
+				PEEK_TOKEN(lbraceToken, lbraceEndCoord);
+				const bool isBraced = (lbraceToken.GetKind() == TokenKind::kLeftBrace);
+				if (isBraced)
+					coord = lbraceEndCoord;
+
+				const FileCoordinate exprCoord = coord;
+				REQUIRE_PARSE(CExpression, expr, ParseAssignmentExpression);
+
+				if (isBraced)
+				{
+					PEEK_TOKEN(commaToken, commaEndCoord);
+					if (commaToken.GetKind() == TokenKind::kComma)
+						coord = commaEndCoord;
+					EXPECT_TOKEN(TokenKind::kRightBrace);
+				}
+
+				CompilerConstant value;
+				CHECK_RV(bool, isConstant, EvaluateConstantExpression(*expr, exprCoord, value));
+				if (!isConstant)
+				{
+					ReportCompileError(CompilationErrorCode::kExpectedConstantExpression, exprCoord);
+					return ErrorCode::kOperationFailed;
+				}
+
+				CHECK_RV(bool, emittedOK, emitter.EmitElement(value));
+				if (!emittedOK)
+				{
+					ReportCompileError(CompilationErrorCode::kConstantOutOfRange, exprCoord);
+					return ErrorCode::kOperationFailed;
+				}
+			}
+
+			// Nothing that was parsed for the element is needed any more, and neither are its tokens
+			DiscardParsedTokens(coord);
+			m_parseArena.Rewind(elementMark);
+
+			inOutCoordinate = coord;
+			return true;
 		}
 
 		Result CCompiler::ParseAndCompileInitDeclaratorListEndingInSemi(CDeclarationSpecifiers *declSpecifiers, FileCoordinate &inOutCoordinate)
@@ -2290,7 +2778,7 @@ namespace expanse
 
 		ResultRV<HTypeQualified> CCompiler::ResolveTypeDefName(const CToken &tokenElement)
 		{
-			const CIdentifierBinding *identBinding = m_currentScope->GetSymbolRecursive(tokenElement.GetToken());
+			const CIdentifierBinding *identBinding = m_currentScope->GetSymbolRecursive(tokenElement.GetToken().GetAtom());
 			if (identBinding != nullptr)
 			{
 				const HTypeQualified *qtype = identBinding->GetTypeDef();
@@ -2332,7 +2820,7 @@ namespace expanse
 
 			if (name.GetToken().Size() > 0)
 			{
-				CHECK(m_currentScope->AddTag(name, CTagBinding(aggDeclPtr)));
+				CHECK(m_currentScope->AddTag(name.GetAtom(), CTagBinding(aggDeclPtr)));
 			}
 
 			return aggDeclPtr;
@@ -2356,7 +2844,7 @@ namespace expanse
 
 			if (name.GetToken().Size() > 0)
 			{
-				CHECK(m_currentScope->AddTag(name, CTagBinding(enumDeclPtr)));
+				CHECK(m_currentScope->AddTag(name.GetAtom(), CTagBinding(enumDeclPtr)));
 			}
 
 			return enumDeclPtr;
@@ -2375,7 +2863,7 @@ namespace expanse
 			if (identifier && !declList)
 			{
 				// Identifier with no definition
-				const CTagBinding *tagBinding = m_currentScope->GetTagRecursive(identifier->GetToken());
+				const CTagBinding *tagBinding = m_currentScope->GetTagRecursive(identifier->GetToken().GetAtom());
 				if (tagBinding == nullptr)
 				{
 					// Tag doesn't exist, declare it here
@@ -2407,7 +2895,7 @@ namespace expanse
 			else if (identifier && declList)
 			{
 				// Identifier with definition.  Ensure that there isn't another of the same tag in the current scope and define it.
-				const CTagBinding *currentScopeBinding = m_currentScope->GetTagLocal(identifier->GetToken());
+				const CTagBinding *currentScopeBinding = m_currentScope->GetTagLocal(identifier->GetToken().GetAtom());
 				if (currentScopeBinding)
 				{
 					ReportCompileError(CompilationErrorCode::kDuplicateTag, identifier->GetCoordinate());
@@ -2434,7 +2922,7 @@ namespace expanse
 			if (identifier && !declList)
 			{
 				// Identifier with no definition
-				const CTagBinding *tagBinding = m_currentScope->GetTagRecursive(identifier->GetToken());
+				const CTagBinding *tagBinding = m_currentScope->GetTagRecursive(identifier->GetToken().GetAtom());
 				if (tagBinding == nullptr)
 				{
 					// Tag doesn't exist, declare it here
@@ -2465,7 +2953,7 @@ namespace expanse
 			else if (identifier && declList)
 			{
 				// Identifier with definition.  Ensure that there isn't another of the same tag in the current scope and define it.
-				const CTagBinding *currentScopeBinding = m_currentScope->GetTagLocal(identifier->GetToken());
+				const CTagBinding *currentScopeBinding = m_currentScope->GetTagLocal(identifier->GetToken().GetAtom());
 				if (currentScopeBinding)
 				{
 					ReportCompileError(CompilationErrorCode::kDuplicateTag, identifier->GetCoordinate());
@@ -2484,7 +2972,7 @@ namespace expanse
 			}
 		}
 
-		Result CCompiler::ResolveDeclSpecifiers(const CDeclarationSpecifiers *declSpecifiers, HTypeQualifiers &outQualifiers, bool &outIsInline, Optional<HStorageClass> &outStorageClass, HTypeUnqualified &outUnqualifiedType)
+		Result CCompiler::ResolveDeclSpecifiers(const CGrammarElementListContainer<CGrammarElement> *declSpecifiers, HTypeQualifiers &outQualifiers, bool &outIsInline, Optional<HStorageClass> &outStorageClass, HTypeUnqualified &outUnqualifiedType)
 		{
 			HTypeQualifiers qualifiers;
 			bool isRestrict = false;
@@ -2545,18 +3033,24 @@ namespace expanse
 						const TokenStrView token = static_cast<const CToken*>(element)->GetToken();
 
 						HStorageClass storageClass = HStorageClass::kInvalid;
-						if (token.IsString("typedef"))
+						switch (token.GetKind())
+						{
+						case TokenKind::kTypedef:
 							storageClass = HStorageClass::kTypeDef;
-						else if (token.IsString("extern"))
+							break;
+						case TokenKind::kExtern:
 							storageClass = HStorageClass::kExtern;
-						else if (token.IsString("static"))
+							break;
+						case TokenKind::kStatic:
 							storageClass = HStorageClass::kStatic;
-						else if (token.IsString("auto"))
+							break;
+						case TokenKind::kAuto:
 							storageClass = HStorageClass::kAuto;
-						else if (token.IsString("register"))
+							break;
+						case TokenKind::kRegister:
 							storageClass = HStorageClass::kRegister;
-						else
-						{
+							break;
+						default:
 							EXP_ASSERT(false);
 							return ErrorCode::kInternalError;
 						}
@@ -2570,9 +3064,9 @@ namespace expanse
 								this->ReportCompileError(CompilationErrorCode::kDeclaratorMultipleStorageClasses, tokenElement->GetCoordinate());
 								return ErrorCode::kOperationFailed;
 							}
-
-							outStorageClass = storageClass;
 						}
+
+						outStorageClass = storageClass;
 					}
 					break;
 				case CGrammarElement::Subtype::kTypeDefNameSpecifier:
@@ -2597,39 +3091,48 @@ namespace expanse
 
 						int invalidQualifiersMask = 0;
 						int newBit = 0;
-						if (token.IsString("void"))
+						switch (token.GetKind())
+						{
+						case TokenKind::kVoid:
 							newBit = kVoidBit;
-						else if (token.IsString("char"))
+							break;
+						case TokenKind::kChar:
 							newBit = kCharBit;
-						else if (token.IsString("short"))
+							break;
+						case TokenKind::kShort:
 							newBit = kShortBit;
-						else if (token.IsString("int"))
+							break;
+						case TokenKind::kInt:
 							newBit = kIntBit;
-						else if (token.IsString("long"))
-						{
-							if ((declSpecQualifiers & kLongBit) == 0)
+							break;
+						case TokenKind::kLong:
+							if ((declSpecQualifiers & kLongBit) != 0)
+							{
+								declSpecQualifiers &= ~kLongBit;
 								newBit = kLongLongBit;
+							}
 							else
 								newBit = kLongBit;
-						}
-						else if (token.IsString("float"))
+							break;
+						case TokenKind::kFloat:
 							newBit = kFloatBit;
-						else if (token.IsString("double"))
+							break;
+						case TokenKind::kDouble:
 							newBit = kDoubleBit;
-						else if (token.IsString("signed"))
+							break;
+						case TokenKind::kSigned:
 							newBit = kSignedBit;
-						else if (token.IsString("unsigned"))
+							break;
+						case TokenKind::kUnsigned:
 							newBit = kUnsignedBit;
-						else if (token.IsString("_Bool"))
+							break;
+						case TokenKind::kBool:
 							newBit = kBoolBit;
-						else if (token.IsString("float"))
-							newBit = kFloatBit;
-						else if (token.IsString("double"))
-							newBit = kDoubleBit;
-						else if (token.IsString("_Complex"))
+							break;
+						case TokenKind::kComplex:
 							newBit = kComplexBit;
-						else
-						{
+							break;
+						default:
 							EXP_ASSERT(false);
 							return ErrorCode::kInternalError;
 						}
@@ -2692,11 +3195,11 @@ namespace expanse
 						const CToken *tokenElement = static_cast<const CToken*>(element);
 						const TokenStrView token = static_cast<const CToken*>(element)->GetToken();
 
-						if (token.IsString("const"))
+						if (token.GetKind() == TokenKind::kConst)
 							qualifiers.m_isConst = true;
-						else if (token.IsString("restrict"))
+						else if (token.GetKind() == TokenKind::kRestrict)
 							qualifiers.m_isRestrict = true;
-						else if (token.IsString("volatile"))
+						else if (token.GetKind() == TokenKind::kVolatile)
 							qualifiers.m_isVolatile = true;
 						else
 						{
@@ -2710,7 +3213,7 @@ namespace expanse
 						const CToken *tokenElement = static_cast<const CToken*>(element);
 						const TokenStrView token = static_cast<const CToken*>(element)->GetToken();
 
-						if (token.IsString("inline"))
+						if (token.GetKind() == TokenKind::kInline)
 							isInline = true;
 						else
 						{
@@ -2852,11 +3355,11 @@ namespace expanse
 			for (const CToken *tokenElement : qualList.GetChildren())
 			{
 				const TokenStrView token = tokenElement->GetToken();
-				if (token.IsString("const"))
+				if (token.GetKind() == TokenKind::kConst)
 					qualifiers.m_isConst = true;
-				else if (token.IsString("volatile"))
+				else if (token.GetKind() == TokenKind::kVolatile)
 					qualifiers.m_isVolatile = true;
-				else if (token.IsString("restrict"))
+				else if (token.GetKind() == TokenKind::kRestrict)
 					qualifiers.m_isRestrict = true;
 				else
 				{
@@ -2959,110 +3462,1246 @@ namespace expanse
 			return ErrorCode::kNotImplemented;
 		}
 
-		Result CCompiler::CommitDeclarator(CDeclarationSpecifiers *declSpecifiers, CDeclarator *declarator)
+		ResultRV<bool> CCompiler::ResolveConstantTableDeclarator(const CDeclarationSpecifiers *declSpecifiers, const CDeclarator *declarator, Optional<HStorageClass> &outStorageClass, TokenStrView &outName, HTypeQualified &outElementType, LType &outElementLType, bool &outIsArray, Optional<MaxUInt> &outNumDeclaredElements)
 		{
-			Optional<HStorageClass> storageClass;
-			TokenStrView name;
-			HTypeQualified declType;
-			CHECK(ResolveDeclarator(declSpecifiers, declarator, storageClass, name, declType));
-
-			if (storageClass.IsSet() && storageClass.Get() == HStorageClass::kTypeDef)
-			{
-				const CIdentifierBinding *identifier = m_currentScope->GetSymbolLocal(name);
-				if (identifier == nullptr)
-				{
-					ReportCompileError(CompilationErrorCode::kSymbolRedefinition, declarator->GetCoordinate());
-					return ErrorCode::kOperationFailed;
-				}
+			HTypeQualifiers qualifiers;
+			bool isInline = false;
+			HTypeUnqualified unqualified;
+			CHECK(ResolveDeclSpecifiers(declSpecifiers, qualifiers, isInline, outStorageClass, unqualified));
 
-				CHECK(m_currentScope->DefineIdentifier(name, CIdentifierBinding(declType)));
+			if (isInline || !ResolveScalarLType(unqualified, outElementLType))
+				return false;
 
-				return ErrorCode::kOK;
-			}
+			if (outStorageClass.IsSet() && outStorageClass.Get() != HStorageClass::kStatic && outStorageClass.Get() != HStorageClass::kExtern)
+				return false;
 
-			const bool isFileScope = (m_currentScope == m_globalScope);
+			if (declarator->GetOptPointer() != nullptr)
+				return false;
 
-			// Commits a declarator to the current scope and creates an identifier and possibly a reserved definition, as defined in 6.2 and 6.9.2
-			// Linkages:
-			//
-			// "static" file scope declaration -> internal linkage
-			// "extern" declaration:
-			//     If prior declaration has internal or external linkage, inherit prior declaration.
-			//     If no prior declaration, or prior declaration has no linkage, new declaration has external linkage.
-			// Functions with no storage class specifier are "extern"
-			// Objects with file scope are "extern"
-			//
-			// Objects with file scope, no initializer, and no storage class or "static" storage class are tentative definitions.
-			//
-			// The end result of this is that we need to resolve this as either a global object or a local object.
-			// Global object references have one of two types: Speculative and real.
-			//
-			// Speculative objects are required for the following situation:
-			// int func(void)
-			// {
-			//     extern int symbol;
-			//     return symbol;
-			// }
-			// float symbol;
-			// 
-			// In this case, the two are the same object despite having different types
-			const bool isFunctionDefinition = (declType.GetUnqualified().GetSubtype() == HTypeUnqualified::Subtype::kFunction);
+			const CDirectDeclarator *ddec = declarator->GetDirectDeclarator();
 
-			if (isFileScope)
+			outIsArray = false;
+			if (ddec->GetDirectDeclType() == CDirectDeclarator::DirectDeclaratorType::kDirectDeclaratorContinuation)
 			{
-				if (storageClass.IsSet())
+				const CDirectDeclaratorContinuation *continuation = ddec->GetContinuation();
+				if (continuation->GetContinuationType() != CDirectDeclaratorContinuation::ContinuationType::kSquareBracket)
+					return false;
+
+				if (continuation->GetTypeQualifierList() || continuation->HasAsterisk() || continuation->HasStatic())
 				{
-					if (storageClass.Get() == HStorageClass::kAuto || storageClass.Get() == HStorageClass::kRegister)
-					{
-						ReportCompileError(CompilationErrorCode::kAutoOrRegisterNotAllowedOnExternalDeclaration, declarator->GetCoordinate());
-						return ErrorCode::kOperationFailed;
-					}
+					ReportCompileError(CompilationErrorCode::kVariableSizeArrayedNotSupported, ddec->GetCoordinate());
+					return ErrorCode::kOperationFailed;
 				}
-			}
 
-			// Scope determination rules:
-			// struct, union, and enum tags: Current scope
-			// 
+				const CExpression *sizeExpr = continuation->GetAssignmentExpr();
+				if (sizeExpr != nullptr)
+				{
+					MaxUInt numElements;
+					CHECK_RV(bool, isConstantSize, EvaluateConstantIndex(*sizeExpr, continuation->GetCoordinate(), numElements));
+					if (!isConstantSize)
+						return false;
 
-			EXP_ASSERT(false);
-			return ErrorCode::kNotImplemented;
-		}
+					if (numElements == MaxUInt(0))
+					{
+						ReportCompileError(CompilationErrorCode::kInvalidArraySize, continuation->GetCoordinate());
+						return ErrorCode::kOperationFailed;
+					}
 
+					outNumDeclaredElements = numElements;
+				}
 
-		bool CCompiler::GetToken(TokenStrView &token, FileCoordinate &coord, CLexer::TokenType &tokenType)
-		{
-			if (m_lastParseCoord.IsSet() && m_lastParseCoord.Get() == coord)
-			{
-				token = m_lastToken;
-				coord = m_lastEndCoord;
-				tokenType = m_lastTokenType;
-				return true;
+				outIsArray = true;
+				ddec = ddec->GetNextDirectDeclarator();
 			}
 
-			FileCoordinate newCoord;
-			ArrayView<const uint8_t> newToken;
-			CLexer::TokenType newTokenType = CLexer::TokenType::kInvalid;
-			const bool hasToken = CLexer::TryGetToken(m_contents.ConstView(), coord, false, false, m_tracer, m_errorReporter, true, true, newToken, newTokenType, newCoord);
-			if (hasToken)
-			{
-				m_lastParseCoord = coord;
-				m_lastToken = TokenStrView(newToken);
-				m_lastEndCoord = newCoord;
-				m_lastTokenType = newTokenType;
+			if (ddec->GetDirectDeclType() != CDirectDeclarator::DirectDeclaratorType::kIdentifier)
+				return false;
 
-				coord = newCoord;
-				token = TokenStrView(newToken);;
-				tokenType = newTokenType;
-				return true;
-			}
+			outName = ddec->GetIdentifier()->GetToken();
+			outElementType = HTypeQualified(unqualified, qualifiers);
 
-			return false;
+			return true;
 		}
 
-
-		void CCompiler::ReportCompileError(CompilationErrorCode errorCode, const FileCoordinate &coord)
+		bool CCompiler::ResolveScalarLType(const HTypeUnqualified &t, LType &outLType) const
 		{
-		}
+			switch (t.GetSubtype())
+			{
+			case HTypeUnqualified::Subtype::kIntegral:
+				{
+					const HTypeIntegral &intType = t.GetIntegral();
+
+					LType lType = LType::kSInt32;
+					switch (intType.m_intType)
+					{
+					case HTypeIntegral::IntegralType::kBool:
+						// Conversions to _Bool compare with zero instead of wrapping around
+						return false;
+					case HTypeIntegral::IntegralType::kChar:
+						lType = LType::kSInt8;
+						break;
+					case HTypeIntegral::IntegralType::kShort:
+						lType = m_config.m_shortIntLType;
+						break;
+					case HTypeIntegral::IntegralType::kInt:
+						lType = m_config.m_intLType;
+						break;
+					case HTypeIntegral::IntegralType::kLongInt:
+						lType = m_config.m_longIntLType;
+						break;
+					case HTypeIntegral::IntegralType::kLongLongInt:
+						lType = m_config.m_longLongIntLType;
+						break;
+					default:
+						EXP_ASSERT(false);
+						return false;
+					}
+
+					outLType = intType.m_isUnsigned ? UnsignedLType(lType) : SignedLType(lType);
+					return true;
+				}
+			case HTypeUnqualified::Subtype::kFloating:
+				{
+					const HTypeFloating &floatType = t.GetFloating();
+					if (floatType.GetComplexityClass() != HTypeFloating::ComplexityClass::kReal)
+						return false;
+
+					// long double is the same as double, as with constants
+					if (floatType.GetFloatingType() == HTypeFloating::FloatingType::kSingle)
+						outLType = m_config.m_floatLType;
+					else
+						outLType = m_config.m_doubleLType;
+					return true;
+				}
+			default:
+				return false;
+			}
+		}
+
+		ResultRV<bool> CCompiler::EvaluateConstantExpression(const CExpression &expr, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			return EvaluateConstantSubexpression(expr, true, blameCoord, outValue);
+		}
+
+		ResultRV<bool> CCompiler::EvaluateConstantSubexpression(const CExpression &expr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			switch (expr.GetExprSubtype())
+			{
+			case CExpression::ExpressionSubtype::kTokenExpression:
+				return EvaluateConstantToken(static_cast<const CTokenExpression&>(expr), blameCoord, outValue);
+			case CExpression::ExpressionSubtype::kUnary:
+				return EvaluateConstantUnary(static_cast<const CUnaryExpression&>(expr), isEvaluated, blameCoord, outValue);
+			case CExpression::ExpressionSubtype::kBinary:
+				return EvaluateConstantBinary(static_cast<const CBinaryExpression&>(expr), isEvaluated, blameCoord, outValue);
+			case CExpression::ExpressionSubtype::kTernary:
+				return EvaluateConstantTernary(static_cast<const CTernaryExpression&>(expr), isEvaluated, blameCoord, outValue);
+			case CExpression::ExpressionSubtype::kCast:
+				return EvaluateConstantCast(static_cast<const CCastExpression&>(expr), isEvaluated, blameCoord, outValue);
+			case CExpression::ExpressionSubtype::kMember:
+			case CExpression::ExpressionSubtype::kTypedInitializer:
+			case CExpression::ExpressionSubtype::kInvoke:
+				return false;
+			case CExpression::ExpressionSubtype::kSizeOfType:
+				// Not evaluated yet
+				return false;
+			default:
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			}
+		}
+
+		ResultRV<bool> CCompiler::EvaluateConstantToken(const CTokenExpression &tokenExpr, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			const ArrayView<const uint8_t> spelling = tokenExpr.GetToken().GetToken();
+
+			switch (tokenExpr.GetTokenExpressionSubtype())
+			{
+			case CTokenExpression::TokenExpressionSubtype::kNumber:
+				break;
+			case CTokenExpression::TokenExpressionSubtype::kIdentifier:
+				// Enumeration constants aren't declared yet, so no identifier is a constant
+				return false;
+			case CTokenExpression::TokenExpressionSubtype::kCharSequence:
+				{
+					// String literals aren't arithmetic
+					if (spelling[spelling.Size() - 1] != CharCode::kSingleQuote)
+						return false;
+
+					NumericLiteral::Character character;
+					switch (NumericLiteral::DecodeCharacter(spelling, character))
+					{
+					case NumericLiteral::DecodeStatus::kOK:
+						NumericLiteral::CharacterToConstant(character, m_config, outValue);
+						return true;
+					case NumericLiteral::DecodeStatus::kInvalidEscape:
+						ReportCompileError(CompilationErrorCode::kInvalidEscapeSequence, blameCoord);
+						return ErrorCode::kOperationFailed;
+					default:
+						ReportCompileError(CompilationErrorCode::kInvalidNumericConstant, blameCoord);
+						return ErrorCode::kOperationFailed;
+					}
+				}
+			default:
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			}
+
+			switch (NumericLiteral::Decode(spelling, m_config, outValue))
+			{
+			case NumericLiteral::DecodeStatus::kOK:
+				return true;
+			case NumericLiteral::DecodeStatus::kOverflow:
+				ReportCompileError(CompilationErrorCode::kConstantOutOfRange, blameCoord);
+				return ErrorCode::kOperationFailed;
+			default:
+				ReportCompileError(CompilationErrorCode::kInvalidNumericConstant, blameCoord);
+				return ErrorCode::kOperationFailed;
+			}
+		}
+
+		ResultRV<bool> CCompiler::EvaluateConstantUnary(const CUnaryExpression &unaryExpr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			switch (unaryExpr.m_unaryOp)
+			{
+			case CUnaryOperator::kAbs:
+			case CUnaryOperator::kNeg:
+			case CUnaryOperator::kBitNot:
+			case CUnaryOperator::kLogicalNot:
+				break;
+			case CUnaryOperator::kPreIncrement:
+			case CUnaryOperator::kPreDecrement:
+			case CUnaryOperator::kPostIncrement:
+			case CUnaryOperator::kPostDecrement:
+			case CUnaryOperator::kReference:
+			case CUnaryOperator::kDereference:
+				return false;
+			case CUnaryOperator::kSizeOfExpr:
+				// Not evaluated yet
+				return false;
+			default:
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			}
+
+			CompilerConstant operand;
+			CHECK_RV(bool, isConstant, EvaluateConstantSubexpression(*unaryExpr.m_expr, isEvaluated, blameCoord, operand));
+			if (!isConstant)
+				return false;
+
+			if (unaryExpr.m_unaryOp == CUnaryOperator::kLogicalNot)
+			{
+				outValue = MakeTruthConstant(!operand.IsNonZero());
+				return true;
+			}
+
+			const LType lType = PromoteLType(operand.GetLType());
+			CompilerConstant promoted;
+			operand.ConvertTo(lType, promoted);
+
+			if (unaryExpr.m_unaryOp == CUnaryOperator::kAbs)
+			{
+				outValue = promoted;
+				return true;
+			}
+
+			if (IsFloatLType(lType))
+			{
+				// ~ only takes integers
+				if (unaryExpr.m_unaryOp == CUnaryOperator::kBitNot)
+					return false;
+
+				outValue = CompilerConstant::FromDouble(lType, -promoted.ToDouble());
+				return true;
+			}
+
+			if (IsSignedIntegerLType(lType))
+			{
+				MaxSInt result;
+				if (unaryExpr.m_unaryOp == CUnaryOperator::kBitNot)
+					result = ~promoted.GetSigned();
+				else if (!TryTakeSignedResult(promoted.GetSigned().Negate(), result))
+					return ResolveConstantOutOfRange(isEvaluated, lType, blameCoord, outValue);
+
+				if (!FitsSignedLType(result, lType, outValue))
+					return ResolveConstantOutOfRange(isEvaluated, lType, blameCoord, outValue);
+
+				return true;
+			}
+
+			const MaxUInt result = (unaryExpr.m_unaryOp == CUnaryOperator::kBitNot) ? ~promoted.GetUnsigned() : -promoted.GetUnsigned();
+			CompilerConstant(LType::kUInt64, result).ConvertTo(lType, outValue);
+
+			return true;
+		}
+
+		ResultRV<bool> CCompiler::EvaluateConstantBinary(const CBinaryExpression &binaryExpr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			const CBinaryOperator op = binaryExpr.m_binOp;
+
+			switch (op)
+			{
+			case CBinaryOperator::kAssign:
+			case CBinaryOperator::kMulAssign:
+			case CBinaryOperator::kDivAssign:
+			case CBinaryOperator::kModAssign:
+			case CBinaryOperator::kAddAssign:
+			case CBinaryOperator::kSubAssign:
+			case CBinaryOperator::kLshAssign:
+			case CBinaryOperator::kRshAssign:
+			case CBinaryOperator::kBitAndAssign:
+			case CBinaryOperator::kBitXorAssign:
+			case CBinaryOperator::kBitOrAssign:
+			case CBinaryOperator::kComma:
+				// Not allowed in constant expressions (6.6)
+				return false;
+			case CBinaryOperator::kIndex:
+				return false;
+			case CBinaryOperator::kInvalid:
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			default:
+				break;
+			}
+
+			CompilerConstant left;
+			CHECK_RV(bool, isLeftConstant, EvaluateConstantSubexpression(*binaryExpr.m_leftExpr, isEvaluated, blameCoord, left));
+			if (!isLeftConstant)
+				return false;
+
+			// The right side of && and || is only evaluated if the left side didn't already decide the result
+			bool isRightEvaluated = isEvaluated;
+			if (op == CBinaryOperator::kLogicalAnd)
+				isRightEvaluated = isEvaluated && left.IsNonZero();
+			else if (op == CBinaryOperator::kLogicalOr)
+				isRightEvaluated = isEvaluated && !left.IsNonZero();
+
+			CompilerConstant right;
+			CHECK_RV(bool, isRightConstant, EvaluateConstantSubexpression(*binaryExpr.m_rightExpr, isRightEvaluated, blameCoord, right));
+			if (!isRightConstant)
+				return false;
+
+			switch (op)
+			{
+			case CBinaryOperator::kLogicalAnd:
+				outValue = MakeTruthConstant(left.IsNonZero() && right.IsNonZero());
+				return true;
+			case CBinaryOperator::kLogicalOr:
+				outValue = MakeTruthConstant(left.IsNonZero() || right.IsNonZero());
+				return true;
+			case CBinaryOperator::kLsh:
+			case CBinaryOperator::kRsh:
+				return EvaluateConstantShift(op, left, right, isEvaluated, blameCoord, outValue);
+			default:
+				break;
+			}
+
+			const LType lType = ResolveCommonArithmeticLType(left.GetLType(), right.GetLType());
+
+			CompilerConstant convertedLeft;
+			CompilerConstant convertedRight;
+			left.ConvertTo(lType, convertedLeft);
+			right.ConvertTo(lType, convertedRight);
+
+			int comparison = 0;
+			if (IsFloatLType(lType))
+			{
+				const double a = convertedLeft.ToDouble();
+				const double b = convertedRight.ToDouble();
+				comparison = (a < b) ? -1 : ((a > b) ? 1 : 0);
+			}
+			else if (IsSignedIntegerLType(lType))
+			{
+				const MaxSInt a = convertedLeft.GetSigned();
+				const MaxSInt b = convertedRight.GetSigned();
+				comparison = (a < b) ? -1 : ((a > b) ? 1 : 0);
+			}
+			else
+			{
+				const MaxUInt a = convertedLeft.GetUnsigned();
+				const MaxUInt b = convertedRight.GetUnsigned();
+				comparison = (a < b) ? -1 : ((a > b) ? 1 : 0);
+			}
+
+			switch (op)
+			{
+			case CBinaryOperator::kEqual:
+				outValue = MakeTruthConstant(comparison == 0);
+				return true;
+			case CBinaryOperator::kNotEqual:
+				outValue = MakeTruthConstant(comparison != 0);
+				return true;
+			case CBinaryOperator::kLess:
+				outValue = MakeTruthConstant(comparison < 0);
+				return true;
+			case CBinaryOperator::kGreater:
+				outValue = MakeTruthConstant(comparison > 0);
+				return true;
+			case CBinaryOperator::kLessOrEqual:
+				outValue = MakeTruthConstant(comparison <= 0);
+				return true;
+			case CBinaryOperator::kGreaterOrEqual:
+				outValue = MakeTruthConstant(comparison >= 0);
+				return true;
+			default:
+				return ApplyConstantArithmetic(op, convertedLeft, convertedRight, isEvaluated, blameCoord, outValue);
+			}
+		}
+
+		ResultRV<bool> CCompiler::EvaluateConstantShift(CBinaryOperator op, const CompilerConstant &left, const CompilerConstant &right, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			if (IsFloatLType(left.GetLType()) || IsFloatLType(right.GetLType()))
+				return false;
+
+			// The result has the promoted type of the left operand, the count only has to be in range (6.5.7)
+			const LType lType = PromoteLType(left.GetLType());
+			const MaxUInt numBits(GetLTypeSize(lType) * 8);
+
+			CompilerConstant promoted;
+			left.ConvertTo(lType, promoted);
+
+			MaxUInt count;
+			if (IsSignedIntegerLType(right.GetLType()))
+			{
+				if (right.GetSigned() < MaxSInt(0))
+					return ResolveUndefinedConstantOperation(isEvaluated, lType, outValue);
+				count = right.GetSigned().BitCastToUnsigned();
+			}
+			else
+				count = right.GetUnsigned();
+
+			if (count >= numBits)
+				return ResolveUndefinedConstantOperation(isEvaluated, lType, outValue);
+
+			if (IsSignedIntegerLType(lType))
+			{
+				// Shifting a negative value left fails too, since it's undefined
+				MaxSInt result;
+				const bool isInRange = (op == CBinaryOperator::kLsh) ? TryTakeSignedResult(promoted.GetSigned().ShiftLeft(count), result) : TryTakeSignedResult(promoted.GetSigned().ShiftRight(count), result);
+				if (!isInRange || !FitsSignedLType(result, lType, outValue))
+					return ResolveConstantOutOfRange(isEvaluated, lType, blameCoord, outValue);
+
+				return true;
+			}
+
+			const MaxUInt value = promoted.GetUnsigned();
+			CHECK_RV(MaxUInt, result, (op == CBinaryOperator::kLsh) ? value.ShiftLeft(count) : value.ShiftRight(count));
+			CompilerConstant(LType::kUInt64, result).ConvertTo(lType, outValue);
+
+			return true;
+		}
+
+		ResultRV<bool> CCompiler::EvaluateConstantTernary(const CTernaryExpression &ternaryExpr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			CompilerConstant condition;
+			CHECK_RV(bool, isConditionConstant, EvaluateConstantSubexpression(*ternaryExpr.m_conditionExpr, isEvaluated, blameCoord, condition));
+			if (!isConditionConstant)
+				return false;
+
+			// Only the selected side is evaluated, but both sides decide the type
+			const bool isTrue = condition.IsNonZero();
+
+			CompilerConstant trueValue;
+			CHECK_RV(bool, isTrueConstant, EvaluateConstantSubexpression(*ternaryExpr.m_trueExpr, isEvaluated && isTrue, blameCoord, trueValue));
+			if (!isTrueConstant)
+				return false;
+
+			CompilerConstant falseValue;
+			CHECK_RV(bool, isFalseConstant, EvaluateConstantSubexpression(*ternaryExpr.m_falseExpr, isEvaluated && !isTrue, blameCoord, falseValue));
+			if (!isFalseConstant)
+				return false;
+
+			const LType lType = ResolveCommonArithmeticLType(trueValue.GetLType(), falseValue.GetLType());
+			(isTrue ? trueValue : falseValue).ConvertTo(lType, outValue);
+
+			return true;
+		}
+
+		ResultRV<bool> CCompiler::EvaluateConstantCast(const CCastExpression &castExpr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			const CTypeName *typeName = castExpr.m_typeName;
+
+			// Abstract declarators only make pointer, array and function types, none of which are arithmetic
+			if (typeName->GetOptAbstractDeclarator() != nullptr)
+				return false;
+
+			HTypeQualifiers qualifiers;
+			bool isInline = false;
+			Optional<HStorageClass> storageClass;
+			HTypeUnqualified unqualified;
+			CHECK(ResolveDeclSpecifiers(typeName->GetSpecifierQualifierList(), qualifiers, isInline, storageClass, unqualified));
+
+			LType lType = LType::kSInt32;
+			if (!ResolveScalarLType(unqualified, lType))
+				return false;
+
+			CompilerConstant operand;
+			CHECK_RV(bool, isConstant, EvaluateConstantSubexpression(*castExpr.m_rightSideExpr, isEvaluated, blameCoord, operand));
+			if (!isConstant)
+				return false;
+
+			if (!operand.ConvertTo(lType, outValue))
+				return ResolveConstantOutOfRange(isEvaluated, lType, blameCoord, outValue);
+
+			return true;
+		}
+
+		ResultRV<bool> CCompiler::ApplyConstantArithmetic(CBinaryOperator op, const CompilerConstant &left, const CompilerConstant &right, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			const LType lType = left.GetLType();
+			EXP_ASSERT(right.GetLType() == lType);
+
+			const bool isDivision = (op == CBinaryOperator::kDiv || op == CBinaryOperator::kMod);
+			if (isDivision && !right.IsNonZero())
+				return ResolveUndefinedConstantOperation(isEvaluated, lType, outValue);
+
+			if (IsFloatLType(lType))
+			{
+				const double a = left.ToDouble();
+				const double b = right.ToDouble();
+
+				// Computing in double and rounding once is exact for float too
+				double result = 0.0;
+				switch (op)
+				{
+				case CBinaryOperator::kAdd:
+					result = a + b;
+					break;
+				case CBinaryOperator::kSub:
+					result = a - b;
+					break;
+				case CBinaryOperator::kMul:
+					result = a * b;
+					break;
+				case CBinaryOperator::kDiv:
+					result = a / b;
+					break;
+				default:
+					// % and the bitwise operators only take integers
+					return false;
+				}
+
+				outValue = CompilerConstant::FromDouble(lType, result);
+				if (!std::isfinite(outValue.ToDouble()))
+					return ResolveConstantOutOfRange(isEvaluated, lType, blameCoord, outValue);
+
+				return true;
+			}
+
+			if (IsSignedIntegerLType(lType))
+			{
+				const MaxSInt a = left.GetSigned();
+				const MaxSInt b = right.GetSigned();
+
+				MaxSInt result;
+				bool isInRange = true;
+				switch (op)
+				{
+				case CBinaryOperator::kAdd:
+					isInRange = TryTakeSignedResult(a.Add(b), result);
+					break;
+				case CBinaryOperator::kSub:
+					isInRange = TryTakeSignedResult(a.Subtract(b), result);
+					break;
+				case CBinaryOperator::kMul:
+					isInRange = TryTakeSignedResult(a.Multiply(b), result);
+					break;
+				case CBinaryOperator::kDiv:
+					isInRange = TryTakeSignedResult(a.Divide(b), result);
+					break;
+				case CBinaryOperator::kMod:
+					isInRange = TryTakeSignedResult(a.Modulo(b), result);
+					break;
+				case CBinaryOperator::kBitAnd:
+					result = a & b;
+					break;
+				case CBinaryOperator::kBitOr:
+					result = a | b;
+					break;
+				case CBinaryOperator::kBitXor:
+					result = a ^ b;
+					break;
+				default:
+					EXP_ASSERT(false);
+					return ErrorCode::kInternalError;
+				}
+
+				if (!isInRange || !FitsSignedLType(result, lType, outValue))
+					return ResolveConstantOutOfRange(isEvaluated, lType, blameCoord, outValue);
+
+				return true;
+			}
+
+			const MaxUInt a = left.GetUnsigned();
+			const MaxUInt b = right.GetUnsigned();
+
+			// Unsigned arithmetic wraps around in the width of the type
+			MaxUInt result;
+			switch (op)
+			{
+			case CBinaryOperator::kAdd:
+				result = a + b;
+				break;
+			case CBinaryOperator::kSub:
+				result = a - b;
+				break;
+			case CBinaryOperator::kMul:
+				result = a * b;
+				break;
+			case CBinaryOperator::kDiv:
+				CHECK_RV_ASSIGN(result, a.Divide(b));
+				break;
+			case CBinaryOperator::kMod:
+				CHECK_RV_ASSIGN(result, a.Modulo(b));
+				break;
+			case CBinaryOperator::kBitAnd:
+				result = a & b;
+				break;
+			case CBinaryOperator::kBitOr:
+				result = a | b;
+				break;
+			case CBinaryOperator::kBitXor:
+				result = a ^ b;
+				break;
+			default:
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			}
+
+			CompilerConstant(LType::kUInt64, result).ConvertTo(lType, outValue);
+
+			return true;
+		}
+
+		ResultRV<bool> CCompiler::ResolveConstantOutOfRange(bool isEvaluated, LType lType, const FileCoordinate &blameCoord, CompilerConstant &outValue)
+		{
+			if (isEvaluated)
+			{
+				ReportCompileError(CompilationErrorCode::kConstantOutOfRange, blameCoord);
+				return ErrorCode::kOperationFailed;
+			}
+
+			CompilerConstant().ConvertTo(lType, outValue);
+			return true;
+		}
+
+		bool CCompiler::ResolveUndefinedConstantOperation(bool isEvaluated, LType lType, CompilerConstant &outValue)
+		{
+			if (isEvaluated)
+				return false;
+
+			CompilerConstant().ConvertTo(lType, outValue);
+			return true;
+		}
+
+		LType CCompiler::PromoteLType(LType lType) const
+		{
+			// Every value of a type smaller than int fits in int
+			if (!IsFloatLType(lType) && GetLTypeSize(lType) < GetLTypeSize(m_config.m_intLType))
+				return SignedLType(m_config.m_intLType);
+
+			return lType;
+		}
+
+		LType CCompiler::ResolveCommonArithmeticLType(LType leftLType, LType rightLType) const
+		{
+			const bool isLeftFloat = IsFloatLType(leftLType);
+			const bool isRightFloat = IsFloatLType(rightLType);
+
+			if (isLeftFloat || isRightFloat)
+			{
+				if (isLeftFloat && isRightFloat)
+					return (GetLTypeSize(leftLType) >= GetLTypeSize(rightLType)) ? leftLType : rightLType;
+				return isLeftFloat ? leftLType : rightLType;
+			}
+
+			leftLType = PromoteLType(leftLType);
+			rightLType = PromoteLType(rightLType);
+
+			const size_t leftSize = GetLTypeSize(leftLType);
+			const size_t rightSize = GetLTypeSize(rightLType);
+
+			if (IsSignedIntegerLType(leftLType) == IsSignedIntegerLType(rightLType))
+				return (leftSize >= rightSize) ? leftLType : rightLType;
+
+			// The signed type is only used if it can represent every value of the unsigned type
+			const LType signedLType = IsSignedIntegerLType(leftLType) ? leftLType : rightLType;
+			const LType unsignedLType = IsSignedIntegerLType(leftLType) ? rightLType : leftLType;
+
+			if (GetLTypeSize(signedLType) > GetLTypeSize(unsignedLType))
+				return signedLType;
+
+			return unsignedLType;
+		}
+
+		CompilerConstant CCompiler::MakeTruthConstant(bool value) const
+		{
+			// Relational, equality and logical operators give an int (6.5.8 to 6.5.14)
+			return CompilerConstant(SignedLType(m_config.m_intLType), MaxSInt(value ? 1 : 0));
+		}
+
+		bool CCompiler::TryTakeSignedResult(ResultRV<MaxSInt> &&result, MaxSInt &outValue)
+		{
+			const ErrorCode errorCode = result.GetErrorCode();
+			result.Handle();
+
+			if (errorCode != ErrorCode::kOK)
+				return false;
+
+			outValue = result.TakeValue();
+			return true;
+		}
+
+		bool CCompiler::FitsSignedLType(const MaxSInt &value, LType lType, CompilerConstant &outValue)
+		{
+			CompilerConstant(LType::kSInt64, value).ConvertTo(lType, outValue);
+			return outValue.GetSigned() == value;
+		}
+
+		ResultRV<bool> CCompiler::EvaluateConstantIndex(const CExpression &expr, const FileCoordinate &blameCoord, MaxUInt &outIndex)
+		{
+			CompilerConstant value;
+			CHECK_RV(bool, isConstant, EvaluateConstantExpression(expr, blameCoord, value));
+			if (!isConstant)
+				return false;
+
+			switch (value.GetLType())
+			{
+			case LType::kSInt8:
+			case LType::kSInt16:
+			case LType::kSInt32:
+			case LType::kSInt64:
+				if (value.GetSigned() < MaxSInt(0))
+					return false;
+				outIndex = value.GetSigned().BitCastToUnsigned();
+				return true;
+			case LType::kUInt8:
+			case LType::kUInt16:
+			case LType::kUInt32:
+			case LType::kUInt64:
+				outIndex = value.GetUnsigned();
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		Result CCompiler::CommitDeclarator(CDeclarationSpecifiers *declSpecifiers, CDeclarator *declarator)
+		{
+			// New names can change how the same tokens parse, e.g. as typedef names
+			ResetParseMemo();
+
+			Optional<HStorageClass> storageClass;
+			TokenStrView name;
+			HTypeQualified declType;
+			CHECK(ResolveDeclarator(declSpecifiers, declarator, storageClass, name, declType));
+
+			if (storageClass.IsSet() && storageClass.Get() == HStorageClass::kTypeDef)
+			{
+				const CIdentifierBinding *identifier = m_currentScope->GetSymbolLocal(name.GetAtom());
+				if (identifier == nullptr)
+				{
+					ReportCompileError(CompilationErrorCode::kSymbolRedefinition, declarator->GetCoordinate());
+					return ErrorCode::kOperationFailed;
+				}
+
+				CHECK(m_currentScope->DefineIdentifier(name.GetAtom(), CIdentifierBinding(declType)));
+
+				return ErrorCode::kOK;
+			}
+
+			const bool isFileScope = (m_currentScope == m_globalScope);
+
+			// Commits a declarator to the current scope and creates an identifier and possibly a reserved definition, as defined in 6.2 and 6.9.2
+			// Linkages:
+			//
+			// "static" file scope declaration -> internal linkage
+			// "extern" declaration:
+			//     If prior declaration has internal or external linkage, inherit prior declaration.
+			//     If no prior declaration, or prior declaration has no linkage, new declaration has external linkage.
+			// Functions with no storage class specifier are "extern"
+			// Objects with file scope are "extern"
+			//
+			// Objects with file scope, no initializer, and no storage class or "static" storage class are tentative definitions.
+			//
+			// The end result of this is that we need to resolve this as either a global object or a local object.
+			// Global object references have one of two types: Speculative and real.
+			//
+			// Speculative objects are required for the following situation:
+			// int func(void)
+			// {
+			//     extern int symbol;
+			//     return symbol;
+			// }
+			// float symbol;
+			// 
+			// In this case, the two are the same object despite having different types
+			const bool isFunctionDefinition = (declType.GetUnqualified().GetSubtype() == HTypeUnqualified::Subtype::kFunction);
+
+			if (isFileScope)
+			{
+				if (storageClass.IsSet())
+				{
+					if (storageClass.Get() == HStorageClass::kAuto || storageClass.Get() == HStorageClass::kRegister)
+					{
+						ReportCompileError(CompilationErrorCode::kAutoOrRegisterNotAllowedOnExternalDeclaration, declarator->GetCoordinate());
+						return ErrorCode::kOperationFailed;
+					}
+				}
+			}
+
+			// Scope determination rules:
+			// struct, union, and enum tags: Current scope
+			// 
+
+			EXP_ASSERT(false);
+			return ErrorCode::kNotImplemented;
+		}
+
+		Result CCompiler::OpenConstantTable(const Optional<HStorageClass> &storageClass, const TokenStrView &name, const HTypeQualified &elementType, const Optional<MaxUInt> &numDeclaredElements, const CDeclarator *declarator, ConstantInitializerEmitter &emitter)
+		{
+			// Array types can't be represented yet, so arrays are recorded with their element type
+			CGlobalObjectInfo objectInfo;
+			objectInfo.m_linkage = (storageClass.IsSet() && storageClass.Get() == HStorageClass::kStatic) ? CLinkage::kInternal : CLinkage::kExternal;
+			objectInfo.m_type = elementType;
+			objectInfo.m_linkName = TokenStrView(m_identifiers.GetSpelling(name.GetAtom()), name.GetKind(), name.GetAtom());
+			objectInfo.m_isDefined = true;
+
+			HAsmOpenDataSectionInstruction openInstr;
+			openInstr.m_objectID = m_globalObjects.Size();
+			if (elementType.GetQualifiers().m_isConst)
+				openInstr.m_flags |= HAsmOpenDataSectionInstruction::kFlagReadOnly;
+
+			if (numDeclaredElements.IsSet() && !emitter.CanHoldElements(numDeclaredElements.Get()))
+			{
+				ReportCompileError(CompilationErrorCode::kInvalidArraySize, declarator->GetCoordinate());
+				return ErrorCode::kOperationFailed;
+			}
+
+			// The name is in scope from the end of its declarator (6.2.1), so before its initializer
+			CHECK(CommitConstantTableDeclarator(name, objectInfo, declarator->GetCoordinate()));
+			CHECK(m_asmWriter->OpenDataSection(openInstr));
+
+			return ErrorCode::kOK;
+		}
+
+		Result CCompiler::CommitConstantTableDeclarator(const TokenStrView &name, const CGlobalObjectInfo &objectInfo, const FileCoordinate &blameCoord)
+		{
+			// New names can change how the same tokens parse, e.g. as typedef names
+			ResetParseMemo();
+
+			// Nothing else declares file scope objects yet, so there's no earlier declaration that this could be
+			// compatible with
+			if (m_globalScope->GetSymbolLocal(name.GetAtom()) != nullptr)
+			{
+				ReportCompileError(CompilationErrorCode::kSymbolRedefinition, blameCoord);
+				return ErrorCode::kOperationFailed;
+			}
+
+			CHECK(m_globalScope->DefineIdentifier(name.GetAtom(), CIdentifierBinding(CRealGlobalObjectBinding(m_globalObjects.Size()))));
+			CHECK(m_globalObjects.Add(objectInfo));
+
+			return ErrorCode::kOK;
+		}
+
+
+		template<class T>
+		ResultRV<bool> CCompiler::MemoizedParse(ParseRule rule, ResultRV<bool> (CCompiler::*parseFunc)(FileCoordinate &, CorePtr<T> &, bool), FileCoordinate &inOutCoordinate, CorePtr<T> &outProduct, bool speculative)
+		{
+			ParseNestingScope nestingScope(this);
+			CHECK(nestingScope.Check(inOutCoordinate));
+
+			ParseRuleStats &stats = m_parseRuleStats[static_cast<size_t>(rule)];
+			stats.m_numCalls++;
+
+			CHECK_RV(ParseMemoEntry*, entry, FindParseMemoEntry(rule, inOutCoordinate, true));
+			if (entry == nullptr)
+				return (this->*parseFunc)(inOutCoordinate, outProduct, speculative);
+
+			if (entry->m_state != ParseMemoState::kUntried)
+			{
+				stats.m_numReentries++;
+
+				if (m_config.m_memoizeSpeculativeParses)
+				{
+					// A non-speculative failure has to run again to report its error
+					if (entry->m_state == ParseMemoState::kFailed && speculative)
+					{
+						stats.m_numMemoHits++;
+						return false;
+					}
+
+					if (entry->m_state == ParseMemoState::kSucceeded && entry->m_parkedProduct != nullptr)
+					{
+						stats.m_numMemoHits++;
+
+						CorePtr<T> product(std::move(entry->m_parkedProduct));
+						outProduct = std::move(product);
+						inOutCoordinate = entry->m_endCoord;
+						return true;
+					}
+				}
+			}
+
+			FileCoordinate coord = inOutCoordinate;
+			CorePtr<T> product;
+			CHECK_RV(bool, succeeded, (this->*parseFunc)(coord, product, speculative));
+
+			// The rule may have grown the memo, so the entry has to be found again
+			CHECK_RV_ASSIGN(entry, FindParseMemoEntry(rule, inOutCoordinate, false));
+			if (entry != nullptr)
+			{
+				entry->m_state = (succeeded ? ParseMemoState::kSucceeded : ParseMemoState::kFailed);
+				entry->m_endCoord = coord;
+				entry->m_parkedProduct = nullptr;
+			}
+
+			if (!succeeded)
+				return false;
+
+			outProduct = std::move(product);
+			inOutCoordinate = coord;
+			return true;
+		}
+
+		template<class T>
+		void CCompiler::ParkParseResult(ParseRule rule, const FileCoordinate &startCoord, CorePtr<T> &&product)
+		{
+			ResultRV<ParseMemoEntry*> entryResult(FindParseMemoEntry(rule, startCoord, false));
+			ParseMemoEntry *entry = nullptr;
+			if (entryResult.GetErrorCode() == ErrorCode::kOK)
+				entry = entryResult.TakeValue();
+			entryResult.Handle();
+
+			// If the memo was reset since the product was parsed, it's simply dropped
+			if (entry != nullptr && entry->m_state == ParseMemoState::kSucceeded)
+				entry->m_parkedProduct = std::move(product);
+		}
+
+		ResultRV<CCompiler::ParseMemoEntry*> CCompiler::FindParseMemoEntry(ParseRule rule, const FileCoordinate &coord, bool mayGrow)
+		{
+			const size_t numRules = static_cast<size_t>(ParseRule::kCount);
+
+			size_t tokenIndex = 0;
+			if (!FindBufferedToken(coord, tokenIndex) || tokenIndex < m_parseMemoBaseTokenIndex)
+				return static_cast<ParseMemoEntry*>(nullptr);
+
+			const size_t relativeTokenIndex = tokenIndex - m_parseMemoBaseTokenIndex;
+			if (relativeTokenIndex >= m_parseMemoNumTokens)
+			{
+				if (!mayGrow)
+					return static_cast<ParseMemoEntry*>(nullptr);
+
+				if (relativeTokenIndex >= std::numeric_limits<size_t>::max() / numRules)
+					return ErrorCode::kOutOfMemory;
+
+				// Resize allocates exactly what it's asked for, so grow geometrically
+				const size_t requiredSize = (relativeTokenIndex + 1u) * numRules;
+				if (m_parseMemo.Size() < requiredSize)
+				{
+					CHECK(m_parseMemo.Resize(std::max(requiredSize, m_parseMemo.Size() * 2u)));
+				}
+
+				m_parseMemoNumTokens = relativeTokenIndex + 1u;
+			}
+
+			return &m_parseMemo[relativeTokenIndex * numRules + static_cast<size_t>(rule)];
+		}
+
+		void CCompiler::ResetParseMemo()
+		{
+			const size_t numEntries = m_parseMemoNumTokens * static_cast<size_t>(ParseRule::kCount);
+			for (size_t i = 0; i < numEntries; i++)
+			{
+				ParseMemoEntry &entry = m_parseMemo[i];
+				entry.m_state = ParseMemoState::kUntried;
+				entry.m_parkedProduct = nullptr;
+			}
+
+			m_parseMemoNumTokens = 0;
+			m_parseMemoBaseTokenIndex = m_tokenCursor;
+		}
+
+		bool CCompiler::GetToken(TokenStrView &token, FileCoordinate &coord, CLexer::TokenType &tokenType)
+		{
+			size_t tokenIndex = 0;
+			if (!FindBufferedToken(coord, tokenIndex))
+			{
+				// Not somewhere a buffered token was lexed from, so it can't be buffered either
+				BufferedToken unbufferedToken;
+				if (!LexToken(coord, unbufferedToken))
+					return false;
+
+				token = unbufferedToken.m_token;
+				coord = unbufferedToken.m_endCoord;
+				tokenType = unbufferedToken.m_tokenType;
+				return true;
+			}
+
+			if (tokenIndex == m_tokens.Size())
+			{
+				BufferedToken newToken;
+				if (!LexToken(coord, newToken))
+					return false;
+
+				// The next token will be lexed from where this one ends
+				newToken.m_endCoord.m_tokenIndexHint = m_numDiscardedTokens + tokenIndex + 1u;
+
+				Result addResult(m_tokens.Add(newToken));
+				m_sourceErrorCode = addResult.GetErrorCode();
+				addResult.Handle();
+
+				if (m_sourceErrorCode != ErrorCode::kOK)
+					return false;
+			}
+
+			const BufferedToken &bufferedToken = m_tokens[tokenIndex];
+			m_tokenCursor = tokenIndex;
+
+			token = bufferedToken.m_token;
+			coord = bufferedToken.m_endCoord;
+			tokenType = bufferedToken.m_tokenType;
+			return true;
+		}
+
+		void CCompiler::DiscardParsedTokens(const FileCoordinate &coord)
+		{
+			ResetParseMemo();
+
+			m_numDiscardedTokens += m_tokens.Size();
+			m_tokens.Clear();
+			m_tokenCursor = 0;
+			m_tokensBaseOffset = coord.m_fileOffset;
+			m_parseMemoBaseTokenIndex = 0;
+
+			DropSourceChunksBefore(coord.m_fileOffset);
+		}
+
+		bool CCompiler::FindBufferedToken(const FileCoordinate &coord, size_t &outTokenIndex) const
+		{
+			const size_t fileOffset = coord.m_fileOffset;
+
+			// Coordinates handed out by GetToken say which token they're at, lex offsets only ever increase so a
+			// matching offset confirms it
+			if (coord.m_tokenIndexHint >= m_numDiscardedTokens)
+			{
+				const size_t hintedIndex = coord.m_tokenIndexHint - m_numDiscardedTokens;
+				if (hintedIndex <= m_tokens.Size() && GetBufferedTokenLexOffset(hintedIndex) == fileOffset)
+				{
+					outTokenIndex = hintedIndex;
+					return true;
+				}
+			}
+
+			// Otherwise most requests are for the token after the last one, or a peek at the same one again
+			for (size_t i = 0; i < 2; i++)
+			{
+				const size_t candidateIndex = m_tokenCursor + i;
+				if (candidateIndex <= m_tokens.Size() && GetBufferedTokenLexOffset(candidateIndex) == fileOffset)
+				{
+					outTokenIndex = candidateIndex;
+					return true;
+				}
+			}
+
+			// Coordinates that weren't handed out by GetToken, such as the start of the unit
+			size_t first = 0;
+			size_t count = m_tokens.Size() + 1;
+			while (count > 1)
+			{
+				const size_t half = count / 2u;
+				if (GetBufferedTokenLexOffset(first + half) <= fileOffset)
+				{
+					first += half;
+					count -= half;
+				}
+				else
+					count = half;
+			}
+
+			if (GetBufferedTokenLexOffset(first) != fileOffset)
+				return false;
+
+			outTokenIndex = first;
+			return true;
+		}
+
+		size_t CCompiler::GetBufferedTokenLexOffset(size_t tokenIndex) const
+		{
+			// Each token is lexed from where the previous one ended
+			if (tokenIndex == 0)
+				return m_tokensBaseOffset;
+
+			return m_tokens[tokenIndex - 1].m_endCoord.m_fileOffset;
+		}
+
+		bool CCompiler::LexToken(const FileCoordinate &coord, BufferedToken &outToken)
+		{
+			FileCoordinate chunkCoord = coord;
+			size_t chunkIndex = 0;
+			while (FindSourceChunk(chunkCoord.m_fileOffset, chunkIndex))
+			{
+				// Reporting an error receives more chunks, which can move the chunk but not its contents
+				const PreprocessorOutputChannel::Chunk &chunk = m_sourceChunks[chunkIndex];
+				const size_t chunkStartOffset = chunk.m_startOffset;
+				const size_t chunkSize = chunk.m_size;
+				const ArrayView<const uint8_t> chunkContents = chunk.m_contents.ConstView().Subrange(0, chunkSize);
+
+				FileCoordinate localCoord = chunkCoord;
+				localCoord.m_fileOffset -= chunkStartOffset;
+
+				FileCoordinate newCoord;
+				ArrayView<const uint8_t> newToken;
+				CLexer::TokenType newTokenType = CLexer::TokenType::kInvalid;
+
+				m_tracer.SetCoordinate(chunkCoord);
+				const bool hasToken = CLexer::TryGetToken(chunkContents, localCoord, false, false, m_tracer, m_errorReporter, true, true, newToken, newTokenType, newCoord);
+				if (hasToken)
+				{
+					newCoord.m_fileOffset += chunkStartOffset;
+
+					const TokenKind kind = CLexer::ClassifyToken(newToken, newTokenType);
+
+					IdentifierAtom atom;
+					if (newTokenType == CLexer::TokenType::kIdentifier && kind == TokenKind::kOther)
+					{
+						ResultRV<IdentifierAtom> internResult(m_identifiers.Intern(newToken));
+						m_sourceErrorCode = internResult.GetErrorCode();
+						internResult.Handle();
+
+						if (m_sourceErrorCode != ErrorCode::kOK)
+							return false;
+
+						atom = internResult.TakeValue();
+					}
+
+					outToken.m_token = TokenStrView(newToken, kind, atom);
+					outToken.m_endCoord = newCoord;
+					outToken.m_tokenType = newTokenType;
+					return true;
+				}
+
+				// Only whitespace is left in this chunk, and chunks end on line boundaries, so continue from the
+				// start of the next one
+				chunkCoord = FileCoordinate(chunkStartOffset + chunkSize);
+			}
+
+			return false;
+		}
+
+		bool CCompiler::FindSourceChunk(size_t fileOffset, size_t &outChunkIndex)
+		{
+			while (fileOffset >= m_sourceSize)
+			{
+				if (!TryReceiveSourceChunk())
+					return false;
+			}
+
+			// Parsing mostly moves forward, so the last chunk found is usually the right one
+			const PreprocessorOutputChannel::Chunk &lastChunk = m_sourceChunks[m_lastSourceChunkIndex];
+			if (fileOffset >= lastChunk.m_startOffset && fileOffset - lastChunk.m_startOffset < lastChunk.m_size)
+			{
+				outChunkIndex = m_lastSourceChunkIndex;
+				return true;
+			}
+
+			// Dropped chunks are never lexed again
+			size_t first = m_numDroppedSourceChunks;
+			size_t count = m_sourceChunks.Size() - first;
+			EXP_ASSERT(count > 0 && m_sourceChunks[first].m_startOffset <= fileOffset);
+			while (count > 1)
+			{
+				const size_t half = count / 2u;
+				if (m_sourceChunks[first + half].m_startOffset <= fileOffset)
+				{
+					first += half;
+					count -= half;
+				}
+				else
+					count = half;
+			}
+
+			m_lastSourceChunkIndex = first;
+			outChunkIndex = first;
+			return true;
+		}
+
+		bool CCompiler::TryReceiveSourceChunk()
+		{
+			if (m_sourceChannel == nullptr || m_sourceErrorCode != ErrorCode::kOK)
+				return false;
+
+			PreprocessorOutputChannel::Chunk chunk;
+			if (!m_sourceChannel->TryTakeChunk(chunk))
+			{
+				m_sourceErrorCode = m_sourceChannel->GetProducerErrorCode();
+				m_traceInfo = m_sourceChannel->GetTraceInfo();
+				m_sourceChannel = nullptr;
+				return false;
+			}
+
+			EXP_ASSERT(chunk.m_startOffset == m_sourceSize && chunk.m_size > 0);
+
+			const size_t chunkSize = chunk.m_size;
+
+			Result addResult(m_sourceChunks.Add(std::move(chunk)));
+			m_sourceErrorCode = addResult.GetErrorCode();
+			addResult.Handle();
+
+			if (m_sourceErrorCode != ErrorCode::kOK)
+				return false;
+
+			m_sourceSize += chunkSize;
+
+			return true;
+		}
+
+		void CCompiler::DropSourceChunksBefore(size_t fileOffset)
+		{
+			while (m_numDroppedSourceChunks < m_sourceChunks.Size())
+			{
+				PreprocessorOutputChannel::Chunk &chunk = m_sourceChunks[m_numDroppedSourceChunks];
+				if (chunk.m_startOffset + chunk.m_size > fileOffset)
+					break;
+
+				// Errors are never reported in source that has been parsed for good, so its lines only need counting
+				if (m_numLineIndexedSourceChunks == m_numDroppedSourceChunks)
+				{
+					m_sourceLineStarts.SkipSpan(chunk.m_contents.ConstView().Subrange(0, chunk.m_size));
+					m_numLineIndexedSourceChunks++;
+				}
+
+				chunk.m_contents = nullptr;
+				m_numDroppedSourceChunks++;
+			}
+		}
+
+		ResultRV<FileLocation> CCompiler::ResolveSourceLocation(const FileCoordinate &coord)
+		{
+			while (m_numLineIndexedSourceChunks < m_sourceChunks.Size())
+			{
+				const PreprocessorOutputChannel::Chunk &chunk = m_sourceChunks[m_numLineIndexedSourceChunks];
+				CHECK(m_sourceLineStarts.AddSpan(chunk.m_contents.ConstView().Subrange(0, chunk.m_size)));
+
+				m_numLineIndexedSourceChunks++;
+			}
+
+			return m_sourceLineStarts.Resolve(coord);
+		}
+
+		const CPreprocessorTraceInfo *CCompiler::WaitForTraceInfo()
+		{
+			while (TryReceiveSourceChunk())
+			{
+			}
+
+			return m_traceInfo;
+		}
+
+		void CCompiler::ReportCompileError(CompilationErrorCode errorCode, const FileCoordinate &coord)
+		{
+			m_tracer.SetCoordinate(coord);
+			m_errorReporter->ReportError(coord, m_tracer, errorCode);
+		}
 
 		void CCompiler::ReportCompileWarning(CompilationWarningCode warningCode, const FileCoordinate &coord)
 		{
@@ -3094,21 +4733,13 @@ namespace expanse
 
 		Result CCompiler::InitGlobalScope()
 		{
-			return ErrorCode::kOK;
-		}
+			IAllocator *alloc = CCompiler::GetCoreObjectAllocator();
 
-		bool CCompiler::IsKeyword(TokenStrView &token)
-		{
-			return token.IsString("auto") || token.IsString("enum") || token.IsString("restrict") || token.IsString("unsigned") ||
-				token.IsString("break") || token.IsString("extern") || token.IsString("return") || token.IsString("void") ||
-				token.IsString("case") || token.IsString("float") || token.IsString("short") || token.IsString("volatile") ||
-				token.IsString("char") || token.IsString("for") || token.IsString("signed") || token.IsString("while") ||
-				token.IsString("const") || token.IsString("goto") || token.IsString("sizeof") || token.IsString("_Bool") ||
-				token.IsString("continue") || token.IsString("if") || token.IsString("static") || token.IsString("_Complex") ||
-				token.IsString("default") || token.IsString("inline") || token.IsString("struct") || token.IsString("_Imaginary") ||
-				token.IsString("do") || token.IsString("int") || token.IsString("switch") ||
-				token.IsString("double") || token.IsString("long") || token.IsString("else") ||
-				token.IsString("register") || token.IsString("union") || token.IsString("typedef");
+			CHECK_RV(CorePtr<CScope>, globalScope, New<CScope>(alloc, alloc, nullptr));
+			m_globalScope = std::move(globalScope);
+			m_currentScope = m_globalScope;
+
+			return ErrorCode::kOK;
 		}
 
 		CCompiler::TemporaryScope::TemporaryScope(CCompiler *compiler)
@@ -3119,7 +4750,10 @@ namespace expanse
 		CCompiler::TemporaryScope::~TemporaryScope()
 		{
 			if (m_scope != nullptr)
+			{
 				m_compiler->m_currentScope = m_scope->GetParentScope();
+				m_compiler->ResetParseMemo();
+			}
 		}
 
 		Result CCompiler::TemporaryScope::CreateScope()
@@ -3128,6 +4762,7 @@ namespace expanse
 
 			CHECK_RV(CorePtr<CScope>, scope, New<CScope>(alloc, alloc, m_compiler->m_currentScope));
 			m_compiler->m_currentScope = scope;
+			m_compiler->ResetParseMemo();
 
 			m_scope = std::move(scope);
 
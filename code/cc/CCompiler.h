@@ -1,5 +1,6 @@
 #pragma once
 
+#include "ArenaAllocator.h"
 #include "ArrayPtr.h"
 #include "CAggregateType.h"
 #include "CCompilerIncludeStackTracer.h"
@@ -7,10 +8,17 @@
 #include "CompilerConfiguration.h"
 #include "CGrammar.h"
 #include "CLexer.h"
+#include "FileCoordinate.h"
+#include "LineStartIndex.h"
 #include "CGlobalObjectInfo.h"
 #include "HStorageClass.h"
 #include "HashMap.h"
+#include "IdentifierTable.h"
 #include "Optional.h"
+#include "ParseRule.h"
+#include "PPTokenStr.h"
+#include "PreprocessorOutputChannel.h"
+#include "Vector.h"
 
 #include <cstdint>
 
@@ -25,13 +33,17 @@ namespace expanse
 	{
 		class CDeclarationSpecifiers;
 		class CDeclarator;
+		class ConstantInitializerEmitter;
 		class CEnumSpecifier;
 		class CPreprocessorTraceInfo;
 		class CScope;
 		class CStructOrUnionSpecifier;
 		class CToken;
 
+		struct CompilerConstant;
 		struct FileCoordinate;
+		struct MaxSInt;
+		struct MaxUInt;
 		struct TokenStrView;
 		struct IHAsmWriter;
 
@@ -40,9 +52,73 @@ namespace expanse
 		public:
 			CCompiler(IAllocator *alloc, IErrorReporter *errorReporter, ArrayPtr<uint8_t> &&contents, CPreprocessorTraceInfo *traceInfo, IHAsmWriter *asmWriter);
 
+			// Compiles from a preprocessor running concurrently on another thread.  Source chunks are kept once
+			// received since tokens refer into them, the trace info is picked up from the channel once it closes.
+			CCompiler(IAllocator *alloc, IErrorReporter *errorReporter, PreprocessorOutputChannel *sourceChannel, IHAsmWriter *asmWriter);
+
 			Result Compile();
 
+			const ParseRuleStats &GetParseRuleStats(ParseRule rule) const;
+
+			// Line and column in the preprocessed source.  Source chunks are only indexed once something asks.
+			ResultRV<FileLocation> ResolveSourceLocation(const FileCoordinate &coord);
+
+			// For mapping errors back to the original source.  The trace info is only handed over once the
+			// preprocessor is done, so this receives the rest of the source first.  Null if it never arrives.
+			const CPreprocessorTraceInfo *WaitForTraceInfo();
+
 		private:
+			static const size_t kParseArenaBlockSize = 64 * 1024;
+
+			// Every recursive rule counts as a level, so one level of parentheses in an expression is a few.  Source
+			// nested deeper than this fails to compile instead of overflowing the stack.
+			static const unsigned int kMaxParseNestingDepth = 1024;
+
+			// Tokens are lexed once, in order, as parsing first reaches them.  A parse position is found in the buffer by
+			// the offset its token was lexed from, which is where the previous token ended, so backtracking and
+			// peeking never lex the same bytes twice.
+			struct BufferedToken
+			{
+				TokenStrView m_token;
+				FileCoordinate m_endCoord;
+				CLexer::TokenType m_tokenType;
+			};
+
+			enum class ParseMemoState
+			{
+				kUntried,
+				kFailed,
+				kSucceeded,
+			};
+
+			// Memoized outcome of a rule at a token position.  Speculative failures are always reused.  Successes
+			// are reused when the caller that discarded the result parked it back, otherwise the rule runs again.
+			struct ParseMemoEntry
+			{
+				ParseMemoEntry();
+
+				ParseMemoState m_state;
+				FileCoordinate m_endCoord;
+				CorePtr<CGrammarElement> m_parkedProduct;
+			};
+
+			// Counts a level of parse nesting for as long as it's in scope
+			class ParseNestingScope
+			{
+			public:
+				explicit ParseNestingScope(CCompiler *compiler);
+				~ParseNestingScope();
+
+				// Reports an error if the level is too deep
+				Result Check(const FileCoordinate &coord) const;
+
+			private:
+				ParseNestingScope(const ParseNestingScope &other) = delete;
+				ParseNestingScope &operator=(const ParseNestingScope &other) = delete;
+
+				CCompiler *m_compiler;
+			};
+
 			struct TemporaryScope
 			{
 				TemporaryScope(CCompiler *compiler);
@@ -55,7 +131,7 @@ namespace expanse
 				CCompiler *m_compiler;
 			};
 
-			typedef CBinaryOperator (*BinOperatorResolver_t)(const TokenStrView &token);
+			typedef CBinaryOperator (*BinOperatorResolver_t)(TokenKind kind);
 			typedef ResultRV<bool> (CCompiler::*ExpressionParseFunc_t)(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
 
 			ResultRV<bool> ParseTranslationUnit(FileCoordinate &coord);
@@ -63,7 +139,9 @@ namespace expanse
 			ResultRV<bool> ParseDeclSpecifiers(FileCoordinate &inOutCoordinate, CorePtr<CDeclarationSpecifiers> &outProduct, bool speculative);
 			ResultRV<bool> ParseSingleDeclSpecifier(FileCoordinate &inOutCoordinate, CorePtr<CGrammarElement> &outProduct, bool speculative);
 			ResultRV<bool> ParseDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CDeclarator> &outProduct, bool speculative);
+			ResultRV<bool> ParseDeclaratorUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CDeclarator> &outProduct, bool speculative);
 			ResultRV<bool> ParseAbstractDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CAbstractDeclarator> &outProduct, bool speculative);
+			ResultRV<bool> ParseAbstractDeclaratorUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CAbstractDeclarator> &outProduct, bool speculative);
 			ResultRV<bool> ParseDirectDeclaratorContinuation(FileCoordinate &inOutCoordinate, CorePtr<CDirectDeclaratorContinuation> &outProduct, bool speculative);
 			ResultRV<bool> ParseDirectDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CDirectDeclarator> &outProduct, bool speculative);
 			ResultRV<bool> ParseDirectAbstractDeclarator(FileCoordinate &inOutCoordinate, CorePtr<CDirectAbstractDeclarator> &outProduct, bool speculative);
@@ -92,6 +170,7 @@ namespace expanse
 			ResultRV<bool> ParseParameterDeclaration(FileCoordinate &inOutCoordinate, CorePtr<CParameterDeclaration> &outProduct, bool speculative);
 			ResultRV<bool> ParseIdentifierList(FileCoordinate &inOutCoordinate, CorePtr<CIdentifierList> &outProduct, bool speculative);
 			ResultRV<bool> ParseTypeName(FileCoordinate &inOutCoordinate, CorePtr<CTypeName> &outProduct, bool speculative);
+			ResultRV<bool> ParseTypeNameUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CTypeName> &outProduct, bool speculative);
 
 			ResultRV<bool> ParseConstantExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
 			ResultRV<bool> ParseConditionalExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
@@ -107,8 +186,10 @@ namespace expanse
 			ResultRV<bool> ParseAdditiveExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
 			ResultRV<bool> ParseMultiplicativeExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
 			ResultRV<bool> ParseCastExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
+			ResultRV<bool> ParseCastExpressionUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
 			ResultRV<bool> ParseExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
 			ResultRV<bool> ParseUnaryExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
+			ResultRV<bool> ParseUnaryExpressionUnmemoized(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
 			ResultRV<bool> ParsePostfixExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
 			ResultRV<bool> ParsePostfixExpressionLeftSide(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
 			ResultRV<bool> ParsePrimaryExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative);
@@ -124,22 +205,75 @@ namespace expanse
 
 			ResultRV<bool> DynamicParseLTRBinaryExpression(FileCoordinate &inOutCoordinate, CorePtr<CExpression> &outProduct, bool speculative, BinOperatorResolver_t opResolverFunc, ExpressionParseFunc_t nextPriorityFunc);
 
-			static CBinaryOperator ResolveLogicalOrOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveLogicalAndOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveInclusiveOrOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveExclusiveOrOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveAndOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveEqualityOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveRelationalOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveShiftOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveAdditiveOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveMultiplicativeOperator(const TokenStrView &token);
-			static CBinaryOperator ResolveCommaOperator(const TokenStrView &token);
+			static CBinaryOperator ResolveLogicalOrOperator(TokenKind kind);
+			static CBinaryOperator ResolveLogicalAndOperator(TokenKind kind);
+			static CBinaryOperator ResolveInclusiveOrOperator(TokenKind kind);
+			static CBinaryOperator ResolveExclusiveOrOperator(TokenKind kind);
+			static CBinaryOperator ResolveAndOperator(TokenKind kind);
+			static CBinaryOperator ResolveEqualityOperator(TokenKind kind);
+			static CBinaryOperator ResolveRelationalOperator(TokenKind kind);
+			static CBinaryOperator ResolveShiftOperator(TokenKind kind);
+			static CBinaryOperator ResolveAdditiveOperator(TokenKind kind);
+			static CBinaryOperator ResolveMultiplicativeOperator(TokenKind kind);
+			static CBinaryOperator ResolveCommaOperator(TokenKind kind);
 
 			Result ParseAndCompileInitializerForDeclarator(CDeclarationSpecifiers *declSpecifiers, CDeclarator *declarator, FileCoordinate &inOutCoordinate);
+			Result CompileTentativeDefinition(CDeclarationSpecifiers *declSpecifiers, CDeclarator *declarator);
 			Result ParseAndCompileInitDeclaratorListEndingInSemi(CDeclarationSpecifiers *declSpecifiers, FileCoordinate &inOutCoordinate);
 			Result CompileFunctionDefinitionAfterDeclarator(CDeclarationSpecifiers *declSpecifiers, CDeclarator *declarator, FileCoordinate &inOutCoordinate);
 
+			// Initializers of file scope scalars and arrays of scalars are compiled straight into a data section an
+			// element at a time, and whatever was parsed for an element is released once it has been emitted, so
+			// tables of any size only need as much memory as their largest element.
+			ResultRV<bool> ParseAndEmitConstantInitializer(ConstantInitializerEmitter &emitter, bool isArray, const Optional<MaxUInt> &numDeclaredElements, FileCoordinate &inOutCoordinate);
+			ResultRV<bool> ParseAndEmitConstantInitializerElement(ConstantInitializerEmitter &emitter, bool isArray, const Optional<MaxUInt> &numDeclaredElements, FileCoordinate &inOutCoordinate);
+
+			// Returns false if the declarator isn't a scalar or a one-dimensional array of scalars with a size that
+			// can be evaluated
+			ResultRV<bool> ResolveConstantTableDeclarator(const CDeclarationSpecifiers *declSpecifiers, const CDeclarator *declarator, Optional<HStorageClass> &outStorageClass, TokenStrView &outName, HTypeQualified &outElementType, LType &outElementLType, bool &outIsArray, Optional<MaxUInt> &outNumDeclaredElements);
+			bool ResolveScalarLType(const HTypeUnqualified &t, LType &outLType) const;
+
+			// Commits the declarator of a constant table and opens its data section
+			Result OpenConstantTable(const Optional<HStorageClass> &storageClass, const TokenStrView &name, const HTypeQualified &elementType, const Optional<MaxUInt> &numDeclaredElements, const CDeclarator *declarator, ConstantInitializerEmitter &emitter);
+
+			// Returns false if the expression isn't an arithmetic constant expression, or is a form that can't be
+			// evaluated yet, which are enumeration constants and sizeof.
+			ResultRV<bool> EvaluateConstantExpression(const CExpression &expr, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+
+			// Operands that aren't evaluated, like the side of ?: that isn't selected, still have to be constant
+			// expressions, but only their type matters, so operations in them that would be out of range or
+			// undefined give a zero instead.
+			ResultRV<bool> EvaluateConstantSubexpression(const CExpression &expr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+			ResultRV<bool> EvaluateConstantToken(const CTokenExpression &tokenExpr, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+			ResultRV<bool> EvaluateConstantUnary(const CUnaryExpression &unaryExpr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+			ResultRV<bool> EvaluateConstantBinary(const CBinaryExpression &binaryExpr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+			ResultRV<bool> EvaluateConstantShift(CBinaryOperator op, const CompilerConstant &left, const CompilerConstant &right, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+			ResultRV<bool> EvaluateConstantTernary(const CTernaryExpression &ternaryExpr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+			ResultRV<bool> EvaluateConstantCast(const CCastExpression &castExpr, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+
+			// Operands of the same type, after the usual arithmetic conversions
+			ResultRV<bool> ApplyConstantArithmetic(CBinaryOperator op, const CompilerConstant &left, const CompilerConstant &right, bool isEvaluated, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+
+			// Reports a constant that its type can't represent (6.6), which is only an error where it's evaluated
+			ResultRV<bool> ResolveConstantOutOfRange(bool isEvaluated, LType lType, const FileCoordinate &blameCoord, CompilerConstant &outValue);
+
+			// Undefined operations, like dividing by zero, don't make constant expressions where they're evaluated
+			static bool ResolveUndefinedConstantOperation(bool isEvaluated, LType lType, CompilerConstant &outValue);
+
+			// Integer promotions (6.3.1.1) and usual arithmetic conversions (6.3.1.8).  Sizes stand in for ranks,
+			// which gives the same types whenever two ranks are the same size.
+			LType PromoteLType(LType lType) const;
+			LType ResolveCommonArithmeticLType(LType leftLType, LType rightLType) const;
+
+			CompilerConstant MakeTruthConstant(bool value) const;
+
+			// Checked MaxSInt operations fail when they overflow
+			static bool TryTakeSignedResult(ResultRV<MaxSInt> &&result, MaxSInt &outValue);
+			static bool FitsSignedLType(const MaxSInt &value, LType lType, CompilerConstant &outValue);
+
+			// Returns false if the expression isn't a constant expression with a nonnegative integer value
+			ResultRV<bool> EvaluateConstantIndex(const CExpression &expr, const FileCoordinate &blameCoord, MaxUInt &outIndex);
+
 			ResultRV<HTypeQualified> ResolveTypeDefName(const CToken &tokenElement);
 
 			Result CompileAggregateDefinition(HAggregateDecl *aggDecl, const CStructDeclarationList *declList);
@@ -149,34 +283,86 @@ namespace expanse
 			ResultRV<HTypeUnqualified> ResolveStructOrUnionSpecifier(const CStructOrUnionSpecifier &souSpecifierElement);
 			ResultRV<HTypeUnqualified> ResolveEnumSpecifier(const CEnumSpecifier &souSpecifierElement);
 
-			Result ResolveDeclSpecifiers(const CDeclarationSpecifiers *declSpecifiers, HTypeQualifiers &outQualifiers, bool &outIsInline, Optional<HStorageClass> &outStorageClass, HTypeUnqualified &outUnqualifiedType);
+			// Also resolves the specifier-qualifier lists of type names, which are the same without storage classes
+			// and function specifiers
+			Result ResolveDeclSpecifiers(const CGrammarElementListContainer<CGrammarElement> *declSpecifiers, HTypeQualifiers &outQualifiers, bool &outIsInline, Optional<HStorageClass> &outStorageClass, HTypeUnqualified &outUnqualifiedType);
 			Result ResolveDeclarator(const CDeclarationSpecifiers *declSpecifiers, const CDeclarator *declarator, Optional<HStorageClass> &outStorageClass, TokenStrView &outName, HTypeQualified &outDeclType);
 			ResultRV<HTypeUnqualified> ResolvePointer(const CPointer &pointer, const HTypeQualified &innerType);
 			static HTypeQualifiers ResolveQualifiers(const CTypeQualifierList &qualList);
 			Result CommitDeclarator(CDeclarationSpecifiers *declSpecifiers, CDeclarator *declarator);
 
+			// Commits the declarator of a constant table, which CommitDeclarator can't resolve because it has no
+			// array types, as a new global object
+			Result CommitConstantTableDeclarator(const TokenStrView &name, const CGlobalObjectInfo &objectInfo, const FileCoordinate &blameCoord);
+
+			template<class T>
+			ResultRV<bool> MemoizedParse(ParseRule rule, ResultRV<bool> (CCompiler::*parseFunc)(FileCoordinate &, CorePtr<T> &, bool), FileCoordinate &inOutCoordinate, CorePtr<T> &outProduct, bool speculative);
+
+			template<class T>
+			void ParkParseResult(ParseRule rule, const FileCoordinate &startCoord, CorePtr<T> &&product);
+
+			ResultRV<ParseMemoEntry*> FindParseMemoEntry(ParseRule rule, const FileCoordinate &coord, bool mayGrow);
+			void ResetParseMemo();
+
 			bool GetToken(TokenStrView &token, FileCoordinate &coord, CLexer::TokenType &tokenType);
 
+			// Drops the buffered tokens before coord, which must never be parsed again, along with the source chunks
+			// that they were lexed from.  Token views from before coord are invalid afterwards, and errors can't be
+			// located there any more.  Resets the parse memo.
+			void DiscardParsedTokens(const FileCoordinate &coord);
+			bool FindBufferedToken(const FileCoordinate &coord, size_t &outTokenIndex) const;
+			size_t GetBufferedTokenLexOffset(size_t tokenIndex) const;
+			bool LexToken(const FileCoordinate &coord, BufferedToken &outToken);
+			bool FindSourceChunk(size_t fileOffset, size_t &outChunkIndex);
+			bool TryReceiveSourceChunk();
+			void DropSourceChunksBefore(size_t fileOffset);
+
 			void ReportCompileError(CompilationErrorCode errorCode, const FileCoordinate &coord);
 			void ReportCompileWarning(CompilationWarningCode warningCode, const FileCoordinate &coord);
 
 			ResultRV<HTypeUnqualifiedInterned*> InternType(const HTypeUnqualified &t);
 
-			static bool IsKeyword(TokenStrView &token);
-
 			Result InitGlobalScope();
 
 			ArrayPtr<uint8_t> m_contents;
 			CPreprocessorTraceInfo *m_traceInfo;
 
+			PreprocessorOutputChannel *m_sourceChannel;
+			Vector<PreprocessorOutputChannel::Chunk> m_sourceChunks;
+			size_t m_sourceSize;
+			size_t m_lastSourceChunkIndex;
+			ErrorCode m_sourceErrorCode;
+
+			// Chunks are released once everything in them has been parsed, and only their extents are kept
+			size_t m_numDroppedSourceChunks;
+
+			LineStartIndex m_sourceLineStarts;
+			size_t m_numLineIndexedSourceChunks;
+
+			// Tokens that are known to be parsed for good are discarded, the first remaining one was lexed from
+			// m_tokensBaseOffset.  Coordinate token index hints count discarded tokens too, m_numDiscardedTokens
+			// of them.
+			Vector<BufferedToken> m_tokens;
+			size_t m_tokenCursor;
+			size_t m_tokensBaseOffset;
+			size_t m_numDiscardedTokens;
+
+			// Identifiers are interned as they're lexed, scopes are keyed by atom
+			IdentifierTable m_identifiers;
+
+			// Grammar elements only live until their external declaration has been compiled, so they are allocated
+			// from an arena that is rewound after each one.  Declared ahead of the memo, which can hold parked elements.
+			ArenaAllocator m_parseArena;
+
+			Vector<ParseMemoEntry> m_parseMemo;
+			size_t m_parseMemoBaseTokenIndex;
+			size_t m_parseMemoNumTokens;
+			unsigned int m_parseNestingDepth;
+			ParseRuleStats m_parseRuleStats[static_cast<size_t>(ParseRule::kCount)];
+
 			CScope *m_currentScope;
 			CorePtr<CScope> m_globalScope;
 
-			Optional<FileCoordinate> m_lastParseCoord;
-			TokenStrView m_lastToken;
-			FileCoordinate m_lastEndCoord;
-			CLexer::TokenType m_lastTokenType;
-
 			HashMap<HTypeUnqualified, CorePtr<HTypeUnqualifiedInterned>> m_globalInternedTypes;
 			HashMap<HTypeUnqualified, CorePtr<HTypeUnqualifiedInterned>> m_tempInternedTypes;
 
@@ -186,7 +372,7 @@ namespace expanse
 			Vector<CorePtr<HEnumDecl>> m_globalInternedEnums;
 			Vector<CorePtr<HEnumDecl>> m_tempInternedEnums;
 			Vector<CGlobalObjectInfo> m_globalObjects;
-			HashMap<TokenStrView, size_t> m_externalLinkageLookup;
+			HashMap<IdentifierAtom, size_t> m_externalLinkageLookup;
 
 			CCompilerIncludeStackTracer m_tracer;
 			IErrorReporter *m_errorReporter;
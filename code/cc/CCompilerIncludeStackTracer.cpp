@@ -1,30 +1,103 @@
 #include "CCompilerIncludeStackTracer.h"
+#include "CCompiler.h"
+#include "CharCodes.h"
+#include "CPreprocessorTraceInfo.h"
 #include "PPTokenStr.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "StringView.h"
 
 namespace expanse
 {
 	namespace cc
 	{
-		CCompilerIncludeStackTracer::CCompilerIncludeStackTracer()
+		CCompilerIncludeStackTracer::CCompilerIncludeStackTracer(CCompiler *compiler)
+			: m_compiler(compiler)
+			, m_traceInfo(nullptr)
+			, m_traceIndex(0)
+			, m_resolveErrorCode(ErrorCode::kOK)
 		{
 		}
 
+		void CCompilerIncludeStackTracer::SetCoordinate(const FileCoordinate &coord)
+		{
+			m_coordinate = coord;
+		}
+
 		void CCompilerIncludeStackTracer::Reset()
 		{
+			m_traceInfo = nullptr;
+			m_traceIndex = 0;
+			m_location = FileLocation();
+
+			ResultRV<FileLocation> locationResult(m_compiler->ResolveSourceLocation(m_coordinate));
+			m_resolveErrorCode = locationResult.GetErrorCode();
+			locationResult.Handle();
+
+			if (m_resolveErrorCode != ErrorCode::kOK)
+				return;
+
+			m_location = locationResult.TakeValue();
+
+			const CPreprocessorTraceInfo *traceInfo = m_compiler->WaitForTraceInfo();
+			uint32_t traceIndex = 0;
+			uint32_t lineNumber = 0;
+			if (traceInfo == nullptr || !traceInfo->FindOutputLineTrace(m_location.m_lineNumber, traceIndex, lineNumber))
+				return;
+
+			m_traceInfo = traceInfo;
+			m_traceIndex = traceIndex;
+			m_location.m_lineNumber = lineNumber;
 		}
 
 		bool CCompilerIncludeStackTracer::Pop()
 		{
-			return false;
+			if (m_traceInfo == nullptr)
+				return false;
+
+			const CPreprocessorTrace &trace = m_traceInfo->GetTrace(m_traceIndex);
+			if (trace.m_prevTraceIndexPlusOne == 0)
+				return false;
+
+			m_traceIndex = trace.m_prevTraceIndexPlusOne - 1;
+			m_location = FileLocation(m_traceInfo->GetTrace(m_traceIndex).m_currentLineNumber, 0);
+
+			return true;
 		}
 
-		void CCompilerIncludeStackTracer::GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileCoordinate &outCoordinate) const
+		Result CCompilerIncludeStackTracer::GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileLocation &outLocation) const
 		{
+			outDevice = UTF8StringView_t();
+			outPath = UTF8StringView_t();
+			outLocation = m_location;
+
+			if (m_resolveErrorCode != ErrorCode::kOK)
+				return m_resolveErrorCode;
+
+			if (m_traceInfo == nullptr)
+				return ErrorCode::kOK;
+
+			// Traced file names are spelled device://path
+			const ArrayView<const uint8_t> fileName = GetCurrentTraceFile().GetToken();
+			for (size_t i = 0; i + 3 <= fileName.Size(); i++)
+			{
+				if (fileName[i] == CharCode::kColon && fileName[i + 1] == CharCode::kSlash && fileName[i + 2] == CharCode::kSlash)
+				{
+					outDevice = UTF8StringView_t(fileName.begin(), i);
+					outPath = UTF8StringView_t(fileName.begin() + i + 3, fileName.Size() - i - 3);
+					break;
+				}
+			}
+
+			return ErrorCode::kOK;
 		}
 
 		TokenStrView CCompilerIncludeStackTracer::GetCurrentTraceFile() const
 		{
-			return TokenStrView();
+			if (m_traceInfo == nullptr)
+				return TokenStrView();
+
+			return m_traceInfo->GetFileName(m_traceInfo->GetTrace(m_traceIndex).m_currentFileNameIndex);
 		}
 	}
 }
\ No newline at end of file
@@ -1,23 +1,41 @@
 #pragma once
 
+#include "ErrorCode.h"
 #include "IIncludeStackTrace.h"
 #include "FileCoordinate.h"
 
+#include <cstdint>
+
 namespace expanse
 {
 	namespace cc
 	{
+		class CCompiler;
+		class CPreprocessorTraceInfo;
+
+		// Errors from lexing the preprocessed source point at the token being lexed.  Reset maps the position back
+		// through the preprocessor's trace info to the file and line it came from, and Pop walks up the files that
+		// included it.  Columns are the ones in the preprocessed line.  Without trace info, positions are reported
+		// in the preprocessed source.
 		struct CCompilerIncludeStackTracer final : public IIncludeStackTrace
 		{
-			CCompilerIncludeStackTracer();
+			explicit CCompilerIncludeStackTracer(CCompiler *compiler);
+
+			void SetCoordinate(const FileCoordinate &coord);
 
 			void Reset() override;
 			bool Pop() override;
-			void GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileCoordinate &outCoordinate) const override;
+			Result GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileLocation &outLocation) const override;
 			TokenStrView GetCurrentTraceFile() const override;
 
 		private:
+			CCompiler *m_compiler;
 			FileCoordinate m_coordinate;
+
+			const CPreprocessorTraceInfo *m_traceInfo;
+			uint32_t m_traceIndex;
+			FileLocation m_location;
+			ErrorCode m_resolveErrorCode;
 		};
 	}
 }
\ No newline at end of file
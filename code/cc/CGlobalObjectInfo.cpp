@@ -0,0 +1,15 @@
+#include "CGlobalObjectInfo.h"
+
+namespace expanse
+{
+	namespace cc
+	{
+		CGlobalObjectInfo::CGlobalObjectInfo()
+			: m_linkage(CLinkage::kNone)
+			, m_isDefined(false)
+			, m_isDefinitionTentative(false)
+			, m_isSpeculative(false)
+		{
+		}
+	}
+}
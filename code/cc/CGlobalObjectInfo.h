@@ -16,7 +16,7 @@ namespace expanse
 
 			CLinkage m_linkage;
 			HTypeQualified m_type;
-			TokenStrView m_linkName;
+			TokenStrView m_linkName;		// Interned, the source it was lexed from is released
 
 			bool m_isDefined;				// Has a definition
 			bool m_isDefinitionTentative;	// Definition is tentative
@@ -499,6 +499,16 @@ namespace expanse
 		{
 		}
 
+		const CSpecifierQualifierList *CTypeName::GetSpecifierQualifierList() const
+		{
+			return m_specQualList;
+		}
+
+		const CAbstractDeclarator *CTypeName::GetOptAbstractDeclarator() const
+		{
+			return m_optAbsDecl;
+		}
+
 		CArgumentExpressionList::CArgumentExpressionList(ArrayPtr<CorePtr<CExpression>> &&exprList)
 			: CGrammarElementListContainer<CExpression>(Subtype::kArgumentExpressionList, std::move(exprList))
 		{
@@ -541,6 +551,21 @@ namespace expanse
 		{
 		}
 
+		const CExpression *CDesignator::GetIndexExpression() const
+		{
+			return m_indexExpr;
+		}
+
+		const CToken *CDesignator::GetIdentifier() const
+		{
+			return m_identifier;
+		}
+
+		CDesignator::DesignatorSubtype CDesignator::GetDesignatorSubtype() const
+		{
+			return m_designatorSubtype;
+		}
+
 
 		CDesignatorList::CDesignatorList(ArrayPtr<CorePtr<CDesignator>> &&designators)
 			: CGrammarElementListContainer<CDesignator>(Subtype::kDesignatorList, std::move(designators))
@@ -553,6 +578,11 @@ namespace expanse
 		{
 		}
 
+		const CDesignatorList *CDesignation::GetDesignatorList() const
+		{
+			return m_designationList;
+		}
+
 		CDesignatableInitializer::CDesignatableInitializer(CorePtr<CInitializer> &&expr)
 			: CGrammarElement(Subtype::kDesignatableInitializer)
 			, m_expr(std::move(expr))
@@ -584,5 +614,15 @@ namespace expanse
 			, m_subtype(subtype)
 		{
 		}
+
+		const TokenStrView &CTokenExpression::GetToken() const
+		{
+			return m_token;
+		}
+
+		CTokenExpression::TokenExpressionSubtype CTokenExpression::GetTokenExpressionSubtype() const
+		{
+			return m_subtype;
+		}
 	}
 }
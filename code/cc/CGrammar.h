@@ -577,6 +577,9 @@ namespace expanse
 		public:
 			explicit CTypeName(CorePtr<CSpecifierQualifierList> &&specQualList, CorePtr<CAbstractDeclarator> &&optAbsDecl);
 
+			const CSpecifierQualifierList *GetSpecifierQualifierList() const;
+			const CAbstractDeclarator *GetOptAbstractDeclarator() const;
+
 		private:
 			CorePtr<CSpecifierQualifierList> m_specQualList;
 			CorePtr<CAbstractDeclarator> m_optAbsDecl;
@@ -628,6 +631,10 @@ namespace expanse
 			explicit CDesignator(CorePtr<CExpression> &&indexExpr);
 			explicit CDesignator(CorePtr<CToken> &&identifier);
 
+			const CExpression *GetIndexExpression() const;
+			const CToken *GetIdentifier() const;
+			DesignatorSubtype GetDesignatorSubtype() const;
+
 		private:
 			CorePtr<CExpression> m_indexExpr;
 			CorePtr<CToken> m_identifier;
@@ -646,6 +653,8 @@ namespace expanse
 		public:
 			explicit CDesignation(CorePtr<CDesignatorList> &&designationList);
 
+			const CDesignatorList *GetDesignatorList() const;
+
 		private:
 			CorePtr<CDesignatorList> m_designationList;
 		};
@@ -689,6 +698,9 @@ namespace expanse
 
 			explicit CTokenExpression(const TokenStrView &token, TokenExpressionSubtype subtype);
 
+			const TokenStrView &GetToken() const;
+			TokenExpressionSubtype GetTokenExpressionSubtype() const;
+
 		private:
 			TokenExpressionSubtype m_subtype;
 			TokenStrView m_token;
@@ -2,6 +2,7 @@
 
 #include "ArrayView.h"
 #include "CharCodes.h"
+#include "CharScan.h"
 #include "IErrorReporter.h"
 
 namespace expanse
@@ -54,6 +55,10 @@ namespace expanse
 				{
 					endCoordinate = nextEndCoordinate;
 					firstTokenType = tokenType;
+
+					// Only whitespace coalesces, don't lex the next token just to find that out
+					if (firstTokenType != TokenType::kWhitespace)
+						break;
 				}
 				
 				if (firstTokenType == TokenType::kWhitespace && tokenType == TokenType::kWhitespace)
@@ -71,6 +76,16 @@ namespace expanse
 			return true;
 		}
 
+		TokenKind CLexer::ClassifyToken(const ArrayView<const uint8_t> &token, TokenType tokenType)
+		{
+			if (tokenType == TokenType::kIdentifier)
+				return TokenKindLookup::FindKeyword(token.begin(), token.Size());
+			else if (tokenType == TokenType::kPunctuation)
+				return TokenKindLookup::FindPunctuator(token.begin(), token.Size());
+			else
+				return TokenKind::kOther;
+		}
+
 		bool CLexer::TryGetToken(ArrayView<const uint8_t> contents, const FileCoordinate &inCoordinate, bool preprocessorRules, bool headerNamePermitted, IIncludeStackTrace &includeStackTrace, IErrorReporter *errorReporter, TokenType &outTokenType, FileCoordinate &outCoordinate)
 		{
 			TokenType tokenType = TokenType::kInvalid;
@@ -122,6 +137,14 @@ namespace expanse
 
 				for (;;)
 				{
+					const size_t bodyLength = CharScan::ScanCharSequenceBody(contents.begin() + coord.m_fileOffset, contents.Size() - coord.m_fileOffset, charSequenceTerminator);
+					if (bodyLength > 0)
+					{
+						coord.m_fileOffset += bodyLength;
+
+						prevCoord = FileCoordinate(coord.m_fileOffset - 1);
+					}
+
 					if (coord.m_fileOffset == contents.Size())
 					{
 						errorReporter->ReportError(prevCoord, includeStackTrace, CompilationErrorCode::kEndOfFileInCharacterSequence);
@@ -245,7 +268,12 @@ namespace expanse
 				{
 				case CharacterType::kControl:
 				case CharacterType::kWhitespace:
-					outTokenType = TokenType::kWhitespace;
+					{
+						const size_t runLength = CharScan::ScanWhitespace(contents.begin() + coord.m_fileOffset, contents.Size() - coord.m_fileOffset);
+						coord.m_fileOffset += runLength;
+
+						outTokenType = TokenType::kWhitespace;
+					}
 					break;
 
 				case CharacterType::kCarriageReturn:
@@ -267,6 +295,7 @@ namespace expanse
 							outTokenType = TokenType::kPunctuation;
 							if (coord.m_fileOffset != contents.Size())
 							{
+								FileCoordinate backupCoord = coord;
 								const uint8_t secondChar = ConsumeLogicalChar(contents, coord);
 								if (secondChar >= CharCode::kDigit0 && secondChar <= CharCode::kDigit9)
 								{
@@ -275,19 +304,21 @@ namespace expanse
 									else if ((!preprocessorRules) && TryGetCNumber(contents, inCoordinate, includeStackTrace, errorReporter, coord))
 										outTokenType = TokenType::kNumber;
 								}
+								else if (secondChar != CharCode::kPeriod || coord.m_fileOffset == contents.Size() || ConsumeLogicalChar(contents, coord) != CharCode::kPeriod)	// ...
+									coord = backupCoord;
 							}
 						}
 						else
 						{
 							outTokenType = TokenType::kPunctuation;
-							if (firstChar == CharCode::kExclamation || firstChar == CharCode::kPercent || firstChar == CharCode::kAsterisk || firstChar == CharCode::kCaret)	// ! % * ^
+							if (firstChar == CharCode::kExclamation || firstChar == CharCode::kPercent || firstChar == CharCode::kAsterisk || firstChar == CharCode::kCaret || firstChar == CharCode::kEqual)	// ! % * ^ =
 							{
 								if (coord.m_fileOffset != contents.Size())
 								{
 									FileCoordinate backupCoord = coord;
 									const uint8_t secondChar = ConsumeLogicalChar(contents, coord);
 
-									if (secondChar != CharCode::kEqual)	// != %= *= ^=
+									if (secondChar != CharCode::kEqual)	// != %= *= ^= ==
 										coord = backupCoord;
 								}
 							}
@@ -322,6 +353,12 @@ namespace expanse
 
 									if (secondChar != firstChar && secondChar != CharCode::kEqual)	// &&, &=, ++, += <<, <=, >>, >=, ||, |=
 										coord = backupCoord;
+									else if (secondChar == firstChar && (firstChar == CharCode::kLess || firstChar == CharCode::kGreater) && coord.m_fileOffset != contents.Size())
+									{
+										FileCoordinate shiftCoord = coord;
+										if (ConsumeLogicalChar(contents, coord) != CharCode::kEqual)	// <<=, >>=
+											coord = shiftCoord;
+									}
 								}
 							}
 							else if (firstChar == CharCode::kPeriod)	// .
@@ -350,44 +387,31 @@ namespace expanse
 
 									if (secondChar == CharCode::kAsterisk)	// /*
 									{
-										outTokenType = TokenType::kComment;
+										const uint8_t *body = contents.begin() + coord.m_fileOffset;
+										const size_t bodyMaxLength = contents.Size() - coord.m_fileOffset;
+										const size_t bodyLength = CharScan::ScanToBlockCommentEnd(body, bodyMaxLength);
 
-										if (coord.m_fileOffset == contents.Size())
+										if (bodyLength == bodyMaxLength)
+										{
+											errorReporter->ReportError(inCoordinate, includeStackTrace, CompilationErrorCode::kEndOfFileInComment);
+											coord.m_fileOffset += bodyMaxLength;
 											outTokenType = TokenType::kInvalid;
+										}
 										else
 										{
-											uint8_t prevChar = ConsumeLogicalChar(contents, coord);
-											for (;;)
-											{
-												if (coord.m_fileOffset == contents.Size())
-													outTokenType = TokenType::kInvalid;
-												else
-												{
-													const uint8_t thisChar = ConsumeLogicalChar(contents, coord);
-													if (prevChar == CharCode::kAsterisk && thisChar == CharCode::kSlash)
-														break;
-
-													prevChar = thisChar;
-												}
-											}
+											coord.m_fileOffset += bodyLength + 2;
+											outTokenType = TokenType::kComment;
 										}
 									}
 									else if (secondChar == CharCode::kSlash)	// //
 									{
-										outTokenType = TokenType::kComment;
+										// The line break isn't part of the comment
+										const size_t bodyLength = CharScan::ScanToLineEnd(contents.begin() + coord.m_fileOffset, contents.Size() - coord.m_fileOffset);
+										coord.m_fileOffset += bodyLength;
 
-										while (coord.m_fileOffset == contents.Size())
-										{
-											FileCoordinate backupCoord = coord;
-											const uint8_t nextChar = ConsumeLogicalChar(contents, coord);
-											if (nextChar == CharCode::kLineFeed)
-											{
-												coord = backupCoord;
-												break;
-											}
-										}
+										outTokenType = TokenType::kComment;
 									}
-									else
+									else if (secondChar != CharCode::kEqual)	// /=
 										coord = backupCoord;
 								}
 							}
@@ -442,6 +466,9 @@ namespace expanse
 
 			for (;;)
 			{
+				const size_t runLength = CharScan::ScanIdentifierChars(contents.begin() + coord.m_fileOffset, contents.Size() - coord.m_fileOffset);
+				coord.m_fileOffset += runLength;
+
 				if (coord.m_fileOffset == contents.Size())
 					break;
 
@@ -472,6 +499,10 @@ namespace expanse
 				}
 			}
 
+			// A lone backslash isn't an identifier
+			if (coord.m_fileOffset == coordinate.m_fileOffset)
+				return false;
+
 			outCoordinate = coord;
 			return true;
 		}
@@ -510,6 +541,13 @@ namespace expanse
 			uint8_t prevChar = thisChar;
 			for (;;)
 			{
+				const size_t runLength = CharScan::ScanIdentifierChars(contents.begin() + coord.m_fileOffset, contents.Size() - coord.m_fileOffset);
+				if (runLength > 0)
+				{
+					coord.m_fileOffset += runLength;
+					thisChar = contents[coord.m_fileOffset - 1];
+				}
+
 				if (coord.m_fileOffset == contents.Size())
 					break;
 
@@ -573,6 +611,7 @@ namespace expanse
 					return true;
 				}
 
+				const FileCoordinate afterZeroCoord = coord;
 				const uint8_t secondChar = ConsumeLogicalChar(contents, coord);
 				if (secondChar == CharCode::kLowercaseX || secondChar == CharCode::kUppercaseX)
 				{
@@ -581,15 +620,9 @@ namespace expanse
 						outCoordinate = coord;
 					return succeeded;
 				}
-				else
-				{
-					coord = coordinate;
-					(void)TryGetOctalNumber(contents, coord);
-					(void)TryGetIntegerSuffix(contents, coord);
 
-					outCoordinate = coord;
-					return true;
-				}
+				// Octal constants are lexed like decimal ones so that a leading 0 can also start a floating-constant
+				coord = afterZeroCoord;
 			}
 
 			// Possible sequences:
@@ -598,6 +631,7 @@ namespace expanse
 			//     digit-sequence [integer-suffix]
 			// floating-constant:
 			//     [digit-sequence] . digit-sequence [exponent-part] [floating-suffix]
+			//     digit-sequence . [exponent-part] [floating-suffix]
 			//     digit-sequence exponent-part [floating-suffix]
 			//
 			// floating-suffix = f, l, F, L
@@ -616,10 +650,10 @@ namespace expanse
 			{
 				// One of:
 				// digit-sequence [integer-suffix]
-				// digit-sequence . digit-sequence [exponent-part] [floating-suffix]
+				// digit-sequence . [digit-sequence] [exponent-part] [floating-suffix]
 				// digit-sequence exponent-part [floating-suffix]
-				if (!TryGetDigitSequence(contents, coord))
-					return false;
+				// The first digit was already consumed
+				(void)TryGetDigitSequence(contents, coord);
 
 				if (TryGetIntegerSuffix(contents, coord))
 				{
@@ -628,22 +662,11 @@ namespace expanse
 				{
 					(void)TryGetFloatingSuffix(contents, coord);
 				}
-				else
+				else if (TryGetSingle(contents, coord, CharCode::kPeriod))
 				{
-
-					if (coord.m_fileOffset != contents.Size())
-					{
-						FileCoordinate backupCoord = coord;
-						const uint8_t nextChar = ConsumeLogicalChar(contents, coord);
-
-						if (nextChar == CharCode::kPeriod && TryGetDigitSequence(contents, coord))
-						{
-							(void)TryGetExponentPart(contents, coord);
-							(void)TryGetFloatingSuffix(contents, coord);
-						}
-						else
-							coord = backupCoord;
-					}
+					(void)TryGetDigitSequence(contents, coord);
+					(void)TryGetExponentPart(contents, coord);
+					(void)TryGetFloatingSuffix(contents, coord);
 				}
 			}
 			else
@@ -653,17 +676,6 @@ namespace expanse
 			return true;
 		}
 
-		bool CLexer::TryGetOctalNumber(ArrayView<const uint8_t> contents, FileCoordinate &inOutCoordinate)
-		{
-			const bool hasOctalDigits = TryGetMultipleMatchingCallback(contents, inOutCoordinate, IsOctalDigit);
-			if (!hasOctalDigits)
-				return false;
-
-			(void)TryGetIntegerSuffix(contents, inOutCoordinate);
-
-			return true;
-		}
-
 		bool CLexer::TryGetHexNumber(ArrayView<const uint8_t> contents, FileCoordinate &inOutCoordinate)
 		{
 			// This handles hexadecimal-floating-constant and integer-constant->hexadecimal-constant, following hexadecimal-prefix
@@ -673,7 +685,7 @@ namespace expanse
 			// hexadecimal-digit-sequence . [hexadecimal-digit-sequence] binary-exponent-part [floating-suffix]
 			// hexadecimal-digit-sequence binary-exponent-part [floating-suffix]
 
-			FileCoordinate coord;
+			FileCoordinate coord = inOutCoordinate;
 			if (TryGetSingle(contents, coord, CharCode::kPeriod))
 			{
 				// . hexadecimal-digit-sequence binary-exponent-part [floating-suffix]
@@ -715,8 +727,6 @@ namespace expanse
 					// hexadecimal-digit-sequence binary-exponent-part [floating-suffix]
 					(void)TryGetFloatingSuffix(contents, coord);
 				}
-				else
-					return false;
 			}
 			else
 				return false;
@@ -971,7 +981,7 @@ namespace expanse
 			for (;;)
 			{
 				FileCoordinate prevCoord = coord;
-				if (contents.Size() == coord.m_lineNumber)
+				if (contents.Size() == coord.m_fileOffset)
 					break;
 
 				const uint8_t ch = ConsumeLogicalChar(contents, coord);
@@ -984,7 +994,7 @@ namespace expanse
 						matched = true;
 						break;
 					}
-					charCodes++;
+					scan++;
 				}
 
 				if (matched)
@@ -1007,33 +1017,18 @@ namespace expanse
 
 		bool CLexer::TryGetMultipleMatchingCallback(ArrayView<const uint8_t> contents, FileCoordinate &inOutCoordinate, bool(*callback)(uint8_t charCode))
 		{
-			bool haveAny = false;
+			// None of the callbacks accept line breaks, which are the only logical characters that aren't single bytes
+			const size_t startOffset = inOutCoordinate.m_fileOffset;
 
-			FileCoordinate coord = inOutCoordinate;
-			for (;;)
-			{
-				FileCoordinate prevCoord = coord;
-				if (contents.Size() == coord.m_lineNumber)
-					break;
-
-				const uint8_t ch = ConsumeLogicalChar(contents, coord);
+			size_t endOffset = startOffset;
+			while (endOffset < contents.Size() && callback(contents[endOffset]))
+				endOffset++;
 
-				if (callback(ch))
-					haveAny = true;
-				else
-				{
-					coord = prevCoord;
-					break;
-				}
-			}
-
-			if (haveAny)
-			{
-				inOutCoordinate = coord;
-				return true;
-			}
+			if (endOffset == startOffset)
+				return false;
 
-			return false;
+			inOutCoordinate.m_fileOffset = endOffset;
+			return true;
 		}
 
 		bool CLexer::IsHexDigit(uint8_t charCode)
@@ -1078,13 +1073,9 @@ namespace expanse
 		{
 			const uint8_t ch = contents[coord.m_fileOffset];
 			coord.m_fileOffset++;
-			coord.m_column++;
 
 			if (ch == 13)
 			{
-				coord.m_lineNumber++;
-				coord.m_column = 0;
-
 				if (coord.m_fileOffset != contents.Size())
 				{
 					if (contents[coord.m_fileOffset] == 10)
@@ -1093,13 +1084,6 @@ namespace expanse
 
 				return 10;
 			}
-			else if (ch == 10)
-			{
-				coord.m_lineNumber++;
-				coord.m_column = 0;
-
-				return 10;
-			}
 			else
 				return ch;
 		}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "FileCoordinate.h"
+#include "TokenKind.h"
 
 #include <cstdint>
 
@@ -47,13 +48,15 @@ namespace expanse
 
 			static bool TryGetToken(ArrayView<const uint8_t> contents, const FileCoordinate &coordinate, bool preprocessorRules, bool headerNamePermitted, IIncludeStackTrace &includeStackTrace, IErrorReporter *errorReporter, bool ignoreWhitespace, bool newLineIsWhitespace, ArrayView<const uint8_t> &outToken, TokenType &outTokenType, FileCoordinate &outCoordinate);
 
+			// Keyword or punctuator kind of a token returned by TryGetToken, kOther for everything else
+			static TokenKind ClassifyToken(const ArrayView<const uint8_t> &token, TokenType tokenType);
+
 		private:
 			static bool TryGetToken(ArrayView<const uint8_t> contents, const FileCoordinate &coordinate, bool preprocessorRules, bool headerNamePermitted, IIncludeStackTrace &includeStackTrace, IErrorReporter *errorReporter, TokenType &outTokenType, FileCoordinate &outCoordinate);
 			static bool TryGetIdentifier(ArrayView<const uint8_t> contents, const FileCoordinate &coordinate, IIncludeStackTrace &includeStackTrace, IErrorReporter *errorReporter, FileCoordinate &outCoordinate);
 			static bool TryGetPPNumber(ArrayView<const uint8_t> contents, const FileCoordinate &coordinate, IIncludeStackTrace &includeStackTrace, IErrorReporter *errorReporter, FileCoordinate &outCoordinate);
 			static bool TryGetCNumber(ArrayView<const uint8_t> contents, const FileCoordinate &coordinate, IIncludeStackTrace &includeStackTrace, IErrorReporter *errorReporter, FileCoordinate &outCoordinate);
 			static bool TryGetUniversalCharacterCode(ArrayView<const uint8_t> contents, const FileCoordinate &coordinate, IIncludeStackTrace &includeStackTrace, IErrorReporter *errorReporter, FileCoordinate &outCoordinate);
-			static bool TryGetOctalNumber(ArrayView<const uint8_t> contents, FileCoordinate &coordinate);
 			static bool TryGetHexNumber(ArrayView<const uint8_t> contents, FileCoordinate &coordinate);
 			static bool TryGetDigitSequence(ArrayView<const uint8_t> contents, FileCoordinate &inOutCoordinate);
 			static bool TryGetExponentPart(ArrayView<const uint8_t> contents, FileCoordinate &inOutCoordinate);
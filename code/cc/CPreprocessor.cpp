@@ -5,27 +5,58 @@
 #include "CLexer.h"
 #include "CPreprocessorTraceInfo.h"
 #include "CharCodes.h"
+#include "CharScan.h"
 #include "FileCache.h"
 #include "FileStream.h"
 #include "IErrorReporter.h"
 #include "IncludeStack.h"
+#include "PPConditionCache.h"
 #include "Result.h"
 #include "StrUtils.h"
+#include "TokenKind.h"
 
-expanse::cc::CPreprocessor::CPreprocessor(IAllocator *alloc, AsyncFileSystem *fs, FileCache *fileCache, FileStream *outStream, IErrorReporter *errorReporter)
+#include <cstring>
+
+class expanse::cc::CPreprocessor::ContinuationLineSource final : public PPMacroExpander::ILineSource
+{
+public:
+	ContinuationLineSource(IAllocator *alloc, CPreprocessor *preprocessor, const FileCoordinate &nextLineStart, bool trailingSpace);
+
+	ResultRV<bool> PullLine(Vector<PPMacroToken> &tokens) override;
+
+	const FileCoordinate &GetNextLineStart() const;
+	bool HasTrailingSpace() const;
+	ArrayView<const FileCoordinate> GetPulledLineStarts() const;
+
+private:
+	CPreprocessor *m_preprocessor;
+	FileCoordinate m_nextLineStart;
+	bool m_trailingSpace;
+	Vector<FileCoordinate> m_pulledLineStarts;
+};
+
+expanse::cc::CPreprocessor::CPreprocessor(IAllocator *alloc, AsyncFileSystem *fs, FileCache *fileCache, PPConditionCache *conditionCache, FileStream *outStream, IErrorReporter *errorReporter)
 	: m_state(State::kIdle)
 	, m_includeStackTop(nullptr)
 	, m_afs(fs)
 	, m_includeStackDepth(0)
 	, m_pathResolutionIndex(0)
 	, m_fileCache(fileCache)
+	, m_conditionCache(conditionCache)
+	, m_haveCachedFile(false)
 	, m_outStream(outStream)
 	, m_errorReporter(errorReporter)
 	, m_includeStackTrace(m_includeStackTop)
 	, m_systemIncludePaths(alloc)
 	, m_nonSystemIncludePaths(alloc)
-	, m_objectLikeMacros(*alloc)
-	, m_functionLikeMacros(*alloc)
+	, m_macros(alloc)
+	, m_macroExpander(alloc, &m_macros, errorReporter, &m_includeStackTrace)
+	, m_conditionEvaluator(alloc, &m_macros, &m_macroExpander, errorReporter, &m_includeStackTrace)
+	, m_lineTokens(alloc)
+	, m_expandedTokens(alloc)
+	, m_lineChars(alloc)
+	, m_pendingPrefetches(alloc)
+	, m_pragmaOnceFiles(alloc)
 {
 }
 
@@ -37,11 +68,10 @@ expanse::Result expanse::cc::CPreprocessor::StartRootFile(const UTF8StringView_t
 {
 	EXP_ASSERT(m_includeStackDepth == 0);
 
-	CHECK_RV(CorePtr<AsyncFileRequest>, request, this->m_afs->Retrieve(device, path));
-	m_currentFileRequest = std::move(request);
-
 	m_state = State::kLoadingRootFile;
 
+	CHECK(RetrieveFile(device, path));
+
 	return ErrorCode::kOK;
 }
 
@@ -52,30 +82,21 @@ expanse::Result expanse::cc::CPreprocessor::PushResolvedInclude(ArrayPtr<uint8_t
 
 	IAllocator *alloc = GetCoreObjectAllocator();
 
-	TokenStr canonicalName;
-	{
-		Vector<uint8_t> canonicalNameBuilder(alloc);
-		CHECK(canonicalNameBuilder.Add(device.GetChars()));
-
-		const uint8_t divider[] = { CharCode::kColon, CharCode::kSlash, CharCode::kSlash };
-		CHECK(canonicalNameBuilder.Add(ArrayView<const uint8_t>(divider)));
+	CHECK_RV(TokenStrView, canonicalName, InternCanonicalFileName(device, path));
 
-		CHECK(canonicalNameBuilder.Add(path.GetChars()));
+	CHECK(PrefetchIncludes(contents.ConstView(), device, path));
 
-		CHECK_RV(ArrayPtr<uint8_t>, canonicalNameClone, canonicalNameBuilder.ConstView().Clone(alloc));
-		canonicalName = TokenStr(std::move(canonicalNameClone));
-	}
+	CHECK_RV(CorePtr<IncludeStack>, newIncludeStack, New<IncludeStack>(alloc, alloc, m_includeStackTop, std::move(contents), std::move(device), std::move(path), canonicalName));
 
-	CHECK_RV(CorePtr<IncludeStack>, newIncludeStack, New<IncludeStack>(alloc, alloc, m_includeStackTop, std::move(contents), std::move(device), std::move(path), std::move(canonicalName)));
+	IncludeStack *newTop = newIncludeStack;
 
 	if (m_includeStackTop == nullptr)
-	{
 		m_includeStack = std::move(newIncludeStack);
-		m_includeStackTop = m_includeStack;
-	}
 	else
 		m_includeStackTop->Append(std::move(newIncludeStack));
 
+	m_includeStackTop = newTop;
+
 	m_includeStackDepth++;
 
 	m_state = State::kProcessing;
@@ -83,95 +104,107 @@ expanse::Result expanse::cc::CPreprocessor::PushResolvedInclude(ArrayPtr<uint8_t
 	return ErrorCode::kOK;
 }
 
-expanse::Result expanse::cc::CPreprocessor::ConvertLineBreaks(IAllocator *alloc, ArrayPtr<uint8_t> &contents)
+void expanse::cc::CPreprocessor::ConvertLineBreaks(ArrayPtr<uint8_t> &contents)
 {
-	ArrayView<const uint8_t> contentsView = ArrayView<uint8_t>(contents);
+	// Converts CR and CR LF line breaks to LF and splices lines ending in a backslash.  A spliced line break is
+	// moved to the end of the logical line so that line numbers stay the same.  Output is never longer than
+	// input, so this works in place, and the bytes before the first CR or backslash never move.
+	uint8_t *chars = contents.GetBuffer();
+	const size_t size = contents.Count();
 
-	const size_t length = contents.Count();
+	size_t readOffset = 0;
+	size_t writeOffset = 0;
+	size_t numDeferredLineBreaks = 0;
 
-	size_t numDeletedChars = 0;
-	for (size_t i = 0; i < length; i++)
+	for (;;)
 	{
-		if (contentsView[i] == CharCode::kBackslash)
+		// With line breaks waiting to be written, the next LF is interesting too
+		size_t runLength = 0;
+		if (numDeferredLineBreaks == 0)
+			runLength = CharScan::ScanToCarriageReturnOrBackslash(chars + readOffset, size - readOffset);
+		else
+			runLength = CharScan::ScanCharSequenceBody(chars + readOffset, size - readOffset, CharCode::kBackslash);
+
+		if (runLength > 0)
 		{
-			if (i != length - 1)
-			{
-				const uint8_t nextChar = contentsView[i + 1];
-				if (nextChar == CharCode::kCarriageReturn || nextChar == CharCode::kLineFeed)
-					numDeletedChars++;
-			}
+			if (writeOffset != readOffset)
+				memmove(chars + writeOffset, chars + readOffset, runLength);
+
+			readOffset += runLength;
+			writeOffset += runLength;
 		}
-		if (i != length - 1 && contentsView[i] == CharCode::kCarriageReturn && contentsView[i + 1] == CharCode::kLineFeed)
-			numDeletedChars++;
-	}
 
-	CHECK_RV(ArrayPtr<uint8_t>, newContents, NewArrayUninitialized<uint8_t>(alloc, length - numDeletedChars));
+		if (readOffset == size)
+			break;
 
-	ArrayView<uint8_t> newContentsView = newContents;
+		const uint8_t thisChar = chars[readOffset];
+		readOffset++;
 
-	size_t outOffset = 0;
-	size_t numExtraNewlines = 0;
-	for (size_t i = 0; i < length; i++)
-	{
-		uint8_t thisChar = contentsView[i];
-		if (thisChar == CharCode::kCarriageReturn)
+		if (thisChar == CharCode::kBackslash)
 		{
-			thisChar = CharCode::kLineFeed;
-			if (i != length - 1)
-			{
-				if (contentsView[i + 1] == CharCode::kLineFeed)
-					i++;
-			}
-		}
+			if (readOffset == size)
+				break;	// Just drop the character
 
-		if (thisChar == CharCode::kLineFeed)
-		{
-			numExtraNewlines++;
-			while (numExtraNewlines > 0)
+			const uint8_t nextChar = chars[readOffset];
+			if (nextChar == CharCode::kLineFeed || nextChar == CharCode::kCarriageReturn)
 			{
-				newContentsView[outOffset++] = CharCode::kLineFeed;
-				numExtraNewlines--;
+				readOffset++;
+				if (nextChar == CharCode::kCarriageReturn && readOffset != size && chars[readOffset] == CharCode::kLineFeed)
+					readOffset++;
+
+				numDeferredLineBreaks++;
 			}
+			else
+				chars[writeOffset++] = thisChar;
 		}
-		else if (thisChar == CharCode::kBackslash)
+		else
 		{
-			if (i == length - 1)
-			{
-				// Just drop the character
-			}
-			else
-			{
-				const uint8_t nextChar = contentsView[i + 1];
-				if (nextChar == CharCode::kLineFeed)
-				{
-					numExtraNewlines++;
-					i++;
-				}
-				else if (nextChar == CharCode::kCarriageReturn)
-				{
-					numExtraNewlines++;
-					i++;
+			if (thisChar == CharCode::kCarriageReturn && readOffset != size && chars[readOffset] == CharCode::kLineFeed)
+				readOffset++;
 
-					if (i != length - 1 && contentsView[i + 1] == CharCode::kLineFeed)
-						i++;
-				}
-				else
-					newContentsView[outOffset++] = thisChar;
+			// Each splice removed at least two bytes, so there's room for its line break
+			chars[writeOffset++] = CharCode::kLineFeed;
+			while (numDeferredLineBreaks > 0)
+			{
+				chars[writeOffset++] = CharCode::kLineFeed;
+				numDeferredLineBreaks--;
 			}
 		}
-		else
-			newContentsView[outOffset++] = thisChar;
 	}
 
-	while (numExtraNewlines > 0)
+	while (numDeferredLineBreaks > 0)
 	{
-		newContentsView[outOffset++] = CharCode::kLineFeed;
-		numExtraNewlines--;
+		chars[writeOffset++] = CharCode::kLineFeed;
+		numDeferredLineBreaks--;
 	}
 
-	EXP_ASSERT(outOffset == newContentsView.Size());
+	if (writeOffset != size)
+		contents.Truncate(writeOffset);
+}
+
+expanse::Result expanse::cc::CPreprocessor::AddIncludeDirectory(bool isSystem, const UTF8StringView_t &device, const UTF8StringView_t &path)
+{
+	IAllocator *alloc = GetCoreObjectAllocator();
+
+	IncludePath includePath;
+	CHECK_RV(UTF8String_t, deviceCopy, device.CloneToString(alloc));
+	includePath.m_device = std::move(deviceCopy);
 
-	contents = std::move(newContents);
+	// Include paths are used as a prefix, so make sure they end with a slash
+	if (path.Length() > 0 && path.GetChars()[path.Length() - 1] != CharCode::kSlash)
+	{
+		CHECK(CombineIncludePath(path.GetChars(), UTF8StringView_t("/"), includePath.m_path));
+	}
+	else
+	{
+		CHECK_RV(UTF8String_t, pathCopy, path.CloneToString(alloc));
+		includePath.m_path = std::move(pathCopy);
+	}
+
+	if (isSystem)
+		CHECK(m_systemIncludePaths.Add(std::move(includePath)));
+	else
+		CHECK(m_nonSystemIncludePaths.Add(std::move(includePath)));
 
 	return ErrorCode::kOK;
 }
@@ -194,6 +227,23 @@ expanse::cc::CPreprocessor::State expanse::cc::CPreprocessor::GetState() const
 	return m_state;
 }
 
+void expanse::cc::CPreprocessor::WaitForFileLoad(ThreadEvent *finishEvent)
+{
+	switch (m_state)
+	{
+	case State::kLoadingRootFile:
+	case State::kLoadingLocalOnlyFile:
+	case State::kLoadingLocalBeforeIncludeDirsFile:
+	case State::kLoadingIncludeDirsFile:
+	case State::kLoadingSystemDirsFile:
+		if (!m_haveCachedFile && m_currentFileRequest)
+			m_currentFileRequest->WaitForFinish(finishEvent);
+		break;
+	default:
+		break;
+	}
+}
+
 expanse::Result expanse::cc::CPreprocessor::FlushTrace(FileStream *traceStream)
 {
 	if (m_traceInfo)
@@ -204,74 +254,9 @@ expanse::Result expanse::cc::CPreprocessor::FlushTrace(FileStream *traceStream)
 	return ErrorCode::kOK;
 }
 
-expanse::cc::CPreprocessor::Subrange::Subrange()
-	: m_start(0)
-	, m_length(0)
-{
-}
-
-expanse::cc::CPreprocessor::Subrange::Subrange(size_t start, size_t length)
-	: m_start(start)
-	, m_length(length)
-{
-}
-
-size_t expanse::cc::CPreprocessor::Subrange::GetStart() const
-{
-	return m_start;
-}
-
-size_t expanse::cc::CPreprocessor::Subrange::GetLength() const
-{
-	return m_length;
-}
-
-
-expanse::cc::CPreprocessor::PPToken::PPToken()
-	: m_isWhitespace(false)
-{
-}
-
-expanse::cc::CPreprocessor::PPTokenCollection::PPTokenCollection()
-{
-}
-
-expanse::cc::CPreprocessor::PPTokenCollection::PPTokenCollection(PPTokenCollection &&other)
-	: m_tokenContents(std::move(other.m_tokenContents))
-	, m_tokens(std::move(other.m_tokens))
-{
-}
-
-expanse::cc::CPreprocessor::PPTokenCollection::PPTokenCollection(ArrayPtr<uint8_t> &&tokenContents, ArrayPtr<ArrayView<const uint8_t>> &&tokens)
-	: m_tokenContents(std::move(tokenContents))
-	, m_tokens(std::move(tokens))
-{
-}
-
-expanse::cc::CPreprocessor::PPTokenCollection::~PPTokenCollection()
-{
-}
-
-expanse::ArrayView<const expanse::ArrayView<const uint8_t>> expanse::cc::CPreprocessor::PPTokenCollection::GetTokens() const
-{
-	return m_tokens.ConstView();
-}
-
-expanse::ArrayPtr<uint8_t> expanse::cc::CPreprocessor::PPTokenCollection::FlattenAndTakeContents()
+expanse::cc::CPreprocessorTraceInfo *expanse::cc::CPreprocessor::GetTraceInfo() const
 {
-	m_tokens = nullptr;
-	return ArrayPtr<uint8_t>(std::move(m_tokenContents));
-}
-
-expanse::cc::CPreprocessor::PPTokenCollection &expanse::cc::CPreprocessor::PPTokenCollection::operator=(expanse::cc::CPreprocessor::PPTokenCollection &&other)
-{
-	if (this != &other)
-	{
-		m_tokenContents = std::move(other.m_tokenContents);
-		m_tokens = std::move(other.m_tokens);
-	}
-
-	return *this;
+	return m_traceInfo;
 }
 
 bool expanse::cc::CPreprocessor::TokenEquals(const ArrayView<const uint8_t> &tokenChars, const char *str)
@@ -296,11 +281,31 @@ void expanse::cc::CPreprocessor::PopIncludeStack()
 			prev->UnlinkNext();
 		else
 			m_includeStack = nullptr;
+
+		m_includeStackTop = prev;
 	}
 
 	m_includeStackDepth--;
 }
 
+expanse::Result expanse::cc::CPreprocessor::LeaveIncludedFile()
+{
+	IncludeStack *f = m_includeStackTop;
+
+	if (m_fileCache && f->IsIncludeGuarded())
+	{
+		UTF8StringView_t device;
+		UTF8StringView_t path;
+		f->GetFileName(device, path);
+
+		CHECK(m_fileCache->SetIncludeGuardMacro(device, path, f->GetIncludeGuardMacro()));
+	}
+
+	PopIncludeStack();
+
+	return ErrorCode::kOK;
+}
+
 expanse::Result expanse::cc::CPreprocessor::DigestChecked()
 {
 	if (!m_traceInfo)
@@ -310,6 +315,8 @@ expanse::Result expanse::cc::CPreprocessor::DigestChecked()
 		m_traceInfo = std::move(traceInfo);
 	}
 
+	CHECK(CollectFinishedPrefetches());
+
 	for (;;)
 	{
 		switch (m_state)
@@ -324,6 +331,13 @@ expanse::Result expanse::cc::CPreprocessor::DigestChecked()
 		case State::kLoadingIncludeDirsFile:
 		case State::kLoadingSystemDirsFile:
 			{
+				if (m_haveCachedFile)
+				{
+					m_haveCachedFile = false;
+					CHECK(PushResolvedInclude(std::move(m_cachedFileContents), std::move(m_cachedFileDevice), std::move(m_cachedFilePath)));
+					break;
+				}
+
 				if (!m_currentFileRequest->IsFinished())
 					return ErrorCode::kOK;
 
@@ -332,17 +346,27 @@ expanse::Result expanse::cc::CPreprocessor::DigestChecked()
 				{
 					ArrayPtr<uint8_t> results(m_currentFileRequest->TakeResult());
 
-					CHECK(ConvertLineBreaks(this->GetCoreObjectAllocator(), results));
-
 					UTF8String_t device;
 					UTF8String_t path;
 					m_currentFileRequest->TakeIdentifier(device, path);
 
+					if (m_fileCache)
+						CHECK(m_fileCache->AddFile(device, path, results.ConstView()));
+
 					m_currentFileRequest = nullptr;
 					CHECK(PushResolvedInclude(std::move(results), std::move(device), std::move(path)));
 				}
 				else if (errorCode == ErrorCode::kFileNotFound)
 				{
+					if (m_fileCache)
+					{
+						UTF8String_t device;
+						UTF8String_t path;
+						m_currentFileRequest->TakeIdentifier(device, path);
+
+						CHECK(m_fileCache->AddMissingFile(device, path));
+					}
+
 					m_currentFileRequest = nullptr;
 					CHECK(AdvanceToNextIncludePath());
 				}
@@ -400,6 +424,21 @@ expanse::Result expanse::cc::CPreprocessor::Process()
 		if (m_state != State::kProcessing)
 			return ErrorCode::kOK;
 
+		// Included files are left before the next line's trace is recorded, so the line is blamed on the includer
+		IncludeStack *f = m_includeStackTop;
+		if (f->GetPrev() != nullptr && f->GetFileCoordinate().m_fileOffset == f->GetFileContents().Size())
+		{
+			CHECK(LeaveIncludedFile());
+			continue;
+		}
+
+		if (!f->IsInActivePreprocessorBlock())
+		{
+			CHECK_RV(bool, skippedLines, SkipInactiveLines());
+			if (skippedLines)
+				continue;
+		}
+
 		CHECK(m_traceInfo->AddLineInfo(&m_includeStackTrace));
 		CHECK(ProcessLine());
 	}
@@ -432,15 +471,14 @@ expanse::Result expanse::cc::CPreprocessor::ProcessLine()
 	{
 		f->SetFileCoordinate(coord);
 		CHECK(ProcessDirectiveLine());
+		CHECK(WriteLineBreaks(1));
 	}
 	else
 	{
-		CHECK(ProcessTextLine());
-	}
+		if (tokenType != CLexer::TokenType::kNewLine)
+			f->NoteIncludeGuardContent();
 
-	{
-		uint8_t newLineChar[] = { CharCode::kLineFeed };
-		CHECK(m_outStream->WriteAll(ArrayView<const uint8_t>(newLineChar)));
+		CHECK(ProcessTextLine());
 	}
 
 	return ErrorCode::kOK;
@@ -452,21 +490,84 @@ expanse::Result expanse::cc::CPreprocessor::ProcessTextLine()
 	IncludeStack *f = m_includeStackTop;
 
 	if (!f->IsInActivePreprocessorBlock())
-		return SkipLine();
+	{
+		CHECK(SkipLine());
+		CHECK(WriteLineBreaks(1));
+		return ErrorCode::kOK;
+	}
 
-	FileCoordinate coord = f->GetFileCoordinate();
+	const FileCoordinate startCoord = f->GetFileCoordinate();
+	FileCoordinate coord = startCoord;
+
+	m_lineTokens.Clear();
+	m_lineChars.Clear();
+
+	bool trailingSpace = false;
+	CHECK(LexLineTokens(coord, m_lineTokens, trailingSpace));
+
+	// Only as far as the first line break, tokens after a splice or a multi-line comment are on another line of the
+	// source but the same line of the output
+	const ArrayView<const uint8_t> lineContents = f->GetFileContents().Subrange(startCoord.m_fileOffset, coord.m_fileOffset - startCoord.m_fileOffset);
+	const ArrayView<const uint8_t> sourceLine = lineContents.Subrange(0, CharScan::ScanToLineEnd(lineContents.begin(), lineContents.Size()));
+
+	// Without any macro names on the line, no invocation can start on it, so expansion wouldn't change anything
+	bool mayExpand = false;
+	for (size_t i = 0; i < m_lineTokens.Size() && !mayExpand; i++)
+	{
+		const PPMacroToken &token = m_lineTokens[i];
+		mayExpand = token.HasFlag(PPMacroToken::kFlagIdentifier) && m_macros.Find(token.m_spelling) != nullptr;
+	}
+
+	// Tokens keep their source columns, so whitespace runs come out as spaces, and whatever trails the last token
+	// comes out as a single space.  The whole line including its line break goes out in one write.
+	if (!mayExpand)
+	{
+		CHECK(PPMacroExpander::AppendSpellingsAtSourceColumns(m_lineTokens.ConstView(), sourceLine, m_lineChars));
+
+		if (trailingSpace)
+		{
+			CHECK(m_lineChars.Add(static_cast<uint8_t>(CharCode::kSpace)));
+		}
+
+		CHECK(m_lineChars.Add(static_cast<uint8_t>(CharCode::kLineFeed)));
+		CHECK(m_outStream->WriteAll(m_lineChars.ConstView()));
+
+		f->SetFileCoordinate(coord);
+
+		return ErrorCode::kOK;
+	}
 
 	IAllocator *alloc = GetCoreObjectAllocator();
-	CHECK_RV(ArrayPtr<PPToken>, simpleTokens, ParseTokenSequence(coord));
-	CHECK_RV(PPTokenCollection, tokenSequence, CanonicalizeTokenSequence(simpleTokens.ConstView()));
-	simpleTokens = nullptr;
 
-	CHECK(ExpandTokenSequence(tokenSequence));
-	ArrayPtr<uint8_t> flatSequence(tokenSequence.FlattenAndTakeContents());
+	ContinuationLineSource lineSource(alloc, this, coord, trailingSpace);
 
-	CHECK(m_outStream->WriteAll(flatSequence.ConstView()));
+	m_expandedTokens.Clear();
+	CHECK(m_macroExpander.Expand(startCoord, m_lineTokens, &lineSource, nullptr, m_expandedTokens));
 
-	f->SetFileCoordinate(coord);
+	CHECK(PPMacroExpander::AppendSpellingsAtSourceColumns(m_expandedTokens.ConstView(), sourceLine, m_lineChars));
+
+	if (lineSource.HasTrailingSpace())
+	{
+		CHECK(m_lineChars.Add(static_cast<uint8_t>(CharCode::kSpace)));
+	}
+
+	m_macroExpander.ResetScratch();
+
+	// An invocation that spans several lines comes out on the first one, the others are left blank so that every
+	// source line still has its own output line and trace entry
+	CHECK(m_lineChars.Add(static_cast<uint8_t>(CharCode::kLineFeed)));
+
+	for (const FileCoordinate &lineStart : lineSource.GetPulledLineStarts())
+	{
+		CHECK(m_lineChars.Add(static_cast<uint8_t>(CharCode::kLineFeed)));
+
+		f->SetFileCoordinate(lineStart);
+		CHECK(m_traceInfo->AddLineInfo(&m_includeStackTrace));
+	}
+
+	CHECK(m_outStream->WriteAll(m_lineChars.ConstView()));
+
+	f->SetFileCoordinate(lineSource.GetNextLineStart());
 
 	return ErrorCode::kOK;
 }
@@ -498,48 +599,71 @@ expanse::Result expanse::cc::CPreprocessor::ProcessDirectiveLine()
 	}
 	else if (tokenType == CLexer::TokenType::kIdentifier)
 	{
-		// Logic blocks, must come first
-		if (TokenEquals(token, "if"))
+		const PPDirective directive = TokenKindLookup::FindDirective(token.begin(), token.Size());
+
+		// #ifndef checks whether it's the guard itself
+		if (directive != PPDirective::kIfNDef)
+			f->NoteIncludeGuardContent();
+
+		switch (directive)
+		{
+		// Logic blocks are tracked even in inactive blocks
+		case PPDirective::kIf:
 			CHECK(ProcessIfDirective(contents, coord));
-		else if (TokenEquals(token, "ifdef"))
+			break;
+		case PPDirective::kIfDef:
 			CHECK(ProcessIfDefDirective(contents, coord));
-		else if (TokenEquals(token, "ifndef"))
+			break;
+		case PPDirective::kIfNDef:
 			CHECK(ProcessIfNDefDirective(contents, coord));
-		else if (TokenEquals(token, "elif"))
+			break;
+		case PPDirective::kElif:
 			CHECK(ProcessElifDirective(contents, coord));
-		else if (TokenEquals(token, "else"))
+			break;
+		case PPDirective::kElse:
 			CHECK(ProcessElseDirective(contents, coord));
-		else if (TokenEquals(token, "endif"))
+			break;
+		case PPDirective::kEndIf:
 			CHECK(ProcessEndIfDirective(contents, coord));
-		else
-		{
-			// Non-logic blocks
-			if (m_includeStackTop->IsInActivePreprocessorBlock())
+			break;
+		default:
 			{
-				if (TokenEquals(token, "include"))
+				// Non-logic blocks
+				if (!m_includeStackTop->IsInActivePreprocessorBlock())
+					return SkipLine();
+
+				switch (directive)
+				{
+				case PPDirective::kInclude:
 					CHECK(ProcessIncludeDirective(contents, coord));
-				else if (TokenEquals(token, "define"))
+					break;
+				case PPDirective::kDefine:
 					CHECK(ProcessDefineDirective(contents, coord));
-				else if (TokenEquals(token, "undef"))
+					break;
+				case PPDirective::kUndef:
 					CHECK(ProcessUndefDirective(contents, coord));
-				else if (TokenEquals(token, "line"))
+					break;
+				case PPDirective::kLine:
 					CHECK(ProcessLineDirective(contents, coord));
-				else if (TokenEquals(token, "error"))
+					break;
+				case PPDirective::kError:
 					CHECK(ProcessErrorDirective(contents, coord));
-				else if (TokenEquals(token, "pragma"))
+					break;
+				case PPDirective::kPragma:
 					CHECK(ProcessPragmaDirective(contents, coord));
-				else
-				{
+					break;
+				default:
 					m_errorReporter->ReportError(startCoord, m_includeStackTrace, CompilationErrorCode::kUnknownDirective);
 					return ErrorCode::kOperationFailed;
 				}
 			}
-			else
-				return SkipLine();
+			break;
 		}
 	}
 	else
 	{
+		f->NoteIncludeGuardContent();
+
 		if (!m_includeStackTop->IsInActivePreprocessorBlock())
 			return SkipLine();
 		else
@@ -559,13 +683,10 @@ expanse::Result expanse::cc::CPreprocessor::ProcessIncludeDirective(const ArrayV
 	FileCoordinate coord = inOutCoordinate;
 	ArrayView<const uint8_t> includePath;
 	CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
-	if (!CLexer::TryGetToken(contents, coord, true, true, m_includeStackTrace, m_errorReporter, true, false, includePath, tokenType, coord))
-		m_errorReporter->ReportError(inOutCoordinate, m_includeStackTrace, CompilationErrorCode::kInvalidIncludePath);
-
-	if (tokenType == CLexer::TokenType::kPPHeaderName || tokenType == CLexer::TokenType::kCharSequence)
+	// Anything but a header name or string literal is lexed again as pp-tokens below, which reports invalid ones
+	if (CLexer::TryGetToken(contents, coord, true, true, m_includeStackTrace, m_errorReporter, true, false, includePath, tokenType, coord)
+		&& (tokenType == CLexer::TokenType::kPPHeaderName || tokenType == CLexer::TokenType::kCharSequence))
 	{
-		m_errorReporter->ReportError(inOutCoordinate, m_includeStackTrace, CompilationErrorCode::kInvalidIncludePath);
-
 		EXP_ASSERT(includePath.Size() >= 2);
 
 		CHECK(StartIncluding(inOutCoordinate, includePath));
@@ -586,84 +707,318 @@ expanse::Result expanse::cc::CPreprocessor::ProcessIncludeDirective(const ArrayV
 
 		IAllocator *alloc = GetCoreObjectAllocator();
 
-		CHECK_RV(ArrayPtr<PPToken>, simpleTokens, ParseTokenSequence(coord));
-		CHECK_RV(PPTokenCollection, tokenSequence, CanonicalizeTokenSequence(simpleTokens.ConstView()));
-		simpleTokens = nullptr;
+		Vector<PPMacroToken> tokens(alloc);
+		bool trailingSpace = false;
+		CHECK(LexLineTokens(coord, tokens, trailingSpace));
 
-		CHECK(ExpandTokenSequence(tokenSequence));
+		Vector<PPMacroToken> expandedTokens(alloc);
+		CHECK(m_macroExpander.Expand(inOutCoordinate, tokens, nullptr, nullptr, expandedTokens));
 
-		EXP_ASSERT(false);	// NOT YET IMPLEMENTED
-	}
+		// The replacement has to be a single string literal or tokens between < and >, which are spelled out with
+		// the spacing between them to form the header name
+		const size_t numTokens = expandedTokens.Size();
+		const bool isQuoted = (numTokens == 1 && expandedTokens[0].m_spelling.Size() >= 2 && expandedTokens[0].m_spelling[0] == CharCode::kDoubleQuote);
+		const bool isBracketed = (numTokens >= 2 && expandedTokens[0].m_kind == TokenKind::kLess && expandedTokens[numTokens - 1].m_kind == TokenKind::kGreater);
 
-	return ErrorCode::kOK;
-}
+		if (!isQuoted && !isBracketed)
+		{
+			m_macroExpander.ResetScratch();
+			m_errorReporter->ReportError(inOutCoordinate, m_includeStackTrace, CompilationErrorCode::kInvalidIncludePath);
+			return ErrorCode::kOperationFailed;
+		}
 
-expanse::Result expanse::cc::CPreprocessor::ProcessDefineDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
-{
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+		expandedTokens[0].m_flags &= ~PPMacroToken::kFlagLeadingSpace;
 
-	return ErrorCode::kOK;
-}
+		Vector<uint8_t> headerName(alloc);
+		CHECK(PPMacroExpander::AppendSpellings(expandedTokens.ConstView(), headerName));
 
-expanse::Result expanse::cc::CPreprocessor::ProcessUndefDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
-{
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+		m_macroExpander.ResetScratch();
+
+		CHECK(StartIncluding(inOutCoordinate, headerName.ConstView()));
+		inOutCoordinate = coord;
+	}
 
 	return ErrorCode::kOK;
 }
 
-expanse::Result expanse::cc::CPreprocessor::ProcessLineDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
+expanse::Result expanse::cc::CPreprocessor::ProcessDefineDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
 {
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+	const FileCoordinate blameCoord = inOutCoordinate;
 
-	return ErrorCode::kOK;
-}
+	IAllocator *alloc = GetCoreObjectAllocator();
 
-expanse::Result expanse::cc::CPreprocessor::ProcessErrorDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
-{
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+	Vector<PPMacroToken> tokens(alloc);
+	bool trailingSpace = false;
+	CHECK(LexLineTokens(inOutCoordinate, tokens, trailingSpace));
 
-	return ErrorCode::kOK;
-}
+	const size_t numTokens = tokens.Size();
 
-expanse::Result expanse::cc::CPreprocessor::ProcessPragmaDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
-{
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+	if (numTokens == 0 || !tokens[0].HasFlag(PPMacroToken::kFlagIdentifier))
+	{
+		m_errorReporter->ReportError(blameCoord, m_includeStackTrace, CompilationErrorCode::kPPExpectedMacroName);
+		return ErrorCode::kOperationFailed;
+	}
 
-	return ErrorCode::kOK;
-}
+	const ArrayView<const uint8_t> name = tokens[0].m_spelling;
 
-expanse::Result expanse::cc::CPreprocessor::ProcessIfDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
-{
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+	const uint8_t vaArgsChars[] = { '_', '_', 'V', 'A', '_', 'A', 'R', 'G', 'S', '_', '_' };
+	const ArrayView<const uint8_t> vaArgsName(vaArgsChars);
 
-	return ErrorCode::kOK;
-}
+	PPMacro macro;
+	Vector<ArrayView<const uint8_t>> parameterNames(alloc);
+	size_t tokenIndex = 1;
 
-expanse::Result expanse::cc::CPreprocessor::ProcessIfDefDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
-{
-	if (!m_includeStackTop->IsInActivePreprocessorBlock())
+	// Only a parenthesis directly after the name starts a parameter list
+	if (tokenIndex < numTokens && tokens[tokenIndex].m_kind == TokenKind::kLeftParen && !tokens[tokenIndex].HasFlag(PPMacroToken::kFlagLeadingSpace))
 	{
-		CHECK(m_includeStackTop->PushLogic(PreprocessorLogicStack(inOutCoordinate, PreprocessorLogicState::kDisabled)));
-		CHECK(SkipLine());
-		return ErrorCode::kOK;
-	}
+		macro.m_isFunctionLike = true;
+		tokenIndex++;
 
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+		if (tokenIndex < numTokens && tokens[tokenIndex].m_kind == TokenKind::kRightParen)
+			tokenIndex++;
+		else
+		{
+			for (;;)
+			{
+				bool isValidParameter = false;
+
+				if (tokenIndex < numTokens)
+				{
+					const PPMacroToken &parameterToken = tokens[tokenIndex++];
+
+					if (parameterToken.m_kind == TokenKind::kEllipsis)
+					{
+						macro.m_isVariadic = true;
+						CHECK(parameterNames.Add(vaArgsName));
+						isValidParameter = true;
+					}
+					else if (parameterToken.HasFlag(PPMacroToken::kFlagIdentifier)
+						&& !SpellingEquals(parameterToken.m_spelling, vaArgsName)
+						&& FindMacroParameter(parameterNames.ConstView(), parameterToken.m_spelling) == PPMacroToken::kNotAParameter)
+					{
+						CHECK(parameterNames.Add(parameterToken.m_spelling));
+						isValidParameter = true;
+					}
+				}
+
+				TokenKind separator = TokenKind::kOther;
+				if (tokenIndex < numTokens)
+					separator = tokens[tokenIndex++].m_kind;
+
+				if (!isValidParameter || (separator != TokenKind::kRightParen && (separator != TokenKind::kComma || macro.m_isVariadic)))
+				{
+					m_errorReporter->ReportError(blameCoord, m_includeStackTrace, CompilationErrorCode::kPPInvalidMacroParameterList);
+					return ErrorCode::kOperationFailed;
+				}
+
+				if (separator == TokenKind::kRightParen)
+					break;
+			}
+		}
+
+		macro.m_numParameters = static_cast<uint32_t>(parameterNames.Size());
+	}
+
+	// Parameters are resolved to indexes here, # is folded into the parameter it applies to and ## into the token
+	// before it, so expansion never has to look at names
+	Vector<PPMacroToken> replacementList(alloc);
+
+	for (; tokenIndex < numTokens; tokenIndex++)
+	{
+		PPMacroToken token = tokens[tokenIndex];
+
+		// Whitespace before the replacement list isn't part of it
+		if (replacementList.Size() == 0)
+			token.m_flags &= ~PPMacroToken::kFlagLeadingSpace;
+
+		if (token.m_kind == TokenKind::kHashHash)
+		{
+			if (replacementList.Size() == 0 || tokenIndex + 1 == numTokens)
+			{
+				m_errorReporter->ReportError(blameCoord, m_includeStackTrace, CompilationErrorCode::kPPPasteAtEdgeOfReplacementList);
+				return ErrorCode::kOperationFailed;
+			}
+
+			replacementList[replacementList.Size() - 1].m_flags |= PPMacroToken::kFlagPasteNext;
+			macro.m_hasPaste = true;
+			continue;
+		}
+
+		if (macro.m_isFunctionLike && token.m_kind == TokenKind::kHash)
+		{
+			uint32_t parameterIndex = PPMacroToken::kNotAParameter;
+			if (tokenIndex + 1 < numTokens && tokens[tokenIndex + 1].HasFlag(PPMacroToken::kFlagIdentifier))
+				parameterIndex = FindMacroParameter(parameterNames.ConstView(), tokens[tokenIndex + 1].m_spelling);
+
+			if (parameterIndex == PPMacroToken::kNotAParameter)
+			{
+				m_errorReporter->ReportError(blameCoord, m_includeStackTrace, CompilationErrorCode::kPPStringifyWithoutParameter);
+				return ErrorCode::kOperationFailed;
+			}
+
+			tokenIndex++;
+
+			PPMacroToken stringifyToken(tokens[tokenIndex].m_spelling, TokenKind::kOther, (token.m_flags & PPMacroToken::kFlagLeadingSpace) | PPMacroToken::kFlagStringify);
+			stringifyToken.m_parameterIndex = parameterIndex;
+
+			CHECK(replacementList.Add(stringifyToken));
+			continue;
+		}
+
+		if (token.HasFlag(PPMacroToken::kFlagIdentifier))
+		{
+			if (!macro.m_isVariadic && SpellingEquals(token.m_spelling, vaArgsName))
+			{
+				m_errorReporter->ReportError(blameCoord, m_includeStackTrace, CompilationErrorCode::kPPVaArgsOutsideVariadicMacro);
+				return ErrorCode::kOperationFailed;
+			}
+
+			token.m_parameterIndex = FindMacroParameter(parameterNames.ConstView(), token.m_spelling);
+		}
+
+		CHECK(replacementList.Add(token));
+	}
+
+	macro.m_replacementList = replacementList.ConstView();
+
+	CHECK_RV(bool, isDefined, m_macros.Define(name, macro));
+	if (!isDefined)
+	{
+		m_errorReporter->ReportError(blameCoord, m_includeStackTrace, CompilationErrorCode::kPPMacroRedefinition);
+		return ErrorCode::kOperationFailed;
+	}
+
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::ProcessUndefDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
+{
+	ArrayView<const uint8_t> name;
+	CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
+	if (!CLexer::TryGetToken(contents, inOutCoordinate, true, false, m_includeStackTrace, m_errorReporter, true, false, name, tokenType, inOutCoordinate) || tokenType != CLexer::TokenType::kIdentifier)
+	{
+		m_errorReporter->ReportError(inOutCoordinate, m_includeStackTrace, CompilationErrorCode::kPPExpectedMacroName);
+		return ErrorCode::kOperationFailed;
+	}
+
+	ArrayView<const uint8_t> token;
+	if (CLexer::TryGetToken(contents, inOutCoordinate, true, false, m_includeStackTrace, m_errorReporter, true, false, token, tokenType, inOutCoordinate) && tokenType != CLexer::TokenType::kNewLine)
+	{
+		m_errorReporter->ReportError(inOutCoordinate, m_includeStackTrace, CompilationErrorCode::kPPExpectedNewLineAfterUndef);
+		return ErrorCode::kOperationFailed;
+	}
+
+	m_macros.Undefine(name);
+
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::ProcessLineDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
+{
+	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::ProcessErrorDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
+{
+	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::ProcessPragmaDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
+{
+	FileCoordinate coord = inOutCoordinate;
+	ArrayView<const uint8_t> token;
+	CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
+	const bool isOnce = CLexer::TryGetToken(contents, coord, true, false, m_includeStackTrace, m_errorReporter, true, false, token, tokenType, coord)
+		&& tokenType == CLexer::TokenType::kIdentifier && token.Size() == 4 && TokenEquals(token, "once");
+
+	ArrayView<const uint8_t> nextToken;
+	if (isOnce && (!CLexer::TryGetToken(contents, coord, true, false, m_includeStackTrace, m_errorReporter, true, false, nextToken, tokenType, coord) || tokenType == CLexer::TokenType::kNewLine))
+	{
+		IncludeStack *f = m_includeStackTop;
+
+		const size_t fileIndex = f->GetTraceFileName().GetAtom().GetIndex();
+		if (fileIndex >= m_pragmaOnceFiles.Size())
+		{
+			const size_t oldSize = m_pragmaOnceFiles.Size();
+			CHECK(m_pragmaOnceFiles.Resize(fileIndex + 1));
+
+			for (size_t i = oldSize; i < m_pragmaOnceFiles.Size(); i++)
+				m_pragmaOnceFiles[i] = 0;
+		}
+
+		m_pragmaOnceFiles[fileIndex] = 1;
+
+		if (m_fileCache)
+		{
+			UTF8StringView_t device;
+			UTF8StringView_t path;
+			f->GetFileName(device, path);
+
+			CHECK(m_fileCache->SetPragmaOnce(device, path));
+		}
+
+		inOutCoordinate = coord;
+		return ErrorCode::kOK;
+	}
+
+	// Pragmas that aren't recognized are ignored (6.10.6)
+	return SkipDirectiveOperands(inOutCoordinate);
+}
+
+expanse::Result expanse::cc::CPreprocessor::ProcessIfDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
+{
+	const FileCoordinate blameCoord = inOutCoordinate;
+
+	if (!m_includeStackTop->IsInActivePreprocessorBlock())
+	{
+		CHECK(m_includeStackTop->PushLogic(PreprocessorLogicStack(blameCoord, PreprocessorLogicState::kDisabled)));
+		return SkipDirectiveOperands(inOutCoordinate);
+	}
+
+	CHECK_RV(bool, isTrue, EvaluateCondition(blameCoord, inOutCoordinate));
+	CHECK(m_includeStackTop->PushLogic(PreprocessorLogicStack(blameCoord, isTrue ? PreprocessorLogicState::kActive : PreprocessorLogicState::kNotYetActive)));
+
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::ProcessIfDefDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
+{
+	const FileCoordinate blameCoord = inOutCoordinate;
+
+	if (!m_includeStackTop->IsInActivePreprocessorBlock())
+	{
+		CHECK(m_includeStackTop->PushLogic(PreprocessorLogicStack(blameCoord, PreprocessorLogicState::kDisabled)));
+		return SkipDirectiveOperands(inOutCoordinate);
+	}
+
+	ArrayView<const uint8_t> name;
+	CHECK_RV(bool, isDefined, EvaluateIfDefName(contents, inOutCoordinate, name));
+	CHECK(m_includeStackTop->PushLogic(PreprocessorLogicStack(blameCoord, isDefined ? PreprocessorLogicState::kActive : PreprocessorLogicState::kNotYetActive)));
 
 	return ErrorCode::kOK;
 }
 
 expanse::Result expanse::cc::CPreprocessor::ProcessIfNDefDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
 {
+	const FileCoordinate blameCoord = inOutCoordinate;
+
 	if (!m_includeStackTop->IsInActivePreprocessorBlock())
 	{
-		CHECK(m_includeStackTop->PushLogic(PreprocessorLogicStack(inOutCoordinate, PreprocessorLogicState::kDisabled)));
-		CHECK(SkipLine());
-		return ErrorCode::kOK;
+		m_includeStackTop->NoteIncludeGuardContent();
+
+		CHECK(m_includeStackTop->PushLogic(PreprocessorLogicStack(blameCoord, PreprocessorLogicState::kDisabled)));
+		return SkipDirectiveOperands(inOutCoordinate);
 	}
 
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+	ArrayView<const uint8_t> name;
+	CHECK_RV(bool, isDefined, EvaluateIfDefName(contents, inOutCoordinate, name));
+	CHECK(m_includeStackTop->PushLogic(PreprocessorLogicStack(blameCoord, isDefined ? PreprocessorLogicState::kNotYetActive : PreprocessorLogicState::kActive)));
+
+	m_includeStackTop->NoteIncludeGuardIfNDef(name);
 
 	return ErrorCode::kOK;
 }
@@ -683,16 +1038,21 @@ expanse::Result expanse::cc::CPreprocessor::ProcessElifDirective(const ArrayView
 		return ErrorCode::kOperationFailed;
 	}
 
+	m_includeStackTop->NoteIncludeGuardElse();
+
 	if (topLogic->m_state == PreprocessorLogicState::kNotYetActive)
 	{
-		topLogic->m_state = PreprocessorLogicState::kDisabled;
-		CHECK(SkipLine());
+		CHECK_RV(bool, isTrue, EvaluateCondition(inOutCoordinate, inOutCoordinate));
+		if (isTrue)
+			topLogic->m_state = PreprocessorLogicState::kActive;
+
 		return ErrorCode::kOK;
 	}
 
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+	// Either an earlier branch was taken or the whole block is inside an inactive one, so the condition isn't evaluated
+	topLogic->m_state = PreprocessorLogicState::kDisabled;
 
-	return ErrorCode::kOK;
+	return SkipDirectiveOperands(inOutCoordinate);
 }
 
 expanse::Result expanse::cc::CPreprocessor::ProcessElseDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate)
@@ -711,6 +1071,7 @@ expanse::Result expanse::cc::CPreprocessor::ProcessElseDirective(const ArrayView
 	}
 
 	topLogic->m_elseEncountered = true;
+	m_includeStackTop->NoteIncludeGuardElse();
 
 	if (topLogic->m_state == PreprocessorLogicState::kActive)
 		topLogic->m_state = PreprocessorLogicState::kDisabled;
@@ -740,7 +1101,7 @@ expanse::Result expanse::cc::CPreprocessor::ProcessEndIfDirective(const ArrayVie
 		return ErrorCode::kOperationFailed;
 	}
 
-	m_includeStackTop->PopLogic();
+	CHECK(m_includeStackTop->PopLogic());
 
 	ArrayView<const uint8_t> token;
 	CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
@@ -757,11 +1118,10 @@ expanse::Result expanse::cc::CPreprocessor::ProcessEndIfDirective(const ArrayVie
 }
 
 
-expanse::ResultRV<expanse::ArrayPtr<expanse::cc::CPreprocessor::PPToken>> expanse::cc::CPreprocessor::ParseTokenSequence(FileCoordinate &inOutCoordinate)
+expanse::Result expanse::cc::CPreprocessor::LexLineTokens(FileCoordinate &inOutCoordinate, Vector<PPMacroToken> &tokens, bool &outTrailingSpace)
 {
-	IAllocator *alloc = GetCoreObjectAllocator();
 	ArrayView<const uint8_t> contents = m_includeStackTop->GetFileContents();
-	Vector<PPToken> ppTokens(alloc);
+	uint8_t pendingFlags = 0;
 
 	for (;;)
 	{
@@ -776,103 +1136,98 @@ expanse::ResultRV<expanse::ArrayPtr<expanse::cc::CPreprocessor::PPToken>> expans
 		if (tokenType == CLexer::TokenType::kInvalid)
 			return ErrorCode::kOperationFailed;
 
-		PPToken ppToken;
-		ppToken.m_isWhitespace = (tokenType == CLexer::TokenType::kWhitespace);
-		ppToken.m_token = token;
+		if (tokenType == CLexer::TokenType::kWhitespace)
+		{
+			pendingFlags = PPMacroToken::kFlagLeadingSpace;
+			continue;
+		}
+
+		if (tokenType == CLexer::TokenType::kIdentifier)
+			pendingFlags |= PPMacroToken::kFlagIdentifier;
 
-		CHECK(ppTokens.Add(ppToken));
+		CHECK(tokens.Add(PPMacroToken(token, CLexer::ClassifyToken(token, tokenType), pendingFlags)));
+		pendingFlags = 0;
 	}
 
-	const size_t numTokens = ppTokens.Size();
-	CHECK_RV(ArrayPtr<PPToken>, flattenedTokens, NewArray<PPToken>(alloc, numTokens));
-
-	for (size_t i = 0; i < numTokens; i++)
-		flattenedTokens[i] = ppTokens[i];
+	outTrailingSpace = (pendingFlags != 0);
 
-	return std::move(flattenedTokens);
+	return ErrorCode::kOK;
 }
 
-expanse::ResultRV<expanse::cc::CPreprocessor::PPTokenCollection> expanse::cc::CPreprocessor::CanonicalizeTokenSequence(const ArrayView<const PPToken> &ppTokens)
+expanse::ResultRV<bool> expanse::cc::CPreprocessor::EvaluateCondition(const FileCoordinate &blameCoordinate, FileCoordinate &inOutCoordinate)
 {
-	size_t totalLength = 0;
-	for (size_t i = 0; i < ppTokens.Size(); i++)
-	{
-		const PPToken &token = ppTokens[i];
-		size_t canonicalLength = 0;
-		if (token.m_isWhitespace)
-			canonicalLength = 1;
-		else
-			canonicalLength = token.m_token.Size();
+	IAllocator *alloc = GetCoreObjectAllocator();
 
-		if (std::numeric_limits<size_t>::max() - totalLength < canonicalLength)
-			return ErrorCode::kOutOfMemory;
+	Vector<PPMacroToken> tokens(alloc);
+	bool trailingSpace = false;
+	CHECK(LexLineTokens(inOutCoordinate, tokens, trailingSpace));
 
-		totalLength += canonicalLength;
+	if (m_conditionCache == nullptr)
+	{
+		CHECK_RV(bool, isTrue, m_conditionEvaluator.Evaluate(blameCoordinate, tokens.ConstView(), nullptr));
+		m_macroExpander.ResetScratch();
+		return isTrue;
 	}
 
-	CHECK_RV(ArrayPtr<uint8_t>, tokenContents, NewArrayUninitialized<uint8_t>(GetCoreObjectAllocator(), totalLength));
-	CHECK_RV(ArrayPtr<ArrayView<const uint8_t>>, tokens, NewArray<ArrayView<const uint8_t>>(GetCoreObjectAllocator(), ppTokens.Size()));
+	// The cache key is the condition as it's spelled, so that it doesn't depend on how it was spaced out
+	if (tokens.Size() > 0)
+		tokens[0].m_flags &= ~PPMacroToken::kFlagLeadingSpace;
 
-	size_t writeOffset = 0;
-	for (size_t i = 0; i < ppTokens.Size(); i++)
-	{
-		const PPToken &token = ppTokens[i];
+	Vector<uint8_t> condition(alloc);
+	CHECK(PPMacroExpander::AppendSpellings(tokens.ConstView(), condition));
 
-		if (token.m_isWhitespace)
-		{
-			tokenContents[writeOffset] = CharCode::kSpace;
-			tokens[i] = tokenContents.ConstView().Subrange(writeOffset, 1);
-			writeOffset++;
-		}
-		else
-		{
-			const size_t tokenSize = token.m_token.Size();
-			if (tokenSize > 0)
-				memcpy(&tokenContents[writeOffset], &token.m_token[0], tokenSize);
+	bool cachedValue = false;
+	CHECK_RV(bool, isCached, m_conditionCache->Lookup(condition.ConstView(), m_macros, cachedValue));
+	if (isCached)
+		return cachedValue;
 
-			tokens[i] = tokenContents.ConstView().Subrange(writeOffset, tokenSize);
-			writeOffset += tokenSize;
-		}
-	}
+	Vector<PPMacroDependency> dependencies(alloc);
+	CHECK_RV(bool, isTrue, m_conditionEvaluator.Evaluate(blameCoordinate, tokens.ConstView(), &dependencies));
 
-	return PPTokenCollection(std::move(tokenContents), std::move(tokens));
+	// Dependency names can be in scratch memory, the cache copies them first
+	CHECK(m_conditionCache->Add(condition.ConstView(), dependencies.ConstView(), isTrue));
+	m_macroExpander.ResetScratch();
+
+	return isTrue;
 }
 
-expanse::Result expanse::cc::CPreprocessor::ExpandTokenSequence(PPTokenCollection &tokenSequence)
+expanse::ResultRV<bool> expanse::cc::CPreprocessor::EvaluateIfDefName(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate, ArrayView<const uint8_t> &outName)
 {
-	bool haveAnyMacros = false;
-	size_t firstMacroIndex = 0;
-
-	const ArrayView<const ArrayView<const uint8_t>> tokens = tokenSequence.GetTokens();
-
-	const size_t numTokens = tokens.Size();
-	for (size_t i = 0; i < numTokens; i++)
+	ArrayView<const uint8_t> name;
+	CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
+	if (!CLexer::TryGetToken(contents, inOutCoordinate, true, false, m_includeStackTrace, m_errorReporter, true, false, name, tokenType, inOutCoordinate) || tokenType != CLexer::TokenType::kIdentifier)
 	{
-		const ArrayView<const uint8_t> token = tokens[i];
-		if (IsIdentifier(token))
-		{
-			const TokenStrView tokenStr(token);
+		m_errorReporter->ReportError(inOutCoordinate, m_includeStackTrace, CompilationErrorCode::kPPExpectedMacroName);
+		return ErrorCode::kOperationFailed;
+	}
 
-			if (m_functionLikeMacros.Contains(tokenStr) || m_objectLikeMacros.Contains(tokenStr))
-			{
-				haveAnyMacros = true;
-				firstMacroIndex = i;
-				break;
-			}
-		}
+	ArrayView<const uint8_t> token;
+	if (CLexer::TryGetToken(contents, inOutCoordinate, true, false, m_includeStackTrace, m_errorReporter, true, false, token, tokenType, inOutCoordinate) && tokenType != CLexer::TokenType::kNewLine)
+	{
+		m_errorReporter->ReportError(inOutCoordinate, m_includeStackTrace, CompilationErrorCode::kPPExpectedNewLineAfterIfDef);
+		return ErrorCode::kOperationFailed;
 	}
 
-	if (!haveAnyMacros)
-		return ErrorCode::kOK;
+	outName = name;
 
-	IAllocator *alloc = GetCoreObjectAllocator();
+	return m_macros.Find(name) != nullptr;
+}
 
-	Vector<uint8_t> newTokens(alloc);
-	Vector<Subrange> newTokenRanges(alloc);
+expanse::Result expanse::cc::CPreprocessor::SkipDirectiveOperands(FileCoordinate &inOutCoordinate)
+{
+	ArrayView<const uint8_t> contents = m_includeStackTop->GetFileContents();
+	ArrayView<const uint8_t> token;
+	CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
+	while (CLexer::TryGetToken(contents, inOutCoordinate, true, false, m_includeStackTrace, m_errorReporter, true, false, token, tokenType, inOutCoordinate))
+	{
+		if (tokenType == CLexer::TokenType::kInvalid)
+			return ErrorCode::kOperationFailed;
 
-	EXP_ASSERT(false);	// NOT YET IMPLEMENTED
+		if (tokenType == CLexer::TokenType::kNewLine)
+			break;
+	}
 
-	return ErrorCode::kNotImplemented;
+	return ErrorCode::kOK;
 }
 
 expanse::Result expanse::cc::CPreprocessor::SplitToPathComponents(Vector<ArrayView<const uint8_t>> &components, const ArrayView<const uint8_t> &pathRef) const
@@ -905,35 +1260,68 @@ expanse::Result expanse::cc::CPreprocessor::SplitToPathComponents(Vector<ArrayVi
 	return ErrorCode::kOK;
 }
 
-expanse::Result expanse::cc::CPreprocessor::StartIncluding(const FileCoordinate &blameLocation, const ArrayView<const uint8_t> &tokenRef)
+expanse::Result expanse::cc::CPreprocessor::StartIncluding(const FileCoordinate &blameLocation, const ArrayView<const uint8_t> &token)
 {
-	IAllocator *alloc = GetCoreObjectAllocator();
+	UTF8StringView_t currentDevice;
+	UTF8StringView_t currentPath;
+	m_includeStackTop->GetFileName(currentDevice, currentPath);
 
-	const ArrayView<const uint8_t> token = tokenRef;
+	IncludePathResolution resolution = IncludePathResolution::kInvalid;
+	UTF8String_t pathBeingResolved;
+	bool isSystemPath = false;
+	bool isLocalOnly = false;
+	CHECK(ResolveIncludePath(token, currentPath, resolution, pathBeingResolved, isSystemPath, isLocalOnly));
 
-	if (token.Size() < 2 || (token[0] != CharCode::kDoubleQuote && token[0] != CharCode::kLess))
+	if (resolution == IncludePathResolution::kEscapesDirectoryTree)
+	{
+		m_errorReporter->ReportError(blameLocation, m_includeStackTrace, CompilationErrorCode::kIncludePathEscapesDirectoryTree);
+		return ErrorCode::kOperationFailed;
+	}
+
+	if (resolution != IncludePathResolution::kResolved)
 	{
 		m_errorReporter->ReportError(blameLocation, m_includeStackTrace, CompilationErrorCode::kInvalidIncludePath);
 		return ErrorCode::kOperationFailed;
 	}
 
+	m_pathBeingResolved = std::move(pathBeingResolved);
+
+	if (isSystemPath)
+		m_state = State::kLoadingSystemDirsFile;
+	else if (isLocalOnly)
+		m_state = State::kLoadingLocalOnlyFile;
+	else
+		m_state = State::kLoadingLocalBeforeIncludeDirsFile;
+
+	m_pathResolutionIndex = 0;
+
+	CHECK(EnterLoadingState());
+
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::ResolveIncludePath(const ArrayView<const uint8_t> &tokenRef, const UTF8StringView_t &currentPath, IncludePathResolution &outResolution, UTF8String_t &outPath, bool &outIsSystemPath, bool &outIsLocalOnly) const
+{
+	IAllocator *alloc = GetCoreObjectAllocator();
+
+	const ArrayView<const uint8_t> token = tokenRef;
+
+	outResolution = IncludePathResolution::kInvalid;
+
+	if (token.Size() < 2 || (token[0] != CharCode::kDoubleQuote && token[0] != CharCode::kLess))
+		return ErrorCode::kOK;
+
 	const bool isSystemPath = (token[0] == CharCode::kLess);
 
 	if (isSystemPath)
 	{
 		if (token[token.Size() - 1] != CharCode::kGreater)
-		{
-			m_errorReporter->ReportError(blameLocation, m_includeStackTrace, CompilationErrorCode::kInvalidIncludePath);
-			return ErrorCode::kOperationFailed;
-		}
+			return ErrorCode::kOK;
 	}
 	else
 	{
 		if (token[token.Size() - 1] != CharCode::kDoubleQuote)
-		{
-			m_errorReporter->ReportError(blameLocation, m_includeStackTrace, CompilationErrorCode::kInvalidIncludePath);
-			return ErrorCode::kOperationFailed;
-		}
+			return ErrorCode::kOK;
 	}
 
 	const ArrayView<const uint8_t> includePath = token.Subrange(1, token.Size() - 2);
@@ -969,10 +1357,6 @@ expanse::Result expanse::cc::CPreprocessor::StartIncluding(const FileCoordinate
 						{
 							convertedToLocalPath = true;
 
-							UTF8StringView_t currentDevice;
-							UTF8StringView_t currentPath;
-							m_includeStackTop->GetFileName(currentDevice, currentPath);
-
 							CHECK(SplitToPathComponents(resolvedPathComponents, currentPath.GetChars()));
 
 							if (resolvedPathComponents.Size() < 2)
@@ -984,8 +1368,8 @@ expanse::Result expanse::cc::CPreprocessor::StartIncluding(const FileCoordinate
 
 					if (escapedTree)
 					{
-						m_errorReporter->ReportError(blameLocation, m_includeStackTrace, CompilationErrorCode::kIncludePathEscapesDirectoryTree);
-						return ErrorCode::kOperationFailed;
+						outResolution = IncludePathResolution::kEscapesDirectoryTree;
+						return ErrorCode::kOK;
 					}
 				}
 				else
@@ -1008,10 +1392,7 @@ expanse::Result expanse::cc::CPreprocessor::StartIncluding(const FileCoordinate
 		isValid = false;
 
 	if (!isValid)
-	{
-		m_errorReporter->ReportError(blameLocation, m_includeStackTrace, CompilationErrorCode::kInvalidIncludePath);
-		return ErrorCode::kOperationFailed;
-	}
+		return ErrorCode::kOK;
 
 	size_t maxRemaining = std::numeric_limits<size_t>::max();
 
@@ -1049,128 +1430,428 @@ expanse::Result expanse::cc::CPreprocessor::StartIncluding(const FileCoordinate
 
 	combinedPath[mergeOffset - 1] = 0;
 
-	CHECK_RV(UTF8String_t, pathBeingResolved, UTF8String_t::CreateFromZeroTerminatedArray(std::move(combinedPath)));
-	m_pathBeingResolved = std::move(pathBeingResolved);
+	CHECK_RV(UTF8String_t, resolvedPath, UTF8String_t::CreateFromZeroTerminatedArray(std::move(combinedPath)));
 
-	if (isSystemPath)
-		m_state = State::kLoadingSystemDirsFile;
-	else if (convertedToLocalPath)
-		m_state = State::kLoadingLocalOnlyFile;
-	else
-		m_state = State::kLoadingLocalBeforeIncludeDirsFile;
+	outPath = std::move(resolvedPath);
+	outIsSystemPath = isSystemPath;
+	outIsLocalOnly = convertedToLocalPath;
+	outResolution = IncludePathResolution::kResolved;
 
-	m_pathResolutionIndex = 0;
+	return ErrorCode::kOK;
+}
 
-	CHECK(EnterLoadingState());
+expanse::Result expanse::cc::CPreprocessor::CombineIncludePath(const ArrayView<const uint8_t> &directory, const UTF8StringView_t &relativePath, UTF8String_t &outPath) const
+{
+	size_t limitCheck = std::numeric_limits<size_t>::max() - directory.Size();
+
+	if (limitCheck < relativePath.Length())
+		return ErrorCode::kOutOfMemory;
+	limitCheck -= relativePath.Length();
+
+	if (limitCheck < 1)
+		return ErrorCode::kOutOfMemory;
+	limitCheck -= 1;
+
+	CHECK_RV(ArrayPtr<uint8_t>, combinedPath, NewArray<uint8_t>(GetCoreObjectAllocator(), directory.Size() + relativePath.Length() + 1));
+	if (directory.Size() > 0)
+		memcpy(&combinedPath[0], &directory[0], directory.Size());
+
+	memcpy(&combinedPath[directory.Size()], &relativePath.GetChars()[0], relativePath.Length());
+
+	combinedPath[directory.Size() + relativePath.Length()] = 0;
+
+	CHECK_RV(UTF8String_t, resolvedPath, UTF8String_t::CreateFromZeroTerminatedArray(std::move(combinedPath)));
+	outPath = std::move(resolvedPath);
 
 	return ErrorCode::kOK;
 }
 
-expanse::Result expanse::cc::CPreprocessor::EnterLoadingState()
+expanse::ArrayView<const uint8_t> expanse::cc::CPreprocessor::GetParentDirectory(const UTF8StringView_t &path)
 {
-	UTF8StringView_t device;
-	ArrayView<const uint8_t> currentPathChars;
+	const ArrayView<const uint8_t> pathChars = path.GetChars();
 
-	if (m_state == State::kLoadingLocalOnlyFile)
+	size_t parentPathOffset = 0;
+	for (size_t i = 0; i < path.Length(); i++)
 	{
-		UTF8StringView_t currentDevice;
-		UTF8StringView_t currentPath;
-		m_includeStackTop->GetFileName(currentDevice, currentPath);
-
-		currentPathChars = m_pathBeingResolved.GetChars();
-		device = currentDevice;
+		if (pathChars[i] == CharCode::kSlash)
+			parentPathOffset = i + 1;
 	}
-	else
+
+	return pathChars.Subrange(0, parentPathOffset);
+}
+
+expanse::Result expanse::cc::CPreprocessor::EnterLoadingState()
+{
+	UTF8StringView_t device;
+	ArrayView<const uint8_t> currentPathChars;
+
+	switch (m_state)
 	{
-		switch (m_state)
+	case State::kLoadingLocalOnlyFile:
 		{
-		case State::kLoadingLocalBeforeIncludeDirsFile:
-			{
-				UTF8StringView_t currentDevice;
-				UTF8StringView_t currentPath;
-				m_includeStackTop->GetFileName(currentDevice, currentPath);
+			// The path being resolved was already rebased onto the current file's directory
+			UTF8StringView_t currentDevice;
+			UTF8StringView_t currentPath;
+			m_includeStackTop->GetFileName(currentDevice, currentPath);
 
-				currentPathChars = currentPath.GetChars();
+			device = currentDevice;
+		}
+		break;
+	case State::kLoadingLocalBeforeIncludeDirsFile:
+		{
+			UTF8StringView_t currentDevice;
+			UTF8StringView_t currentPath;
+			m_includeStackTop->GetFileName(currentDevice, currentPath);
 
-				size_t parentPathOffset = 0;
-				for (size_t i = 0; i < currentPath.Length(); i++)
-				{
-					if (currentPathChars[i] == CharCode::kSlash)
-						parentPathOffset = i + 1;
-				}
+			currentPathChars = GetParentDirectory(currentPath);
+			device = currentDevice;
+		}
+		break;
+	case State::kLoadingIncludeDirsFile:
+	case State::kLoadingSystemDirsFile:
+		{
+			const Vector<IncludePath> *includePathsPtr = nullptr;
+			if (m_state == State::kLoadingIncludeDirsFile)
+				includePathsPtr = &m_nonSystemIncludePaths;
+			else if (m_state == State::kLoadingSystemDirsFile)
+				includePathsPtr = &m_systemIncludePaths;
+			else
+			{
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			}
 
-				currentPathChars = currentPathChars.Subrange(0, parentPathOffset);
-				device = currentDevice;
+			const Vector<IncludePath> &includePaths = *includePathsPtr;
+
+			if (m_pathResolutionIndex == includePaths.Size())
+			{
+				m_errorReporter->ReportError(m_includeStackTop->GetFileCoordinate(), m_includeStackTrace, CompilationErrorCode::kIncludeNotFound);
+				return ErrorCode::kOperationFailed;
 			}
-			break;
-		case State::kLoadingIncludeDirsFile:
-		case State::kLoadingSystemDirsFile:
+			else if (m_pathResolutionIndex > includePaths.Size())
 			{
-				const Vector<IncludePath> *includePathsPtr = nullptr;
-				if (m_state == State::kLoadingIncludeDirsFile)
-					includePathsPtr = &m_nonSystemIncludePaths;
-				else if (m_state == State::kLoadingSystemDirsFile)
-					includePathsPtr = &m_systemIncludePaths;
-				else
-				{
-					EXP_ASSERT(false);
-					return ErrorCode::kInternalError;
-				}
+				EXP_ASSERT(false);
+				return ErrorCode::kInternalError;
+			}
+			else
+			{
+				// AdvanceToNextIncludePath moves the index along
+				const IncludePath &includePath = includePaths[m_pathResolutionIndex];
+				device = includePath.m_device;
+				currentPathChars = includePath.m_path.GetChars();
+			}
+		}
+		break;
+	default:
+		EXP_ASSERT(false);
+		return ErrorCode::kInternalError;
+	};
 
-				const Vector<IncludePath> &includePaths = *includePathsPtr;
+	UTF8String_t resolvedPath;
+	CHECK(CombineIncludePath(currentPathChars, m_pathBeingResolved, resolvedPath));
 
-				if (m_pathResolutionIndex == includePaths.Size())
-				{
-					m_errorReporter->ReportError(m_includeStackTop->GetFileCoordinate(), m_includeStackTrace, CompilationErrorCode::kIncludeNotFound);
-					return ErrorCode::kOperationFailed;
-				}
-				else if (m_pathResolutionIndex > includePaths.Size())
-				{
-					EXP_ASSERT(false);
-					return ErrorCode::kInternalError;
-				}
-				else
-				{
-					const IncludePath &includePath = includePaths[m_pathResolutionIndex++];
-					device = includePath.m_device;
-					currentPathChars = includePath.m_path.GetChars();
-				}
+	CHECK(RetrieveFile(device, resolvedPath));
+
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::RetrieveFile(const UTF8StringView_t &device, const UTF8StringView_t &path)
+{
+	if (m_fileCache)
+	{
+		IAllocator *alloc = GetCoreObjectAllocator();
+
+		CHECK(CollectFinishedPrefetches());
+
+		// Checked first so that the contents of a guarded file aren't even copied
+		CHECK_RV(bool, isGuarded, IsIncludeGuarded(device, path));
+		if (isGuarded)
+		{
+			m_state = State::kProcessing;
+			return ErrorCode::kOK;
+		}
+
+		ArrayPtr<uint8_t> contents;
+		CHECK_RV(FileCacheLookupResult, lookupResult, m_fileCache->Lookup(alloc, device, path, contents));
+
+		switch (lookupResult)
+		{
+		case FileCacheLookupResult::kFound:
+			{
+				// Don't push here, the including file's coordinate hasn't been committed yet
+				CHECK_RV(UTF8String_t, deviceCopy, device.CloneToString(alloc));
+				CHECK_RV(UTF8String_t, pathCopy, path.CloneToString(alloc));
+
+				m_cachedFileContents = std::move(contents);
+				m_cachedFileDevice = std::move(deviceCopy);
+				m_cachedFilePath = std::move(pathCopy);
+				m_haveCachedFile = true;
+
+				return ErrorCode::kOK;
 			}
+		case FileCacheLookupResult::kNotFound:
+			return AdvanceToNextIncludePath();
+		case FileCacheLookupResult::kNotCached:
 			break;
 		default:
 			EXP_ASSERT(false);
 			return ErrorCode::kInternalError;
-		};
+		}
 
-		size_t limitCheck = std::numeric_limits<size_t>::max() - currentPathChars.Size();
+		// Still in flight from the prefetch pass, take it over instead of loading the file again
+		CorePtr<AsyncFileRequest> prefetchRequest;
+		CHECK(TakePendingPrefetch(device, path, prefetchRequest));
+		if (prefetchRequest)
+		{
+			prefetchRequest->Promote(AsyncFileRequestPriority::kBlocking);
+			m_currentFileRequest = std::move(prefetchRequest);
 
-		if (limitCheck < m_pathBeingResolved.Length())
-			return ErrorCode::kOutOfMemory;
-		limitCheck -= m_pathBeingResolved.Length();
+			return ErrorCode::kOK;
+		}
+	}
 
-		if (limitCheck < 1)
-			return ErrorCode::kOutOfMemory;
-		limitCheck -= 1;
+	CHECK_RV(CorePtr<AsyncFileRequest>, request, this->m_afs->Retrieve(device, path, AsyncFileRequestPriority::kBlocking, ConvertLineBreaks));
+	m_currentFileRequest = std::move(request);
+
+	return ErrorCode::kOK;
+}
+
+expanse::ResultRV<bool> expanse::cc::CPreprocessor::IsIncludeGuarded(const UTF8StringView_t &device, const UTF8StringView_t &path)
+{
+	// The root file is never skipped
+	if (m_includeStackTop == nullptr)
+		return false;
+
+	bool isMacroDefined = false;
+	CHECK_RV(FileCacheIncludeGuard, includeGuard, m_fileCache->LookupIncludeGuard(device, path, m_macros, isMacroDefined));
+
+	switch (includeGuard)
+	{
+	case FileCacheIncludeGuard::kUnknown:
+		return false;
+	case FileCacheIncludeGuard::kMacro:
+		return isMacroDefined;
+	case FileCacheIncludeGuard::kPragmaOnce:
+		{
+			CHECK_RV(TokenStrView, canonicalName, InternCanonicalFileName(device, path));
+
+			const size_t fileIndex = canonicalName.GetAtom().GetIndex();
+			return fileIndex < m_pragmaOnceFiles.Size() && m_pragmaOnceFiles[fileIndex] != 0;
+		}
+	default:
+		EXP_ASSERT(false);
+		return ErrorCode::kInternalError;
+	}
+}
+
+expanse::ResultRV<expanse::cc::TokenStrView> expanse::cc::CPreprocessor::InternCanonicalFileName(const UTF8StringView_t &device, const UTF8StringView_t &path)
+{
+	Vector<uint8_t> canonicalNameBuilder(GetCoreObjectAllocator());
+	CHECK(canonicalNameBuilder.Add(device.GetChars()));
+
+	const uint8_t divider[] = { CharCode::kColon, CharCode::kSlash, CharCode::kSlash };
+	CHECK(canonicalNameBuilder.Add(ArrayView<const uint8_t>(divider)));
+
+	CHECK(canonicalNameBuilder.Add(path.GetChars()));
+
+	return m_traceInfo->InternFileName(canonicalNameBuilder.ConstView());
+}
+
+expanse::Result expanse::cc::CPreprocessor::PrefetchIncludes(const ArrayView<const uint8_t> &contentsRef, const UTF8StringView_t &device, const UTF8StringView_t &path)
+{
+	if (!m_fileCache)
+		return ErrorCode::kOK;
+
+	const ArrayView<const uint8_t> contents = contentsRef;
+
+	size_t lineStart = 0;
+	while (lineStart < contents.Size())
+	{
+		size_t lineEnd = lineStart;
+		while (lineEnd < contents.Size() && contents[lineEnd] != CharCode::kLineFeed)
+			lineEnd++;
+
+		ArrayView<const uint8_t> token;
+		if (TryScanIncludeDirective(contents.Subrange(lineStart, lineEnd - lineStart), token))
+			CHECK(PrefetchInclude(token, device, path));
+
+		lineStart = lineEnd + 1;
+	}
 
-		CHECK_RV(ArrayPtr<uint8_t>, combinedPath, NewArray<uint8_t>(GetCoreObjectAllocator(), currentPathChars.Size() + m_pathBeingResolved.Length() + 1));
-		if (currentPathChars.Size() > 0)
-			memcpy(&combinedPath[0], &currentPathChars[0], currentPathChars.Size());
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::PrefetchInclude(const ArrayView<const uint8_t> &token, const UTF8StringView_t &device, const UTF8StringView_t &path)
+{
+	IncludePathResolution resolution = IncludePathResolution::kInvalid;
+	UTF8String_t pathBeingResolved;
+	bool isSystemPath = false;
+	bool isLocalOnly = false;
+	CHECK(ResolveIncludePath(token, path, resolution, pathBeingResolved, isSystemPath, isLocalOnly));
+
+	// Bad paths get reported when the directive is actually processed
+	if (resolution != IncludePathResolution::kResolved)
+		return ErrorCode::kOK;
 
-		memcpy(&combinedPath[currentPathChars.Size()], &m_pathBeingResolved.GetChars()[0], m_pathBeingResolved.Length());
+	if (isLocalOnly)
+		return IssuePrefetch(device, pathBeingResolved);
 
-		combinedPath[currentPathChars.Size() + m_pathBeingResolved.Length()] = 0;
+	// Probe every place the include could resolve to at once instead of one after another
+	if (!isSystemPath)
+	{
+		UTF8String_t candidatePath;
+		CHECK(CombineIncludePath(GetParentDirectory(path), pathBeingResolved, candidatePath));
+		CHECK(IssuePrefetch(device, candidatePath));
+	}
 
-		CHECK_RV(UTF8String_t, resolvedPath, UTF8String_t::CreateFromZeroTerminatedArray(std::move(combinedPath)));
-			
-		CHECK_RV(CorePtr<AsyncFileRequest>, request, this->m_afs->Retrieve(device, resolvedPath));
-		m_currentFileRequest = std::move(request);
+	const Vector<IncludePath> &includePaths = isSystemPath ? m_systemIncludePaths : m_nonSystemIncludePaths;
+	for (size_t i = 0; i < includePaths.Size(); i++)
+	{
+		const IncludePath &includePath = includePaths[i];
+
+		UTF8String_t candidatePath;
+		CHECK(CombineIncludePath(includePath.m_path.GetChars(), pathBeingResolved, candidatePath));
+		CHECK(IssuePrefetch(includePath.m_device, candidatePath));
+	}
 
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::IssuePrefetch(const UTF8StringView_t &device, const UTF8StringView_t &path)
+{
+	if (m_pendingPrefetches.Size() >= kMaxPendingPrefetches)
 		return ErrorCode::kOK;
+
+	for (size_t i = 0; i < m_pendingPrefetches.Size(); i++)
+	{
+		const PendingPrefetch &prefetch = m_pendingPrefetches[i];
+		if (prefetch.m_device == device && prefetch.m_path == path)
+			return ErrorCode::kOK;
 	}
 
+	CHECK_RV(bool, isCached, m_fileCache->Contains(device, path));
+	if (isCached)
+		return ErrorCode::kOK;
+
+	IAllocator *alloc = GetCoreObjectAllocator();
+
+	PendingPrefetch prefetch;
+	CHECK_RV(UTF8String_t, deviceCopy, device.CloneToString(alloc));
+	CHECK_RV(UTF8String_t, pathCopy, path.CloneToString(alloc));
+	CHECK_RV(CorePtr<AsyncFileRequest>, request, m_afs->Retrieve(device, path, AsyncFileRequestPriority::kSpeculative, ConvertLineBreaks));
+
+	prefetch.m_device = std::move(deviceCopy);
+	prefetch.m_path = std::move(pathCopy);
+	prefetch.m_request = std::move(request);
+
+	CHECK(m_pendingPrefetches.Add(std::move(prefetch)));
+
 	return ErrorCode::kOK;
 }
 
+expanse::Result expanse::cc::CPreprocessor::CollectFinishedPrefetches()
+{
+	size_t numRemaining = 0;
+	for (size_t i = 0; i < m_pendingPrefetches.Size(); i++)
+	{
+		PendingPrefetch &prefetch = m_pendingPrefetches[i];
+
+		if (prefetch.m_request->IsFinished())
+		{
+			const ErrorCode errorCode = prefetch.m_request->GetErrorCode();
+			if (errorCode == ErrorCode::kOK)
+			{
+				ArrayPtr<uint8_t> results(prefetch.m_request->TakeResult());
+
+				CHECK(m_fileCache->AddFile(prefetch.m_device, prefetch.m_path, results.ConstView()));
+			}
+			else if (errorCode == ErrorCode::kFileNotFound)
+				CHECK(m_fileCache->AddMissingFile(prefetch.m_device, prefetch.m_path));
+
+			// Any other failure is left for the blocking load to run into and report
+			continue;
+		}
+
+		if (numRemaining != i)
+			m_pendingPrefetches[numRemaining] = std::move(prefetch);
+
+		numRemaining++;
+	}
+
+	CHECK(m_pendingPrefetches.Resize(numRemaining));
+
+	return ErrorCode::kOK;
+}
+
+expanse::Result expanse::cc::CPreprocessor::TakePendingPrefetch(const UTF8StringView_t &device, const UTF8StringView_t &path, CorePtr<AsyncFileRequest> &outRequest)
+{
+	const size_t numPrefetches = m_pendingPrefetches.Size();
+
+	for (size_t i = 0; i < numPrefetches; i++)
+	{
+		PendingPrefetch &prefetch = m_pendingPrefetches[i];
+		if (prefetch.m_device == device && prefetch.m_path == path)
+		{
+			outRequest = std::move(prefetch.m_request);
+
+			if (i != numPrefetches - 1)
+				prefetch = std::move(m_pendingPrefetches[numPrefetches - 1]);
+
+			CHECK(m_pendingPrefetches.Resize(numPrefetches - 1));
+
+			return ErrorCode::kOK;
+		}
+	}
+
+	return ErrorCode::kOK;
+}
+
+bool expanse::cc::CPreprocessor::TryScanIncludeDirective(const ArrayView<const uint8_t> &lineRef, ArrayView<const uint8_t> &outToken)
+{
+	const ArrayView<const uint8_t> line = lineRef;
+	const size_t lineLength = line.Size();
+
+	size_t offset = 0;
+	while (offset < lineLength && (line[offset] == CharCode::kSpace || line[offset] == CharCode::kTab))
+		offset++;
+
+	if (offset == lineLength || line[offset] != CharCode::kHash)
+		return false;
+	offset++;
+
+	while (offset < lineLength && (line[offset] == CharCode::kSpace || line[offset] == CharCode::kTab))
+		offset++;
+
+	if (lineLength - offset < 7 || !TokenEquals(line.Subrange(offset, 7), "include"))
+		return false;
+	offset += 7;
+
+	while (offset < lineLength && (line[offset] == CharCode::kSpace || line[offset] == CharCode::kTab))
+		offset++;
+
+	if (offset == lineLength)
+		return false;
+
+	uint8_t terminator = 0;
+	if (line[offset] == CharCode::kDoubleQuote)
+		terminator = CharCode::kDoubleQuote;
+	else if (line[offset] == CharCode::kLess)
+		terminator = CharCode::kGreater;
+	else
+		return false;
+
+	for (size_t end = offset + 1; end < lineLength; end++)
+	{
+		if (line[end] == terminator)
+		{
+			outToken = line.Subrange(offset, end + 1 - offset);
+			return true;
+		}
+	}
+
+	return false;
+}
+
 expanse::Result expanse::cc::CPreprocessor::SkipLine()
 {
 	IncludeStack *f = m_includeStackTop;
@@ -1193,6 +1874,155 @@ expanse::Result expanse::cc::CPreprocessor::SkipLine()
 	return ErrorCode::kOK;
 }
 
+expanse::ResultRV<bool> expanse::cc::CPreprocessor::SkipInactiveLines()
+{
+	IncludeStack *f = m_includeStackTop;
+
+	FileCoordinate coord = f->GetFileCoordinate();
+
+	size_t numLineBreaks = 0;
+	const size_t endOffset = ScanInactiveLines(f->GetFileContents(), coord.m_fileOffset, numLineBreaks);
+
+	if (numLineBreaks == 0)
+		return false;
+
+	// Every skipped line still gets an empty output line so that the trace lines up
+	CHECK(m_traceInfo->AddLineRun(&m_includeStackTrace, numLineBreaks));
+	CHECK(WriteLineBreaks(numLineBreaks));
+
+	coord.m_fileOffset = endOffset;
+	f->SetFileCoordinate(coord);
+
+	return true;
+}
+
+expanse::Result expanse::cc::CPreprocessor::WriteLineBreaks(size_t numLineBreaks)
+{
+	uint8_t lineBreaks[64];
+	memset(lineBreaks, CharCode::kLineFeed, sizeof(lineBreaks));
+
+	while (numLineBreaks > 0)
+	{
+		const size_t chunkSize = (numLineBreaks < sizeof(lineBreaks)) ? numLineBreaks : sizeof(lineBreaks);
+		CHECK(m_outStream->WriteAll(ArrayView<const uint8_t>(lineBreaks, chunkSize)));
+
+		numLineBreaks -= chunkSize;
+	}
+
+	return ErrorCode::kOK;
+}
+
+size_t expanse::cc::CPreprocessor::ScanInactiveLines(const ArrayView<const uint8_t> &contents, size_t offset, size_t &outNumLineBreaks)
+{
+	const uint8_t *chars = contents.begin();
+	const size_t size = contents.Size();
+
+	size_t numLineBreaks = 0;
+
+	// The line that a directive would start on, which is the last one that began outside of a block comment
+	size_t lineStart = offset;
+	size_t numLineBreaksBeforeLineStart = 0;
+
+	// Whether there's been nothing but whitespace and comments since lineStart
+	bool isLineStart = true;
+
+	for (;;)
+	{
+		if (isLineStart)
+			offset += CharScan::ScanWhitespace(chars + offset, size - offset);
+		else
+			offset += CharScan::ScanSkippedText(chars + offset, size - offset);
+
+		if (offset == size)
+			break;
+
+		const uint8_t thisChar = chars[offset];
+
+		if (thisChar == CharCode::kHash && isLineStart)
+			break;
+
+		switch (thisChar)
+		{
+		case CharCode::kCarriageReturn:
+		case CharCode::kLineFeed:
+			offset++;
+			numLineBreaks++;
+
+			lineStart = offset;
+			numLineBreaksBeforeLineStart = numLineBreaks;
+			isLineStart = true;
+			break;
+
+		case CharCode::kSlash:
+			if (size - offset >= 2 && chars[offset + 1] == CharCode::kAsterisk)
+			{
+				const uint8_t *body = chars + offset + 2;
+				const size_t bodyMaxLength = size - offset - 2;
+				const size_t bodyLength = CharScan::ScanToBlockCommentEnd(body, bodyMaxLength);
+
+				// Left for the lexer to report
+				if (bodyLength == bodyMaxLength)
+				{
+					outNumLineBreaks = numLineBreaksBeforeLineStart;
+					return lineStart;
+				}
+
+				// The comment is whitespace, so a # after it can still start a directive on the line it started on
+				const uint8_t *lineBreak = static_cast<const uint8_t *>(memchr(body, CharCode::kLineFeed, bodyLength));
+				while (lineBreak != nullptr)
+				{
+					numLineBreaks++;
+					lineBreak = static_cast<const uint8_t *>(memchr(lineBreak + 1, CharCode::kLineFeed, static_cast<size_t>(body + bodyLength - lineBreak - 1)));
+				}
+
+				offset += bodyLength + 4;
+			}
+			else if (size - offset >= 2 && chars[offset + 1] == CharCode::kSlash)
+				offset += 2 + CharScan::ScanToLineEnd(chars + offset + 2, size - offset - 2);
+			else
+			{
+				offset++;
+				isLineStart = false;
+			}
+			break;
+
+		case CharCode::kSingleQuote:
+		case CharCode::kDoubleQuote:
+			// Literals don't span lines, one that isn't terminated just ends with the line
+			offset++;
+			for (;;)
+			{
+				offset += CharScan::ScanCharSequenceBody(chars + offset, size - offset, thisChar);
+				if (offset == size)
+					break;
+
+				const uint8_t bodyChar = chars[offset];
+				if (bodyChar == thisChar)
+				{
+					offset++;
+					break;
+				}
+
+				if (bodyChar != CharCode::kBackslash)
+					break;
+
+				offset++;
+				if (offset != size && chars[offset] != CharCode::kCarriageReturn && chars[offset] != CharCode::kLineFeed)
+					offset++;
+			}
+
+			isLineStart = false;
+			break;
+
+		default:
+			isLineStart = false;
+			break;
+		}
+	}
+
+	outNumLineBreaks = numLineBreaksBeforeLineStart;
+	return lineStart;
+}
 
 bool expanse::cc::CPreprocessor::ValidatePathComponent(const ArrayView<const uint8_t> &component)
 {
@@ -1292,50 +2122,67 @@ bool expanse::cc::CPreprocessor::ValidatePathComponent(const ArrayView<const uin
 	return true;
 }
 
+bool expanse::cc::CPreprocessor::SpellingEquals(const ArrayView<const uint8_t> &a, const ArrayView<const uint8_t> &b)
+{
+	return a.Size() == b.Size() && (a.Size() == 0 || !memcmp(a.begin(), b.begin(), a.Size()));
+}
 
-bool expanse::cc::CPreprocessor::IsIdentifier(const ArrayView<const uint8_t> &token)
+uint32_t expanse::cc::CPreprocessor::FindMacroParameter(const ArrayView<const ArrayView<const uint8_t>> &parameterNames, const ArrayView<const uint8_t> &name)
 {
-	const size_t tokenSize = token.Size();
-	for (size_t i = 0; i < tokenSize; i++)
+	for (size_t i = 0; i < parameterNames.Size(); i++)
 	{
-		const uint8_t ch = token[i];
-		if (ch == CharCode::kUnderscore
-			|| (ch >= CharCode::kLowercaseA && ch <= CharCode::kLowercaseZ)
-			|| (ch >= CharCode::kUppercaseA && ch <= CharCode::kUppercaseZ))
-			continue;
+		if (SpellingEquals(parameterNames[i], name))
+			return static_cast<uint32_t>(i);
+	}
 
-		if (ch >= CharCode::kDigit0 && ch <= CharCode::kDigit9 && i != 0)
-			continue;
+	return PPMacroToken::kNotAParameter;
+}
 
-		if (ch == CharCode::kBackslash)
-		{
-			if (tokenSize - i < 6)
-				return false;
+expanse::cc::CPreprocessor::ContinuationLineSource::ContinuationLineSource(IAllocator *alloc, CPreprocessor *preprocessor, const FileCoordinate &nextLineStart, bool trailingSpace)
+	: m_preprocessor(preprocessor)
+	, m_nextLineStart(nextLineStart)
+	, m_trailingSpace(trailingSpace)
+	, m_pulledLineStarts(alloc)
+{
+}
 
-			size_t hexDigitsExpected = 0;
-			if (token[i + 1] == CharCode::kLowercaseU)
-				hexDigitsExpected = 4;
-			else if (token[i + 1] == CharCode::kUppercaseU)
-			{
-				hexDigitsExpected = 8;
-				if (tokenSize - i < 10)
-					return false;
-			}
-			else
-				return false;
+expanse::ResultRV<bool> expanse::cc::CPreprocessor::ContinuationLineSource::PullLine(Vector<PPMacroToken> &tokens)
+{
+	IncludeStack *f = m_preprocessor->m_includeStackTop;
 
-			for (size_t j = 0; j < hexDigitsExpected; j++)
-			{
-				const uint8_t hexDigit = token[i + 2 + j];
-				if ((ch < CharCode::kLowercaseA || ch > CharCode::kLowercaseF)
-					&& (ch < CharCode::kUppercaseA || ch > CharCode::kUppercaseF)
-					&& (ch < CharCode::kDigit0 || ch > CharCode::kDigit9))
-					return false;
-			}
+	// Invocations don't continue into directives or past the end of the file
+	ArrayView<const uint8_t> token;
+	CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
+	FileCoordinate coord = m_nextLineStart;
+	if (!CLexer::TryGetToken(f->GetFileContents(), m_nextLineStart, true, false, m_preprocessor->m_includeStackTrace, m_preprocessor->m_errorReporter, true, false, token, tokenType, coord))
+		return false;
 
-			i += 1 + hexDigitsExpected;
-		}
-	}
+	if (token.Size() == 1 && token[0] == CharCode::kHash)
+		return false;
+
+	CHECK(m_pulledLineStarts.Add(m_nextLineStart));
+
+	// The line break separates the first token of the line from the ones before it
+	const size_t firstNewToken = tokens.Size();
+	CHECK(m_preprocessor->LexLineTokens(m_nextLineStart, tokens, m_trailingSpace));
+
+	if (tokens.Size() > firstNewToken)
+		tokens[firstNewToken].m_flags |= PPMacroToken::kFlagLeadingSpace;
 
 	return true;
 }
+
+const expanse::cc::FileCoordinate &expanse::cc::CPreprocessor::ContinuationLineSource::GetNextLineStart() const
+{
+	return m_nextLineStart;
+}
+
+bool expanse::cc::CPreprocessor::ContinuationLineSource::HasTrailingSpace() const
+{
+	return m_trailingSpace;
+}
+
+expanse::ArrayView<const expanse::cc::FileCoordinate> expanse::cc::CPreprocessor::ContinuationLineSource::GetPulledLineStarts() const
+{
+	return m_pulledLineStarts.ConstView();
+}
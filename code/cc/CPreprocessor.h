@@ -2,8 +2,10 @@
 
 #include "CoreObject.h"
 #include "CorePtr.h"
-#include "HashMap.h"
 #include "IncludeStackTrace.h"
+#include "PPConditionEvaluator.h"
+#include "PPMacroExpander.h"
+#include "PPMacroTable.h"
 #include "PPTokenStr.h"
 #include "StringProto.h"
 #include "Vector.h"
@@ -17,6 +19,7 @@ namespace expanse
 	class AsyncFileSystem;
 	class AsyncFileRequest;
 	class FileStream;
+	class ThreadEvent;
 	struct IAllocator;
 
 	namespace cc
@@ -24,6 +27,8 @@ namespace expanse
 		class CPreprocessorTraceInfo;
 		class IncludeStack;
 		class FileCache;
+		class PPConditionCache;
+		struct FileCoordinate;
 		struct IErrorReporter;
 
 		class CPreprocessor final : public CoreObject
@@ -41,19 +46,26 @@ namespace expanse
 				kFailed,
 			};
 
-			CPreprocessor(IAllocator *alloc, AsyncFileSystem *fs, FileCache *fileCache, FileStream *outStream, IErrorReporter *errorReporter);
+			// The condition cache is optional
+			CPreprocessor(IAllocator *alloc, AsyncFileSystem *fs, FileCache *fileCache, PPConditionCache *conditionCache, FileStream *outStream, IErrorReporter *errorReporter);
 			~CPreprocessor();
 
 			Result StartRootFile(const UTF8StringView_t &device, const UTF8StringView_t &path);
 			Result PushResolvedInclude(ArrayPtr<uint8_t> &&contents, UTF8String_t &&device, UTF8String_t &&path);
 
-			static Result ConvertLineBreaks(IAllocator *alloc, ArrayPtr<uint8_t> &contents);
+			// Runs on the IO worker as each file is loaded, see AsyncFileContentsFilter_t
+			static void ConvertLineBreaks(ArrayPtr<uint8_t> &contents);
 			Result AddIncludeDirectory(bool isSystem, const UTF8StringView_t &device, const UTF8StringView_t &path);
 
 			void Digest();
 			State GetState() const;
 
+			// In a loading state, blocks until the file being loaded is ready for Digest, see
+			// AsyncFileRequest::WaitForFinish.  Returns right away in any other state.
+			void WaitForFileLoad(ThreadEvent *finishEvent);
+
 			Result FlushTrace(FileStream *traceStream);
+			CPreprocessorTraceInfo *GetTraceInfo() const;
 
 		private:
 			struct IncludePath
@@ -62,60 +74,30 @@ namespace expanse
 				UTF8String_t m_path;
 			};
 
-			struct Subrange
-			{
-			public:
-				Subrange();
-				Subrange(size_t start, size_t length);
-
-				size_t GetStart() const;
-				size_t GetLength() const;
+			// Feeds the lines after a text line to the macro expander when an invocation's arguments run past it
+			class ContinuationLineSource;
 
-			private:
-				size_t m_start;
-				size_t m_length;
-			};
-
-			struct PPToken
+			enum class IncludePathResolution
 			{
-				PPToken();
-
-				ArrayView<const uint8_t> m_token;
-				bool m_isWhitespace;
-			};
-
-			struct PPTokenCollection
-			{
-			public:
-				PPTokenCollection();
-				PPTokenCollection(PPTokenCollection &&other);
-				PPTokenCollection(ArrayPtr<uint8_t> &&tokenContents, ArrayPtr<ArrayView<const uint8_t>> &&tokens);
-				~PPTokenCollection();
-
-				ArrayView<const ArrayView<const uint8_t>> GetTokens() const;
-				ArrayPtr<uint8_t> FlattenAndTakeContents();
-
-				PPTokenCollection &operator=(PPTokenCollection &&other);
-
-			private:
-				ArrayPtr<uint8_t> m_tokenContents;
-				ArrayPtr<ArrayView<const uint8_t>> m_tokens;
-
-				PPTokenCollection(const PPTokenCollection &other) = delete;
-
-				PPTokenCollection &operator=(const PPTokenCollection &other) = delete;
+				kResolved,
+				kInvalid,
+				kEscapesDirectoryTree,
 			};
 
-			struct FunctionLikeMacro
+			struct PendingPrefetch
 			{
-			public:
+				UTF8String_t m_device;
+				UTF8String_t m_path;
+				CorePtr<AsyncFileRequest> m_request;
 			};
 
 			static bool TokenEquals(const ArrayView<const uint8_t> &tokenChars, const char *str);
 
 			static const unsigned int kIncludeStackLimit = 256;
+			static const size_t kMaxPendingPrefetches = 64;
 
 			void PopIncludeStack();
+			Result LeaveIncludedFile();
 			Result DigestChecked();
 			Result AdvanceToNextIncludePath();
 			Result RaiseIncludeError(ErrorCode errorCode);
@@ -137,17 +119,55 @@ namespace expanse
 			Result ProcessElseDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate);
 			Result ProcessEndIfDirective(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate);
 
-			ResultRV<ArrayPtr<PPToken>> ParseTokenSequence(FileCoordinate &inOutCoordinate);
-			ResultRV<PPTokenCollection> CanonicalizeTokenSequence(const ArrayView<const PPToken> &ppTokens);
-			Result ExpandTokenSequence(PPTokenCollection &outTokenSequence);
+			// Appends the tokens up to the end of the line and moves past it.  Whitespace and comments only set the
+			// leading space flag of the token after them, or outTrailingSpace at the end of the line.
+			Result LexLineTokens(FileCoordinate &inOutCoordinate, Vector<PPMacroToken> &tokens, bool &outTrailingSpace);
+
+			// Evaluates the rest of an #if or #elif line and moves past it
+			ResultRV<bool> EvaluateCondition(const FileCoordinate &blameCoordinate, FileCoordinate &inOutCoordinate);
+
+			// Parses the rest of an #ifdef or #ifndef line and moves past it
+			ResultRV<bool> EvaluateIfDefName(const ArrayView<const uint8_t> &contents, FileCoordinate &inOutCoordinate, ArrayView<const uint8_t> &outName);
+
+			// Moves past the rest of a directive line whose operands don't matter
+			Result SkipDirectiveOperands(FileCoordinate &inOutCoordinate);
 			Result StartIncluding(const FileCoordinate &blameLocation, const ArrayView<const uint8_t> &token);
+			Result ResolveIncludePath(const ArrayView<const uint8_t> &token, const UTF8StringView_t &currentPath, IncludePathResolution &outResolution, UTF8String_t &outPath, bool &outIsSystemPath, bool &outIsLocalOnly) const;
+			Result CombineIncludePath(const ArrayView<const uint8_t> &directory, const UTF8StringView_t &relativePath, UTF8String_t &outPath) const;
 			Result SplitToPathComponents(Vector<ArrayView<const uint8_t>> &components, const ArrayView<const uint8_t> &pathRef) const;
 
 			Result EnterLoadingState();
+			Result RetrieveFile(const UTF8StringView_t &device, const UTF8StringView_t &path);
 			Result SkipLine();
 
+			// Moves over the lines of an inactive block up to the next one that could be a directive, with one trace
+			// record and one output write for all of them.  Returns false if the current line has to be processed.
+			ResultRV<bool> SkipInactiveLines();
+			Result WriteLineBreaks(size_t numLineBreaks);
+
+			// Checks whether a file that was found in the file cache can be left out because of its include guard
+			ResultRV<bool> IsIncludeGuarded(const UTF8StringView_t &device, const UTF8StringView_t &path);
+			ResultRV<TokenStrView> InternCanonicalFileName(const UTF8StringView_t &device, const UTF8StringView_t &path);
+
+			// Speculatively loads the includes of a newly entered file into the file cache so that they're usually
+			// already there by the time the directives are reached.  The scan is textual and ignores conditionals and
+			// comments, so it can fetch files that are never used, which only costs a wasted load.
+			Result PrefetchIncludes(const ArrayView<const uint8_t> &contents, const UTF8StringView_t &device, const UTF8StringView_t &path);
+			Result PrefetchInclude(const ArrayView<const uint8_t> &token, const UTF8StringView_t &device, const UTF8StringView_t &path);
+			Result IssuePrefetch(const UTF8StringView_t &device, const UTF8StringView_t &path);
+			Result CollectFinishedPrefetches();
+			Result TakePendingPrefetch(const UTF8StringView_t &device, const UTF8StringView_t &path, CorePtr<AsyncFileRequest> &outRequest);
+
 			static bool ValidatePathComponent(const ArrayView<const uint8_t> &component);
-			static bool IsIdentifier(const ArrayView<const uint8_t> &token);
+			static bool SpellingEquals(const ArrayView<const uint8_t> &a, const ArrayView<const uint8_t> &b);
+			static uint32_t FindMacroParameter(const ArrayView<const ArrayView<const uint8_t>> &parameterNames, const ArrayView<const uint8_t> &name);
+			static bool TryScanIncludeDirective(const ArrayView<const uint8_t> &line, ArrayView<const uint8_t> &outToken);
+
+			// Finds the start of the first line from offset that can't be skipped without lexing it: one that could be
+			// a directive, the last line if it has no line break, or one with a block comment that never ends.
+			// Comments and literals are only followed far enough to tell where lines and comments really end.
+			static size_t ScanInactiveLines(const ArrayView<const uint8_t> &contents, size_t offset, size_t &outNumLineBreaks);
+			static ArrayView<const uint8_t> GetParentDirectory(const UTF8StringView_t &path);
 				
 			CorePtr<IncludeStack> m_includeStack;
 			IncludeStack *m_includeStackTop;
@@ -163,6 +183,12 @@ namespace expanse
 			size_t m_pathResolutionIndex;
 
 			FileCache *m_fileCache;
+			PPConditionCache *m_conditionCache;
+
+			ArrayPtr<uint8_t> m_cachedFileContents;
+			UTF8String_t m_cachedFileDevice;
+			UTF8String_t m_cachedFilePath;
+			bool m_haveCachedFile;
 
 			FileStream *m_outStream;
 
@@ -173,8 +199,19 @@ namespace expanse
 			Vector<IncludePath> m_systemIncludePaths;
 			Vector<IncludePath> m_nonSystemIncludePaths;
 
-			HashMap<TokenStr, PPTokenCollection> m_objectLikeMacros;
-			HashMap<TokenStr, FunctionLikeMacro> m_functionLikeMacros;
+			PPMacroTable m_macros;
+			PPMacroExpander m_macroExpander;
+			PPConditionEvaluator m_conditionEvaluator;
+
+			// Reused by every text line so that lines don't allocate once these have grown to fit
+			Vector<PPMacroToken> m_lineTokens;
+			Vector<PPMacroToken> m_expandedTokens;
+			Vector<uint8_t> m_lineChars;
+
+			Vector<PendingPrefetch> m_pendingPrefetches;
+
+			// Indexed by interned file name, nonzero for files that have had #pragma once
+			Vector<uint8_t> m_pragmaOnceFiles;
 		};
 	}
 }
@@ -29,8 +29,9 @@ bool expanse::cc::CPreprocessorTrace::operator!=(const CPreprocessorTrace &other
 
 expanse::cc::CPreprocessorTraceInfo::CPreprocessorTraceInfo(IAllocator *alloc)
 	: m_numSequentialLines(0)
+	, m_fileNameTable(alloc)
 	, m_fileNames(alloc)
-	, m_fileNamesIndexes(*alloc)
+	, m_atomToFileNameIndex(alloc)
 	, m_traces(alloc)
 	, m_traceToIndex(*alloc)
 	, m_binaryData(alloc)
@@ -86,6 +87,23 @@ expanse::Result expanse::cc::CPreprocessorTraceInfo::AddLineInfo(IIncludeStackTr
 	return ErrorCode::kOK;
 }
 
+expanse::Result expanse::cc::CPreprocessorTraceInfo::AddLineRun(IIncludeStackTrace *trace, size_t numLines)
+{
+	if (numLines == 0)
+		return ErrorCode::kOK;
+
+	CHECK(AddLineInfo(trace));
+
+	// The rest of the run continues the sequence that AddLineInfo just started or extended
+	const size_t numFollowingLines = numLines - 1;
+	if (numFollowingLines > std::numeric_limits<uint32_t>::max() - m_currentTrace.m_currentLineNumber)
+		return ErrorCode::kOutOfMemory;
+
+	m_currentTrace.m_currentLineNumber += static_cast<uint32_t>(numFollowingLines);
+	m_numSequentialLines += numFollowingLines;
+
+	return ErrorCode::kOK;
+}
 
 expanse::Result expanse::cc::CPreprocessorTraceInfo::Write(FileStream *fs)
 {
@@ -100,17 +118,18 @@ expanse::Result expanse::cc::CPreprocessorTraceInfo::Write(FileStream *fs)
 		CHECK(m_binaryData.Add(static_cast<uint8_t>(m_numSequentialLines)));
 	}
 
-	if (m_fileNames.Size() > std::numeric_limits<uint32_t>::max())
+	const size_t numFileNames = m_fileNames.Size();
+	if (numFileNames > std::numeric_limits<uint32_t>::max())
 		return ErrorCode::kOutOfMemory;
 
 	StaticArray<uint8_t, 4> binInt;
 
-	ToBinary(static_cast<uint32_t>(m_fileNames.Size()), binInt);
+	ToBinary(static_cast<uint32_t>(numFileNames), binInt);
 	CHECK(fs->WriteAll(binInt.ConstView()));
 
-	for (size_t i = 0; i < m_fileNames.Size(); i++)
+	for (size_t i = 0; i < numFileNames; i++)
 	{
-		const ArrayView<const uint8_t> fileNameBytes = m_fileNames[i].GetToken();
+		const ArrayView<const uint8_t> fileNameBytes = m_fileNameTable.GetSpelling(m_fileNames[i]);
 
 		if (fileNameBytes.Size() > std::numeric_limits<uint32_t>::max())
 			return ErrorCode::kOutOfMemory;
@@ -157,8 +176,8 @@ expanse::ResultRV<expanse::cc::CPreprocessorTrace> expanse::cc::CPreprocessorTra
 expanse::ResultRV<expanse::cc::CPreprocessorTrace> expanse::cc::CPreprocessorTraceInfo::GenerateTraceRecursive(IIncludeStackTrace *trace)
 {
 	UTF8StringView_t device, path;
-	FileCoordinate coord;
-	trace->GetCurrentFile(device, path, coord);
+	FileLocation location;
+	CHECK(trace->GetCurrentFile(device, path, location));
 
 	TokenStrView traceFileName = trace->GetCurrentTraceFile();
 
@@ -173,7 +192,7 @@ expanse::ResultRV<expanse::cc::CPreprocessorTrace> expanse::cc::CPreprocessorTra
 
 	CPreprocessorTrace newTrace;
 	CHECK_RV_ASSIGN(newTrace.m_currentFileNameIndex, IndexFileName(traceFileName));
-	newTrace.m_currentLineNumber = coord.m_lineNumber;
+	newTrace.m_currentLineNumber = location.m_lineNumber;
 	newTrace.m_prevTraceIndexPlusOne = prevTraceIndexPlusOne;
 
 	return newTrace;
@@ -197,26 +216,96 @@ expanse::ResultRV<uint32_t> expanse::cc::CPreprocessorTraceInfo::IndexTrace(cons
 		return it.Value();
 }
 
+expanse::ResultRV<expanse::cc::TokenStrView> expanse::cc::CPreprocessorTraceInfo::InternFileName(const ArrayView<const uint8_t> &name)
+{
+	CHECK_RV(IdentifierAtom, atom, m_fileNameTable.Intern(name));
+
+	return TokenStrView(m_fileNameTable.GetSpelling(atom), TokenKind::kOther, atom);
+}
+
+bool expanse::cc::CPreprocessorTraceInfo::FindOutputLineTrace(uint32_t outputLineNumber, uint32_t &outTraceIndex, uint32_t &outLineNumber) const
+{
+	if (outputLineNumber == 0)
+		return false;
+
+	// Each run of lines is a trace index, then how many more lines follow it in pieces of up to 255, then a 0 sync
+	// code if another run comes after it.  The last run's count may not have been flushed yet, so it takes in every
+	// line from its start on.
+	const ArrayView<const uint8_t> data = m_binaryData.ConstView();
+
+	uint32_t runFirstLineNumber = 1;
+	size_t offset = 0;
+	while (data.Size() - offset >= 4)
+	{
+		uint32_t traceIndex = 0;
+		for (size_t i = 0; i < 4; i++)
+			traceIndex |= static_cast<uint32_t>(data[offset + i]) << (i * 8);
+		offset += 4;
+
+		size_t numLines = 1;
+		while (offset < data.Size() && data[offset] != 0)
+		{
+			numLines += data[offset];
+			offset++;
+		}
+
+		const bool isLastRun = (offset == data.Size());
+		if (isLastRun || outputLineNumber - runFirstLineNumber < numLines)
+		{
+			if (traceIndex >= m_traces.Size())
+				return false;
+
+			outTraceIndex = traceIndex;
+			outLineNumber = m_traces[traceIndex].m_currentLineNumber + (outputLineNumber - runFirstLineNumber);
+			return true;
+		}
+
+		runFirstLineNumber += static_cast<uint32_t>(numLines);
+		offset++;
+	}
+
+	return false;
+}
+
+const expanse::cc::CPreprocessorTrace &expanse::cc::CPreprocessorTraceInfo::GetTrace(uint32_t traceIndex) const
+{
+	return m_traces[traceIndex];
+}
+
+expanse::cc::TokenStrView expanse::cc::CPreprocessorTraceInfo::GetFileName(uint32_t fileNameIndex) const
+{
+	const IdentifierAtom atom = m_fileNames[fileNameIndex];
+
+	return TokenStrView(m_fileNameTable.GetSpelling(atom), TokenKind::kOther, atom);
+}
+
 expanse::ResultRV<uint32_t> expanse::cc::CPreprocessorTraceInfo::IndexFileName(const TokenStrView &name)
 {
-	HashMapIterator<TokenStrView, uint32_t> it = m_fileNamesIndexes.Find(name);
-	if (it == m_fileNamesIndexes.end())
+	IdentifierAtom atom = name.GetAtom();
+	if (!atom.IsValid())
 	{
-		if (m_fileNames.Size() == std::numeric_limits<uint32_t>::max())
-			return ErrorCode::kOutOfMemory;
+		CHECK_RV_ASSIGN(atom, m_fileNameTable.Intern(name.GetToken()));
+	}
 
-		CHECK_RV(ArrayPtr<uint8_t>, nameCopyBytes, name.GetToken().Clone(GetCoreObjectAllocator()));
-		
-		TokenStr nameCopy(std::move(nameCopyBytes));
+	const size_t atomIndex = atom.GetIndex();
+	if (atomIndex >= m_atomToFileNameIndex.Size())
+	{
+		const size_t oldSize = m_atomToFileNameIndex.Size();
+		CHECK(m_atomToFileNameIndex.Resize(m_fileNameTable.GetNumAtoms()));
 
+		for (size_t i = oldSize; i < m_atomToFileNameIndex.Size(); i++)
+			m_atomToFileNameIndex[i] = kUnindexedFileName;
+	}
+
+	if (m_atomToFileNameIndex[atomIndex] == kUnindexedFileName)
+	{
 		const uint32_t fileNameIndex = static_cast<uint32_t>(m_fileNames.Size());
-		CHECK(m_fileNamesIndexes.Insert(nameCopy.GetTokenView(), fileNameIndex));
-		CHECK(m_fileNames.Add(std::move(nameCopy)));
+		CHECK(m_fileNames.Add(atom));
 
-		return fileNameIndex;
+		m_atomToFileNameIndex[atomIndex] = fileNameIndex;
 	}
-	else
-		return it.Value();
+
+	return m_atomToFileNameIndex[atomIndex];
 }
 
 void expanse::cc::CPreprocessorTraceInfo::ToBinary(uint32_t value, StaticArray<uint8_t, 4> &outBin)
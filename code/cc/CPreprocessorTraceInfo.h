@@ -3,6 +3,7 @@
 #include "ArrayPtr.h"
 #include "CoreObject.h"
 #include "HashMap.h"
+#include "IdentifierTable.h"
 #include "PPTokenStr.h"
 #include "Vector.h"
 
@@ -37,8 +38,22 @@ namespace expanse
 			explicit CPreprocessorTraceInfo(IAllocator *alloc);
 
 			Result AddLineInfo(IIncludeStackTrace *trace);
+
+			// Same as calling AddLineInfo for numLines consecutive lines of the current file, starting at the
+			// current one, but only resolves the first
+			Result AddLineRun(IIncludeStackTrace *trace, size_t numLines);
 			Result Write(FileStream *fs);
 
+			// File names are interned when a file is pushed, so a trace file name that carries an atom from here
+			// is indexed without being hashed again for every line.  The spelling stays valid as long as this does.
+			ResultRV<TokenStrView> InternFileName(const ArrayView<const uint8_t> &name);
+
+			// Finds the trace of a line of the preprocessed output and the line of the traced file that it came
+			// from.  Lines are numbered from 1.  Returns false if the output doesn't have that many lines.
+			bool FindOutputLineTrace(uint32_t outputLineNumber, uint32_t &outTraceIndex, uint32_t &outLineNumber) const;
+			const CPreprocessorTrace &GetTrace(uint32_t traceIndex) const;
+			TokenStrView GetFileName(uint32_t fileNameIndex) const;
+
 		private:
 			ResultRV<CPreprocessorTrace> GenerateTrace(IIncludeStackTrace *trace);
 			ResultRV<CPreprocessorTrace> GenerateTraceRecursive(IIncludeStackTrace *trace);
@@ -52,8 +67,13 @@ namespace expanse
 
 			size_t m_numSequentialLines;
 
-			Vector<TokenStr> m_fileNames;
-			HashMap<TokenStrView, uint32_t> m_fileNamesIndexes;
+			// File names are numbered in the order lines from them are first traced, which isn't the order they're
+			// interned in since some files never produce a line.  Both directions are direct lookups by index.
+			static const uint32_t kUnindexedFileName = 0xffffffffu;
+
+			IdentifierTable m_fileNameTable;
+			Vector<IdentifierAtom> m_fileNames;
+			Vector<uint32_t> m_atomToFileNameIndex;
 
 			Vector<CPreprocessorTrace> m_traces;
 			HashMap<CPreprocessorTrace, uint32_t> m_traceToIndex;
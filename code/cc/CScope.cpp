@@ -1,9 +1,43 @@
 #include "CScope.h"
 
+#include "ExpAssert.h"
+#include "IAllocator.h"
+
 namespace expanse
 {
 	namespace cc
 	{
+		CSpeculativeGlobalObjectBinding::CSpeculativeGlobalObjectBinding()
+			: m_index(0)
+		{
+		}
+
+		CSpeculativeGlobalObjectBinding::CSpeculativeGlobalObjectBinding(const HTypeQualified &apparentType, size_t index)
+			: m_apparentType(apparentType)
+			, m_index(index)
+		{
+		}
+
+		CRealGlobalObjectBinding::CRealGlobalObjectBinding()
+			: m_index(0)
+		{
+		}
+
+		CRealGlobalObjectBinding::CRealGlobalObjectBinding(size_t index)
+			: m_index(index)
+		{
+		}
+
+		CIdentifierLocalObjectBinding::CIdentifierLocalObjectBinding()
+			: m_index(0)
+		{
+		}
+
+		CIdentifierLocalObjectBinding::CIdentifierLocalObjectBinding(size_t index)
+			: m_index(index)
+		{
+		}
+
 		CIdentifierBinding::BindingUnion::BindingUnion()
 		{
 		}
@@ -28,6 +62,10 @@ namespace expanse
 		{
 		}
 
+		CIdentifierBinding::BindingUnion::~BindingUnion()
+		{
+		}
+
 		CIdentifierBinding::CIdentifierBinding()
 			: m_u()
 			, m_bindingType(BindingType::kInvalid)
@@ -300,21 +338,24 @@ namespace expanse
 			return m_parentScope;
 		}
 
-		const CIdentifierBinding *CScope::GetSymbolLocal(const TokenStrView &token) const
+		const CIdentifierBinding *CScope::GetSymbolLocal(const IdentifierAtom &name) const
 		{
-			HashMapConstIterator<TokenStrView, CIdentifierBinding> it = m_symbols.Find(token);
+			if (!name.IsValid())
+				return nullptr;
+
+			HashMapConstIterator<IdentifierAtom, CIdentifierBinding> it = m_symbols.Find(name);
 			if (it == m_symbols.end())
 				return nullptr;
 			return &it.Value();
 		}
 
-		const CIdentifierBinding *CScope::GetSymbolRecursive(const TokenStrView &token) const
+		const CIdentifierBinding *CScope::GetSymbolRecursive(const IdentifierAtom &name) const
 		{
 			const CScope *scope = this;
 
 			while (scope != nullptr)
 			{
-				const CIdentifierBinding *binding = scope->GetSymbolLocal(token);
+				const CIdentifierBinding *binding = scope->GetSymbolLocal(name);
 				if (binding != nullptr)
 					return binding;
 
@@ -324,21 +365,24 @@ namespace expanse
 			return nullptr;
 		}
 
-		const CTagBinding *CScope::GetTagLocal(const TokenStrView &token) const
+		const CTagBinding *CScope::GetTagLocal(const IdentifierAtom &name) const
 		{
-			HashMapConstIterator<TokenStrView, CTagBinding> it = m_tags.Find(token);
+			if (!name.IsValid())
+				return nullptr;
+
+			HashMapConstIterator<IdentifierAtom, CTagBinding> it = m_tags.Find(name);
 			if (it == m_tags.end())
 				return nullptr;
 			return &it.Value();
 		}
 
-		const CTagBinding *CScope::GetTagRecursive(const TokenStrView &token) const
+		const CTagBinding *CScope::GetTagRecursive(const IdentifierAtom &name) const
 		{
 			const CScope *scope = this;
 
 			while (scope != nullptr)
 			{
-				const CTagBinding *binding = scope->GetTagLocal(token);
+				const CTagBinding *binding = scope->GetTagLocal(name);
 				if (binding != nullptr)
 					return binding;
 
@@ -348,14 +392,16 @@ namespace expanse
 			return nullptr;
 		}
 
-		Result CScope::DefineIdentifier(const TokenStrView &name, const CIdentifierBinding &binding)
+		Result CScope::DefineIdentifier(const IdentifierAtom &name, const CIdentifierBinding &binding)
 		{
+			EXP_ASSERT(name.IsValid());
 			return m_symbols.Insert(name, binding);
 		}
 
-		Result CScope::AddTag(const TokenStrView &token, const CTagBinding &tagBinding)
+		Result CScope::AddTag(const IdentifierAtom &name, const CTagBinding &tagBinding)
 		{
-			return m_tags.Insert(token, tagBinding);
+			EXP_ASSERT(name.IsValid());
+			return m_tags.Insert(name, tagBinding);
 		}
 	}
 }
@@ -3,11 +3,11 @@
 #include "CoreObject.h"
 #include "HashMap.h"
 #include "HType.h"
-#include "PPTokenStr.h"
+#include "IAllocator.h"
+#include "IdentifierAtom.h"
 
 namespace expanse
 {
-	struct IAllocator;
 	template<class T> struct ResultRV;
 
 	namespace cc
@@ -142,20 +142,22 @@ namespace expanse
 			explicit CScope(IAllocator *alloc, CScope *parentScope);
 
 			CScope *GetParentScope() const;
-			const CIdentifierBinding *GetSymbolLocal(const TokenStrView &token) const;
-			const CIdentifierBinding *GetSymbolRecursive(const TokenStrView &token) const;
 
-			const CTagBinding *GetTagLocal(const TokenStrView &token) const;
-			const CTagBinding *GetTagRecursive(const TokenStrView &token) const;
+			// Names are atoms from the compiler's identifier table.  Looking up an invalid atom finds nothing.
+			const CIdentifierBinding *GetSymbolLocal(const IdentifierAtom &name) const;
+			const CIdentifierBinding *GetSymbolRecursive(const IdentifierAtom &name) const;
 
-			Result DefineIdentifier(const TokenStrView &token, const CIdentifierBinding &binding);
+			const CTagBinding *GetTagLocal(const IdentifierAtom &name) const;
+			const CTagBinding *GetTagRecursive(const IdentifierAtom &name) const;
 
-			Result AddTag(const TokenStrView &token, const CTagBinding &tagBinding);
+			Result DefineIdentifier(const IdentifierAtom &name, const CIdentifierBinding &binding);
+
+			Result AddTag(const IdentifierAtom &name, const CTagBinding &tagBinding);
 
 		private:
-			HashMap<TokenStrView, CIdentifierBinding> m_symbols;
-			HashMap<TokenStrView, CTagBinding> m_tags;
-			HashMap<TokenStrView, CLabelBinding> m_labels;
+			HashMap<IdentifierAtom, CIdentifierBinding> m_symbols;
+			HashMap<IdentifierAtom, CTagBinding> m_tags;
+			HashMap<IdentifierAtom, CLabelBinding> m_labels;
 
 			CScope *m_parentScope;
 		};
@@ -0,0 +1,317 @@
+#include "CharScan.h"
+
+#include "CharCodes.h"
+
+#if defined(__AVX2__)
+#define EXPANSE_CHARSCAN_AVX2	1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EXPANSE_CHARSCAN_SSE2	1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace expanse
+{
+	namespace cc
+	{
+		namespace
+		{
+			inline unsigned int CountTrailingZeros(uint32_t mask)
+			{
+#if defined(_MSC_VER)
+				unsigned long index = 0;
+				_BitScanForward(&index, mask);
+				return static_cast<unsigned int>(index);
+#else
+				return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+			}
+
+#if EXPANSE_CHARSCAN_AVX2
+			struct VectorOps
+			{
+				typedef __m256i Vec_t;
+
+				static const size_t kWidth = 32;
+				static const uint32_t kFullMask = 0xffffffffu;
+
+				static Vec_t Load(const uint8_t *chars) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chars)); }
+				static Vec_t Splat(uint8_t ch) { return _mm256_set1_epi8(static_cast<char>(ch)); }
+				static Vec_t Equal(Vec_t a, Vec_t b) { return _mm256_cmpeq_epi8(a, b); }
+				static Vec_t LessOrEqualUnsigned(Vec_t a, Vec_t b) { return _mm256_cmpeq_epi8(_mm256_min_epu8(a, b), a); }
+				static Vec_t Subtract(Vec_t a, Vec_t b) { return _mm256_sub_epi8(a, b); }
+				static Vec_t Or(Vec_t a, Vec_t b) { return _mm256_or_si256(a, b); }
+				static Vec_t And(Vec_t a, Vec_t b) { return _mm256_and_si256(a, b); }
+				static Vec_t AndNot(Vec_t notA, Vec_t b) { return _mm256_andnot_si256(notA, b); }
+				static uint32_t MoveMask(Vec_t v) { return static_cast<uint32_t>(_mm256_movemask_epi8(v)); }
+			};
+#elif EXPANSE_CHARSCAN_SSE2
+			struct VectorOps
+			{
+				typedef __m128i Vec_t;
+
+				static const size_t kWidth = 16;
+				static const uint32_t kFullMask = 0xffffu;
+
+				static Vec_t Load(const uint8_t *chars) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars)); }
+				static Vec_t Splat(uint8_t ch) { return _mm_set1_epi8(static_cast<char>(ch)); }
+				static Vec_t Equal(Vec_t a, Vec_t b) { return _mm_cmpeq_epi8(a, b); }
+				static Vec_t LessOrEqualUnsigned(Vec_t a, Vec_t b) { return _mm_cmpeq_epi8(_mm_min_epu8(a, b), a); }
+				static Vec_t Subtract(Vec_t a, Vec_t b) { return _mm_sub_epi8(a, b); }
+				static Vec_t Or(Vec_t a, Vec_t b) { return _mm_or_si128(a, b); }
+				static Vec_t And(Vec_t a, Vec_t b) { return _mm_and_si128(a, b); }
+				static Vec_t AndNot(Vec_t notA, Vec_t b) { return _mm_andnot_si128(notA, b); }
+				static uint32_t MoveMask(Vec_t v) { return static_cast<uint32_t>(_mm_movemask_epi8(v)); }
+			};
+#endif
+
+			struct IdentifierCharPredicate
+			{
+				bool Test(uint8_t ch) const
+				{
+					return (ch >= CharCode::kDigit0 && ch <= CharCode::kDigit9)
+						|| (ch >= CharCode::kLowercaseA && ch <= CharCode::kLowercaseZ)
+						|| (ch >= CharCode::kUppercaseA && ch <= CharCode::kUppercaseZ)
+						|| ch == CharCode::kUnderscore;
+				}
+
+#if EXPANSE_CHARSCAN_AVX2 || EXPANSE_CHARSCAN_SSE2
+				VectorOps::Vec_t Test(VectorOps::Vec_t v) const
+				{
+					typedef VectorOps V;
+
+					// Setting bit 5 folds upper case into lower case without moving anything else into a-z
+					const V::Vec_t folded = V::Or(v, V::Splat(0x20));
+					const V::Vec_t isLetter = V::LessOrEqualUnsigned(V::Subtract(folded, V::Splat(CharCode::kLowercaseA)), V::Splat(CharCode::kLowercaseZ - CharCode::kLowercaseA));
+					const V::Vec_t isDigit = V::LessOrEqualUnsigned(V::Subtract(v, V::Splat(CharCode::kDigit0)), V::Splat(CharCode::kDigit9 - CharCode::kDigit0));
+					const V::Vec_t isUnderscore = V::Equal(v, V::Splat(CharCode::kUnderscore));
+
+					return V::Or(V::Or(isLetter, isDigit), isUnderscore);
+				}
+#endif
+			};
+
+			struct WhitespacePredicate
+			{
+				// Matches CLexer's kControl and kWhitespace character types
+				bool Test(uint8_t ch) const
+				{
+					return (ch <= CharCode::kSpace && ch != CharCode::kCarriageReturn && ch != CharCode::kLineFeed) || ch == 0x7f;
+				}
+
+#if EXPANSE_CHARSCAN_AVX2 || EXPANSE_CHARSCAN_SSE2
+				VectorOps::Vec_t Test(VectorOps::Vec_t v) const
+				{
+					typedef VectorOps V;
+
+					const V::Vec_t isLow = V::LessOrEqualUnsigned(v, V::Splat(CharCode::kSpace));
+					const V::Vec_t isNewLine = V::Or(V::Equal(v, V::Splat(CharCode::kCarriageReturn)), V::Equal(v, V::Splat(CharCode::kLineFeed)));
+					const V::Vec_t isDelete = V::Equal(v, V::Splat(0x7f));
+
+					return V::Or(V::AndNot(isNewLine, isLow), isDelete);
+				}
+#endif
+			};
+
+			struct NotLineEndPredicate
+			{
+				bool Test(uint8_t ch) const
+				{
+					return ch != CharCode::kCarriageReturn && ch != CharCode::kLineFeed;
+				}
+
+#if EXPANSE_CHARSCAN_AVX2 || EXPANSE_CHARSCAN_SSE2
+				VectorOps::Vec_t Test(VectorOps::Vec_t v) const
+				{
+					typedef VectorOps V;
+
+					const V::Vec_t isNewLine = V::Or(V::Equal(v, V::Splat(CharCode::kCarriageReturn)), V::Equal(v, V::Splat(CharCode::kLineFeed)));
+					return V::AndNot(isNewLine, V::Equal(v, v));
+				}
+#endif
+			};
+
+			struct NotCarriageReturnOrBackslashPredicate
+			{
+				bool Test(uint8_t ch) const
+				{
+					return ch != CharCode::kCarriageReturn && ch != CharCode::kBackslash;
+				}
+
+#if EXPANSE_CHARSCAN_AVX2 || EXPANSE_CHARSCAN_SSE2
+				VectorOps::Vec_t Test(VectorOps::Vec_t v) const
+				{
+					typedef VectorOps V;
+
+					const V::Vec_t isSpecial = V::Or(V::Equal(v, V::Splat(CharCode::kCarriageReturn)), V::Equal(v, V::Splat(CharCode::kBackslash)));
+					return V::AndNot(isSpecial, V::Equal(v, v));
+				}
+#endif
+			};
+
+			struct CharSequenceBodyPredicate
+			{
+				explicit CharSequenceBodyPredicate(uint8_t terminator)
+					: m_terminator(terminator)
+				{
+				}
+
+				bool Test(uint8_t ch) const
+				{
+					return ch != m_terminator && ch != CharCode::kBackslash && ch != CharCode::kCarriageReturn && ch != CharCode::kLineFeed;
+				}
+
+#if EXPANSE_CHARSCAN_AVX2 || EXPANSE_CHARSCAN_SSE2
+				VectorOps::Vec_t Test(VectorOps::Vec_t v) const
+				{
+					typedef VectorOps V;
+
+					const V::Vec_t isNewLine = V::Or(V::Equal(v, V::Splat(CharCode::kCarriageReturn)), V::Equal(v, V::Splat(CharCode::kLineFeed)));
+					const V::Vec_t isSpecial = V::Or(V::Equal(v, V::Splat(m_terminator)), V::Equal(v, V::Splat(CharCode::kBackslash)));
+
+					return V::AndNot(V::Or(isNewLine, isSpecial), V::Equal(v, v));
+				}
+#endif
+
+				uint8_t m_terminator;
+			};
+
+			struct SkippedTextPredicate
+			{
+				bool Test(uint8_t ch) const
+				{
+					return ch != CharCode::kCarriageReturn && ch != CharCode::kLineFeed && ch != CharCode::kSlash
+						&& ch != CharCode::kSingleQuote && ch != CharCode::kDoubleQuote;
+				}
+
+#if EXPANSE_CHARSCAN_AVX2 || EXPANSE_CHARSCAN_SSE2
+				VectorOps::Vec_t Test(VectorOps::Vec_t v) const
+				{
+					typedef VectorOps V;
+
+					const V::Vec_t isNewLine = V::Or(V::Equal(v, V::Splat(CharCode::kCarriageReturn)), V::Equal(v, V::Splat(CharCode::kLineFeed)));
+					const V::Vec_t isQuote = V::Or(V::Equal(v, V::Splat(CharCode::kSingleQuote)), V::Equal(v, V::Splat(CharCode::kDoubleQuote)));
+					const V::Vec_t isSlash = V::Equal(v, V::Splat(CharCode::kSlash));
+
+					return V::AndNot(V::Or(V::Or(isNewLine, isQuote), isSlash), V::Equal(v, v));
+				}
+#endif
+			};
+
+			template<class TPredicate>
+			size_t ScanWhile(const uint8_t *chars, size_t size, const TPredicate &predicate, bool useVectorKernels)
+			{
+				// Most runs are empty or a few bytes long, don't pay for a vector load on those
+				if (size == 0 || !predicate.Test(chars[0]))
+					return 0;
+
+				size_t offset = 1;
+
+#if EXPANSE_CHARSCAN_AVX2 || EXPANSE_CHARSCAN_SSE2
+				if (useVectorKernels)
+				{
+					while (size - offset >= VectorOps::kWidth)
+					{
+						const uint32_t mismatches = ~VectorOps::MoveMask(predicate.Test(VectorOps::Load(chars + offset))) & VectorOps::kFullMask;
+						if (mismatches != 0)
+							return offset + CountTrailingZeros(mismatches);
+
+						offset += VectorOps::kWidth;
+					}
+				}
+#endif
+
+				while (offset < size && predicate.Test(chars[offset]))
+					offset++;
+
+				return offset;
+			}
+		}
+
+		bool CharScan::ms_vectorKernelsEnabled = true;
+
+		size_t CharScan::ScanIdentifierChars(const uint8_t *chars, size_t size)
+		{
+			return ScanWhile(chars, size, IdentifierCharPredicate(), ms_vectorKernelsEnabled);
+		}
+
+		size_t CharScan::ScanWhitespace(const uint8_t *chars, size_t size)
+		{
+			return ScanWhile(chars, size, WhitespacePredicate(), ms_vectorKernelsEnabled);
+		}
+
+		size_t CharScan::ScanToLineEnd(const uint8_t *chars, size_t size)
+		{
+			return ScanWhile(chars, size, NotLineEndPredicate(), ms_vectorKernelsEnabled);
+		}
+
+		size_t CharScan::ScanToCarriageReturnOrBackslash(const uint8_t *chars, size_t size)
+		{
+			return ScanWhile(chars, size, NotCarriageReturnOrBackslashPredicate(), ms_vectorKernelsEnabled);
+		}
+
+		size_t CharScan::ScanToBlockCommentEnd(const uint8_t *chars, size_t size)
+		{
+			size_t offset = 0;
+
+#if EXPANSE_CHARSCAN_AVX2 || EXPANSE_CHARSCAN_SSE2
+			if (ms_vectorKernelsEnabled)
+			{
+				const VectorOps::Vec_t asterisks = VectorOps::Splat(CharCode::kAsterisk);
+				const VectorOps::Vec_t slashes = VectorOps::Splat(CharCode::kSlash);
+
+				// Compares each byte with the next one, so a block needs one byte past it
+				while (size - offset > VectorOps::kWidth)
+				{
+					const VectorOps::Vec_t isAsterisk = VectorOps::Equal(VectorOps::Load(chars + offset), asterisks);
+					const VectorOps::Vec_t isSlashNext = VectorOps::Equal(VectorOps::Load(chars + offset + 1), slashes);
+
+					const uint32_t matches = VectorOps::MoveMask(VectorOps::And(isAsterisk, isSlashNext));
+					if (matches != 0)
+						return offset + CountTrailingZeros(matches);
+
+					offset += VectorOps::kWidth;
+				}
+			}
+#endif
+
+			for (; size - offset >= 2; offset++)
+			{
+				if (chars[offset] == CharCode::kAsterisk && chars[offset + 1] == CharCode::kSlash)
+					return offset;
+			}
+
+			return size;
+		}
+
+		size_t CharScan::ScanCharSequenceBody(const uint8_t *chars, size_t size, uint8_t terminator)
+		{
+			return ScanWhile(chars, size, CharSequenceBodyPredicate(terminator), ms_vectorKernelsEnabled);
+		}
+
+		size_t CharScan::ScanSkippedText(const uint8_t *chars, size_t size)
+		{
+			return ScanWhile(chars, size, SkippedTextPredicate(), ms_vectorKernelsEnabled);
+		}
+
+		void CharScan::SetVectorKernelsEnabled(bool enabled)
+		{
+			ms_vectorKernelsEnabled = enabled;
+		}
+
+		const char *CharScan::GetVectorKernelName()
+		{
+#if EXPANSE_CHARSCAN_AVX2
+			return "AVX2";
+#elif EXPANSE_CHARSCAN_SSE2
+			return "SSE2";
+#else
+			return "none";
+#endif
+		}
+	}
+}
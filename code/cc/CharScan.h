@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	namespace cc
+	{
+		// Byte scanning kernels for the lexer's most common runs.  Each one returns how many bytes from the start of
+		// the range belong to the run, testing 32 bytes at a time with AVX2 or 16 with SSE2 when the build targets
+		// them, and a byte at a time otherwise.  They work on raw bytes, so runs must not contain anything that
+		// ConsumeLogicalChar would treat differently.
+		class CharScan
+		{
+		public:
+			// [A-Za-z0-9_]
+			static size_t ScanIdentifierChars(const uint8_t *chars, size_t size);
+
+			// Spaces and control characters other than CR and LF
+			static size_t ScanWhitespace(const uint8_t *chars, size_t size);
+
+			// Everything up to the first CR or LF
+			static size_t ScanToLineEnd(const uint8_t *chars, size_t size);
+
+			// Everything up to the first CR or backslash
+			static size_t ScanToCarriageReturnOrBackslash(const uint8_t *chars, size_t size);
+
+			// Everything up to the "*/" that closes a block comment, or size if there isn't one
+			static size_t ScanToBlockCommentEnd(const uint8_t *chars, size_t size);
+
+			// Everything up to the first terminator, backslash, CR or LF
+			static size_t ScanCharSequenceBody(const uint8_t *chars, size_t size, uint8_t terminator);
+
+			// Everything up to the first CR, LF, slash or quote, which are all a skipped line needs to look at
+			static size_t ScanSkippedText(const uint8_t *chars, size_t size);
+
+			// For benchmarking, forces the scalar kernels.  Not thread-safe, only change it while nothing is lexing.
+			static void SetVectorKernelsEnabled(bool enabled);
+			static const char *GetVectorKernelName();
+
+		private:
+			static bool ms_vectorKernelsEnabled;
+		};
+	}
+}
@@ -15,6 +15,7 @@ namespace expanse
 			, m_floatLType(LType::kFloat32)
 			, m_doubleLType(LType::kFloat64)
 			, m_intptrLType(LType::kSInt32)
+			, m_memoizeSpeculativeParses(true)
 		{
 		}
 	}
@@ -26,6 +26,7 @@ namespace expanse
 			LType m_floatLType;
 			LType m_doubleLType;
 			LType m_intptrLType;
+			bool m_memoizeSpeculativeParses;
 
 			CompilerConfiguration();
 		};
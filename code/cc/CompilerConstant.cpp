@@ -1,10 +1,61 @@
 #include "CompilerConstant.h"
 #include "ExpAssert.h"
 
+#include <cmath>
+#include <cstring>
+#include <new>
+
 namespace expanse
 {
 	namespace cc
 	{
+		namespace
+		{
+			uint64_t GetBits(const MaxUInt &value)
+			{
+				uint8_t bytes[MaxUInt::kMaxBytes];
+				value.ToLittleEndian(bytes, MaxUInt::kMaxBytes);
+
+				uint64_t bits = 0;
+				for (size_t i = 0; i < MaxUInt::kMaxBytes; i++)
+					bits |= static_cast<uint64_t>(bytes[i]) << (i * 8);
+
+				return bits;
+			}
+
+			double FloatBitsToDouble(LType lType, uint64_t bits)
+			{
+				if (lType == LType::kFloat32)
+				{
+					const uint32_t floatBits = static_cast<uint32_t>(bits);
+					float f = 0.0f;
+					memcpy(&f, &floatBits, sizeof(f));
+					return f;
+				}
+
+				double d = 0.0;
+				memcpy(&d, &bits, sizeof(d));
+				return d;
+			}
+
+			template<class T>
+			uint64_t ToFloatBits(LType lType, T value)
+			{
+				if (lType == LType::kFloat32)
+				{
+					const float f = static_cast<float>(value);
+					uint32_t floatBits = 0;
+					memcpy(&floatBits, &f, sizeof(f));
+					return floatBits;
+				}
+
+				const double d = static_cast<double>(value);
+				uint64_t bits = 0;
+				memcpy(&bits, &d, sizeof(d));
+				return bits;
+			}
+		}
+
 		CompilerConstant::CompilerConstant()
 			: m_u(MaxSInt(0))
 			, m_isSigned(true)
@@ -53,10 +104,100 @@ namespace expanse
 
 		MaxUInt CompilerConstant::GetUnsigned() const
 		{
-			EXP_ASSERT(m_isSigned);
+			EXP_ASSERT(!m_isSigned);
 			return m_u.m_u;
 		}
 
+		bool CompilerConstant::ConvertTo(LType lType, CompilerConstant &outConverted) const
+		{
+			const bool sourceIsFloat = IsFloatLType(m_ltype);
+
+			const uint64_t sourceBits = m_isSigned ? GetBits(m_u.m_s.BitCastToUnsigned()) : GetBits(m_u.m_u);
+
+			if (IsFloatLType(lType))
+			{
+				uint64_t bits = 0;
+				if (sourceIsFloat)
+					bits = ToFloatBits(lType, FloatBitsToDouble(m_ltype, sourceBits));
+				else if (m_isSigned)
+					bits = ToFloatBits(lType, static_cast<int64_t>(sourceBits));
+				else
+					bits = ToFloatBits(lType, sourceBits);
+
+				outConverted = CompilerConstant(lType, MaxUInt(bits));
+				return true;
+			}
+
+			const unsigned int numBits = static_cast<unsigned int>(GetLTypeSize(lType) * 8);
+			const bool isSigned = IsSignedIntegerLType(lType);
+
+			uint64_t bits = sourceBits;
+			if (sourceIsFloat)
+			{
+				// Truncated toward zero, which has to fit (6.3.1.4).  NaNs fail both comparisons.
+				const double d = FloatBitsToDouble(m_ltype, sourceBits);
+
+				if (isSigned)
+				{
+					const double limit = std::ldexp(1.0, static_cast<int>(numBits - 1));
+					if (!(d > -limit - 1.0 && d < limit))
+						return false;
+
+					bits = static_cast<uint64_t>(static_cast<int64_t>(d));
+				}
+				else
+				{
+					if (!(d > -1.0 && d < std::ldexp(1.0, static_cast<int>(numBits))))
+						return false;
+
+					bits = static_cast<uint64_t>(d);
+				}
+			}
+
+			const uint64_t mask = (numBits == 64) ? ~static_cast<uint64_t>(0) : ((static_cast<uint64_t>(1) << numBits) - 1);
+			bits &= mask;
+
+			if (isSigned)
+			{
+				if ((bits >> (numBits - 1)) & 1)
+					bits |= ~mask;
+
+				outConverted = CompilerConstant(lType, MaxUInt(bits).BitCastToSigned());
+			}
+			else
+				outConverted = CompilerConstant(lType, MaxUInt(bits));
+
+			return true;
+		}
+
+		bool CompilerConstant::IsNonZero() const
+		{
+			if (IsFloatLType(m_ltype))
+				return ToDouble() != 0.0;
+
+			if (m_isSigned)
+				return m_u.m_s != MaxSInt(0);
+
+			return m_u.m_u != MaxUInt(0);
+		}
+
+		double CompilerConstant::ToDouble() const
+		{
+			if (IsFloatLType(m_ltype))
+				return FloatBitsToDouble(m_ltype, GetBits(m_u.m_u));
+
+			if (m_isSigned)
+				return static_cast<double>(static_cast<int64_t>(GetBits(m_u.m_s.BitCastToUnsigned())));
+
+			return static_cast<double>(GetBits(m_u.m_u));
+		}
+
+		CompilerConstant CompilerConstant::FromDouble(LType floatLType, double value)
+		{
+			EXP_ASSERT(IsFloatLType(floatLType));
+			return CompilerConstant(floatLType, MaxUInt(ToFloatBits(floatLType, value)));
+		}
+
 		CompilerConstant &CompilerConstant::operator=(const CompilerConstant &other)
 		{
 			if (m_isSigned == other.m_isSigned)
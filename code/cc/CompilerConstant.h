@@ -20,6 +20,19 @@ namespace expanse
 			MaxSInt GetSigned() const;
 			MaxUInt GetUnsigned() const;
 
+			// Converts to another arithmetic type the way C does (6.3.1).  Narrowing integers wraps around, which
+			// the implementation defines signed types to do too.  Returns false if a floating value truncated toward
+			// zero doesn't fit in an integer type.
+			bool ConvertTo(LType lType, CompilerConstant &outConverted) const;
+
+			bool IsNonZero() const;
+
+			// The value of any arithmetic constant, rounded if it's an integer that a double can't hold exactly
+			double ToDouble() const;
+
+			// Rounds the value to a floating type
+			static CompilerConstant FromDouble(LType floatLType, double value);
+
 			CompilerConstant &operator=(const CompilerConstant &other);
 
 		private:
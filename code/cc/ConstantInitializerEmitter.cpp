@@ -0,0 +1,128 @@
+#include "ConstantInitializerEmitter.h"
+#include "CompilerConstant.h"
+#include "ExpAssert.h"
+#include "IHAsmWriter.h"
+#include "Result.h"
+#include "ResultRV.h"
+
+#include <limits>
+
+namespace expanse
+{
+	namespace cc
+	{
+		ConstantInitializerEmitter::ConstantInitializerEmitter(IHAsmWriter *asmWriter, LType elementLType)
+			: m_asmWriter(asmWriter)
+			, m_elementLType(elementLType)
+			, m_codedType(GetCodedType(elementLType))
+			, m_elementSize(GetLTypeSize(elementLType))
+			, m_maxNumElements(static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) / GetLTypeSize(elementLType))
+			, m_nextIndex(0)
+			, m_writtenIndex(0)
+			, m_numElements(0)
+		{
+			EXP_ASSERT(IsElementLType(elementLType));
+		}
+
+		void ConstantInitializerEmitter::SeekToElement(const MaxUInt &index)
+		{
+			m_nextIndex = index;
+		}
+
+		ResultRV<bool> ConstantInitializerEmitter::EmitElement(const CompilerConstant &value)
+		{
+			if (m_nextIndex >= m_maxNumElements)
+				return false;
+
+			CompilerConstant converted;
+			if (!value.ConvertTo(m_elementLType, converted))
+				return false;
+
+			if (m_nextIndex != m_writtenIndex)
+				CHECK(SeekFromWrittenPosition(m_nextIndex));
+
+			CHECK(m_asmWriter->WriteDataEmitOpt(HAsmDataEmitOpt(converted, 0, m_codedType)));
+
+			m_nextIndex = m_nextIndex + MaxUInt(1);
+			m_writtenIndex = m_nextIndex;
+
+			if (m_numElements < m_nextIndex)
+				m_numElements = m_nextIndex;
+
+			return true;
+		}
+
+		ResultRV<bool> ConstantInitializerEmitter::Finish(const MaxUInt &numElements)
+		{
+			if (!CanHoldElements(numElements))
+				return false;
+
+			if (numElements > m_writtenIndex)
+				CHECK(SeekFromWrittenPosition(numElements));
+
+			return true;
+		}
+
+		bool ConstantInitializerEmitter::CanHoldElements(const MaxUInt &numElements) const
+		{
+			return numElements <= m_maxNumElements;
+		}
+
+		const MaxUInt &ConstantInitializerEmitter::GetNextIndex() const
+		{
+			return m_nextIndex;
+		}
+
+		const MaxUInt &ConstantInitializerEmitter::GetNumElements() const
+		{
+			return m_numElements;
+		}
+
+		bool ConstantInitializerEmitter::IsElementLType(LType lType)
+		{
+			return lType != LType::kAddress;
+		}
+
+		HAsmDataEmitOpt::CodedType ConstantInitializerEmitter::GetCodedType(LType lType)
+		{
+			switch (lType)
+			{
+			case LType::kSInt8:
+				return HAsmDataEmitOpt::CodedType::kS8;
+			case LType::kSInt16:
+				return HAsmDataEmitOpt::CodedType::kS16;
+			case LType::kSInt32:
+				return HAsmDataEmitOpt::CodedType::kS32;
+			case LType::kSInt64:
+				return HAsmDataEmitOpt::CodedType::kS64;
+			case LType::kUInt8:
+				return HAsmDataEmitOpt::CodedType::kU8;
+			case LType::kUInt16:
+				return HAsmDataEmitOpt::CodedType::kU16;
+			case LType::kUInt32:
+				return HAsmDataEmitOpt::CodedType::kU32;
+			case LType::kUInt64:
+				return HAsmDataEmitOpt::CodedType::kU64;
+			case LType::kFloat32:
+				return HAsmDataEmitOpt::CodedType::kF32;
+			case LType::kFloat64:
+				return HAsmDataEmitOpt::CodedType::kF64;
+			default:
+				EXP_ASSERT(false);
+				return HAsmDataEmitOpt::CodedType::kU8;
+			}
+		}
+
+		Result ConstantInitializerEmitter::SeekFromWrittenPosition(const MaxUInt &index)
+		{
+			// Both indexes are below m_maxNumElements, so the wrapped difference in bytes is the signed offset
+			const MaxUInt offset = (index - m_writtenIndex) * MaxUInt(m_elementSize);
+
+			CHECK(m_asmWriter->WriteDataSeekOpt(HAsmDataSeekOpt(offset.BitCastToSigned())));
+
+			m_writtenIndex = index;
+
+			return ErrorCode::kOK;
+		}
+	}
+}
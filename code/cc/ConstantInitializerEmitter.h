@@ -0,0 +1,68 @@
+#pragma once
+
+#include "HAssembly.h"
+#include "LType.h"
+#include "MaxInt.h"
+
+#include <cstddef>
+
+namespace expanse
+{
+	struct Result;
+	template<class T> struct ResultRV;
+
+	namespace cc
+	{
+		struct CompilerConstant;
+		struct IHAsmWriter;
+
+		// Writes the elements of an array of scalars to an open data section as each one is compiled, so that
+		// nothing about an element needs to be kept once it has been emitted.  Elements that designators skip over
+		// are left to the zero fill of the section, and a seek is only written when an element doesn't directly
+		// follow the last one written.
+		class ConstantInitializerEmitter
+		{
+		public:
+			ConstantInitializerEmitter(IHAsmWriter *asmWriter, LType elementLType);
+
+			// Sets the index that the next element goes to
+			void SeekToElement(const MaxUInt &index);
+
+			// Converts the value to the element type and emits it at the current index.  Returns false without
+			// writing anything if the value can't be converted or the index is too large to seek to.
+			ResultRV<bool> EmitElement(const CompilerConstant &value);
+
+			// Extends the section to hold numElements elements if fewer than that were written.  Returns false if
+			// that's too large to seek to.
+			ResultRV<bool> Finish(const MaxUInt &numElements);
+
+			// False if a section of numElements elements would be too large to seek to the end of
+			bool CanHoldElements(const MaxUInt &numElements) const;
+
+			// The index that the next element goes to, and one past the highest index that was emitted to
+			const MaxUInt &GetNextIndex() const;
+			const MaxUInt &GetNumElements() const;
+
+			static bool IsElementLType(LType lType);
+
+		private:
+			ConstantInitializerEmitter() = delete;
+
+			static HAsmDataEmitOpt::CodedType GetCodedType(LType lType);
+
+			Result SeekFromWrittenPosition(const MaxUInt &index);
+
+			IHAsmWriter *m_asmWriter;
+			LType m_elementLType;
+			HAsmDataEmitOpt::CodedType m_codedType;
+			size_t m_elementSize;
+
+			// Indexes past this are too far into the section to seek to
+			MaxUInt m_maxNumElements;
+
+			MaxUInt m_nextIndex;
+			MaxUInt m_writtenIndex;
+			MaxUInt m_numElements;
+		};
+	}
+}
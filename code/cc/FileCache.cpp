@@ -1,11 +1,29 @@
 #include "FileCache.h"
 
+#include "CharCodes.h"
+#include "Mutex.h"
+#include "MutexLock.h"
+#include "PPMacroTable.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "StringView.h"
+#include "Vector.h"
+
 namespace expanse
 {
 	namespace cc
 	{
 		FileCacheEntry::FileCacheEntry(bool exists)
 			: m_exists(exists)
+			, m_includeGuard(FileCacheIncludeGuard::kUnknown)
+		{
+		}
+
+		FileCacheEntry::FileCacheEntry(FileCacheEntry &&other)
+			: m_exists(other.m_exists)
+			, m_contents(std::move(other.m_contents))
+			, m_includeGuard(other.m_includeGuard)
+			, m_includeGuardMacro(std::move(other.m_includeGuardMacro))
 		{
 		}
 
@@ -13,6 +31,16 @@ namespace expanse
 		{
 		}
 
+		bool FileCacheEntry::Exists() const
+		{
+			return m_exists;
+		}
+
+		void FileCacheEntry::SetContents(ArrayPtr<uint8_t> &&contents)
+		{
+			m_contents = std::move(contents);
+		}
+
 		const ArrayPtr<uint8_t> &FileCacheEntry::GetContents() const
 		{
 			return m_contents;
@@ -23,11 +51,209 @@ namespace expanse
 			return ArrayPtr<uint8_t>(std::move(m_contents));
 		}
 
+		void FileCacheEntry::SetIncludeGuard(FileCacheIncludeGuard includeGuard, ArrayPtr<uint8_t> &&macroName)
+		{
+			m_includeGuard = includeGuard;
+			m_includeGuardMacro = std::move(macroName);
+		}
+
+		FileCacheIncludeGuard FileCacheEntry::GetIncludeGuard() const
+		{
+			return m_includeGuard;
+		}
+
+		ArrayView<const uint8_t> FileCacheEntry::GetIncludeGuardMacro() const
+		{
+			return m_includeGuardMacro.ConstView();
+		}
+
+		FileCacheEntry &FileCacheEntry::operator=(FileCacheEntry &&other)
+		{
+			m_exists = other.m_exists;
+			m_contents = std::move(other.m_contents);
+			m_includeGuard = other.m_includeGuard;
+			m_includeGuardMacro = std::move(other.m_includeGuardMacro);
+			return *this;
+		}
+
 		FileCache::FileCache(IAllocator *alloc)
-			: m_absolutePathCache(*alloc)
-			, m_includeDirsCache(*alloc)
-			, m_systemDirsCache(*alloc)
+			: m_entries(*alloc)
+			, m_hitCount(0)
+			, m_negativeHitCount(0)
+			, m_missCount(0)
+		{
+		}
+
+		FileCache::~FileCache()
 		{
 		}
+
+		Result FileCache::Initialize()
+		{
+			CHECK_RV(CorePtr<Mutex>, mutex, Mutex::Create(GetCoreObjectAllocator()));
+			m_mutex = std::move(mutex);
+
+			return ErrorCode::kOK;
+		}
+
+		ResultRV<FileCacheLookupResult> FileCache::Lookup(IAllocator *alloc, const UTF8StringView_t &device, const UTF8StringView_t &path, ArrayPtr<uint8_t> &outContents)
+		{
+			Vector<uint8_t> key(GetCoreObjectAllocator());
+			CHECK(BuildKey(key, device, path));
+
+			MutexLock lock(m_mutex);
+
+			HashMapIterator<TokenStr, FileCacheEntry> it = m_entries.Find(TokenStrView(key.ConstView()));
+			if (it == m_entries.end())
+			{
+				m_missCount.fetch_add(1, std::memory_order_relaxed);
+				return FileCacheLookupResult::kNotCached;
+			}
+
+			const FileCacheEntry &entry = it.Value();
+			if (!entry.Exists())
+			{
+				m_negativeHitCount.fetch_add(1, std::memory_order_relaxed);
+				return FileCacheLookupResult::kNotFound;
+			}
+
+			CHECK_RV(ArrayPtr<uint8_t>, contents, entry.GetContents().ConstView().Clone(alloc));
+			lock.Release();
+
+			outContents = std::move(contents);
+			m_hitCount.fetch_add(1, std::memory_order_relaxed);
+
+			return FileCacheLookupResult::kFound;
+		}
+
+		ResultRV<bool> FileCache::Contains(const UTF8StringView_t &device, const UTF8StringView_t &path)
+		{
+			Vector<uint8_t> key(GetCoreObjectAllocator());
+			CHECK(BuildKey(key, device, path));
+
+			MutexLock lock(m_mutex);
+
+			return m_entries.Contains(TokenStrView(key.ConstView()));
+		}
+
+		Result FileCache::AddFile(const UTF8StringView_t &device, const UTF8StringView_t &path, const ArrayView<const uint8_t> &contents)
+		{
+			CHECK_RV(ArrayPtr<uint8_t>, contentsCopy, contents.Clone(GetCoreObjectAllocator()));
+
+			FileCacheEntry entry(true);
+			entry.SetContents(std::move(contentsCopy));
+
+			return AddEntry(device, path, std::move(entry));
+		}
+
+		Result FileCache::AddMissingFile(const UTF8StringView_t &device, const UTF8StringView_t &path)
+		{
+			return AddEntry(device, path, FileCacheEntry(false));
+		}
+
+		ResultRV<FileCacheIncludeGuard> FileCache::LookupIncludeGuard(const UTF8StringView_t &device, const UTF8StringView_t &path, PPMacroTable &macros, bool &outIsMacroDefined)
+		{
+			Vector<uint8_t> key(GetCoreObjectAllocator());
+			CHECK(BuildKey(key, device, path));
+
+			MutexLock lock(m_mutex);
+
+			HashMapIterator<TokenStr, FileCacheEntry> it = m_entries.Find(TokenStrView(key.ConstView()));
+			if (it == m_entries.end())
+				return FileCacheIncludeGuard::kUnknown;
+
+			const FileCacheEntry &entry = it.Value();
+			const FileCacheIncludeGuard includeGuard = entry.GetIncludeGuard();
+
+			// The name is only in the cache's memory, so it has to be checked under the lock
+			if (includeGuard == FileCacheIncludeGuard::kMacro)
+				outIsMacroDefined = (macros.Find(entry.GetIncludeGuardMacro()) != nullptr);
+
+			return includeGuard;
+		}
+
+		Result FileCache::SetIncludeGuardMacro(const UTF8StringView_t &device, const UTF8StringView_t &path, const ArrayView<const uint8_t> &macroName)
+		{
+			return SetIncludeGuard(device, path, FileCacheIncludeGuard::kMacro, macroName);
+		}
+
+		Result FileCache::SetPragmaOnce(const UTF8StringView_t &device, const UTF8StringView_t &path)
+		{
+			return SetIncludeGuard(device, path, FileCacheIncludeGuard::kPragmaOnce, ArrayView<const uint8_t>());
+		}
+
+		uint64_t FileCache::GetHitCount() const
+		{
+			return m_hitCount.load(std::memory_order_relaxed);
+		}
+
+		uint64_t FileCache::GetNegativeHitCount() const
+		{
+			return m_negativeHitCount.load(std::memory_order_relaxed);
+		}
+
+		uint64_t FileCache::GetMissCount() const
+		{
+			return m_missCount.load(std::memory_order_relaxed);
+		}
+
+		Result FileCache::BuildKey(Vector<uint8_t> &outKey, const UTF8StringView_t &device, const UTF8StringView_t &path) const
+		{
+			const uint8_t divider[] = { CharCode::kColon, CharCode::kSlash, CharCode::kSlash };
+
+			CHECK(outKey.Add(device.GetChars()));
+			CHECK(outKey.Add(ArrayView<const uint8_t>(divider)));
+			CHECK(outKey.Add(path.GetChars()));
+
+			return ErrorCode::kOK;
+		}
+
+		Result FileCache::AddEntry(const UTF8StringView_t &device, const UTF8StringView_t &path, FileCacheEntry &&entry)
+		{
+			IAllocator *alloc = GetCoreObjectAllocator();
+
+			Vector<uint8_t> keyBuilder(alloc);
+			CHECK(BuildKey(keyBuilder, device, path));
+
+			CHECK_RV(ArrayPtr<uint8_t>, keyChars, keyBuilder.ConstView().Clone(alloc));
+
+			MutexLock lock(m_mutex);
+
+			// Another preprocessor may have loaded the same file in the meantime, in which case the first result is kept
+			if (m_entries.Contains(TokenStrView(keyBuilder.ConstView())))
+				return ErrorCode::kOK;
+
+			CHECK(m_entries.Insert(TokenStr(std::move(keyChars)), std::move(entry)));
+
+			return ErrorCode::kOK;
+		}
+
+		Result FileCache::SetIncludeGuard(const UTF8StringView_t &device, const UTF8StringView_t &path, FileCacheIncludeGuard includeGuard, const ArrayView<const uint8_t> &macroName)
+		{
+			IAllocator *alloc = GetCoreObjectAllocator();
+
+			Vector<uint8_t> key(alloc);
+			CHECK(BuildKey(key, device, path));
+
+			ArrayPtr<uint8_t> macroNameCopy;
+			if (macroName.Size() > 0)
+			{
+				CHECK_RV_ASSIGN(macroNameCopy, macroName.Clone(alloc));
+			}
+
+			MutexLock lock(m_mutex);
+
+			HashMapIterator<TokenStr, FileCacheEntry> it = m_entries.Find(TokenStrView(key.ConstView()));
+			if (it == m_entries.end())
+				return ErrorCode::kOK;
+
+			// Every preprocessor finds the same guard, but #pragma once can be found before the end of the file where a
+			// macro guard is, so it replaces one
+			FileCacheEntry &entry = it.Value();
+			if (entry.GetIncludeGuard() == FileCacheIncludeGuard::kUnknown || (includeGuard == FileCacheIncludeGuard::kPragmaOnce && entry.GetIncludeGuard() != FileCacheIncludeGuard::kPragmaOnce))
+				entry.SetIncludeGuard(includeGuard, std::move(macroNameCopy));
+
+			return ErrorCode::kOK;
+		}
 	}
 }
@@ -1,38 +1,115 @@
 #pragma once
 
+#include "ArrayPtr.h"
 #include "CoreObject.h"
+#include "CorePtr.h"
 #include "HashMap.h"
-#include "XString.h"
+#include "PPTokenStr.h"
+#include "StringProto.h"
+
+#include <atomic>
+#include <cstdint>
 
 namespace expanse
 {
+	template<class T> struct ResultRV;
+	template<class T> struct Vector;
+	class Mutex;
+	struct Result;
+
 	namespace cc
 	{
+		class PPMacroTable;
+
+		enum class FileCacheLookupResult
+		{
+			kNotCached,
+			kFound,
+			kNotFound,
+		};
+
+		// What keeps a file from contributing anything when it's included again, as found by the first preprocessor
+		// to reach its end.  A macro guard applies wherever the macro is defined, #pragma once only applies to
+		// translation units that have already included the file.
+		enum class FileCacheIncludeGuard
+		{
+			kUnknown,
+			kMacro,
+			kPragmaOnce,
+		};
+
 		struct FileCacheEntry final
 		{
 		public:
 			explicit FileCacheEntry(bool exists);
+			FileCacheEntry(FileCacheEntry &&other);
 			~FileCacheEntry();
 
 			bool Exists() const;
 
+			void SetContents(ArrayPtr<uint8_t> &&contents);
 			const ArrayPtr<uint8_t> &GetContents() const;
 			ArrayPtr<uint8_t> TakeContents();
 
+			void SetIncludeGuard(FileCacheIncludeGuard includeGuard, ArrayPtr<uint8_t> &&macroName);
+			FileCacheIncludeGuard GetIncludeGuard() const;
+			ArrayView<const uint8_t> GetIncludeGuardMacro() const;
+
+			FileCacheEntry &operator=(FileCacheEntry &&other);
+
 		private:
+			FileCacheEntry(const FileCacheEntry &other) = delete;
+			FileCacheEntry &operator=(const FileCacheEntry &other) = delete;
+
 			bool m_exists;
 			ArrayPtr<uint8_t> m_contents;
+
+			FileCacheIncludeGuard m_includeGuard;
+			ArrayPtr<uint8_t> m_includeGuardMacro;
 		};
 
+		// Memoizes the results of include file loads, both found and not found, by resolved device and path.
+		// May be shared by multiple preprocessors, including ones running on other threads.
 		class FileCache final : public CoreObject
 		{
 		public:
 			explicit FileCache(IAllocator *alloc);
+			~FileCache();
+
+			Result Initialize();
+
+			// If the file was found, outContents receives a copy of the contents allocated from alloc.
+			ResultRV<FileCacheLookupResult> Lookup(IAllocator *alloc, const UTF8StringView_t &device, const UTF8StringView_t &path, ArrayPtr<uint8_t> &outContents);
+
+			// Checks for an entry, found or not found, without copying anything or affecting the hit counters
+			ResultRV<bool> Contains(const UTF8StringView_t &device, const UTF8StringView_t &path);
+
+			Result AddFile(const UTF8StringView_t &device, const UTF8StringView_t &path, const ArrayView<const uint8_t> &contents);
+			Result AddMissingFile(const UTF8StringView_t &device, const UTF8StringView_t &path);
+
+			// Looks up a file's include guard without copying anything.  For a macro guard, outIsMacroDefined is set
+			// to whether macros currently defines it.
+			ResultRV<FileCacheIncludeGuard> LookupIncludeGuard(const UTF8StringView_t &device, const UTF8StringView_t &path, PPMacroTable &macros, bool &outIsMacroDefined);
+
+			// #pragma once takes precedence over a macro guard.  Files that aren't in the cache are ignored.
+			Result SetIncludeGuardMacro(const UTF8StringView_t &device, const UTF8StringView_t &path, const ArrayView<const uint8_t> &macroName);
+			Result SetPragmaOnce(const UTF8StringView_t &device, const UTF8StringView_t &path);
+
+			uint64_t GetHitCount() const;
+			uint64_t GetNegativeHitCount() const;
+			uint64_t GetMissCount() const;
 
 		private:
-			HashMap<UTF8String_t, FileCacheEntry> m_absolutePathCache;
-			HashMap<UTF8String_t, FileCacheEntry> m_includeDirsCache;
-			HashMap<UTF8String_t, FileCacheEntry> m_systemDirsCache;
+			Result BuildKey(Vector<uint8_t> &outKey, const UTF8StringView_t &device, const UTF8StringView_t &path) const;
+			Result AddEntry(const UTF8StringView_t &device, const UTF8StringView_t &path, FileCacheEntry &&entry);
+			Result SetIncludeGuard(const UTF8StringView_t &device, const UTF8StringView_t &path, FileCacheIncludeGuard includeGuard, const ArrayView<const uint8_t> &macroName);
+
+			CorePtr<Mutex> m_mutex;
+			HashMap<TokenStr, FileCacheEntry> m_entries;
+
+			std::atomic<uint64_t> m_hitCount;
+			std::atomic<uint64_t> m_negativeHitCount;
+			std::atomic<uint64_t> m_missCount;
 		};
 	}
 }
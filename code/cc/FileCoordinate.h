@@ -1,21 +1,36 @@
 #pragma once
 
+#include <cstddef>
+
 namespace expanse
 {
 	namespace cc
 	{
+		// Position in a file as a byte offset.  Line and column are only worked out, as a FileLocation, when
+		// something needs to show them.
 		struct FileCoordinate
 		{
 			FileCoordinate();
-			FileCoordinate(size_t m_fileOffset, unsigned int m_lineNumber, unsigned int m_column);
+			explicit FileCoordinate(size_t fileOffset);
 
 			size_t m_fileOffset;
-			unsigned int m_lineNumber;
-			unsigned int m_column;
+
+			// Which of the compiler's buffered tokens is lexed from here, so backtracking to this position
+			// doesn't have to search for it.  Only a hint, it's checked against the offset and doesn't affect equality.
+			size_t m_tokenIndexHint;
 
 			bool operator==(const FileCoordinate &other) const;
 			bool operator!=(const FileCoordinate &other) const;
 		};
+
+		struct FileLocation
+		{
+			FileLocation();
+			FileLocation(unsigned int lineNumber, unsigned int column);
+
+			unsigned int m_lineNumber;
+			unsigned int m_column;
+		};
 	}
 }
 
@@ -25,26 +40,36 @@ namespace expanse
 	{
 		inline FileCoordinate::FileCoordinate()
 			: m_fileOffset(0)
-			, m_lineNumber(0)
-			, m_column(0)
+			, m_tokenIndexHint(0)
 		{
 		}
 
-		inline FileCoordinate::FileCoordinate(size_t fileOffset, unsigned int lineNumber, unsigned int column)
+		inline FileCoordinate::FileCoordinate(size_t fileOffset)
 			: m_fileOffset(fileOffset)
-			, m_lineNumber(lineNumber)
-			, m_column(column)
+			, m_tokenIndexHint(0)
 		{
 		}
 
 		inline bool FileCoordinate::operator==(const FileCoordinate &other) const
 		{
-			return m_fileOffset == other.m_fileOffset && m_lineNumber == other.m_lineNumber && m_column == other.m_column;
+			return m_fileOffset == other.m_fileOffset;
 		}
 
 		inline bool FileCoordinate::operator!=(const FileCoordinate &other) const
 		{
 			return !((*this) == other);
 		}
+
+		inline FileLocation::FileLocation()
+			: m_lineNumber(0)
+			, m_column(0)
+		{
+		}
+
+		inline FileLocation::FileLocation(unsigned int lineNumber, unsigned int column)
+			: m_lineNumber(lineNumber)
+			, m_column(column)
+		{
+		}
 	}
 }
@@ -20,7 +20,7 @@ namespace expanse
 		{
 			static const uint8_t kFlagMergeable = 1;
 			static const uint8_t kFlagStructural = 2;
-			static const uint8_t kFlagReadOnly = 3;
+			static const uint8_t kFlagReadOnly = 4;
 
 			size_t m_structureReference;
 			size_t m_objectID;
@@ -2,6 +2,8 @@
 #include "Hasher.h"
 #include "ExpAssert.h"
 
+#include <new>
+
 namespace expanse
 {
 	namespace cc
@@ -95,6 +97,16 @@ namespace expanse
 			return !((*this) == other);
 		}
 
+		HTypeFloating::FloatingType HTypeFloating::GetFloatingType() const
+		{
+			return m_floatingType;
+		}
+
+		HTypeFloating::ComplexityClass HTypeFloating::GetComplexityClass() const
+		{
+			return m_complexityClass;
+		}
+
 		uint32_t HTypeFloating::GetHash() const
 		{
 			uint8_t inputs[] = { static_cast<uint8_t>(m_floatingType), static_cast<uint8_t>(m_complexityClass) };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 
 #include "CoreObject.h"
 #include "CAggregateType.h"
@@ -79,6 +80,9 @@ namespace expanse
 			bool operator==(const HTypeFloating &other) const;
 			bool operator!=(const HTypeFloating &other) const;
 
+			FloatingType GetFloatingType() const;
+			ComplexityClass GetComplexityClass() const;
+
 			uint32_t GetHash() const;
 
 		private:
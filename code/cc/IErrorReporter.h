@@ -18,6 +18,7 @@ namespace expanse
 			kUnknownError,
 
 			kEndOfFileInCharacterSequence,
+			kEndOfFileInComment,
 			kNewlineInCharacterSequence,
 			kInvalidEscapeSequence,
 			kInvalidCharacter,
@@ -34,6 +35,21 @@ namespace expanse
 			kPPExpectedNewLineAfterElse,
 			kPPEndIfOutsideOfLogic,
 			kPPExpectedNewLineAfterEndIf,
+			kPPExpectedMacroName,
+			kPPInvalidMacroParameterList,
+			kPPMacroRedefinition,
+			kPPStringifyWithoutParameter,
+			kPPPasteAtEdgeOfReplacementList,
+			kPPVaArgsOutsideVariadicMacro,
+			kPPExpectedNewLineAfterUndef,
+			kPPUnterminatedMacroInvocation,
+			kPPMacroArgumentCountMismatch,
+			kPPInvalidTokenPaste,
+			kPPMacroArgumentsNestedTooDeeply,
+			kPPExpectedNewLineAfterIfDef,
+			kPPInvalidCondition,
+			kPPConditionOverflow,
+			kPPConditionDivisionByZero,
 
 			kExpectedExternalDeclaration,
 			kExpectedDeclarationSpecifiers,
@@ -52,6 +68,13 @@ namespace expanse
 			kVariableSizeArrayedNotSupported,
 			kAutoOrRegisterNotAllowedOnExternalDeclaration,
 			kSymbolRedefinition,
+			kInvalidArraySize,
+			kInvalidDesignator,
+			kTooManyInitializers,
+			kExpectedConstantExpression,
+			kInvalidNumericConstant,
+			kConstantOutOfRange,
+			kNestedTooDeeply,
 
 			kUnexpectedEndOfFile,
 			kUnexpectedToken,
@@ -4,16 +4,18 @@
 
 namespace expanse
 {
+	struct Result;
+
 	namespace cc
 	{
-		struct FileCoordinate;
+		struct FileLocation;
 		struct TokenStrView;
 
 		struct IIncludeStackTrace
 		{
 			virtual void Reset() = 0;
 			virtual bool Pop() = 0;
-			virtual void GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileCoordinate &outCoordinate) const = 0;
+			virtual Result GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileLocation &outLocation) const = 0;
 			virtual TokenStrView GetCurrentTraceFile() const = 0;
 		};
 	}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+
+namespace expanse
+{
+	namespace cc
+	{
+		// Dense index of an identifier spelling in an IdentifierTable.  Two atoms from the same table are equal if and
+		// only if their spellings are, atoms from different tables can't be compared.
+		struct IdentifierAtom
+		{
+			IdentifierAtom();
+			explicit IdentifierAtom(uint32_t index);
+
+			bool IsValid() const;
+			uint32_t GetIndex() const;
+
+			bool operator==(const IdentifierAtom &other) const;
+			bool operator!=(const IdentifierAtom &other) const;
+
+			static const uint32_t kInvalidIndex = 0xffffffffu;
+
+		private:
+			uint32_t m_index;
+		};
+	}
+}
+
+#include "Hasher.h"
+
+namespace expanse
+{
+	// Atoms are handed out in order from 0, so the index itself spreads them evenly over the buckets
+	template<>
+	class Hasher<cc::IdentifierAtom>
+	{
+	public:
+		static Hash_t Compute(const cc::IdentifierAtom &key);
+	};
+}
+
+namespace expanse
+{
+	namespace cc
+	{
+		inline IdentifierAtom::IdentifierAtom()
+			: m_index(kInvalidIndex)
+		{
+		}
+
+		inline IdentifierAtom::IdentifierAtom(uint32_t index)
+			: m_index(index)
+		{
+		}
+
+		inline bool IdentifierAtom::IsValid() const
+		{
+			return m_index != kInvalidIndex;
+		}
+
+		inline uint32_t IdentifierAtom::GetIndex() const
+		{
+			return m_index;
+		}
+
+		inline bool IdentifierAtom::operator==(const IdentifierAtom &other) const
+		{
+			return m_index == other.m_index;
+		}
+
+		inline bool IdentifierAtom::operator!=(const IdentifierAtom &other) const
+		{
+			return m_index != other.m_index;
+		}
+	}
+
+	inline Hash_t Hasher<cc::IdentifierAtom>::Compute(const cc::IdentifierAtom &key)
+	{
+		return static_cast<Hash_t>(key.GetIndex());
+	}
+}
@@ -0,0 +1,165 @@
+#include "IdentifierTable.h"
+
+#include "ArrayView.h"
+#include "Mem.h"
+#include "Result.h"
+#include "ResultRV.h"
+
+#include <cstring>
+#include <limits>
+
+namespace expanse
+{
+	namespace cc
+	{
+		const uint32_t IdentifierTable::kEmptySlot;
+
+		IdentifierTable::Entry::Entry()
+			: m_chars(nullptr)
+			, m_size(0)
+			, m_hash(0)
+		{
+		}
+
+		IdentifierTable::IdentifierTable(IAllocator *alloc)
+			: m_alloc(alloc)
+			, m_spellingArena(alloc, kArenaBlockSize)
+			, m_entries(alloc)
+		{
+		}
+
+		ResultRV<IdentifierAtom> IdentifierTable::Intern(const ArrayView<const uint8_t> &spelling)
+		{
+			const Hash_t hash = HashSpelling(spelling);
+
+			size_t slot = 0;
+			if (FindSlot(spelling, hash, slot))
+				return IdentifierAtom(m_slots[slot] - 1u);
+
+			const size_t atomIndex = m_entries.Size();
+			if (atomIndex >= static_cast<size_t>(IdentifierAtom::kInvalidIndex - 1u))
+				return ErrorCode::kOutOfMemory;
+
+			if ((atomIndex + 1u) * 2u > m_slots.Count())
+			{
+				CHECK(Grow());
+
+				FindSlot(spelling, hash, slot);
+			}
+
+			Entry entry;
+			entry.m_size = spelling.Size();
+			entry.m_hash = hash;
+
+			if (entry.m_size > 0)
+			{
+				uint8_t *chars = static_cast<uint8_t*>(m_spellingArena.Alloc(entry.m_size, 1));
+				if (chars == nullptr)
+					return ErrorCode::kOutOfMemory;
+
+				memcpy(chars, spelling.begin(), entry.m_size);
+				entry.m_chars = chars;
+			}
+
+			CHECK(m_entries.Add(entry));
+
+			m_slots[slot] = static_cast<uint32_t>(atomIndex + 1u);
+
+			return IdentifierAtom(static_cast<uint32_t>(atomIndex));
+		}
+
+		bool IdentifierTable::TryFind(const ArrayView<const uint8_t> &spelling, IdentifierAtom &outAtom) const
+		{
+			if (m_entries.Size() == 0)
+				return false;
+
+			size_t slot = 0;
+			if (!FindSlot(spelling, HashSpelling(spelling), slot))
+				return false;
+
+			outAtom = IdentifierAtom(m_slots[slot] - 1u);
+			return true;
+		}
+
+		ArrayView<const uint8_t> IdentifierTable::GetSpelling(const IdentifierAtom &atom) const
+		{
+			const Entry &entry = m_entries[atom.GetIndex()];
+			return ArrayView<const uint8_t>(entry.m_chars, entry.m_size);
+		}
+
+		size_t IdentifierTable::GetNumAtoms() const
+		{
+			return m_entries.Size();
+		}
+
+		Hash_t IdentifierTable::HashSpelling(const ArrayView<const uint8_t> &spelling)
+		{
+			// FNV-1a, identifiers are short enough that XXHash's setup costs more than it saves
+			Hash_t hash = 2166136261u;
+			for (uint8_t c : spelling)
+			{
+				hash ^= c;
+				hash *= 16777619u;
+			}
+
+			return hash;
+		}
+
+		bool IdentifierTable::FindSlot(const ArrayView<const uint8_t> &spelling, Hash_t hash, size_t &outSlot) const
+		{
+			const size_t capacity = m_slots.Count();
+			if (capacity == 0)
+				return false;
+
+			const size_t mask = capacity - 1u;
+			const size_t size = spelling.Size();
+
+			size_t slot = static_cast<size_t>(hash) & mask;
+			for (;;)
+			{
+				const uint32_t slotValue = m_slots[slot];
+				if (slotValue == kEmptySlot)
+				{
+					outSlot = slot;
+					return false;
+				}
+
+				const Entry &entry = m_entries[slotValue - 1u];
+				if (entry.m_hash == hash && entry.m_size == size && (size == 0 || !memcmp(entry.m_chars, spelling.begin(), size)))
+				{
+					outSlot = slot;
+					return true;
+				}
+
+				slot = (slot + 1u) & mask;
+			}
+		}
+
+		Result IdentifierTable::Grow()
+		{
+			const size_t oldCapacity = m_slots.Count();
+			if (oldCapacity > std::numeric_limits<size_t>::max() / 2u)
+				return ErrorCode::kOutOfMemory;
+
+			const size_t newCapacity = (oldCapacity == 0) ? 256 : oldCapacity * 2u;
+			const size_t mask = newCapacity - 1u;
+
+			CHECK_RV(ArrayPtr<uint32_t>, newSlots, NewArray<uint32_t>(m_alloc, newCapacity, kEmptySlot));
+
+			// Stored hashes make this a pure reinsert, no spelling is read again
+			const size_t numEntries = m_entries.Size();
+			for (size_t i = 0; i < numEntries; i++)
+			{
+				size_t slot = static_cast<size_t>(m_entries[i].m_hash) & mask;
+				while (newSlots[slot] != kEmptySlot)
+					slot = (slot + 1u) & mask;
+
+				newSlots[slot] = static_cast<uint32_t>(i + 1u);
+			}
+
+			m_slots = std::move(newSlots);
+
+			return ErrorCode::kOK;
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ArenaAllocator.h"
+#include "ArrayPtr.h"
+#include "Hash.h"
+#include "IdentifierAtom.h"
+#include "Vector.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	template<class T> struct ArrayView;
+	template<class T> struct ResultRV;
+	struct IAllocator;
+
+	namespace cc
+	{
+		// Interns identifier spellings, handing each distinct one a dense atom the first time it's seen.  Spellings
+		// are copied once into an arena and never move, so spelling views stay valid for the table's lifetime.
+		// Not thread-safe.
+		class IdentifierTable
+		{
+		public:
+			explicit IdentifierTable(IAllocator *alloc);
+
+			ResultRV<IdentifierAtom> Intern(const ArrayView<const uint8_t> &spelling);
+
+			// Doesn't add anything, fails if the spelling has never been interned
+			bool TryFind(const ArrayView<const uint8_t> &spelling, IdentifierAtom &outAtom) const;
+
+			ArrayView<const uint8_t> GetSpelling(const IdentifierAtom &atom) const;
+			size_t GetNumAtoms() const;
+
+		private:
+			struct Entry
+			{
+				Entry();
+
+				const uint8_t *m_chars;
+				size_t m_size;
+				Hash_t m_hash;
+			};
+
+			static const size_t kArenaBlockSize = 16 * 1024;
+			static const uint32_t kEmptySlot = 0;
+
+			IdentifierTable(const IdentifierTable &other) = delete;
+			IdentifierTable &operator=(const IdentifierTable &other) = delete;
+
+			static Hash_t HashSpelling(const ArrayView<const uint8_t> &spelling);
+
+			bool FindSlot(const ArrayView<const uint8_t> &spelling, Hash_t hash, size_t &outSlot) const;
+			Result Grow();
+
+			IAllocator *m_alloc;
+			ArenaAllocator m_spellingArena;
+			Vector<Entry> m_entries;
+
+			// Open addressing, each slot holds an atom index plus one, or kEmptySlot.  The capacity is a power of two
+			// and at most half the slots are used.
+			ArrayPtr<uint32_t> m_slots;
+		};
+	}
+}
@@ -2,27 +2,33 @@
 
 #include "CoreObject.h"
 #include "CorePtr.h"
+#include "Result.h"
+#include "ResultRV.h"
 
-expanse::cc::IncludeStack::IncludeStack(IAllocator *alloc, IncludeStack *prev, ArrayPtr<uint8_t> &&contentsToTake, UTF8String_t &&device, UTF8String_t &&path, TokenStr &&traceName)
+expanse::cc::IncludeStack::IncludeStack(IAllocator *alloc, IncludeStack *prev, ArrayPtr<uint8_t> &&contentsToTake, UTF8String_t &&device, UTF8String_t &&path, const TokenStrView &traceName)
 	: m_prev(prev)
 	, m_ownedContents(std::move(contentsToTake))
 	, m_device(std::move(device))
 	, m_path(std::move(path))
-	, m_coordinate(0, 1, 0)
+	, m_coordinate(0)
 	, m_logicStack(alloc)
-	, m_traceName(std::move(traceName))
+	, m_traceName(traceName)
+	, m_lineStarts(alloc)
+	, m_includeGuardState(IncludeGuardState::kExpectingIfNDef)
 {
 	m_contents = ArrayView<uint8_t>(m_ownedContents);
 }
 
-expanse::cc::IncludeStack::IncludeStack(IAllocator *alloc, IncludeStack *prev, const ArrayView<uint8_t> &contents, UTF8String_t &&device, UTF8String_t &&path, TokenStr &&traceName)
+expanse::cc::IncludeStack::IncludeStack(IAllocator *alloc, IncludeStack *prev, const ArrayView<uint8_t> &contents, UTF8String_t &&device, UTF8String_t &&path, const TokenStrView &traceName)
 	: m_prev(prev)
 	, m_contents(contents)
 	, m_device(std::move(device))
 	, m_path(std::move(path))
-	, m_coordinate(0, 1, 0)
+	, m_coordinate(0)
 	, m_logicStack(alloc)
-	, m_traceName(std::move(traceName))
+	, m_traceName(traceName)
+	, m_lineStarts(alloc)
+	, m_includeGuardState(IncludeGuardState::kExpectingIfNDef)
 {
 }
 
@@ -59,6 +65,16 @@ void expanse::cc::IncludeStack::SetFileCoordinate(const FileCoordinate &coordina
 	m_coordinate = coordinate;
 }
 
+expanse::ResultRV<expanse::cc::FileLocation> expanse::cc::IncludeStack::ResolveFileLocation(const FileCoordinate &coordinate)
+{
+	if (m_lineStarts.GetIndexedSize() != m_contents.Size())
+	{
+		CHECK(m_lineStarts.AddSpan(ArrayView<const uint8_t>(m_contents)));
+	}
+
+	return m_lineStarts.Resolve(coordinate);
+}
+
 expanse::ArrayView<const uint8_t> expanse::cc::IncludeStack::GetFileContents() const
 {
 	return ArrayView<const uint8_t>(m_contents);
@@ -72,7 +88,7 @@ void expanse::cc::IncludeStack::GetFileName(UTF8StringView_t &outDevice, UTF8Str
 
 expanse::cc::TokenStrView expanse::cc::IncludeStack::GetTraceFileName() const
 {
-	return m_traceName.GetTokenView();
+	return m_traceName;
 }
 
 expanse::Result expanse::cc::IncludeStack::PushLogic(const PreprocessorLogicStack &logic)
@@ -81,10 +97,15 @@ expanse::Result expanse::cc::IncludeStack::PushLogic(const PreprocessorLogicStac
 	return ErrorCode::kOK;
 }
 
-void expanse::cc::IncludeStack::PopLogic()
+expanse::Result expanse::cc::IncludeStack::PopLogic()
 {
 	EXP_ASSERT(m_logicStack.Size() > 0);
-	m_logicStack.Resize(m_logicStack.Size() - 1);
+	CHECK(m_logicStack.Resize(m_logicStack.Size() - 1));
+
+	if (m_logicStack.Size() == 0 && m_includeGuardState == IncludeGuardState::kInsideIfNDef)
+		m_includeGuardState = IncludeGuardState::kAfterEndIf;
+
+	return ErrorCode::kOK;
 }
 
 expanse::cc::PreprocessorLogicStack *expanse::cc::IncludeStack::GetTopLogic()
@@ -102,3 +123,36 @@ bool expanse::cc::IncludeStack::IsInActivePreprocessorBlock() const
 
 	return m_logicStack[m_logicStack.Size() - 1].m_state == PreprocessorLogicState::kActive;
 }
+
+void expanse::cc::IncludeStack::NoteIncludeGuardContent()
+{
+	if (m_includeGuardState != IncludeGuardState::kInsideIfNDef)
+		m_includeGuardState = IncludeGuardState::kNotGuarded;
+}
+
+void expanse::cc::IncludeStack::NoteIncludeGuardIfNDef(const ArrayView<const uint8_t> &macroName)
+{
+	if (m_includeGuardState == IncludeGuardState::kExpectingIfNDef && m_logicStack.Size() == 1)
+	{
+		m_includeGuardState = IncludeGuardState::kInsideIfNDef;
+		m_includeGuardMacro = macroName;
+	}
+	else
+		NoteIncludeGuardContent();
+}
+
+void expanse::cc::IncludeStack::NoteIncludeGuardElse()
+{
+	if (m_includeGuardState == IncludeGuardState::kInsideIfNDef && m_logicStack.Size() == 1)
+		m_includeGuardState = IncludeGuardState::kNotGuarded;
+}
+
+bool expanse::cc::IncludeStack::IsIncludeGuarded() const
+{
+	return m_includeGuardState == IncludeGuardState::kAfterEndIf;
+}
+
+expanse::ArrayView<const uint8_t> expanse::cc::IncludeStack::GetIncludeGuardMacro() const
+{
+	return m_includeGuardMacro;
+}
@@ -5,6 +5,7 @@
 #include "CoreObject.h"
 #include "CorePtr.h"
 #include "FileCoordinate.h"
+#include "LineStartIndex.h"
 #include "PreprocessorLogicStack.h"
 #include "PPTokenStr.h"
 #include "Token.h"
@@ -14,16 +15,27 @@
 namespace expanse
 {
 	class AsyncFileRequest;
+	template<class T> struct ResultRV;
 
 	namespace cc
 	{
 		struct TokenStrView;
 
+		// How far a file has matched the include guard pattern, where everything in the file other than whitespace
+		// and comments is inside a single #ifndef block that has no #elif or #else
+		enum class IncludeGuardState
+		{
+			kExpectingIfNDef,
+			kInsideIfNDef,
+			kAfterEndIf,
+			kNotGuarded,
+		};
+
 		class IncludeStack final : public CoreObject
 		{
 		public:
-			IncludeStack(IAllocator *alloc, IncludeStack *prev, ArrayPtr<uint8_t> &&contentsToTake, UTF8String_t &&device, UTF8String_t &&path, TokenStr &&traceName);
-			IncludeStack(IAllocator *alloc, IncludeStack *prev, const ArrayView<uint8_t> &contents, UTF8String_t &&device, UTF8String_t &&path, TokenStr &&traceName);
+			IncludeStack(IAllocator *alloc, IncludeStack *prev, ArrayPtr<uint8_t> &&contentsToTake, UTF8String_t &&device, UTF8String_t &&path, const TokenStrView &traceName);
+			IncludeStack(IAllocator *alloc, IncludeStack *prev, const ArrayView<uint8_t> &contents, UTF8String_t &&device, UTF8String_t &&path, const TokenStrView &traceName);
 
 			void Append(CorePtr<IncludeStack> &&next);
 			void UnlinkNext();
@@ -33,16 +45,27 @@ namespace expanse
 			const FileCoordinate &GetFileCoordinate() const;
 			void SetFileCoordinate(const FileCoordinate &coordinate);
 
+			// Lines are only indexed the first time something needs a line number from this file
+			ResultRV<FileLocation> ResolveFileLocation(const FileCoordinate &coordinate);
+
 			ArrayView<const uint8_t> GetFileContents() const;
 
 			void GetFileName(UTF8StringView_t &outDevice, UTF8StringView_t &outPath) const;
 			TokenStrView GetTraceFileName() const;
 
 			Result PushLogic(const PreprocessorLogicStack &logic);
-			void PopLogic();
+			Result PopLogic();
 			PreprocessorLogicStack *GetTopLogic();
 			bool IsInActivePreprocessorBlock() const;
 
+			// Include guard detection.  Anything that isn't inside the guard's #ifndef block rules the guard out,
+			// and so does an #elif or #else of the block itself.  The block ends when its logic is popped.
+			void NoteIncludeGuardContent();
+			void NoteIncludeGuardIfNDef(const ArrayView<const uint8_t> &macroName);
+			void NoteIncludeGuardElse();
+			bool IsIncludeGuarded() const;
+			ArrayView<const uint8_t> GetIncludeGuardMacro() const;
+
 		private:
 			CorePtr<IncludeStack> m_next;
 			ArrayPtr<uint8_t> m_ownedContents;
@@ -54,9 +77,13 @@ namespace expanse
 
 			UTF8String_t m_device;
 			UTF8String_t m_path;
-			TokenStr m_traceName;
+			TokenStrView m_traceName;	// Interned by the trace info
 
 			FileCoordinate m_coordinate;
+			LineStartIndex m_lineStarts;
+
+			IncludeGuardState m_includeGuardState;
+			ArrayView<const uint8_t> m_includeGuardMacro;	// Refers to the file contents
 		};
 	}
 }
@@ -1,5 +1,8 @@
 #include "IncludeStackTrace.h"
 #include "IncludeStack.h"
+#include "FileCoordinate.h"
+#include "Result.h"
+#include "ResultRV.h"
 
 namespace expanse
 {
@@ -22,10 +25,12 @@ namespace expanse
 			return (m_current != nullptr);
 		}
 
-		void IncludeStackTrace::GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileCoordinate &outCoordinate) const
+		Result IncludeStackTrace::GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileLocation &outLocation) const
 		{
 			m_current->GetFileName(outDevice, outPath);
-			outCoordinate = m_current->GetFileCoordinate();
+			CHECK_RV_ASSIGN(outLocation, m_current->ResolveFileLocation(m_current->GetFileCoordinate()));
+
+			return ErrorCode::kOK;
 		}
 
 		TokenStrView IncludeStackTrace::GetCurrentTraceFile() const
@@ -15,7 +15,7 @@ namespace expanse
 
 			void Reset() override;
 			bool Pop() override;
-			void GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileCoordinate &outCoordinate) const override;
+			Result GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileLocation &outLocation) const override;
 			TokenStrView GetCurrentTraceFile() const override;
 
 		private:
@@ -1,4 +1,5 @@
 #include "LType.h"
+#include "ExpAssert.h"
 
 namespace expanse
 {
@@ -37,5 +38,44 @@ namespace expanse
 				return lType;
 			}
 		}
+
+		bool IsFloatLType(LType lType)
+		{
+			return lType == LType::kFloat32 || lType == LType::kFloat64;
+		}
+
+		bool IsSignedIntegerLType(LType lType)
+		{
+			return lType == LType::kSInt8 || lType == LType::kSInt16 || lType == LType::kSInt32 || lType == LType::kSInt64;
+		}
+
+		bool IsUnsignedIntegerLType(LType lType)
+		{
+			return lType == LType::kUInt8 || lType == LType::kUInt16 || lType == LType::kUInt32 || lType == LType::kUInt64;
+		}
+
+		size_t GetLTypeSize(LType lType)
+		{
+			switch (lType)
+			{
+			case LType::kSInt8:
+			case LType::kUInt8:
+				return 1;
+			case LType::kSInt16:
+			case LType::kUInt16:
+				return 2;
+			case LType::kSInt32:
+			case LType::kUInt32:
+			case LType::kFloat32:
+				return 4;
+			case LType::kSInt64:
+			case LType::kUInt64:
+			case LType::kFloat64:
+				return 8;
+			default:
+				EXP_ASSERT(false);
+				return 1;
+			}
+		}
 	}
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 namespace expanse
 {
 	namespace cc
@@ -24,5 +26,12 @@ namespace expanse
 
 		LType UnsignedLType(LType lType);
 		LType SignedLType(LType lType);
+
+		bool IsFloatLType(LType lType);
+		bool IsSignedIntegerLType(LType lType);
+		bool IsUnsignedIntegerLType(LType lType);
+
+		// Size in bytes of any LType except kAddress, which depends on the target
+		size_t GetLTypeSize(LType lType);
 	}
 }
@@ -0,0 +1,143 @@
+#include "ArrayPtr.h"
+#include "ArrayView.h"
+#include "CharScan.h"
+#include "CLexer.h"
+#include "FileCoordinate.h"
+#include "FileStream.h"
+#include "Mem.h"
+#include "NullErrorReporter.h"
+#include "PPTokenStr.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "StringView.h"
+#include "StringProto.h"
+#include "SynchronousFileSystem.h"
+#include "XString.h"
+
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+namespace expanse
+{
+	namespace cc
+	{
+		namespace
+		{
+			struct LexerPassResult
+			{
+				size_t m_numTokens;
+				size_t m_endOffset;
+			};
+
+			// Lexes a whole file the way the preprocessor does, but keeps whitespace tokens so that they're measured too
+			LexerPassResult RunLexerPass(const ArrayView<const uint8_t> &contents)
+			{
+				NullErrorReporter errorReporter;
+				NullIncludeStackTrace includeStackTrace;
+
+				LexerPassResult result;
+				result.m_numTokens = 0;
+
+				FileCoordinate coord(0);
+				for (;;)
+				{
+					ArrayView<const uint8_t> token;
+					CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
+					if (!CLexer::TryGetToken(contents, coord, true, false, includeStackTrace, &errorReporter, false, false, token, tokenType, coord))
+						break;
+
+					result.m_numTokens++;
+				}
+
+				result.m_endOffset = coord.m_fileOffset;
+				return result;
+			}
+
+			// Repeats passes for at least kMinTime and kMinPasses and returns the best throughput in bytes per second
+			double MeasureLexerThroughput(const ArrayView<const uint8_t> &contents, LexerPassResult &outPassResult)
+			{
+				const std::chrono::steady_clock::duration kMinTime = std::chrono::milliseconds(250);
+				const unsigned int kMinPasses = 5;
+
+				double bestSeconds = std::numeric_limits<double>::max();
+
+				const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+				for (unsigned int pass = 0; pass < kMinPasses || std::chrono::steady_clock::now() - startTime < kMinTime; pass++)
+				{
+					const std::chrono::steady_clock::time_point passStartTime = std::chrono::steady_clock::now();
+					outPassResult = RunLexerPass(contents);
+					const std::chrono::duration<double> passTime = std::chrono::steady_clock::now() - passStartTime;
+
+					if (passTime.count() < bestSeconds)
+						bestSeconds = passTime.count();
+				}
+
+				if (bestSeconds <= 0.0)
+					return 0.0;
+
+				return static_cast<double>(contents.Size()) / bestSeconds;
+			}
+
+			Result LoadFile(IAllocator *alloc, SynchronousFileSystem *syncFS, const UTF8StringView_t &device, const UTF8StringView_t &path, ArrayPtr<uint8_t> &outContents)
+			{
+				CHECK_RV(CorePtr<FileStream>, stream, syncFS->Open(device, path, SynchronousFileSystem::Permission::kRead, SynchronousFileSystem::CreationDisposition::kOpenExisting));
+				CHECK_RV(UFilePos_t, fileSize, stream->GetSize());
+
+				if (fileSize > std::numeric_limits<size_t>::max())
+					return ErrorCode::kOutOfMemory;
+
+				CHECK_RV(ArrayPtr<uint8_t>, contents, NewArrayUninitialized<uint8_t>(alloc, static_cast<size_t>(fileSize)));
+				CHECK(stream->ReadAll(contents.View()));
+
+				outContents = std::move(contents);
+				return ErrorCode::kOK;
+			}
+		}
+	}
+}
+
+static double BytesPerSecondToMegabytesPerSecond(double bytesPerSecond)
+{
+	return bytesPerSecond / (1024.0 * 1024.0);
+}
+
+// Measures raw lexer throughput over each source file with the scalar and vector scanning kernels
+expanse::Result LexerBenchmark(expanse::IAllocator *alloc, expanse::SynchronousFileSystem *syncFS, const expanse::ArrayView<const expanse::UTF8String_t> &sourcePaths)
+{
+	typedef expanse::cc::CharScan CharScan;
+
+	const expanse::UTF8StringView_t device("game");
+
+	for (size_t i = 0; i < sourcePaths.Size(); i++)
+	{
+		const expanse::UTF8String_t &path = sourcePaths[i];
+
+		expanse::ArrayPtr<uint8_t> contents;
+		CHECK(expanse::cc::LoadFile(alloc, syncFS, device, path, contents));
+
+		expanse::cc::LexerPassResult scalarPassResult;
+		CharScan::SetVectorKernelsEnabled(false);
+		const double scalarThroughput = expanse::cc::MeasureLexerThroughput(contents.ConstView(), scalarPassResult);
+
+		expanse::cc::LexerPassResult vectorPassResult;
+		CharScan::SetVectorKernelsEnabled(true);
+		const double vectorThroughput = expanse::cc::MeasureLexerThroughput(contents.ConstView(), vectorPassResult);
+
+		// Both kernels have to produce the same tokens
+		if (scalarPassResult.m_numTokens != vectorPassResult.m_numTokens || scalarPassResult.m_endOffset != vectorPassResult.m_endOffset)
+			return expanse::ErrorCode::kInternalError;
+
+		if (path.Length() > 0)
+			fwrite(&path.GetChars()[0], path.Length(), 1, stderr);
+		fprintf(stderr, ": %u bytes, %u tokens, scalar %.1f MB/s, %s %.1f MB/s, speedup %.2fx\n",
+			static_cast<unsigned int>(contents.Count()),
+			static_cast<unsigned int>(vectorPassResult.m_numTokens),
+			BytesPerSecondToMegabytesPerSecond(scalarThroughput),
+			CharScan::GetVectorKernelName(),
+			BytesPerSecondToMegabytesPerSecond(vectorThroughput),
+			(scalarThroughput > 0.0) ? vectorThroughput / scalarThroughput : 0.0);
+	}
+
+	return expanse::ErrorCode::kOK;
+}
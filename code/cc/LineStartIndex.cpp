@@ -0,0 +1,114 @@
+#include "LineStartIndex.h"
+
+#include "ArrayView.h"
+#include "CharCodes.h"
+#include "CharScan.h"
+#include "FileCoordinate.h"
+#include "Result.h"
+
+namespace expanse
+{
+	namespace cc
+	{
+		LineStartIndex::LineStartIndex(IAllocator *alloc)
+			: m_lineStarts(alloc)
+			, m_indexedSize(0)
+			, m_skippedSize(0)
+			, m_numSkippedLines(0)
+		{
+		}
+
+		Result LineStartIndex::AddSpan(const ArrayView<const uint8_t> &contents)
+		{
+			if (m_lineStarts.Size() == 0)
+			{
+				CHECK(m_lineStarts.Add(m_skippedSize));
+			}
+
+			const uint8_t *chars = contents.begin();
+			const size_t size = contents.Size();
+
+			size_t offset = 0;
+			for (;;)
+			{
+				offset += CharScan::ScanToLineEnd(chars + offset, size - offset);
+				if (offset == size)
+					break;
+
+				if (chars[offset] == CharCode::kCarriageReturn && size - offset >= 2 && chars[offset + 1] == CharCode::kLineFeed)
+					offset++;
+
+				offset++;
+				CHECK(m_lineStarts.Add(m_indexedSize + offset));
+			}
+
+			m_indexedSize += size;
+
+			return ErrorCode::kOK;
+		}
+
+		void LineStartIndex::SkipSpan(const ArrayView<const uint8_t> &contents)
+		{
+			// The last line start is the start of the span, which is counted along with the lines in it
+			if (m_lineStarts.Size() > 0)
+				m_numSkippedLines += m_lineStarts.Size() - 1u;
+
+			m_lineStarts.Clear();
+
+			const uint8_t *chars = contents.begin();
+			const size_t size = contents.Size();
+
+			size_t offset = 0;
+			while (offset < size)
+			{
+				offset += CharScan::ScanToLineEnd(chars + offset, size - offset);
+				if (offset == size)
+					break;
+
+				if (chars[offset] == CharCode::kCarriageReturn && size - offset >= 2 && chars[offset + 1] == CharCode::kLineFeed)
+					offset++;
+
+				offset++;
+				m_numSkippedLines++;
+			}
+
+			m_indexedSize += size;
+			m_skippedSize = m_indexedSize;
+		}
+
+		size_t LineStartIndex::GetIndexedSize() const
+		{
+			return m_indexedSize;
+		}
+
+		FileLocation LineStartIndex::Resolve(const FileCoordinate &coord) const
+		{
+			const size_t fileOffset = coord.m_fileOffset;
+
+			const unsigned int firstLineNumber = static_cast<unsigned int>(m_numSkippedLines + 1u);
+
+			if (fileOffset < m_skippedSize)
+				return FileLocation(firstLineNumber, 0);
+
+			if (m_lineStarts.Size() == 0)
+				return FileLocation(firstLineNumber, static_cast<unsigned int>(fileOffset - m_skippedSize));
+
+			// Find the last line that starts at or before the offset
+			size_t first = 0;
+			size_t count = m_lineStarts.Size();
+			while (count > 1)
+			{
+				const size_t half = count / 2u;
+				if (m_lineStarts[first + half] <= fileOffset)
+				{
+					first += half;
+					count -= half;
+				}
+				else
+					count = half;
+			}
+
+			return FileLocation(static_cast<unsigned int>(first + firstLineNumber), static_cast<unsigned int>(fileOffset - m_lineStarts[first]));
+		}
+	}
+}
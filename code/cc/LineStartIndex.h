@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Vector.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	template<class T> struct ArrayView;
+	struct IAllocator;
+	struct Result;
+
+	namespace cc
+	{
+		struct FileCoordinate;
+		struct FileLocation;
+
+		// Offset of the start of each line in a file, for turning FileCoordinates into line and column only when
+		// they're shown.  CR, LF and CR LF each end a line, the same as in the lexer.  A file that arrives in pieces
+		// can be indexed one span at a time, as long as no span ends between the CR and LF of a CR LF pair.  Spans
+		// that nothing will be resolved in again can be skipped, which only counts their lines.
+		class LineStartIndex
+		{
+		public:
+			explicit LineStartIndex(IAllocator *alloc);
+
+			// Indexes the next span of the file, starting where the last one ended
+			Result AddSpan(const ArrayView<const uint8_t> &contents);
+
+			// Same as AddSpan, but forgets the line starts of everything up to the end of the span, which must also
+			// be the end of a line
+			void SkipSpan(const ArrayView<const uint8_t> &contents);
+
+			size_t GetIndexedSize() const;
+
+			// Lines are numbered from 1 and columns from 0.  Offsets past the indexed part of the file resolve to its
+			// last line, and offsets in skipped spans to the start of the first line after them.
+			FileLocation Resolve(const FileCoordinate &coord) const;
+
+		private:
+			// Line starts from the end of the last skipped span on
+			Vector<size_t> m_lineStarts;
+			size_t m_indexedSize;
+			size_t m_skippedSize;
+			size_t m_numSkippedLines;
+		};
+	}
+}
@@ -1,7 +1,11 @@
 #include "MaxInt.h"
+#include "ExpAssert.h"
 #include "Result.h"
 #include "ResultRV.h"
 
+#include "ms_charconv.h"
+
+#include <cstring>
 #include <limits>
 
 namespace expanse
@@ -36,6 +40,14 @@ namespace expanse
 			outRemainder = static_cast<int8_t>(remainder);
 		}
 
+		size_t MaxSInt::ToDecimalChars(char *outChars) const
+		{
+			const msstl::to_chars_result result = msstl::to_chars(outChars, outChars + kMaxDecimalChars, m_data);
+			EXP_ASSERT(result.ec == msstl::errc());
+
+			return static_cast<size_t>(result.ptr - outChars);
+		}
+
 		ResultRV<MaxUInt> MaxSInt::ToUnsigned() const
 		{
 			if (m_data < 0)
@@ -44,6 +56,116 @@ namespace expanse
 			return MaxUInt(static_cast<uint64_t>(m_data));
 		}
 
+		MaxUInt MaxSInt::BitCastToUnsigned() const
+		{
+			return MaxUInt(static_cast<uint64_t>(m_data));
+		}
+
+		ResultRV<MaxSInt> MaxSInt::Add(const MaxSInt &other) const
+		{
+			if (other.m_data > 0 && m_data > std::numeric_limits<int64_t>::max() - other.m_data)
+				return ErrorCode::kArithmeticOverflow;
+			if (other.m_data < 0 && m_data < std::numeric_limits<int64_t>::min() - other.m_data)
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxSInt(m_data + other.m_data);
+		}
+
+		ResultRV<MaxSInt> MaxSInt::Subtract(const MaxSInt &other) const
+		{
+			if (other.m_data < 0 && m_data > std::numeric_limits<int64_t>::max() + other.m_data)
+				return ErrorCode::kArithmeticOverflow;
+			if (other.m_data > 0 && m_data < std::numeric_limits<int64_t>::min() + other.m_data)
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxSInt(m_data - other.m_data);
+		}
+
+		ResultRV<MaxSInt> MaxSInt::Multiply(const MaxSInt &other) const
+		{
+			const int64_t a = m_data;
+			const int64_t b = other.m_data;
+
+			if (a > 0)
+			{
+				if (b > 0 ? (a > std::numeric_limits<int64_t>::max() / b) : (b < std::numeric_limits<int64_t>::min() / a))
+					return ErrorCode::kArithmeticOverflow;
+			}
+			else if (a < 0)
+			{
+				if (b > 0 ? (a < std::numeric_limits<int64_t>::min() / b) : (b != 0 && b < std::numeric_limits<int64_t>::max() / a))
+					return ErrorCode::kArithmeticOverflow;
+			}
+
+			return MaxSInt(a * b);
+		}
+
+		ResultRV<MaxSInt> MaxSInt::Divide(const MaxSInt &other) const
+		{
+			if (other.m_data == 0 || (m_data == std::numeric_limits<int64_t>::min() && other.m_data == -1))
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxSInt(m_data / other.m_data);
+		}
+
+		ResultRV<MaxSInt> MaxSInt::Modulo(const MaxSInt &other) const
+		{
+			if (other.m_data == 0 || (m_data == std::numeric_limits<int64_t>::min() && other.m_data == -1))
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxSInt(m_data % other.m_data);
+		}
+
+		ResultRV<MaxSInt> MaxSInt::Negate() const
+		{
+			if (m_data == std::numeric_limits<int64_t>::min())
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxSInt(-m_data);
+		}
+
+		ResultRV<MaxSInt> MaxSInt::ShiftLeft(const MaxUInt &count) const
+		{
+			if (m_data < 0 || count >= MaxUInt(64))
+				return ErrorCode::kArithmeticOverflow;
+
+			const unsigned int bits = static_cast<unsigned int>(count.BitCastToSigned().m_data);
+			if (m_data > (std::numeric_limits<int64_t>::max() >> bits))
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxSInt(m_data << bits);
+		}
+
+		ResultRV<MaxSInt> MaxSInt::ShiftRight(const MaxUInt &count) const
+		{
+			if (count >= MaxUInt(64))
+				return ErrorCode::kArithmeticOverflow;
+
+			// Negative values are shifted arithmetically
+			const unsigned int bits = static_cast<unsigned int>(count.BitCastToSigned().m_data);
+			return MaxSInt(m_data >> bits);
+		}
+
+		MaxSInt MaxSInt::operator&(const MaxSInt &other) const
+		{
+			return MaxSInt(m_data & other.m_data);
+		}
+
+		MaxSInt MaxSInt::operator|(const MaxSInt &other) const
+		{
+			return MaxSInt(m_data | other.m_data);
+		}
+
+		MaxSInt MaxSInt::operator^(const MaxSInt &other) const
+		{
+			return MaxSInt(m_data ^ other.m_data);
+		}
+
+		MaxSInt MaxSInt::operator~() const
+		{
+			return MaxSInt(~m_data);
+		}
+
 		bool MaxSInt::operator<(const MaxSInt &other) const
 		{
 			return m_data < other.m_data;
@@ -108,6 +230,47 @@ namespace expanse
 			outRemainder = static_cast<uint8_t>(remainder);
 		}
 
+		size_t MaxUInt::ToDecimalChars(char *outChars) const
+		{
+			const msstl::to_chars_result result = msstl::to_chars(outChars, outChars + kMaxDecimalChars, m_data);
+			EXP_ASSERT(result.ec == msstl::errc());
+
+			return static_cast<size_t>(result.ptr - outChars);
+		}
+
+		size_t MaxUInt::FloatBitsToDecimalChars(LType floatLType, char *outChars) const
+		{
+			msstl::to_chars_result result;
+
+			if (floatLType == LType::kFloat32)
+			{
+				const uint32_t bits = static_cast<uint32_t>(m_data);
+				float f = 0.0f;
+				memcpy(&f, &bits, sizeof(f));
+				result = msstl::to_chars(outChars, outChars + kMaxFloatDecimalChars, f);
+			}
+			else
+			{
+				EXP_ASSERT(floatLType == LType::kFloat64);
+
+				double d = 0.0;
+				memcpy(&d, &m_data, sizeof(d));
+				result = msstl::to_chars(outChars, outChars + kMaxFloatDecimalChars, d);
+			}
+
+			EXP_ASSERT(result.ec == msstl::errc());
+
+			return static_cast<size_t>(result.ptr - outChars);
+		}
+
+		void MaxUInt::ToLittleEndian(uint8_t *outBytes, size_t numBytes) const
+		{
+			EXP_ASSERT(numBytes <= kMaxBytes);
+
+			for (size_t i = 0; i < numBytes; i++)
+				outBytes[i] = static_cast<uint8_t>((m_data >> (i * 8)) & 0xff);
+		}
+
 		ResultRV<MaxSInt> MaxUInt::ToSigned() const
 		{
 			if (m_data > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
@@ -115,6 +278,99 @@ namespace expanse
 			return MaxSInt(static_cast<int64_t>(m_data));
 		}
 
+		MaxSInt MaxUInt::BitCastToSigned() const
+		{
+			return MaxSInt(static_cast<int64_t>(m_data));
+		}
+
+		ResultRV<MaxUInt> MaxUInt::Add(const MaxUInt &other) const
+		{
+			if (m_data > std::numeric_limits<uint64_t>::max() - other.m_data)
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxUInt(m_data + other.m_data);
+		}
+
+		ResultRV<MaxUInt> MaxUInt::Multiply(const MaxUInt &other) const
+		{
+			if (other.m_data != 0 && m_data > std::numeric_limits<uint64_t>::max() / other.m_data)
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxUInt(m_data * other.m_data);
+		}
+
+		ResultRV<MaxUInt> MaxUInt::Divide(const MaxUInt &other) const
+		{
+			if (other.m_data == 0)
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxUInt(m_data / other.m_data);
+		}
+
+		ResultRV<MaxUInt> MaxUInt::Modulo(const MaxUInt &other) const
+		{
+			if (other.m_data == 0)
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxUInt(m_data % other.m_data);
+		}
+
+		ResultRV<MaxUInt> MaxUInt::ShiftLeft(const MaxUInt &count) const
+		{
+			if (count.m_data >= 64)
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxUInt(m_data << count.m_data);
+		}
+
+		ResultRV<MaxUInt> MaxUInt::ShiftRight(const MaxUInt &count) const
+		{
+			if (count.m_data >= 64)
+				return ErrorCode::kArithmeticOverflow;
+
+			return MaxUInt(m_data >> count.m_data);
+		}
+
+		MaxUInt MaxUInt::operator+(const MaxUInt &other) const
+		{
+			return MaxUInt(m_data + other.m_data);
+		}
+
+		MaxUInt MaxUInt::operator-(const MaxUInt &other) const
+		{
+			return MaxUInt(m_data - other.m_data);
+		}
+
+		MaxUInt MaxUInt::operator*(const MaxUInt &other) const
+		{
+			return MaxUInt(m_data * other.m_data);
+		}
+
+		MaxUInt MaxUInt::operator-() const
+		{
+			return MaxUInt(0u - m_data);
+		}
+
+		MaxUInt MaxUInt::operator&(const MaxUInt &other) const
+		{
+			return MaxUInt(m_data & other.m_data);
+		}
+
+		MaxUInt MaxUInt::operator|(const MaxUInt &other) const
+		{
+			return MaxUInt(m_data | other.m_data);
+		}
+
+		MaxUInt MaxUInt::operator^(const MaxUInt &other) const
+		{
+			return MaxUInt(m_data ^ other.m_data);
+		}
+
+		MaxUInt MaxUInt::operator~() const
+		{
+			return MaxUInt(~m_data);
+		}
+
 		bool MaxUInt::operator<(const MaxUInt &other) const
 		{
 			return m_data < other.m_data;
@@ -122,7 +378,7 @@ namespace expanse
 
 		bool MaxUInt::operator<=(const MaxUInt &other) const
 		{
-			return m_data < other.m_data;
+			return m_data <= other.m_data;
 		}
 
 		bool MaxUInt::operator>(const MaxUInt &other) const
@@ -13,6 +13,8 @@ namespace expanse
 	{
 		struct MaxUInt;
 
+		// Arithmetic follows C: signed overflow, division by zero and out of range shifts fail with
+		// kArithmeticOverflow, while unsigned +, - and * wrap around, so they're plain operators.
 		struct MaxSInt final
 		{
 			MaxSInt();
@@ -23,9 +25,29 @@ namespace expanse
 
 			static const LType kLType = LType::kSInt64;
 			static const unsigned int kMaxDecimalDigits = 19;
+			static const size_t kMaxDecimalChars = kMaxDecimalDigits + 1;
 
 			void DivMod10(MaxSInt &outQuotient, int8_t &outRemainder) const;
+
+			// Writes the value in decimal, with a '-' if it's negative, and returns the number of chars written.
+			// There has to be room for kMaxDecimalChars.
+			size_t ToDecimalChars(char *outChars) const;
 			ResultRV<MaxUInt> ToUnsigned() const;
+			MaxUInt BitCastToUnsigned() const;
+
+			ResultRV<MaxSInt> Add(const MaxSInt &other) const;
+			ResultRV<MaxSInt> Subtract(const MaxSInt &other) const;
+			ResultRV<MaxSInt> Multiply(const MaxSInt &other) const;
+			ResultRV<MaxSInt> Divide(const MaxSInt &other) const;
+			ResultRV<MaxSInt> Modulo(const MaxSInt &other) const;
+			ResultRV<MaxSInt> Negate() const;
+			ResultRV<MaxSInt> ShiftLeft(const MaxUInt &count) const;
+			ResultRV<MaxSInt> ShiftRight(const MaxUInt &count) const;
+
+			MaxSInt operator&(const MaxSInt &other) const;
+			MaxSInt operator|(const MaxSInt &other) const;
+			MaxSInt operator^(const MaxSInt &other) const;
+			MaxSInt operator~() const;
 
 			bool operator<(const MaxSInt &other) const;
 			bool operator<=(const MaxSInt &other) const;
@@ -50,9 +72,43 @@ namespace expanse
 
 			static const LType kLType = LType::kUInt64;
 			static const unsigned int kMaxDecimalDigits = 20;
+			static const size_t kMaxDecimalChars = kMaxDecimalDigits;
+			static const size_t kMaxFloatDecimalChars = 32;
+			static const size_t kMaxBytes = 8;
 
 			void DivMod10(MaxUInt &outQuotient, uint8_t &outRemainder) const;
+
+			// Writes the value in decimal and returns the number of chars written, there has to be room for
+			// kMaxDecimalChars
+			size_t ToDecimalChars(char *outChars) const;
+
+			// Writes the float that the value holds the bits of, kFloat32 or kFloat64, as the shortest decimal that
+			// reads back to the same value.  NaNs are written without their payload.  There has to be room for
+			// kMaxFloatDecimalChars.
+			size_t FloatBitsToDecimalChars(LType floatLType, char *outChars) const;
+
+			// Writes the low numBytes bytes, up to kMaxBytes, least significant first
+			void ToLittleEndian(uint8_t *outBytes, size_t numBytes) const;
 			ResultRV<MaxSInt> ToSigned() const;
+			MaxSInt BitCastToSigned() const;
+
+			// Checked versions of + and *, for when wrapping around isn't wanted
+			ResultRV<MaxUInt> Add(const MaxUInt &other) const;
+			ResultRV<MaxUInt> Multiply(const MaxUInt &other) const;
+
+			ResultRV<MaxUInt> Divide(const MaxUInt &other) const;
+			ResultRV<MaxUInt> Modulo(const MaxUInt &other) const;
+			ResultRV<MaxUInt> ShiftLeft(const MaxUInt &count) const;
+			ResultRV<MaxUInt> ShiftRight(const MaxUInt &count) const;
+
+			MaxUInt operator+(const MaxUInt &other) const;
+			MaxUInt operator-(const MaxUInt &other) const;
+			MaxUInt operator*(const MaxUInt &other) const;
+			MaxUInt operator-() const;
+			MaxUInt operator&(const MaxUInt &other) const;
+			MaxUInt operator|(const MaxUInt &other) const;
+			MaxUInt operator^(const MaxUInt &other) const;
+			MaxUInt operator~() const;
 
 			bool operator<(const MaxUInt &other) const;
 			bool operator<=(const MaxUInt &other) const;
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "FileCoordinate.h"
+#include "IErrorReporter.h"
+#include "IIncludeStackTrace.h"
+#include "PPTokenStr.h"
+#include "Result.h"
+#include "StringView.h"
+
+namespace expanse
+{
+	namespace cc
+	{
+		// For lexing text that isn't part of a translation unit, so there's nowhere to report errors
+		struct NullErrorReporter final : public IErrorReporter
+		{
+			void ReportError(const FileCoordinate &fileCoordinate, IIncludeStackTrace &includeStackTrace, CompilationErrorCode errorCode) override
+			{
+			}
+		};
+
+		struct NullIncludeStackTrace final : public IIncludeStackTrace
+		{
+			void Reset() override
+			{
+			}
+
+			bool Pop() override
+			{
+				return false;
+			}
+
+			Result GetCurrentFile(UTF8StringView_t &outDevice, UTF8StringView_t &outPath, FileLocation &outLocation) const override
+			{
+				outDevice = UTF8StringView_t();
+				outPath = UTF8StringView_t();
+				outLocation = FileLocation();
+
+				return ErrorCode::kOK;
+			}
+
+			TokenStrView GetCurrentTraceFile() const override
+			{
+				return TokenStrView();
+			}
+		};
+	}
+}
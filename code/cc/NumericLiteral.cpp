@@ -0,0 +1,534 @@
+#include "NumericLiteral.h"
+#include "CharCodes.h"
+#include "CompilerConfiguration.h"
+#include "CompilerConstant.h"
+#include "ExpAssert.h"
+
+#include "ms_charconv.h"
+
+#include <cstring>
+#include <limits>
+
+namespace expanse
+{
+	namespace cc
+	{
+		namespace
+		{
+			bool IsOctalDigitChar(uint8_t ch)
+			{
+				return ch >= CharCode::kDigit0 && ch <= CharCode::kDigit7;
+			}
+
+			// Returns 16 or more for anything that isn't a hex digit
+			unsigned int GetDigitValue(uint8_t ch)
+			{
+				if (ch >= CharCode::kDigit0 && ch <= CharCode::kDigit9)
+					return ch - CharCode::kDigit0;
+				if (ch >= CharCode::kLowercaseA && ch <= CharCode::kLowercaseF)
+					return ch - CharCode::kLowercaseA + 10;
+				if (ch >= CharCode::kUppercaseA && ch <= CharCode::kUppercaseF)
+					return ch - CharCode::kUppercaseA + 10;
+				return 16;
+			}
+
+			bool HasHexPrefix(const ArrayView<const uint8_t> &spelling)
+			{
+				return spelling.Size() >= 2 && spelling[0] == CharCode::kDigit0 && (spelling[1] == CharCode::kLowercaseX || spelling[1] == CharCode::kUppercaseX);
+			}
+		}
+
+		NumericLiteral::Integer::Integer()
+			: m_value(0)
+			, m_base(10)
+			, m_hasUnsignedSuffix(false)
+			, m_numLongSuffixes(0)
+		{
+		}
+
+		NumericLiteral::Character::Character()
+			: m_packed(0)
+			, m_lastChar(0)
+			, m_numChars(0)
+			, m_isWide(false)
+		{
+		}
+
+		NumericLiteral::DecodeStatus NumericLiteral::DecodeInteger(const ArrayView<const uint8_t> &spelling, Integer &outInteger)
+		{
+			const size_t size = spelling.Size();
+			if (size == 0)
+				return DecodeStatus::kMalformed;
+
+			size_t pos = 0;
+			unsigned int base = 10;
+			if (HasHexPrefix(spelling))
+			{
+				base = 16;
+				pos = 2;
+			}
+			else if (spelling[0] == CharCode::kDigit0)
+				base = 8;
+
+			const size_t firstDigit = pos;
+			const uint64_t maxValue = std::numeric_limits<uint64_t>::max();
+			bool isOverflowed = false;
+			uint64_t value = 0;
+
+			if (base == 10)
+			{
+				const uint64_t kEightDigitScale = 100000000;
+
+				uint32_t eightDigits = 0;
+				while (size - pos >= 8 && TryDecodeEightDecimalDigits(LoadEightChars(&spelling[pos]), eightDigits))
+				{
+					if (value > (maxValue - eightDigits) / kEightDigitScale)
+						isOverflowed = true;
+					else
+						value = value * kEightDigitScale + eightDigits;
+
+					pos += 8;
+				}
+			}
+			else if (base == 16)
+			{
+				uint32_t eightDigits = 0;
+				while (size - pos >= 8 && TryDecodeEightHexDigits(LoadEightChars(&spelling[pos]), eightDigits))
+				{
+					if ((value >> 32) != 0)
+						isOverflowed = true;
+					else
+						value = (value << 32) | eightDigits;
+
+					pos += 8;
+				}
+			}
+
+			while (pos < size)
+			{
+				const unsigned int digit = GetDigitValue(spelling[pos]);
+				if (digit >= base)
+					break;
+
+				if (value > (maxValue - digit) / base)
+					isOverflowed = true;
+				else
+					value = value * base + digit;
+
+				pos++;
+			}
+
+			if (pos == firstDigit && base == 16)
+				return DecodeStatus::kMalformed;
+
+			// Suffix, u and l or ll in either order
+			bool hasUnsignedSuffix = false;
+			unsigned int numLongSuffixes = 0;
+			while (pos < size)
+			{
+				const uint8_t ch = spelling[pos];
+				if ((ch == CharCode::kLowercaseU || ch == CharCode::kUppercaseU) && !hasUnsignedSuffix)
+				{
+					hasUnsignedSuffix = true;
+					pos++;
+				}
+				else if ((ch == CharCode::kLowercaseL || ch == CharCode::kUppercaseL) && numLongSuffixes == 0)
+				{
+					numLongSuffixes = 1;
+					pos++;
+					if (pos < size && spelling[pos] == ch)
+					{
+						numLongSuffixes = 2;
+						pos++;
+					}
+				}
+				else
+					return DecodeStatus::kMalformed;
+			}
+
+			if (isOverflowed)
+				return DecodeStatus::kOverflow;
+
+			outInteger.m_value = MaxUInt(value);
+			outInteger.m_base = base;
+			outInteger.m_hasUnsignedSuffix = hasUnsignedSuffix;
+			outInteger.m_numLongSuffixes = numLongSuffixes;
+
+			return DecodeStatus::kOK;
+		}
+
+		bool NumericLiteral::IntegerToConstant(const Integer &integer, const CompilerConfiguration &config, CompilerConstant &outConstant)
+		{
+			const LType rankLTypes[] = { config.m_intLType, config.m_longIntLType, config.m_longLongIntLType };
+			const size_t numRanks = sizeof(rankLTypes) / sizeof(rankLTypes[0]);
+
+			// Decimal constants without a u suffix only get signed types, the others try the unsigned type of each
+			// rank after the signed one
+			const bool allowSigned = !integer.m_hasUnsignedSuffix;
+			const bool allowUnsigned = integer.m_hasUnsignedSuffix || integer.m_base != 10;
+
+			for (size_t rank = integer.m_numLongSuffixes; rank < numRanks; rank++)
+			{
+				const LType signedLType = SignedLType(rankLTypes[rank]);
+				const unsigned int numBits = GetIntegerBits(signedLType);
+
+				if (allowSigned)
+				{
+					const MaxUInt signedMax((static_cast<uint64_t>(1) << (numBits - 1)) - 1);
+					if (integer.m_value <= signedMax)
+					{
+						outConstant = CompilerConstant(signedLType, integer.m_value.BitCastToSigned());
+						return true;
+					}
+				}
+
+				if (allowUnsigned)
+				{
+					const MaxUInt unsignedMax = (numBits == 64) ? MaxUInt::Max() : MaxUInt((static_cast<uint64_t>(1) << numBits) - 1);
+					if (integer.m_value <= unsignedMax)
+					{
+						outConstant = CompilerConstant(UnsignedLType(signedLType), integer.m_value);
+						return true;
+					}
+				}
+			}
+
+			return false;
+		}
+
+		NumericLiteral::DecodeStatus NumericLiteral::DecodeCharacter(const ArrayView<const uint8_t> &spelling, Character &outCharacter)
+		{
+			const size_t size = spelling.Size();
+
+			size_t pos = 0;
+			bool isWide = false;
+			if (size > 0 && spelling[0] == CharCode::kUppercaseL)
+			{
+				isWide = true;
+				pos = 1;
+			}
+
+			if (size < pos + 3 || spelling[pos] != CharCode::kSingleQuote || spelling[size - 1] != CharCode::kSingleQuote)
+				return DecodeStatus::kMalformed;
+
+			pos++;
+
+			const size_t endPos = size - 1;
+			const uint32_t charMask = isWide ? 0xffffffffu : 0xffu;
+
+			uint32_t packed = 0;
+			unsigned int numChars = 0;
+			uint32_t lastChar = 0;
+
+			while (pos < endPos)
+			{
+				uint32_t ch = spelling[pos++];
+
+				if (ch == CharCode::kBackslash)
+				{
+					if (pos == endPos)
+						return DecodeStatus::kInvalidEscape;
+
+					const uint8_t escapeChar = spelling[pos++];
+					switch (escapeChar)
+					{
+					case CharCode::kLowercaseA:
+						ch = 7;
+						break;
+					case CharCode::kLowercaseB:
+						ch = 8;
+						break;
+					case CharCode::kLowercaseF:
+						ch = 12;
+						break;
+					case CharCode::kLowercaseN:
+						ch = 10;
+						break;
+					case CharCode::kLowercaseR:
+						ch = 13;
+						break;
+					case CharCode::kLowercaseT:
+						ch = 9;
+						break;
+					case CharCode::kLowercaseV:
+						ch = 11;
+						break;
+					case CharCode::kBackslash:
+					case CharCode::kSingleQuote:
+					case CharCode::kDoubleQuote:
+					case CharCode::kQuestion:
+						ch = escapeChar;
+						break;
+					case CharCode::kLowercaseX:
+						{
+							const size_t firstDigit = pos;
+							ch = 0;
+							while (pos < endPos && GetDigitValue(spelling[pos]) < 16)
+							{
+								if (ch > (charMask >> 4))
+									return DecodeStatus::kInvalidEscape;
+								ch = (ch << 4) | GetDigitValue(spelling[pos++]);
+							}
+
+							if (pos == firstDigit)
+								return DecodeStatus::kInvalidEscape;
+						}
+						break;
+					default:
+						if (!IsOctalDigitChar(escapeChar))
+							return DecodeStatus::kInvalidEscape;
+
+						ch = escapeChar - CharCode::kDigit0;
+						for (int i = 0; i < 2 && pos < endPos && IsOctalDigitChar(spelling[pos]); i++)
+							ch = (ch << 3) | static_cast<uint32_t>(spelling[pos++] - CharCode::kDigit0);
+
+						if (ch > charMask)
+							return DecodeStatus::kInvalidEscape;
+						break;
+					}
+				}
+
+				lastChar = ch;
+				packed = (packed << 8) | (ch & 0xffu);
+				numChars++;
+			}
+
+			if (numChars == 0 || numChars > 4)
+				return DecodeStatus::kMalformed;
+
+			outCharacter.m_packed = packed;
+			outCharacter.m_lastChar = lastChar;
+			outCharacter.m_numChars = numChars;
+			outCharacter.m_isWide = isWide;
+
+			return DecodeStatus::kOK;
+		}
+
+		void NumericLiteral::CharacterToConstant(const Character &character, const CompilerConfiguration &config, CompilerConstant &outConstant)
+		{
+			CompilerConstant value;
+			LType lType = config.m_intLType;
+
+			if (character.m_isWide)
+			{
+				value = CompilerConstant(LType::kUInt32, MaxUInt(character.m_lastChar));
+				lType = config.m_wcharLType;
+			}
+			else if (character.m_numChars > 1)
+				value = CompilerConstant(LType::kSInt32, MaxSInt(static_cast<int32_t>(character.m_packed)));
+			else if (config.m_plainCharIsUnsigned)
+				value = CompilerConstant(LType::kUInt8, MaxUInt(character.m_packed));
+			else
+				value = CompilerConstant(LType::kSInt8, MaxSInt(static_cast<int8_t>(character.m_packed)));
+
+			// Integer to integer conversions can't fail
+			const bool converted = value.ConvertTo(lType, outConstant);
+			EXP_ASSERT(converted);
+			(void)converted;
+		}
+
+		NumericLiteral::DecodeStatus NumericLiteral::DecodeFloat(const ArrayView<const uint8_t> &spelling, const CompilerConfiguration &config, CompilerConstant &outConstant)
+		{
+			size_t size = spelling.Size();
+			if (size == 0)
+				return DecodeStatus::kMalformed;
+
+			LType lType = config.m_doubleLType;
+
+			const uint8_t lastChar = spelling[size - 1];
+			if (lastChar == CharCode::kLowercaseF || lastChar == CharCode::kUppercaseF)
+			{
+				lType = config.m_floatLType;
+				size--;
+			}
+			else if (lastChar == CharCode::kLowercaseL || lastChar == CharCode::kUppercaseL)
+				size--;
+
+			size_t pos = 0;
+			msstl::chars_format format = msstl::chars_format::general;
+			if (HasHexPrefix(spelling))
+			{
+				// from_chars doesn't take the prefix, and C doesn't make the exponent optional like it does
+				pos = 2;
+				format = msstl::chars_format::hex;
+
+				bool hasExponent = false;
+				for (size_t i = pos; i < size; i++)
+				{
+					if (spelling[i] == CharCode::kLowercaseP || spelling[i] == CharCode::kUppercaseP)
+						hasExponent = true;
+				}
+
+				if (!hasExponent)
+					return DecodeStatus::kMalformed;
+			}
+
+			// from_chars also takes signs, infinities and NaNs, none of which can start a constant
+			if (pos == size || (GetDigitValue(spelling[pos]) >= 16 && spelling[pos] != CharCode::kPeriod))
+				return DecodeStatus::kMalformed;
+
+			const char *first = reinterpret_cast<const char*>(&spelling[pos]);
+			const char *last = reinterpret_cast<const char*>(&spelling[0]) + size;
+
+			msstl::from_chars_result fcResult;
+			uint64_t bits = 0;
+			if (lType == LType::kFloat32)
+			{
+				float f = 0.0f;
+				fcResult = msstl::from_chars(first, last, f, format);
+
+				uint32_t floatBits = 0;
+				memcpy(&floatBits, &f, sizeof(f));
+				bits = floatBits;
+			}
+			else
+			{
+				EXP_ASSERT(lType == LType::kFloat64);
+
+				double d = 0.0;
+				fcResult = msstl::from_chars(first, last, d, format);
+				memcpy(&bits, &d, sizeof(d));
+			}
+
+			// from_chars reports both directions as out of range.  Values too large for the type come back as
+			// infinity, which is an overflow, but values too small for even the smallest denormal come back as zero,
+			// which is the nearest representable value (6.4.4.2) and is fine.
+			if (fcResult.ec == msstl::errc::result_out_of_range)
+			{
+				if (bits != 0)
+					return DecodeStatus::kOverflow;
+
+				fcResult.ec = msstl::errc();
+			}
+
+			if (fcResult.ec != msstl::errc() || fcResult.ptr != last)
+				return DecodeStatus::kMalformed;
+
+			outConstant = CompilerConstant(lType, MaxUInt(bits));
+
+			return DecodeStatus::kOK;
+		}
+
+		NumericLiteral::DecodeStatus NumericLiteral::Decode(const ArrayView<const uint8_t> &spelling, const CompilerConfiguration &config, CompilerConstant &outConstant)
+		{
+			if (IsFloatSpelling(spelling))
+				return DecodeFloat(spelling, config, outConstant);
+
+			Integer integer;
+			const DecodeStatus status = DecodeInteger(spelling, integer);
+			if (status != DecodeStatus::kOK)
+				return status;
+
+			if (!IntegerToConstant(integer, config, outConstant))
+				return DecodeStatus::kOverflow;
+
+			return DecodeStatus::kOK;
+		}
+
+		bool NumericLiteral::IsFloatSpelling(const ArrayView<const uint8_t> &spelling)
+		{
+			if (HasHexPrefix(spelling))
+			{
+				for (size_t i = 2; i < spelling.Size(); i++)
+				{
+					const uint8_t ch = spelling[i];
+					if (ch == CharCode::kPeriod || ch == CharCode::kLowercaseP || ch == CharCode::kUppercaseP)
+						return true;
+				}
+
+				return false;
+			}
+
+			for (size_t i = 0; i < spelling.Size(); i++)
+			{
+				const uint8_t ch = spelling[i];
+				if (ch == CharCode::kPeriod || ch == CharCode::kLowercaseE || ch == CharCode::kUppercaseE)
+					return true;
+			}
+
+			return false;
+		}
+
+		unsigned int NumericLiteral::GetIntegerBits(LType lType)
+		{
+			switch (lType)
+			{
+			case LType::kSInt8:
+			case LType::kUInt8:
+				return 8;
+			case LType::kSInt16:
+			case LType::kUInt16:
+				return 16;
+			case LType::kSInt32:
+			case LType::kUInt32:
+				return 32;
+			case LType::kSInt64:
+			case LType::kUInt64:
+				return 64;
+			default:
+				EXP_ASSERT(false);
+				return 64;
+			}
+		}
+
+		bool NumericLiteral::TryDecodeEightDecimalDigits(uint64_t chars, uint32_t &outValue)
+		{
+			// A byte is a digit if its high nibble is 3 and adding 6 doesn't carry out of its low nibble
+			const uint64_t highNibbles = chars & 0xf0f0f0f0f0f0f0f0u;
+			const uint64_t carriedNibbles = ((chars + 0x0606060606060606u) & 0xf0f0f0f0f0f0f0f0u) >> 4;
+			if ((highNibbles | carriedNibbles) != 0x3333333333333333u)
+				return false;
+
+			// Combine neighboring digits into 2 digit numbers in the low byte of each 16-bit lane, then those into the
+			// 8 digit result with one multiply per pair of lanes
+			uint64_t digits = chars - 0x3030303030303030u;
+			digits = (digits * 10) + (digits >> 8);
+
+			const uint64_t kLanePairMask = 0x000000ff000000ffu;
+			const uint64_t kHighLaneScale = 100 + (static_cast<uint64_t>(1000000) << 32);
+			const uint64_t kLowLaneScale = 1 + (static_cast<uint64_t>(10000) << 32);
+			digits = (((digits & kLanePairMask) * kHighLaneScale) + (((digits >> 16) & kLanePairMask) * kLowLaneScale)) >> 32;
+
+			outValue = static_cast<uint32_t>(digits);
+			return true;
+		}
+
+		bool NumericLiteral::TryDecodeEightHexDigits(uint64_t chars, uint32_t &outValue)
+		{
+			const uint64_t kOnes = 0x0101010101010101u;
+			const uint64_t kHighBits = kOnes * 0x80;
+
+			if ((chars & kHighBits) != 0)
+				return false;
+
+			// For bytes below 0x80, adding 0x80 - lo sets the high bit of the ones that are at least lo, and adding
+			// 0x7f - hi sets it for the ones above hi, without carrying into the next byte.  Setting 0x20 maps A-F to
+			// a-f and leaves everything else that could land in a-f out of it.
+			const uint64_t lowered = chars | (kOnes * 0x20);
+			const uint64_t digitBits = (chars + kOnes * (0x80 - CharCode::kDigit0)) & ~(chars + kOnes * (0x7f - CharCode::kDigit9)) & kHighBits;
+			const uint64_t letterBits = (lowered + kOnes * (0x80 - CharCode::kLowercaseA)) & ~(lowered + kOnes * (0x7f - CharCode::kLowercaseF)) & kHighBits;
+			if ((digitBits | letterBits) != kHighBits)
+				return false;
+
+			// Digits and letters both keep their value in the low nibble, letters less 9
+			const uint64_t nibbles = (chars & (kOnes * 0x0f)) + (letterBits >> 7) * 9;
+
+			// The first char is the most significant digit and sits in the low byte, so each step puts the lower
+			// lane of a pair above the higher one
+			const uint64_t bytes = ((nibbles & 0x000f000f000f000fu) << 4) | ((nibbles >> 8) & 0x000f000f000f000fu);
+			const uint64_t halves = ((bytes & 0x000000ff000000ffu) << 8) | ((bytes >> 16) & 0x000000ff000000ffu);
+
+			outValue = static_cast<uint32_t>(((halves & 0xffffu) << 16) | ((halves >> 32) & 0xffffu));
+			return true;
+		}
+
+		uint64_t NumericLiteral::LoadEightChars(const uint8_t *chars)
+		{
+			uint64_t result = 0;
+			for (size_t i = 0; i < 8; i++)
+				result |= static_cast<uint64_t>(chars[i]) << (i * 8);
+
+			return result;
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ArrayView.h"
+#include "LType.h"
+#include "MaxInt.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	namespace cc
+	{
+		struct CompilerConfiguration;
+		struct CompilerConstant;
+
+		// Decodes the spellings of numeric and character constants into values in one pass over the digits and
+		// suffix.  Decimal and hex digits are converted 8 at a time as SWAR arithmetic on 64-bit words while there
+		// are at least 8 left, and a digit at a time after that.  Spellings are raw bytes, so line splices must
+		// already be gone.
+		class NumericLiteral
+		{
+		public:
+			enum class DecodeStatus
+			{
+				kOK,
+				kMalformed,
+				kOverflow,
+				kInvalidEscape,
+			};
+
+			struct Integer
+			{
+				Integer();
+
+				MaxUInt m_value;
+				unsigned int m_base;
+				bool m_hasUnsignedSuffix;
+				unsigned int m_numLongSuffixes;
+			};
+
+			struct Character
+			{
+				Character();
+
+				// The low byte of each char, with the first one in the most significant byte
+				uint32_t m_packed;
+				uint32_t m_lastChar;
+				unsigned int m_numChars;
+				bool m_isWide;
+			};
+
+			// Decodes an integer-constant (6.4.4.1).  Malformed spellings, including bad suffixes, take precedence
+			// over overflow.
+			static DecodeStatus DecodeInteger(const ArrayView<const uint8_t> &spelling, Integer &outInteger);
+
+			// Gives the integer the first type from the list in 6.4.4.1 for its base and suffix that can represent
+			// it, with the sizes from config.  Returns false if none of them can.
+			static bool IntegerToConstant(const Integer &integer, const CompilerConfiguration &config, CompilerConstant &outConstant);
+
+			// Decodes a character-constant (6.4.4.4) of 1 to 4 chars, with or without an L prefix.  Escapes have to
+			// fit in a byte, or in 32 bits in wide constants.
+			static DecodeStatus DecodeCharacter(const ArrayView<const uint8_t> &spelling, Character &outCharacter);
+
+			// Plain constants of one char are ints with the value of that char as a plain char, and multi-character
+			// constants pack their chars into an int the way most compilers do.  Wide constants have the value of
+			// their last char as a wchar_t.
+			static void CharacterToConstant(const Character &character, const CompilerConfiguration &config, CompilerConstant &outConstant);
+
+			// Decodes a decimal or hexadecimal floating-constant (6.4.4.2).  Unsuffixed and long double constants
+			// are doubles.  Values too small to represent, even as a denormal, are zero.
+			static DecodeStatus DecodeFloat(const ArrayView<const uint8_t> &spelling, const CompilerConfiguration &config, CompilerConstant &outConstant);
+
+			// Decodes either kind of constant, whichever the spelling is
+			static DecodeStatus Decode(const ArrayView<const uint8_t> &spelling, const CompilerConfiguration &config, CompilerConstant &outConstant);
+
+		private:
+			static bool IsFloatSpelling(const ArrayView<const uint8_t> &spelling);
+			static unsigned int GetIntegerBits(LType lType);
+
+			// Both take 8 chars with the first one in the low byte and return false if any of them isn't a digit
+			static bool TryDecodeEightDecimalDigits(uint64_t chars, uint32_t &outValue);
+			static bool TryDecodeEightHexDigits(uint64_t chars, uint32_t &outValue);
+
+			static uint64_t LoadEightChars(const uint8_t *chars);
+		};
+	}
+}
@@ -0,0 +1,159 @@
+#include "PPConditionCache.h"
+
+#include "Mem.h"
+#include "Mutex.h"
+#include "MutexLock.h"
+#include "Result.h"
+#include "ResultRV.h"
+
+#include <cstring>
+
+namespace expanse
+{
+	namespace cc
+	{
+		const size_t PPConditionCache::kMaxResultsPerCondition;
+
+		PPConditionCache::CachedResult::CachedResult()
+			: m_value(false)
+		{
+		}
+
+		PPConditionCache::CachedResult::CachedResult(CachedResult &&other)
+			: m_nameChars(std::move(other.m_nameChars))
+			, m_dependencies(std::move(other.m_dependencies))
+			, m_value(other.m_value)
+		{
+		}
+
+		PPConditionCache::CachedResult &PPConditionCache::CachedResult::operator=(CachedResult &&other)
+		{
+			m_nameChars = std::move(other.m_nameChars);
+			m_dependencies = std::move(other.m_dependencies);
+			m_value = other.m_value;
+			return *this;
+		}
+
+		PPConditionCache::PPConditionCache(IAllocator *alloc)
+			: m_conditions(*alloc)
+			, m_hitCount(0)
+			, m_missCount(0)
+		{
+		}
+
+		PPConditionCache::~PPConditionCache()
+		{
+		}
+
+		Result PPConditionCache::Initialize()
+		{
+			CHECK_RV(CorePtr<Mutex>, mutex, Mutex::Create(GetCoreObjectAllocator()));
+			m_mutex = std::move(mutex);
+
+			return ErrorCode::kOK;
+		}
+
+		ResultRV<bool> PPConditionCache::Lookup(const ArrayView<const uint8_t> &condition, PPMacroTable &macros, bool &outValue)
+		{
+			MutexLock lock(m_mutex);
+
+			HashMapIterator<TokenStr, Vector<CachedResult>> it = m_conditions.Find(TokenStrView(condition));
+			if (it != m_conditions.end())
+			{
+				const Vector<CachedResult> &results = it.Value();
+
+				for (size_t i = 0; i < results.Size(); i++)
+				{
+					const CachedResult &result = results[i];
+					const size_t numDependencies = result.m_dependencies.Count();
+
+					bool isValid = true;
+					for (size_t j = 0; j < numDependencies && isValid; j++)
+					{
+						const PPMacroDependency &dependency = result.m_dependencies[j];
+						isValid = (macros.GetVersion(dependency.m_name) == dependency.m_version);
+					}
+
+					if (isValid)
+					{
+						outValue = result.m_value;
+						m_hitCount.fetch_add(1, std::memory_order_relaxed);
+						return true;
+					}
+				}
+			}
+
+			m_missCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		Result PPConditionCache::Add(const ArrayView<const uint8_t> &condition, const ArrayView<const PPMacroDependency> &dependencies, bool value)
+		{
+			IAllocator *alloc = GetCoreObjectAllocator();
+
+			// Everything is copied before taking the lock, the dependency names are packed into one allocation
+			const size_t numDependencies = dependencies.Size();
+
+			size_t numNameChars = 0;
+			for (size_t i = 0; i < numDependencies; i++)
+				numNameChars += dependencies[i].m_name.Size();
+
+			CachedResult result;
+			result.m_value = value;
+
+			if (numDependencies > 0)
+			{
+				CHECK_RV(ArrayPtr<uint8_t>, nameChars, NewArrayUninitialized<uint8_t>(alloc, numNameChars));
+				CHECK_RV(ArrayPtr<PPMacroDependency>, resultDependencies, NewArray<PPMacroDependency>(alloc, numDependencies));
+
+				size_t namePos = 0;
+				for (size_t i = 0; i < numDependencies; i++)
+				{
+					const PPMacroDependency &dependency = dependencies[i];
+					const size_t nameSize = dependency.m_name.Size();
+
+					memcpy(&nameChars[namePos], dependency.m_name.begin(), nameSize);
+					resultDependencies[i] = PPMacroDependency(ArrayView<const uint8_t>(&nameChars[namePos], nameSize), dependency.m_version);
+
+					namePos += nameSize;
+				}
+
+				result.m_nameChars = std::move(nameChars);
+				result.m_dependencies = std::move(resultDependencies);
+			}
+
+			MutexLock lock(m_mutex);
+
+			HashMapIterator<TokenStr, Vector<CachedResult>> it = m_conditions.Find(TokenStrView(condition));
+			if (it != m_conditions.end())
+			{
+				Vector<CachedResult> &results = it.Value();
+				if (results.Size() < kMaxResultsPerCondition)
+				{
+					CHECK(results.Add(std::move(result)));
+				}
+
+				return ErrorCode::kOK;
+			}
+
+			CHECK_RV(ArrayPtr<uint8_t>, keyChars, condition.Clone(alloc));
+
+			Vector<CachedResult> results(alloc);
+			CHECK(results.Add(std::move(result)));
+
+			CHECK(m_conditions.Insert(TokenStr(std::move(keyChars)), std::move(results)));
+
+			return ErrorCode::kOK;
+		}
+
+		uint64_t PPConditionCache::GetHitCount() const
+		{
+			return m_hitCount.load(std::memory_order_relaxed);
+		}
+
+		uint64_t PPConditionCache::GetMissCount() const
+		{
+			return m_missCount.load(std::memory_order_relaxed);
+		}
+	}
+}
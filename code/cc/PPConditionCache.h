@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ArrayPtr.h"
+#include "CoreObject.h"
+#include "CorePtr.h"
+#include "HashMap.h"
+#include "PPMacroTable.h"
+#include "PPTokenStr.h"
+#include "Vector.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	template<class T> struct ResultRV;
+	class Mutex;
+	struct Result;
+
+	namespace cc
+	{
+		// Memoizes the results of #if and #elif conditions by their spelling.  Each result is stored with the version of
+		// every macro it depended on, so it's reused wherever those macros have the same definitions, including in
+		// other translation units.  May be shared by multiple preprocessors, including ones running on other threads.
+		class PPConditionCache final : public CoreObject
+		{
+		public:
+			explicit PPConditionCache(IAllocator *alloc);
+			~PPConditionCache();
+
+			Result Initialize();
+
+			// Returns true and sets outValue if there's a result for the condition that's valid for macros
+			ResultRV<bool> Lookup(const ArrayView<const uint8_t> &condition, PPMacroTable &macros, bool &outValue);
+
+			Result Add(const ArrayView<const uint8_t> &condition, const ArrayView<const PPMacroDependency> &dependencies, bool value);
+
+			uint64_t GetHitCount() const;
+			uint64_t GetMissCount() const;
+
+			// Conditions that come out differently in many translation units stop being cached after this many results
+			static const size_t kMaxResultsPerCondition = 16;
+
+		private:
+			struct CachedResult
+			{
+				CachedResult();
+				CachedResult(CachedResult &&other);
+
+				CachedResult &operator=(CachedResult &&other);
+
+				ArrayPtr<uint8_t> m_nameChars;
+				ArrayPtr<PPMacroDependency> m_dependencies;	// Names refer to m_nameChars
+				bool m_value;
+
+			private:
+				CachedResult(const CachedResult &other) = delete;
+				CachedResult &operator=(const CachedResult &other) = delete;
+			};
+
+			CorePtr<Mutex> m_mutex;
+			HashMap<TokenStr, Vector<CachedResult>> m_conditions;
+
+			std::atomic<uint64_t> m_hitCount;
+			std::atomic<uint64_t> m_missCount;
+		};
+	}
+}
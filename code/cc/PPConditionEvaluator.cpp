@@ -0,0 +1,528 @@
+#include "PPConditionEvaluator.h"
+
+#include "CharCodes.h"
+#include "NumericLiteral.h"
+#include "PPMacroExpander.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "Vector.h"
+
+#include <cstring>
+
+namespace expanse
+{
+	namespace cc
+	{
+		namespace
+		{
+			const uint8_t kDefinedSpelling[] = { 'd', 'e', 'f', 'i', 'n', 'e', 'd' };
+			const uint8_t kZeroSpelling[] = { CharCode::kDigit0 };
+			const uint8_t kOneSpelling[] = { CharCode::kDigit1 };
+
+			bool IsDefinedOperator(const PPMacroToken &token)
+			{
+				return token.HasFlag(PPMacroToken::kFlagIdentifier)
+					&& token.m_spelling.Size() == sizeof(kDefinedSpelling)
+					&& memcmp(token.m_spelling.begin(), kDefinedSpelling, sizeof(kDefinedSpelling)) == 0;
+			}
+
+			bool IsDigitChar(uint8_t ch)
+			{
+				return ch >= CharCode::kDigit0 && ch <= CharCode::kDigit9;
+			}
+		}
+
+		const unsigned int PPConditionEvaluator::kMaxNestingDepth;
+
+		PPConditionEvaluator::Value::Value()
+			: m_isUnsigned(false)
+		{
+		}
+
+		PPConditionEvaluator::Value::Value(const MaxSInt &value)
+			: m_signed(value)
+			, m_isUnsigned(false)
+		{
+		}
+
+		PPConditionEvaluator::Value::Value(const MaxUInt &value)
+			: m_unsigned(value)
+			, m_isUnsigned(true)
+		{
+		}
+
+		bool PPConditionEvaluator::Value::IsNonZero() const
+		{
+			if (m_isUnsigned)
+				return m_unsigned != MaxUInt(0);
+			return m_signed != MaxSInt(0);
+		}
+
+		void PPConditionEvaluator::Value::ConvertToUnsigned()
+		{
+			if (!m_isUnsigned)
+			{
+				m_unsigned = m_signed.BitCastToUnsigned();
+				m_isUnsigned = true;
+			}
+		}
+
+		PPConditionEvaluator::PPConditionEvaluator(IAllocator *alloc, PPMacroTable *macros, PPMacroExpander *macroExpander, IErrorReporter *errorReporter, IIncludeStackTrace *includeStackTrace)
+			: m_alloc(alloc)
+			, m_macros(macros)
+			, m_macroExpander(macroExpander)
+			, m_errorReporter(errorReporter)
+			, m_includeStackTrace(includeStackTrace)
+			, m_nextToken(0)
+		{
+		}
+
+		ResultRV<bool> PPConditionEvaluator::Evaluate(const FileCoordinate &blameCoordinate, const ArrayView<const PPMacroToken> &tokens, Vector<PPMacroDependency> *dependencies)
+		{
+			m_blameCoordinate = blameCoordinate;
+
+			Vector<PPMacroToken> resolvedTokens(m_alloc);
+			CHECK(ResolveDefined(tokens, dependencies, resolvedTokens));
+
+			Vector<PPMacroToken> expandedTokens(m_alloc);
+			CHECK(m_macroExpander->Expand(blameCoordinate, resolvedTokens, nullptr, dependencies, expandedTokens));
+
+			m_tokens = expandedTokens.ConstView();
+			m_nextToken = 0;
+
+			CHECK_RV(Value, value, ParseConditional(true, 0));
+
+			if (m_nextToken != m_tokens.Size())
+				return ReportError(CompilationErrorCode::kPPInvalidCondition);
+
+			m_tokens = ArrayView<const PPMacroToken>();
+
+			return value.IsNonZero();
+		}
+
+		// defined has to be resolved before expansion, since its operand is a macro name and not something to expand
+		Result PPConditionEvaluator::ResolveDefined(const ArrayView<const PPMacroToken> &tokens, Vector<PPMacroDependency> *dependencies, Vector<PPMacroToken> &outTokens)
+		{
+			const size_t numTokens = tokens.Size();
+
+			for (size_t i = 0; i < numTokens; i++)
+			{
+				const PPMacroToken &token = tokens[i];
+
+				if (!IsDefinedOperator(token))
+				{
+					CHECK(outTokens.Add(token));
+					continue;
+				}
+
+				size_t nameIndex = i + 1;
+				bool hasParen = false;
+				if (nameIndex < numTokens && tokens[nameIndex].m_kind == TokenKind::kLeftParen)
+				{
+					hasParen = true;
+					nameIndex++;
+				}
+
+				if (nameIndex >= numTokens || !tokens[nameIndex].HasFlag(PPMacroToken::kFlagIdentifier))
+					return ReportError(CompilationErrorCode::kPPExpectedMacroName);
+
+				if (hasParen && (nameIndex + 1 >= numTokens || tokens[nameIndex + 1].m_kind != TokenKind::kRightParen))
+					return ReportError(CompilationErrorCode::kPPInvalidCondition);
+
+				const ArrayView<const uint8_t> &name = tokens[nameIndex].m_spelling;
+				const PPMacro *macro = m_macros->Find(name);
+				if (dependencies)
+				{
+					CHECK(PPMacroTable::AddDependency(*dependencies, name, macro));
+				}
+
+				const ArrayView<const uint8_t> result = (macro != nullptr) ? ArrayView<const uint8_t>(kOneSpelling) : ArrayView<const uint8_t>(kZeroSpelling);
+				CHECK(outTokens.Add(PPMacroToken(result, TokenKind::kOther, token.m_flags & PPMacroToken::kFlagLeadingSpace)));
+
+				i = hasParen ? (nameIndex + 1) : nameIndex;
+			}
+
+			return ErrorCode::kOK;
+		}
+
+		ResultRV<PPConditionEvaluator::Value> PPConditionEvaluator::ParseConditional(bool isEvaluated, unsigned int depth)
+		{
+			if (depth > kMaxNestingDepth)
+				return ReportError(CompilationErrorCode::kPPInvalidCondition);
+
+			CHECK_RV(Value, condition, ParseBinary(1, isEvaluated, depth));
+
+			if (!TryTakeToken(TokenKind::kQuestion))
+				return condition;
+
+			const bool isTrue = condition.IsNonZero();
+
+			CHECK_RV(Value, trueValue, ParseConditional(isEvaluated && isTrue, depth + 1));
+
+			if (!TryTakeToken(TokenKind::kColon))
+				return ReportError(CompilationErrorCode::kPPInvalidCondition);
+
+			CHECK_RV(Value, falseValue, ParseConditional(isEvaluated && !isTrue, depth + 1));
+
+			// Both operands get the common type, whichever one is chosen
+			if (trueValue.m_isUnsigned || falseValue.m_isUnsigned)
+			{
+				trueValue.ConvertToUnsigned();
+				falseValue.ConvertToUnsigned();
+			}
+
+			return isTrue ? trueValue : falseValue;
+		}
+
+		ResultRV<PPConditionEvaluator::Value> PPConditionEvaluator::ParseBinary(unsigned int minPrecedence, bool isEvaluated, unsigned int depth)
+		{
+			CHECK_RV(Value, left, ParseUnary(isEvaluated, depth));
+
+			for (;;)
+			{
+				if (m_nextToken == m_tokens.Size())
+					return left;
+
+				const TokenKind op = m_tokens[m_nextToken].m_kind;
+				const unsigned int precedence = GetBinaryPrecedence(op);
+				if (precedence == 0 || precedence < minPrecedence)
+					return left;
+
+				m_nextToken++;
+
+				// The right side of && and || is only evaluated if the left side didn't already decide the result
+				bool isRightEvaluated = isEvaluated;
+				if (op == TokenKind::kLogicalAnd)
+					isRightEvaluated = isEvaluated && left.IsNonZero();
+				else if (op == TokenKind::kLogicalOr)
+					isRightEvaluated = isEvaluated && !left.IsNonZero();
+
+				CHECK_RV(Value, right, ParseBinary(precedence + 1, isRightEvaluated, depth));
+
+				if (isRightEvaluated)
+				{
+					CHECK_RV_ASSIGN(left, ApplyBinary(op, left, right));
+				}
+				else if (isEvaluated)
+				{
+					// Short-circuited, the left side is the result
+					left = Value(MaxSInt(left.IsNonZero() ? 1 : 0));
+				}
+				else
+				{
+					// Nothing is computed in an unevaluated operand, but the type still has to come out right
+					const bool isUnsigned = (left.m_isUnsigned || right.m_isUnsigned) && op != TokenKind::kLogicalAnd && op != TokenKind::kLogicalOr;
+					left = isUnsigned ? Value(MaxUInt(0)) : Value(MaxSInt(0));
+				}
+			}
+		}
+
+		ResultRV<PPConditionEvaluator::Value> PPConditionEvaluator::ParseUnary(bool isEvaluated, unsigned int depth)
+		{
+			if (depth > kMaxNestingDepth || m_nextToken == m_tokens.Size())
+				return ReportError(CompilationErrorCode::kPPInvalidCondition);
+
+			const PPMacroToken &token = m_tokens[m_nextToken++];
+
+			// Identifiers left after expansion, including keywords, are 0
+			if (token.HasFlag(PPMacroToken::kFlagIdentifier))
+				return Value(MaxSInt(0));
+
+			switch (token.m_kind)
+			{
+			case TokenKind::kPlus:
+				return ParseUnary(isEvaluated, depth + 1);
+			case TokenKind::kMinus:
+				{
+					CHECK_RV(Value, operand, ParseUnary(isEvaluated, depth + 1));
+					if (operand.m_isUnsigned)
+						return Value(-operand.m_unsigned);
+					if (!isEvaluated)
+						return operand;
+					return CheckSigned(operand.m_signed.Negate());
+				}
+			case TokenKind::kTilde:
+				{
+					CHECK_RV(Value, operand, ParseUnary(isEvaluated, depth + 1));
+					if (operand.m_isUnsigned)
+						return Value(~operand.m_unsigned);
+					return Value(~operand.m_signed);
+				}
+			case TokenKind::kExclamation:
+				{
+					CHECK_RV(Value, operand, ParseUnary(isEvaluated, depth + 1));
+					return Value(MaxSInt(operand.IsNonZero() ? 0 : 1));
+				}
+			case TokenKind::kLeftParen:
+				{
+					CHECK_RV(Value, value, ParseConditional(isEvaluated, depth + 1));
+					if (!TryTakeToken(TokenKind::kRightParen))
+						return ReportError(CompilationErrorCode::kPPInvalidCondition);
+					return value;
+				}
+			default:
+				break;
+			}
+
+			const ArrayView<const uint8_t> &spelling = token.m_spelling;
+			if (spelling.Size() > 0 && IsDigitChar(spelling[0]))
+				return DecodeNumber(spelling);
+
+			if (spelling.Size() > 0 && (spelling[0] == CharCode::kSingleQuote || spelling[0] == CharCode::kUppercaseL))
+				return DecodeCharacter(spelling);
+
+			return ReportError(CompilationErrorCode::kPPInvalidCondition);
+		}
+
+		ResultRV<PPConditionEvaluator::Value> PPConditionEvaluator::ApplyBinary(TokenKind op, Value left, Value right)
+		{
+			switch (op)
+			{
+			case TokenKind::kLogicalAnd:
+				return Value(MaxSInt((left.IsNonZero() && right.IsNonZero()) ? 1 : 0));
+			case TokenKind::kLogicalOr:
+				return Value(MaxSInt((left.IsNonZero() || right.IsNonZero()) ? 1 : 0));
+			case TokenKind::kLeftShift:
+			case TokenKind::kRightShift:
+				{
+					// The result has the type of the left operand, the count only has to be in range
+					if (!right.m_isUnsigned && right.m_signed < MaxSInt(0))
+						return ReportError(CompilationErrorCode::kPPConditionOverflow);
+
+					const MaxUInt count = right.m_isUnsigned ? right.m_unsigned : right.m_signed.BitCastToUnsigned();
+
+					if (left.m_isUnsigned)
+						return CheckUnsigned((op == TokenKind::kLeftShift) ? left.m_unsigned.ShiftLeft(count) : left.m_unsigned.ShiftRight(count));
+					return CheckSigned((op == TokenKind::kLeftShift) ? left.m_signed.ShiftLeft(count) : left.m_signed.ShiftRight(count));
+				}
+			default:
+				break;
+			}
+
+			// Usual arithmetic conversions
+			if (left.m_isUnsigned || right.m_isUnsigned)
+			{
+				left.ConvertToUnsigned();
+				right.ConvertToUnsigned();
+			}
+
+			if ((op == TokenKind::kSlash || op == TokenKind::kPercent) && !right.IsNonZero())
+				return ReportError(CompilationErrorCode::kPPConditionDivisionByZero);
+
+			if (left.m_isUnsigned)
+			{
+				const MaxUInt &a = left.m_unsigned;
+				const MaxUInt &b = right.m_unsigned;
+
+				switch (op)
+				{
+				case TokenKind::kAsterisk:
+					return Value(a * b);
+				case TokenKind::kSlash:
+					return CheckUnsigned(a.Divide(b));
+				case TokenKind::kPercent:
+					return CheckUnsigned(a.Modulo(b));
+				case TokenKind::kPlus:
+					return Value(a + b);
+				case TokenKind::kMinus:
+					return Value(a - b);
+				case TokenKind::kLess:
+					return Value(MaxSInt(a < b ? 1 : 0));
+				case TokenKind::kGreater:
+					return Value(MaxSInt(a > b ? 1 : 0));
+				case TokenKind::kLessEqual:
+					return Value(MaxSInt(a <= b ? 1 : 0));
+				case TokenKind::kGreaterEqual:
+					return Value(MaxSInt(a >= b ? 1 : 0));
+				case TokenKind::kEqual:
+					return Value(MaxSInt(a == b ? 1 : 0));
+				case TokenKind::kNotEqual:
+					return Value(MaxSInt(a != b ? 1 : 0));
+				case TokenKind::kAmpersand:
+					return Value(a & b);
+				case TokenKind::kCaret:
+					return Value(a ^ b);
+				case TokenKind::kVerticalBar:
+					return Value(a | b);
+				default:
+					break;
+				}
+			}
+			else
+			{
+				const MaxSInt &a = left.m_signed;
+				const MaxSInt &b = right.m_signed;
+
+				switch (op)
+				{
+				case TokenKind::kAsterisk:
+					return CheckSigned(a.Multiply(b));
+				case TokenKind::kSlash:
+					return CheckSigned(a.Divide(b));
+				case TokenKind::kPercent:
+					return CheckSigned(a.Modulo(b));
+				case TokenKind::kPlus:
+					return CheckSigned(a.Add(b));
+				case TokenKind::kMinus:
+					return CheckSigned(a.Subtract(b));
+				case TokenKind::kLess:
+					return Value(MaxSInt(a < b ? 1 : 0));
+				case TokenKind::kGreater:
+					return Value(MaxSInt(a > b ? 1 : 0));
+				case TokenKind::kLessEqual:
+					return Value(MaxSInt(a <= b ? 1 : 0));
+				case TokenKind::kGreaterEqual:
+					return Value(MaxSInt(a >= b ? 1 : 0));
+				case TokenKind::kEqual:
+					return Value(MaxSInt(a == b ? 1 : 0));
+				case TokenKind::kNotEqual:
+					return Value(MaxSInt(a != b ? 1 : 0));
+				case TokenKind::kAmpersand:
+					return Value(a & b);
+				case TokenKind::kCaret:
+					return Value(a ^ b);
+				case TokenKind::kVerticalBar:
+					return Value(a | b);
+				default:
+					break;
+				}
+			}
+
+			return ReportError(CompilationErrorCode::kPPInvalidCondition);
+		}
+
+		// Integer constants (6.4.4.1).  Unsuffixed decimal constants are intmax_t and octal and hex ones become uintmax_t
+		// if they don't fit, since every integer type acts like one of the two here.
+		ResultRV<PPConditionEvaluator::Value> PPConditionEvaluator::DecodeNumber(const ArrayView<const uint8_t> &spelling)
+		{
+			NumericLiteral::Integer integer;
+
+			switch (NumericLiteral::DecodeInteger(spelling, integer))
+			{
+			case NumericLiteral::DecodeStatus::kOK:
+				break;
+			case NumericLiteral::DecodeStatus::kOverflow:
+				return ReportError(CompilationErrorCode::kPPConditionOverflow);
+			default:
+				return ReportError(CompilationErrorCode::kPPInvalidCondition);
+			}
+
+			// The length suffix doesn't matter when everything is the widest type
+			if (integer.m_hasUnsignedSuffix)
+				return Value(integer.m_value);
+
+			if (integer.m_value <= MaxSInt::Max().BitCastToUnsigned())
+				return Value(integer.m_value.BitCastToSigned());
+
+			if (integer.m_base == 10)
+				return ReportError(CompilationErrorCode::kPPConditionOverflow);
+
+			return Value(integer.m_value);
+		}
+
+		// Character constants (6.4.4.4).  Plain char is signed and wchar_t is 32 bits, and multi-character constants
+		// pack their characters into an int the way most compilers do.
+		ResultRV<PPConditionEvaluator::Value> PPConditionEvaluator::DecodeCharacter(const ArrayView<const uint8_t> &spelling)
+		{
+			NumericLiteral::Character character;
+
+			switch (NumericLiteral::DecodeCharacter(spelling, character))
+			{
+			case NumericLiteral::DecodeStatus::kOK:
+				break;
+			case NumericLiteral::DecodeStatus::kInvalidEscape:
+				return ReportError(CompilationErrorCode::kInvalidEscapeSequence);
+			default:
+				return ReportError(CompilationErrorCode::kPPInvalidCondition);
+			}
+
+			if (character.m_isWide)
+			{
+				// Only the last character counts if there's more than one
+				return Value(MaxSInt(static_cast<int32_t>(character.m_lastChar)));
+			}
+
+			if (character.m_numChars == 1)
+				return Value(MaxSInt(static_cast<int8_t>(character.m_packed)));
+
+			return Value(MaxSInt(static_cast<int32_t>(character.m_packed)));
+		}
+
+		bool PPConditionEvaluator::TryTakeToken(TokenKind kind)
+		{
+			if (m_nextToken < m_tokens.Size() && m_tokens[m_nextToken].m_kind == kind)
+			{
+				m_nextToken++;
+				return true;
+			}
+
+			return false;
+		}
+
+		ResultRV<PPConditionEvaluator::Value> PPConditionEvaluator::CheckSigned(ResultRV<MaxSInt> &&result)
+		{
+			const ErrorCode errorCode = result.GetErrorCode();
+			result.Handle();
+
+			if (errorCode != ErrorCode::kOK)
+				return ReportError(CompilationErrorCode::kPPConditionOverflow);
+
+			return Value(result.TakeValue());
+		}
+
+		ResultRV<PPConditionEvaluator::Value> PPConditionEvaluator::CheckUnsigned(ResultRV<MaxUInt> &&result)
+		{
+			const ErrorCode errorCode = result.GetErrorCode();
+			result.Handle();
+
+			if (errorCode != ErrorCode::kOK)
+				return ReportError(CompilationErrorCode::kPPConditionOverflow);
+
+			return Value(result.TakeValue());
+		}
+
+		// Higher binds tighter, 0 is not a binary operator.  ?: is handled by ParseConditional.
+		unsigned int PPConditionEvaluator::GetBinaryPrecedence(TokenKind kind)
+		{
+			switch (kind)
+			{
+			case TokenKind::kLogicalOr:
+				return 1;
+			case TokenKind::kLogicalAnd:
+				return 2;
+			case TokenKind::kVerticalBar:
+				return 3;
+			case TokenKind::kCaret:
+				return 4;
+			case TokenKind::kAmpersand:
+				return 5;
+			case TokenKind::kEqual:
+			case TokenKind::kNotEqual:
+				return 6;
+			case TokenKind::kLess:
+			case TokenKind::kGreater:
+			case TokenKind::kLessEqual:
+			case TokenKind::kGreaterEqual:
+				return 7;
+			case TokenKind::kLeftShift:
+			case TokenKind::kRightShift:
+				return 8;
+			case TokenKind::kPlus:
+			case TokenKind::kMinus:
+				return 9;
+			case TokenKind::kAsterisk:
+			case TokenKind::kSlash:
+			case TokenKind::kPercent:
+				return 10;
+			default:
+				return 0;
+			}
+		}
+
+		ErrorCode PPConditionEvaluator::ReportError(CompilationErrorCode errorCode)
+		{
+			m_errorReporter->ReportError(m_blameCoordinate, *m_includeStackTrace, errorCode);
+			return ErrorCode::kOperationFailed;
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ArrayView.h"
+#include "ErrorCode.h"
+#include "FileCoordinate.h"
+#include "IErrorReporter.h"
+#include "MaxInt.h"
+#include "PPMacroTable.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	template<class T> struct ResultRV;
+	template<class T> struct Vector;
+	struct IAllocator;
+	struct Result;
+
+	namespace cc
+	{
+		class PPMacroExpander;
+
+		// Evaluates the controlling expressions of #if and #elif (6.10.1).  defined is resolved on the unexpanded
+		// tokens, the rest is macro replaced, any identifiers left over are 0, and the result is computed in intmax_t
+		// and uintmax_t by precedence climbing straight over the expanded tokens.  Operands that aren't evaluated,
+		// such as the right side of a false &&, are still parsed but can't overflow or divide by zero.
+		class PPConditionEvaluator
+		{
+		public:
+			PPConditionEvaluator(IAllocator *alloc, PPMacroTable *macros, PPMacroExpander *macroExpander, IErrorReporter *errorReporter, IIncludeStackTrace *includeStackTrace);
+
+			// Errors are reported at blameCoordinate.  If there is a dependencies list, every macro name the result
+			// depended on is added to it, whether it was defined or not.  The expansion is left in the expander's
+			// scratch memory.
+			ResultRV<bool> Evaluate(const FileCoordinate &blameCoordinate, const ArrayView<const PPMacroToken> &tokens, Vector<PPMacroDependency> *dependencies);
+
+		private:
+			struct Value
+			{
+				Value();
+				explicit Value(const MaxSInt &value);
+				explicit Value(const MaxUInt &value);
+
+				bool IsNonZero() const;
+				void ConvertToUnsigned();
+
+				MaxSInt m_signed;
+				MaxUInt m_unsigned;
+				bool m_isUnsigned;
+			};
+
+			static const unsigned int kMaxNestingDepth = 256;
+
+			PPConditionEvaluator(const PPConditionEvaluator &other) = delete;
+			PPConditionEvaluator &operator=(const PPConditionEvaluator &other) = delete;
+
+			Result ResolveDefined(const ArrayView<const PPMacroToken> &tokens, Vector<PPMacroDependency> *dependencies, Vector<PPMacroToken> &outTokens);
+
+			ResultRV<Value> ParseConditional(bool isEvaluated, unsigned int depth);
+			ResultRV<Value> ParseBinary(unsigned int minPrecedence, bool isEvaluated, unsigned int depth);
+			ResultRV<Value> ParseUnary(bool isEvaluated, unsigned int depth);
+			ResultRV<Value> ApplyBinary(TokenKind op, Value left, Value right);
+
+			ResultRV<Value> DecodeNumber(const ArrayView<const uint8_t> &spelling);
+			ResultRV<Value> DecodeCharacter(const ArrayView<const uint8_t> &spelling);
+
+			bool TryTakeToken(TokenKind kind);
+			ResultRV<Value> CheckSigned(ResultRV<MaxSInt> &&result);
+			ResultRV<Value> CheckUnsigned(ResultRV<MaxUInt> &&result);
+
+			static unsigned int GetBinaryPrecedence(TokenKind kind);
+
+			ErrorCode ReportError(CompilationErrorCode errorCode);
+
+			IAllocator *m_alloc;
+			PPMacroTable *m_macros;
+			PPMacroExpander *m_macroExpander;
+
+			IErrorReporter *m_errorReporter;
+			IIncludeStackTrace *m_includeStackTrace;
+			FileCoordinate m_blameCoordinate;
+
+			ArrayView<const PPMacroToken> m_tokens;
+			size_t m_nextToken;
+		};
+	}
+}
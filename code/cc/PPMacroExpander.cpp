@@ -0,0 +1,875 @@
+#include "PPMacroExpander.h"
+
+#include "CharCodes.h"
+#include "Result.h"
+#include "ResultRV.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+
+namespace expanse
+{
+	namespace cc
+	{
+		namespace
+		{
+			bool IsDigitChar(uint8_t ch)
+			{
+				return ch >= CharCode::kDigit0 && ch <= CharCode::kDigit9;
+			}
+
+			bool IsIdentifierStartChar(uint8_t ch)
+			{
+				return (ch >= CharCode::kLowercaseA && ch <= CharCode::kLowercaseZ)
+					|| (ch >= CharCode::kUppercaseA && ch <= CharCode::kUppercaseZ)
+					|| ch == CharCode::kUnderscore;
+			}
+
+			bool IsIdentifierChar(uint8_t ch)
+			{
+				return IsIdentifierStartChar(ch) || IsDigitChar(ch);
+			}
+
+			bool IsExponentChar(uint8_t ch)
+			{
+				return ch == CharCode::kLowercaseE || ch == CharCode::kUppercaseE || ch == CharCode::kLowercaseP || ch == CharCode::kUppercaseP;
+			}
+
+			// Characters that can continue a punctuator, or start a comment
+			bool IsPunctuatorJoinChar(uint8_t ch)
+			{
+				switch (ch)
+				{
+				case CharCode::kPlus:
+				case CharCode::kMinus:
+				case CharCode::kAsterisk:
+				case CharCode::kSlash:
+				case CharCode::kPercent:
+				case CharCode::kLess:
+				case CharCode::kGreater:
+				case CharCode::kEqual:
+				case CharCode::kExclamation:
+				case CharCode::kAmpersand:
+				case CharCode::kVerticalBar:
+				case CharCode::kCaret:
+				case CharCode::kHash:
+				case CharCode::kColon:
+				case CharCode::kPeriod:
+					return true;
+				default:
+					return false;
+				}
+			}
+
+			bool IsPPNumber(const ArrayView<const uint8_t> &chars)
+			{
+				return chars.Size() > 0 && (IsDigitChar(chars[0]) || (chars[0] == CharCode::kPeriod && chars.Size() > 1 && IsDigitChar(chars[1])));
+			}
+
+			bool IsCharSequenceLiteral(const ArrayView<const uint8_t> &chars)
+			{
+				size_t start = 0;
+				if (chars.Size() > 0 && chars[0] == CharCode::kUppercaseL)
+					start = 1;
+
+				return chars.Size() > start && (chars[start] == CharCode::kDoubleQuote || chars[start] == CharCode::kSingleQuote);
+			}
+		}
+
+		PPMacroExpander::Context::Context()
+			: m_tokens(nullptr)
+			, m_numTokens(0)
+			, m_nextToken(0)
+			, m_macro(nullptr)
+		{
+		}
+
+		PPMacroExpander::Run::Run(IAllocator *alloc, const ArrayView<const PPMacroToken> &baseTokens, const ArrayView<const size_t> &baseGroupSizes, Vector<PPMacroToken> *lineTokens, ILineSource *lineSource, Vector<PPMacroDependency> *dependencies)
+			: m_baseTokens(baseTokens)
+			, m_nextBaseToken(0)
+			, m_baseGroupSizes(baseGroupSizes)
+			, m_lineTokens(lineTokens)
+			, m_lineSource(lineSource)
+			, m_dependencies(dependencies)
+			, m_contexts(alloc)
+			, m_numContexts(0)
+			, m_pendingFlags(0)
+			, m_argumentDepth(0)
+		{
+		}
+
+		PPMacroExpander::Argument::Argument()
+			: m_firstToken(0)
+			, m_numTokens(0)
+			, m_isExpanded(false)
+		{
+		}
+
+		PPMacroExpander::PPMacroExpander(IAllocator *alloc, PPMacroTable *macros, IErrorReporter *errorReporter, IIncludeStackTrace *includeStackTrace)
+			: m_alloc(alloc)
+			, m_macros(macros)
+			, m_scratchArena(alloc, kScratchArenaBlockSize)
+			, m_errorReporter(errorReporter)
+			, m_includeStackTrace(includeStackTrace)
+			, m_blameCoordinate(0)
+		{
+		}
+
+		Result PPMacroExpander::Expand(const FileCoordinate &blameCoordinate, Vector<PPMacroToken> &tokens, ILineSource *lineSource, Vector<PPMacroDependency> *dependencies, Vector<PPMacroToken> &outTokens)
+		{
+			m_blameCoordinate = blameCoordinate;
+
+			Run run(m_alloc, tokens.ConstView(), ArrayView<const size_t>(), &tokens, lineSource, dependencies);
+
+			for (;;)
+			{
+				PPMacroToken token;
+				CHECK_RV(bool, haveToken, NextToken(run, token));
+				if (!haveToken)
+					break;
+
+				CHECK(outTokens.Add(token));
+			}
+
+			return ErrorCode::kOK;
+		}
+
+		void PPMacroExpander::ResetScratch()
+		{
+			m_scratchArena.Rewind(ArenaAllocator::Mark());
+		}
+
+		Result PPMacroExpander::AppendSpellings(const ArrayView<const PPMacroToken> &tokens, Vector<uint8_t> &outChars)
+		{
+			return AppendSpellingsAtSourceColumns(tokens, ArrayView<const uint8_t>(), outChars);
+		}
+
+		Result PPMacroExpander::AppendSpellingsAtSourceColumns(const ArrayView<const PPMacroToken> &tokens, const ArrayView<const uint8_t> &sourceLine, Vector<uint8_t> &outChars)
+		{
+			const PPMacroToken *prevToken = nullptr;
+
+			for (const PPMacroToken &token : tokens)
+			{
+				bool needSpace = token.HasFlag(PPMacroToken::kFlagLeadingSpace);
+				if (!needSpace && prevToken != nullptr && token.HasFlag(PPMacroToken::kFlagAvoidPaste))
+					needSpace = WouldMerge(*prevToken, token);
+
+				size_t numSpaces = needSpace ? 1 : 0;
+
+				// Tokens from anywhere else, like replacement lists and pastes, are never spelled in the line
+				const uint8_t *spellingStart = token.m_spelling.begin();
+				if (token.m_spelling.Size() > 0 && spellingStart >= sourceLine.begin() && spellingStart < sourceLine.end())
+				{
+					const size_t sourceColumn = static_cast<size_t>(spellingStart - sourceLine.begin());
+					if (sourceColumn > outChars.Size())
+						numSpaces = std::max(numSpaces, sourceColumn - outChars.Size());
+				}
+
+				for (size_t i = 0; i < numSpaces; i++)
+				{
+					CHECK(outChars.Add(static_cast<uint8_t>(CharCode::kSpace)));
+				}
+
+				CHECK(outChars.Add(token.m_spelling));
+
+				prevToken = &token;
+			}
+
+			return ErrorCode::kOK;
+		}
+
+		ResultRV<bool> PPMacroExpander::NextToken(Run &run, PPMacroToken &outToken)
+		{
+			for (;;)
+			{
+				PPMacroToken token;
+				CHECK_RV(bool, haveToken, NextRawToken(run, false, token));
+				if (!haveToken)
+					return false;
+
+				if (token.HasFlag(PPMacroToken::kFlagIdentifier) && !token.HasFlag(PPMacroToken::kFlagNoExpand))
+				{
+					PPMacro *macro = m_macros->Find(token.m_spelling);
+
+					if (run.m_dependencies != nullptr)
+					{
+						CHECK(PPMacroTable::AddDependency(*run.m_dependencies, token.m_spelling, macro));
+					}
+
+					if (macro != nullptr)
+					{
+						if (macro->m_isExpanding)
+							token.m_flags |= PPMacroToken::kFlagNoExpand;
+						else
+						{
+							CHECK_RV(bool, expanded, EnterMacro(run, token, macro));
+							if (expanded)
+								continue;
+						}
+					}
+				}
+
+				token.m_flags |= run.m_pendingFlags;
+				run.m_pendingFlags = 0;
+
+				outToken = token;
+				return true;
+			}
+		}
+
+		ResultRV<bool> PPMacroExpander::NextRawToken(Run &run, bool mayPullLines, PPMacroToken &outToken)
+		{
+			while (run.m_numContexts > 0)
+			{
+				Context &context = run.m_contexts[run.m_numContexts - 1];
+				if (context.m_nextToken < context.m_numTokens)
+				{
+					outToken = context.m_tokens[context.m_nextToken++];
+					return true;
+				}
+
+				PopContext(run);
+			}
+
+			for (;;)
+			{
+				if (run.m_nextBaseToken < run.m_baseTokens.Size())
+				{
+					outToken = run.m_baseTokens[run.m_nextBaseToken++];
+					return true;
+				}
+
+				if (!mayPullLines)
+					return false;
+
+				CHECK_RV(bool, pulledLine, PullLine(run));
+				if (!pulledLine)
+					return false;
+			}
+		}
+
+		ResultRV<bool> PPMacroExpander::PeekRawToken(Run &run, PPMacroToken &outToken)
+		{
+			// Exhausted contexts stay on the stack, they still have to disable their macros for whatever is read next
+			for (size_t i = 0; i < run.m_numContexts; i++)
+			{
+				const Context &context = run.m_contexts[run.m_numContexts - 1 - i];
+				if (context.m_nextToken < context.m_numTokens)
+				{
+					outToken = context.m_tokens[context.m_nextToken];
+					return true;
+				}
+			}
+
+			for (;;)
+			{
+				if (run.m_nextBaseToken < run.m_baseTokens.Size())
+				{
+					outToken = run.m_baseTokens[run.m_nextBaseToken];
+					return true;
+				}
+
+				CHECK_RV(bool, pulledLine, PullLine(run));
+				if (!pulledLine)
+					return false;
+			}
+		}
+
+		ResultRV<bool> PPMacroExpander::PullLine(Run &run)
+		{
+			if (run.m_lineSource == nullptr)
+				return false;
+
+			CHECK_RV(bool, pulledLine, run.m_lineSource->PullLine(*run.m_lineTokens));
+
+			// The line tokens may have moved
+			run.m_baseTokens = run.m_lineTokens->ConstView();
+
+			return pulledLine;
+		}
+
+		Result PPMacroExpander::PushContext(Run &run, const ArrayView<const PPMacroToken> &tokens, PPMacro *macro)
+		{
+			if (run.m_numContexts == run.m_contexts.Size())
+			{
+				CHECK(run.m_contexts.Add(Context()));
+			}
+
+			Context &context = run.m_contexts[run.m_numContexts];
+			context.m_tokens = tokens.begin();
+			context.m_numTokens = tokens.Size();
+			context.m_nextToken = 0;
+			context.m_macro = macro;
+
+			run.m_numContexts++;
+			macro->m_isExpanding = true;
+
+			return ErrorCode::kOK;
+		}
+
+		void PPMacroExpander::PopContext(Run &run)
+		{
+			EXP_ASSERT(run.m_numContexts > 0);
+
+			run.m_numContexts--;
+			run.m_contexts[run.m_numContexts].m_macro->m_isExpanding = false;
+
+			run.m_pendingFlags |= PPMacroToken::kFlagAvoidPaste;
+		}
+
+		ResultRV<bool> PPMacroExpander::EnterMacro(Run &run, const PPMacroToken &nameToken, PPMacro *macro)
+		{
+			ArrayView<const PPMacroToken> expansion;
+
+			if (!macro->m_isFunctionLike)
+			{
+				if (macro->m_hasPaste)
+				{
+					CHECK_RV_ASSIGN(expansion, Substitute(run, *macro, ArrayView<const PPMacroToken>(), ArrayView<const size_t>(), ArrayView<Argument>()));
+				}
+				else
+					expansion = macro->m_replacementList;
+			}
+			else
+			{
+				// A function-like macro name that isn't followed by a parenthesis is just an identifier
+				PPMacroToken nextToken;
+				CHECK_RV(bool, haveNextToken, PeekRawToken(run, nextToken));
+				if (!haveNextToken || nextToken.m_kind != TokenKind::kLeftParen)
+					return false;
+
+				Vector<PPMacroToken> argTokenStorage(m_alloc);
+				Vector<size_t> groupSizeStorage(m_alloc);
+				ArrayView<const PPMacroToken> argTokens;
+				ArrayView<const size_t> argGroupSizes;
+				Vector<Argument> args(m_alloc);
+				CHECK(CollectArguments(run, *macro, argTokenStorage, groupSizeStorage, argTokens, argGroupSizes, args));
+
+				CHECK_RV_ASSIGN(expansion, Substitute(run, *macro, argTokens, argGroupSizes, args.View()));
+			}
+
+			run.m_pendingFlags |= (nameToken.m_flags & PPMacroToken::kFlagLeadingSpace) | PPMacroToken::kFlagAvoidPaste;
+
+			CHECK(PushContext(run, expansion, macro));
+
+			return true;
+		}
+
+		Result PPMacroExpander::CollectArguments(Run &run, const PPMacro &macro, Vector<PPMacroToken> &argTokenStorage, Vector<size_t> &groupSizeStorage, ArrayView<const PPMacroToken> &outArgTokens, ArrayView<const size_t> &outGroupSizes, Vector<Argument> &args)
+		{
+			// Starts at the left parenthesis
+			CHECK_RV(bool, isInBase, FindArgumentsInBase(run, groupSizeStorage, outArgTokens, outGroupSizes));
+			if (!isInBase)
+			{
+				// Copy everything up to and including the closing parenthesis
+				size_t depth = 0;
+				for (;;)
+				{
+					PPMacroToken token;
+					CHECK_RV(bool, haveToken, NextRawToken(run, true, token));
+					if (!haveToken)
+						return ReportError(CompilationErrorCode::kPPUnterminatedMacroInvocation);
+
+					if (token.m_kind == TokenKind::kLeftParen)
+					{
+						depth++;
+						if (depth == 1)
+							continue;
+					}
+					else if (token.m_kind == TokenKind::kRightParen)
+						depth--;
+
+					CHECK(argTokenStorage.Add(token));
+
+					if (depth == 0)
+						break;
+				}
+
+				size_t numArgTokens = 0;
+				CHECK_RV(bool, isClosed, MeasureGroups(argTokenStorage.ConstView(), groupSizeStorage, numArgTokens));
+				EXP_ASSERT(isClosed && numArgTokens + 1 == argTokenStorage.Size());
+
+				outArgTokens = argTokenStorage.ConstView().Subrange(0, numArgTokens);
+				outGroupSizes = groupSizeStorage.ConstView();
+			}
+
+			// Commas only separate arguments outside of nested parentheses, and the variable arguments take everything
+			// up to the closing parenthesis
+			const ArrayView<const PPMacroToken> argTokens = outArgTokens;
+			Argument arg;
+
+			for (size_t i = 0; i < argTokens.Size(); i++)
+			{
+				const PPMacroToken &token = argTokens[i];
+
+				if (token.m_kind == TokenKind::kLeftParen)
+				{
+					const size_t groupSize = outGroupSizes[i];
+					arg.m_numTokens += groupSize + 1;
+					i += groupSize;
+					continue;
+				}
+
+				if (token.m_kind == TokenKind::kComma)
+				{
+					const bool isInVariableArguments = (macro.m_isVariadic && args.Size() + 1 == macro.m_numParameters);
+					if (!isInVariableArguments)
+					{
+						CHECK(args.Add(arg));
+
+						arg = Argument();
+						arg.m_firstToken = i + 1;
+						continue;
+					}
+				}
+
+				arg.m_numTokens++;
+			}
+
+			CHECK(args.Add(arg));
+
+			// An empty argument list is one empty argument, which is no arguments for a macro without parameters,
+			// and variable arguments that are left out entirely are empty
+			if (macro.m_numParameters == 0 && args.Size() == 1 && args[0].m_numTokens == 0)
+			{
+				CHECK(args.Resize(0));
+			}
+			else if (macro.m_isVariadic && args.Size() + 1 == macro.m_numParameters)
+			{
+				Argument emptyArg;
+				emptyArg.m_firstToken = argTokens.Size();
+
+				CHECK(args.Add(emptyArg));
+			}
+
+			if (args.Size() != macro.m_numParameters)
+				return ReportError(CompilationErrorCode::kPPMacroArgumentCountMismatch);
+
+			return ErrorCode::kOK;
+		}
+
+		ResultRV<bool> PPMacroExpander::FindArgumentsInBase(Run &run, Vector<size_t> &groupSizeStorage, ArrayView<const PPMacroToken> &outArgTokens, ArrayView<const size_t> &outGroupSizes)
+		{
+			// An invocation that is entirely in the base tokens doesn't need its arguments copied.  Its arguments are
+			// expanded in place, and since a nested invocation in them gets its extent from the group sizes instead of
+			// searching for its closing parenthesis again, each level of nesting only costs as much as its own tokens.
+			while (run.m_numContexts > 0)
+			{
+				const Context &context = run.m_contexts[run.m_numContexts - 1];
+				if (context.m_nextToken < context.m_numTokens)
+					return false;
+
+				PopContext(run);
+			}
+
+			const size_t leftParen = run.m_nextBaseToken;
+			EXP_ASSERT(leftParen < run.m_baseTokens.Size() && run.m_baseTokens[leftParen].m_kind == TokenKind::kLeftParen);
+
+			size_t numArgTokens = 0;
+			if (run.m_baseGroupSizes.Size() > 0)
+			{
+				numArgTokens = run.m_baseGroupSizes[leftParen] - 1;
+				outGroupSizes = run.m_baseGroupSizes.Subrange(leftParen + 1, numArgTokens);
+			}
+			else
+			{
+				// The closing parenthesis may be on a line that hasn't been pulled yet
+				CHECK_RV(bool, isClosed, MeasureGroups(run.m_baseTokens.Subrange(leftParen + 1), groupSizeStorage, numArgTokens));
+				if (!isClosed)
+					return false;
+
+				outGroupSizes = groupSizeStorage.ConstView().Subrange(0, numArgTokens);
+			}
+
+			outArgTokens = run.m_baseTokens.Subrange(leftParen + 1, numArgTokens);
+			run.m_nextBaseToken = leftParen + numArgTokens + 2;
+
+			return true;
+		}
+
+		ResultRV<bool> PPMacroExpander::MeasureGroups(const ArrayView<const PPMacroToken> &tokens, Vector<size_t> &outGroupSizes, size_t &outNumTokens)
+		{
+			// Finds the unmatched right parenthesis in tokens and the group size of every left parenthesis before it
+			Vector<size_t> openGroups(m_alloc);
+			size_t numOpenGroups = 0;
+
+			outGroupSizes.Clear();
+
+			for (size_t i = 0; i < tokens.Size(); i++)
+			{
+				const TokenKind kind = tokens[i].m_kind;
+
+				if (kind == TokenKind::kRightParen)
+				{
+					if (numOpenGroups == 0)
+					{
+						outNumTokens = i;
+						return true;
+					}
+
+					numOpenGroups--;
+
+					const size_t leftParen = openGroups[numOpenGroups];
+					outGroupSizes[leftParen] = i - leftParen;
+				}
+				else if (kind == TokenKind::kLeftParen)
+				{
+					if (numOpenGroups == openGroups.Size())
+					{
+						CHECK(openGroups.Add(i));
+					}
+					else
+						openGroups[numOpenGroups] = i;
+
+					numOpenGroups++;
+				}
+
+				CHECK(outGroupSizes.Add(0));
+			}
+
+			return false;
+		}
+
+		ResultRV<ArrayView<const PPMacroToken>> PPMacroExpander::Substitute(const Run &run, const PPMacro &macro, const ArrayView<const PPMacroToken> &argTokens, const ArrayView<const size_t> &argGroupSizes, const ArrayView<Argument> &args)
+		{
+			Vector<PPMacroToken> result(m_alloc);
+
+			bool pasteLeft = false;
+			bool avoidPaste = false;
+
+			for (const PPMacroToken &replacementToken : macro.m_replacementList)
+			{
+				const bool pasteRight = replacementToken.HasFlag(PPMacroToken::kFlagPasteNext);
+				const uint8_t leadingSpace = (replacementToken.m_flags & PPMacroToken::kFlagLeadingSpace);
+
+				ArrayView<const PPMacroToken> operands;
+				PPMacroToken singleToken;
+				bool isReplacedArgument = false;
+
+				if (replacementToken.m_parameterIndex == PPMacroToken::kNotAParameter)
+				{
+					singleToken = replacementToken;
+					singleToken.m_flags &= ~PPMacroToken::kFlagPasteNext;
+					operands = ArrayView<const PPMacroToken>(&singleToken, 1);
+				}
+				else
+				{
+					Argument &arg = args[replacementToken.m_parameterIndex];
+					const ArrayView<const PPMacroToken> rawArg = argTokens.Subrange(arg.m_firstToken, arg.m_numTokens);
+
+					if (replacementToken.HasFlag(PPMacroToken::kFlagStringify))
+					{
+						CHECK_RV_ASSIGN(singleToken, Stringify(rawArg, leadingSpace));
+						operands = ArrayView<const PPMacroToken>(&singleToken, 1);
+					}
+					else if (pasteLeft || pasteRight)
+					{
+						// Operands of ## aren't replaced first
+						operands = rawArg;
+					}
+					else
+					{
+						if (!arg.m_isExpanded)
+						{
+							CHECK(ExpandArgument(run, rawArg, argGroupSizes.Subrange(arg.m_firstToken, arg.m_numTokens), arg));
+						}
+
+						operands = arg.m_expansion;
+						isReplacedArgument = true;
+					}
+
+					if (operands.Size() == 0)
+					{
+						singleToken = PPMacroToken(ArrayView<const uint8_t>(), TokenKind::kOther, PPMacroToken::kFlagPlacemarker);
+						operands = ArrayView<const PPMacroToken>(&singleToken, 1);
+					}
+				}
+
+				size_t firstOperand = 0;
+				if (pasteLeft)
+				{
+					PPMacroToken &left = result[result.Size() - 1];
+					CHECK_RV(PPMacroToken, pasted, Paste(left, operands[0]));
+					left = pasted;
+
+					firstOperand = 1;
+				}
+
+				for (size_t i = firstOperand; i < operands.Size(); i++)
+				{
+					PPMacroToken token = operands[i];
+					if (i == 0)
+					{
+						token.m_flags = (token.m_flags & ~PPMacroToken::kFlagLeadingSpace) | leadingSpace;
+
+						// Replaced arguments are expansion boundaries on both sides
+						if (avoidPaste || isReplacedArgument)
+							token.m_flags |= PPMacroToken::kFlagAvoidPaste;
+					}
+
+					CHECK(result.Add(token));
+				}
+
+				if (firstOperand < operands.Size())
+					avoidPaste = isReplacedArgument;
+
+				pasteLeft = pasteRight;
+			}
+
+			// Placemarkers have done their job once ## has been applied
+			size_t numKept = 0;
+			for (size_t i = 0; i < result.Size(); i++)
+			{
+				if (!result[i].HasFlag(PPMacroToken::kFlagPlacemarker))
+					result[numKept++] = result[i];
+			}
+
+			return CommitTokens(result.ConstView().Subrange(0, numKept));
+		}
+
+		Result PPMacroExpander::ExpandArgument(const Run &outerRun, const ArrayView<const PPMacroToken> &argTokens, const ArrayView<const size_t> &argGroupSizes, Argument &arg)
+		{
+			if (outerRun.m_argumentDepth == kMaxArgumentDepth)
+				return ReportError(CompilationErrorCode::kPPMacroArgumentsNestedTooDeeply);
+
+			// Arguments are completely replaced on their own, as if they were the rest of the file
+			Run run(m_alloc, argTokens, argGroupSizes, nullptr, nullptr, outerRun.m_dependencies);
+			run.m_argumentDepth = outerRun.m_argumentDepth + 1;
+			Vector<PPMacroToken> expansion(m_alloc);
+
+			for (;;)
+			{
+				PPMacroToken token;
+				CHECK_RV(bool, haveToken, NextToken(run, token));
+				if (!haveToken)
+					break;
+
+				CHECK(expansion.Add(token));
+			}
+
+			CHECK_RV_ASSIGN(arg.m_expansion, CommitTokens(expansion.ConstView()));
+			arg.m_isExpanded = true;
+
+			return ErrorCode::kOK;
+		}
+
+		ResultRV<PPMacroToken> PPMacroExpander::Stringify(const ArrayView<const PPMacroToken> &tokens, uint8_t flags)
+		{
+			Vector<uint8_t> chars(m_alloc);
+
+			CHECK(chars.Add(static_cast<uint8_t>(CharCode::kDoubleQuote)));
+
+			for (size_t i = 0; i < tokens.Size(); i++)
+			{
+				const PPMacroToken &token = tokens[i];
+
+				if (i > 0 && token.HasFlag(PPMacroToken::kFlagLeadingSpace))
+				{
+					CHECK(chars.Add(static_cast<uint8_t>(CharCode::kSpace)));
+				}
+
+				const bool isCharSequence = IsCharSequenceLiteral(token.m_spelling);
+
+				for (uint8_t ch : token.m_spelling)
+				{
+					if (isCharSequence && (ch == CharCode::kDoubleQuote || ch == CharCode::kBackslash))
+					{
+						CHECK(chars.Add(static_cast<uint8_t>(CharCode::kBackslash)));
+					}
+
+					CHECK(chars.Add(ch));
+				}
+			}
+
+			CHECK(chars.Add(static_cast<uint8_t>(CharCode::kDoubleQuote)));
+
+			CHECK_RV(ArrayView<const uint8_t>, spelling, CommitChars(chars.ConstView()));
+
+			return PPMacroToken(spelling, TokenKind::kOther, flags);
+		}
+
+		ResultRV<PPMacroToken> PPMacroExpander::Paste(const PPMacroToken &left, const PPMacroToken &right)
+		{
+			if (left.HasFlag(PPMacroToken::kFlagPlacemarker))
+			{
+				PPMacroToken result = right;
+				result.m_flags = (right.m_flags & ~PPMacroToken::kFlagLeadingSpace) | (left.m_flags & PPMacroToken::kFlagLeadingSpace);
+				return result;
+			}
+
+			if (right.HasFlag(PPMacroToken::kFlagPlacemarker))
+				return left;
+
+			Vector<uint8_t> chars(m_alloc);
+			CHECK(chars.Add(left.m_spelling));
+			CHECK(chars.Add(right.m_spelling));
+
+			bool isIdentifier = false;
+			if (!IsSinglePPToken(chars.ConstView(), isIdentifier))
+				return ReportError(CompilationErrorCode::kPPInvalidTokenPaste);
+
+			CHECK_RV(ArrayView<const uint8_t>, spelling, CommitChars(chars.ConstView()));
+
+			uint8_t flags = (left.m_flags & PPMacroToken::kFlagLeadingSpace);
+			TokenKind kind = TokenKind::kOther;
+			if (isIdentifier)
+			{
+				flags |= PPMacroToken::kFlagIdentifier;
+				kind = TokenKindLookup::FindKeyword(spelling.begin(), spelling.Size());
+			}
+			else
+				kind = TokenKindLookup::FindPunctuator(spelling.begin(), spelling.Size());
+
+			return PPMacroToken(spelling, kind, flags);
+		}
+
+		ResultRV<ArrayView<const PPMacroToken>> PPMacroExpander::CommitTokens(const ArrayView<const PPMacroToken> &tokens)
+		{
+			const size_t numTokens = tokens.Size();
+			if (numTokens == 0)
+				return ArrayView<const PPMacroToken>();
+
+			if (numTokens > std::numeric_limits<size_t>::max() / sizeof(PPMacroToken))
+				return ErrorCode::kOutOfMemory;
+
+			PPMacroToken *committedTokens = static_cast<PPMacroToken*>(m_scratchArena.Alloc(sizeof(PPMacroToken) * numTokens, alignof(PPMacroToken)));
+			if (committedTokens == nullptr)
+				return ErrorCode::kOutOfMemory;
+
+			for (size_t i = 0; i < numTokens; i++)
+				new (committedTokens + i) PPMacroToken(tokens[i]);
+
+			return ArrayView<const PPMacroToken>(committedTokens, numTokens);
+		}
+
+		ResultRV<ArrayView<const uint8_t>> PPMacroExpander::CommitChars(const ArrayView<const uint8_t> &chars)
+		{
+			const size_t numChars = chars.Size();
+			if (numChars == 0)
+				return ArrayView<const uint8_t>();
+
+			uint8_t *committedChars = static_cast<uint8_t*>(m_scratchArena.Alloc(numChars, 1));
+			if (committedChars == nullptr)
+				return ErrorCode::kOutOfMemory;
+
+			memcpy(committedChars, chars.begin(), numChars);
+
+			return ArrayView<const uint8_t>(committedChars, numChars);
+		}
+
+		bool PPMacroExpander::IsSinglePPToken(const ArrayView<const uint8_t> &chars, bool &outIsIdentifier)
+		{
+			outIsIdentifier = false;
+
+			const size_t size = chars.Size();
+			if (size == 0)
+				return false;
+
+			const uint8_t firstChar = chars[0];
+
+			if (IsIdentifierStartChar(firstChar))
+			{
+				size_t identifierLength = 1;
+				while (identifierLength < size && IsIdentifierChar(chars[identifierLength]))
+					identifierLength++;
+
+				if (identifierLength == size)
+				{
+					outIsIdentifier = true;
+					return true;
+				}
+
+				// Wide character constants and string literals
+				if (identifierLength == 1 && firstChar == CharCode::kUppercaseL)
+					return IsSingleCharSequence(chars.Subrange(1));
+
+				return false;
+			}
+
+			if (IsPPNumber(chars))
+			{
+				for (size_t i = 1; i < size; i++)
+				{
+					const uint8_t ch = chars[i];
+					if (IsIdentifierChar(ch) || ch == CharCode::kPeriod)
+						continue;
+
+					if ((ch == CharCode::kPlus || ch == CharCode::kMinus) && IsExponentChar(chars[i - 1]))
+						continue;
+
+					return false;
+				}
+
+				return true;
+			}
+
+			if (firstChar == CharCode::kDoubleQuote || firstChar == CharCode::kSingleQuote)
+				return IsSingleCharSequence(chars);
+
+			return TokenKindLookup::FindPunctuator(chars.begin(), size) != TokenKind::kOther;
+		}
+
+		bool PPMacroExpander::IsSingleCharSequence(const ArrayView<const uint8_t> &chars)
+		{
+			const size_t size = chars.Size();
+			if (size < 2)
+				return false;
+
+			const uint8_t quoteChar = chars[0];
+			if (quoteChar != CharCode::kDoubleQuote && quoteChar != CharCode::kSingleQuote)
+				return false;
+
+			for (size_t i = 1; i < size; i++)
+			{
+				const uint8_t ch = chars[i];
+				if (ch == CharCode::kBackslash)
+					i++;
+				else if (ch == quoteChar)
+					return i == size - 1;
+				else if (ch == CharCode::kLineFeed)
+					return false;
+			}
+
+			return false;
+		}
+
+		bool PPMacroExpander::WouldMerge(const PPMacroToken &left, const PPMacroToken &right)
+		{
+			const ArrayView<const uint8_t> leftChars = left.m_spelling;
+			const ArrayView<const uint8_t> rightChars = right.m_spelling;
+			if (leftChars.Size() == 0 || rightChars.Size() == 0)
+				return false;
+
+			const uint8_t lastChar = leftChars[leftChars.Size() - 1];
+			const uint8_t firstChar = rightChars[0];
+
+			if (IsPPNumber(leftChars))
+			{
+				return IsIdentifierChar(firstChar) || firstChar == CharCode::kPeriod
+					|| ((firstChar == CharCode::kPlus || firstChar == CharCode::kMinus) && IsExponentChar(lastChar));
+			}
+
+			if (left.HasFlag(PPMacroToken::kFlagIdentifier))
+			{
+				if (IsIdentifierChar(firstChar))
+					return true;
+
+				// L followed by a literal would make it wide
+				return leftChars.Size() == 1 && lastChar == CharCode::kUppercaseL && (firstChar == CharCode::kDoubleQuote || firstChar == CharCode::kSingleQuote);
+			}
+
+			if (lastChar == CharCode::kPeriod && IsDigitChar(firstChar))
+				return true;
+
+			return IsPunctuatorJoinChar(lastChar) && IsPunctuatorJoinChar(firstChar);
+		}
+
+		ErrorCode PPMacroExpander::ReportError(CompilationErrorCode errorCode)
+		{
+			m_errorReporter->ReportError(m_blameCoordinate, *m_includeStackTrace, errorCode);
+			return ErrorCode::kOperationFailed;
+		}
+	}
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ArenaAllocator.h"
+#include "ArrayView.h"
+#include "ErrorCode.h"
+#include "FileCoordinate.h"
+#include "IErrorReporter.h"
+#include "PPMacroTable.h"
+#include "Vector.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	template<class T> struct ResultRV;
+	struct IAllocator;
+	struct Result;
+
+	namespace cc
+	{
+		// C99 macro replacement (6.10.3).  Expansions are rescanned from a stack of contexts, one per macro being
+		// expanded, and a macro is disabled for as long as its context is on the stack, which stands in for the hide
+		// sets of the standard's description: a name read while its macro is disabled is painted so that it never
+		// expands again.  Object-like macros without ## are rescanned straight out of their replacement lists, and
+		// everything else builds its expansion once into scratch memory, so each token is only touched a bounded number
+		// of times per level of expansion instead of the whole sequence being rebuilt at every step.
+		class PPMacroExpander
+		{
+		public:
+			// Supplies the lines after the one being expanded, for invocations whose arguments continue past it
+			struct ILineSource
+			{
+				// Appends the tokens of the next line, or returns false if there isn't one that can be joined
+				virtual ResultRV<bool> PullLine(Vector<PPMacroToken> &tokens) = 0;
+			};
+
+			PPMacroExpander(IAllocator *alloc, PPMacroTable *macros, IErrorReporter *errorReporter, IIncludeStackTrace *includeStackTrace);
+
+			// Appends the full macro replacement of tokens to outTokens.  Errors are reported at blameCoordinate.  The
+			// result may refer to scratch memory, which stays valid until ResetScratch.  If there is a dependencies
+			// list, every macro name that was looked up is added to it.
+			Result Expand(const FileCoordinate &blameCoordinate, Vector<PPMacroToken> &tokens, ILineSource *lineSource, Vector<PPMacroDependency> *dependencies, Vector<PPMacroToken> &outTokens);
+			void ResetScratch();
+
+			// Appends the spellings of tokens as one line, with a space wherever one preceded a token and wherever an
+			// expansion boundary would otherwise turn two tokens into something else
+			static Result AppendSpellings(const ArrayView<const PPMacroToken> &tokens, Vector<uint8_t> &outChars);
+
+			// Same, but outChars starts a line and tokens spelled from sourceLine are spaced out to the column they
+			// have there, unless the output is already past it.  That keeps the columns of the output the same as
+			// the source's up to the first expansion that comes out longer than its invocation.
+			static Result AppendSpellingsAtSourceColumns(const ArrayView<const PPMacroToken> &tokens, const ArrayView<const uint8_t> &sourceLine, Vector<uint8_t> &outChars);
+
+		private:
+			struct Context
+			{
+				Context();
+
+				const PPMacroToken *m_tokens;
+				size_t m_numTokens;
+				size_t m_nextToken;
+				PPMacro *m_macro;
+			};
+
+			struct Run
+			{
+				Run(IAllocator *alloc, const ArrayView<const PPMacroToken> &baseTokens, const ArrayView<const size_t> &baseGroupSizes, Vector<PPMacroToken> *lineTokens, ILineSource *lineSource, Vector<PPMacroDependency> *dependencies);
+
+				ArrayView<const PPMacroToken> m_baseTokens;
+				size_t m_nextBaseToken;
+
+				// If known, the distance from each left parenthesis in m_baseTokens to the one that closes it.  Empty
+				// otherwise.
+				ArrayView<const size_t> m_baseGroupSizes;
+
+				// Only for runs that can pull more lines, m_baseTokens is a view of lineTokens
+				Vector<PPMacroToken> *m_lineTokens;
+				ILineSource *m_lineSource;
+
+				Vector<PPMacroDependency> *m_dependencies;
+
+				Vector<Context> m_contexts;
+				size_t m_numContexts;
+
+				uint8_t m_pendingFlags;
+
+				// How many arguments this run is nested in
+				unsigned int m_argumentDepth;
+			};
+
+			struct Argument
+			{
+				Argument();
+
+				size_t m_firstToken;
+				size_t m_numTokens;
+
+				// Arguments are only fully replaced if a parameter is used outside of # and ##, and only once
+				ArrayView<const PPMacroToken> m_expansion;
+				bool m_isExpanded;
+			};
+
+			static const size_t kScratchArenaBlockSize = 16 * 1024;
+
+			// Each level of arguments containing macro invocations is expanded recursively
+			static const unsigned int kMaxArgumentDepth = 256;
+
+			PPMacroExpander(const PPMacroExpander &other) = delete;
+			PPMacroExpander &operator=(const PPMacroExpander &other) = delete;
+
+			ResultRV<bool> NextToken(Run &run, PPMacroToken &outToken);
+			ResultRV<bool> NextRawToken(Run &run, bool mayPullLines, PPMacroToken &outToken);
+			ResultRV<bool> PeekRawToken(Run &run, PPMacroToken &outToken);
+			ResultRV<bool> PullLine(Run &run);
+			Result PushContext(Run &run, const ArrayView<const PPMacroToken> &tokens, PPMacro *macro);
+			void PopContext(Run &run);
+
+			ResultRV<bool> EnterMacro(Run &run, const PPMacroToken &nameToken, PPMacro *macro);
+			Result CollectArguments(Run &run, const PPMacro &macro, Vector<PPMacroToken> &argTokenStorage, Vector<size_t> &groupSizeStorage, ArrayView<const PPMacroToken> &outArgTokens, ArrayView<const size_t> &outGroupSizes, Vector<Argument> &args);
+			ResultRV<bool> FindArgumentsInBase(Run &run, Vector<size_t> &groupSizeStorage, ArrayView<const PPMacroToken> &outArgTokens, ArrayView<const size_t> &outGroupSizes);
+			ResultRV<bool> MeasureGroups(const ArrayView<const PPMacroToken> &tokens, Vector<size_t> &outGroupSizes, size_t &outNumTokens);
+			ResultRV<ArrayView<const PPMacroToken>> Substitute(const Run &run, const PPMacro &macro, const ArrayView<const PPMacroToken> &argTokens, const ArrayView<const size_t> &argGroupSizes, const ArrayView<Argument> &args);
+			Result ExpandArgument(const Run &run, const ArrayView<const PPMacroToken> &argTokens, const ArrayView<const size_t> &argGroupSizes, Argument &arg);
+
+			ResultRV<PPMacroToken> Stringify(const ArrayView<const PPMacroToken> &tokens, uint8_t flags);
+			ResultRV<PPMacroToken> Paste(const PPMacroToken &left, const PPMacroToken &right);
+			ResultRV<ArrayView<const PPMacroToken>> CommitTokens(const ArrayView<const PPMacroToken> &tokens);
+			ResultRV<ArrayView<const uint8_t>> CommitChars(const ArrayView<const uint8_t> &chars);
+
+			static bool IsSinglePPToken(const ArrayView<const uint8_t> &chars, bool &outIsIdentifier);
+			static bool IsSingleCharSequence(const ArrayView<const uint8_t> &chars);
+			static bool WouldMerge(const PPMacroToken &left, const PPMacroToken &right);
+
+			ErrorCode ReportError(CompilationErrorCode errorCode);
+
+			IAllocator *m_alloc;
+			PPMacroTable *m_macros;
+			ArenaAllocator m_scratchArena;
+
+			IErrorReporter *m_errorReporter;
+			IIncludeStackTrace *m_includeStackTrace;
+			FileCoordinate m_blameCoordinate;
+		};
+	}
+}
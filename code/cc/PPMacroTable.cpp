@@ -0,0 +1,226 @@
+#include "PPMacroTable.h"
+
+#include "Result.h"
+#include "ResultRV.h"
+#include "Vector.h"
+
+#include <cstring>
+#include <limits>
+#include <new>
+
+namespace expanse
+{
+	namespace cc
+	{
+		PPMacroToken::PPMacroToken()
+			: m_parameterIndex(kNotAParameter)
+			, m_kind(TokenKind::kOther)
+			, m_flags(0)
+		{
+		}
+
+		PPMacroToken::PPMacroToken(const ArrayView<const uint8_t> &spelling, TokenKind kind, uint8_t flags)
+			: m_spelling(spelling)
+			, m_parameterIndex(kNotAParameter)
+			, m_kind(kind)
+			, m_flags(flags)
+		{
+		}
+
+		bool PPMacroToken::HasFlag(uint8_t flag) const
+		{
+			return (m_flags & flag) != 0;
+		}
+
+		PPMacro::PPMacro()
+			: m_numParameters(0)
+			, m_isFunctionLike(false)
+			, m_isVariadic(false)
+			, m_hasPaste(false)
+			, m_isExpanding(false)
+			, m_version(0)
+		{
+		}
+
+		PPMacroDependency::PPMacroDependency()
+			: m_version(0)
+		{
+		}
+
+		PPMacroDependency::PPMacroDependency(const ArrayView<const uint8_t> &name, uint64_t version)
+			: m_name(name)
+			, m_version(version)
+		{
+		}
+
+		PPMacroTable::PPMacroTable(IAllocator *alloc)
+			: m_names(alloc)
+			, m_macros(*alloc)
+			, m_definitionArena(alloc, kDefinitionArenaBlockSize)
+		{
+		}
+
+		ResultRV<bool> PPMacroTable::Define(const ArrayView<const uint8_t> &name, const PPMacro &macro)
+		{
+			CHECK_RV(IdentifierAtom, atom, m_names.Intern(name));
+
+			HashMapIterator<IdentifierAtom, PPMacro> it = m_macros.Find(atom);
+			if (it != m_macros.end())
+				return IsSameDefinition(it.Value(), macro);
+
+			const ArrayView<const PPMacroToken> replacementList = macro.m_replacementList;
+			const size_t numTokens = replacementList.Size();
+
+			size_t numChars = 0;
+			for (const PPMacroToken &token : replacementList)
+			{
+				if (std::numeric_limits<size_t>::max() - numChars < token.m_spelling.Size())
+					return ErrorCode::kOutOfMemory;
+
+				numChars += token.m_spelling.Size();
+			}
+
+			PPMacro definition(macro);
+			definition.m_replacementList = ArrayView<const PPMacroToken>();
+			definition.m_isExpanding = false;
+
+			if (numTokens > 0)
+			{
+				if (numTokens > std::numeric_limits<size_t>::max() / sizeof(PPMacroToken))
+					return ErrorCode::kOutOfMemory;
+
+				PPMacroToken *tokens = static_cast<PPMacroToken*>(m_definitionArena.Alloc(sizeof(PPMacroToken) * numTokens, alignof(PPMacroToken)));
+				if (tokens == nullptr)
+					return ErrorCode::kOutOfMemory;
+
+				uint8_t *chars = nullptr;
+				if (numChars > 0)
+				{
+					chars = static_cast<uint8_t*>(m_definitionArena.Alloc(numChars, 1));
+					if (chars == nullptr)
+						return ErrorCode::kOutOfMemory;
+				}
+
+				size_t charOffset = 0;
+				for (size_t i = 0; i < numTokens; i++)
+				{
+					const PPMacroToken &token = replacementList[i];
+					const size_t spellingSize = token.m_spelling.Size();
+
+					if (spellingSize > 0)
+						memcpy(chars + charOffset, token.m_spelling.begin(), spellingSize);
+
+					PPMacroToken *copy = new (tokens + i) PPMacroToken(token);
+					copy->m_spelling = ArrayView<const uint8_t>(chars + charOffset, spellingSize);
+
+					charOffset += spellingSize;
+				}
+
+				definition.m_replacementList = ArrayView<const PPMacroToken>(tokens, numTokens);
+			}
+
+			definition.m_version = ComputeVersion(definition);
+
+			CHECK(m_macros.Insert(atom, definition));
+
+			return true;
+		}
+
+		void PPMacroTable::Undefine(const ArrayView<const uint8_t> &name)
+		{
+			IdentifierAtom atom;
+			if (m_names.TryFind(name, atom))
+				m_macros.Remove(atom);
+		}
+
+		PPMacro *PPMacroTable::Find(const ArrayView<const uint8_t> &name)
+		{
+			IdentifierAtom atom;
+			if (!m_names.TryFind(name, atom))
+				return nullptr;
+
+			HashMapIterator<IdentifierAtom, PPMacro> it = m_macros.Find(atom);
+			if (it == m_macros.end())
+				return nullptr;
+
+			return &it.Value();
+		}
+
+		uint64_t PPMacroTable::GetVersion(const ArrayView<const uint8_t> &name)
+		{
+			const PPMacro *macro = Find(name);
+			if (macro == nullptr)
+				return 0;
+
+			return macro->m_version;
+		}
+
+		Result PPMacroTable::AddDependency(Vector<PPMacroDependency> &dependencies, const ArrayView<const uint8_t> &name, const PPMacro *macro)
+		{
+			// Conditions only name a handful of macros, so a scan beats hashing
+			const size_t nameSize = name.Size();
+			for (size_t i = 0; i < dependencies.Size(); i++)
+			{
+				const PPMacroDependency &dependency = dependencies[i];
+				if (dependency.m_name.Size() == nameSize && !memcmp(dependency.m_name.begin(), name.begin(), nameSize))
+					return ErrorCode::kOK;
+			}
+
+			return dependencies.Add(PPMacroDependency(name, (macro == nullptr) ? 0 : macro->m_version));
+		}
+
+		bool PPMacroTable::IsSameDefinition(const PPMacro &a, const PPMacro &b)
+		{
+			// 6.10.3p2, whitespace only has to match in where it appears, not in how much of it there is
+			if (a.m_isFunctionLike != b.m_isFunctionLike || a.m_isVariadic != b.m_isVariadic || a.m_numParameters != b.m_numParameters)
+				return false;
+
+			const size_t numTokens = a.m_replacementList.Size();
+			if (b.m_replacementList.Size() != numTokens)
+				return false;
+
+			for (size_t i = 0; i < numTokens; i++)
+			{
+				const PPMacroToken &tokenA = a.m_replacementList[i];
+				const PPMacroToken &tokenB = b.m_replacementList[i];
+
+				if (tokenA.m_flags != tokenB.m_flags || tokenA.m_parameterIndex != tokenB.m_parameterIndex)
+					return false;
+
+				const size_t spellingSize = tokenA.m_spelling.Size();
+				if (tokenB.m_spelling.Size() != spellingSize || (spellingSize > 0 && memcmp(tokenA.m_spelling.begin(), tokenB.m_spelling.begin(), spellingSize)))
+					return false;
+			}
+
+			return true;
+		}
+
+		uint64_t PPMacroTable::ComputeVersion(const PPMacro &macro)
+		{
+			// FNV-1a over everything IsSameDefinition compares
+			const uint64_t kFNVOffsetBasis = 14695981039346656037ull;
+			const uint64_t kFNVPrime = 1099511628211ull;
+
+			uint64_t hash = kFNVOffsetBasis;
+
+			const uint8_t header[] = { static_cast<uint8_t>(macro.m_isFunctionLike), static_cast<uint8_t>(macro.m_isVariadic), static_cast<uint8_t>(macro.m_numParameters & 0xffu), static_cast<uint8_t>((macro.m_numParameters >> 8) & 0xffu) };
+			for (uint8_t ch : header)
+				hash = (hash ^ ch) * kFNVPrime;
+
+			for (const PPMacroToken &token : macro.m_replacementList)
+			{
+				const uint8_t tokenHeader[] = { token.m_flags, static_cast<uint8_t>(token.m_parameterIndex & 0xffu), static_cast<uint8_t>((token.m_parameterIndex >> 8) & 0xffu), static_cast<uint8_t>(token.m_spelling.Size() & 0xffu) };
+				for (uint8_t ch : tokenHeader)
+					hash = (hash ^ ch) * kFNVPrime;
+
+				for (uint8_t ch : token.m_spelling)
+					hash = (hash ^ ch) * kFNVPrime;
+			}
+
+			if (hash == 0)
+				hash = 1;
+
+			return hash;
+		}
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ArenaAllocator.h"
+#include "ArrayView.h"
+#include "HashMap.h"
+#include "IdentifierTable.h"
+#include "TokenKind.h"
+
+#include <cstdint>
+
+namespace expanse
+{
+	template<class T> struct ResultRV;
+	template<class T> struct Vector;
+	struct IAllocator;
+	struct Result;
+
+	namespace cc
+	{
+		// Preprocessing token as seen by macro expansion.  The spelling refers to wherever the token came from: the
+		// source file for tokens of the line being expanded, the macro table for replacement lists, or the expander's
+		// scratch memory for tokens made by # and ##.  Tokens are only ever copied when a macro is defined.
+		struct PPMacroToken
+		{
+			PPMacroToken();
+			PPMacroToken(const ArrayView<const uint8_t> &spelling, TokenKind kind, uint8_t flags);
+
+			bool HasFlag(uint8_t flag) const;
+
+			static const uint8_t kFlagLeadingSpace = 1;
+			static const uint8_t kFlagIdentifier = 2;
+			static const uint8_t kFlagNoExpand = 4;		// Named a macro while it was being expanded, so it never expands
+			static const uint8_t kFlagAvoidPaste = 8;		// First token after an expansion boundary, spaced out on output if it would merge with the previous one
+			static const uint8_t kFlagPlacemarker = 16;	// Stands in for an empty argument while ## is applied
+			static const uint8_t kFlagStringify = 32;		// Replacement lists only, the parameter is the operand of #
+			static const uint8_t kFlagPasteNext = 64;		// Replacement lists only, the token is the left operand of ##
+
+			static const uint32_t kNotAParameter = 0xffffffffu;
+
+			ArrayView<const uint8_t> m_spelling;
+			uint32_t m_parameterIndex;	// Replacement lists only
+			TokenKind m_kind;
+			uint8_t m_flags;
+		};
+
+		struct PPMacro
+		{
+			PPMacro();
+
+			ArrayView<const PPMacroToken> m_replacementList;
+			uint32_t m_numParameters;	// Includes __VA_ARGS__ for variadic macros
+			bool m_isFunctionLike;
+			bool m_isVariadic;
+			bool m_hasPaste;		// Object-like macros without ## are rescanned straight out of the replacement list
+			bool m_isExpanding;		// Set while the macro's own expansion is being rescanned
+
+			// Fingerprint of the definition, set by the table.  Identical definitions have the same version in every
+			// translation unit, and no definition has version 0, which stands for not being defined.
+			uint64_t m_version;
+		};
+
+		// A macro name that a result depended on, and the version of its definition at the time
+		struct PPMacroDependency
+		{
+			PPMacroDependency();
+			PPMacroDependency(const ArrayView<const uint8_t> &name, uint64_t version);
+
+			ArrayView<const uint8_t> m_name;
+			uint64_t m_version;
+		};
+
+		// Macro definitions of a translation unit.  Replacement lists are copied into an arena as they're defined, and
+		// #undef or an identical redefinition leaves the old copy there, which is cheap since both are rare.
+		class PPMacroTable
+		{
+		public:
+			explicit PPMacroTable(IAllocator *alloc);
+
+			// Copies the replacement list, whose parameter tokens must already have their indexes.  Returns false
+			// without changing anything if the name is already a macro with a different definition.
+			ResultRV<bool> Define(const ArrayView<const uint8_t> &name, const PPMacro &macro);
+			void Undefine(const ArrayView<const uint8_t> &name);
+
+			// Names that have never been defined are turned away by the name table without a map lookup
+			PPMacro *Find(const ArrayView<const uint8_t> &name);
+			uint64_t GetVersion(const ArrayView<const uint8_t> &name);
+
+			// Adds a lookup of name, which found macro or nullptr, unless dependencies already has the name
+			static Result AddDependency(Vector<PPMacroDependency> &dependencies, const ArrayView<const uint8_t> &name, const PPMacro *macro);
+
+		private:
+			static const size_t kDefinitionArenaBlockSize = 16 * 1024;
+
+			PPMacroTable(const PPMacroTable &other) = delete;
+			PPMacroTable &operator=(const PPMacroTable &other) = delete;
+
+			static bool IsSameDefinition(const PPMacro &a, const PPMacro &b);
+			static uint64_t ComputeVersion(const PPMacro &macro);
+
+			IdentifierTable m_names;
+			HashMap<IdentifierAtom, PPMacro> m_macros;
+			ArenaAllocator m_definitionArena;
+		};
+	}
+}
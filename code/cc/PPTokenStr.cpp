@@ -33,11 +33,26 @@ bool expanse::cc::TokenStr::operator!=(const TokenStr &other) const
 }
 
 expanse::cc::TokenStrView::TokenStrView()
+	: m_kind(TokenKind::kOther)
 {
 }
 
 expanse::cc::TokenStrView::TokenStrView(const ArrayView<const uint8_t> &token)
 	: m_token(token)
+	, m_kind(TokenKind::kOther)
+{
+}
+
+expanse::cc::TokenStrView::TokenStrView(const ArrayView<const uint8_t> &token, TokenKind kind)
+	: m_token(token)
+	, m_kind(kind)
+{
+}
+
+expanse::cc::TokenStrView::TokenStrView(const ArrayView<const uint8_t> &token, TokenKind kind, const IdentifierAtom &atom)
+	: m_token(token)
+	, m_kind(kind)
+	, m_atom(atom)
 {
 }
 
@@ -46,6 +61,16 @@ expanse::ArrayView<const uint8_t> expanse::cc::TokenStrView::GetToken() const
 	return m_token;
 }
 
+expanse::cc::TokenKind expanse::cc::TokenStrView::GetKind() const
+{
+	return m_kind;
+}
+
+expanse::cc::IdentifierAtom expanse::cc::TokenStrView::GetAtom() const
+{
+	return m_atom;
+}
+
 bool expanse::cc::TokenStrView::operator==(const TokenStrView &other) const
 {
 	if (this == &other)
@@ -91,22 +116,22 @@ expanse::Hash_t expanse::Hasher<expanse::cc::TokenStrView>::Compute(const expans
 	return HashUtil::ComputePODHash(&token[0], token.Size());
 }
 
-bool expanse::Comparer<expanse::cc::TokenStr>::StrictlyEqual(const expanse::cc::TokenStr &a, const expanse::cc::TokenStr &b)
-{
-	return a.GetTokenView() == b.GetTokenView();
-}
-
-bool expanse::Comparer<expanse::cc::TokenStr>::StrictlyEqual(const expanse::cc::TokenStr &a, const expanse::cc::TokenStrView &b)
-{
-	return a.GetTokenView() == b;
-}
-
-bool expanse::Comparer<expanse::cc::TokenStrView>::StrictlyEqual(const expanse::cc::TokenStrView &a, const expanse::cc::TokenStr &b)
-{
-	return a == b.GetTokenView();
-}
-
-bool expanse::Comparer<expanse::cc::TokenStrView>::StrictlyEqual(const expanse::cc::TokenStrView &a, const expanse::cc::TokenStrView &b)
-{
-	return a == b;
-}
+bool expanse::Comparer<expanse::cc::TokenStr>::StrictlyEqual(const expanse::cc::TokenStr &a, const expanse::cc::TokenStr &b)
+{
+	return a.GetTokenView() == b.GetTokenView();
+}
+
+bool expanse::Comparer<expanse::cc::TokenStr>::StrictlyEqual(const expanse::cc::TokenStr &a, const expanse::cc::TokenStrView &b)
+{
+	return a.GetTokenView() == b;
+}
+
+bool expanse::Comparer<expanse::cc::TokenStrView>::StrictlyEqual(const expanse::cc::TokenStrView &a, const expanse::cc::TokenStr &b)
+{
+	return a == b.GetTokenView();
+}
+
+bool expanse::Comparer<expanse::cc::TokenStrView>::StrictlyEqual(const expanse::cc::TokenStrView &a, const expanse::cc::TokenStrView &b)
+{
+	return a == b;
+}
@@ -2,6 +2,8 @@
 
 #include "ArrayPtr.h"
 #include "ArrayView.h"
+#include "IdentifierAtom.h"
+#include "TokenKind.h"
 
 namespace expanse
 {
@@ -24,12 +26,18 @@ namespace expanse
 			ArrayPtr<uint8_t> m_token;
 		};
 
+		// The kind and atom are only known for tokens that came from the lexer, and aren't part of comparisons or
+		// hashing.  Only identifiers have an atom.
 		struct TokenStrView
 		{
 			TokenStrView();
 			explicit TokenStrView(const ArrayView<const uint8_t> &token);
+			TokenStrView(const ArrayView<const uint8_t> &token, TokenKind kind);
+			TokenStrView(const ArrayView<const uint8_t> &token, TokenKind kind, const IdentifierAtom &atom);
 
 			ArrayView<const uint8_t> GetToken() const;
+			TokenKind GetKind() const;
+			IdentifierAtom GetAtom() const;
 
 			template<size_t TSize>
 			bool IsString(const char (&str)[TSize]) const;
@@ -39,6 +47,8 @@ namespace expanse
 
 		private:
 			ArrayView<const uint8_t> m_token;
+			TokenKind m_kind;
+			IdentifierAtom m_atom;
 		};
 	}
 }
@@ -69,18 +79,18 @@ public:
 	static Hash_t Compute(const expanse::cc::TokenStrView &key);
 };
 
-template<>
-class expanse::Comparer<expanse::cc::TokenStr>
-{
-public:
-	static bool StrictlyEqual(const expanse::cc::TokenStr &a, const expanse::cc::TokenStr &b);
-	static bool StrictlyEqual(const expanse::cc::TokenStr &a, const expanse::cc::TokenStrView &b);
-};
-
-template<>
-class expanse::Comparer<expanse::cc::TokenStrView>
-{
-public:
-	static bool StrictlyEqual(const expanse::cc::TokenStrView &a, const expanse::cc::TokenStr &b);
-	static bool StrictlyEqual(const expanse::cc::TokenStrView &a, const expanse::cc::TokenStrView &b);
-};
+template<>
+class expanse::Comparer<expanse::cc::TokenStr>
+{
+public:
+	static bool StrictlyEqual(const expanse::cc::TokenStr &a, const expanse::cc::TokenStr &b);
+	static bool StrictlyEqual(const expanse::cc::TokenStr &a, const expanse::cc::TokenStrView &b);
+};
+
+template<>
+class expanse::Comparer<expanse::cc::TokenStrView>
+{
+public:
+	static bool StrictlyEqual(const expanse::cc::TokenStrView &a, const expanse::cc::TokenStr &b);
+	static bool StrictlyEqual(const expanse::cc::TokenStrView &a, const expanse::cc::TokenStrView &b);
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+
+namespace expanse
+{
+	namespace cc
+	{
+		// Rules that are retried at the same position often enough to be worth memoizing
+		enum class ParseRule
+		{
+			kDeclarator,
+			kAbstractDeclarator,
+			kTypeName,
+			kCastExpression,
+			kUnaryExpression,
+
+			kCount,
+		};
+
+		struct ParseRuleStats
+		{
+			ParseRuleStats();
+
+			size_t m_numCalls;
+			size_t m_numReentries;	// Calls at a position where the rule was already tried
+			size_t m_numMemoHits;	// Reentries answered from the memo without running the rule
+		};
+	}
+}
+
+namespace expanse
+{
+	namespace cc
+	{
+		inline ParseRuleStats::ParseRuleStats()
+			: m_numCalls(0)
+			, m_numReentries(0)
+			, m_numMemoHits(0)
+		{
+		}
+	}
+}
@@ -0,0 +1,272 @@
+#include "PreprocessorOutputChannel.h"
+
+#include "CharCodes.h"
+#include "Mem.h"
+#include "Mutex.h"
+#include "MutexLock.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "StringView.h"
+#include "ThreadEvent.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace expanse
+{
+	namespace cc
+	{
+		const size_t PreprocessorOutputChannel::kChunkSize;
+		const size_t PreprocessorOutputChannel::kMaxQueuedChunks;
+
+		PreprocessorOutputChannel::Chunk::Chunk()
+			: m_size(0)
+			, m_startOffset(0)
+		{
+		}
+
+		PreprocessorOutputChannel::WriteStream::WriteStream(PreprocessorOutputChannel *channel)
+			: m_channel(channel)
+		{
+		}
+
+		Result PreprocessorOutputChannel::WriteStream::SeekStart(UFilePos_t pos)
+		{
+			return ErrorCode::kNotImplemented;
+		}
+
+		Result PreprocessorOutputChannel::WriteStream::SeekCurrent(FilePos_t pos)
+		{
+			return ErrorCode::kNotImplemented;
+		}
+
+		Result PreprocessorOutputChannel::WriteStream::SeekEnd(FilePos_t pos)
+		{
+			return ErrorCode::kNotImplemented;
+		}
+
+		ResultRV<UFilePos_t> PreprocessorOutputChannel::WriteStream::GetPosition() const
+		{
+			return static_cast<UFilePos_t>(m_channel->m_numBytesWritten);
+		}
+
+		ResultRV<UFilePos_t> PreprocessorOutputChannel::WriteStream::GetSize() const
+		{
+			return static_cast<UFilePos_t>(m_channel->m_numBytesWritten);
+		}
+
+		bool PreprocessorOutputChannel::WriteStream::IsReadable()
+		{
+			return false;
+		}
+
+		bool PreprocessorOutputChannel::WriteStream::IsWriteable()
+		{
+			return true;
+		}
+
+		ResultRV<size_t> PreprocessorOutputChannel::WriteStream::Read(void *buffer, size_t size)
+		{
+			return ErrorCode::kNotImplemented;
+		}
+
+		ResultRV<size_t> PreprocessorOutputChannel::WriteStream::Write(const void *buffer, size_t size)
+		{
+			CHECK(m_channel->WriteChecked(static_cast<const uint8_t*>(buffer), size));
+			return size;
+		}
+
+		PreprocessorOutputChannel::PreprocessorOutputChannel(IAllocator *alloc, FileStream *teeStream)
+			: m_writeStream(this)
+			, m_teeStream(teeStream)
+			, m_numBytesWritten(0)
+			, m_queueStart(0)
+			, m_queueCount(0)
+			, m_isClosed(false)
+			, m_isAbandoned(false)
+			, m_producerErrorCode(ErrorCode::kOK)
+			, m_traceInfo(nullptr)
+		{
+		}
+
+		PreprocessorOutputChannel::~PreprocessorOutputChannel()
+		{
+		}
+
+		Result PreprocessorOutputChannel::Initialize()
+		{
+			IAllocator *alloc = GetCoreObjectAllocator();
+
+			CHECK_RV(CorePtr<Mutex>, mutex, Mutex::Create(alloc));
+			CHECK_RV(CorePtr<ThreadEvent>, chunkQueuedEvent, ThreadEvent::Create(alloc, UTF8StringView_t(""), true, false));
+			CHECK_RV(CorePtr<ThreadEvent>, chunkTakenEvent, ThreadEvent::Create(alloc, UTF8StringView_t(""), true, false));
+			CHECK_RV(ArrayPtr<Chunk>, queue, NewArray<Chunk>(alloc, kMaxQueuedChunks));
+
+			m_mutex = std::move(mutex);
+			m_chunkQueuedEvent = std::move(chunkQueuedEvent);
+			m_chunkTakenEvent = std::move(chunkTakenEvent);
+			m_queue = std::move(queue);
+
+			return ErrorCode::kOK;
+		}
+
+		FileStream *PreprocessorOutputChannel::GetWriteStream()
+		{
+			return &m_writeStream;
+		}
+
+		Result PreprocessorOutputChannel::Close(ErrorCode errorCode, CPreprocessorTraceInfo *traceInfo)
+		{
+			// The partial chunk still goes out on failure so that the tee stream gets everything that was produced
+			Result publishResult(PublishChunk());
+			const ErrorCode publishErrorCode = publishResult.GetErrorCode();
+			publishResult.Handle();
+
+			if (errorCode == ErrorCode::kOK)
+				errorCode = publishErrorCode;
+
+			{
+				MutexLock lock(m_mutex);
+				m_isClosed = true;
+				m_producerErrorCode = errorCode;
+				m_traceInfo = traceInfo;
+			}
+
+			m_chunkQueuedEvent->Set();
+
+			return errorCode;
+		}
+
+		bool PreprocessorOutputChannel::TryTakeChunk(Chunk &outChunk)
+		{
+			for (;;)
+			{
+				MutexLock lock(m_mutex);
+
+				if (m_queueCount > 0)
+				{
+					outChunk = std::move(m_queue[m_queueStart]);
+					m_queueStart = (m_queueStart + 1) % kMaxQueuedChunks;
+					m_queueCount--;
+
+					lock.Release();
+					m_chunkTakenEvent->Set();
+
+					return true;
+				}
+
+				if (m_isClosed)
+					return false;
+
+				lock.Release();
+				m_chunkQueuedEvent->Wait();
+			}
+		}
+
+		void PreprocessorOutputChannel::Abandon()
+		{
+			{
+				MutexLock lock(m_mutex);
+				m_isAbandoned = true;
+
+				for (size_t i = 0; i < m_queueCount; i++)
+					m_queue[(m_queueStart + i) % kMaxQueuedChunks] = Chunk();
+
+				m_queueStart = 0;
+				m_queueCount = 0;
+			}
+
+			m_chunkTakenEvent->Set();
+		}
+
+		ErrorCode PreprocessorOutputChannel::GetProducerErrorCode() const
+		{
+			MutexLock lock(m_mutex);
+			return m_producerErrorCode;
+		}
+
+		CPreprocessorTraceInfo *PreprocessorOutputChannel::GetTraceInfo() const
+		{
+			MutexLock lock(m_mutex);
+			return m_traceInfo;
+		}
+
+		Result PreprocessorOutputChannel::WriteChecked(const uint8_t *bytes, size_t size)
+		{
+			if (size == 0)
+				return ErrorCode::kOK;
+
+			const size_t capacity = m_pendingChunk.m_contents.Count();
+
+			if (capacity - m_pendingChunk.m_size < size)
+			{
+				// Chunks can only be cut where a line ends, a line that doesn't fit grows the chunk instead
+				if (m_pendingChunk.m_size > 0 && m_pendingChunk.m_contents[m_pendingChunk.m_size - 1] == CharCode::kLineFeed)
+				{
+					CHECK(PublishChunk());
+				}
+
+				if (size > std::numeric_limits<size_t>::max() - m_pendingChunk.m_size)
+					return ErrorCode::kOutOfMemory;
+
+				const size_t requiredCapacity = m_pendingChunk.m_size + size;
+				if (m_pendingChunk.m_contents.Count() < requiredCapacity)
+				{
+					const size_t newCapacity = std::max(std::max(requiredCapacity, kChunkSize), m_pendingChunk.m_contents.Count() * 2u);
+
+					CHECK_RV(ArrayPtr<uint8_t>, newContents, NewArrayUninitialized<uint8_t>(GetCoreObjectAllocator(), newCapacity));
+					if (m_pendingChunk.m_size > 0)
+						memcpy(&newContents[0], &m_pendingChunk.m_contents[0], m_pendingChunk.m_size);
+
+					m_pendingChunk.m_contents = std::move(newContents);
+				}
+			}
+
+			memcpy(&m_pendingChunk.m_contents[m_pendingChunk.m_size], bytes, size);
+
+			m_pendingChunk.m_size += size;
+			m_numBytesWritten += size;
+
+			return ErrorCode::kOK;
+		}
+
+		Result PreprocessorOutputChannel::PublishChunk()
+		{
+			if (m_pendingChunk.m_size == 0)
+				return ErrorCode::kOK;
+
+			Chunk chunk(std::move(m_pendingChunk));
+
+			m_pendingChunk = Chunk();
+			m_pendingChunk.m_startOffset = chunk.m_startOffset + chunk.m_size;
+
+			if (m_teeStream)
+			{
+				CHECK(m_teeStream->WriteAll(chunk.m_contents.ConstView().Subrange(0, chunk.m_size)));
+			}
+
+			for (;;)
+			{
+				MutexLock lock(m_mutex);
+
+				if (m_isAbandoned)
+					return ErrorCode::kOK;
+
+				if (m_queueCount < kMaxQueuedChunks)
+				{
+					m_queue[(m_queueStart + m_queueCount) % kMaxQueuedChunks] = std::move(chunk);
+					m_queueCount++;
+
+					lock.Release();
+					m_chunkQueuedEvent->Set();
+
+					return ErrorCode::kOK;
+				}
+
+				lock.Release();
+				m_chunkTakenEvent->Wait();
+			}
+		}
+	}
+}
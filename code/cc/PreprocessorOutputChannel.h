@@ -0,0 +1,116 @@
+#pragma once
+
+#include "ArrayPtr.h"
+#include "CoreObject.h"
+#include "CorePtr.h"
+#include "ErrorCode.h"
+#include "FileStream.h"
+
+#include <cstdint>
+
+namespace expanse
+{
+	template<class T> struct ResultRV;
+	struct IAllocator;
+	struct Result;
+	class Mutex;
+	class ThreadEvent;
+
+	namespace cc
+	{
+		class CPreprocessorTraceInfo;
+
+		// Bounded single-producer, single-consumer channel carrying preprocessed source from a CPreprocessor on one
+		// thread to a CCompiler on another.  The preprocessor writes to GetWriteStream() as it would to any output
+		// file, the output is cut into chunks on line boundaries so that no token ever spans two chunks, and the
+		// producer blocks once kMaxQueuedChunks chunks are waiting for the consumer.
+		//
+		// Each preprocessed line gets exactly one entry in the preprocessor's trace info, so line numbers in the
+		// output are also trace indexes.  The trace info itself is only handed to the consumer once the producer
+		// has closed the channel, since the producer keeps appending to it until then.
+		class PreprocessorOutputChannel final : public CoreObject
+		{
+		public:
+			struct Chunk
+			{
+				Chunk();
+
+				ArrayPtr<uint8_t> m_contents;	// Only the first m_size bytes are used
+				size_t m_size;
+				size_t m_startOffset;
+			};
+
+			// Every chunk is also written to teeStream, if there is one, before it is queued
+			PreprocessorOutputChannel(IAllocator *alloc, FileStream *teeStream);
+			~PreprocessorOutputChannel();
+
+			Result Initialize();
+
+			// Producer only
+			FileStream *GetWriteStream();
+			Result Close(ErrorCode errorCode, CPreprocessorTraceInfo *traceInfo);
+
+			// Consumer only.  TryTakeChunk blocks until a chunk is available, and returns false once the producer
+			// has closed the channel and every chunk has been taken.
+			bool TryTakeChunk(Chunk &outChunk);
+
+			// Consumer only.  Stops the producer from ever blocking on the consumer again, chunks produced from
+			// then on are only written to the tee stream.
+			void Abandon();
+
+			// Consumer only, valid once TryTakeChunk has returned false
+			ErrorCode GetProducerErrorCode() const;
+			CPreprocessorTraceInfo *GetTraceInfo() const;
+
+			static const size_t kChunkSize = 64 * 1024;
+			static const size_t kMaxQueuedChunks = 4;
+
+		private:
+			class WriteStream final : public FileStream
+			{
+			public:
+				explicit WriteStream(PreprocessorOutputChannel *channel);
+
+				Result SeekStart(UFilePos_t pos) override;
+				Result SeekCurrent(FilePos_t pos) override;
+				Result SeekEnd(FilePos_t pos) override;
+
+				ResultRV<UFilePos_t> GetPosition() const override;
+				ResultRV<UFilePos_t> GetSize() const override;
+
+				bool IsReadable() override;
+				bool IsWriteable() override;
+
+			protected:
+				ResultRV<size_t> Read(void *buffer, size_t size) override;
+				ResultRV<size_t> Write(const void *buffer, size_t size) override;
+
+			private:
+				PreprocessorOutputChannel *m_channel;
+			};
+
+			Result WriteChecked(const uint8_t *bytes, size_t size);
+			Result PublishChunk();
+
+			WriteStream m_writeStream;
+			FileStream *m_teeStream;
+
+			CorePtr<Mutex> m_mutex;
+			CorePtr<ThreadEvent> m_chunkQueuedEvent;
+			CorePtr<ThreadEvent> m_chunkTakenEvent;
+
+			// Producer state
+			Chunk m_pendingChunk;
+			size_t m_numBytesWritten;
+
+			// Guarded by m_mutex
+			ArrayPtr<Chunk> m_queue;
+			size_t m_queueStart;
+			size_t m_queueCount;
+			bool m_isClosed;
+			bool m_isAbandoned;
+			ErrorCode m_producerErrorCode;
+			CPreprocessorTraceInfo *m_traceInfo;
+		};
+	}
+}
@@ -0,0 +1,1577 @@
+#include "ArenaAllocator.h"
+#include "ArrayView.h"
+#include "BinaryHAsmWriter.h"
+#include "AsyncFileWorkQueue.h"
+#include "BufferedFileStream.h"
+#include "CCompiler.h"
+#include "CLexer.h"
+#include "CPreprocessor.h"
+#include "CPreprocessorTraceInfo.h"
+#include "CharCodes.h"
+#include "CompilerConfiguration.h"
+#include "CompilerConstant.h"
+#include "FileCache.h"
+#include "FileCoordinate.h"
+#include "IAllocator.h"
+#include "LType.h"
+#include "LineStartIndex.h"
+#include "MaxInt.h"
+#include "Mem.h"
+#include "MemoryRWFileStream.h"
+#include "NullErrorReporter.h"
+#include "NumericLiteral.h"
+#include "PooledAllocator.h"
+#include "PreprocessorOutputChannel.h"
+#include "PPConditionCache.h"
+#include "PPMacroTable.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "StringView.h"
+#include "TextHAsmWriter.h"
+#include "Thread.h"
+#include "ThreadEvent.h"
+#include "Vector.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace expanse
+{
+	namespace cc
+	{
+		namespace
+		{
+			ArrayView<const uint8_t> SpellingView(const char *spelling)
+			{
+				return ArrayView<const uint8_t>(reinterpret_cast<const uint8_t*>(spelling), strlen(spelling));
+			}
+
+			struct FloatDecodeCase
+			{
+				const char *m_spelling;
+				NumericLiteral::DecodeStatus m_status;
+				LType m_lType;
+				uint64_t m_bits;
+			};
+
+			const FloatDecodeCase kFloatDecodeCases[] =
+			{
+				{ "1.5", NumericLiteral::DecodeStatus::kOK, LType::kFloat64, 0x3ff8000000000000u },
+				{ "1.7976931348623157e308", NumericLiteral::DecodeStatus::kOK, LType::kFloat64, 0x7fefffffffffffffu },
+				{ "1.", NumericLiteral::DecodeStatus::kOK, LType::kFloat64, 0x3ff0000000000000u },
+				{ "1.e5", NumericLiteral::DecodeStatus::kOK, LType::kFloat64, 0x40f86a0000000000u },
+				{ "1.f", NumericLiteral::DecodeStatus::kOK, LType::kFloat32, 0x3f800000u },
+
+				// Too large for the type
+				{ "1e400", NumericLiteral::DecodeStatus::kOverflow, LType::kFloat64, 0 },
+				{ "0x1p1024", NumericLiteral::DecodeStatus::kOverflow, LType::kFloat64, 0 },
+				{ "1e39f", NumericLiteral::DecodeStatus::kOverflow, LType::kFloat32, 0 },
+
+				// Denormals
+				{ "4.9406564584124654e-324", NumericLiteral::DecodeStatus::kOK, LType::kFloat64, 1 },
+				{ "0x1p-1074", NumericLiteral::DecodeStatus::kOK, LType::kFloat64, 1 },
+				{ "0x1.8p-1075", NumericLiteral::DecodeStatus::kOK, LType::kFloat64, 1 },
+				{ "0x1p-149f", NumericLiteral::DecodeStatus::kOK, LType::kFloat32, 1 },
+
+				// Too small for even the smallest denormal
+				{ "1e-400", NumericLiteral::DecodeStatus::kOK, LType::kFloat64, 0 },
+				{ "0x1p-1080", NumericLiteral::DecodeStatus::kOK, LType::kFloat64, 0 },
+				{ "1e-50f", NumericLiteral::DecodeStatus::kOK, LType::kFloat32, 0 },
+			};
+
+			struct NumberLexCase
+			{
+				const char *m_text;
+				size_t m_tokenLength;
+			};
+
+			// Only the first m_tokenLength chars of the text are the number
+			const NumberLexCase kNumberLexCases[] =
+			{
+				{ "1", 1 },
+				{ "12u;", 3 },
+				{ "1e5", 3 },
+				{ "1e+5f)", 5 },
+				{ "1.5", 3 },
+				{ ".5L", 3 },
+				{ "1.", 2 },
+				{ "1.;", 2 },
+				{ "0.", 2 },
+				{ "1.+2", 2 },
+				{ "1.e5", 4 },
+				{ "1.E-5L,", 6 },
+				{ "1.f", 3 },
+				{ "0x1.p3", 6 },
+				{ "0x1f.", 4 },
+			};
+
+			unsigned int TestNumberLexing()
+			{
+				NullErrorReporter errorReporter;
+				NullIncludeStackTrace includeStackTrace;
+				unsigned int numFailures = 0;
+
+				for (const NumberLexCase &testCase : kNumberLexCases)
+				{
+					ArrayView<const uint8_t> token;
+					CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
+					FileCoordinate endCoord(0);
+					const bool haveToken = CLexer::TryGetToken(SpellingView(testCase.m_text), FileCoordinate(0), false, false, includeStackTrace, &errorReporter, false, false, token, tokenType, endCoord);
+
+					if (!haveToken || tokenType != CLexer::TokenType::kNumber || token.Size() != testCase.m_tokenLength)
+					{
+						fprintf(stderr, "Number lexed wrong: %s\n", testCase.m_text);
+						numFailures++;
+					}
+				}
+
+				return numFailures;
+			}
+
+			struct LineResolveCase
+			{
+				size_t m_fileOffset;
+				unsigned int m_line;
+				unsigned int m_column;
+			};
+
+			// Split into spans the same way whether the first one is indexed or skipped
+			const char *const kLineSpans[] = { "ab\n", "cd\r\n", "ef\rgh\nij" };
+
+			const LineResolveCase kLineResolveCases[] =
+			{
+				{ 7, 3, 0 },
+				{ 8, 3, 1 },
+				{ 11, 4, 1 },
+				{ 13, 5, 0 },
+				{ 14, 5, 1 },
+
+				// In the skipped span
+				{ 4, 3, 0 },
+			};
+
+			unsigned int TestLineSkipping(IAllocator *alloc)
+			{
+				unsigned int numFailures = 0;
+
+				for (int indexFirstSpan = 0; indexFirstSpan < 2; indexFirstSpan++)
+				{
+					LineStartIndex lineStarts(alloc);
+					if (indexFirstSpan)
+					{
+						Result addResult(lineStarts.AddSpan(SpellingView(kLineSpans[0])));
+						if (addResult.GetErrorCode() != ErrorCode::kOK)
+							numFailures++;
+						addResult.Handle();
+					}
+					else
+						lineStarts.SkipSpan(SpellingView(kLineSpans[0]));
+
+					lineStarts.SkipSpan(SpellingView(kLineSpans[1]));
+
+					Result addResult(lineStarts.AddSpan(SpellingView(kLineSpans[2])));
+					if (addResult.GetErrorCode() != ErrorCode::kOK)
+						numFailures++;
+					addResult.Handle();
+
+					for (const LineResolveCase &testCase : kLineResolveCases)
+					{
+						const FileLocation location = lineStarts.Resolve(FileCoordinate(testCase.m_fileOffset));
+						if (location.m_lineNumber != testCase.m_line || location.m_column != testCase.m_column)
+						{
+							fprintf(stderr, "Line resolved wrong after skipping: offset %u\n", static_cast<unsigned int>(testCase.m_fileOffset));
+							numFailures++;
+						}
+					}
+				}
+
+				return numFailures;
+			}
+
+			// Found and missing files are both remembered, keyed so that the device and path can't run together
+			Result CheckFileCache(IAllocator *alloc, bool &outPassed)
+			{
+				CHECK_RV(CorePtr<FileCache>, fileCache, New<FileCache>(alloc, alloc));
+				CHECK(fileCache->Initialize());
+
+				CHECK(fileCache->AddFile(UTF8StringView_t("a"), UTF8StringView_t("bc"), SpellingView("abc")));
+				CHECK(fileCache->AddMissingFile(UTF8StringView_t("ab"), UTF8StringView_t("c")));
+
+				ArrayPtr<uint8_t> contents;
+				CHECK_RV(FileCacheLookupResult, foundResult, fileCache->Lookup(alloc, UTF8StringView_t("a"), UTF8StringView_t("bc"), contents));
+				outPassed = (foundResult == FileCacheLookupResult::kFound && contents.Count() == 3 && memcmp(&contents[0], "abc", 3) == 0);
+
+				ArrayPtr<uint8_t> missingContents;
+				CHECK_RV(FileCacheLookupResult, missingResult, fileCache->Lookup(alloc, UTF8StringView_t("ab"), UTF8StringView_t("c"), missingContents));
+				outPassed = outPassed && missingResult == FileCacheLookupResult::kNotFound && missingContents.Count() == 0;
+
+				CHECK_RV(FileCacheLookupResult, uncachedResult, fileCache->Lookup(alloc, UTF8StringView_t("abc"), UTF8StringView_t(""), missingContents));
+				outPassed = outPassed && uncachedResult == FileCacheLookupResult::kNotCached;
+
+				CHECK_RV(bool, containsMissing, fileCache->Contains(UTF8StringView_t("ab"), UTF8StringView_t("c")));
+				CHECK_RV(bool, containsUncached, fileCache->Contains(UTF8StringView_t("a"), UTF8StringView_t("b")));
+				outPassed = outPassed && containsMissing && !containsUncached;
+
+				outPassed = outPassed && fileCache->GetHitCount() == 1 && fileCache->GetNegativeHitCount() == 1 && fileCache->GetMissCount() == 1;
+
+				return ErrorCode::kOK;
+			}
+
+			unsigned int TestFileCache(IAllocator *alloc)
+			{
+				bool passed = false;
+				Result checkResult(CheckFileCache(alloc, passed));
+				passed = passed && (checkResult.GetErrorCode() == ErrorCode::kOK);
+				checkResult.Handle();
+
+				if (!passed)
+				{
+					fputs("File cache looked up files wrong\n", stderr);
+					return 1;
+				}
+
+				return 0;
+			}
+
+			struct AllocatorTestCase
+			{
+				size_t m_size;
+				size_t m_alignment;
+			};
+
+			// Fills each allocation with its own byte so that overlaps show up once they're all checked
+			bool FillAllocatorTestAllocation(void *mem, size_t index, const AllocatorTestCase &testCase)
+			{
+				if (mem == nullptr || reinterpret_cast<uintptr_t>(mem) % testCase.m_alignment != 0)
+					return false;
+
+				memset(mem, static_cast<int>(index + 1u), testCase.m_size);
+				return true;
+			}
+
+			bool CheckAllocatorTestAllocation(const void *mem, size_t index, const AllocatorTestCase &testCase)
+			{
+				const uint8_t *bytes = static_cast<const uint8_t*>(mem);
+				for (size_t i = 0; i < testCase.m_size; i++)
+				{
+					if (bytes[i] != static_cast<uint8_t>(index + 1u))
+						return false;
+				}
+
+				return true;
+			}
+
+			// Includes allocations bigger than a block and more aligned than the block data
+			const AllocatorTestCase kArenaTestCases[] =
+			{
+				{ 1, 1 },
+				{ 24, 8 },
+				{ 3, 2 },
+				{ 100, 64 },
+				{ 7, 1 },
+				{ 1000, 16 },
+				{ 16, 128 },
+				{ 40, 8 },
+			};
+
+			const size_t kArenaTestBlockSize = 256;
+			const size_t kArenaTestMarkIndex = 3;
+
+			// Allocations are aligned and don't overlap, only the latest one can be resized, and rewinding hands the
+			// same memory out again
+			unsigned int TestArenaAllocator(IAllocator *alloc)
+			{
+				const size_t numCases = sizeof(kArenaTestCases) / sizeof(kArenaTestCases[0]);
+
+				ArenaAllocator arena(alloc, kArenaTestBlockSize);
+
+				const ArenaAllocator::Mark startMark = arena.GetMark();
+				ArenaAllocator::Mark midMark;
+
+				void *allocations[numCases];
+				bool passed = true;
+				for (size_t i = 0; i < numCases; i++)
+				{
+					if (i == kArenaTestMarkIndex)
+						midMark = arena.GetMark();
+
+					allocations[i] = arena.Alloc(kArenaTestCases[i].m_size, kArenaTestCases[i].m_alignment);
+					passed = passed && FillAllocatorTestAllocation(allocations[i], i, kArenaTestCases[i]);
+				}
+
+				for (size_t i = 0; i < numCases && passed; i++)
+					passed = CheckAllocatorTestAllocation(allocations[i], i, kArenaTestCases[i]);
+
+				// The latest allocation keeps its contents when it grows, but nothing else can be resized
+				const size_t lastIndex = numCases - 1u;
+				void *grown = arena.Realloc(allocations[lastIndex], kArenaTestBlockSize * 2u, kArenaTestCases[lastIndex].m_alignment);
+				passed = passed && grown != nullptr && CheckAllocatorTestAllocation(grown, lastIndex, kArenaTestCases[lastIndex]);
+				passed = passed && arena.Realloc(allocations[0], kArenaTestCases[0].m_size * 2u, kArenaTestCases[0].m_alignment) == nullptr;
+
+				arena.Rewind(midMark);
+				passed = passed && arena.Alloc(kArenaTestCases[kArenaTestMarkIndex].m_size, kArenaTestCases[kArenaTestMarkIndex].m_alignment) == allocations[kArenaTestMarkIndex];
+
+				// An allocation that fits where it is grows in place
+				void *inPlace = arena.Realloc(allocations[kArenaTestMarkIndex], kArenaTestCases[kArenaTestMarkIndex].m_size + 8u, kArenaTestCases[kArenaTestMarkIndex].m_alignment);
+				passed = passed && inPlace == allocations[kArenaTestMarkIndex];
+
+				arena.Rewind(startMark);
+				passed = passed && arena.Alloc(kArenaTestCases[0].m_size, kArenaTestCases[0].m_alignment) == allocations[0];
+
+				if (!passed)
+				{
+					fputs("Arena allocator handed out memory wrong\n", stderr);
+					return 1;
+				}
+
+				return 0;
+			}
+
+			// Small and large, including small sizes aligned past what any slot that fits them is
+			const AllocatorTestCase kPooledTestCases[] =
+			{
+				{ 1, 1 },
+				{ 16, 16 },
+				{ 17, 8 },
+				{ 48, 32 },
+				{ 100, 64 },
+				{ 4000, 4096 },
+				{ PooledAllocator::kMaxSmallSize, 16 },
+				{ PooledAllocator::kMaxSmallSize + 1u, 16 },
+				{ 100000, 65536 },
+			};
+
+			const size_t kNumPooledTestCases = sizeof(kPooledTestCases) / sizeof(kPooledTestCases[0]);
+
+			struct PooledAllocatorTestThread
+			{
+				PooledAllocator *m_alloc;
+				void *m_allocations[kNumPooledTestCases];
+				bool m_passed;
+			};
+
+			int PooledAllocatorTestThreadFunc(void *userdata)
+			{
+				PooledAllocatorTestThread *thread = static_cast<PooledAllocatorTestThread*>(userdata);
+
+				for (size_t i = 0; i < kNumPooledTestCases; i++)
+				{
+					thread->m_allocations[i] = thread->m_alloc->Alloc(kPooledTestCases[i].m_size, kPooledTestCases[i].m_alignment);
+					thread->m_passed = FillAllocatorTestAllocation(thread->m_allocations[i], i, kPooledTestCases[i]) && thread->m_passed;
+				}
+
+				return 0;
+			}
+
+			// Allocations made on a thread that has since exited are released on another one, and a small allocation
+			// grows into a large one and back.  Everything has to be accounted for once it's all released.
+			Result CheckPooledAllocator(IAllocator *alloc, bool &outPassed)
+			{
+				PooledAllocator pooledAlloc(alloc, true);
+				CHECK(pooledAlloc.Initialize());
+
+				PooledAllocatorTestThread thread;
+				thread.m_alloc = &pooledAlloc;
+				thread.m_passed = true;
+
+				CHECK_RV(CorePtr<Thread>, allocThread, Thread::CreateThread(alloc, PooledAllocatorTestThreadFunc, &thread, UTF8StringView_t("SelfTestAlloc")));
+				allocThread->WaitForExit();
+
+				outPassed = thread.m_passed;
+				for (size_t i = 0; i < kNumPooledTestCases && outPassed; i++)
+					outPassed = CheckAllocatorTestAllocation(thread.m_allocations[i], i, kPooledTestCases[i]);
+
+				for (void *mem : thread.m_allocations)
+					pooledAlloc.Release(mem);
+
+				const AllocatorTestCase smallCase = { 24, 8 };
+				void *mem = pooledAlloc.Alloc(smallCase.m_size, smallCase.m_alignment);
+				outPassed = FillAllocatorTestAllocation(mem, 0, smallCase) && outPassed;
+
+				void *grown = (mem != nullptr) ? pooledAlloc.Realloc(mem, PooledAllocator::kMaxSmallSize * 4u, smallCase.m_alignment) : nullptr;
+				if (grown != nullptr)
+					mem = grown;
+
+				// Large allocations are rounded up, so shrinking stays where it is
+				void *shrunk = (grown != nullptr) ? pooledAlloc.Realloc(grown, smallCase.m_size, smallCase.m_alignment) : nullptr;
+				outPassed = outPassed && grown != nullptr && shrunk == grown && CheckAllocatorTestAllocation(shrunk, 0, smallCase);
+
+				pooledAlloc.Release(mem);
+
+				const PooledAllocator::Stats stats = pooledAlloc.GetStats();
+				outPassed = outPassed && stats.m_liveBytes == 0 && stats.m_peakLiveBytes > 0 && stats.m_numLargeAllocations >= 4 && stats.m_numInPlaceReallocs == 1;
+
+				for (size_t i = 0; i < pooledAlloc.GetNumSizeClasses() && outPassed; i++)
+					outPassed = (pooledAlloc.GetSizeClassStats(i).m_numLive == 0);
+
+				return ErrorCode::kOK;
+			}
+
+			unsigned int TestPooledAllocator(IAllocator *alloc)
+			{
+				bool passed = false;
+				Result checkResult(CheckPooledAllocator(alloc, passed));
+				passed = passed && (checkResult.GetErrorCode() == ErrorCode::kOK);
+				checkResult.Handle();
+
+				if (!passed)
+				{
+					fputs("Pooled allocator handed out memory wrong\n", stderr);
+					return 1;
+				}
+
+				return 0;
+			}
+
+			struct OutputChannelTestProducer
+			{
+				PreprocessorOutputChannel *m_channel;
+				ErrorCode m_errorCode;
+			};
+
+			const uint32_t kNumOutputChannelTestLines = 40000;
+			const uint32_t kOutputChannelTestLongLine = 1000;
+
+			Result WriteOutputChannelTestLines(FileStream *stream)
+			{
+				for (uint32_t i = 0; i < kNumOutputChannelTestLines; i++)
+				{
+					char line[64];
+					const int lineSize = snprintf(line, sizeof(line), "int v%u = %u;\n", i, i * 7u);
+					CHECK(stream->WriteAll(ArrayView<const char>(line, static_cast<size_t>(lineSize))));
+
+					// One line that doesn't fit in a chunk on its own
+					if (i == kOutputChannelTestLongLine)
+					{
+						for (size_t j = 0; j <= PreprocessorOutputChannel::kChunkSize / 16u; j++)
+						{
+							CHECK(stream->WriteAll(ArrayView<const char>("/*comment text*/", 16)));
+						}
+						CHECK(stream->WriteAll(ArrayView<const char>("\n", 1)));
+					}
+				}
+
+				return ErrorCode::kOK;
+			}
+
+			int OutputChannelTestProducerFunc(void *userdata)
+			{
+				OutputChannelTestProducer *producer = static_cast<OutputChannelTestProducer*>(userdata);
+
+				Result writeResult(WriteOutputChannelTestLines(producer->m_channel->GetWriteStream()));
+				const ErrorCode writeErrorCode = writeResult.GetErrorCode();
+				writeResult.Handle();
+
+				Result closeResult(producer->m_channel->Close(writeErrorCode, nullptr));
+				producer->m_errorCode = closeResult.GetErrorCode();
+				closeResult.Handle();
+
+				return 0;
+			}
+
+			// Far more output than the channel holds at once goes through it, so the producer has to block.  Every
+			// chunk has to end on a line break and pick up where the last one left off, and together they have to
+			// match what went to the tee stream.
+			Result CheckOutputChannel(IAllocator *alloc, bool &outPassed)
+			{
+				CHECK_RV(CorePtr<MemoryRWFileStream>, teeStream, New<MemoryRWFileStream>(alloc, alloc));
+				CHECK_RV(CorePtr<PreprocessorOutputChannel>, channel, New<PreprocessorOutputChannel>(alloc, alloc, teeStream.Get()));
+				CHECK(channel->Initialize());
+
+				OutputChannelTestProducer producer;
+				producer.m_channel = channel;
+				producer.m_errorCode = ErrorCode::kOK;
+
+				CHECK_RV(CorePtr<Thread>, producerThread, Thread::CreateThread(alloc, OutputChannelTestProducerFunc, &producer, UTF8StringView_t("SelfTestProducer")));
+
+				Vector<PreprocessorOutputChannel::Chunk> chunks(alloc);
+				ErrorCode addErrorCode = ErrorCode::kOK;
+
+				PreprocessorOutputChannel::Chunk chunk;
+				while (channel->TryTakeChunk(chunk))
+				{
+					// Chunks are still taken after a failure so that the producer isn't left blocked
+					if (addErrorCode == ErrorCode::kOK)
+					{
+						Result addResult(chunks.Add(std::move(chunk)));
+						addErrorCode = addResult.GetErrorCode();
+						addResult.Handle();
+					}
+				}
+
+				producerThread->WaitForExit();
+
+				if (addErrorCode != ErrorCode::kOK)
+					return addErrorCode;
+
+				if (producer.m_errorCode != ErrorCode::kOK)
+					return producer.m_errorCode;
+				CHECK_RV(ArrayPtr<uint8_t>, teeContents, teeStream->ContentsToArray());
+
+				outPassed = (channel->GetProducerErrorCode() == ErrorCode::kOK && chunks.Size() > PreprocessorOutputChannel::kMaxQueuedChunks);
+
+				size_t offset = 0;
+				for (size_t i = 0; i < chunks.Size() && outPassed; i++)
+				{
+					const PreprocessorOutputChannel::Chunk &takenChunk = chunks[i];
+
+					outPassed = (takenChunk.m_startOffset == offset && takenChunk.m_size > 0 && takenChunk.m_size <= teeContents.Count() - offset);
+					outPassed = outPassed && takenChunk.m_contents[takenChunk.m_size - 1] == CharCode::kLineFeed;
+					outPassed = outPassed && memcmp(&takenChunk.m_contents[0], &teeContents[offset], takenChunk.m_size) == 0;
+
+					offset += takenChunk.m_size;
+				}
+
+				outPassed = outPassed && offset == teeContents.Count();
+
+				return ErrorCode::kOK;
+			}
+
+			unsigned int TestOutputChannel(IAllocator *alloc)
+			{
+				bool passed = false;
+				Result checkResult(CheckOutputChannel(alloc, passed));
+				passed = passed && (checkResult.GetErrorCode() == ErrorCode::kOK);
+				checkResult.Handle();
+
+				if (!passed)
+				{
+					fputs("Preprocessor output channel chunked output wrong\n", stderr);
+					return 1;
+				}
+
+				return 0;
+			}
+
+			const char *const kSourceDevice = "selftest";
+
+			enum AsyncFileTestItem
+			{
+				kAsyncFileTestSpeculative,
+				kAsyncFileTestNormal,
+				kAsyncFileTestCancelled,
+				kAsyncFileTestPromoted,
+				kAsyncFileTestBlocking,
+
+				kNumAsyncFileTestItems,
+			};
+
+			// The request side references, released on destruction
+			struct AsyncFileTestItems
+			{
+			public:
+				AsyncFileTestItems();
+				~AsyncFileTestItems();
+
+				AsyncFileWorkItem *m_items[kNumAsyncFileTestItems];
+			};
+
+			AsyncFileTestItems::AsyncFileTestItems()
+			{
+				for (AsyncFileWorkItem *&item : m_items)
+					item = nullptr;
+			}
+
+			AsyncFileTestItems::~AsyncFileTestItems()
+			{
+				for (AsyncFileWorkItem *item : m_items)
+				{
+					if (item != nullptr)
+						item->Release();
+				}
+			}
+
+			// Stands in for an IO worker, loading everything queued in the order it's popped
+			struct AsyncFileTestWorker
+			{
+				AsyncFileWorkQueue *m_queue;
+				AsyncFileWorkItem *m_loadOrder[kNumAsyncFileTestItems];
+				size_t m_numLoads;
+			};
+
+			int AsyncFileTestWorkerFunc(void *userdata)
+			{
+				AsyncFileTestWorker *worker = static_cast<AsyncFileTestWorker*>(userdata);
+
+				while (AsyncFileWorkItem *workItem = worker->m_queue->TryPop())
+				{
+					if (workItem->TryBeginLoad())
+					{
+						if (worker->m_numLoads < kNumAsyncFileTestItems)
+							worker->m_loadOrder[worker->m_numLoads] = workItem;
+						worker->m_numLoads++;
+
+						workItem->Complete(ErrorCode::kOK, ArrayPtr<uint8_t>());
+					}
+
+					workItem->Release();
+				}
+
+				return 0;
+			}
+
+			// Loads are picked up most urgent first, a promoted load is picked up once at its new priority, and a
+			// cancelled one isn't picked up at all.  The requester waits for the load on another thread.
+			Result CheckAsyncFileWorkQueue(IAllocator *alloc, bool &outPassed)
+			{
+				CHECK_RV(CorePtr<AsyncFileWorkQueue>, queue, New<AsyncFileWorkQueue>(alloc));
+				CHECK(queue->Initialize(kNumAsyncFileTestItems));
+
+				CHECK_RV(CorePtr<ThreadEvent>, finishEvent, ThreadEvent::Create(alloc, UTF8StringView_t("SelfTestLoad"), true, false));
+
+				const AsyncFileRequestPriority priorities[kNumAsyncFileTestItems] =
+				{
+					AsyncFileRequestPriority::kSpeculative,
+					AsyncFileRequestPriority::kNormal,
+					AsyncFileRequestPriority::kNormal,
+					AsyncFileRequestPriority::kSpeculative,
+					AsyncFileRequestPriority::kBlocking,
+				};
+
+				AsyncFileTestItems items;
+				for (size_t i = 0; i < kNumAsyncFileTestItems; i++)
+				{
+					CHECK_RV_ASSIGN(items.m_items[i], AsyncFileWorkItem::Create(alloc, UTF8StringView_t(kSourceDevice), UTF8StringView_t("x.h"), nullptr));
+				}
+
+				for (size_t i = 0; i < kNumAsyncFileTestItems; i++)
+				{
+					// Takes over the second reference from Create
+					queue->Push(items.m_items[i], priorities[i]);
+				}
+
+				queue->Promote(items.m_items[kAsyncFileTestPromoted], AsyncFileRequestPriority::kBlocking);
+				items.m_items[kAsyncFileTestCancelled]->Cancel();
+
+				AsyncFileTestWorker worker;
+				worker.m_queue = queue;
+				worker.m_numLoads = 0;
+
+				CHECK_RV(CorePtr<Thread>, workerThread, Thread::CreateThread(alloc, AsyncFileTestWorkerFunc, &worker, UTF8StringView_t("SelfTestIO")));
+
+				// Waiting on a load that's already finished has to return straight away
+				for (AsyncFileWorkItem *item : items.m_items)
+				{
+					if (item != items.m_items[kAsyncFileTestCancelled])
+						item->WaitForFinish(finishEvent);
+				}
+
+				workerThread->WaitForExit();
+
+				const AsyncFileTestItem expectedLoadOrder[] = { kAsyncFileTestBlocking, kAsyncFileTestPromoted, kAsyncFileTestNormal, kAsyncFileTestSpeculative };
+				const size_t numExpectedLoads = sizeof(expectedLoadOrder) / sizeof(expectedLoadOrder[0]);
+
+				outPassed = (worker.m_numLoads == numExpectedLoads);
+				for (size_t i = 0; i < numExpectedLoads && outPassed; i++)
+				{
+					AsyncFileWorkItem *item = items.m_items[expectedLoadOrder[i]];
+					outPassed = (worker.m_loadOrder[i] == item && item->IsFinished() && item->GetErrorCode() == ErrorCode::kOK);
+				}
+
+				outPassed = outPassed && !items.m_items[kAsyncFileTestCancelled]->IsFinished();
+
+				return ErrorCode::kOK;
+			}
+
+			unsigned int TestAsyncFileWorkQueue(IAllocator *alloc)
+			{
+				bool passed = false;
+				Result checkResult(CheckAsyncFileWorkQueue(alloc, passed));
+				passed = passed && (checkResult.GetErrorCode() == ErrorCode::kOK);
+				checkResult.Handle();
+
+				if (!passed)
+				{
+					fputs("Async file loads dequeued wrong\n", stderr);
+					return 1;
+				}
+
+				return 0;
+			}
+
+			struct SourceFile
+			{
+				const char *m_path;
+				const char *m_contents;
+			};
+
+			struct CountingErrorReporter final : public IErrorReporter
+			{
+			public:
+				CountingErrorReporter();
+
+				void ReportError(const FileCoordinate &fileCoordinate, IIncludeStackTrace &includeStackTrace, CompilationErrorCode errorCode) override;
+
+				unsigned int m_numErrors;
+			};
+
+			CountingErrorReporter::CountingErrorReporter()
+				: m_numErrors(0)
+			{
+			}
+
+			void CountingErrorReporter::ReportError(const FileCoordinate &fileCoordinate, IIncludeStackTrace &includeStackTrace, CompilationErrorCode errorCode)
+			{
+				m_numErrors++;
+			}
+
+			// Preprocesses in-memory files, the first one being the root.  Every file is put in the file cache up front,
+			// with its line breaks converted the same way as a loaded file, so nothing is loaded from disk.  That means
+			// that only the listed files can be included.  None of the sources are erroneous, so a run fails if any
+			// error is reported.
+			struct PreprocessorRun
+			{
+			public:
+				explicit PreprocessorRun(IAllocator *alloc);
+
+				Result Run(const ArrayView<const SourceFile> &files, PPConditionCache *conditionCache);
+
+				// Counts the tokens in the output that are spelled the same as name
+				size_t CountToken(const char *name) const;
+
+				// Whether the output is the same tokens as expected, ignoring white space
+				bool HasTokens(const char *expected) const;
+
+				CorePtr<FileCache> m_fileCache;
+				CorePtr<CPreprocessor> m_preprocessor;
+				ArrayPtr<uint8_t> m_text;
+
+			private:
+				IAllocator *m_alloc;
+				CountingErrorReporter m_errorReporter;
+				CorePtr<MemoryRWFileStream> m_outStream;
+			};
+
+			PreprocessorRun::PreprocessorRun(IAllocator *alloc)
+				: m_alloc(alloc)
+			{
+			}
+
+			Result PreprocessorRun::Run(const ArrayView<const SourceFile> &files, PPConditionCache *conditionCache)
+			{
+				CHECK_RV(CorePtr<FileCache>, fileCache, New<FileCache>(m_alloc, m_alloc));
+				CHECK(fileCache->Initialize());
+
+				for (const SourceFile &file : files)
+				{
+					CHECK_RV(ArrayPtr<uint8_t>, contents, SpellingView(file.m_contents).Clone(m_alloc));
+					CPreprocessor::ConvertLineBreaks(contents);
+
+					CHECK(fileCache->AddFile(UTF8StringView_t(kSourceDevice), UTF8StringView_t(file.m_path), contents.ConstView()));
+				}
+
+				CHECK_RV(CorePtr<MemoryRWFileStream>, outStream, New<MemoryRWFileStream>(m_alloc, m_alloc));
+				CHECK_RV(CorePtr<CPreprocessor>, preprocessor, New<CPreprocessor>(m_alloc, m_alloc, nullptr, fileCache.Get(), conditionCache, outStream.Get(), &m_errorReporter));
+
+				m_fileCache = std::move(fileCache);
+				m_outStream = std::move(outStream);
+				m_preprocessor = std::move(preprocessor);
+
+				CHECK(m_preprocessor->StartRootFile(UTF8StringView_t(kSourceDevice), UTF8StringView_t(files[0].m_path)));
+
+				// Every include is a cache hit, so there's never a load to wait for
+				for (;;)
+				{
+					m_preprocessor->Digest();
+
+					const CPreprocessor::State state = m_preprocessor->GetState();
+					if (state == CPreprocessor::State::kIdle)
+						break;
+
+					if (state == CPreprocessor::State::kFailed)
+						return ErrorCode::kOperationFailed;
+				}
+
+				if (m_errorReporter.m_numErrors != 0)
+					return ErrorCode::kOperationFailed;
+
+				CHECK_RV_ASSIGN(m_text, m_outStream->ContentsToArray());
+
+				return ErrorCode::kOK;
+			}
+
+			size_t PreprocessorRun::CountToken(const char *name) const
+			{
+				const ArrayView<const uint8_t> text = m_text.ConstView();
+				const ArrayView<const uint8_t> nameView = SpellingView(name);
+
+				NullErrorReporter errorReporter;
+				NullIncludeStackTrace includeStackTrace;
+				size_t numMatches = 0;
+
+				FileCoordinate coord(0);
+				for (;;)
+				{
+					ArrayView<const uint8_t> token;
+					CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
+					if (!CLexer::TryGetToken(text, coord, false, false, includeStackTrace, &errorReporter, false, false, token, tokenType, coord))
+						break;
+
+					if (tokenType == CLexer::TokenType::kInvalid)
+						break;
+
+					if (token.Size() == nameView.Size() && memcmp(&token[0], &nameView[0], token.Size()) == 0)
+						numMatches++;
+				}
+
+				return numMatches;
+			}
+
+			// Skips white space, line breaks and comments, and fails at the end of the text
+			bool TryGetSignificantToken(const ArrayView<const uint8_t> &text, FileCoordinate &coord, ArrayView<const uint8_t> &outToken)
+			{
+				NullErrorReporter errorReporter;
+				NullIncludeStackTrace includeStackTrace;
+
+				for (;;)
+				{
+					CLexer::TokenType tokenType = CLexer::TokenType::kInvalid;
+					if (!CLexer::TryGetToken(text, coord, false, false, includeStackTrace, &errorReporter, false, false, outToken, tokenType, coord))
+						return false;
+
+					switch (tokenType)
+					{
+					case CLexer::TokenType::kWhitespace:
+					case CLexer::TokenType::kNewLine:
+					case CLexer::TokenType::kComment:
+						break;
+					case CLexer::TokenType::kInvalid:
+					case CLexer::TokenType::kEndOfFile:
+						return false;
+					default:
+						return true;
+					}
+				}
+			}
+
+			bool PreprocessorRun::HasTokens(const char *expected) const
+			{
+				const ArrayView<const uint8_t> text = m_text.ConstView();
+				const ArrayView<const uint8_t> expectedText = SpellingView(expected);
+
+				FileCoordinate coord(0);
+				FileCoordinate expectedCoord(0);
+				for (;;)
+				{
+					ArrayView<const uint8_t> token;
+					const bool haveToken = TryGetSignificantToken(text, coord, token);
+
+					ArrayView<const uint8_t> expectedToken;
+					const bool haveExpectedToken = TryGetSignificantToken(expectedText, expectedCoord, expectedToken);
+
+					if (!haveToken || !haveExpectedToken)
+						return haveToken == haveExpectedToken;
+
+					if (token.Size() != expectedToken.Size() || memcmp(&token[0], &expectedToken[0], token.Size()) != 0)
+						return false;
+				}
+			}
+
+			struct MacroExpansionCase
+			{
+				const char *m_source;
+				const char *m_expectedTokens;
+			};
+
+			const MacroExpansionCase kMacroExpansionCases[] =
+			{
+				{ "#define u 1\n#undef u\nu", "u" },
+				{ "#define fn(a) a\nfn + fn(1)", "fn + 1" },
+				{ "#define e(a) [a]\ne() e( )", "[ ] [ ]" },
+				{ "#define r r + 1\n#define s(a) a + s\nr s(s)(2)", "r + 1 s + s(2)" },
+				{ "#define cat(a, b) a ## b\ncat(x, y) cat(1, 2) cat(, z) cat(<, <=)", "xy 12 z <<=" },
+				{ "#define str(s) # s\nstr( a  +  \"b\\n\" ) str('\\'')", "\"a + \\\"b\\\\n\\\"\" \"'\\\\''\"" },
+				{ "#define v(a, ...) a __VA_ARGS__\nv(1, 2, (3, 4)) v(1)", "1 2, (3, 4) 1" },
+				{ "#define p(a) (a)\n#define q p(\nq 1)", "(1)" },
+
+				// The examples from C99 6.10.3.5
+				{
+					"#define x 3\n#define f(a) f(x * (a))\n#undef x\n#define x 2\n#define g f\n#define z z[0]\n#define h g(~\n#define m(a) a(w)\n#define w 0,1\n#define t(a) a\n"
+					"f(y+1) + f(f(z)) % t(t(g)(0) + t)(1);\ng(x+(3,4)-w) | h 5) & m\n(f)^m(m);\n",
+					"f(2 * (y+1)) + f(2 * (f(2 * (z[0])))) % f(2 * (0)) + t(1);\nf(2 * (2+(3,4)-0,1)) | f(2 * (~ 5)) & f(2 * (0,1))^m(0,1);"
+				},
+				{
+					"#define hash_hash # ## #\n#define mkstr(a) # a\n#define in_between(a) mkstr(a)\n#define join(c, d) in_between(c hash_hash d)\nchar p[] = join(x, y);\n",
+					"char p[] = \"x ## y\";"
+				},
+			};
+
+			unsigned int TestMacroExpansion(IAllocator *alloc)
+			{
+				unsigned int numFailures = 0;
+
+				for (const MacroExpansionCase &testCase : kMacroExpansionCases)
+				{
+					const SourceFile files[] =
+					{
+						{ "main.c", testCase.m_source },
+					};
+
+					PreprocessorRun run(alloc);
+					Result runResult(run.Run(ArrayView<const SourceFile>(files, 1), nullptr));
+					const bool passed = (runResult.GetErrorCode() == ErrorCode::kOK && run.HasTokens(testCase.m_expectedTokens));
+					runResult.Handle();
+
+					if (!passed)
+					{
+						fprintf(stderr, "Macro expanded wrong: %s\n", testCase.m_source);
+						numFailures++;
+					}
+				}
+
+				return numFailures;
+			}
+
+			struct IncludeGuardCase
+			{
+				const char *m_header;
+				FileCacheIncludeGuard m_includeGuard;
+				size_t m_numCopies;
+			};
+
+			// Each header declares "h" and is included twice
+			const IncludeGuardCase kIncludeGuardCases[] =
+			{
+				{ "#ifndef H_H\n#define H_H\nint h;\n#endif\n", FileCacheIncludeGuard::kMacro, 1 },
+				{ "/* c */\n#ifndef H_H\n#define H_H\n#if 1\nint h;\n#endif\n#endif\n// c\n", FileCacheIncludeGuard::kMacro, 1 },
+				{ "#pragma once\nint h;\n", FileCacheIncludeGuard::kPragmaOnce, 1 },
+
+				// Not guarded
+				{ "#ifndef H_H\n#define H_H\n#endif\nint h;\n", FileCacheIncludeGuard::kUnknown, 2 },
+				{ "#ifndef H_H\n#define H_H\nint h;\n#else\n#endif\n", FileCacheIncludeGuard::kUnknown, 1 },
+				{ "int h;\n", FileCacheIncludeGuard::kUnknown, 2 },
+			};
+
+			unsigned int TestIncludeGuards(IAllocator *alloc)
+			{
+				unsigned int numFailures = 0;
+
+				for (const IncludeGuardCase &testCase : kIncludeGuardCases)
+				{
+					const SourceFile files[] =
+					{
+						{ "main.c", "#include \"h.h\"\n#include \"h.h\"\n" },
+						{ "h.h", testCase.m_header },
+					};
+
+					PreprocessorRun run(alloc);
+					Result runResult(run.Run(ArrayView<const SourceFile>(files, 2), nullptr));
+					bool passed = (runResult.GetErrorCode() == ErrorCode::kOK);
+					runResult.Handle();
+
+					if (passed)
+					{
+						// Only the kind of guard matters, not whether it's defined
+						PPMacroTable macros(alloc);
+						bool isMacroDefined = false;
+						ResultRV<FileCacheIncludeGuard> guardResult(run.m_fileCache->LookupIncludeGuard(UTF8StringView_t(kSourceDevice), UTF8StringView_t("h.h"), macros, isMacroDefined));
+						passed = (guardResult.GetErrorCode() == ErrorCode::kOK && guardResult.GetValue() == testCase.m_includeGuard && run.CountToken("h") == testCase.m_numCopies);
+						guardResult.Handle();
+					}
+
+					if (!passed)
+					{
+						fprintf(stderr, "Include guard handled wrong: %s\n", testCase.m_header);
+						numFailures++;
+					}
+				}
+
+				return numFailures;
+			}
+
+			struct ConditionCase
+			{
+				const char *m_condition;
+				bool m_value;
+			};
+
+			// Evaluated after "#define ONE 1" and "#define ID(x) x"
+			const ConditionCase kConditionCases[] =
+			{
+				{ "defined(ONE)", true },
+				{ "defined ONE && !defined(TWO)", true },
+				{ "defined(TWO)", false },
+				{ "defined ID", true },
+				{ "TWO == 0", true },
+				{ "ID(ONE) + 1 == 2", true },
+
+				// Usual arithmetic conversions in intmax_t and uintmax_t
+				{ "-1 < 0", true },
+				{ "-1 < 0u", false },
+				{ "-1 > 0u", true },
+				{ "~0u == 18446744073709551615u", true },
+				{ "(2 || 3) == 1", true },
+				{ "'a' == 97", true },
+
+				// Operands that aren't evaluated can't divide by zero
+				{ "1 ? 2 : (1/0)", true },
+				{ "0 ? (1/0) : 0", false },
+				{ "0 && 1 % 0", false },
+				{ "1 || (1/0)", true },
+			};
+
+			Result CheckCondition(IAllocator *alloc, const ConditionCase &testCase, bool useCache, bool &outPassed)
+			{
+				char root[256];
+				snprintf(root, sizeof(root), "#define ONE 1\n#define ID(x) x\n#if %s\nyes\n#else\nno\n#endif\n", testCase.m_condition);
+
+				const SourceFile files[] =
+				{
+					{ "main.c", root },
+				};
+
+				// The cache has the preprocessor collect dependencies while evaluating
+				CorePtr<PPConditionCache> conditionCache;
+				if (useCache)
+				{
+					CHECK_RV_ASSIGN(conditionCache, New<PPConditionCache>(alloc, alloc));
+					CHECK(conditionCache->Initialize());
+				}
+
+				PreprocessorRun run(alloc);
+				CHECK(run.Run(ArrayView<const SourceFile>(files, 1), conditionCache));
+
+				outPassed = (run.CountToken("yes") == (testCase.m_value ? 1u : 0u) && run.CountToken("no") == (testCase.m_value ? 0u : 1u));
+
+				return ErrorCode::kOK;
+			}
+
+			unsigned int TestConditions(IAllocator *alloc)
+			{
+				unsigned int numFailures = 0;
+
+				for (const ConditionCase &testCase : kConditionCases)
+				{
+					for (int useCache = 0; useCache < 2; useCache++)
+					{
+						bool passed = false;
+						Result checkResult(CheckCondition(alloc, testCase, useCache != 0, passed));
+						if (checkResult.GetErrorCode() != ErrorCode::kOK || !passed)
+						{
+							fprintf(stderr, "Condition evaluated wrong: %s\n", testCase.m_condition);
+							numFailures++;
+						}
+						checkResult.Handle();
+					}
+				}
+
+				return numFailures;
+			}
+
+			// A result is reused where the macros it depends on have the same definitions, even after an #undef and in
+			// another translation unit, and not where they've changed
+			const SourceFile kConditionCacheFirstUnit[] =
+			{
+				{ "first.c", "#define A 1\n#if A == 1\ny1\n#endif\n#undef A\n#if A == 1\nn2\n#endif\n#define A 1\n#if A == 1\ny3\n#endif\n#undef A\n#define A 2\n#if A == 1\nn4\n#endif\n" },
+			};
+
+			const SourceFile kConditionCacheSecondUnit[] =
+			{
+				{ "second.c", "#define A 1\n#if A == 1\ny5\n#endif\n" },
+			};
+
+			Result CheckConditionCache(IAllocator *alloc, bool &outPassed)
+			{
+				CHECK_RV(CorePtr<PPConditionCache>, conditionCache, New<PPConditionCache>(alloc, alloc));
+				CHECK(conditionCache->Initialize());
+
+				PreprocessorRun firstRun(alloc);
+				CHECK(firstRun.Run(ArrayView<const SourceFile>(kConditionCacheFirstUnit, 1), conditionCache));
+
+				outPassed = (conditionCache->GetHitCount() == 1 && conditionCache->GetMissCount() == 3);
+				outPassed = outPassed && firstRun.CountToken("y1") == 1 && firstRun.CountToken("n2") == 0 && firstRun.CountToken("y3") == 1 && firstRun.CountToken("n4") == 0;
+
+				PreprocessorRun secondRun(alloc);
+				CHECK(secondRun.Run(ArrayView<const SourceFile>(kConditionCacheSecondUnit, 1), conditionCache));
+
+				outPassed = outPassed && conditionCache->GetHitCount() == 2 && conditionCache->GetMissCount() == 3 && secondRun.CountToken("y5") == 1;
+
+				return ErrorCode::kOK;
+			}
+
+			unsigned int TestConditionCache(IAllocator *alloc)
+			{
+				bool passed = false;
+				Result checkResult(CheckConditionCache(alloc, passed));
+				passed = passed && (checkResult.GetErrorCode() == ErrorCode::kOK);
+				checkResult.Handle();
+
+				if (!passed)
+				{
+					fputs("Condition cache reused results wrong\n", stderr);
+					return 1;
+				}
+
+				return 0;
+			}
+
+			// Each one is the body of an "#if 0" block followed by a line with "after", none of it should be output.
+			// Every line is still traced to itself, and since the lines are all consecutive they're one run.
+			const char *const kInactiveBlockCases[] =
+			{
+				"no\n",
+				"no /*\n#endif\n*/ no\n",
+				"no // #endif\n",
+				"\"/* #endif\" no\n",
+				"'\"' no /* '\n#endif */\n",
+				"don't\n\"no\n",
+				"#if 1\n#endif\nno\n",
+				"#ifdef X\n#else\nno\n#endif\n",
+				"  #  if 0\n #endif\n",
+				"/* a */ # /* b */ if 0\n#elif 1\nno\n#endif\n",
+				"no \\\n#endif\n",
+				"no\r\n#if 1\r\nno\r\n#endif\r\n",
+			};
+
+			Result CheckInactiveBlock(IAllocator *alloc, const char *body, bool &outPassed)
+			{
+				char root[256];
+				snprintf(root, sizeof(root), "#if 0\n%s#endif\nafter\n", body);
+
+				uint32_t numLines = 0;
+				for (size_t i = 0; root[i] != 0; i++)
+				{
+					if (root[i] == '\n')
+						numLines++;
+				}
+
+				const SourceFile files[] =
+				{
+					{ "main.c", root },
+				};
+
+				PreprocessorRun run(alloc);
+				CHECK(run.Run(ArrayView<const SourceFile>(files, 1), nullptr));
+
+				const ArrayView<const uint8_t> text = run.m_text.ConstView();
+
+				uint32_t numOutputLines = 0;
+				for (size_t i = 0; i < text.Size(); i++)
+				{
+					if (text[i] == CharCode::kLineFeed)
+						numOutputLines++;
+				}
+
+				outPassed = (run.CountToken("after") == 1 && run.CountToken("no") == 0 && numOutputLines == numLines);
+
+				const CPreprocessorTraceInfo *traceInfo = run.m_preprocessor->GetTraceInfo();
+				for (uint32_t lineNumber = 1; lineNumber <= numLines && outPassed; lineNumber++)
+				{
+					uint32_t traceIndex = 0;
+					uint32_t tracedLineNumber = 0;
+					outPassed = (traceInfo->FindOutputLineTrace(lineNumber, traceIndex, tracedLineNumber) && tracedLineNumber == lineNumber);
+				}
+
+				// The run-length data at the end of the trace is the first trace index and the count of lines after it,
+				// which includes the empty one after the last line break
+				CHECK_RV(CorePtr<MemoryRWFileStream>, traceStream, New<MemoryRWFileStream>(alloc, alloc));
+				CHECK(run.m_preprocessor->FlushTrace(traceStream));
+				CHECK_RV(ArrayPtr<uint8_t>, trace, traceStream->ContentsToArray());
+
+				const uint8_t expectedRuns[] = { 0, 0, 0, 0, static_cast<uint8_t>(numLines) };
+				const size_t runsSize = sizeof(expectedRuns);
+
+				outPassed = outPassed && trace.Count() >= runsSize + 4;
+				outPassed = outPassed && memcmp(&trace[trace.Count() - runsSize - 4], "\x05\0\0\0", 4) == 0;
+				outPassed = outPassed && memcmp(&trace[trace.Count() - runsSize], expectedRuns, runsSize) == 0;
+
+				return ErrorCode::kOK;
+			}
+
+			unsigned int TestInactiveBlocks(IAllocator *alloc)
+			{
+				unsigned int numFailures = 0;
+
+				for (const char *body : kInactiveBlockCases)
+				{
+					bool passed = false;
+					Result checkResult(CheckInactiveBlock(alloc, body, passed));
+					if (checkResult.GetErrorCode() != ErrorCode::kOK || !passed)
+					{
+						fprintf(stderr, "Inactive block skipped wrong: %s\n", body);
+						numFailures++;
+					}
+					checkResult.Handle();
+				}
+
+				return numFailures;
+			}
+
+			struct SourceColumnCase
+			{
+				const char *m_source;
+				const char *m_expectedOutput;
+			};
+
+			// Output tokens stay in their source columns until an expansion comes out longer than its invocation
+			const SourceColumnCase kSourceColumnCases[] =
+			{
+				{ "int  x  =  1;\n", "int  x  =  1;\n" },
+				{ "  \tint y;\n", "   int y;\n" },
+				{ "/* c */ int z; // c\n", "        int z; \n" },
+				{ "#define M(a) a\nint w = M( 3 )  +  4;\n", "\nint w =    3    +  4;\n" },
+				{ "#define N 100000000\nint v = N  +  1;\n", "\nint v = 100000000 + 1;\n" },
+			};
+
+			unsigned int TestSourceColumns(IAllocator *alloc)
+			{
+				unsigned int numFailures = 0;
+
+				for (const SourceColumnCase &testCase : kSourceColumnCases)
+				{
+					const SourceFile files[] =
+					{
+						{ "main.c", testCase.m_source },
+					};
+
+					PreprocessorRun run(alloc);
+					Result runResult(run.Run(ArrayView<const SourceFile>(files, 1), nullptr));
+
+					const size_t expectedSize = strlen(testCase.m_expectedOutput);
+					const bool passed = (runResult.GetErrorCode() == ErrorCode::kOK && run.m_text.Count() == expectedSize && memcmp(&run.m_text[0], testCase.m_expectedOutput, expectedSize) == 0);
+					runResult.Handle();
+
+					if (!passed)
+					{
+						fprintf(stderr, "Source columns not kept: %s\n", testCase.m_source);
+						numFailures++;
+					}
+				}
+
+				return numFailures;
+			}
+
+			struct ConstantExpressionCase
+			{
+				const char *m_source;
+				const char *m_expectedData;
+			};
+
+			// Each source defines one read-only table, and the expected data is what its section lists
+			const ConstantExpressionCase kConstantExpressionCases[] =
+			{
+				{ "static const int x = 1 + 2;", " s323" },
+				{ "static const int x = ((2)*100+(3));", " s32203" },
+				{ "static const double d[] = {1.0/3};", " f640.3333333333333333" },
+				{ "static const char c[] = {'a','b'};", " s897 s898" },
+				{ "static const int t[] = {'\\377', L'xy', 'ab'};", " s32-1 s32121 s3224930" },
+
+				// Conversions, casts and integer promotions
+				{ "static const int t[] = {(unsigned char)300, (int)-2.9, (char)200, (short)65535};", " s3244 s32-2 s32-56 s32-1" },
+				{ "static const int t[] = {-1 < 0u, ~0u, 1u << 31, (unsigned char)1 - 2};", " s320 s32-1 s32-2147483648 s32-1" },
+				{ "static const unsigned short s = 65535 + 1u;", " u160" },
+				{ "static const long long t[] = {2147483647 + 1LL, -2147483647 - 1, 7 / -2, 7 % -2, -8 >> 1};", " s642147483648 s64-2147483648 s64-3 s641 s64-4" },
+
+				// The operand that isn't evaluated only has to be a constant expression
+				{ "static const int t[] = {1 ? 2 : 1/0, 0 && 1/0, 1 || 2147483647 + 1, 0 ? 1 : 2.5};", " s322 s320 s321 s322" },
+
+				// Tentative definitions are zero filled, with one element if there's no size
+				{ "static const int a[];", " sk4" },
+				{ "static const short a[3];", " sk6" },
+			};
+
+			Result CheckConstantExpression(IAllocator *alloc, const ConstantExpressionCase &testCase, bool &outPassed)
+			{
+				CHECK_RV(ArrayPtr<uint8_t>, contents, SpellingView(testCase.m_source).Clone(alloc));
+
+				CHECK_RV(CorePtr<MemoryRWFileStream>, memoryStream, New<MemoryRWFileStream>(alloc, alloc));
+				const MemoryRWFileStream *memoryStreamPtr = memoryStream.Get();
+
+				CHECK_RV(CorePtr<BufferedFileStream>, asmStream, New<BufferedFileStream>(alloc, alloc, std::move(memoryStream)));
+				CHECK(asmStream->Initialize(BufferedFileStream::kDefaultBufferSize));
+
+				NullErrorReporter errorReporter;
+				TextHAsmWriter asmWriter(asmStream);
+
+				CHECK_RV(CorePtr<CCompiler>, compiler, New<CCompiler>(alloc, alloc, &errorReporter, std::move(contents), nullptr, &asmWriter));
+				CHECK(compiler->Compile());
+				CHECK(asmStream->Flush());
+
+				CHECK_RV(ArrayPtr<uint8_t>, text, memoryStreamPtr->ContentsToArray());
+
+				char expected[256];
+				snprintf(expected, sizeof(expected), "hasm ptr=u32\ndata 0 readonly\n   %s\nend\n", testCase.m_expectedData);
+
+				const size_t expectedSize = strlen(expected);
+				outPassed = (text.Count() == expectedSize && memcmp(&text[0], expected, expectedSize) == 0);
+
+				return ErrorCode::kOK;
+			}
+
+			unsigned int TestConstantExpressions(IAllocator *alloc)
+			{
+				unsigned int numFailures = 0;
+
+				for (const ConstantExpressionCase &testCase : kConstantExpressionCases)
+				{
+					bool passed = false;
+					Result checkResult(CheckConstantExpression(alloc, testCase, passed));
+					if (checkResult.GetErrorCode() != ErrorCode::kOK || !passed)
+					{
+						fprintf(stderr, "Constant expression evaluated wrong: %s\n", testCase.m_source);
+						numFailures++;
+					}
+					checkResult.Handle();
+				}
+
+				return numFailures;
+			}
+
+			Result EmitHAsmTestValue(IHAsmWriter &asmWriter, HAsmDataEmitOpt::CodedType codedType, LType lType, uint64_t bits, size_t symbolTableIndex)
+			{
+				return asmWriter.WriteDataEmitOpt(HAsmDataEmitOpt(CompilerConstant(lType, MaxUInt(bits)), symbolTableIndex, codedType));
+			}
+
+			Result SeekHAsmTest(IHAsmWriter &asmWriter, int64_t offset)
+			{
+				return asmWriter.WriteDataSeekOpt(HAsmDataSeekOpt(MaxSInt(offset)));
+			}
+
+			// Coded as described in notes/hlasm.txt.  Emits of the same coded type are merged until a run is full or
+			// something else comes in between.
+			const uint8_t kBinaryHAsmExpected[] =
+			{
+				static_cast<uint8_t>(LType::kUInt32),
+
+				// Read-only section 200, then a structural one
+				0x01, 0xc8, 0x01, 0x04,
+				0xd4, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 0x24, 14, 15, 16, 0xe1, 0x04, 17,
+				0xe3, 0xef, 0xe0, 0xc8, 0x01, 0xe0, 0x11, 0xe0, 0x00,
+				0x01, 0xfe, 0xff, 0x08, 0x00, 0x00, 0x80, 0x3f,
+				0x1a,
+				0x0b, 0xac, 0x02, 0x0c, 0x01, 0x08, 0x00, 0x00, 0x00, 0x0d, 0x34, 0x12, 0x00, 0x00,
+				0xf0,
+				0x01, 0x01, 0x02, 0x82, 0x01,
+				0xf0,
+			};
+
+			Result CheckBinaryHAsm(IAllocator *alloc, bool &outPassed)
+			{
+				CHECK_RV(CorePtr<MemoryRWFileStream>, asmStream, New<MemoryRWFileStream>(alloc, alloc));
+
+				BinaryHAsmWriter asmWriter(alloc, asmStream);
+
+				CHECK(asmWriter.Start(HAsmHeader()));
+
+				HAsmOpenDataSectionInstruction readOnlySection;
+				readOnlySection.m_objectID = 200;
+				readOnlySection.m_flags = HAsmOpenDataSectionInstruction::kFlagReadOnly;
+				CHECK(asmWriter.OpenDataSection(readOnlySection));
+
+				// More than fits in a run, then a seek in between
+				for (uint64_t i = 0; i < 17; i++)
+				{
+					CHECK(EmitHAsmTestValue(asmWriter, HAsmDataEmitOpt::CodedType::kU8, LType::kUInt8, i, 0));
+				}
+
+				CHECK(SeekHAsmTest(asmWriter, 1));
+				CHECK(EmitHAsmTestValue(asmWriter, HAsmDataEmitOpt::CodedType::kU8, LType::kUInt8, 17, 0));
+
+				// Short seeks and zigzag coded long ones
+				CHECK(SeekHAsmTest(asmWriter, 3));
+				CHECK(SeekHAsmTest(asmWriter, -1));
+				CHECK(SeekHAsmTest(asmWriter, 100));
+				CHECK(SeekHAsmTest(asmWriter, -9));
+				CHECK(SeekHAsmTest(asmWriter, 0));
+
+				CHECK(asmWriter.WriteDataEmitOpt(HAsmDataEmitOpt(CompilerConstant(LType::kSInt16, MaxSInt(-2)), 0, HAsmDataEmitOpt::CodedType::kS16)));
+				CHECK(EmitHAsmTestValue(asmWriter, HAsmDataEmitOpt::CodedType::kF32, LType::kFloat32, 0x3f800000u, 0));
+
+				CHECK(EmitHAsmTestValue(asmWriter, HAsmDataEmitOpt::CodedType::kNullPtr, LType::kUInt32, 0, 0));
+				CHECK(EmitHAsmTestValue(asmWriter, HAsmDataEmitOpt::CodedType::kNullPtr, LType::kUInt32, 0, 0));
+
+				CHECK(EmitHAsmTestValue(asmWriter, HAsmDataEmitOpt::CodedType::kDataPtr, LType::kUInt32, 0, 300));
+				CHECK(EmitHAsmTestValue(asmWriter, HAsmDataEmitOpt::CodedType::kDataOffsetPtr, LType::kUInt32, 8, 1));
+				CHECK(EmitHAsmTestValue(asmWriter, HAsmDataEmitOpt::CodedType::KLiteralPtr, LType::kUInt32, 0x1234u, 0));
+
+				CHECK(asmWriter.CloseDataSection());
+
+				HAsmOpenDataSectionInstruction structuralSection;
+				structuralSection.m_objectID = 1;
+				structuralSection.m_flags = HAsmOpenDataSectionInstruction::kFlagStructural;
+				structuralSection.m_structureReference = 130;
+				CHECK(asmWriter.OpenDataSection(structuralSection));
+				CHECK(asmWriter.CloseDataSection());
+
+				CHECK(asmWriter.Finish());
+
+				CHECK_RV(ArrayPtr<uint8_t>, contents, asmStream->ContentsToArray());
+
+				outPassed = (contents.Count() == sizeof(kBinaryHAsmExpected) && memcmp(&contents[0], kBinaryHAsmExpected, sizeof(kBinaryHAsmExpected)) == 0);
+
+				return ErrorCode::kOK;
+			}
+
+			unsigned int TestBinaryHAsm(IAllocator *alloc)
+			{
+				bool passed = false;
+				Result checkResult(CheckBinaryHAsm(alloc, passed));
+				passed = passed && (checkResult.GetErrorCode() == ErrorCode::kOK);
+				checkResult.Handle();
+
+				if (!passed)
+				{
+					fputs("Binary HAsm coded wrong\n", stderr);
+					return 1;
+				}
+
+				return 0;
+			}
+
+			struct SignedFormatCase
+			{
+				int64_t m_value;
+				const char *m_expectedChars;
+			};
+
+			struct UnsignedFormatCase
+			{
+				uint64_t m_value;
+				const char *m_expectedChars;
+			};
+
+			struct FloatFormatCase
+			{
+				LType m_lType;
+				uint64_t m_bits;
+				const char *m_expectedChars;
+			};
+
+			// Digits are produced two at a time, so odd and even lengths both matter
+			const SignedFormatCase kSignedFormatCases[] =
+			{
+				{ 0, "0" },
+				{ 9, "9" },
+				{ 10, "10" },
+				{ -99, "-99" },
+				{ 100, "100" },
+				{ -1000000007, "-1000000007" },
+				{ INT64_MAX, "9223372036854775807" },
+				{ INT64_MIN, "-9223372036854775808" },
+			};
+
+			const UnsignedFormatCase kUnsignedFormatCases[] =
+			{
+				{ 0, "0" },
+				{ 1234, "1234" },
+				{ 10000000000000000000u, "10000000000000000000" },
+				{ UINT64_MAX, "18446744073709551615" },
+			};
+
+			// The shortest decimal that reads back to the same value
+			const FloatFormatCase kFloatFormatCases[] =
+			{
+				{ LType::kFloat64, 0x3ff8000000000000u, "1.5" },
+				{ LType::kFloat64, 0x3fb999999999999au, "0.1" },
+				{ LType::kFloat64, 0x40fe240000000000u, "123456" },
+				{ LType::kFloat64, 0x7e37e43c8800759cu, "1e+300" },
+				{ LType::kFloat64, 0x0000000000000001u, "5e-324" },
+				{ LType::kFloat64, 0x8000000000000000u, "-0" },
+				{ LType::kFloat64, 0xfff0000000000000u, "-inf" },
+				{ LType::kFloat64, 0x7ff8000000000001u, "nan" },
+				{ LType::kFloat32, 0x3dcccccdu, "0.1" },
+				{ LType::kFloat32, 0x7f7fffffu, "3.4028235e+38" },
+				{ LType::kFloat32, 0x00000001u, "1e-45" },
+			};
+
+			bool CheckFormattedChars(const char *chars, size_t numChars, const char *expectedChars)
+			{
+				return numChars == strlen(expectedChars) && memcmp(chars, expectedChars, numChars) == 0;
+			}
+
+			unsigned int TestConstantFormatting()
+			{
+				unsigned int numFailures = 0;
+
+				for (const SignedFormatCase &testCase : kSignedFormatCases)
+				{
+					char chars[MaxSInt::kMaxDecimalChars];
+					if (!CheckFormattedChars(chars, MaxSInt(testCase.m_value).ToDecimalChars(chars), testCase.m_expectedChars))
+					{
+						fprintf(stderr, "Signed constant formatted wrong: %s\n", testCase.m_expectedChars);
+						numFailures++;
+					}
+				}
+
+				for (const UnsignedFormatCase &testCase : kUnsignedFormatCases)
+				{
+					char chars[MaxUInt::kMaxDecimalChars];
+					if (!CheckFormattedChars(chars, MaxUInt(testCase.m_value).ToDecimalChars(chars), testCase.m_expectedChars))
+					{
+						fprintf(stderr, "Unsigned constant formatted wrong: %s\n", testCase.m_expectedChars);
+						numFailures++;
+					}
+				}
+
+				for (const FloatFormatCase &testCase : kFloatFormatCases)
+				{
+					char chars[MaxUInt::kMaxFloatDecimalChars];
+					if (!CheckFormattedChars(chars, MaxUInt(testCase.m_bits).FloatBitsToDecimalChars(testCase.m_lType, chars), testCase.m_expectedChars))
+					{
+						fprintf(stderr, "Float constant formatted wrong: %s\n", testCase.m_expectedChars);
+						numFailures++;
+					}
+				}
+
+				return numFailures;
+			}
+
+			unsigned int TestFloatDecoding()
+			{
+				const CompilerConfiguration config;
+				unsigned int numFailures = 0;
+
+				for (const FloatDecodeCase &testCase : kFloatDecodeCases)
+				{
+					CompilerConstant constant;
+					const NumericLiteral::DecodeStatus status = NumericLiteral::DecodeFloat(SpellingView(testCase.m_spelling), config, constant);
+
+					bool passed = (status == testCase.m_status);
+					if (passed && status == NumericLiteral::DecodeStatus::kOK)
+						passed = (constant.GetLType() == testCase.m_lType && constant.GetUnsigned() == MaxUInt(testCase.m_bits));
+
+					if (!passed)
+					{
+						fprintf(stderr, "Float constant decoded wrong: %s\n", testCase.m_spelling);
+						numFailures++;
+					}
+				}
+
+				return numFailures;
+			}
+		}
+	}
+}
+
+// Checks cases that the source corpora don't reliably cover
+expanse::Result SelfTest(expanse::IAllocator *alloc)
+{
+	unsigned int numFailures = 0;
+	numFailures += expanse::cc::TestNumberLexing();
+	numFailures += expanse::cc::TestFloatDecoding();
+	numFailures += expanse::cc::TestConstantFormatting();
+	numFailures += expanse::cc::TestLineSkipping(alloc);
+	numFailures += expanse::cc::TestArenaAllocator(alloc);
+	numFailures += expanse::cc::TestPooledAllocator(alloc);
+	numFailures += expanse::cc::TestFileCache(alloc);
+	numFailures += expanse::cc::TestAsyncFileWorkQueue(alloc);
+	numFailures += expanse::cc::TestOutputChannel(alloc);
+	numFailures += expanse::cc::TestMacroExpansion(alloc);
+	numFailures += expanse::cc::TestIncludeGuards(alloc);
+	numFailures += expanse::cc::TestConditions(alloc);
+	numFailures += expanse::cc::TestConditionCache(alloc);
+	numFailures += expanse::cc::TestInactiveBlocks(alloc);
+	numFailures += expanse::cc::TestSourceColumns(alloc);
+	numFailures += expanse::cc::TestConstantExpressions(alloc);
+	numFailures += expanse::cc::TestBinaryHAsm(alloc);
+
+	if (numFailures > 0)
+	{
+		fprintf(stderr, "%u self test cases failed\n", numFailures);
+		return expanse::ErrorCode::kOperationFailed;
+	}
+
+	fputs("All self test cases passed\n", stderr);
+	return expanse::ErrorCode::kOK;
+}
@@ -1,89 +1,157 @@
-#include "CCompiler.h"
-#include "CPreprocessor.h"
-#include "CPreprocessorTraceInfo.h"
-
 #include "FileCache.h"
-#include "FileCoordinate.h"
-#include "IErrorReporter.h"
 #include "Result.h"
 #include "ResultRV.h"
 #include "Mem.h"
-#include "MemoryRWFileStream.h"
-#include "Numerics.h"
+#include "PPConditionCache.h"
 #include "StringView.h"
 #include "StringProto.h"
-#include "TextHAsmWriter.h"
-
-#include "IncludeWindows.h"
+#include "TranslationUnitDriver.h"
 
 #include <cstdio>
 
 namespace expanse
 {
 	class AsyncFileSystem;
+	class SynchronousFileSystem;
 }
 
-struct ErrorReporter final : public expanse::cc::IErrorReporter
+static void PrintPath(const expanse::UTF8String_t &device, const expanse::UTF8String_t &path)
 {
-	void ReportError(const expanse::cc::FileCoordinate &fileCoordinate, expanse::cc::IIncludeStackTrace &includeStackTrace, expanse::cc::CompilationErrorCode errorCode)
-	{
-		includeStackTrace.Reset();
-
-		expanse::UTF8StringView_t device;
-		expanse::UTF8StringView_t path;
-		expanse::cc::FileCoordinate coord;
+	if (device.Length() > 0)
+		fwrite(&device.GetChars()[0], device.Length(), 1, stderr);
+	fputs("://", stderr);
+	if (path.Length() > 0)
+		fwrite(&path.GetChars()[0], path.Length(), 1, stderr);
+}
 
-		includeStackTrace.GetCurrentFile(device, path, coord);
+static double MicrosecondsToMilliseconds(uint64_t microseconds)
+{
+	return static_cast<double>(microseconds) / 1000.0;
+}
 
-		if (device.Length() > 0)
-			fwrite(&device.GetChars()[0], device.Length(), 1, stderr);
-		fputs("://", stderr);
-		if (path.Length() > 0)
-			fwrite(&path.GetChars()[0], path.Length(), 1, stderr);
-		fprintf(stderr, "(%u,%u): %i\n", coord.m_lineNumber, coord.m_column, static_cast<int>(errorCode));
+static const char *GetParseRuleName(expanse::cc::ParseRule rule)
+{
+	switch (rule)
+	{
+	case expanse::cc::ParseRule::kDeclarator:
+		return "declarator";
+	case expanse::cc::ParseRule::kAbstractDeclarator:
+		return "abstract-declarator";
+	case expanse::cc::ParseRule::kTypeName:
+		return "type-name";
+	case expanse::cc::ParseRule::kCastExpression:
+		return "cast-expression";
+	case expanse::cc::ParseRule::kUnaryExpression:
+		return "unary-expression";
+	default:
+		return "unknown";
 	}
-};
+}
 
-expanse::Result TestCC(expanse::IAllocator *alloc, expanse::AsyncFileSystem *asyncFS, expanse::FileStream *outFile, expanse::FileStream *traceOutFile)
+expanse::Result TestCC(expanse::IAllocator *alloc, const expanse::ArrayView<expanse::IAllocator *const> &workerAllocators, expanse::SynchronousFileSystem *syncFS, expanse::AsyncFileSystem *asyncFS, const expanse::ArrayView<const expanse::UTF8String_t> &sourcePaths, const expanse::ArrayView<const expanse::UTF8String_t> &manifestPaths, bool binaryHAsm)
 {
-	ErrorReporter errorReporter;
+	typedef expanse::cc::TranslationUnitDriver TranslationUnitDriver;
 
-	CHECK_RV(expanse::CorePtr<expanse::MemoryRWFileStream>, ppFile, expanse::New<expanse::MemoryRWFileStream>(alloc, alloc));
-	CHECK_RV(expanse::CorePtr<expanse::MemoryRWFileStream>, traceFile, expanse::New<expanse::MemoryRWFileStream>(alloc, alloc));
+	const expanse::UTF8StringView_t device("game");
 
 	CHECK_RV(expanse::CorePtr<expanse::cc::FileCache>, fileCache, expanse::New<expanse::cc::FileCache>(alloc, alloc));
-	CHECK_RV(expanse::CorePtr<expanse::cc::CPreprocessor>, preprocessor, expanse::New<expanse::cc::CPreprocessor>(alloc, alloc, asyncFS, fileCache, ppFile, &errorReporter));
+	CHECK(fileCache->Initialize());
+
+	CHECK_RV(expanse::CorePtr<expanse::cc::PPConditionCache>, conditionCache, expanse::New<expanse::cc::PPConditionCache>(alloc, alloc));
+	CHECK(conditionCache->Initialize());
 
-	CHECK(preprocessor->StartRootFile(expanse::UTF8StringView_t("game"), expanse::UTF8StringView_t("logic/test.c")));
+	CHECK_RV(expanse::CorePtr<TranslationUnitDriver>, driver, expanse::New<TranslationUnitDriver>(alloc, alloc, syncFS, asyncFS, fileCache, conditionCache, binaryHAsm));
 
-	for (;;)
+	for (size_t i = 0; i < manifestPaths.Size(); i++)
 	{
-		preprocessor->Digest();
+		CHECK(driver->AddManifest(device, manifestPaths[i]));
+	}
 
-		expanse::cc::CPreprocessor::State state = preprocessor->GetState();
-		if (state == expanse::cc::CPreprocessor::State::kIdle)
-			break;
+	for (size_t i = 0; i < sourcePaths.Size(); i++)
+	{
+		CHECK(driver->AddTranslationUnit(device, sourcePaths[i]));
+	}
 
-		if (state == expanse::cc::CPreprocessor::State::kFailed)
-			return expanse::ErrorCode::kOperationFailed;
+	if (driver->GetTranslationUnits().Size() == 0)
+	{
+		CHECK(driver->AddTranslationUnit(device, expanse::UTF8StringView_t("logic/test.c")));
 	}
 
-	CHECK(preprocessor->FlushTrace(traceFile));
-	preprocessor = nullptr;
+	CHECK(driver->Run(workerAllocators));
+
+	const expanse::ArrayView<const TranslationUnitDriver::TranslationUnit> units = driver->GetTranslationUnits();
+	const expanse::ArrayView<const TranslationUnitDriver::WorkerStats> workerStats = driver->GetWorkerStats();
+
+	size_t numFailed = 0;
+	uint64_t totalPreprocessTime = 0;
+	uint64_t totalCompileTime = 0;
+	uint64_t totalTime = 0;
+
+	for (size_t i = 0; i < units.Size(); i++)
+	{
+		const TranslationUnitDriver::TranslationUnit &unit = units[i];
+
+		PrintPath(unit.m_device, unit.m_path);
+		fprintf(stderr, ": %s, worker %u, preprocess %.3f ms, compile %.3f ms, total %.3f ms\n",
+			(unit.m_errorCode == expanse::ErrorCode::kOK) ? "OK" : "FAILED",
+			static_cast<unsigned int>(unit.m_workerIndex),
+			MicrosecondsToMilliseconds(unit.m_preprocessTimeMicroseconds),
+			MicrosecondsToMilliseconds(unit.m_compileTimeMicroseconds),
+			MicrosecondsToMilliseconds(unit.m_totalTimeMicroseconds));
+
+		if (unit.m_errorCode != expanse::ErrorCode::kOK)
+			numFailed++;
+
+		totalPreprocessTime += unit.m_preprocessTimeMicroseconds;
+		totalCompileTime += unit.m_compileTimeMicroseconds;
+		totalTime += unit.m_totalTimeMicroseconds;
+	}
 
-	CHECK_RV(expanse::ArrayPtr<uint8_t>, ppContents, ppFile->ContentsToArray());
-	CHECK_RV(expanse::ArrayPtr<uint8_t>, traceContents, traceFile->ContentsToArray());
+	for (size_t i = 0; i < workerStats.Size(); i++)
+	{
+		const TranslationUnitDriver::WorkerStats &stats = workerStats[i];
 
-	CHECK_RV(expanse::CorePtr<expanse::cc::CPreprocessorTraceInfo>, traceInfo, expanse::New<expanse::cc::CPreprocessorTraceInfo>(alloc, alloc));
-	//CHECK(traceInfo->Load(traceContents));
+		fprintf(stderr, "Worker %u: %u units (%u stolen), busy %.3f ms\n",
+			static_cast<unsigned int>(i),
+			static_cast<unsigned int>(stats.m_numTranslationUnits),
+			static_cast<unsigned int>(stats.m_numStolen),
+			MicrosecondsToMilliseconds(stats.m_busyTimeMicroseconds));
+	}
 
-	expanse::cc::TextHAsmWriter asmWriter(outFile);
-	expanse::cc::IHAsmWriter *asmWriterPtr = &asmWriter;
+	// The unit times are summed wall times, which include time spent waiting on loads and on each other, so
+	// they say nothing about how well the workers scale
+	fprintf(stderr, "%u units, %u failed, %u workers: wall %.3f ms, preprocess %.3f ms, compile %.3f ms, total %.3f ms\n",
+		static_cast<unsigned int>(units.Size()),
+		static_cast<unsigned int>(numFailed),
+		static_cast<unsigned int>(workerStats.Size()),
+		MicrosecondsToMilliseconds(driver->GetWallTimeMicroseconds()),
+		MicrosecondsToMilliseconds(totalPreprocessTime),
+		MicrosecondsToMilliseconds(totalCompileTime),
+		MicrosecondsToMilliseconds(totalTime));
+
+	for (size_t rule = 0; rule < static_cast<size_t>(expanse::cc::ParseRule::kCount); rule++)
+	{
+		expanse::cc::ParseRuleStats totalStats;
+		for (size_t i = 0; i < units.Size(); i++)
+		{
+			const expanse::cc::ParseRuleStats &stats = units[i].m_parseRuleStats[rule];
+			totalStats.m_numCalls += stats.m_numCalls;
+			totalStats.m_numReentries += stats.m_numReentries;
+			totalStats.m_numMemoHits += stats.m_numMemoHits;
+		}
+
+		fprintf(stderr, "Parse rule %s: %llu calls, %llu reentries, %llu memo hits\n",
+			GetParseRuleName(static_cast<expanse::cc::ParseRule>(rule)),
+			static_cast<unsigned long long>(totalStats.m_numCalls),
+			static_cast<unsigned long long>(totalStats.m_numReentries),
+			static_cast<unsigned long long>(totalStats.m_numMemoHits));
+	}
 
-	CHECK_RV(expanse::CorePtr<expanse::cc::CCompiler>, compiler, expanse::New<expanse::cc::CCompiler>(alloc, alloc, &errorReporter, std::move(ppContents), traceInfo, asmWriterPtr));
-	CHECK(compiler->Compile());
+	fprintf(stderr, "File cache: %llu hits, %llu negative hits, %llu misses\n", static_cast<unsigned long long>(fileCache->GetHitCount()), static_cast<unsigned long long>(fileCache->GetNegativeHitCount()), static_cast<unsigned long long>(fileCache->GetMissCount()));
+	fprintf(stderr, "Condition cache: %llu hits, %llu misses\n", static_cast<unsigned long long>(conditionCache->GetHitCount()), static_cast<unsigned long long>(conditionCache->GetMissCount()));
 
-	EXP_ASSERT(false);
+	if (numFailed > 0)
+		return expanse::ErrorCode::kOperationFailed;
 
 	return expanse::ErrorCode::kOK;
 }
@@ -1,13 +1,15 @@
 #include "TextHAsmWriter.h"
-#include "FileStream.h"
+#include "BufferedFileStream.h"
 #include "Result.h"
-#include "StaticArray.h"
+#include "ResultRV.h"
+
+#include <cstring>
 
 namespace expanse
 {
 	namespace cc
 	{
-		TextHAsmWriter::TextHAsmWriter(FileStream *fs)
+		TextHAsmWriter::TextHAsmWriter(BufferedFileStream *fs)
 			: m_fs(fs)
 			, m_sequentialDataOps(0)
 		{
@@ -170,66 +172,24 @@ namespace expanse
 
 		Result TextHAsmWriter::WriteSInt(const MaxSInt &sint)
 		{
-			MaxSInt zero = MaxSInt(0);
-
-			if (sint < zero)
-			{
-				StaticArray<char, MaxSInt::kMaxDecimalDigits + 2> writeBuffer;
-				size_t writeOffset = 0;
-
-				writeBuffer[writeOffset++] = '-';
-
-				MaxSInt decomposeTemp = sint;
-				while (decomposeTemp != 0)
-				{
-					int8_t remainder = 0;
-					decomposeTemp.DivMod10(decomposeTemp, remainder);
-					writeBuffer[writeOffset++] = '0' - remainder;
-				}
-
-				for (size_t i = 0; i < writeOffset / 2; i++)
-					std::swap(writeBuffer[i], writeBuffer[writeOffset - 1 - i]);
-
-				writeBuffer[writeOffset++] = 0;
-
-				CHECK(WriteString(&writeBuffer.ConstView()[0]));
-			}
-			else
-			{
-				CHECK_RV(MaxUInt, uint, (sint.ToUnsigned()));
-				CHECK(WriteUInt(uint));
-			}
+			CHECK_RV(uint8_t*, writeBuffer, m_fs->Reserve(MaxSInt::kMaxDecimalChars));
+			m_fs->Commit(sint.ToDecimalChars(reinterpret_cast<char*>(writeBuffer)));
 
 			return ErrorCode::kOK;
 		}
 
 		Result TextHAsmWriter::WriteUInt(const MaxUInt &uint)
 		{
-			MaxUInt zero = MaxUInt(0);
+			CHECK_RV(uint8_t*, writeBuffer, m_fs->Reserve(MaxUInt::kMaxDecimalChars));
+			m_fs->Commit(uint.ToDecimalChars(reinterpret_cast<char*>(writeBuffer)));
 
-			if (uint == zero)
-			{
-				CHECK(WriteString("0"));
-			}
-			else
-			{
-				StaticArray<char, MaxSInt::kMaxDecimalDigits + 1> writeBuffer;
-				size_t writeOffset = 0;
-				MaxUInt decomposeTemp = uint;
-				while (decomposeTemp != 0)
-				{
-					uint8_t remainder = 0;
-					decomposeTemp.DivMod10(decomposeTemp, remainder);
-					writeBuffer[writeOffset++] = '0' + remainder;
-				}
-
-				for (size_t i = 0; i < writeOffset / 2; i++)
-					std::swap(writeBuffer[i], writeBuffer[writeOffset - 1 - i]);
-
-				writeBuffer[writeOffset++] = 0;
-
-				CHECK(WriteString(&writeBuffer.ConstView()[0]));
-			}
+			return ErrorCode::kOK;
+		}
+
+		Result TextHAsmWriter::WriteFloat(LType lType, const MaxUInt &bits)
+		{
+			CHECK_RV(uint8_t*, writeBuffer, m_fs->Reserve(MaxUInt::kMaxFloatDecimalChars));
+			m_fs->Commit(bits.FloatBitsToDecimalChars(lType, reinterpret_cast<char*>(writeBuffer)));
 
 			return ErrorCode::kOK;
 		}
@@ -304,11 +264,13 @@ namespace expanse
 			case LType::kUInt16:
 			case LType::kUInt32:
 			case LType::kUInt64:
-			case LType::kFloat32:
-			case LType::kFloat64:
 			case LType::kAddress:
 				return WriteUInt(c.GetUnsigned());
 
+			case LType::kFloat32:
+			case LType::kFloat64:
+				return WriteFloat(c.GetLType(), c.GetUnsigned());
+
 			default:
 				EXP_ASSERT(false);
 				return ErrorCode::kInternalError;
@@ -4,7 +4,7 @@
 
 namespace expanse
 {
-	class FileStream;
+	class BufferedFileStream;
 
 	namespace cc
 	{
@@ -13,7 +13,7 @@ namespace expanse
 		class TextHAsmWriter final : public IHAsmWriter
 		{
 		public:
-			explicit TextHAsmWriter(FileStream *fs);
+			explicit TextHAsmWriter(BufferedFileStream *fs);
 
 			Result Start(const HAsmHeader &asmHeader) override;
 
@@ -29,11 +29,12 @@ namespace expanse
 
 			Result WriteSInt(const MaxSInt &sint);
 			Result WriteUInt(const MaxUInt &uint);
+			Result WriteFloat(LType lType, const MaxUInt &bits);
 			Result WriteString(const char *str);
 			Result WriteLType(LType lType);
 			Result WriteCompilerConst(const CompilerConstant &c);
 
-			FileStream *m_fs;
+			BufferedFileStream *m_fs;
 			size_t m_sequentialDataOps;
 		};
 	}
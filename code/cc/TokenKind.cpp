@@ -0,0 +1,269 @@
+#include "TokenKind.h"
+
+#include <cstring>
+
+namespace expanse
+{
+	namespace cc
+	{
+		namespace
+		{
+			template<class TValue>
+			struct PerfectHashEntry
+			{
+				const char *m_chars;
+				TValue m_value;
+			};
+
+			constexpr size_t ConstStrLen(const char *str)
+			{
+				size_t length = 0;
+				while (str[length] != 0)
+					length++;
+
+				return length;
+			}
+
+			// Only the length and the first, middle and last characters are hashed, which is enough to tell apart
+			// every word in these sets.  The seed is picked when the table is built.
+			template<class TChar>
+			constexpr uint32_t HashWord(const TChar *chars, size_t size, uint32_t seed)
+			{
+				const uint32_t kPrime = 16777619u;
+
+				uint32_t hash = seed ^ (static_cast<uint32_t>(size) * 0x9e3779b9u);
+				hash = (hash ^ static_cast<uint8_t>(chars[0])) * kPrime;
+				hash = (hash ^ static_cast<uint8_t>(chars[size / 2u])) * kPrime;
+				hash = (hash ^ static_cast<uint8_t>(chars[size - 1u])) * kPrime;
+
+				return hash ^ (hash >> 16);
+			}
+
+			template<class TValue, size_t TNumEntries, size_t TNumSlots>
+			struct PerfectHashTable
+			{
+				static_assert((TNumSlots & (TNumSlots - 1u)) == 0, "Slot count must be a power of two");
+				static_assert(TNumEntries < 256u, "Slots can't index that many entries");
+
+				TValue Find(const uint8_t *chars, size_t size, TValue notFound) const;
+
+				PerfectHashEntry<TValue> m_entries[TNumEntries];
+				size_t m_entrySizes[TNumEntries];
+				uint8_t m_slots[TNumSlots];	// Entry index plus one, zero if empty
+				uint32_t m_seed;
+				size_t m_minSize;
+				size_t m_maxSize;
+				bool m_isValid;
+			};
+
+			// Tries seeds until one puts every entry in a slot of its own.  The slot count trades table size for how
+			// many seeds that takes, m_isValid is left false if none of them work.
+			template<size_t TNumSlots, class TValue, size_t TNumEntries>
+			constexpr PerfectHashTable<TValue, TNumEntries, TNumSlots> BuildPerfectHashTable(const PerfectHashEntry<TValue> (&entries)[TNumEntries])
+			{
+				const uint32_t kMaxSeeds = 4096;
+
+				PerfectHashTable<TValue, TNumEntries, TNumSlots> table = {};
+
+				table.m_minSize = ~static_cast<size_t>(0);
+				for (size_t i = 0; i < TNumEntries; i++)
+				{
+					const size_t size = ConstStrLen(entries[i].m_chars);
+
+					table.m_entries[i] = entries[i];
+					table.m_entrySizes[i] = size;
+
+					if (size < table.m_minSize)
+						table.m_minSize = size;
+					if (size > table.m_maxSize)
+						table.m_maxSize = size;
+				}
+
+				for (uint32_t seed = 0; seed < kMaxSeeds; seed++)
+				{
+					for (size_t slot = 0; slot < TNumSlots; slot++)
+						table.m_slots[slot] = 0;
+
+					bool collided = false;
+					for (size_t i = 0; i < TNumEntries; i++)
+					{
+						const size_t slot = HashWord(entries[i].m_chars, table.m_entrySizes[i], seed) & (TNumSlots - 1u);
+						if (table.m_slots[slot] != 0)
+						{
+							collided = true;
+							break;
+						}
+
+						table.m_slots[slot] = static_cast<uint8_t>(i + 1u);
+					}
+
+					if (!collided)
+					{
+						table.m_seed = seed;
+						table.m_isValid = true;
+						break;
+					}
+				}
+
+				return table;
+			}
+
+			template<class TValue, size_t TNumEntries, size_t TNumSlots>
+			TValue PerfectHashTable<TValue, TNumEntries, TNumSlots>::Find(const uint8_t *chars, size_t size, TValue notFound) const
+			{
+				if (size < m_minSize || size > m_maxSize)
+					return notFound;
+
+				const uint8_t slot = m_slots[HashWord(chars, size, m_seed) & (TNumSlots - 1u)];
+				if (slot == 0)
+					return notFound;
+
+				const size_t entryIndex = slot - 1u;
+				if (m_entrySizes[entryIndex] != size || memcmp(m_entries[entryIndex].m_chars, chars, size) != 0)
+					return notFound;
+
+				return m_entries[entryIndex].m_value;
+			}
+
+			constexpr PerfectHashEntry<TokenKind> kKeywords[] =
+			{
+				{ "auto", TokenKind::kAuto },
+				{ "break", TokenKind::kBreak },
+				{ "case", TokenKind::kCase },
+				{ "char", TokenKind::kChar },
+				{ "const", TokenKind::kConst },
+				{ "continue", TokenKind::kContinue },
+				{ "default", TokenKind::kDefault },
+				{ "do", TokenKind::kDo },
+				{ "double", TokenKind::kDouble },
+				{ "else", TokenKind::kElse },
+				{ "enum", TokenKind::kEnum },
+				{ "extern", TokenKind::kExtern },
+				{ "float", TokenKind::kFloat },
+				{ "for", TokenKind::kFor },
+				{ "goto", TokenKind::kGoto },
+				{ "if", TokenKind::kIf },
+				{ "inline", TokenKind::kInline },
+				{ "int", TokenKind::kInt },
+				{ "long", TokenKind::kLong },
+				{ "register", TokenKind::kRegister },
+				{ "restrict", TokenKind::kRestrict },
+				{ "return", TokenKind::kReturn },
+				{ "short", TokenKind::kShort },
+				{ "signed", TokenKind::kSigned },
+				{ "sizeof", TokenKind::kSizeof },
+				{ "static", TokenKind::kStatic },
+				{ "struct", TokenKind::kStruct },
+				{ "switch", TokenKind::kSwitch },
+				{ "typedef", TokenKind::kTypedef },
+				{ "union", TokenKind::kUnion },
+				{ "unsigned", TokenKind::kUnsigned },
+				{ "void", TokenKind::kVoid },
+				{ "volatile", TokenKind::kVolatile },
+				{ "while", TokenKind::kWhile },
+				{ "_Bool", TokenKind::kBool },
+				{ "_Complex", TokenKind::kComplex },
+				{ "_Imaginary", TokenKind::kImaginary },
+			};
+
+			constexpr PerfectHashEntry<TokenKind> kPunctuators[] =
+			{
+				{ "[", TokenKind::kLeftBracket },
+				{ "]", TokenKind::kRightBracket },
+				{ "(", TokenKind::kLeftParen },
+				{ ")", TokenKind::kRightParen },
+				{ "{", TokenKind::kLeftBrace },
+				{ "}", TokenKind::kRightBrace },
+				{ ".", TokenKind::kPeriod },
+				{ "->", TokenKind::kArrow },
+				{ "++", TokenKind::kIncrement },
+				{ "--", TokenKind::kDecrement },
+				{ "&", TokenKind::kAmpersand },
+				{ "*", TokenKind::kAsterisk },
+				{ "+", TokenKind::kPlus },
+				{ "-", TokenKind::kMinus },
+				{ "~", TokenKind::kTilde },
+				{ "!", TokenKind::kExclamation },
+				{ "/", TokenKind::kSlash },
+				{ "%", TokenKind::kPercent },
+				{ "<<", TokenKind::kLeftShift },
+				{ ">>", TokenKind::kRightShift },
+				{ "<", TokenKind::kLess },
+				{ ">", TokenKind::kGreater },
+				{ "<=", TokenKind::kLessEqual },
+				{ ">=", TokenKind::kGreaterEqual },
+				{ "==", TokenKind::kEqual },
+				{ "!=", TokenKind::kNotEqual },
+				{ "^", TokenKind::kCaret },
+				{ "|", TokenKind::kVerticalBar },
+				{ "&&", TokenKind::kLogicalAnd },
+				{ "||", TokenKind::kLogicalOr },
+				{ "?", TokenKind::kQuestion },
+				{ ":", TokenKind::kColon },
+				{ ";", TokenKind::kSemicolon },
+				{ "...", TokenKind::kEllipsis },
+				{ "=", TokenKind::kAssign },
+				{ "*=", TokenKind::kMulAssign },
+				{ "/=", TokenKind::kDivAssign },
+				{ "%=", TokenKind::kModAssign },
+				{ "+=", TokenKind::kAddAssign },
+				{ "-=", TokenKind::kSubAssign },
+				{ "<<=", TokenKind::kLshAssign },
+				{ ">>=", TokenKind::kRshAssign },
+				{ "&=", TokenKind::kAndAssign },
+				{ "^=", TokenKind::kXorAssign },
+				{ "|=", TokenKind::kOrAssign },
+				{ ",", TokenKind::kComma },
+				{ "#", TokenKind::kHash },
+				{ "##", TokenKind::kHashHash },
+
+				// Digraphs
+				{ "<:", TokenKind::kLeftBracket },
+				{ ":>", TokenKind::kRightBracket },
+				{ "<%", TokenKind::kLeftBrace },
+				{ "%>", TokenKind::kRightBrace },
+				{ "%:", TokenKind::kHash },
+				{ "%:%:", TokenKind::kHashHash },
+			};
+
+			constexpr PerfectHashEntry<PPDirective> kDirectives[] =
+			{
+				{ "if", PPDirective::kIf },
+				{ "ifdef", PPDirective::kIfDef },
+				{ "ifndef", PPDirective::kIfNDef },
+				{ "elif", PPDirective::kElif },
+				{ "else", PPDirective::kElse },
+				{ "endif", PPDirective::kEndIf },
+				{ "include", PPDirective::kInclude },
+				{ "define", PPDirective::kDefine },
+				{ "undef", PPDirective::kUndef },
+				{ "line", PPDirective::kLine },
+				{ "error", PPDirective::kError },
+				{ "pragma", PPDirective::kPragma },
+			};
+
+			constexpr auto kKeywordTable = BuildPerfectHashTable<256>(kKeywords);
+			constexpr auto kPunctuatorTable = BuildPerfectHashTable<512>(kPunctuators);
+			constexpr auto kDirectiveTable = BuildPerfectHashTable<64>(kDirectives);
+
+			static_assert(kKeywordTable.m_isValid, "No seed gives a perfect hash of the keywords");
+			static_assert(kPunctuatorTable.m_isValid, "No seed gives a perfect hash of the punctuators");
+			static_assert(kDirectiveTable.m_isValid, "No seed gives a perfect hash of the directives");
+		}
+
+		TokenKind TokenKindLookup::FindKeyword(const uint8_t *chars, size_t size)
+		{
+			return kKeywordTable.Find(chars, size, TokenKind::kOther);
+		}
+
+		TokenKind TokenKindLookup::FindPunctuator(const uint8_t *chars, size_t size)
+		{
+			return kPunctuatorTable.Find(chars, size, TokenKind::kOther);
+		}
+
+		PPDirective TokenKindLookup::FindDirective(const uint8_t *chars, size_t size)
+		{
+			return kDirectiveTable.Find(chars, size, PPDirective::kUnknown);
+		}
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace expanse
+{
+	namespace cc
+	{
+		// What a token is when it's one of the fixed words or punctuators of the language, so the parser can switch
+		// on it instead of comparing strings.  Digraphs have the same kind as the punctuator they stand for.
+		enum class TokenKind : uint8_t
+		{
+			kOther,
+
+			// Keywords
+			kAuto,
+			kBreak,
+			kCase,
+			kChar,
+			kConst,
+			kContinue,
+			kDefault,
+			kDo,
+			kDouble,
+			kElse,
+			kEnum,
+			kExtern,
+			kFloat,
+			kFor,
+			kGoto,
+			kIf,
+			kInline,
+			kInt,
+			kLong,
+			kRegister,
+			kRestrict,
+			kReturn,
+			kShort,
+			kSigned,
+			kSizeof,
+			kStatic,
+			kStruct,
+			kSwitch,
+			kTypedef,
+			kUnion,
+			kUnsigned,
+			kVoid,
+			kVolatile,
+			kWhile,
+			kBool,
+			kComplex,
+			kImaginary,
+
+			// Punctuators
+			kLeftBracket,
+			kRightBracket,
+			kLeftParen,
+			kRightParen,
+			kLeftBrace,
+			kRightBrace,
+			kPeriod,
+			kArrow,
+			kIncrement,
+			kDecrement,
+			kAmpersand,
+			kAsterisk,
+			kPlus,
+			kMinus,
+			kTilde,
+			kExclamation,
+			kSlash,
+			kPercent,
+			kLeftShift,
+			kRightShift,
+			kLess,
+			kGreater,
+			kLessEqual,
+			kGreaterEqual,
+			kEqual,
+			kNotEqual,
+			kCaret,
+			kVerticalBar,
+			kLogicalAnd,
+			kLogicalOr,
+			kQuestion,
+			kColon,
+			kSemicolon,
+			kEllipsis,
+			kAssign,
+			kMulAssign,
+			kDivAssign,
+			kModAssign,
+			kAddAssign,
+			kSubAssign,
+			kLshAssign,
+			kRshAssign,
+			kAndAssign,
+			kXorAssign,
+			kOrAssign,
+			kComma,
+			kHash,
+			kHashHash,
+
+			kFirstKeyword = kAuto,
+			kLastKeyword = kImaginary,
+		};
+
+		enum class PPDirective : uint8_t
+		{
+			kUnknown,
+
+			kIf,
+			kIfDef,
+			kIfNDef,
+			kElif,
+			kElse,
+			kEndIf,
+			kInclude,
+			kDefine,
+			kUndef,
+			kLine,
+			kError,
+			kPragma,
+		};
+
+		// Each set is looked up through a perfect hash built at compile time, so a lookup is one hash, one table
+		// load and at most one string compare.
+		class TokenKindLookup
+		{
+		public:
+			static TokenKind FindKeyword(const uint8_t *chars, size_t size);
+			static TokenKind FindPunctuator(const uint8_t *chars, size_t size);
+			static PPDirective FindDirective(const uint8_t *chars, size_t size);
+
+			static bool IsKeyword(TokenKind kind);
+		};
+	}
+}
+
+namespace expanse
+{
+	namespace cc
+	{
+		inline bool TokenKindLookup::IsKeyword(TokenKind kind)
+		{
+			return kind >= TokenKind::kFirstKeyword && kind <= TokenKind::kLastKeyword;
+		}
+	}
+}
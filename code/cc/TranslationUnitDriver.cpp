@@ -0,0 +1,528 @@
+#include "TranslationUnitDriver.h"
+
+#include "AsyncFileSystem.h"
+#include "BinaryHAsmWriter.h"
+#include "BufferedFileStream.h"
+#include "CCompiler.h"
+#include "CharCodes.h"
+#include "CPreprocessor.h"
+#include "FileCache.h"
+#include "FileCoordinate.h"
+#include "FileStream.h"
+#include "IErrorReporter.h"
+#include "IIncludeStackTrace.h"
+#include "Mem.h"
+#include "Mutex.h"
+#include "MutexLock.h"
+#include "PPConditionCache.h"
+#include "PreprocessorOutputChannel.h"
+#include "Result.h"
+#include "ResultRV.h"
+#include "StringView.h"
+#include "SynchronousFileSystem.h"
+#include "TextHAsmWriter.h"
+#include "Thread.h"
+#include "ThreadEvent.h"
+
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+namespace expanse
+{
+	namespace cc
+	{
+		// Reports go to stderr, the mutex keeps lines from different workers from being interleaved
+		struct TranslationUnitDriver::ErrorReporter final : public IErrorReporter
+		{
+		public:
+			explicit ErrorReporter(Mutex *outputMutex);
+
+			void ReportError(const FileCoordinate &fileCoordinate, IIncludeStackTrace &includeStackTrace, CompilationErrorCode errorCode) override;
+
+		private:
+			Mutex *m_outputMutex;
+		};
+
+		struct TranslationUnitDriver::PreprocessorJob
+		{
+			PreprocessorJob();
+
+			TranslationUnitDriver *m_driver;
+			TranslationUnit *m_unit;
+			CPreprocessor *m_preprocessor;
+			PreprocessorOutputChannel *m_channel;
+			ThreadEvent *m_fileLoadEvent;
+			ErrorCode m_errorCode;
+		};
+
+		static uint64_t GetMicrosecondsSince(const std::chrono::steady_clock::time_point &startTime)
+		{
+			const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - startTime;
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+		}
+
+		TranslationUnitDriver::ErrorReporter::ErrorReporter(Mutex *outputMutex)
+			: m_outputMutex(outputMutex)
+		{
+		}
+
+		void TranslationUnitDriver::ErrorReporter::ReportError(const FileCoordinate &fileCoordinate, IIncludeStackTrace &includeStackTrace, CompilationErrorCode errorCode)
+		{
+			includeStackTrace.Reset();
+
+			UTF8StringView_t device;
+			UTF8StringView_t path;
+			FileLocation location;
+
+			// Still worth reporting the error if its location can't be found
+			Result locationResult(includeStackTrace.GetCurrentFile(device, path, location));
+			locationResult.Handle();
+
+			MutexLock lock(m_outputMutex);
+
+			if (device.Length() > 0)
+				fwrite(&device.GetChars()[0], device.Length(), 1, stderr);
+			fputs("://", stderr);
+			if (path.Length() > 0)
+				fwrite(&path.GetChars()[0], path.Length(), 1, stderr);
+			fprintf(stderr, "(%u,%u): %i\n", location.m_lineNumber, location.m_column, static_cast<int>(errorCode));
+		}
+
+		TranslationUnitDriver::TranslationUnit::TranslationUnit()
+			: m_errorCode(ErrorCode::kOK)
+			, m_workerIndex(0)
+			, m_preprocessTimeMicroseconds(0)
+			, m_compileTimeMicroseconds(0)
+			, m_totalTimeMicroseconds(0)
+		{
+		}
+
+		TranslationUnitDriver::WorkerStats::WorkerStats()
+			: m_numTranslationUnits(0)
+			, m_numStolen(0)
+			, m_busyTimeMicroseconds(0)
+		{
+		}
+
+		TranslationUnitDriver::PreprocessorJob::PreprocessorJob()
+			: m_driver(nullptr)
+			, m_unit(nullptr)
+			, m_preprocessor(nullptr)
+			, m_channel(nullptr)
+			, m_fileLoadEvent(nullptr)
+			, m_errorCode(ErrorCode::kOK)
+		{
+		}
+
+		TranslationUnitDriver::Worker::Worker()
+			: m_driver(nullptr)
+			, m_alloc(nullptr)
+			, m_workerIndex(0)
+			, m_preprocessorJob(nullptr)
+		{
+		}
+
+		TranslationUnitDriver::Worker::~Worker()
+		{
+			// The worker thread may still be handing units to the preprocessor thread
+			m_thread = nullptr;
+
+			if (m_preprocessorThread)
+			{
+				m_preprocessorJob = nullptr;
+				m_preprocessorStartEvent->Set();
+				m_preprocessorThread = nullptr;
+			}
+		}
+
+		TranslationUnitDriver::TranslationUnitDriver(IAllocator *alloc, SynchronousFileSystem *syncFS, AsyncFileSystem *asyncFS, FileCache *fileCache, PPConditionCache *conditionCache, bool binaryHAsm)
+			: m_syncFS(syncFS)
+			, m_asyncFS(asyncFS)
+			, m_fileCache(fileCache)
+			, m_conditionCache(conditionCache)
+			, m_binaryHAsm(binaryHAsm)
+			, m_translationUnits(alloc)
+			, m_wallTimeMicroseconds(0)
+		{
+		}
+
+		TranslationUnitDriver::~TranslationUnitDriver()
+		{
+			// Joins any workers that are still running
+			m_workers = nullptr;
+		}
+
+		Result TranslationUnitDriver::AddTranslationUnit(const UTF8StringView_t &device, const UTF8StringView_t &path)
+		{
+			IAllocator *alloc = GetCoreObjectAllocator();
+
+			TranslationUnit unit;
+			CHECK_RV(UTF8String_t, deviceCopy, device.CloneToString(alloc));
+			CHECK_RV(UTF8String_t, pathCopy, path.CloneToString(alloc));
+
+			unit.m_device = std::move(deviceCopy);
+			unit.m_path = std::move(pathCopy);
+
+			CHECK(m_translationUnits.Add(std::move(unit)));
+
+			return ErrorCode::kOK;
+		}
+
+		Result TranslationUnitDriver::AddManifest(const UTF8StringView_t &device, const UTF8StringView_t &path)
+		{
+			IAllocator *alloc = GetCoreObjectAllocator();
+
+			CHECK_RV(CorePtr<FileStream>, stream, m_syncFS->Open(device, path, SynchronousFileSystem::Permission::kRead, SynchronousFileSystem::CreationDisposition::kOpenExisting));
+			CHECK_RV(UFilePos_t, fileSize, stream->GetSize());
+
+			if (fileSize > std::numeric_limits<size_t>::max())
+				return ErrorCode::kOutOfMemory;
+
+			if (fileSize == 0)
+				return ErrorCode::kOK;
+
+			CHECK_RV(ArrayPtr<uint8_t>, contents, NewArrayUninitialized<uint8_t>(alloc, static_cast<size_t>(fileSize)));
+			CHECK(stream->ReadAll(contents.View()));
+			stream = nullptr;
+
+			const ArrayView<const uint8_t> contentsView = contents.ConstView();
+
+			size_t lineStart = 0;
+			while (lineStart < contentsView.Size())
+			{
+				size_t lineEnd = lineStart;
+				while (lineEnd < contentsView.Size() && contentsView[lineEnd] != CharCode::kLineFeed)
+					lineEnd++;
+
+				const size_t nextLineStart = lineEnd + 1;
+
+				while (lineStart < lineEnd && (contentsView[lineStart] == CharCode::kSpace || contentsView[lineStart] == CharCode::kTab))
+					lineStart++;
+
+				while (lineEnd > lineStart)
+				{
+					const uint8_t lastChar = contentsView[lineEnd - 1];
+					if (lastChar != CharCode::kSpace && lastChar != CharCode::kTab && lastChar != CharCode::kCarriageReturn)
+						break;
+
+					lineEnd--;
+				}
+
+				if (lineEnd > lineStart && contentsView[lineStart] != CharCode::kHash)
+				{
+					const ArrayView<const uint8_t> unitPath = contentsView.Subrange(lineStart, lineEnd - lineStart);
+					CHECK(AddTranslationUnit(device, UTF8StringView_t(&unitPath[0], unitPath.Size())));
+				}
+
+				lineStart = nextLineStart;
+			}
+
+			return ErrorCode::kOK;
+		}
+
+		Result TranslationUnitDriver::Run(const ArrayView<IAllocator *const> &workerAllocators)
+		{
+			IAllocator *alloc = GetCoreObjectAllocator();
+
+			const size_t numWorkers = workerAllocators.Size();
+			const size_t numUnits = m_translationUnits.Size();
+
+			if (numWorkers == 0)
+				return ErrorCode::kInvalidArgument;
+
+			CHECK_RV(CorePtr<Mutex>, errorOutputMutex, Mutex::Create(alloc));
+			m_errorOutputMutex = std::move(errorOutputMutex);
+
+			CHECK_RV(ArrayPtr<Worker>, workers, NewArray<Worker>(alloc, numWorkers));
+			CHECK_RV(ArrayPtr<WorkerStats>, workerStats, NewArray<WorkerStats>(alloc, numWorkers));
+
+			// Every deque is big enough to hold all of the units since nothing is pushed once the workers start
+			for (size_t i = 0; i < numWorkers; i++)
+			{
+				Worker &worker = workers[i];
+				worker.m_driver = this;
+				worker.m_alloc = workerAllocators[i];
+				worker.m_workerIndex = i;
+
+				CHECK(worker.m_deque.Initialize(alloc, numUnits));
+			}
+
+			// Deal the units out in reverse so each worker pops its share in listed order
+			for (size_t i = 0; i < numUnits; i++)
+			{
+				const size_t unitIndex = numUnits - 1 - i;
+				if (!workers[unitIndex % numWorkers].m_deque.TryPush(unitIndex))
+					return ErrorCode::kInternalError;
+			}
+
+			m_workers = std::move(workers);
+			m_workerStats = std::move(workerStats);
+
+			const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+			for (size_t i = 0; i < numWorkers; i++)
+			{
+				Worker &worker = m_workers[i];
+
+				CHECK_RV(CorePtr<ThreadEvent>, startEvent, ThreadEvent::Create(alloc, UTF8StringView_t("Preprocessor Start Event"), true, false));
+				CHECK_RV(CorePtr<ThreadEvent>, doneEvent, ThreadEvent::Create(alloc, UTF8StringView_t("Preprocessor Done Event"), true, false));
+				CHECK_RV(CorePtr<ThreadEvent>, fileLoadEvent, ThreadEvent::Create(alloc, UTF8StringView_t("File Load Event"), true, false));
+
+				worker.m_preprocessorStartEvent = std::move(startEvent);
+				worker.m_preprocessorDoneEvent = std::move(doneEvent);
+				worker.m_fileLoadEvent = std::move(fileLoadEvent);
+
+				CHECK_RV(CorePtr<Thread>, preprocessorThread, Thread::CreateThread(alloc, StaticPreprocessorThreadFunc, &worker, UTF8StringView_t("Preprocessor")));
+				worker.m_preprocessorThread = std::move(preprocessorThread);
+			}
+
+			for (size_t i = 0; i < numWorkers; i++)
+			{
+				CHECK_RV(CorePtr<Thread>, thread, Thread::CreateThread(alloc, StaticWorkerThreadFunc, &m_workers[i], UTF8StringView_t("CompileWorker"), kCompileWorkerStackSize));
+				m_workers[i].m_thread = std::move(thread);
+			}
+
+			for (size_t i = 0; i < numWorkers; i++)
+				m_workers[i].m_thread->WaitForExit();
+
+			m_wallTimeMicroseconds = GetMicrosecondsSince(startTime);
+
+			m_workers = nullptr;
+
+			return ErrorCode::kOK;
+		}
+
+		ArrayView<const TranslationUnitDriver::TranslationUnit> TranslationUnitDriver::GetTranslationUnits() const
+		{
+			return m_translationUnits.ConstView();
+		}
+
+		ArrayView<const TranslationUnitDriver::WorkerStats> TranslationUnitDriver::GetWorkerStats() const
+		{
+			return m_workerStats.ConstView();
+		}
+
+		uint64_t TranslationUnitDriver::GetWallTimeMicroseconds() const
+		{
+			return m_wallTimeMicroseconds;
+		}
+
+		int TranslationUnitDriver::StaticWorkerThreadFunc(void *userdata)
+		{
+			Worker *worker = static_cast<Worker*>(userdata);
+			return worker->m_driver->WorkerThreadFunc(*worker);
+		}
+
+		int TranslationUnitDriver::StaticPreprocessorThreadFunc(void *userdata)
+		{
+			Worker *worker = static_cast<Worker*>(userdata);
+			return worker->m_driver->PreprocessorThreadFunc(*worker);
+		}
+
+		int TranslationUnitDriver::WorkerThreadFunc(Worker &worker)
+		{
+			size_t unitIndex = 0;
+			while (TryGetWork(worker, unitIndex))
+				RunTranslationUnit(worker, m_translationUnits[unitIndex]);
+
+			return 0;
+		}
+
+		int TranslationUnitDriver::PreprocessorThreadFunc(Worker &worker)
+		{
+			for (;;)
+			{
+				worker.m_preprocessorStartEvent->Wait();
+
+				PreprocessorJob *job = worker.m_preprocessorJob;
+				if (job == nullptr)
+					return 0;
+
+				RunPreprocessor(*job);
+				worker.m_preprocessorDoneEvent->Set();
+			}
+		}
+
+		bool TranslationUnitDriver::TryGetWork(Worker &worker, size_t &outUnitIndex)
+		{
+			if (worker.m_deque.TryPop(outUnitIndex))
+				return true;
+
+			// Nothing new is ever queued, so once every deque comes up empty there's nothing left to do
+			const size_t numWorkers = m_workers.Count();
+			for (size_t i = 1; i < numWorkers; i++)
+			{
+				Worker &victim = m_workers[(worker.m_workerIndex + i) % numWorkers];
+				if (victim.m_deque.TrySteal(outUnitIndex))
+				{
+					m_workerStats[worker.m_workerIndex].m_numStolen++;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		void TranslationUnitDriver::RunTranslationUnit(Worker &worker, TranslationUnit &unit)
+		{
+			const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+			unit.m_workerIndex = worker.m_workerIndex;
+
+			Result result(RunTranslationUnitChecked(worker, unit));
+			result.Handle();
+
+			unit.m_errorCode = result.GetErrorCode();
+			unit.m_totalTimeMicroseconds = GetMicrosecondsSince(startTime);
+
+			WorkerStats &stats = m_workerStats[worker.m_workerIndex];
+			stats.m_numTranslationUnits++;
+			stats.m_busyTimeMicroseconds += unit.m_totalTimeMicroseconds;
+		}
+
+		Result TranslationUnitDriver::RunTranslationUnitChecked(Worker &worker, TranslationUnit &unit)
+		{
+			IAllocator *alloc = worker.m_alloc;
+			ErrorReporter errorReporter(m_errorOutputMutex);
+
+			// The preprocessed source goes to the .i file on its way through the channel
+			CorePtr<BufferedFileStream> ppOutFile;
+			CHECK(OpenOutput(unit, "i", ppOutFile));
+
+			CHECK_RV(CorePtr<PreprocessorOutputChannel>, channel, New<PreprocessorOutputChannel>(alloc, alloc, ppOutFile));
+			CHECK(channel->Initialize());
+
+			CHECK_RV(CorePtr<CPreprocessor>, preprocessor, New<CPreprocessor>(alloc, alloc, m_asyncFS, m_fileCache, m_conditionCache, channel->GetWriteStream(), &errorReporter));
+			CHECK(preprocessor->StartRootFile(unit.m_device, unit.m_path));
+
+			CorePtr<BufferedFileStream> asmOutFile;
+			CHECK(OpenOutput(unit, m_binaryHAsm ? "hasmb" : "hasm", asmOutFile));
+
+			TextHAsmWriter textAsmWriter(asmOutFile);
+			BinaryHAsmWriter binaryAsmWriter(alloc, asmOutFile);
+			IHAsmWriter *asmWriterPtr = &textAsmWriter;
+			if (m_binaryHAsm)
+				asmWriterPtr = &binaryAsmWriter;
+
+			CHECK_RV(CorePtr<CCompiler>, compiler, New<CCompiler>(alloc, alloc, &errorReporter, channel.Get(), asmWriterPtr));
+
+			PreprocessorJob job;
+			job.m_driver = this;
+			job.m_unit = &unit;
+			job.m_preprocessor = preprocessor;
+			job.m_channel = channel;
+			job.m_fileLoadEvent = worker.m_fileLoadEvent;
+
+			worker.m_preprocessorJob = &job;
+			worker.m_preprocessorStartEvent->Set();
+
+			const std::chrono::steady_clock::time_point compileStartTime = std::chrono::steady_clock::now();
+
+			Result compileResult(compiler->Compile());
+			unit.m_compileTimeMicroseconds = GetMicrosecondsSince(compileStartTime);
+
+			for (size_t i = 0; i < static_cast<size_t>(ParseRule::kCount); i++)
+				unit.m_parseRuleStats[i] = compiler->GetParseRuleStats(static_cast<ParseRule>(i));
+
+			// The compiler may have stopped early, let the preprocessor run to the end without it so that the .i and
+			// .tr outputs are still complete
+			channel->Abandon();
+			worker.m_preprocessorDoneEvent->Wait();
+
+			if (job.m_errorCode != ErrorCode::kOK)
+			{
+				compileResult.Handle();
+				return job.m_errorCode;
+			}
+
+			// Failed units leave the rest of their outputs to be written when the streams are destroyed
+			if (compileResult.GetErrorCode() == ErrorCode::kOK)
+			{
+				CHECK(ppOutFile->Flush());
+				CHECK(asmOutFile->Flush());
+			}
+
+			return compileResult;
+		}
+
+		void TranslationUnitDriver::RunPreprocessor(PreprocessorJob &job)
+		{
+			const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+			Result result(RunPreprocessorChecked(job));
+			const ErrorCode errorCode = result.GetErrorCode();
+			result.Handle();
+
+			// The trace info is done changing by now, so the compiler can have it
+			Result closeResult(job.m_channel->Close(errorCode, job.m_preprocessor->GetTraceInfo()));
+			job.m_errorCode = closeResult.GetErrorCode();
+			closeResult.Handle();
+
+			job.m_unit->m_preprocessTimeMicroseconds = GetMicrosecondsSince(startTime);
+		}
+
+		Result TranslationUnitDriver::RunPreprocessorChecked(PreprocessorJob &job)
+		{
+			CPreprocessor *preprocessor = job.m_preprocessor;
+
+			for (;;)
+			{
+				preprocessor->Digest();
+
+				const CPreprocessor::State state = preprocessor->GetState();
+				if (state == CPreprocessor::State::kIdle)
+					break;
+
+				if (state == CPreprocessor::State::kFailed)
+					return ErrorCode::kOperationFailed;
+
+				preprocessor->WaitForFileLoad(job.m_fileLoadEvent);
+			}
+
+			CorePtr<BufferedFileStream> traceOutFile;
+			CHECK(OpenOutput(*job.m_unit, "tr", traceOutFile));
+			CHECK(preprocessor->FlushTrace(traceOutFile));
+			CHECK(traceOutFile->Flush());
+
+			return ErrorCode::kOK;
+		}
+
+		Result TranslationUnitDriver::OpenOutput(const TranslationUnit &unit, const char *extension, CorePtr<BufferedFileStream> &outStream) const
+		{
+			IAllocator *alloc = GetCoreObjectAllocator();
+
+			const ArrayView<const uint8_t> sourcePath = unit.m_path.GetChars();
+
+			// Replace the source's extension, if it has one
+			size_t stemLength = sourcePath.Size();
+			for (size_t i = 0; i < sourcePath.Size(); i++)
+			{
+				const uint8_t c = sourcePath[i];
+				if (c == CharCode::kSlash)
+					stemLength = sourcePath.Size();
+				else if (c == CharCode::kPeriod)
+					stemLength = i;
+			}
+
+			const UTF8StringView_t extensionView(extension);
+
+			Vector<uint8_t> outputPath(alloc);
+			CHECK(outputPath.Add(sourcePath.Subrange(0, stemLength)));
+			CHECK(outputPath.Add(static_cast<uint8_t>(CharCode::kPeriod)));
+			CHECK(outputPath.Add(extensionView.GetChars()));
+
+			const UTF8StringView_t outputPathView(&outputPath[0], outputPath.Size());
+
+			CHECK_RV(CorePtr<FileStream>, stream, m_syncFS->Open(unit.m_device, outputPathView, SynchronousFileSystem::Permission::kWrite, SynchronousFileSystem::CreationDisposition::kCreateAlways));
+
+			// Every output is produced in small pieces, so they're all buffered
+			CHECK_RV(CorePtr<BufferedFileStream>, bufferedStream, New<BufferedFileStream>(alloc, alloc, std::move(stream)));
+			CHECK(bufferedStream->Initialize(BufferedFileStream::kDefaultBufferSize));
+
+			outStream = std::move(bufferedStream);
+
+			return ErrorCode::kOK;
+		}
+	}
+}
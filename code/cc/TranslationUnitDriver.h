@@ -0,0 +1,147 @@
+#pragma once
+
+#include "ArrayPtr.h"
+#include "CoreObject.h"
+#include "CorePtr.h"
+#include "ErrorCode.h"
+#include "ParseRule.h"
+#include "StringProto.h"
+#include "Vector.h"
+#include "WorkStealingDeque.h"
+#include "XString.h"
+
+#include <cstdint>
+
+namespace expanse
+{
+	template<class T> struct ArrayView;
+	template<class T> struct ResultRV;
+	struct Result;
+	class AsyncFileSystem;
+	class BufferedFileStream;
+	class Mutex;
+	class SynchronousFileSystem;
+	class Thread;
+	class ThreadEvent;
+	struct IAllocator;
+
+	namespace cc
+	{
+		class FileCache;
+		class PPConditionCache;
+
+		// Runs the preprocessor and compiler over a batch of translation units on a pool of worker threads.
+		// Workers share the file system and the include and condition caches, but each one allocates everything for
+		// the units it runs from its own allocator.  Units are dealt out up front and idle workers steal from busy ones.
+		// Each worker also has a preprocessor thread, which runs the preprocessor for the worker's current unit and
+		// streams its output into the compiler on the worker thread through a bounded channel, so compiling starts
+		// before preprocessing is done.
+		//
+		// For a unit "dir/name.c" the outputs are "dir/name.i" (preprocessed source), "dir/name.tr" (preprocessor
+		// trace) and "dir/name.hasm" (assembly), on the same device as the source.
+		class TranslationUnitDriver final : public CoreObject
+		{
+		public:
+			struct TranslationUnit
+			{
+				TranslationUnit();
+
+				UTF8String_t m_device;
+				UTF8String_t m_path;
+
+				ErrorCode m_errorCode;
+				size_t m_workerIndex;
+
+				uint64_t m_preprocessTimeMicroseconds;
+				uint64_t m_compileTimeMicroseconds;
+				uint64_t m_totalTimeMicroseconds;
+
+				ParseRuleStats m_parseRuleStats[static_cast<size_t>(ParseRule::kCount)];
+			};
+
+			struct WorkerStats
+			{
+				WorkerStats();
+
+				size_t m_numTranslationUnits;
+				size_t m_numStolen;
+				uint64_t m_busyTimeMicroseconds;
+			};
+
+			// With binaryHAsm, HAsm is written in the binary encoding to .hasmb files instead of as text to .hasm
+			TranslationUnitDriver(IAllocator *alloc, SynchronousFileSystem *syncFS, AsyncFileSystem *asyncFS, FileCache *fileCache, PPConditionCache *conditionCache, bool binaryHAsm);
+			~TranslationUnitDriver();
+
+			Result AddTranslationUnit(const UTF8StringView_t &device, const UTF8StringView_t &path);
+
+			// Adds every unit listed in a manifest, one path per line relative to the manifest's device.
+			// Blank lines and lines starting with '#' are skipped.
+			Result AddManifest(const UTF8StringView_t &device, const UTF8StringView_t &path);
+
+			// Starts one worker per allocator and blocks until every unit has been processed.  Failing units don't
+			// stop the others, check each unit's error code afterwards.
+			Result Run(const ArrayView<IAllocator *const> &workerAllocators);
+
+			ArrayView<const TranslationUnit> GetTranslationUnits() const;
+			ArrayView<const WorkerStats> GetWorkerStats() const;
+			uint64_t GetWallTimeMicroseconds() const;
+
+		private:
+			struct PreprocessorJob;
+
+			struct Worker
+			{
+				Worker();
+				~Worker();
+
+				TranslationUnitDriver *m_driver;
+				IAllocator *m_alloc;
+				size_t m_workerIndex;
+				WorkStealingDeque<size_t> m_deque;
+				CorePtr<Thread> m_thread;
+
+				// The worker hands m_preprocessorJob over by setting the start event and waits on the done event.  A
+				// null job stops the preprocessor thread.
+				CorePtr<Thread> m_preprocessorThread;
+				CorePtr<ThreadEvent> m_preprocessorStartEvent;
+				CorePtr<ThreadEvent> m_preprocessorDoneEvent;
+				CorePtr<ThreadEvent> m_fileLoadEvent;
+				PreprocessorJob *m_preprocessorJob;
+			};
+
+			struct ErrorReporter;
+
+			// The parser recurses for every level of nesting in the source, see CCompiler::kMaxParseNestingDepth
+			static const size_t kCompileWorkerStackSize = 16 * 1024 * 1024;
+
+			static int StaticWorkerThreadFunc(void *userdata);
+			static int StaticPreprocessorThreadFunc(void *userdata);
+			int WorkerThreadFunc(Worker &worker);
+			int PreprocessorThreadFunc(Worker &worker);
+
+			bool TryGetWork(Worker &worker, size_t &outUnitIndex);
+
+			void RunTranslationUnit(Worker &worker, TranslationUnit &unit);
+			Result RunTranslationUnitChecked(Worker &worker, TranslationUnit &unit);
+
+			void RunPreprocessor(PreprocessorJob &job);
+			Result RunPreprocessorChecked(PreprocessorJob &job);
+
+			Result OpenOutput(const TranslationUnit &unit, const char *extension, CorePtr<BufferedFileStream> &outStream) const;
+
+			SynchronousFileSystem *m_syncFS;
+			AsyncFileSystem *m_asyncFS;
+			FileCache *m_fileCache;
+			PPConditionCache *m_conditionCache;
+			bool m_binaryHAsm;
+
+			CorePtr<Mutex> m_errorOutputMutex;
+
+			Vector<TranslationUnit> m_translationUnits;
+			ArrayPtr<Worker> m_workers;
+			ArrayPtr<WorkerStats> m_workerStats;
+
+			uint64_t m_wallTimeMicroseconds;
+		};
+	}
+}
@@ -8,7 +8,9 @@
 #include <cstring>
 #include <algorithm>
 
+#ifdef _MSC_VER
 #include "ms_xbit_ops.h"
+#endif
 #include "ms_xcharconv.h"
 #include "ms_xcharconv_ryu.h"
 
@@ -46,8 +48,7 @@ to_chars_result _Integer_to_chars(
 
     switch (_Base) {
     case 10:
-        { // Derived from _UIntegral_to_buff()
-            // Performance note: Ryu's digit table should be faster here.
+        { // Derived from _UIntegral_to_buff(), but two digits at a time from Ryu's digit table
             const bool _Use_chunks = sizeof(_Unsigned) > sizeof(size_t);
 
             if (_Use_chunks) { // For 64-bit numbers on 32-bit platforms, work in chunks to avoid 64-bit
@@ -57,10 +58,13 @@ to_chars_result _Integer_to_chars(
                     unsigned long _Chunk = static_cast<unsigned long>(_Value % 1000000000);
                     _Value               = static_cast<_Unsigned>(_Value / 1000000000);
 
-                    for (int _Idx = 0; _Idx != 9; ++_Idx) {
-                        *--_RNext = static_cast<char>('0' + _Chunk % 10);
-                        _Chunk /= 10;
+                    for (int _Idx = 0; _Idx != 4; ++_Idx) {
+                        _RNext -= 2;
+                        ::memcpy(_RNext, _Digit_table<char>::table + (_Chunk % 100) * 2, 2);
+                        _Chunk /= 100;
                     }
+
+                    *--_RNext = static_cast<char>('0' + _Chunk);
                 }
             }
 
@@ -68,10 +72,18 @@ to_chars_result _Integer_to_chars(
 
             _Truncated _Trunc = static_cast<_Truncated>(_Value);
 
-            do {
-                *--_RNext = static_cast<char>('0' + _Trunc % 10);
-                _Trunc /= 10;
-            } while (_Trunc != 0);
+            while (_Trunc >= 100) {
+                _RNext -= 2;
+                ::memcpy(_RNext, _Digit_table<char>::table + (_Trunc % 100) * 2, 2);
+                _Trunc /= 100;
+            }
+
+            if (_Trunc >= 10) {
+                _RNext -= 2;
+                ::memcpy(_RNext, _Digit_table<char>::table + _Trunc * 2, 2);
+            } else {
+                *--_RNext = static_cast<char>('0' + _Trunc);
+            }
             break;
         }
 
@@ -39,7 +39,9 @@
 #include <utility>
 #include "ms_xcharconv.h"
 #include "ms_xcharconv_ryu_tables.h"
+#ifdef _MSC_VER
 #include <xutility>
+#endif
 
 namespace msstl
 {
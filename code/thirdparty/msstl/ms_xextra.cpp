@@ -1,5 +1,7 @@
 #include "ms_xextra.h"
+#ifdef _MSC_VER
 #include <intrin.h>
+#endif
 
 namespace msstl
 {
@@ -23,8 +25,8 @@ namespace msstl
 
 		const uint8_t resultHigh = _BitScanReverse(&_Index, _Ui32);
 		if (resultHigh != 0) {
-			index = static_cast<uint32_t>(_Index);
-			return resultHigh + 32;
+			index = static_cast<uint32_t>(_Index) + 32;
+			return resultHigh;
 		}
 
 		_Ui32 = static_cast<uint32_t>(mask & 0xffffffffu);
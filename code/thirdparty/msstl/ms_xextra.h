@@ -12,7 +12,33 @@ constexpr _BITMASK operator&(_BITMASK _Left, _BITMASK _Right) noexcept \
 #define MSSTL_ASSERT(n, str)
 #define MSSTL_ASSERT_SINGLE(n)
 
+#include <climits>
 #include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+
+#ifndef _MSC_VER
+// Replacements for the MSVC intrinsics used by the charconv implementation
+#define __forceinline inline __attribute__((always_inline))
+#define _STD ::std::
+
+inline unsigned char _BitScanReverse(unsigned long *index, uint32_t mask)
+{
+	if (mask == 0)
+		return 0;
+	*index = 31u - static_cast<unsigned long>(__builtin_clz(mask));
+	return 1;
+}
+
+inline unsigned char _BitScanForward(unsigned long *index, uint32_t mask)
+{
+	if (mask == 0)
+		return 0;
+	*index = static_cast<unsigned long>(__builtin_ctz(mask));
+	return 1;
+}
+#endif
 
 namespace msstl
 {